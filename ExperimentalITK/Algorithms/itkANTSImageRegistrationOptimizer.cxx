@@ -846,6 +846,9 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
         }
       }
 
+    // merge the per-thread metric data (e.g. the energy) into the metric
+    df->ReleaseGlobalDataPointer( globalData );
+
     // begin restriction of deformation field
     bool restrict = false;
     for( unsigned int jj = 0; jj < this->m_RestrictDeformation.size();  jj++ )
@@ -1368,6 +1371,9 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
         }
       }
 
+    // merge the per-thread metric data (e.g. the energy) into the metric
+    df->ReleaseGlobalDataPointer( globalData );
+
     if( updateenergy )
       {
       this->m_LastEnergy[metricCount] = this->m_Energy[metricCount];
@@ -28,6 +28,7 @@
 #include "vnl/vnl_math.h"
 #include "itkDiscreteGaussianImageFilter.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
+#include "vnl/vnl_random.h"
 
 namespace itk
 {
@@ -87,6 +88,10 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
 
   this->m_RobustnessParameter = -1.e19;
 
+  this->m_SamplingStrategy = FullSampling;
+  this->m_SamplingPercentage = 1.0;
+  this->m_RandomSeed = 0;
+
 }
 
 /**
@@ -122,6 +127,12 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
   os << m_MovingImageBinSize << std::endl;
   os << indent << "InterpolatorIsBSpline: ";
   os << m_InterpolatorIsBSpline << std::endl;
+  os << indent << "SamplingStrategy: ";
+  os << m_SamplingStrategy << std::endl;
+  os << indent << "SamplingPercentage: ";
+  os << m_SamplingPercentage << std::endl;
+  os << indent << "RandomSeed: ";
+  os << m_RandomSeed << std::endl;
 
 }
 
@@ -346,77 +357,180 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
 }
 
 /**
- * Get the both Value and Derivative Measure
+ * Threader callback: bin one slab of the fixed image
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+ITK_THREAD_RETURN_TYPE
+AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::FillJointHistogramThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  FillJointHistogramThreadStruct *str = (FillJointHistogramThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const long numberOfPlanes = static_cast<long>( str->Function->m_FixedImage
+                                                 ->GetLargestPossibleRegion().GetSize()[ImageDimension - 1] );
+  const long begin = ( numberOfPlanes * threadId ) / threadCount;
+  const long end = ( numberOfPlanes * ( threadId + 1 ) ) / threadCount;
+  if( begin < end )
+    {
+    str->Function->ThreadedFillJointHistogram( begin, end, threadId,
+                                               (*str->Histograms)[threadId] );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/**
+ * Bin the sampled voxels of one slab into a flat joint histogram
  */
 template <class TFixedImage, class TMovingImage, class TDisplacementField>
 void
 AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
-::GetProbabilities()
+::ThreadedFillJointHistogram( long begin, long end, int, std::vector<double> & histogram )
 {
-  typedef ImageRegionConstIteratorWithIndex<FixedImageType> RandomIterator;
-  RandomIterator randIter( this->m_FixedImage, this->m_FixedImage->GetLargestPossibleRegion() );
-  this->m_FixedImageMarginalPDF->FillBuffer(0);
-  this->m_MovingImageMarginalPDF->FillBuffer(0);
+  const unsigned int lastDimension = ImageDimension - 1;
+  const long         numberOfBins = static_cast<long>( this->m_NumberOfHistogramBins );
+
+  histogram.assign( numberOfBins * numberOfBins, 0.0 );
 
-  // Reset the joint pdfs to zero
-  m_JointPDF->FillBuffer( 0.0 );
+  const JointPDFPointType   origin = this->m_JointPDF->GetOrigin();
+  const JointPDFSpacingType spacing = this->m_JointPDF->GetSpacing();
 
-  unsigned long  nSamples = 0;
-  RandomIterator iter( this->m_FixedImage, this->m_FixedImage->GetLargestPossibleRegion() );
-  for( iter.GoToBegin(); !iter.IsAtEnd(); ++iter )
+  unsigned long stratumSize = 1;
+  if( this->m_SamplingStrategy == StratifiedSampling )
     {
+    stratumSize = static_cast<unsigned long>(
+        vcl_floor( 1.0 / this->m_SamplingPercentage + 0.5 ) );
+    if( stratumSize < 1 )
+      {
+      stratumSize = 1;
+      }
+    }
 
-    bool takesample = true;
-    if( this->m_FixedImageMask )
+  const typename FixedImageType::RegionType largestRegion =
+    this->m_FixedImage->GetLargestPossibleRegion();
+
+  for( long plane = begin; plane < end; plane++ )
+    {
+    typename FixedImageType::IndexType planeIndex = largestRegion.GetIndex();
+    typename FixedImageType::SizeType  planeSize = largestRegion.GetSize();
+    planeIndex[lastDimension] += plane;
+    planeSize[lastDimension] = 1;
+
+    typename FixedImageType::RegionType region;
+    region.SetIndex( planeIndex );
+    region.SetSize( planeSize );
+
+    // The MersenneTwister generator of ITK is a shared singleton, so every
+    // hyperplane draws from its own generator, seeded from its position.
+    // The samples do not depend on the number of threads.
+    vnl_random generator( this->m_RandomSeed + static_cast<unsigned long>( plane ) );
+
+    unsigned long position = 0;
+    unsigned long selected = 0;
+
+    ImageRegionConstIteratorWithIndex<FixedImageType> fixedIt( this->m_FixedImage, region );
+    ImageRegionConstIterator<MovingImageType>         movingIt( this->m_MovingImage, region );
+    for( fixedIt.GoToBegin(), movingIt.GoToBegin(); !fixedIt.IsAtEnd(); ++fixedIt, ++movingIt, ++position )
       {
-      if( this->m_FixedImageMask->GetPixel( iter.GetIndex() ) < 1.e-6 )
+      if( this->m_SamplingStrategy == RandomSampling )
         {
-        takesample = false;
+        if( generator.drand64() >= this->m_SamplingPercentage )
+          {
+          continue;
+          }
+        }
+      else if( this->m_SamplingStrategy == StratifiedSampling )
+        {
+        // one voxel drawn from each run of stratumSize voxels
+        if( position % stratumSize == 0 )
+          {
+          selected = position + static_cast<unsigned long>(
+              generator.lrand32( 0, static_cast<int>( stratumSize - 1 ) ) );
+          }
+        if( position != selected )
+          {
+          continue;
+          }
         }
-      }
 
-    if( takesample )
-      {
+      if( this->m_FixedImageMask )
+        {
+        if( this->m_FixedImageMask->GetPixel( fixedIt.GetIndex() ) < 1.e-6 )
+          {
+          continue;
+          }
+        }
 
-      // Get sampled index
-      FixedImageIndexType index = iter.GetIndex();
-/*    bool inimage=true;
-    for (unsigned int dd=0; dd<ImageDimension; dd++)
-      {
-        if ( index[dd] < 1 ||    index[dd] >= static_cast<typename IndexType::IndexValueType>(imagesize[dd]-1) )
-          inimage=false;
-      }
-*/
-      double movingImageValue = this->GetMovingParzenTerm(  this->m_MovingImage->GetPixel( index )  );
-      double fixedImageValue = this->GetFixedParzenTerm(  this->m_FixedImage->GetPixel( index )  );
+      double movingImageValue = this->GetMovingParzenTerm( movingIt.Get() );
+      double fixedImageValue = this->GetFixedParzenTerm( fixedIt.Get() );
 
       /** add the paired intensity points to the joint histogram */
       JointPDFPointType jointPDFpoint;
       this->ComputeJointPDFPoint(fixedImageValue, movingImageValue, jointPDFpoint);
-      JointPDFIndexType jointPDFIndex;
-      jointPDFIndex.Fill(0);
-      this->m_JointPDF->TransformPhysicalPointToIndex(jointPDFpoint, jointPDFIndex);
-      this->m_JointPDF->SetPixel(jointPDFIndex, this->m_JointPDF->GetPixel(jointPDFIndex) + 1);
 
-      ++nSamples;
+      long bin[2];
+      for( unsigned int d = 0; d < 2; d++ )
+        {
+        bin[d] = static_cast<long>( vcl_floor( ( jointPDFpoint[d] - origin[d] ) / spacing[d] + 0.5 ) );
+        bin[d] = vnl_math_max( 0L, vnl_math_min( bin[d], numberOfBins - 1 ) );
+        }
+      histogram[bin[0] + numberOfBins * bin[1]] += 1.0;
       }
     }
+}
 
-  /**
-   * Normalize the PDFs, compute moving image marginal PDF
-   *
-   */
-  typedef ImageRegionIterator<JointPDFType> JointPDFIteratorType;
-  JointPDFIteratorType jointPDFIterator( m_JointPDF, m_JointPDF->GetBufferedRegion() );
+/**
+ * Get the both Value and Derivative Measure
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+void
+AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::GetProbabilities()
+{
+  const long numberOfBins = static_cast<long>( this->m_NumberOfHistogramBins );
+  const long numberOfPlanes = static_cast<long>(
+      this->m_FixedImage->GetLargestPossibleRegion().GetSize()[ImageDimension - 1] );
+
+  int numberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if( numberOfThreads > numberOfPlanes )
+    {
+    numberOfThreads = static_cast<int>( vnl_math_max( numberOfPlanes, 1L ) );
+    }
+
+  std::vector<std::vector<double> > histograms( numberOfThreads );
+
+  FillJointHistogramThreadStruct str;
+  str.Function = this;
+  str.Histograms = &histograms;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->FillJointHistogramThreaderCallback, &str );
+  threader->SingleMethodExecute();
+
+  // Sum the histograms of the threads
+  std::vector<double> jointHistogram( numberOfBins * numberOfBins, 0.0 );
+  for( int t = 0; t < numberOfThreads; t++ )
+    {
+    if( histograms[t].empty() )
+      {
+      continue;
+      }
+    for( unsigned long k = 0; k < jointHistogram.size(); k++ )
+      {
+      jointHistogram[k] += histograms[t][k];
+      }
+    }
 
   // Compute joint PDF normalization factor (to ensure joint PDF sum adds to 1.0)
   double jointPDFSum = 0.0;
-  jointPDFIterator.GoToBegin();
-  while( !jointPDFIterator.IsAtEnd() )
+  for( unsigned long k = 0; k < jointHistogram.size(); k++ )
     {
-    float temp = jointPDFIterator.Get();
-    jointPDFSum += temp;
-    ++jointPDFIterator;
+    jointPDFSum += jointHistogram[k];
     }
 
 // of derivatives
@@ -426,11 +540,10 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
     }
 
   // Normalize the PDF bins
-  jointPDFIterator.GoToEnd();
-  while( !jointPDFIterator.IsAtBegin() )
+  PDFValueType *pdfPtr = m_JointPDF->GetBufferPointer();
+  for( unsigned long k = 0; k < jointHistogram.size(); k++ )
     {
-    --jointPDFIterator;
-    jointPDFIterator.Value() /= static_cast<PDFValueType>( jointPDFSum );
+    pdfPtr[k] = static_cast<PDFValueType>( jointHistogram[k] / jointPDFSum );
     }
 
   bool smoothjh = true;
@@ -446,48 +559,95 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
     this->m_JointPDF = dg->GetOutput();
     }
 
-  // Compute moving image marginal PDF by summing over fixed image bins.
-  typedef ImageLinearIteratorWithIndex<JointPDFType> JointPDFLinearIterator;
-  JointPDFLinearIterator linearIter(
-    m_JointPDF, m_JointPDF->GetBufferedRegion() );
-  linearIter.SetDirection( 0 );
-  linearIter.GoToBegin();
-  unsigned int fixedIndex = 0;
-  while( !linearIter.IsAtEnd() )
+  /**
+   * Compute the marginal PDFs by summing the lines of the joint PDF along
+   * each direction and, in the same sweep, the differences between
+   * neighbouring bins used for the joint PDF derivatives.
+   */
+  const PDFValueType       *pdf = m_JointPDF->GetBufferPointer();
+  const JointPDFSpacingType spacing = m_JointPDF->GetSpacing();
+
+  std::vector<double> fixedMarginal( numberOfBins, 0.0 );
+  std::vector<double> movingMarginal( numberOfBins, 0.0 );
+  this->m_JointPDFDerivativeTables[0].assign( ( numberOfBins - 1 ) * numberOfBins, 0.0 );
+  this->m_JointPDFDerivativeTables[1].assign( numberOfBins * ( numberOfBins - 1 ), 0.0 );
+  for( long j = 0; j < numberOfBins; j++ )
     {
-    double sum = 0.0;
-    while( !linearIter.IsAtEndOfLine() )
+    for( long i = 0; i < numberOfBins; i++ )
       {
-      sum += linearIter.Get();
-      ++linearIter;
+      const double value = pdf[i + numberOfBins * j];
+      fixedMarginal[j] += value;
+      movingMarginal[i] += value;
+      if( i + 1 < numberOfBins )
+        {
+        this->m_JointPDFDerivativeTables[0][i + ( numberOfBins - 1 ) * j] =
+          ( pdf[i + 1 + numberOfBins * j] - value ) / spacing[0];
+        }
+      if( j + 1 < numberOfBins )
+        {
+        this->m_JointPDFDerivativeTables[1][i + numberOfBins * j] =
+          ( pdf[i + numberOfBins * ( j + 1 )] - value ) / spacing[1];
+        }
       }
+    }
 
+  // the lines along direction 0 give the fixed marginal, those along
+  // direction 1 the moving marginal
+  for( long n = 0; n < numberOfBins; n++ )
+    {
     MarginalPDFIndexType mind;
-    mind[0] = fixedIndex;
-    m_FixedImageMarginalPDF->SetPixel(mind, static_cast<PDFValueType>(sum) );
-    linearIter.NextLine();
-    ++fixedIndex;
+    mind[0] = n;
+    m_FixedImageMarginalPDF->SetPixel(mind, static_cast<PDFValueType>( fixedMarginal[n] ) );
+    m_MovingImageMarginalPDF->SetPixel(mind, static_cast<PDFValueType>( movingMarginal[n] ) );
     }
 
-  linearIter.SetDirection( 1 );
-  linearIter.GoToBegin();
-  unsigned int movingIndex = 0;
-  while( !linearIter.IsAtEnd() )
+}
+
+/**
+ * Centred difference of the joint PDF along one axis
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+double
+AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::EvaluateJointPDFDerivative( const JointPDFPointType & jointPDFpoint, unsigned int ind )
+{
+  const unsigned int other = 1 - ind;
+  const double       h = this->m_JointPDFSpacing[ind];
+
+  // ComputeJointPDFDerivative clamps the two points to [h, 1]; only the
+  // unclamped case is read from the tables.
+  if( this->m_JointPDFDerivativeTables[ind].empty() ||
+      jointPDFpoint[ind] - 0.5 * h < h || jointPDFpoint[ind] + 0.5 * h > 1 ||
+      jointPDFpoint[other] < 0 || jointPDFpoint[other] > 1 )
     {
-    double sum = 0.0;
-    while( !linearIter.IsAtEndOfLine() )
-      {
-      sum += linearIter.Get();
-      ++linearIter;
-      }
+    return this->ComputeJointPDFDerivative( jointPDFpoint, 0, ind );
+    }
 
-    MarginalPDFIndexType mind;
-    mind[0] = movingIndex;
-    m_MovingImageMarginalPDF->SetPixel(mind, static_cast<PDFValueType>(sum) );
-    linearIter.NextLine();
-    ++movingIndex;
+  const long              numberOfBins = static_cast<long>( this->m_NumberOfHistogramBins );
+  const JointPDFPointType origin = this->m_JointPDF->GetOrigin();
+
+  // the table along ind is staggered by half a bin and has one entry less
+  long   size[2];
+  double cindex[2];
+  size[ind] = numberOfBins - 1;
+  size[other] = numberOfBins;
+  cindex[ind] = ( jointPDFpoint[ind] - origin[ind] ) / h - 0.5;
+  cindex[other] = ( jointPDFpoint[other] - origin[other] ) / this->m_JointPDFSpacing[other];
+
+  long   base[2];
+  double t[2];
+  for( unsigned int d = 0; d < 2; d++ )
+    {
+    base[d] = static_cast<long>( vcl_floor( cindex[d] ) );
+    base[d] = vnl_math_max( 0L, vnl_math_min( base[d], size[d] - 2 ) );
+    t[d] = cindex[d] - static_cast<double>( base[d] );
     }
 
+  const double *table = &( this->m_JointPDFDerivativeTables[ind][0] ) + base[0] + size[0] * base[1];
+  return ( 1.0 - t[0] ) * ( 1.0 - t[1] ) * table[0]
+         + t[0] * ( 1.0 - t[1] ) * table[1]
+         + ( 1.0 - t[0] ) * t[1] * table[size[0]]
+         + t[0] * t[1] * table[size[0] + 1];
 }
 
 /**
@@ -513,7 +673,7 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
   JointPDFPointType pdfind;
   this->ComputeJointPDFPoint(fixedImageValue, movingImageValue, pdfind);
   jointPDFValue = pdfinterpolator->Evaluate(pdfind);
-  dJPDF = this->ComputeJointPDFDerivative( pdfind, 0, 0 );
+  dJPDF = this->EvaluateJointPDFDerivative( pdfind, 0 );
 
   typename   pdfintType2::ContinuousIndexType  mind;
   mind[0] = pdfind[0];
@@ -555,7 +715,7 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
   JointPDFPointType pdfind;
   this->ComputeJointPDFPoint(fixedImageValue, movingImageValue, pdfind);
   jointPDFValue = pdfinterpolator->Evaluate(pdfind);
-  dJPDF = this->ComputeJointPDFDerivative( pdfind, 0, 1 );
+  dJPDF = this->EvaluateJointPDFDerivative( pdfind, 1 );
 
   typename   pdfintType2::ContinuousIndexType  mind;
   mind[0] = pdfind[1];
@@ -39,6 +39,9 @@
 #include "itkGradientRecursiveGaussianImageFilter.h"
 #include "itkSpatialObject.h"
 #include "itkConstNeighborhoodIterator.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -82,10 +85,16 @@ namespace itk
  * smoothness a third order BSpline kernel is used for the
  * moving image intensity PDF.
  *
- * On Initialize(), the FixedImage is uniformly sampled within
- * the FixedImageRegion. The number of samples used can be set
- * via SetNumberOfSpatialSamples(). Typically, the number of
- * spatial samples used should increase with the image size.
+ * On InitializeIteration(), the joint histogram is filled from the fixed
+ * image voxels, split into slabs across threads, each thread binning into
+ * its own flat histogram; the histograms are summed at the end.  By
+ * default every voxel is binned.  With SetSamplingStrategy() only a
+ * fraction, given by SetSamplingPercentage(), is binned: either each
+ * voxel is drawn independently (RandomSampling) or one voxel is drawn
+ * from each run of consecutive voxels of a hyperplane
+ * (StratifiedSampling).  Every hyperplane of the last dimension has its
+ * own generator, seeded from the random seed and its position, so the
+ * samples drawn only depend on the random seed.
  *
  * During each call of GetValue(), GetDerivatives(),
  * GetValueAndDerivatives(), marginal and joint intensity PDF's
@@ -643,6 +652,38 @@ public:
     m_OpticalFlow = b;
   }
 
+  /** Strategy used to select the voxels binned into the joint histogram. */
+  typedef enum { FullSampling, RandomSampling, StratifiedSampling } SamplingStrategyType;
+
+  void SetSamplingStrategy( SamplingStrategyType s )
+  {
+    m_SamplingStrategy = s;
+  }
+  SamplingStrategyType GetSamplingStrategy() const
+  {
+    return m_SamplingStrategy;
+  }
+
+  /** Fraction, in (0, 1], of the voxels binned by the random and stratified
+   * sampling strategies. */
+  void SetSamplingPercentage( double p )
+  {
+    m_SamplingPercentage = vnl_math_max( vnl_math_min( p, 1.0 ), 1.e-6 );
+  }
+  double GetSamplingPercentage() const
+  {
+    return m_SamplingPercentage;
+  }
+
+  void SetRandomSeed( unsigned int seed )
+  {
+    m_RandomSeed = seed;
+  }
+  unsigned int GetRandomSeed() const
+  {
+    return m_RandomSeed;
+  }
+
   typename JointPDFType::Pointer GetJointPDF()
   {
     return m_JointPDF;
@@ -693,6 +734,24 @@ protected:
   };
   void PrintSelf(std::ostream& os, Indent indent) const;
 
+  /** Bin the sampled voxels of the hyperplanes [begin, end) of the last
+   * dimension into the flat joint histogram, fixed bin fastest. */
+  void ThreadedFillJointHistogram( long begin, long end, int threadId,
+                                   std::vector<double> & histogram );
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE FillJointHistogramThreaderCallback( void *arg );
+
+  struct FillJointHistogramThreadStruct
+    {
+    Self                               *Function;
+    std::vector<std::vector<double> >  *Histograms;
+    };
+
+  /** Same as ComputeJointPDFDerivative, read from the derivative tables
+   * when none of the two evaluation points is clamped. */
+  double EvaluateJointPDFDerivative( const JointPDFPointType & jointPDFpoint, unsigned int ind );
+
 private:
 
   AvantsMutualInformationRegistrationFunction(const Self &); // purposely not implemented
@@ -700,6 +759,18 @@ private:
 
   typename JointPDFDerivativesType::Pointer m_JointPDFDerivatives;
 
+  /**
+   * Finite differences of the joint PDF between neighbouring bins along the
+   * fixed (index 0) and moving (index 1) axis, divided by the bin spacing.
+   * The centred differences of ComputeJointPDFDerivative are the bilinear
+   * interpolation of these staggered tables.
+   */
+  std::vector<double> m_JointPDFDerivativeTables[2];
+
+  SamplingStrategyType m_SamplingStrategy;
+  double               m_SamplingPercentage;
+  unsigned int         m_RandomSeed;
+
   /** Typedefs for BSpline kernel and derivative functions. */
   typedef BSplineKernelFunction<3> CubicBSplineFunctionType;
   typedef BSplineDerivativeKernelFunction<3>
@@ -22,14 +22,13 @@
 #include "itkExceptionObject.h"
 #include "vnl/vnl_math.h"
 #include "itkImageFileWriter.h"
-#include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
 #include "itkDiscreteGaussianImageFilter.h"
 #include "itkMeanImageFilter.h"
 #include "itkMedianImageFilter.h"
 #include "itkImageFileWriter.h"
 
-#include <deque>
-
 namespace itk
 {
 
@@ -42,6 +41,7 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
 {
   m_AvgMag = 0;
   m_Iteration = 0;
+  m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
   RadiusType   r;
   unsigned int j;
   for( j = 0; j < ImageDimension; j++ )
@@ -68,10 +68,7 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
 
   m_MovingImageInterpolator = static_cast<InterpolatorType *>(
       interp.GetPointer() );
-  for( int i = 0; i < 5; i++ )
-    {
-    finitediffimages[i] = NULL;
-    }
+  m_LocalCorrelationImage = NULL;
 
   m_NumberOfHistogramBins = 32;
 
@@ -90,6 +87,7 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
 {
 
   Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
 /*
   os << indent << "MovingImageIterpolator: ";
   os << m_MovingImageInterpolator.GetPointer() << std::endl;
@@ -151,11 +149,7 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
 
 
   bool makeimg = false;
-  if( m_Iteration == 0 )
-    {
-    makeimg = true;
-    }
-  else if( !finitediffimages[0] )
+  if( !m_LocalCorrelationImage )
     {
     makeimg = true;
     }
@@ -163,7 +157,7 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
     {
     for( unsigned int dd = 0; dd < ImageDimension; dd++ )
       {
-      if( finitediffimages[0]->GetLargestPossibleRegion().GetSize()[dd] !=
+      if( m_LocalCorrelationImage->GetLargestPossibleRegion().GetSize()[dd] !=
           this->GetFixedImage()->GetLargestPossibleRegion().GetSize()[dd] )
         {
         makeimg = true;
@@ -173,229 +167,307 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
 
   if( makeimg )
     {
-    finitediffimages[0] = this->MakeImage();
-    finitediffimages[1] = this->MakeImage();
-    finitediffimages[2] = this->MakeImage();
-    finitediffimages[3] = this->MakeImage();
-    finitediffimages[4] = this->MakeImage();
+    FixedImageType* img = const_cast<FixedImageType *>(Superclass::m_FixedImage.GetPointer() );
+    m_LocalCorrelationImage = LocalCorrelationImageType::New();
+    m_LocalCorrelationImage->SetRegions( img->GetLargestPossibleRegion() );
+    m_LocalCorrelationImage->SetSpacing( img->GetSpacing() );
+    m_LocalCorrelationImage->SetOrigin( img->GetOrigin() );
+    m_LocalCorrelationImage->SetDirection( img->GetDirection() );
+    m_LocalCorrelationImage->Allocate();
     }
 
-  // float sig=15.;
-
-  RadiusType r;
-  for( int j = 0; j < ImageDimension; j++ )
+  //
+  // The windowed sums are box sums, separable in the image dimensions.  The
+  // in-plane sums of each hyperplane of the last dimension are running sums
+  // along each in-plane dimension, and the window along the last dimension
+  // is a running sum of those hyperplanes.  The hyperplanes are split into
+  // slabs, one per thread.
+  //
+  const long numberOfPlanes = static_cast<long>(
+      m_LocalCorrelationImage->GetLargestPossibleRegion().GetSize()[ImageDimension - 1] );
+  int numberOfThreads = this->GetNumberOfThreads();
+  if( numberOfThreads > numberOfPlanes )
     {
-    r[j] = this->GetRadius()[j];
+    numberOfThreads = static_cast<int>( vnl_math_max( numberOfPlanes, 1L ) );
     }
 
-  typedef itk::ImageRegionIteratorWithIndex<TFixedImage> Iterator;
-  Iterator tIter(this->GetFixedImage(), this->GetFixedImage()->GetLargestPossibleRegion() );
+  LocalCorrelationThreadStruct str;
+  str.Function = this;
 
-  // compute local means
-  //  typedef itk::ImageRegionIteratorWithIndex<MetricImageType> Iterator;
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->LocalCorrelationThreaderCallback, &str );
+  threader->SingleMethodExecute();
 
-  //
-  // The following change was made to speed up the correlation calculation.
-  //
+  m_MaxMag = 0.0;
+  m_MinMag = 9.e9;
+  m_AvgMag = 0.0;
+  m_Iteration++;
 
-  typedef std::deque<float> SumQueueType;
+}
+/*
+ * Threader callback: fill the local correlation image on one slab of
+ * hyperplanes
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+ITK_THREAD_RETURN_TYPE
+CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::LocalCorrelationThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
 
-  SumQueueType Qsuma2;
-  SumQueueType Qsumb2;
-  SumQueueType Qsuma;
-  SumQueueType Qsumb;
-  SumQueueType Qsumab;
-  SumQueueType Qcount;
+  LocalCorrelationThreadStruct *str = (LocalCorrelationThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
 
-  ImageLinearConstIteratorWithIndex<MetricImageType> outIter( this->finitediffimages[0],
-                                                              this->finitediffimages[0]->GetLargestPossibleRegion() );
-  outIter.SetDirection( 0 );
-  outIter.GoToBegin();
-  while( !outIter.IsAtEnd() )
+  const long numberOfPlanes = static_cast<long>( str->Function->m_LocalCorrelationImage
+                                                 ->GetLargestPossibleRegion().GetSize()[ImageDimension - 1] );
+  const long begin = ( numberOfPlanes * threadId ) / threadCount;
+  const long end = ( numberOfPlanes * ( threadId + 1 ) ) / threadCount;
+  if( begin < end )
     {
-    // Push the zeros onto the stack that are outsized the image boundary at
-    // the beginning of the line.
-    Qsuma2 = SumQueueType( r[0], 0.0 );
-    Qsumb2 = SumQueueType( r[0], 0.0 );
-    Qsuma = SumQueueType( r[0], 0.0 );
-    Qsumb = SumQueueType( r[0], 0.0 );
-    Qsumab = SumQueueType( r[0], 0.0 );
-    Qcount = SumQueueType( r[0], 0.0 );
-
-    NeighborhoodIterator<MetricImageType> hoodIt(
-      this->GetRadius(),
-      this->finitediffimages[0],
-      this->finitediffimages[0]->GetLargestPossibleRegion() );
-    IndexType oindex = outIter.GetIndex();
-    hoodIt.SetLocation( oindex );
-    unsigned int hoodlen = hoodIt.Size();
-
-    // Now add the rest of the values from each hyperplane
-    for( unsigned int i = r[0]; i < ( 2 * r[0] + 1 ); i++ )
-      {
-      float suma2 = 0.0;
-      float sumb2 = 0.0;
-      float suma = 0.0;
-      float sumb = 0.0;
-      float sumab = 0.0;
-      float count = 0.0;
-      for( unsigned int indct = i; indct < hoodlen; indct += ( 2 * r[0] + 1 ) )
-        {
-        bool isInBounds = true;
-        hoodIt.GetPixel( indct, isInBounds );
-        IndexType index = hoodIt.GetIndex( indct );
+    str->Function->ThreadedComputeLocalCorrelation( begin, end );
+    }
 
-        if( !isInBounds || ( this->m_FixedImageMask &&
-                             this->m_FixedImageMask->GetPixel( index ) < 0.25 ) )
-          {
-          continue;
-          }
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-        float a = this->GetFixedImage()->GetPixel( index );
-        float b = this->GetMovingImage()->GetPixel( index );
+/*
+ * Windowed in-plane sums of one hyperplane of the last dimension
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+void
+CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::ComputeHyperplaneSums( long plane, std::vector<double> & sums, std::vector<double> & line ) const
+{
+  const unsigned int lastDimension = ImageDimension - 1;
+
+  typename FixedImageType::RegionType region = Superclass::m_FixedImage->GetLargestPossibleRegion();
+  typename FixedImageType::IndexType  planeIndex = region.GetIndex();
+  typename FixedImageType::SizeType   planeSize = region.GetSize();
+  planeIndex[lastDimension] += plane;
+  planeSize[lastDimension] = 1;
+  region.SetIndex( planeIndex );
+  region.SetSize( planeSize );
+
+  ImageRegionConstIterator<FixedImageType>  fixedIt( Superclass::m_FixedImage, region );
+  ImageRegionConstIterator<MovingImageType> movingIt( Superclass::m_MovingImage, region );
+  ImageRegionConstIterator<MetricImageType> maskIt;
+  if( this->m_FixedImageMask )
+    {
+    maskIt = ImageRegionConstIterator<MetricImageType>( this->m_FixedImageMask, region );
+    maskIt.GoToBegin();
+    }
 
-        suma2 += a * a;
-        sumb2 += b * b;
-        suma += a;
-        sumb += b;
-        sumab += a * b;
-        count += 1.0;
+  // voxels outside the mask do not contribute to the sums
+  double *sum = &sums[0];
+  for( fixedIt.GoToBegin(), movingIt.GoToBegin(); !fixedIt.IsAtEnd(); ++fixedIt, ++movingIt, sum += 6 )
+    {
+    bool inside = true;
+    if( this->m_FixedImageMask )
+      {
+      inside = ( maskIt.Get() >= 0.25 );
+      ++maskIt;
+      }
+    if( !inside )
+      {
+      for( unsigned int c = 0; c < 6; c++ )
+        {
+        sum[c] = 0.0;
         }
+      continue;
+      }
+    double a = fixedIt.Get();
+    double b = movingIt.Get();
+    sum[0] = a;
+    sum[1] = b;
+    sum[2] = a * a;
+    sum[3] = b * b;
+    sum[4] = a * b;
+    sum[5] = 1.0;
+    }
 
-      Qsuma2.push_back( suma2 );
-      Qsumb2.push_back( sumb2 );
-      Qsuma.push_back( suma );
-      Qsumb.push_back( sumb );
-      Qsumab.push_back( sumab );
-      Qcount.push_back( count );
+  // running sums along each in-plane dimension, clipped at the border
+  const unsigned long numberOfPixels = region.GetNumberOfPixels();
+  unsigned long       stride = 1;
+  for( unsigned int d = 0; d < lastDimension; d++ )
+    {
+    const long length = static_cast<long>( region.GetSize()[d] );
+    const long radius = static_cast<long>( this->GetRadius()[d] );
+    if( line.size() < static_cast<unsigned long>( 6 * length ) )
+      {
+      line.resize( 6 * length );
       }
 
-    while( !outIter.IsAtEndOfLine() )
+    const unsigned long numberOfLines = numberOfPixels / length;
+    for( unsigned long l = 0; l < numberOfLines; l++ )
       {
-      // Test to see if there are any voxels we need to handle in the current
-      // window.
-
-      float suma2 = 0.0;
-      float sumb2 = 0.0;
-      float suma = 0.0;
-      float sumb = 0.0;
-      float sumab = 0.0;
-      float count = 0.0;
-
-      typename SumQueueType::iterator itcount = Qcount.begin();
-      while( itcount != Qcount.end() )
+      double *first = &sums[0] + 6 * ( ( l / stride ) * stride * length + l % stride );
+      for( long k = 0; k < length; k++ )
         {
-        count += *itcount;
-        ++itcount;
+        for( unsigned int c = 0; c < 6; c++ )
+          {
+          line[6 * k + c] = first[6 * k * stride + c];
+          }
         }
 
-      // If there are values, we need to calculate the different quantities
-      if( count > 0 )
+      double window[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+      for( long k = 0; k <= radius && k < length; k++ )
         {
-
-        typename SumQueueType::iterator ita2 = Qsuma2.begin();
-        typename SumQueueType::iterator itb2 = Qsumb2.begin();
-        typename SumQueueType::iterator ita = Qsuma.begin();
-        typename SumQueueType::iterator itb = Qsumb.begin();
-        typename SumQueueType::iterator itab = Qsumab.begin();
-
-        while( ita2 != Qsuma2.end() )
+        for( unsigned int c = 0; c < 6; c++ )
+          {
+          window[c] += line[6 * k + c];
+          }
+        }
+      for( long k = 0; k < length; k++ )
+        {
+        for( unsigned int c = 0; c < 6; c++ )
+          {
+          first[6 * k * stride + c] = window[c];
+          }
+        if( k + radius + 1 < length )
           {
-          suma2 += *ita2;
-          sumb2 += *itb2;
-          suma += *ita;
-          sumb += *itb;
-          sumab += *itab;
-
-          ++ita2;
-          ++itb2;
-          ++ita;
-          ++itb;
-          ++itab;
+          for( unsigned int c = 0; c < 6; c++ )
+            {
+            window[c] += line[6 * ( k + radius + 1 ) + c];
+            }
           }
+        if( k - radius >= 0 )
+          {
+          for( unsigned int c = 0; c < 6; c++ )
+            {
+            window[c] -= line[6 * ( k - radius ) + c];
+            }
+          }
+        }
+      }
+    stride *= length;
+    }
+}
 
-        float fixedMean = suma / count;
-        float movingMean = sumb / count;
+/*
+ * Compute the gradient coefficients and the local correlation on the
+ * hyperplanes [begin, end) of the last dimension
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+void
+CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::ThreadedComputeLocalCorrelation( long begin, long end )
+{
+  const unsigned int lastDimension = ImageDimension - 1;
 
-        float sff = suma2 - fixedMean * suma - fixedMean * suma + count * fixedMean * fixedMean;
-        float smm = sumb2 - movingMean * sumb - movingMean * sumb + count * movingMean * movingMean;
-        float sfm = sumab - movingMean * suma - fixedMean * sumb + count * movingMean * fixedMean;
+  const typename FixedImageType::RegionType largestRegion =
+    Superclass::m_FixedImage->GetLargestPossibleRegion();
+  const long          numberOfPlanes = static_cast<long>( largestRegion.GetSize()[lastDimension] );
+  const long          radius = static_cast<long>( this->GetRadius()[lastDimension] );
+  const unsigned long numberOfPlanePixels = largestRegion.GetNumberOfPixels() / numberOfPlanes;
 
-        IndexType _oindex = outIter.GetIndex();
+  // Relative tolerance below which a variance is considered zero.
+  const double varianceTolerance = 1e-9;
 
-        float val = this->GetFixedImage()->GetPixel( _oindex ) - fixedMean;
-        this->finitediffimages[0]->SetPixel( _oindex, val );
-        val = this->GetMovingImage()->GetPixel( _oindex ) - movingMean;
-        this->finitediffimages[1]->SetPixel( _oindex, val );
-        this->finitediffimages[2]->SetPixel( _oindex, sfm ); // A
-        this->finitediffimages[3]->SetPixel( _oindex, sff ); // B
-        this->finitediffimages[4]->SetPixel( _oindex, smm ); // C
-        }
+  // The sums of the last 2 * radius + 1 hyperplanes are kept so that the
+  // plane leaving the window is subtracted without being recomputed.
+  const long ringSize = 2 * radius + 1;
 
-      // Increment the iterator and check to see if we're at the end of the
-      // line.  If so, go to the next line.  Otherwise, add the
-      // the values for the next hyperplane.
-      ++outIter;
+  std::vector<double>                window( 6 * numberOfPlanePixels, 0.0 );
+  std::vector<std::vector<double> >  ring( ringSize, std::vector<double>( 6 * numberOfPlanePixels ) );
+  std::vector<double>                line;
 
-      if( !outIter.IsAtEndOfLine() )
+  for( long z = vnl_math_max( 0L, begin - radius ); z <= begin + radius && z < numberOfPlanes; z++ )
+    {
+    std::vector<double> & sums = ring[z % ringSize];
+    this->ComputeHyperplaneSums( z, sums, line );
+    for( unsigned long n = 0; n < sums.size(); n++ )
+      {
+      window[n] += sums[n];
+      }
+    }
+
+  for( long z = begin; z < end; z++ )
+    {
+    typename FixedImageType::IndexType planeIndex = largestRegion.GetIndex();
+    typename FixedImageType::SizeType  planeSize = largestRegion.GetSize();
+    planeIndex[lastDimension] += z;
+    planeSize[lastDimension] = 1;
+    typename FixedImageType::RegionType region( planeIndex, planeSize );
+
+    ImageRegionConstIterator<FixedImageType>       fixedIt( Superclass::m_FixedImage, region );
+    ImageRegionConstIterator<MovingImageType>      movingIt( Superclass::m_MovingImage, region );
+    ImageRegionIterator<LocalCorrelationImageType> outIt( m_LocalCorrelationImage, region );
+    ImageRegionConstIterator<MetricImageType>      maskIt;
+    if( this->m_FixedImageMask )
+      {
+      maskIt = ImageRegionConstIterator<MetricImageType>( this->m_FixedImageMask, region );
+      maskIt.GoToBegin();
+      }
+
+    const double *w = &window[0];
+    for( fixedIt.GoToBegin(), movingIt.GoToBegin(), outIt.GoToBegin(); !outIt.IsAtEnd();
+         ++fixedIt, ++movingIt, ++outIt, w += 6 )
+      {
+      LocalCorrelationPixelType coefficients;
+      coefficients.Fill( 0.0 );
+
+      bool inside = true;
+      if( this->m_FixedImageMask )
         {
-        hoodIt.SetLocation( outIter.GetIndex() );
-
-        suma2 = 0.0;
-        sumb2 = 0.0;
-        suma = 0.0;
-        sumb = 0.0;
-        sumab = 0.0;
-        count = 0.0;
-        for( unsigned int indct = 2 * r[0]; indct < hoodlen; indct += ( 2 * r[0] + 1 ) )
-          {
-          bool isInBounds = true;
-          hoodIt.GetPixel( indct, isInBounds );
-          IndexType index = hoodIt.GetIndex( indct );
+        inside = ( maskIt.Get() >= 0.25 );
+        ++maskIt;
+        }
 
-          if( !isInBounds || ( this->m_FixedImageMask &&
-                               this->m_FixedImageMask->GetPixel( index ) < 0.25 ) )
+      const double count = w[5];
+      if( inside && count > 0 )
+        {
+        double sff = w[2] - w[0] * w[0] / count;
+        double smm = w[3] - w[1] * w[1] / count;
+        double sfm = w[4] - w[0] * w[1] / count;
+        if( sff <= varianceTolerance * w[2] )
+          {
+          sff = 0.0;
+          }
+        if( smm <= varianceTolerance * w[3] )
+          {
+          smm = 0.0;
+          }
+        if( sff != 0.0 && smm != 0.0 )
+          {
+          double Ii = fixedIt.Get() - w[0] / count;
+          double Ji = movingIt.Get() - w[1] / count;
+          double factor = 2.0 * sfm / ( sff * smm );
+          coefficients[0] = factor * ( Ji - sfm / sff * Ii );
+          coefficients[1] = factor * ( Ii - sfm / smm * Ji );
+          if( sff * smm > 1.e-5 )
             {
-            continue;
+            coefficients[2] = sfm * sfm / ( sff * smm );
             }
-
-          float a = this->GetFixedImage()->GetPixel( index );
-          float b = this->GetMovingImage()->GetPixel( index );
-
-          suma2 += a * a;
-          sumb2 += b * b;
-          suma += a;
-          sumb += b;
-          sumab += a * b;
-          count += 1.0;
           }
-
-        Qsuma2.push_back( suma2 );
-        Qsumb2.push_back( sumb2 );
-        Qsuma.push_back( suma );
-        Qsumb.push_back( sumb );
-        Qsumab.push_back( sumab );
-        Qcount.push_back( count );
         }
-
-      Qsuma2.pop_front();
-      Qsumb2.pop_front();
-      Qsuma.pop_front();
-      Qsumb.pop_front();
-      Qsumab.pop_front();
-      Qcount.pop_front();
+      outIt.Set( coefficients );
       }
 
-    outIter.NextLine();
+    // the leaving plane z - radius and the entering plane z + radius + 1
+    // share a slot of the ring, so the former is subtracted first
+    if( z + 1 < end )
+      {
+      if( z - radius >= 0 )
+        {
+        const std::vector<double> & sums = ring[( z - radius ) % ringSize];
+        for( unsigned long n = 0; n < sums.size(); n++ )
+          {
+          window[n] -= sums[n];
+          }
+        }
+      if( z + radius + 1 < numberOfPlanes )
+        {
+        std::vector<double> & sums = ring[( z + radius + 1 ) % ringSize];
+        this->ComputeHyperplaneSums( z + radius + 1, sums, line );
+        for( unsigned long n = 0; n < sums.size(); n++ )
+          {
+          window[n] += sums[n];
+          }
+        }
+      }
     }
-
-  // m_FixedImageGradientCalculator->SetInputImage(finitediffimages[0]);
-
-  m_MaxMag = 0.0;
-  m_MinMag = 9.e9;
-  m_AvgMag = 0.0;
-  m_Iteration++;
-
 }
 
 /*
@@ -409,59 +481,20 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
 
   typename TDisplacementField::PixelType deriv;
   deriv.Fill(0.0);
-  double sff = 0.0;
-  double smm = 0.0;
-  double sfm = 0.0;
-//  double fixedValue;
-//  double movingValue;
-  sff = 0.0;
-  smm = 0.0;
-  sfm = 0.0;
-  PointType           mappedPoint;
-  CovariantVectorType gradI, gradJ;
-  if( this->m_FixedImageMask )
-    {
-    if( this->m_FixedImageMask->GetPixel( oindex ) < 0.25 )
-      {
-      return deriv;
-      }
-    }
 
-  sfm = finitediffimages[2]->GetPixel(oindex);
-  sff = finitediffimages[3]->GetPixel(oindex);
-  smm = finitediffimages[4]->GetPixel(oindex);
-  if( sff == 0.0 || smm == 0.0 )
+  double coefficient = m_LocalCorrelationImage->GetPixel(oindex)[0];
+  if( coefficient == 0.0 )
     {
     return deriv;
     }
 
-  this->localCrossCorrelation = 0;
-  if( sff * smm > 1.e-5 )
-    {
-    this->localCrossCorrelation = sfm * sfm / ( sff * smm );
-    }
-  IndexType index = oindex;  // hoodIt.GetIndex(indct);
-  gradI = m_FixedImageGradientCalculator->EvaluateAtIndex( index );
-  //    gradJ = m_MovingImageGradientCalculator->EvaluateAtIndex( index );
-
-  float Ji = finitediffimages[1]->GetPixel(index);
-  float Ii = finitediffimages[0]->GetPixel(index);
-
-  m_TEMP = 2.0 * sfm / (sff * smm) * ( Ji - sfm / sff * Ii );
+  CovariantVectorType gradI = m_FixedImageGradientCalculator->EvaluateAtIndex( oindex );
   for( int qq = 0; qq < ImageDimension; qq++ )
     {
-    deriv[qq]   -= 2.0 * sfm / (sff * smm) * ( Ji - sfm / sff * Ii ) * gradI[qq];
-    //        derivinv[qq]-=2.0*sfm/(sff*smm)*( Ii - sfm/smm*Ji )*gradJ[qq];
+    deriv[qq] -= coefficient * gradI[qq];
     }
 
-  //  if ( this->localCrossCorrelation*(-1.0) < this->m_RobustnessParameter) deriv.Fill(0);
-//  if ( this->localCrossCorrelation*(-1.0) < this->m_RobustnessParameter) {
-//  std::cout << " localC " << this->localCrossCorrelation << std::endl; }
-  if( this->localCrossCorrelation < 1 )
-    {
-    this->m_Energy -= this->localCrossCorrelation;
-    }
-  return deriv; // localCrossCorrelation;
+  return deriv;
 
 }
 
@@ -476,69 +509,20 @@ CrossCorrelationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementFie
 
   typename TDisplacementField::PixelType deriv;
   deriv.Fill(0.0);
-  double sff = 0.0;
-  double smm = 0.0;
-  double sfm = 0.0;
-//  double fixedValue;
-//  double movingValue;
-  sff = 0.0;
-  smm = 0.0;
-  sfm = 0.0;
-  PointType           mappedPoint;
-  CovariantVectorType gradI, gradJ;
-  if( this->m_FixedImageMask )
-    {
-    if( this->m_FixedImageMask->GetPixel( oindex ) < 0.25 )
-      {
-      return deriv;
-      }
-    }
-
-  sfm = finitediffimages[2]->GetPixel(oindex);
-  sff = finitediffimages[3]->GetPixel(oindex);
-  smm = finitediffimages[4]->GetPixel(oindex);
 
-  if( sff == 0.0 || smm == 0.0 )
+  double coefficient = m_LocalCorrelationImage->GetPixel(oindex)[1];
+  if( coefficient == 0.0 )
     {
     return deriv;
     }
 
-  IndexType index = oindex; // hoodIt.GetIndex(indct);
-  if( sff == 0.0 )
-    {
-    sff = 1.0;
-    }
-  if( smm == 0.0 )
-    {
-    smm = 1.0;
-    }
-
-  // /gradI = m_FixedImageGradientCalculator->EvaluateAtIndex( index );
-  gradJ = m_MovingImageGradientCalculator->EvaluateAtIndex( index );
-
-  float Ji = finitediffimages[1]->GetPixel(index);
-  float Ii = finitediffimages[0]->GetPixel(index);
+  CovariantVectorType gradJ = m_MovingImageGradientCalculator->EvaluateAtIndex( oindex );
   for( int qq = 0; qq < ImageDimension; qq++ )
     {
-    // deriv[qq]   -=2.0*sfm/(sff*smm)*( Ji - sfm/sff*Ii )*gradI[qq];
-    deriv[qq] -= 2.0 * sfm / (sff * smm) * ( Ii - sfm / smm * Ji ) * gradJ[qq];
-    }
-
-  if( sff * smm != 0.0 )
-    {
-    this->localCrossCorrelation = sfm * sfm / ( sff * smm );
-    }
-  else if( sff == 0.0 && smm == 0 )
-    {
-    this->localCrossCorrelation = 1.0;
-    }
-  else
-    {
-    this->localCrossCorrelation = 1.0;
+    deriv[qq] -= coefficient * gradJ[qq];
     }
-  //  if ( this->localCrossCorrelation*(-1.0) < this->m_RobustnessParameter) deriv.Fill(0);
 
-  return deriv; // localCrossCorrelation;
+  return deriv;
 
 }
 
@@ -25,9 +25,13 @@
 #include "itkLinearInterpolateImageFunction.h"
 #include "itkCentralDifferenceImageFunction.h"
 #include "itkGradientRecursiveGaussianImageFilter.h"
+#include "itkFastMutexLock.h"
+#include "itkMultiThreader.h"
 
 #include "itkAvantsMutualInformationRegistrationFunction.h"
 
+#include <vector>
+
 namespace itk
 {
 
@@ -48,6 +52,17 @@ namespace itk
  * This class is templated over the fixed image type, moving image type,
  * and the deformation field type.
  *
+ * The local correlation terms are computed once per iteration in
+ * InitializeIteration.  The windowed sums of the fixed and moving
+ * intensities are separable box sums, accumulated with running sums in a
+ * single streaming pass over the image, split into slabs along the last
+ * dimension across threads.  Each thread keeps the in-plane sums of the
+ * hyperplanes inside its window, so every hyperplane is summed once per
+ * thread.  Only the two gradient coefficients and the
+ * local correlation are kept per voxel.  The energy is accumulated per
+ * thread in the global data structure and merged in
+ * ReleaseGlobalDataPointer.
+ *
  * \warning This filter assumes that the fixed image type, moving image type
  * and deformation field type all have the same number of dimensions.
  *
@@ -103,6 +118,13 @@ public:
   typedef Image<float, itkGetStaticConstMacro(ImageDimension)> BinaryImageType;
   typedef typename BinaryImageType::Pointer                    BinaryImagePointer;
 
+  /** Per voxel gradient coefficients of the fixed and moving image and the
+   * local correlation. */
+  typedef Vector<float, 3>                                     LocalCorrelationPixelType;
+  typedef Image<LocalCorrelationPixelType,
+                itkGetStaticConstMacro(ImageDimension)>        LocalCorrelationImageType;
+  typedef typename LocalCorrelationImageType::Pointer          LocalCorrelationImagePointer;
+
   /** Inherit some enums from the superclass. */
   itkStaticConstMacro(ImageDimension, unsigned int, Superclass::ImageDimension);
 
@@ -158,13 +180,21 @@ public:
   {
     GlobalDataStruct *global = new GlobalDataStruct();
 
+    global->m_Energy = 0.0;
     return global;
   }
 
-  /** Release memory for global data structure. */
+  /** Add the energy of the thread to the metric and release memory for
+   * global data structure. */
   virtual void ReleaseGlobalDataPointer( void *GlobalData ) const
   {
-    delete (GlobalDataStruct *) GlobalData;
+    GlobalDataStruct *global = (GlobalDataStruct *) GlobalData;
+
+    m_MetricCalculationLock.Lock();
+    this->m_Energy += global->m_Energy;
+    m_MetricCalculationLock.Unlock();
+
+    delete global;
   }
 
   /** Set the object's state before each iteration. */
@@ -172,22 +202,20 @@ public:
 
   double ComputeCrossCorrelation()
   {
-    if( finitediffimages[0] )
+    if( m_LocalCorrelationImage )
       {
       double        totalcc = 0;
       unsigned long ct = 0;
-      typedef ImageRegionIteratorWithIndex<MetricImageType> ittype;
-      ittype it(this->finitediffimages[0], this->finitediffimages[0]->GetLargestPossibleRegion().GetSize() );
+      typedef ImageRegionIteratorWithIndex<LocalCorrelationImageType> ittype;
+      ittype it(this->m_LocalCorrelationImage,
+                this->m_LocalCorrelationImage->GetLargestPossibleRegion() );
       for( it.GoToBegin(); !it.IsAtEnd(); ++it )
         {
         IndexType oindex = it.GetIndex();
-        double    sfm = finitediffimages[2]->GetPixel(oindex);
-        double    sff = finitediffimages[3]->GetPixel(oindex);
-        double    smm = finitediffimages[4]->GetPixel(oindex);
-        double    cc = 0;
-        if( fabs(sff * smm) > 0 )
+        double    cc = it.Get()[2];
+        if( cc > 0 )
           {
-          cc += sfm * sfm / (sff * smm); ct++;
+          ct++;
           }
         if( this->m_MetricImage )
           {
@@ -197,7 +225,10 @@ public:
           }
         totalcc += cc;
         }
-      this->m_Energy = totalcc / (float)ct * (-1.0);
+      if( ct > 0 )
+        {
+        this->m_Energy = totalcc / (float)ct * (-1.0);
+        }
       return this->m_Energy;
       }
     else
@@ -275,7 +306,7 @@ public:
   }
 
   virtual VectorType ComputeUpdate(const NeighborhoodType & neighborhood,
-                                   void * /* globalData */,
+                                   void *globalData,
                                    const FloatOffsetType & /* offset */ = FloatOffsetType(0.0) )
   {
     VectorType update;
@@ -283,12 +314,26 @@ public:
     update.Fill(0.0);
     IndexType       oindex = neighborhood.GetIndex();
     FixedImageType* img = const_cast<FixedImageType *>(Superclass::m_FixedImage.GetPointer() );
-    if( !img )
+    if( !img || !m_LocalCorrelationImage )
       {
       return update;
       }
     update = this->ComputeMetricAtPairB(oindex, update);
 
+    double localCrossCorrelation = m_LocalCorrelationImage->GetPixel(oindex)[2];
+    if( localCrossCorrelation < 1 )
+      {
+      GlobalDataStruct *global = (GlobalDataStruct *) globalData;
+      if( global )
+        {
+        global->m_Energy -= localCrossCorrelation;
+        }
+      else
+        {
+        this->m_Energy -= localCrossCorrelation;
+        }
+      }
+
     return update;
 
   }
@@ -302,7 +347,7 @@ public:
     update.Fill(0.0);
     IndexType       oindex = neighborhood.GetIndex();
     FixedImageType* img = const_cast<FixedImageType *>(Superclass::m_FixedImage.GetPointer() );
-    if( !img )
+    if( !img || !m_LocalCorrelationImage )
       {
       return update;
       }
@@ -316,10 +361,15 @@ public:
   {
     m_FullyRobust = b;
   }
+
+  /** Number of threads of the local correlation pass in
+   * InitializeIteration (default: the global default).  Each thread keeps
+   * the in-plane sums of 2 * radius + 1 hyperplanes, six doubles per
+   * voxel, plus the running window. */
+  itkSetClampMacro( NumberOfThreads, int, 1, ITK_MAX_THREADS );
+  itkGetConstMacro( NumberOfThreads, int );
   void GetProbabilities();
 
-  double localCrossCorrelation;
-  float  m_TEMP;
   MetricImagePointer MakeImage()
   {
     typedef ImageRegionIteratorWithIndex<MetricImageType> ittype;
@@ -369,7 +419,27 @@ protected:
   struct GlobalDataStruct
     {
     FixedImageNeighborhoodIteratorType m_FixedImageIterator;
+    double                             m_Energy;
     };
+
+  /** Windowed sums of a, b, a*a, b*b, a*b and the number of unmasked
+   * voxels (a fixed, b moving) over the in-plane dimensions of one
+   * hyperplane of the last dimension, six interleaved values per voxel. */
+  void ComputeHyperplaneSums( long plane, std::vector<double> & sums,
+                              std::vector<double> & line ) const;
+
+  /** Fill the local correlation image on the hyperplanes [begin, end) of
+   * the last dimension. */
+  void ThreadedComputeLocalCorrelation( long begin, long end );
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE LocalCorrelationThreaderCallback( void *arg );
+
+  struct LocalCorrelationThreadStruct
+    {
+    Self *Function;
+    };
+
 private:
   CrossCorrelationRegistrationFunction(const Self &); // purposely not implemented
   void operator=(const Self &);                       // purposely not implemented
@@ -403,7 +473,7 @@ private:
 
   GradientImagePointer m_MetricGradientImage;
 
-  MetricImagePointer finitediffimages[5];
+  LocalCorrelationImagePointer m_LocalCorrelationImage;
   BinaryImagePointer binaryimage;
 
   MetricImagePointer m_FixedImageMask;
@@ -416,6 +486,10 @@ private:
   bool         m_FullyRobust;
   unsigned int m_Iteration;
   float        m_Normalizer;
+  int          m_NumberOfThreads;
+
+  /** Mutex lock to protect modification to metric. */
+  mutable SimpleFastMutexLock m_MetricCalculationLock;
 
 };
 
@@ -22,6 +22,8 @@
 
 #include "itkVector.h"
 
+#include <vector>
+
 namespace itk
 {
 /** \class DiReCTImageFilter
@@ -230,6 +232,23 @@ public:
    */
   itkGetConstMacro( SmoothingSigma, RealType );
 
+  /**
+   * Use the fused integration path.  The work images are then allocated
+   * once, the composition of the inverse field and the warping of the
+   * three scalar images are done in one threaded pass, the speed, update,
+   * hit and total images are accumulated in a second one, and the field
+   * inversions use one threaded pass per inversion iteration.  Turning it
+   * off uses the original pipeline of filters at every integration
+   * point.  Default = true.
+   */
+  itkSetMacro( UseFusedIntegration, bool );
+
+  /**
+   * Get whether the fused integration path is used.  Default = true.
+   */
+  itkGetConstMacro( UseFusedIntegration, bool );
+  itkBooleanMacro( UseFusedIntegration );
+
   /**
    * Get the number of elapsed iterations.  This is a helper function for
    * reporting observations.
@@ -285,6 +304,100 @@ private:
   VectorImagePointer SmoothDeformationField( const VectorImageType *,
     const RealType );
 
+  /**
+   * Buffers and per-thread results shared by the passes of the fused
+   * integration path.  All the images share the region of the
+   * segmentation image and the buffers are indexed by voxel offset.
+   */
+  typedef typename InputImageType::SizeType      SizeType;
+  typedef typename InputImageType::OffsetValueType OffsetValueType;
+
+  itkStaticConstMacro( NumberOfNeighbors, unsigned int,
+    1 << TInputImage::ImageDimension );
+
+  enum { ComposeAndWarpPass, IntegrationUpdatePass, InversionPass };
+
+  struct FusedIntegrationStruct
+    {
+    Self                                     *Filter;
+    unsigned int                              Pass;
+    unsigned int                              IntegrationPoint;
+
+    SizeType                                  Size;
+    OffsetValueType                           OffsetTable[ImageDimension + 1];
+    VectorType                                InverseSpacing;
+
+    const InputPixelType                     *SegmentationImage;
+    const InputPixelType                     *MaskImage;
+    const RealType                           *GrayMatterProbabilityMap;
+    const RealType                           *WhiteMatterProbabilityMap;
+    const RealType                           *WhiteMatterContours;
+    RealType                                 *ThicknessImage;
+    RealType                                 *WarpedWhiteMatterProbabilityMap;
+    RealType                                 *WarpedWhiteMatterContours;
+    RealType                                 *WarpedThicknessImage;
+    RealType                                 *HitImage;
+    RealType                                 *TotalImage;
+
+    VectorType                               *InverseField;
+    VectorType                               *InverseIncrementalField;
+    VectorType                               *ForwardIncrementalField;
+    VectorType                               *IntegratedField;
+    VectorType                               *VelocityField;
+    const VectorType                         *GradientImage;
+
+    /** Field inversion: the inverse is updated with the composition of
+     * the previous pass, then composed again with the field. */
+    const VectorType                         *DeformationField;
+    VectorType                               *InverseDeformationField;
+    VectorType                               *CompositionField;
+    bool                                      UpdateInverse;
+    bool                                      Compose;
+    RealType                                  Epsilon;
+    RealType                                  MaxNorm;
+    RealType                                  NormFactor;
+
+    std::vector<RealType>                     ThreaderEnergy;
+    std::vector<RealType>                     ThreaderNumberOfGrayMatterVoxels;
+    std::vector<RealType>                     ThreaderNormSum;
+    std::vector<RealType>                     ThreaderNormMax;
+    };
+
+  /**
+   * Runs one pass of the fused integration path over slabs of the last
+   * dimension.
+   */
+  void RunFusedIntegrationPass( FusedIntegrationStruct *, unsigned int );
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE FusedIntegrationThreaderCallback( void *arg );
+
+  void ThreadedComposeAndWarp( FusedIntegrationStruct *,
+    unsigned long, unsigned long );
+  void ThreadedIntegrationUpdate( FusedIntegrationStruct *, int,
+    unsigned long, unsigned long );
+  void ThreadedInversion( FusedIntegrationStruct *, int,
+    unsigned long, unsigned long );
+
+  /**
+   * Fused counterpart of InvertDeformationField() with the same iterations
+   * and stopping criteria.
+   */
+  void InvertDeformationFieldFused( FusedIntegrationStruct *,
+    const VectorImageType *, VectorImageType * );
+
+  /**
+   * Linear interpolation weights and buffer offsets of the neighbors of a
+   * continuous index (relative to the start of the buffer).  Returns false
+   * if the index is outside of the buffer.
+   */
+  static bool ComputeInterpolationWeights( const FusedIntegrationStruct *,
+    const RealType *, OffsetValueType *, RealType * );
+
+  /** Moves to the next voxel in raster order. */
+  static void IncrementPosition( const FusedIntegrationStruct *,
+    OffsetValueType * );
+
   RealType                                       m_ThicknessPriorEstimate;
   RealType                                       m_SmoothingSigma;
   RealType                                       m_GradientStep;
@@ -299,6 +412,8 @@ private:
   RealType                                       m_CurrentConvergenceMeasurement;
   RealType                                       m_ConvergenceThreshold;
   unsigned int                                   m_ConvergenceWindowSize;
+
+  bool                                           m_UseFusedIntegration;
 };
 
 } // end namespace itk
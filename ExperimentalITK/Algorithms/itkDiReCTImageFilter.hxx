@@ -63,7 +63,8 @@ DiReCTImageFilter<TInputImage, TOutputImage>
   m_MaximumNumberOfIterations( 50 ),
   m_CurrentEnergy( NumericTraits<RealType>::max() ),
   m_ConvergenceThreshold( 0.001 ),
-  m_ConvergenceWindowSize( 10 )
+  m_ConvergenceWindowSize( 10 ),
+  m_UseFusedIntegration( true )
 {
   this->SetNumberOfRequiredInputs( 3 );
 }
@@ -272,6 +273,78 @@ DiReCTImageFilter<TInputImage, TOutputImage>
     whiteMatterContours,
     whiteMatterContours->GetRequestedRegion() );
 
+  // Work images and pass data of the fused integration path.  These are
+  // allocated once and reused at every integration point.
+
+  typedef GradientRecursiveGaussianImageFilter<RealImageType, VectorImageType>
+    GradientImageFilterType;
+
+  FusedIntegrationStruct fused;
+  typename GradientImageFilterType::Pointer fusedGradientFilter;
+  RealImagePointer fusedWarpedWhiteMatterProbabilityMap;
+  RealImagePointer fusedWarpedWhiteMatterContours;
+  RealImagePointer fusedWarpedThicknessImage;
+  VectorImagePointer compositionField;
+
+  if( this->m_UseFusedIntegration )
+    {
+    fusedWarpedWhiteMatterProbabilityMap = RealImageType::New();
+    fusedWarpedWhiteMatterProbabilityMap->CopyInformation( this->GetInput() );
+    fusedWarpedWhiteMatterProbabilityMap->SetRegions( this->GetInput()->GetRequestedRegion() );
+    fusedWarpedWhiteMatterProbabilityMap->Allocate();
+
+    fusedWarpedWhiteMatterContours = RealImageType::New();
+    fusedWarpedWhiteMatterContours->CopyInformation( this->GetInput() );
+    fusedWarpedWhiteMatterContours->SetRegions( this->GetInput()->GetRequestedRegion() );
+    fusedWarpedWhiteMatterContours->Allocate();
+
+    fusedWarpedThicknessImage = RealImageType::New();
+    fusedWarpedThicknessImage->CopyInformation( this->GetInput() );
+    fusedWarpedThicknessImage->SetRegions( this->GetInput()->GetRequestedRegion() );
+    fusedWarpedThicknessImage->Allocate();
+
+    compositionField = VectorImageType::New();
+    compositionField->CopyInformation( this->GetInput() );
+    compositionField->SetRegions( this->GetInput()->GetRequestedRegion() );
+    compositionField->Allocate();
+
+    // The gradient filter is kept so that its output buffer is reused.
+    fusedGradientFilter = GradientImageFilterType::New();
+    fusedGradientFilter->SetInput( fusedWarpedWhiteMatterProbabilityMap );
+    fusedGradientFilter->SetSigma( this->m_SmoothingSigma );
+
+    fused.Filter = this;
+    fused.Size = this->GetInput()->GetRequestedRegion().GetSize();
+    fused.OffsetTable[0] = 1;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      fused.OffsetTable[d + 1] = fused.OffsetTable[d] * fused.Size[d];
+      fused.InverseSpacing[d] = 1.0 / this->GetInput()->GetSpacing()[d];
+      }
+
+    fused.SegmentationImage = this->GetSegmentationImage()->GetBufferPointer();
+    fused.MaskImage = maskImage->GetBufferPointer();
+    fused.GrayMatterProbabilityMap =
+      this->GetGrayMatterProbabilityImage()->GetBufferPointer();
+    fused.WhiteMatterProbabilityMap =
+      this->GetWhiteMatterProbabilityImage()->GetBufferPointer();
+    fused.WhiteMatterContours = whiteMatterContours->GetBufferPointer();
+    fused.ThicknessImage = thicknessImage->GetBufferPointer();
+    fused.WarpedWhiteMatterProbabilityMap =
+      fusedWarpedWhiteMatterProbabilityMap->GetBufferPointer();
+    fused.WarpedWhiteMatterContours =
+      fusedWarpedWhiteMatterContours->GetBufferPointer();
+    fused.WarpedThicknessImage = fusedWarpedThicknessImage->GetBufferPointer();
+    fused.HitImage = hitImage->GetBufferPointer();
+    fused.TotalImage = totalImage->GetBufferPointer();
+
+    fused.InverseField = inverseField->GetBufferPointer();
+    fused.InverseIncrementalField = inverseIncrementalField->GetBufferPointer();
+    fused.ForwardIncrementalField = forwardIncrementalField->GetBufferPointer();
+    fused.IntegratedField = integratedField->GetBufferPointer();
+    fused.CompositionField = compositionField->GetBufferPointer();
+    }
+
   // Instantiate objects for profiling energy convergence
 
   typedef Vector<RealType, 1>                     ProfilePointDataType;
@@ -311,6 +384,35 @@ DiReCTImageFilter<TInputImage, TOutputImage>
     unsigned int integrationPoint = 0;
     while( integrationPoint++ < this->m_NumberOfIntegrationPoints )
       {
+      if( this->m_UseFusedIntegration )
+        {
+        // Compose the inverse field and warp the scalar images
+        this->RunFusedIntegrationPass( &fused, ComposeAndWarpPass );
+
+        fusedWarpedWhiteMatterProbabilityMap->Modified();
+        fusedGradientFilter->Update();
+
+        // Speed, update, hit and total images
+        fused.IntegrationPoint = integrationPoint;
+        fused.VelocityField = velocityField->GetBufferPointer();
+        fused.GradientImage = fusedGradientFilter->GetOutput()->GetBufferPointer();
+        this->RunFusedIntegrationPass( &fused, IntegrationUpdatePass );
+
+        for( unsigned int i = 0; i < fused.ThreaderEnergy.size(); i++ )
+          {
+          currentEnergy[0] += fused.ThreaderEnergy[i];
+          numberOfGrayMatterVoxels += fused.ThreaderNumberOfGrayMatterVoxels[i];
+          }
+
+        if( integrationPoint == 1 )
+          {
+          integratedField->FillBuffer( zeroVector );
+          }
+        this->InvertDeformationFieldFused( &fused, inverseField, integratedField );
+        this->InvertDeformationFieldFused( &fused, integratedField, inverseField );
+        continue;
+        }
+
       typedef ComposeDiffeomorphismsImageFilter<VectorImageType> ComposerType;
       typename ComposerType::Pointer composer = ComposerType::New();
       composer->SetDeformationField( inverseIncrementalField );
@@ -327,8 +429,6 @@ DiReCTImageFilter<TInputImage, TOutputImage>
    	  RealImagePointer warpedThicknessImage = this->WarpImage(
    	    thicknessImage, inverseField );
 
-      typedef GradientRecursiveGaussianImageFilter<RealImageType, VectorImageType>
-        GradientImageFilterType;
       typename GradientImageFilterType::Pointer gradientFilter =
         GradientImageFilterType::New();
       gradientFilter->SetInput( warpedWhiteMatterProbabilityMap );
@@ -852,6 +952,418 @@ DiReCTImageFilter<TInputImage, TOutputImage>
   return outputField;
 }
 
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::InvertDeformationFieldFused( FusedIntegrationStruct *str,
+  const VectorImageType *deformationField, VectorImageType *inverseField )
+{
+  // Same iterations as InvertDeformationField().  The update of the inverse
+  // at one iteration only needs the composition at the same voxel and the
+  // maximum norm, so it is done in the same pass as the composition of the
+  // next iteration.
+
+  typename VectorImageType::SpacingType spacing =
+    deformationField->GetSpacing();
+
+  RealType normFactor = 1.0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    normFactor /= spacing[d];
+    }
+  const RealType numberOfVoxels = static_cast<RealType>(
+    str->OffsetTable[ImageDimension] );
+
+  str->DeformationField = deformationField->GetBufferPointer();
+  str->InverseDeformationField = inverseField->GetBufferPointer();
+  str->NormFactor = normFactor;
+  str->UpdateInverse = false;
+  str->Compose = true;
+
+  unsigned int iteration = 1;
+  while( true )
+    {
+    this->RunFusedIntegrationPass( str, InversionPass );
+
+    RealType meanNorm = 0.0;
+    RealType maxNorm = 0.0;
+    for( unsigned int i = 0; i < str->ThreaderNormSum.size(); i++ )
+      {
+      meanNorm += str->ThreaderNormSum[i];
+      maxNorm = vnl_math_max( maxNorm, str->ThreaderNormMax[i] );
+      }
+    meanNorm /= numberOfVoxels;
+
+    str->UpdateInverse = true;
+    str->Epsilon = ( iteration == 1 ) ? 0.75 : 0.5;
+    str->MaxNorm = maxNorm;
+    str->Compose = ( iteration++ < 20 && maxNorm > 0.1 && meanNorm > 0.001 );
+    if( !str->Compose )
+      {
+      this->RunFusedIntegrationPass( str, InversionPass );
+      break;
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::RunFusedIntegrationPass( FusedIntegrationStruct *str, unsigned int pass )
+{
+  const unsigned long numberOfSlices = str->Size[ImageDimension - 1];
+
+  int numberOfThreads = vnl_math_min( this->GetNumberOfThreads(),
+    static_cast<int>( numberOfSlices ) );
+  numberOfThreads = vnl_math_max( numberOfThreads, 1 );
+
+  str->Pass = pass;
+  str->ThreaderEnergy.assign( numberOfThreads, 0.0 );
+  str->ThreaderNumberOfGrayMatterVoxels.assign( numberOfThreads, 0.0 );
+  str->ThreaderNormSum.assign( numberOfThreads, 0.0 );
+  str->ThreaderNormMax.assign( numberOfThreads, 0.0 );
+
+  this->GetMultiThreader()->SetNumberOfThreads( numberOfThreads );
+  this->GetMultiThreader()->SetSingleMethod(
+    this->FusedIntegrationThreaderCallback, str );
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+template<class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+DiReCTImageFilter<TInputImage, TOutputImage>
+::FusedIntegrationThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  FusedIntegrationStruct *str = (FusedIntegrationStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const unsigned long numberOfSlices = str->Size[ImageDimension - 1];
+  const unsigned long firstSlice = ( numberOfSlices * threadId ) / threadCount;
+  const unsigned long endSlice =
+    ( numberOfSlices * ( threadId + 1 ) ) / threadCount;
+
+  if( firstSlice < endSlice )
+    {
+    switch( str->Pass )
+      {
+      case ComposeAndWarpPass:
+        str->Filter->ThreadedComposeAndWarp( str, firstSlice, endSlice );
+        break;
+      case IntegrationUpdatePass:
+        str->Filter->ThreadedIntegrationUpdate( str, threadId, firstSlice,
+          endSlice );
+        break;
+      case InversionPass:
+        str->Filter->ThreadedInversion( str, threadId, firstSlice, endSlice );
+        break;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ThreadedComposeAndWarp( FusedIntegrationStruct *str,
+  unsigned long firstSlice, unsigned long endSlice )
+{
+  OffsetValueType position[ImageDimension];
+  for( unsigned int d = 0; d < ImageDimension - 1; d++ )
+    {
+    position[d] = 0;
+    }
+  position[ImageDimension - 1] = firstSlice;
+
+  RealType cindex[ImageDimension];
+  OffsetValueType neighbors[NumberOfNeighbors];
+  RealType weights[NumberOfNeighbors];
+
+  const OffsetValueType sliceSize = str->OffsetTable[ImageDimension - 1];
+  const OffsetValueType end = endSlice * sliceSize;
+  for( OffsetValueType o = firstSlice * sliceSize; o < end; o++ )
+    {
+    // Compose the incremental inverse field with the inverse field.  Only
+    // the inverse at this voxel is read, so it is updated in place.
+
+    VectorType inverse = str->InverseField[o];
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      cindex[d] = position[d] + inverse[d] * str->InverseSpacing[d];
+      }
+    if( ComputeInterpolationWeights( str, cindex, neighbors, weights ) )
+      {
+      for( unsigned int n = 0; n < NumberOfNeighbors; n++ )
+        {
+        inverse += str->InverseIncrementalField[neighbors[n]] * weights[n];
+        }
+      }
+    else
+      {
+      inverse.Fill( 0.0 );
+      }
+    str->InverseField[o] = inverse;
+
+    // Warp the three scalar images with the same weights
+
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      cindex[d] = position[d] + inverse[d] * str->InverseSpacing[d];
+      }
+    RealType whiteMatterProbability = 0.0;
+    RealType whiteMatterContour = 0.0;
+    RealType thickness = 0.0;
+    if( ComputeInterpolationWeights( str, cindex, neighbors, weights ) )
+      {
+      for( unsigned int n = 0; n < NumberOfNeighbors; n++ )
+        {
+        whiteMatterProbability +=
+          str->WhiteMatterProbabilityMap[neighbors[n]] * weights[n];
+        whiteMatterContour +=
+          str->WhiteMatterContours[neighbors[n]] * weights[n];
+        thickness += str->ThicknessImage[neighbors[n]] * weights[n];
+        }
+      }
+    str->WarpedWhiteMatterProbabilityMap[o] = whiteMatterProbability;
+    str->WarpedWhiteMatterContours[o] = whiteMatterContour;
+    str->WarpedThicknessImage[o] = thickness;
+
+    IncrementPosition( str, position );
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ThreadedIntegrationUpdate( FusedIntegrationStruct *str, int threadId,
+  unsigned long firstSlice, unsigned long endSlice )
+{
+  VectorType zeroVector( 0.0 );
+
+  RealType energy = 0.0;
+  RealType numberOfGrayMatterVoxels = 0.0;
+
+  const OffsetValueType sliceSize = str->OffsetTable[ImageDimension - 1];
+  const OffsetValueType end = endSlice * sliceSize;
+  for( OffsetValueType o = firstSlice * sliceSize; o < end; o++ )
+    {
+    const InputPixelType segmentationValue = str->SegmentationImage[o];
+
+    // Speed at the voxel (zero outside of the gray matter)
+
+    RealType speedValue = 0.0;
+    VectorType gradient = zeroVector;
+    if( segmentationValue == this->m_GrayMatterLabel )
+      {
+      gradient = str->GradientImage[o];
+      RealType norm = gradient.GetNorm();
+      if( norm > 1e-3 && !vnl_math_isnan( norm ) && !vnl_math_isinf( norm ) )
+        {
+        gradient /= norm;
+        }
+      else
+        {
+        gradient = zeroVector;
+        }
+
+      RealType delta = ( str->WarpedWhiteMatterProbabilityMap[o] -
+        str->GrayMatterProbabilityMap[o] );
+
+      energy += vnl_math_abs( delta );
+      numberOfGrayMatterVoxels++;
+
+      speedValue = -1.0 * delta * str->GrayMatterProbabilityMap[o] *
+        this->m_GradientStep;
+      if( vnl_math_isnan( speedValue ) || vnl_math_isinf( speedValue ) )
+        {
+        speedValue = 0.0;
+        }
+      }
+
+    if( !str->MaskImage[o] )
+      {
+      str->IntegratedField[o] = zeroVector;
+      str->InverseField[o] = zeroVector;
+      str->VelocityField[o] = zeroVector;
+      }
+    str->InverseIncrementalField[o] = str->VelocityField[o];
+    if( speedValue != 0.0 )
+      {
+      str->ForwardIncrementalField[o] += gradient * speedValue;
+      }
+
+    if( segmentationValue == this->m_GrayMatterLabel ||
+      segmentationValue == this->m_WhiteMatterLabel )
+      {
+      if( str->IntegrationPoint == 1 )
+        {
+        RealType whiteMatterContoursValue = str->WhiteMatterContours[o];
+        str->HitImage[o] = whiteMatterContoursValue;
+
+        RealType weightedNorm = str->IntegratedField[o].GetNorm() *
+          whiteMatterContoursValue;
+
+        str->ThicknessImage[o] = weightedNorm;
+        str->TotalImage[o] = weightedNorm;
+        }
+      else if( segmentationValue == this->m_GrayMatterLabel )
+        {
+        str->HitImage[o] += str->WarpedWhiteMatterContours[o];
+        str->TotalImage[o] += str->WarpedThicknessImage[o];
+        }
+      }
+    }
+
+  str->ThreaderEnergy[threadId] = energy;
+  str->ThreaderNumberOfGrayMatterVoxels[threadId] = numberOfGrayMatterVoxels;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ThreadedInversion( FusedIntegrationStruct *str, int threadId,
+  unsigned long firstSlice, unsigned long endSlice )
+{
+  OffsetValueType position[ImageDimension];
+  for( unsigned int d = 0; d < ImageDimension - 1; d++ )
+    {
+    position[d] = 0;
+    }
+  position[ImageDimension - 1] = firstSlice;
+
+  RealType cindex[ImageDimension];
+  OffsetValueType neighbors[NumberOfNeighbors];
+  RealType weights[NumberOfNeighbors];
+
+  const RealType maxUpdateNorm = str->Epsilon * str->MaxNorm / str->NormFactor;
+
+  RealType normSum = 0.0;
+  RealType normMax = 0.0;
+
+  const OffsetValueType sliceSize = str->OffsetTable[ImageDimension - 1];
+  const OffsetValueType end = endSlice * sliceSize;
+  for( OffsetValueType o = firstSlice * sliceSize; o < end; o++ )
+    {
+    VectorType inverse = str->InverseDeformationField[o];
+
+    if( str->UpdateInverse )
+      {
+      VectorType update = -str->CompositionField[o];
+      RealType updateNorm = update.GetNorm();
+
+      if( updateNorm > maxUpdateNorm )
+        {
+        update *= ( str->Epsilon * str->MaxNorm /
+          ( updateNorm * str->NormFactor ) );
+        }
+      inverse += update * str->Epsilon;
+      str->InverseDeformationField[o] = inverse;
+      }
+
+    if( str->Compose )
+      {
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        cindex[d] = position[d] + inverse[d] * str->InverseSpacing[d];
+        }
+      VectorType composition( 0.0 );
+      if( ComputeInterpolationWeights( str, cindex, neighbors, weights ) )
+        {
+        composition = inverse;
+        for( unsigned int n = 0; n < NumberOfNeighbors; n++ )
+          {
+          composition += str->DeformationField[neighbors[n]] * weights[n];
+          }
+        }
+      str->CompositionField[o] = composition;
+
+      RealType norm = 0.0;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        norm += vnl_math_sqr( composition[d] * str->InverseSpacing[d] );
+        }
+      norm = vcl_sqrt( norm );
+
+      normSum += norm;
+      normMax = vnl_math_max( normMax, norm );
+      }
+
+    IncrementPosition( str, position );
+    }
+
+  str->ThreaderNormSum[threadId] = normSum;
+  str->ThreaderNormMax[threadId] = normMax;
+}
+
+template<class TInputImage, class TOutputImage>
+bool
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ComputeInterpolationWeights( const FusedIntegrationStruct *str,
+  const RealType *cindex, OffsetValueType *neighbors, RealType *weights )
+{
+  // Same buffer test as the interpolators of the filter-based path: the
+  // continuous index must lie between the first and the last voxels.
+
+  OffsetValueType base = 0;
+  OffsetValueType step[ImageDimension];
+  RealType fraction[ImageDimension];
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    if( !( cindex[d] >= 0.0 &&
+      cindex[d] <= static_cast<RealType>( str->Size[d] - 1 ) ) )
+      {
+      return false;
+      }
+    OffsetValueType lower = static_cast<OffsetValueType>(
+      vcl_floor( cindex[d] ) );
+    fraction[d] = cindex[d] - static_cast<RealType>( lower );
+    base += lower * str->OffsetTable[d];
+    step[d] = ( lower + 1 < static_cast<OffsetValueType>( str->Size[d] ) )
+      ? str->OffsetTable[d] : 0;
+    }
+
+  for( unsigned int n = 0; n < NumberOfNeighbors; n++ )
+    {
+    OffsetValueType offset = base;
+    RealType weight = 1.0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      if( n & ( 1 << d ) )
+        {
+        offset += step[d];
+        weight *= fraction[d];
+        }
+      else
+        {
+        weight *= ( 1.0 - fraction[d] );
+        }
+      }
+    neighbors[n] = offset;
+    weights[n] = weight;
+    }
+  return true;
+}
+
+template<class TInputImage, class TOutputImage>
+void
+DiReCTImageFilter<TInputImage, TOutputImage>
+::IncrementPosition( const FusedIntegrationStruct *str,
+  OffsetValueType *position )
+{
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    if( ++position[d] < static_cast<OffsetValueType>( str->Size[d] ) ||
+      d == ImageDimension - 1 )
+      {
+      break;
+      }
+    position[d] = 0;
+    }
+}
+
 /**
  * Standard "PrintSelf" method
  */
@@ -878,6 +1390,8 @@ DiReCTImageFilter<TInputImage, TOutputImage>
     << this->m_ConvergenceThreshold << std::endl;
   std::cout << indent << "Convergence window size = "
     << this->m_ConvergenceWindowSize << std::endl;
+  std::cout << indent << "Use fused integration = "
+    << this->m_UseFusedIntegration << std::endl;
 }
 
 } // end namespace itk
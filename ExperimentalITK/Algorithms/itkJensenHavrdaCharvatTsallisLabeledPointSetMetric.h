@@ -20,6 +20,7 @@
 #include "itkPointSetToPointSetMetric.h"
 
 #include "itkIdentityTransform.h"
+#include "itkMultiThreader.h"
 
 namespace itk {
 
@@ -171,6 +172,21 @@ public:
   itkSetMacro( MovingKernelSigma, RealType );
   itkGetConstMacro( MovingKernelSigma, RealType );
 
+  /** Forwarded to the metric of each label. */
+  itkSetMacro( UseSpatialHashing, bool );
+  itkGetConstMacro( UseSpatialHashing, bool );
+  itkBooleanMacro( UseSpatialHashing );
+
+  itkSetMacro( CutoffSigma, RealType );
+  itkGetConstMacro( CutoffSigma, RealType );
+
+  /**
+   * Forwarded to the metric of each label; only used when spatial hashing
+   * is on, which is not the default.
+   */
+  itkSetClampMacro( NumberOfThreads, int, 1, ITK_MAX_THREADS );
+  itkGetConstMacro( NumberOfThreads, int );
+
   void SetFixedLabelSet( LabelSetType labels )
     {
     typename LabelSetType::const_iterator iter;
@@ -228,6 +244,10 @@ private:
 
   RealType                                 m_Alpha;
 
+  bool                                     m_UseSpatialHashing;
+  RealType                                 m_CutoffSigma;
+  int                                      m_NumberOfThreads;
+
   TransformPointer                         m_Transform;
 
   LabelSetType                             m_FixedLabelSet;
@@ -45,6 +45,10 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
   this->m_Alpha = 2.0;
   this->m_UseWithRespectToTheMovingPointSet = true;
 
+  this->m_UseSpatialHashing = false;
+  this->m_CutoffSigma = 5.0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+
   typename DefaultTransformType::Pointer transform
     = DefaultTransformType::New();
   transform->SetIdentity();
@@ -217,6 +221,9 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
     metric->SetUseWithRespectToTheMovingPointSet(
       this->m_UseWithRespectToTheMovingPointSet );
     metric->SetAlpha( this->m_Alpha );
+    metric->SetUseSpatialHashing( this->m_UseSpatialHashing );
+    metric->SetCutoffSigma( this->m_CutoffSigma );
+    metric->SetNumberOfThreads( this->m_NumberOfThreads );
 
     metric->Initialize();
 
@@ -339,6 +346,9 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
     metric->SetUseWithRespectToTheMovingPointSet(
       this->m_UseWithRespectToTheMovingPointSet );
     metric->SetAlpha( this->m_Alpha );
+    metric->SetUseSpatialHashing( this->m_UseSpatialHashing );
+    metric->SetCutoffSigma( this->m_CutoffSigma );
+    metric->SetNumberOfThreads( this->m_NumberOfThreads );
 
     metric->Initialize();
 
@@ -502,6 +512,9 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
     metric->SetUseWithRespectToTheMovingPointSet(
       this->m_UseWithRespectToTheMovingPointSet );
     metric->SetAlpha( this->m_Alpha );
+    metric->SetUseSpatialHashing( this->m_UseSpatialHashing );
+    metric->SetCutoffSigma( this->m_CutoffSigma );
+    metric->SetNumberOfThreads( this->m_NumberOfThreads );
 
     metric->Initialize();
 
@@ -579,6 +592,10 @@ JensenHavrdaCharvatTsallisLabeledPointSetMetric<TPointSet>
      << this->m_FixedPointSetSigma << std::endl;
   os << indent << "Moving sigma: "
      << this->m_MovingPointSetSigma << std::endl;
+  os << indent << "Use spatial hashing: "
+     << this->m_UseSpatialHashing << std::endl;
+  os << indent << "Number of threads: "
+     << this->m_NumberOfThreads << std::endl;
 }
 
 } // end namespace itk
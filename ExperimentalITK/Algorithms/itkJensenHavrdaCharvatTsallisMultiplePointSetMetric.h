@@ -21,6 +21,7 @@
 
 #include "itkIdentityTransform.h"
 #include "itkManifoldParzenWindowsPointSetFunction.h"
+#include "itkJensenHavrdaCharvatTsallisPointSetEvaluator.h"
 
 #include <vector>
 
@@ -69,6 +70,8 @@ public:
     <PointSetType, RealType>                            DensityFunctionType;
   typedef typename DensityFunctionType::Pointer         DensityFunctionPointer;
   typedef typename DensityFunctionType::GaussianType    GaussianType;
+  typedef JensenHavrdaCharvatTsallisPointSetEvaluator
+    <PointSetType>                                      EvaluatorType;
 
 
   /** Initialize the Metric by making sure that all the components
@@ -99,6 +102,22 @@ public:
   itkGetConstMacro( UseInputAsSamples, bool );
   itkBooleanMacro( UseInputAsSamples );
 
+  /**
+   * Evaluate the densities through their Gaussian grid instead of the
+   * k-d tree.  This is required for the samples to be processed by more
+   * than one thread; since it is off by default, NumberOfThreads has no
+   * effect unless spatial hashing is turned on.
+   */
+  itkSetMacro( UseSpatialHashing, bool );
+  itkGetConstMacro( UseSpatialHashing, bool );
+  itkBooleanMacro( UseSpatialHashing );
+
+  itkSetMacro( CutoffSigma, RealType );
+  itkGetConstMacro( CutoffSigma, RealType );
+
+  itkSetClampMacro( NumberOfThreads, int, 1, ITK_MAX_THREADS );
+  itkGetConstMacro( NumberOfThreads, int );
+
   void SetPointSetSigma( unsigned int i, RealType sigma )
     {
     if( i >= this->m_PointSetSigma.size() )
@@ -230,6 +249,10 @@ protected:
 
   void PrintSelf( std::ostream& os, Indent indent ) const;
 
+  /** Value and, if requested, derivative in a single pass. */
+  void ComputeValueAndDerivative( MeasureType & value,
+    DerivativeType * derivative ) const;
+
 private:
   //purposely not implemented
   JensenHavrdaCharvatTsallisMultiplePointSetMetric(const Self&);
@@ -249,6 +272,11 @@ private:
 
   RealType                                 m_Alpha;
 
+  bool                                     m_UseSpatialHashing;
+  RealType                                 m_CutoffSigma;
+  int                                      m_NumberOfThreads;
+  typename EvaluatorType::Pointer          m_Evaluator;
+
 };
 
 
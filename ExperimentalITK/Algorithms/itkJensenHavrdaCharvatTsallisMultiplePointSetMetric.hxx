@@ -30,6 +30,11 @@ JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
   this->m_UseAnisotropicCovariances = false;
   this->m_Alpha = 2.0;
 
+  this->m_UseSpatialHashing = false;
+  this->m_CutoffSigma = 5.0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_Evaluator = EvaluatorType::New();
+
   this->SetNumberOfRequiredInputs( 2 );
 }
 
@@ -101,6 +106,8 @@ JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
       }
     densityFunction->SetEvaluationKNeighborhood(
       this->m_EvaluationKNeighborhood[i] );
+    densityFunction->SetUseSpatialHashing( this->m_UseSpatialHashing );
+    densityFunction->SetCutoffSigma( this->m_CutoffSigma );
     densityFunction->SetInputPointSet( this->GetInput( i ) );
     this->m_DensityFunction.push_back( densityFunction );
 
@@ -153,135 +160,8 @@ typename JensenHavrdaCharvatTsallisMultiplePointSetMetric
 JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
 ::GetValue() const
 {
-
-  RealType totalNumberOfPoints = 0;
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-    {
-    PointSetPointer points = const_cast<PointSetType*>(
-      static_cast<const PointSetType*>( this->ProcessObject::GetInput( i ) ) );
-    totalNumberOfPoints += points->GetNumberOfPoints();
-    }
-  RealType totalNumberOfSamples = 0;
-  for( unsigned int i = 0; i < this->m_SamplePoints.size(); i++ )
-    {
-    totalNumberOfSamples += static_cast<RealType>(
-      this->m_SamplePoints[i]->GetNumberOfPoints() );
-    }
-
-  PointSetPointer points[this->GetNumberOfInputs()];
-  PointSetPointer samples[this->GetNumberOfInputs()];
-
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-    {
-    points[i] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->ProcessObject::GetInput( i ) ) );
-    if( this->m_UseInputAsSamples )
-      {
-      samples[i] = points[i];
-      }
-    else
-      {
-      samples[i] = this->m_SamplePoints[i];
-      }
-    }
-
   MeasureType measure;
-  measure.SetSize( 1 );
-  measure.Fill( 0 );
-
-  RealType energyTerm1 = 0.0;
-  RealType energyTerm2 = 0.0;
-
-  /**
-    * first term
-    */
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-    {
-    RealType prefactor = -1.0 / totalNumberOfSamples;
-    if( this->m_Alpha != 1.0 )
-      {
-      prefactor /= ( this->m_Alpha - 1.0 );
-      }
-
-    typename PointSetType::PointsContainerConstIterator It
-      = samples[i]->GetPoints()->Begin();
-    while( It != samples[i]->GetPoints()->End() )
-      {
-      PointType samplePoint = It.Value();
-
-      RealType probabilityStar = 0.0;
-      for( unsigned int j = 0; j < this->m_DensityFunction.size(); j++ )
-        {
-        probabilityStar += this->m_DensityFunction[j]->Evaluate( samplePoint )
-          * static_cast<RealType>( points[j]->GetNumberOfPoints() );
-        }
-      probabilityStar /= totalNumberOfPoints;
-
-      if( probabilityStar == 0 )
-        {
-        ++It;
-        continue;
-        }
-
-      if( this->m_Alpha == 1.0 )
-        {
-        energyTerm1 += ( prefactor *
-          vcl_log( probabilityStar )  / vnl_math::ln2 );
-        }
-      else
-        {
-        energyTerm1 += ( prefactor * vcl_pow( probabilityStar,
-          static_cast<RealType>( this->m_Alpha - 1.0 ) ) );
-        }
-      ++It;
-      }
-    }
-
-  /**
-    * second term, i.e. regularization term
-    */
-  if( this->m_UseRegularizationTerm )
-    {
-    for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-      {
-      RealType prefactor = -static_cast<RealType>(
-        points[i]->GetNumberOfPoints() ) / ( totalNumberOfPoints *
-        static_cast<RealType>( samples[i]->GetNumberOfPoints() ) );
-      if( this->m_Alpha != 1.0 )
-        {
-        prefactor /= ( this->m_Alpha - 1.0 );
-        }
-
-      typename PointSetType::PointsContainerConstIterator It
-        = samples[i]->GetPoints()->Begin();
-      while( It != samples[i]->GetPoints()->End() )
-        {
-        PointType samplePoint = It.Value();
-
-        RealType probability
-          = this->m_DensityFunction[i]->Evaluate( samplePoint );
-
-        if( probability == 0 )
-          {
-          ++It;
-          continue;
-          }
-
-        if( this->m_Alpha == 1.0 )
-          {
-          energyTerm2 += ( prefactor * vcl_log( probability ) / vnl_math::ln2 );
-          }
-        else
-          {
-          energyTerm2 += ( prefactor * vcl_pow( probability,
-            static_cast<RealType>( this->m_Alpha - 1.0 ) ) );
-          }
-        ++It;
-        }
-      }
-    }
-
-  measure[0] = energyTerm1 - energyTerm2;
+  this->ComputeValueAndDerivative( measure, NULL );
 
   return measure;
 }
@@ -292,25 +172,35 @@ void
 JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
 ::GetDerivative( DerivativeType & derivative ) const
 {
+  MeasureType measure;
+  this->ComputeValueAndDerivative( measure, &derivative );
+}
 
-  RealType totalNumberOfPoints = 0;
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-    {
-    PointSetPointer points = const_cast<PointSetType*>(
-      static_cast<const PointSetType*>( this->ProcessObject::GetInput( i ) ) );
-    totalNumberOfPoints += points->GetNumberOfPoints();
-    }
-  RealType totalNumberOfSamples = 0;
-  for( unsigned int i = 0; i < this->m_SamplePoints.size(); i++ )
-    {
-    totalNumberOfSamples += static_cast<RealType>(
-      this->m_SamplePoints[i]->GetNumberOfPoints() );
-    }
+/** Get both the match Measure and theDerivative Measure  */
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
+::GetValueAndDerivative( MeasureType & value,
+  DerivativeType  & derivative ) const
+{
+  this->ComputeValueAndDerivative( value, &derivative );
+}
+
+/** Evaluate both terms in one pass over the samples */
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
+::ComputeValueAndDerivative( MeasureType & value,
+  DerivativeType * derivative ) const
+{
+  const unsigned int numberOfInputs = this->GetNumberOfInputs();
 
-  PointSetPointer points[this->GetNumberOfInputs()];
-  PointSetPointer samples[this->GetNumberOfInputs()];
+  std::vector<PointSetPointer> points( numberOfInputs );
+  std::vector<PointSetPointer> samples( numberOfInputs );
 
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
+  RealType totalNumberOfPoints = 0;
+  RealType totalNumberOfSamples = 0;
+  for( unsigned int i = 0; i < numberOfInputs; i++ )
     {
     points[i] = const_cast<PointSetType *>(
       static_cast<const PointSetType *>( this->ProcessObject::GetInput( i ) ) );
@@ -322,445 +212,88 @@ JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
       {
       samples[i] = this->m_SamplePoints[i];
       }
+    totalNumberOfPoints += static_cast<RealType>(
+      points[i]->GetNumberOfPoints() );
+    totalNumberOfSamples += static_cast<RealType>(
+      samples[i]->GetNumberOfPoints() );
     }
 
-  derivative.SetSize( this->GetNumberOfValues(), PointDimension );
-  derivative.Fill( 0 );
+  value.SetSize( 1 );
+  value.Fill( 0 );
 
-  /**
-   * first term
-   */
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
+  if( derivative )
     {
-    unsigned int index = 0;
-    for ( unsigned int j = 0; j < i; j++ )
-      {
-      PointSetPointer pts = const_cast<PointSetType*>(
-        static_cast<const PointSetType*>( this->ProcessObject::GetInput( j ) ) );
-      index += pts->GetNumberOfPoints();
-      }
-    RealType prefactor = 1.0 / ( totalNumberOfSamples * totalNumberOfPoints );
-
-    for( unsigned int k = 0; k < this->GetNumberOfInputs(); k++ )
-      {
-      typename PointSetType::PointsContainerConstIterator It
-        = samples[k]->GetPoints()->Begin();
-      while( It != samples[k]->GetPoints()->End() )
-        {
-        PointType samplePoint = It.Value();
-  
-        RealType probabilityStar = 0.0;
-        for( unsigned int j = 0; j < this->m_DensityFunction.size(); j++ )
-          {
-          probabilityStar += this->m_DensityFunction[j]->Evaluate( samplePoint )
-            * static_cast<RealType>( points[j]->GetNumberOfPoints() );
-          }
-        probabilityStar /= totalNumberOfPoints;
-  
-        if( probabilityStar == 0 )
-          {
-          ++It;
-          continue;
-          }
-  
-        RealType probabilityStarFactor = vcl_pow( probabilityStar,
-          static_cast<RealType>( 2.0 - this->m_Alpha ) );
-  
-        typename GaussianType::MeasurementVectorType sampleMeasurement;
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          sampleMeasurement[d] = samplePoint[d];
-          }
-  
-        typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-          = this->m_DensityFunction[i]->GetNeighborhoodIdentifiers(
-            sampleMeasurement, this->m_EvaluationKNeighborhood[i] );
-  
-        for( unsigned int n = 0; n < neighbors.size(); n++ )
-          {
-          RealType gaussian = this->m_DensityFunction[i]->
-            GetGaussian( neighbors[n] )->Evaluate( sampleMeasurement );
-  
-          if( gaussian == 0 )
-            {
-            continue;
-            }
-  
-          typename GaussianType::MeanType mean
-            = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )->GetMean();
-  
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            mean[d] -= samplePoint[d];
-            }
-  
-          if( this->m_UseAnisotropicCovariances )
-            {
-            typename GaussianType::MatrixType Ci
-              = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )
-                ->GetInverseCovariance();
-            mean = Ci * mean;
-            }
-          else
-            {
-            mean /= vnl_math_sqr( this->m_DensityFunction[i]->
-              GetGaussian( neighbors[n] )->GetSigma() );
-            }
-  
-          mean *= ( prefactor * gaussian / probabilityStarFactor );
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            derivative(index+neighbors[n], d) += mean[d];
-            }
-          }
-        ++It;
-        }
-      }
+    derivative->SetSize( this->GetNumberOfValues(), PointDimension );
+    derivative->Fill( 0 );
     }
+
   /**
-   * second term, i.e. regularization term
+   * Every density enters p* and, through its Gaussians, the derivative
+   * of the points of its own point-set.
    */
-  if( this->m_UseRegularizationTerm )
+  typename EvaluatorType::DensityComponentContainerType
+    components( numberOfInputs );
+  unsigned long index = 0;
+  for( unsigned int i = 0; i < numberOfInputs; i++ )
     {
-    for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-      {
-      unsigned int index = 0;
-      for ( unsigned int j = 0; j < i; j++ )
-        {
-        PointSetPointer pts = const_cast<PointSetType*>(
-          static_cast<const PointSetType*>( this->ProcessObject::GetInput( j ) ) );
-        index += pts->GetNumberOfPoints();
-        }
-      RealType prefactor = -1.0 / ( static_cast<RealType>(
-        samples[i]->GetNumberOfPoints() ) * totalNumberOfPoints );
-
-      typename PointSetType::PointsContainerConstIterator It
-        = samples[i]->GetPoints()->Begin();
-      while( It != samples[i]->GetPoints()->End() )
-        {
-        PointType samplePoint = It.Value();
-
-        RealType probability
-          = this->m_DensityFunction[i]->Evaluate( samplePoint );
-
-        if( probability == 0 )
-          {
-          ++It;
-          continue;
-          }
-
-        RealType probabilityFactor = vcl_pow( probability,
-          static_cast<RealType>( 2.0 - this->m_Alpha ) );
-
-        typename GaussianType::MeasurementVectorType sampleMeasurement;
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          sampleMeasurement[d] = samplePoint[d];
-          }
-
-        typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-          = this->m_DensityFunction[i]->GetNeighborhoodIdentifiers(
-            sampleMeasurement, this->m_EvaluationKNeighborhood[i] );
-
-        for( unsigned int n = 0; n < neighbors.size(); n++ )
-          {
-          RealType gaussian = this->m_DensityFunction[i]->
-            GetGaussian( neighbors[n] )->Evaluate( sampleMeasurement );
-          if( gaussian == 0 )
-            {
-            continue;
-            }
-
-          typename GaussianType::MeanType mean
-            = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )->GetMean();
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            mean[d] -= samplePoint[d];
-            }
-
-          if( this->m_UseAnisotropicCovariances )
-            {
-            typename GaussianType::MatrixType Ci
-              = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )
-                ->GetInverseCovariance();
-            mean = Ci * mean;
-            }
-          else
-            {
-            mean /= vnl_math_sqr( this->m_DensityFunction[i]->
-              GetGaussian( neighbors[n] )->GetSigma() );
-            }
-
-          mean *= ( prefactor * gaussian / probabilityFactor );
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            derivative(index+neighbors[n], d) += mean[d];
-            }
-          }
-        ++It;
-        }
-      }
+    components[i].Density = this->m_DensityFunction[i].GetPointer();
+    components[i].Weight = static_cast<RealType>(
+      points[i]->GetNumberOfPoints() ) / totalNumberOfPoints;
+    components[i].DerivativeOffset = index;
+    components[i].ComputeDerivative = true;
+    index += points[i]->GetNumberOfPoints();
     }
-}
 
-/** Get both the match Measure and theDerivative Measure  */
-template <class TPointSet>
-void
-JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
-::GetValueAndDerivative( MeasureType & value,
-  DerivativeType  & derivative ) const
-{
+  this->m_Evaluator->SetAlpha( this->m_Alpha );
+  this->m_Evaluator->SetNumberOfThreads( this->m_NumberOfThreads );
 
-  RealType totalNumberOfPoints = 0;
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-    {
-    PointSetPointer points = const_cast<PointSetType*>(
-      static_cast<const PointSetType*>( this->ProcessObject::GetInput( i ) ) );
-    totalNumberOfPoints += points->GetNumberOfPoints();
-    }
-  RealType totalNumberOfSamples = 0;
-  for( unsigned int i = 0; i < this->m_SamplePoints.size(); i++ )
+  RealType prefactor = -1.0 / totalNumberOfSamples;
+  if( this->m_Alpha != 1.0 )
     {
-    totalNumberOfSamples += static_cast<RealType>(
-      this->m_SamplePoints[i]->GetNumberOfPoints() );
+    prefactor /= ( this->m_Alpha - 1.0 );
     }
-
-  PointSetPointer points[this->GetNumberOfInputs()];
-  PointSetPointer samples[this->GetNumberOfInputs()];
-
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
+  else
     {
-    points[i] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->ProcessObject::GetInput( i ) ) );
-    if( this->m_UseInputAsSamples )
-      {
-      samples[i] = points[i];
-      }
-    else
-      {
-      samples[i] = this->m_SamplePoints[i];
-      }
+    prefactor /= vnl_math::ln2;
     }
 
-  derivative.SetSize( this->GetNumberOfValues(), PointDimension );
-  derivative.Fill( 0 );
-
-  value.SetSize( 1 );
-  value.Fill( 0 );
-
   RealType energyTerm1 = 0.0;
   RealType energyTerm2 = 0.0;
 
   /**
-   * first term
+   * The samples of point-set i carry the first term and the
+   * regularization term of density i, which share the neighbors of
+   * density i at each sample.
    */
-  for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
+  typename EvaluatorType::SampleContainerType samplePoints;
+  for( unsigned int i = 0; i < numberOfInputs; i++ )
     {
-    unsigned int index = 0;
-    for ( unsigned int j = 0; j < i; j++ )
-      {
-      PointSetPointer pts = const_cast<PointSetType*>(
-        static_cast<const PointSetType*>( this->ProcessObject::GetInput( j ) ) );
-      index += pts->GetNumberOfPoints();
-      }
-    RealType prefactor[2];
-    prefactor[0] = -1.0 / totalNumberOfSamples;
+    RealType numberOfSamples = static_cast<RealType>(
+      samples[i]->GetNumberOfPoints() );
+
+    RealType prefactor2[2];
+    prefactor2[0] = -static_cast<RealType>(
+      points[i]->GetNumberOfPoints() ) / ( totalNumberOfPoints *
+      numberOfSamples );
     if( this->m_Alpha != 1.0 )
       {
-      prefactor[0] /= ( this->m_Alpha - 1.0 );
+      prefactor2[0] /= ( this->m_Alpha - 1.0 );
       }
-    prefactor[1] = 1.0 / ( totalNumberOfSamples * totalNumberOfPoints );
-
-    for( unsigned int k = 0; k < this->GetNumberOfInputs(); k++ )
+    else
       {
-      typename PointSetType::PointsContainerConstIterator It
-        = samples[k]->GetPoints()->Begin();
-      while( It != samples[k]->GetPoints()->End() )
-        {
-        PointType samplePoint = It.Value();
-  
-        RealType probabilityStar = 0.0;
-        for( unsigned int j = 0; j < this->m_DensityFunction.size(); j++ )
-          {
-          probabilityStar += this->m_DensityFunction[j]->Evaluate( samplePoint )
-            * static_cast<RealType>( points[j]->GetNumberOfPoints() );
-          }
-        probabilityStar /= totalNumberOfPoints;
-  
-        if( probabilityStar == 0 )
-          {
-          ++It;
-          continue;
-          }
-  
-        if( this->m_Alpha == 1.0 )
-          {
-          energyTerm1 += ( prefactor[0] *
-            vcl_log( probabilityStar )  / vnl_math::ln2 );
-          }
-        else
-          {
-          energyTerm1 += ( prefactor[0] * vcl_pow( probabilityStar,
-            static_cast<RealType>( this->m_Alpha - 1.0 ) ) );
-          }
-  
-        RealType probabilityStarFactor = vcl_pow( probabilityStar,
-          static_cast<RealType>( 2.0 - this->m_Alpha ) );
-  
-        typename GaussianType::MeasurementVectorType sampleMeasurement;
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          sampleMeasurement[d] = samplePoint[d];
-          }
-  
-        typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-          = this->m_DensityFunction[i]->GetNeighborhoodIdentifiers(
-            sampleMeasurement, this->m_EvaluationKNeighborhood[i] );
-  
-        for( unsigned int n = 0; n < neighbors.size(); n++ )
-          {
-          RealType gaussian = this->m_DensityFunction[i]->
-            GetGaussian( neighbors[n] )->Evaluate( sampleMeasurement );
-  
-          if( gaussian == 0 )
-            {
-            continue;
-            }
-  
-          typename GaussianType::MeanType mean
-            = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )->GetMean();
-  
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            mean[d] -= samplePoint[d];
-            }
-  
-          if( this->m_UseAnisotropicCovariances )
-            {
-            typename GaussianType::MatrixType Ci
-              = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )
-                ->GetInverseCovariance();
-            mean = Ci * mean;
-            }
-          else
-            {
-            mean /= vnl_math_sqr( this->m_DensityFunction[i]->
-              GetGaussian( neighbors[n] )->GetSigma() );
-            }
-  
-          mean *= ( prefactor[1] * gaussian / probabilityStarFactor );
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            derivative(index+neighbors[n], d) += mean[d];
-            }
-          }
-        ++It;
-        }
-      }  
-    }
+      prefactor2[0] /= vnl_math::ln2;
+      }
+    prefactor2[1] = -1.0 / ( numberOfSamples * totalNumberOfPoints );
 
-  /**
-   * second term, i.e. regularization term
-   */
-  if( this->m_UseRegularizationTerm )
-    {
-    for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
-      {
-      unsigned int index = 0;
-      for ( unsigned int j = 0; j < i; j++ )
-        {
-        PointSetPointer pts = const_cast<PointSetType*>(
-          static_cast<const PointSetType*>( this->ProcessObject::GetInput( j ) ) );
-        index += pts->GetNumberOfPoints();
-        }
-      RealType prefactor[2];
-      prefactor[0] = -static_cast<RealType>(
-        points[i]->GetNumberOfPoints() ) / ( totalNumberOfPoints *
-        static_cast<RealType>( samples[i]->GetNumberOfPoints() ) );
-      if( this->m_Alpha != 1.0 )
-        {
-        prefactor[0] /= ( this->m_Alpha - 1.0 );
-        }
-      prefactor[1] = -1.0 / ( static_cast<RealType>(
-        samples[i]->GetNumberOfPoints() ) * totalNumberOfPoints );
+    RealType sum[2];
+    EvaluatorType::GetSamples( samples[i], samplePoints );
+    this->m_Evaluator->Accumulate( samplePoints, components,
+      1.0 / ( totalNumberOfSamples * totalNumberOfPoints ),
+      this->m_UseRegularizationTerm ? static_cast<int>( i ) : -1,
+      prefactor2[1], sum[0], sum[1], derivative );
 
-      typename PointSetType::PointsContainerConstIterator It
-        = samples[i]->GetPoints()->Begin();
-      while( It != samples[i]->GetPoints()->End() )
-        {
-        PointType samplePoint = It.Value();
-
-        RealType probability
-          = this->m_DensityFunction[i]->Evaluate( samplePoint );
-
-        if( probability == 0 )
-          {
-          ++It;
-          continue;
-          }
-
-        if( this->m_Alpha == 1.0 )
-          {
-          energyTerm2 += ( prefactor[0]
-            * vcl_log( probability ) / vnl_math::ln2 );
-          }
-        else
-          {
-          energyTerm2 += ( prefactor[0] * vcl_pow( probability,
-            static_cast<RealType>( this->m_Alpha - 1.0 ) ) );
-          }
-
-        RealType probabilityFactor = vcl_pow( probability,
-          static_cast<RealType>( 2.0 - this->m_Alpha ) );
-
-        typename GaussianType::MeasurementVectorType sampleMeasurement;
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          sampleMeasurement[d] = samplePoint[d];
-          }
-
-        typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-          = this->m_DensityFunction[i]->GetNeighborhoodIdentifiers(
-            sampleMeasurement, this->m_EvaluationKNeighborhood[i] );
-
-        for( unsigned int n = 0; n < neighbors.size(); n++ )
-          {
-          RealType gaussian = this->m_DensityFunction[i]->
-            GetGaussian( neighbors[n] )->Evaluate( sampleMeasurement );
-          if( gaussian == 0 )
-            {
-            continue;
-            }
-
-          typename GaussianType::MeanType mean
-            = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )->GetMean();
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            mean[d] -= samplePoint[d];
-            }
-
-          if( this->m_UseAnisotropicCovariances )
-            {
-            typename GaussianType::MatrixType Ci
-              = this->m_DensityFunction[i]->GetGaussian( neighbors[n] )
-                ->GetInverseCovariance();
-            mean = Ci * mean;
-            }
-          else
-            {
-            mean /= vnl_math_sqr( this->m_DensityFunction[i]->
-              GetGaussian( neighbors[n] )->GetSigma() );
-            }
-
-          mean *= ( prefactor[1] * gaussian / probabilityFactor );
-          for( unsigned int d = 0; d < PointDimension; d++ )
-            {
-            derivative(index+neighbors[n], d) += mean[d];
-            }
-          }
-        ++It;
-        }
-      }
+    energyTerm1 += prefactor * sum[0];
+    energyTerm2 += prefactor2[0] * sum[1];
     }
 
   value[0] = energyTerm1 - energyTerm2;
@@ -785,6 +318,10 @@ JensenHavrdaCharvatTsallisMultiplePointSetMetric<TPointSet>
     {
     os << indent << "Use input points as samples." << std::endl;
     }
+  os << indent << "Use spatial hashing: "
+     << this->m_UseSpatialHashing << std::endl;
+  os << indent << "Number of threads: "
+     << this->m_NumberOfThreads << std::endl;
 
   for( unsigned int i = 0; i < this->GetNumberOfInputs(); i++ )
     {
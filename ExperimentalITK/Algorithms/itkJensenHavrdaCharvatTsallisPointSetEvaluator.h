@@ -0,0 +1,177 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkJensenHavrdaCharvatTsallisPointSetEvaluator.h,v $
+  Language:  C++
+  Date:      $$
+  Version:   $ $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkJensenHavrdaCharvatTsallisPointSetEvaluator_h
+#define __itkJensenHavrdaCharvatTsallisPointSetEvaluator_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkArray2D.h"
+#include "itkMultiThreader.h"
+#include "itkManifoldParzenWindowsPointSetFunction.h"
+
+#include <vector>
+
+namespace itk {
+
+/** \class JensenHavrdaCharvatTsallisPointSetEvaluator
+ * \brief One-pass evaluation of the Jensen-Havrda-Charvat-Tsallis terms.
+ *
+ * Shared by the JHCT point-set metrics.  For every sample x the
+ * contributing Gaussians of each density D_j are looked up once and
+ * used both for the mixture
+ *
+ *   p*(x) = sum_j w_j D_j(x)
+ *
+ * and for the gradient with respect to the Gaussian means,
+ *
+ *   factor * g_n(x) C_n^{-1} ( mu_n - x ) / p*(x)^(2-alpha).
+ *
+ * Optionally one of the densities also carries the regularization term
+ * over the same samples, which reuses the neighbor list already looked
+ * up for the mixture.  The accumulated sums are f(p) = log(p) for
+ * alpha = 1 and p^(alpha-1) otherwise; the metrics apply their own
+ * prefactors.
+ *
+ * The samples are split across threads, each thread accumulating its own
+ * sums and derivative which are reduced afterwards.  The k-d tree search
+ * of the densities is not thread-safe, so more than one thread is only
+ * used if every density has a valid spatial hash (see
+ * ManifoldParzenWindowsPointSetFunction::SetUseSpatialHashing()).
+ */
+template<class TPointSet>
+class ITK_EXPORT JensenHavrdaCharvatTsallisPointSetEvaluator
+  : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef JensenHavrdaCharvatTsallisPointSetEvaluator    Self;
+  typedef Object                                         Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro( JensenHavrdaCharvatTsallisPointSetEvaluator, Object );
+
+  itkStaticConstMacro( PointDimension, unsigned int,
+                       TPointSet::PointDimension );
+
+  typedef TPointSet                                      PointSetType;
+  typedef typename PointSetType::PointType               PointType;
+  typedef std::vector<PointType>                         SampleContainerType;
+
+  typedef double                                         RealType;
+  typedef Array2D<RealType>                              DerivativeType;
+  typedef ManifoldParzenWindowsPointSetFunction
+    <PointSetType, RealType>                             DensityFunctionType;
+  typedef typename DensityFunctionType::GaussianType     GaussianType;
+  typedef typename DensityFunctionType::VectorType       VectorType;
+
+  /** One density of the mixture.  Its gradient is added to the rows of
+   * the derivative starting at DerivativeOffset if ComputeDerivative is
+   * set; otherwise it only contributes to p*. */
+  struct DensityComponentType
+    {
+    DensityFunctionType       *Density;
+    RealType                   Weight;
+    unsigned long              DerivativeOffset;
+    bool                       ComputeDerivative;
+    };
+  typedef std::vector<DensityComponentType>      DensityComponentContainerType;
+
+  itkSetMacro( Alpha, RealType );
+  itkGetConstMacro( Alpha, RealType );
+
+  itkSetClampMacro( NumberOfThreads, int, 1, ITK_MAX_THREADS );
+  itkGetConstMacro( NumberOfThreads, int );
+
+  /** Copies the points of a point set into a sample container. */
+  static void GetSamples( const PointSetType *pointSet,
+    SampleContainerType &samples );
+
+  /**
+   * Accumulates over the samples
+   *   mixtureSum += f( p*(x) )
+   *   regularizationSum += f( D_r(x) ),  r = regularizationComponent
+   * and, if derivative is not null, adds the mixture gradient scaled by
+   * mixtureFactor and the gradient of D_r scaled by regularizationFactor.
+   * A negative regularizationComponent disables the second term.  The
+   * derivative has to be allocated and is not cleared.
+   */
+  void Accumulate( const SampleContainerType &samples,
+    const DensityComponentContainerType &components,
+    RealType mixtureFactor, int regularizationComponent,
+    RealType regularizationFactor, RealType &mixtureSum,
+    RealType &regularizationSum, DerivativeType *derivative ) const;
+
+protected:
+  JensenHavrdaCharvatTsallisPointSetEvaluator();
+  ~JensenHavrdaCharvatTsallisPointSetEvaluator() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Processes samples [begin, end) into the given accumulators. */
+  void AccumulateRange( const SampleContainerType &samples,
+    unsigned long begin, unsigned long end,
+    const DensityComponentContainerType &components,
+    RealType mixtureFactor, int regularizationComponent,
+    RealType regularizationFactor, RealType &mixtureSum,
+    RealType &regularizationSum, RealType *derivative ) const;
+
+  /** Adds factor * g_n C_n^{-1} ( mu_n - x ) for the contributing
+   * Gaussians of one density. */
+  void AddGradient( const DensityComponentType &component,
+    const PointType &point,
+    const typename DensityFunctionType::GaussianIdentifierContainerType &ids,
+    const typename DensityFunctionType::GaussianValueContainerType &values,
+    RealType factor, RealType *derivative ) const;
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE AccumulateThreaderCallback( void *arg );
+
+  struct AccumulateThreadStruct
+    {
+    const Self                              *Evaluator;
+    const SampleContainerType               *Samples;
+    const DensityComponentContainerType     *Components;
+    RealType                                 MixtureFactor;
+    int                                      RegularizationComponent;
+    RealType                                 RegularizationFactor;
+    unsigned long                            NumberOfRows;
+    std::vector<RealType>                   *MixtureSums;
+    std::vector<RealType>                   *RegularizationSums;
+    std::vector<std::vector<RealType> >     *Derivatives;
+    };
+
+private:
+  //purposely not implemented
+  JensenHavrdaCharvatTsallisPointSetEvaluator( const Self& );
+  void operator=( const Self& );
+
+  RealType                                 m_Alpha;
+  int                                      m_NumberOfThreads;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkJensenHavrdaCharvatTsallisPointSetEvaluator.hxx"
+#endif
+
+#endif
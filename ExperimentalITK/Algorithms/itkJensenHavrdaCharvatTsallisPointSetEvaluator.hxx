@@ -0,0 +1,339 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkJensenHavrdaCharvatTsallisPointSetEvaluator.hxx,v $
+  Language:  C++
+  Date:      $$
+  Version:   $ $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkJensenHavrdaCharvatTsallisPointSetEvaluator_hxx
+#define __itkJensenHavrdaCharvatTsallisPointSetEvaluator_hxx
+
+#include "itkJensenHavrdaCharvatTsallisPointSetEvaluator.h"
+
+#include "vnl/vnl_math.h"
+
+namespace itk {
+
+template <class TPointSet>
+JensenHavrdaCharvatTsallisPointSetEvaluator<TPointSet>
+::JensenHavrdaCharvatTsallisPointSetEvaluator()
+{
+  this->m_Alpha = 2.0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisPointSetEvaluator<TPointSet>
+::GetSamples( const PointSetType *pointSet, SampleContainerType &samples )
+{
+  samples.clear();
+  samples.reserve( pointSet->GetNumberOfPoints() );
+
+  typename PointSetType::PointsContainerConstIterator It
+    = pointSet->GetPoints()->Begin();
+  while( It != pointSet->GetPoints()->End() )
+    {
+    samples.push_back( It.Value() );
+    ++It;
+    }
+}
+
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisPointSetEvaluator<TPointSet>
+::Accumulate( const SampleContainerType &samples,
+  const DensityComponentContainerType &components,
+  RealType mixtureFactor, int regularizationComponent,
+  RealType regularizationFactor, RealType &mixtureSum,
+  RealType &regularizationSum, DerivativeType *derivative ) const
+{
+  mixtureSum = 0.0;
+  regularizationSum = 0.0;
+
+  if( samples.empty() || components.empty() )
+    {
+    return;
+    }
+
+  /**
+   * The k-d tree search is not reentrant, so without the spatial hash
+   * all samples are processed by the calling thread.
+   */
+  int numberOfThreads = this->m_NumberOfThreads;
+  for( unsigned int j = 0; j < components.size(); j++ )
+    {
+    if( !components[j].Density->GetSpatialHashIsValid() )
+      {
+      numberOfThreads = 1;
+      }
+    }
+  if( static_cast<unsigned long>( numberOfThreads ) > samples.size() )
+    {
+    numberOfThreads = static_cast<int>( samples.size() );
+    }
+
+  unsigned long numberOfRows = derivative ? derivative->rows() : 0;
+
+  if( numberOfThreads <= 1 )
+    {
+    this->AccumulateRange( samples, 0, samples.size(), components,
+      mixtureFactor, regularizationComponent, regularizationFactor,
+      mixtureSum, regularizationSum,
+      derivative ? derivative->data_block() : NULL );
+    return;
+    }
+
+  std::vector<RealType> mixtureSums( numberOfThreads, 0.0 );
+  std::vector<RealType> regularizationSums( numberOfThreads, 0.0 );
+  std::vector<std::vector<RealType> > derivatives( numberOfThreads );
+
+  AccumulateThreadStruct str;
+  str.Evaluator = this;
+  str.Samples = &samples;
+  str.Components = &components;
+  str.MixtureFactor = mixtureFactor;
+  str.RegularizationComponent = regularizationComponent;
+  str.RegularizationFactor = regularizationFactor;
+  str.NumberOfRows = numberOfRows;
+  str.MixtureSums = &mixtureSums;
+  str.RegularizationSums = &regularizationSums;
+  str.Derivatives = &derivatives;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->AccumulateThreaderCallback, &str );
+  threader->SingleMethodExecute();
+
+  /**
+   * Reduce in thread order so that the result does not depend on the
+   * scheduling.
+   */
+  for( int t = 0; t < numberOfThreads; t++ )
+    {
+    mixtureSum += mixtureSums[t];
+    regularizationSum += regularizationSums[t];
+    if( derivative && !derivatives[t].empty() )
+      {
+      RealType *block = derivative->data_block();
+      for( unsigned long k = 0; k < derivatives[t].size(); k++ )
+        {
+        block[k] += derivatives[t][k];
+        }
+      }
+    }
+}
+
+template <class TPointSet>
+ITK_THREAD_RETURN_TYPE
+JensenHavrdaCharvatTsallisPointSetEvaluator<TPointSet>
+::AccumulateThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  AccumulateThreadStruct *str = (AccumulateThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  unsigned long numberOfSamples = str->Samples->size();
+  unsigned long begin = ( numberOfSamples * threadId ) / threadCount;
+  unsigned long end = ( numberOfSamples * ( threadId + 1 ) ) / threadCount;
+
+  RealType *derivative = NULL;
+  if( str->NumberOfRows > 0 )
+    {
+    (*str->Derivatives)[threadId].assign(
+      str->NumberOfRows * PointDimension, 0.0 );
+    derivative = &( (*str->Derivatives)[threadId][0] );
+    }
+
+  str->Evaluator->AccumulateRange( *str->Samples, begin, end,
+    *str->Components, str->MixtureFactor, str->RegularizationComponent,
+    str->RegularizationFactor, (*str->MixtureSums)[threadId],
+    (*str->RegularizationSums)[threadId], derivative );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisPointSetEvaluator<TPointSet>
+::AccumulateRange( const SampleContainerType &samples,
+  unsigned long begin, unsigned long end,
+  const DensityComponentContainerType &components,
+  RealType mixtureFactor, int regularizationComponent,
+  RealType regularizationFactor, RealType &mixtureSum,
+  RealType &regularizationSum, RealType *derivative ) const
+{
+  const unsigned int numberOfComponents = components.size();
+
+  std::vector<typename DensityFunctionType
+    ::GaussianIdentifierContainerType> ids( numberOfComponents );
+  std::vector<typename DensityFunctionType
+    ::GaussianValueContainerType> values( numberOfComponents );
+  std::vector<RealType> densities( numberOfComponents );
+
+  for( unsigned long s = begin; s < end; s++ )
+    {
+    const PointType &samplePoint = samples[s];
+
+    /**
+     * Look up the contributing Gaussians of every density once.
+     */
+    RealType probabilityStar = 0.0;
+    for( unsigned int j = 0; j < numberOfComponents; j++ )
+      {
+      RealType normalization = components[j].Density
+        ->GetContributingGaussians( samplePoint, ids[j], values[j] );
+      RealType sum = 0.0;
+      for( unsigned int n = 0; n < values[j].size(); n++ )
+        {
+        sum += values[j][n];
+        }
+      densities[j] = ( normalization > 0 ) ? sum / normalization : 0.0;
+      probabilityStar += components[j].Weight * densities[j];
+      }
+
+    /**
+     * first term
+     */
+    if( probabilityStar > 0 )
+      {
+      if( this->m_Alpha == 1.0 )
+        {
+        mixtureSum += vcl_log( probabilityStar );
+        }
+      else
+        {
+        mixtureSum += vcl_pow( probabilityStar,
+          static_cast<RealType>( this->m_Alpha - 1.0 ) );
+        }
+
+      if( derivative )
+        {
+        RealType factor = mixtureFactor / vcl_pow( probabilityStar,
+          static_cast<RealType>( 2.0 - this->m_Alpha ) );
+        for( unsigned int j = 0; j < numberOfComponents; j++ )
+          {
+          if( components[j].ComputeDerivative )
+            {
+            this->AddGradient( components[j], samplePoint, ids[j], values[j],
+              factor, derivative );
+            }
+          }
+        }
+      }
+
+    /**
+     * second term, i.e. regularization term, from the same neighbors
+     */
+    if( regularizationComponent >= 0 )
+      {
+      const unsigned int r = static_cast<unsigned int>(
+        regularizationComponent );
+      RealType probability = densities[r];
+      if( probability > 0 )
+        {
+        if( this->m_Alpha == 1.0 )
+          {
+          regularizationSum += vcl_log( probability );
+          }
+        else
+          {
+          regularizationSum += vcl_pow( probability,
+            static_cast<RealType>( this->m_Alpha - 1.0 ) );
+          }
+
+        if( derivative )
+          {
+          RealType factor = regularizationFactor / vcl_pow( probability,
+            static_cast<RealType>( 2.0 - this->m_Alpha ) );
+          this->AddGradient( components[r], samplePoint, ids[r], values[r],
+            factor, derivative );
+          }
+        }
+      }
+    }
+}
+
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisPointSetEvaluator<TPointSet>
+::AddGradient( const DensityComponentType &component,
+  const PointType &point,
+  const typename DensityFunctionType::GaussianIdentifierContainerType &ids,
+  const typename DensityFunctionType::GaussianValueContainerType &values,
+  RealType factor, RealType *derivative ) const
+{
+  DensityFunctionType *density = component.Density;
+  const bool useCache = density->GetSpatialHashIsValid();
+
+  for( unsigned int n = 0; n < ids.size(); n++ )
+    {
+    RealType gaussian = values[n];
+    if( gaussian == 0 )
+      {
+      continue;
+      }
+
+    VectorType gradient;
+    if( useCache )
+      {
+      density->GetCachedPrecisionTimesOffset( ids[n], point, gradient );
+      }
+    else
+      {
+      typename GaussianType::Pointer g = density->GetGaussian( ids[n] );
+      typename GaussianType::MeanType mean = g->GetMean();
+      for( unsigned int d = 0; d < PointDimension; d++ )
+        {
+        mean[d] -= point[d];
+        }
+      if( density->GetUseAnisotropicCovariances() )
+        {
+        typename GaussianType::MatrixType Ci = g->GetInverseCovariance();
+        mean = Ci * mean;
+        }
+      else
+        {
+        mean /= vnl_math_sqr( g->GetSigma() );
+        }
+      for( unsigned int d = 0; d < PointDimension; d++ )
+        {
+        gradient[d] = mean[d];
+        }
+      }
+
+    RealType *row = derivative
+      + ( component.DerivativeOffset + ids[n] ) * PointDimension;
+    for( unsigned int d = 0; d < PointDimension; d++ )
+      {
+      row[d] += factor * gaussian * gradient[d];
+      }
+    }
+}
+
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisPointSetEvaluator<TPointSet>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Alpha: " << this->m_Alpha << std::endl;
+  os << indent << "Number of threads: "
+     << this->m_NumberOfThreads << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -21,6 +21,7 @@
 
 #include "itkIdentityTransform.h"
 #include "itkManifoldParzenWindowsPointSetFunction.h"
+#include "itkJensenHavrdaCharvatTsallisPointSetEvaluator.h"
 
 namespace itk {
 
@@ -74,6 +75,8 @@ public:
     <PointSetType, RealType>                               DensityFunctionType;
   typedef typename DensityFunctionType::GaussianType       GaussianType;
   typedef IdentityTransform<RealType, PointDimension>      DefaultTransformType;
+  typedef JensenHavrdaCharvatTsallisPointSetEvaluator
+    <PointSetType>                                         EvaluatorType;
 
 
   /**
@@ -175,6 +178,22 @@ public:
   itkSetMacro( MovingKernelSigma, RealType );
   itkGetConstMacro( MovingKernelSigma, RealType );
 
+  /**
+   * Evaluate the densities through their Gaussian grid instead of the
+   * k-d tree.  This is required for the samples to be processed by more
+   * than one thread; since it is off by default, NumberOfThreads has no
+   * effect unless spatial hashing is turned on.
+   */
+  itkSetMacro( UseSpatialHashing, bool );
+  itkGetConstMacro( UseSpatialHashing, bool );
+  itkBooleanMacro( UseSpatialHashing );
+
+  itkSetMacro( CutoffSigma, RealType );
+  itkGetConstMacro( CutoffSigma, RealType );
+
+  itkSetClampMacro( NumberOfThreads, int, 1, ITK_MAX_THREADS );
+  itkGetConstMacro( NumberOfThreads, int );
+
 
 protected:
   JensenHavrdaCharvatTsallisPointSetMetric();
@@ -182,6 +201,10 @@ protected:
 
   void PrintSelf( std::ostream& os, Indent indent ) const;
 
+  /** Value and, if requested, derivative in a single pass. */
+  void ComputeValueAndDerivative( MeasureType & value,
+    DerivativeType * derivative ) const;
+
 private:
   //purposely not implemented
   JensenHavrdaCharvatTsallisPointSetMetric(const Self&);
@@ -210,6 +233,11 @@ private:
 
   RealType                                 m_Alpha;
 
+  bool                                     m_UseSpatialHashing;
+  RealType                                 m_CutoffSigma;
+  int                                      m_NumberOfThreads;
+  typename EvaluatorType::Pointer          m_Evaluator;
+
   TransformPointer                         m_Transform;
 
 };
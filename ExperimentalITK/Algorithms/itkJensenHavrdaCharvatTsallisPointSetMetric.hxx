@@ -44,6 +44,11 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
   this->m_Alpha = 2.0;
   this->m_UseWithRespectToTheMovingPointSet = true;
 
+  this->m_UseSpatialHashing = false;
+  this->m_CutoffSigma = 5.0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_Evaluator = EvaluatorType::New();
+
   typename DefaultTransformType::Pointer transform
     = DefaultTransformType::New();
   transform->SetIdentity();
@@ -74,6 +79,9 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
       this->m_FixedCovarianceKNeighborhood );
   this->m_FixedDensityFunction->SetEvaluationKNeighborhood(
       this->m_FixedEvaluationKNeighborhood );
+  this->m_FixedDensityFunction->SetUseSpatialHashing(
+    this->m_UseSpatialHashing );
+  this->m_FixedDensityFunction->SetCutoffSigma( this->m_CutoffSigma );
   this->m_FixedDensityFunction->SetInputPointSet( this->m_FixedPointSet );
 
   if( !this->m_UseInputAsSamples )
@@ -103,6 +111,9 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
       this->m_MovingCovarianceKNeighborhood );
   this->m_MovingDensityFunction->SetEvaluationKNeighborhood(
       this->m_MovingEvaluationKNeighborhood );
+  this->m_MovingDensityFunction->SetUseSpatialHashing(
+    this->m_UseSpatialHashing );
+  this->m_MovingDensityFunction->SetCutoffSigma( this->m_CutoffSigma );
   this->m_MovingDensityFunction->SetInputPointSet( this->m_MovingPointSet );
 
   if( !this->m_UseInputAsSamples )
@@ -156,155 +167,8 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
    */
 //  this->SetTransformParameters( parameters );
 
-  PointSetPointer points[2];
-  PointSetPointer samples[2];
-
-  typename DensityFunctionType::Pointer densityFunctions[2];
-
-  if( this->m_UseWithRespectToTheMovingPointSet )
-    {
-    points[0] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_FixedPointSet ) );
-    points[1] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_MovingPointSet ) );
-
-    if( this->m_UseInputAsSamples )
-      {
-      samples[0] = points[0];
-      samples[1] = points[1];
-      }
-    else
-      {
-      samples[0] = this->m_FixedSamplePoints;
-      samples[1] = this->m_MovingSamplePoints;
-      }
-    densityFunctions[0] = this->m_FixedDensityFunction;
-    densityFunctions[1] = this->m_MovingDensityFunction;
-    }
-  else
-    {
-    points[1] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_FixedPointSet ) );
-    points[0] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_MovingPointSet ) );
-
-    if( this->m_UseInputAsSamples )
-      {
-      samples[1] = points[1];
-      samples[0] = points[0];
-      }
-    else
-      {
-      samples[1] = this->m_FixedSamplePoints;
-      samples[0] = this->m_MovingSamplePoints;
-      }
-    densityFunctions[1] = this->m_FixedDensityFunction;
-    densityFunctions[0] = this->m_MovingDensityFunction;
-    }
-
-  RealType totalNumberOfPoints
-    = static_cast<RealType>( points[0]->GetNumberOfPoints() )
-    + static_cast<RealType>( points[1]->GetNumberOfPoints() );
-  RealType totalNumberOfSamples
-    = static_cast<RealType>( samples[0]->GetNumberOfPoints() )
-    + static_cast<RealType>( samples[1]->GetNumberOfPoints() );
-
   MeasureType measure;
-  measure.SetSize( 1 );
-  measure.Fill( 0 );
-
-  RealType energyTerm1 = 0.0;
-  RealType energyTerm2 = 0.0;
-
-  /**
-    * first term
-    */
-  RealType prefactor = -1.0 / totalNumberOfSamples;
-  if( this->m_Alpha != 1.0 )
-    {
-    prefactor /= ( this->m_Alpha - 1.0 );
-    }
-  typename PointSetType::PointsContainerConstIterator It
-    = samples[0]->GetPoints()->Begin();
-  while( It != samples[0]->GetPoints()->End() )
-    {
-    PointType samplePoint = It.Value();
-
-    RealType probabilityStar =
-//         densityFunctions[0]->Evaluate( samplePoint ) *
-//         static_cast<RealType>( points[0]->GetNumberOfPoints() ) +
-        densityFunctions[1]->Evaluate( samplePoint ) *
-        static_cast<RealType>( points[1]->GetNumberOfPoints() );
-    probabilityStar /= totalNumberOfPoints;
-
-    if( probabilityStar == 0 )
-      {
-      ++It;
-      continue;
-      }
-
-    if( this->m_Alpha == 1.0 )
-      {
-      energyTerm1 += vcl_log( probabilityStar );
-      }
-    else
-      {
-      energyTerm1 += vcl_pow( probabilityStar,
-        static_cast<RealType>( this->m_Alpha - 1.0 ) );
-      }
-    ++It;
-    }
-  if( this->m_Alpha != 1.0 )
-    {
-    energyTerm1 -= 1.0;
-    }
-  energyTerm1 *= prefactor;
-
-  /**
-    * second term, i.e. regularization term
-    */
-  if( this->m_UseRegularizationTerm )
-    {
-    RealType prefactor2 = -static_cast<RealType>(
-      points[1]->GetNumberOfPoints() ) / ( totalNumberOfPoints *
-      static_cast<RealType>( samples[1]->GetNumberOfPoints() ) );
-    if( this->m_Alpha != 1.0 )
-      {
-      prefactor2 /= ( this->m_Alpha - 1.0 );
-      }
-    typename PointSetType::PointsContainerConstIterator It
-      = samples[1]->GetPoints()->Begin();
-    while( It != samples[1]->GetPoints()->End() )
-      {
-      PointType samplePoint = It.Value();
-
-      RealType probability = densityFunctions[1]->Evaluate( samplePoint );
-
-      if( probability == 0 )
-        {
-        ++It;
-        continue;
-        }
-
-      if( this->m_Alpha == 1.0 )
-        {
-        energyTerm2 += ( prefactor2 * vcl_log( probability ) );
-        }
-      else
-        {
-        energyTerm2 += ( prefactor2 * vcl_pow( probability,
-          static_cast<RealType>( this->m_Alpha - 1.0 ) ) );
-        }
-      ++It;
-      }
-    if( this->m_Alpha != 1.0 )
-      {
-      energyTerm2 -= 1.0;
-      }
-    energyTerm2 *= prefactor2;
-    }
-
-  measure[0] = energyTerm1 - energyTerm2;
+  this->ComputeValueAndDerivative( measure, NULL );
 
   return measure;
 }
@@ -322,222 +186,8 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
    */
 //  this->SetTransformParameters( parameters );
 
-  PointSetPointer points[2];
-  PointSetPointer samples[2];
-
-  typename DensityFunctionType::Pointer densityFunctions[2];
-
-  unsigned int kNeighborhood;
-
-  if( this->m_UseWithRespectToTheMovingPointSet )
-    {
-    points[0] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_FixedPointSet ) );
-    points[1] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_MovingPointSet ) );
-
-    if( this->m_UseInputAsSamples )
-      {
-      samples[0] = points[0];
-      samples[1] = points[1];
-      }
-    else
-      {
-      samples[0] = this->m_FixedSamplePoints;
-      samples[1] = this->m_MovingSamplePoints;
-      }
-    densityFunctions[0] = this->m_FixedDensityFunction;
-    densityFunctions[1] = this->m_MovingDensityFunction;
-
-    kNeighborhood = this->m_MovingEvaluationKNeighborhood;
-    }
-  else
-    {
-    points[1] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_FixedPointSet ) );
-    points[0] = const_cast<PointSetType *>(
-      static_cast<const PointSetType *>( this->m_MovingPointSet ) );
-
-    if( this->m_UseInputAsSamples )
-      {
-      samples[1] = points[1];
-      samples[0] = points[0];
-      }
-    else
-      {
-      samples[1] = this->m_FixedSamplePoints;
-      samples[0] = this->m_MovingSamplePoints;
-      }
-    densityFunctions[1] = this->m_FixedDensityFunction;
-    densityFunctions[0] = this->m_MovingDensityFunction;
-
-    kNeighborhood = this->m_FixedEvaluationKNeighborhood;
-    }
-  RealType totalNumberOfPoints
-    = static_cast<RealType>( points[0]->GetNumberOfPoints() )
-    + static_cast<RealType>( points[1]->GetNumberOfPoints() );
-
-  RealType totalNumberOfSamples
-    = static_cast<RealType>( samples[0]->GetNumberOfPoints() )
-    + static_cast<RealType>( samples[1]->GetNumberOfPoints() );
-
-  derivative.SetSize( points[1]->GetPoints()->Size(), PointDimension );
-  derivative.Fill( 0 );
-
-  /**
-   * first term
-   */
-
-  RealType prefactor = 1.0 / ( totalNumberOfSamples * totalNumberOfPoints );
-
-  typename PointSetType::PointsContainerConstIterator It
-    = samples[0]->GetPoints()->Begin();
-  while( It != samples[0]->GetPoints()->End() )
-    {
-    PointType fixedSamplePoint = It.Value();
-
-    RealType probabilityStar =
-//         densityFunctions[0]->Evaluate( fixedSamplePoint ) *
-//         static_cast<RealType>( points[0]->GetNumberOfPoints() ) +
-        densityFunctions[1]->Evaluate( fixedSamplePoint ) *
-        static_cast<RealType>( points[1]->GetNumberOfPoints() );
-    probabilityStar /= totalNumberOfPoints;
-
-    if( probabilityStar == 0 )
-      {
-      ++It;
-      continue;
-      }
-
-    RealType probabilityStarFactor = vcl_pow( probabilityStar,
-      static_cast<RealType>( 2.0 - this->m_Alpha ) );
-
-    typename GaussianType::MeasurementVectorType sampleMeasurement;
-    for( unsigned int d = 0; d < PointDimension; d++ )
-      {
-      sampleMeasurement[d] = fixedSamplePoint[d];
-      }
-
-    typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-      = densityFunctions[1]->GetNeighborhoodIdentifiers(
-        sampleMeasurement, kNeighborhood );
-
-    for( unsigned int n = 0; n < neighbors.size(); n++ )
-      {
-      RealType gaussian = densityFunctions[1]->
-        GetGaussian( neighbors[n] )->Evaluate( sampleMeasurement );
-
-      if( gaussian == 0 )
-        {
-        continue;
-        }
-
-      typename GaussianType::MeanType mean
-        = densityFunctions[1]->GetGaussian( neighbors[n] )->GetMean();
-
-      for( unsigned int d = 0; d < PointDimension; d++ )
-        {
-        mean[d] -= fixedSamplePoint[d];
-        }
-
-      if( this->m_UseAnisotropicCovariances )
-        {
-        typename GaussianType::MatrixType Ci
-          = densityFunctions[1]->GetGaussian( neighbors[n] )
-            ->GetInverseCovariance();
-        mean = Ci * mean;
-        }
-      else
-        {
-        mean /= vnl_math_sqr(
-          densityFunctions[1]->GetGaussian( neighbors[n] )->GetSigma() );
-        }
-
-      mean *= ( prefactor * gaussian / probabilityStarFactor );
-      for( unsigned int d = 0; d < PointDimension; d++ )
-        {
-        derivative(neighbors[n], d) += mean[d];
-        }
-      }
-    ++It;
-    }
-
-  /**
-   * second term, i.e. regularization term
-   */
-  if( this->m_UseRegularizationTerm )
-    {
-    RealType prefactor2 = -1.0 / ( static_cast<RealType>(
-      samples[1]->GetNumberOfPoints() ) * totalNumberOfPoints );
-
-    typename PointSetType::PointsContainerConstIterator It
-      = samples[1]->GetPoints()->Begin();
-    while( It != samples[1]->GetPoints()->End() )
-      {
-      PointType movingSamplePoint = It.Value();
-
-      RealType probability = densityFunctions[1]->Evaluate( movingSamplePoint );
-
-      if( probability == 0 )
-        {
-        ++It;
-        continue;
-        }
-
-      RealType probabilityFactor = vcl_pow( probability,
-        static_cast<RealType>( 2.0 - this->m_Alpha ) );
-      probabilityFactor *= ( samples[1]->GetNumberOfPoints()
-        / totalNumberOfSamples );
-
-      typename GaussianType::MeasurementVectorType sampleMeasurement;
-      for( unsigned int d = 0; d < PointDimension; d++ )
-        {
-        sampleMeasurement[d] = movingSamplePoint[d];
-        }
-
-      typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-        = densityFunctions[1]->GetNeighborhoodIdentifiers(
-          sampleMeasurement, kNeighborhood );
-
-      for( unsigned int i = 0; i < neighbors.size(); i++ )
-        {
-        RealType gaussian = densityFunctions[1]->
-          GetGaussian( neighbors[i] )->Evaluate( sampleMeasurement );
-        if( gaussian == 0 )
-          {
-          continue;
-          }
-
-        typename GaussianType::MeanType mean
-          = densityFunctions[1]->GetGaussian( neighbors[i] )->GetMean();
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          mean[d] -= movingSamplePoint[d];
-          }
-
-        if( this->m_UseAnisotropicCovariances )
-          {
-          typename GaussianType::MatrixType Ci
-            = densityFunctions[1]->GetGaussian( neighbors[i] )
-              ->GetInverseCovariance();
-          mean = Ci * mean;
-          }
-        else
-          {
-          mean /= vnl_math_sqr(
-            densityFunctions[1]->GetGaussian( neighbors[i] )->GetSigma() );
-          }
-
-        mean *= ( prefactor2 * gaussian / probabilityFactor );
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          derivative(neighbors[i], d) += mean[d];
-          }
-        }
-      ++It;
-      }
-    }
-
+  MeasureType measure;
+  this->ComputeValueAndDerivative( measure, &derivative );
 }
 
 /** Get both the match Measure and theDerivative Measure  */
@@ -553,13 +203,21 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
    */
 //  this->SetTransformParameters( parameters );
 
+  this->ComputeValueAndDerivative( value, &derivative );
+}
+
+/** Evaluate both terms in one pass over the samples */
+template <class TPointSet>
+void
+JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
+::ComputeValueAndDerivative( MeasureType & value,
+  DerivativeType * derivative ) const
+{
   PointSetPointer points[2];
   PointSetPointer samples[2];
 
   typename DensityFunctionType::Pointer densityFunctions[2];
 
-  unsigned int kNeighborhood;
-
   if( this->m_UseWithRespectToTheMovingPointSet )
     {
     points[0] = const_cast<PointSetType *>(
@@ -579,8 +237,6 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
       }
     densityFunctions[0] = this->m_FixedDensityFunction;
     densityFunctions[1] = this->m_MovingDensityFunction;
-
-    kNeighborhood = this->m_MovingEvaluationKNeighborhood;
     }
   else
     {
@@ -601,222 +257,90 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
       }
     densityFunctions[1] = this->m_FixedDensityFunction;
     densityFunctions[0] = this->m_MovingDensityFunction;
-
-    kNeighborhood = this->m_FixedEvaluationKNeighborhood;
     }
+
   RealType totalNumberOfPoints
     = static_cast<RealType>( points[0]->GetNumberOfPoints() )
     + static_cast<RealType>( points[1]->GetNumberOfPoints() );
-
   RealType totalNumberOfSamples
     = static_cast<RealType>( samples[0]->GetNumberOfPoints() )
     + static_cast<RealType>( samples[1]->GetNumberOfPoints() );
 
-  derivative.SetSize( points[1]->GetPoints()->Size(), PointDimension );
-  derivative.Fill( 0 );
-
   value.SetSize( 1 );
   value.Fill( 0 );
 
-  /**
-   * first term
-   */
-  RealType energyTerm1 = 0.0;
-  RealType energyTerm2 = 0.0;
-
-  RealType prefactor[2];
-  prefactor[0] = -1.0 / totalNumberOfSamples;
-  if( this->m_Alpha != 1.0 )
+  if( derivative )
     {
-    prefactor[0] /= ( this->m_Alpha - 1.0 );
+    derivative->SetSize( points[1]->GetPoints()->Size(), PointDimension );
+    derivative->Fill( 0 );
     }
-  prefactor[1] = 1.0 / ( totalNumberOfSamples * totalNumberOfPoints );
-
-  typename PointSetType::PointsContainerConstIterator It
-    = samples[0]->GetPoints()->Begin();
-  while( It != samples[0]->GetPoints()->End() )
-    {
-    PointType fixedSamplePoint = It.Value();
-
-    RealType probabilityStar =
-//       densityFunctions[0]->Evaluate( fixedSamplePoint ) *
-//       static_cast<RealType>( points[0]->GetNumberOfPoints() ) +
-      densityFunctions[1]->Evaluate( fixedSamplePoint ) *
-      static_cast<RealType>( points[1]->GetNumberOfPoints() );
 
-    probabilityStar /= totalNumberOfPoints;
+  this->m_Evaluator->SetAlpha( this->m_Alpha );
+  this->m_Evaluator->SetNumberOfThreads( this->m_NumberOfThreads );
 
-    if( probabilityStar == 0 )
-      {
-      ++It;
-      continue;
-      }
-
-    if( this->m_Alpha == 1.0 )
-      {
-      energyTerm1 += ( prefactor[0] * vcl_log( probabilityStar ) );
-      }
-    else
-      {
-      energyTerm1 += ( prefactor[0] * vcl_pow( probabilityStar,
-        static_cast<RealType>( this->m_Alpha - 1.0 ) ) );
-      }
+  /**
+   * Only the density of points[1] enters p*; the density of points[0]
+   * is constant with respect to the derivative.
+   */
+  typename EvaluatorType::DensityComponentContainerType components( 1 );
+  components[0].Density = densityFunctions[1].GetPointer();
+  components[0].DerivativeOffset = 0;
+  components[0].ComputeDerivative = true;
 
-    RealType probabilityStarFactor = vcl_pow( probabilityStar,
-      static_cast<RealType>( 2.0 - this->m_Alpha ) );
+  typename EvaluatorType::SampleContainerType samplePoints;
+  RealType sum = 0.0;
+  RealType unused = 0.0;
 
-    typename GaussianType::MeasurementVectorType sampleMeasurement;
-    for( unsigned int d = 0; d < PointDimension; d++ )
-      {
-      sampleMeasurement[d] = fixedSamplePoint[d];
-      }
+  /**
+   * first term
+   */
+  components[0].Weight = static_cast<RealType>(
+    points[1]->GetNumberOfPoints() ) / totalNumberOfPoints;
 
-    typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-      = densityFunctions[1]->GetNeighborhoodIdentifiers(
-        sampleMeasurement, kNeighborhood );
+  EvaluatorType::GetSamples( samples[0], samplePoints );
+  this->m_Evaluator->Accumulate( samplePoints, components,
+    1.0 / ( totalNumberOfSamples * totalNumberOfPoints ), -1, 0.0,
+    sum, unused, derivative );
 
-    for( unsigned int n = 0; n < neighbors.size(); n++ )
-      {
-      RealType gaussian = densityFunctions[1]->
-        GetGaussian( neighbors[n] )->Evaluate( sampleMeasurement );
-
-      if( gaussian == 0 )
-        {
-        continue;
-        }
-
-      typename GaussianType::MeanType mean
-        = densityFunctions[1]->GetGaussian( neighbors[n] )->GetMean();
-
-      for( unsigned int d = 0; d < PointDimension; d++ )
-        {
-        mean[d] -= fixedSamplePoint[d];
-        }
-
-      if( this->m_UseAnisotropicCovariances )
-        {
-        typename GaussianType::MatrixType Ci
-          = densityFunctions[1]->GetGaussian( neighbors[n] )
-            ->GetInverseCovariance();
-        mean = Ci * mean;
-        }
-      else
-        {
-        mean /= vnl_math_sqr(
-          densityFunctions[1]->GetGaussian( neighbors[n] )->GetSigma() );
-        }
-
-      mean *= ( prefactor[1] * gaussian / probabilityStarFactor );
-      for( unsigned int d = 0; d < PointDimension; d++ )
-        {
-        derivative(neighbors[n], d) += mean[d];
-        }
-      }
-    ++It;
-    }
+  RealType prefactor = -1.0 / totalNumberOfSamples;
   if( this->m_Alpha != 1.0 )
     {
-    energyTerm1 -= 1.0;
+    prefactor /= ( this->m_Alpha - 1.0 );
+    sum -= 1.0;
     }
-  energyTerm1 *= prefactor[0];
+  RealType energyTerm1 = prefactor * sum;
 
   /**
    * second term, i.e. regularization term
    */
+  RealType energyTerm2 = 0.0;
   if( this->m_UseRegularizationTerm )
     {
+    RealType numberOfSamples = static_cast<RealType>(
+      samples[1]->GetNumberOfPoints() );
+
     RealType prefactor2[2];
     prefactor2[0] = -static_cast<RealType>(
       points[1]->GetNumberOfPoints() ) / ( totalNumberOfPoints *
-      static_cast<RealType>( samples[1]->GetNumberOfPoints() ) );
-    prefactor2[1] = -1.0 / ( static_cast<RealType>(
-      samples[1]->GetNumberOfPoints() ) * totalNumberOfPoints );
+      numberOfSamples );
     if( this->m_Alpha != 1.0 )
       {
       prefactor2[0] /= ( this->m_Alpha - 1.0 );
       }
+    prefactor2[1] = -1.0 / ( numberOfSamples * totalNumberOfPoints )
+      * ( totalNumberOfSamples / numberOfSamples );
+
+    components[0].Weight = 1.0;
+
+    EvaluatorType::GetSamples( samples[1], samplePoints );
+    this->m_Evaluator->Accumulate( samplePoints, components,
+      prefactor2[1], -1, 0.0, sum, unused, derivative );
 
-    typename PointSetType::PointsContainerConstIterator It
-      = samples[1]->GetPoints()->Begin();
-    while( It != samples[1]->GetPoints()->End() )
-      {
-      PointType movingSamplePoint = It.Value();
-
-      RealType probability = densityFunctions[1]->Evaluate( movingSamplePoint );
-
-      if( probability == 0 )
-        {
-        ++It;
-        continue;
-        }
-
-      if( this->m_Alpha == 1.0 )
-        {
-        energyTerm2 += ( prefactor2[0] * vcl_log( probability ) );
-        }
-      else
-        {
-        energyTerm2 += ( prefactor2[0] * vcl_pow( probability,
-          static_cast<RealType>( this->m_Alpha - 1.0 ) ) );
-        }
-
-      RealType probabilityFactor = vcl_pow( probability,
-        static_cast<RealType>( 2.0 - this->m_Alpha ) );
-      probabilityFactor *= ( samples[1]->GetNumberOfPoints()
-        / totalNumberOfSamples );
-
-      typename GaussianType::MeasurementVectorType sampleMeasurement;
-      for( unsigned int d = 0; d < PointDimension; d++ )
-        {
-        sampleMeasurement[d] = movingSamplePoint[d];
-        }
-
-      typename DensityFunctionType::NeighborhoodIdentifierType neighbors
-        = densityFunctions[1]->GetNeighborhoodIdentifiers(
-          sampleMeasurement, kNeighborhood );
-
-      for( unsigned int i = 0; i < neighbors.size(); i++ )
-        {
-        RealType gaussian = densityFunctions[1]->
-          GetGaussian( neighbors[i] )->Evaluate( sampleMeasurement );
-        if( gaussian == 0 )
-          {
-          continue;
-          }
-
-        typename GaussianType::MeanType mean
-          = densityFunctions[1]->GetGaussian( neighbors[i] )->GetMean();
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          mean[d] -= movingSamplePoint[d];
-          }
-
-        if( this->m_UseAnisotropicCovariances )
-          {
-          typename GaussianType::MatrixType Ci
-            = densityFunctions[1]->GetGaussian( neighbors[i] )
-              ->GetInverseCovariance();
-          mean = Ci * mean;
-          }
-        else
-          {
-          mean /= vnl_math_sqr(
-            densityFunctions[1]->GetGaussian( neighbors[i] )->GetSigma() );
-          }
-
-        mean *= ( prefactor2[1] * gaussian / probabilityFactor );
-        for( unsigned int d = 0; d < PointDimension; d++ )
-          {
-          derivative(neighbors[i], d) += mean[d];
-          }
-        }
-      ++It;
-      }
     if( this->m_Alpha != 1.0 )
       {
-      energyTerm2 -= 1.0;
+      sum -= 1.0;
       }
-    energyTerm2 *= prefactor2[0];
+    energyTerm2 = prefactor2[0] * sum;
     }
 
   value[0] = energyTerm1 - energyTerm2;
@@ -868,6 +392,15 @@ JensenHavrdaCharvatTsallisPointSetMetric<TPointSet>
     {
     os << indent << "Isotropic covariances are used." << std::endl;
     }
+  os << indent << "Use spatial hashing: "
+     << this->m_UseSpatialHashing << std::endl;
+  if( this->m_UseSpatialHashing )
+    {
+    os << indent << "Cutoff sigma: "
+       << this->m_CutoffSigma << std::endl;
+    }
+  os << indent << "Number of threads: "
+     << this->m_NumberOfThreads << std::endl;
 }
 
 } // end namespace itk
@@ -27,6 +27,9 @@
 #include "itkBSplineInterpolateImageFunction.h"
 #include "itkBSplineDeformableTransform.h"
 #include "itkArray2D.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -90,6 +93,15 @@ namespace itk
  * One the PDF's have been contructed, the mutual information
  * is obtained by doubling summing over the discrete PDF values.
  *
+ * The derivative is linear in the derivatives of the joint PDF, so it is
+ * computed without storing them: once the joint PDF is known, each of
+ * its bins gets the weight of its derivative in the metric derivative,
+ * and a second pass over the samples adds the weighted Parzen window
+ * derivatives of each sample to the parameters it depends on.  With a
+ * BSplineDeformableTransform these are only the parameters of the
+ * control points in the support of the sample.  Both passes are run in
+ * parallel over the samples, with per thread histograms and derivatives.
+ *
  *
  * Notes: 
  * 1. This class returns the negative mutual information value.
@@ -205,6 +217,10 @@ public:
   itkGetConstReferenceMacro(UseAllPixels,bool);
   itkBooleanMacro(UseAllPixels);
 
+  /** Number of threads used to go through the samples. */
+  itkSetClampMacro( NumberOfThreads, unsigned int, 1, ITK_MAX_THREADS );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
 
 protected:
 
@@ -267,21 +283,15 @@ private:
   /** The moving image marginal PDF. */
   mutable MarginalPDFType m_MovingImageMarginalPDF;
 
-  /** Typedef for the joint PDF and PDF derivatives are stored as ITK Images. */
+  /** Typedef for the joint PDF is stored as ITK Image. */
   typedef Image<PDFValueType,2>                  JointPDFType;
-  typedef Image<PDFValueType,3>                  JointPDFDerivativesType;
   typedef JointPDFType::IndexType                JointPDFIndexType;
   typedef JointPDFType::PixelType                JointPDFValueType;
   typedef JointPDFType::RegionType               JointPDFRegionType;
   typedef JointPDFType::SizeType                 JointPDFSizeType;
-  typedef JointPDFDerivativesType::IndexType     JointPDFDerivativesIndexType;
-  typedef JointPDFDerivativesType::PixelType     JointPDFDerivativesValueType;
-  typedef JointPDFDerivativesType::RegionType    JointPDFDerivativesRegionType;
-  typedef JointPDFDerivativesType::SizeType      JointPDFDerivativesSizeType;
 
-  /** The joint PDF and PDF derivatives. */
+  /** The joint PDF. */
   typename JointPDFType::Pointer m_JointPDF;
-  typename JointPDFDerivativesType::Pointer m_JointPDFDerivatives;
 
   unsigned long m_NumberOfSpatialSamples;
   unsigned long m_NumberOfParameters;
@@ -340,11 +350,65 @@ private:
   typename DerivativeFunctionType::Pointer m_DerivativeCalculator;
 
 
-  /** Compute PDF derivative contribution for each parameter. */
-  virtual void ComputePDFDerivatives( unsigned int sampleNumber,
-                                      int movingImageParzenWindowIndex,
-                                      const ImageDerivativesType& movingImageGradientValue,
-                                      double cubicBSplineDerivativeValue ) const;
+  /**
+   * Fills and normalizes the joint and marginal PDFs from the samples
+   * mapped with the given parameters.  If cacheSampleValues is set, the
+   * moving image Parzen window term and gradient of each sample are kept
+   * for ComputeDerivative().  Returns the number of valid samples.
+   */
+  unsigned long ComputeJointPDF( const ParametersType& parameters,
+                                 bool cacheSampleValues ) const;
+
+  /**
+   * Derivative of the metric from the weights of the derivatives of the
+   * joint PDF bins (fixed image bin major), using the values cached by
+   * ComputeJointPDF().
+   */
+  void ComputeDerivative( const std::vector<double> & binWeights,
+                          unsigned long numberOfValidSamples,
+                          DerivativeType & derivative ) const;
+
+  /** Adds the derivative contribution of one sample, scaled by the
+   * weighted Parzen window derivative, to the derivative. */
+  void AddSampleDerivative( unsigned int sampleNumber, double scale,
+                            double *derivative ) const;
+
+  /** Central bin of the moving image Parzen window, kept within the
+   * valid bins. */
+  unsigned int GetMovingImageParzenWindowIndex( double parzenWindowTerm ) const;
+
+  struct ThreadStruct
+    {
+    const Self                               *Metric;
+    const ParametersType                     *Parameters;
+    bool                                      CacheSampleValues;
+    const std::vector<double>                *BinWeights;
+    double                                    DerivativeFactor;
+    };
+
+  /** Static functions used as "callbacks" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE JointPDFThreaderCallback( void *arg );
+  static ITK_THREAD_RETURN_TYPE DerivativeThreaderCallback( void *arg );
+
+  void RunThreads( ThreadStruct *str, ThreadFunctionType callback,
+                   unsigned int numberOfThreads ) const;
+
+  /** Contiguous range of samples of a thread. */
+  void GetThreadSamples( int threadId, int threadCount,
+                         unsigned long & begin, unsigned long & end ) const;
+
+  unsigned int m_NumberOfThreads;
+
+  /** Histograms and derivatives accumulated by each thread. */
+  mutable std::vector<std::vector<double> >  m_ThreaderJointPDFs;
+  mutable std::vector<std::vector<double> >  m_ThreaderFixedImageMarginalPDFs;
+  mutable std::vector<unsigned long>         m_ThreaderNumberOfSamples;
+  mutable std::vector<std::vector<double> >  m_ThreaderDerivatives;
+
+  /** Values of the samples cached for the derivative pass. */
+  mutable std::vector<unsigned char>         m_SampleIsValid;
+  mutable std::vector<double>                m_MovingImageParzenWindowTerms;
+  mutable std::vector<ImageDerivativesType>  m_MovingImageGradients;
 
   /**
    * Types and variables related to BSpline deformable transforms.
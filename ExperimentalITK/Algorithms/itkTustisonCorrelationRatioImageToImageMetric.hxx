@@ -50,7 +50,6 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
 
   // Initialize PDFs to NULL
   m_JointPDF = NULL;
-  m_JointPDFDerivatives = NULL;
 
   typename BSplineTransformType::Pointer transformer = BSplineTransformType::New();
   this->SetTransform (transformer);
@@ -73,6 +72,7 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
   m_BSplineTransform = NULL;
   m_NumberOfParameters = 0;
   m_UseAllPixels = false;
+  m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
   m_ReseedIterator = false;
   m_RandomSeed = -1;
 }
@@ -95,6 +95,8 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
   os << m_NumberOfHistogramBins << std::endl;
   os << indent << "UseAllPixels: ";
   os << m_UseAllPixels << std::endl;
+  os << indent << "NumberOfThreads: ";
+  os << m_NumberOfThreads << std::endl;
 
   // Debugging information
   os << indent << "NumberOfParameters: ";
@@ -254,21 +256,17 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
   m_MovingImageMarginalPDF.resize( m_NumberOfHistogramBins, 0.0 );
 
   /**
-   * Allocate memory for the joint PDF and joint PDF derivatives.
-   * The joint PDF and joint PDF derivatives are store as itk::Image.
+   * Allocate memory for the joint PDF which is stored as itk::Image.
+   * The derivatives of the joint PDF are not stored, see
+   * GetValueAndDerivative().
    */
   m_JointPDF = JointPDFType::New();
-  m_JointPDFDerivatives = JointPDFDerivativesType::New();
 
   // Instantiate a region, index, size
   JointPDFRegionType            jointPDFRegion;
   JointPDFIndexType              jointPDFIndex;
   JointPDFSizeType              jointPDFSize;
 
-  JointPDFDerivativesRegionType  jointPDFDerivativesRegion;
-  JointPDFDerivativesIndexType  jointPDFDerivativesIndex;
-  JointPDFDerivativesSizeType    jointPDFDerivativesSize;
-
   // For the joint PDF define a region starting from {0,0} 
   // with size {m_NumberOfHistogramBins, m_NumberOfHistogramBins}.
   // The dimension represents fixed image parzen window index
@@ -283,23 +281,6 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
   m_JointPDF->SetRegions( jointPDFRegion );
   m_JointPDF->Allocate();
 
-  // For the derivatives of the joint PDF define a region starting from {0,0,0} 
-  // with size {m_NumberOfParameters,m_NumberOfHistogramBins, 
-  // m_NumberOfHistogramBins}. The dimension represents transform parameters,
-  // fixed image parzen window index and moving image parzen window index,
-  // respectively. 
-  jointPDFDerivativesIndex.Fill( 0 ); 
-  jointPDFDerivativesSize[0] = m_NumberOfParameters;
-  jointPDFDerivativesSize[1] = m_NumberOfHistogramBins;
-  jointPDFDerivativesSize[2] = m_NumberOfHistogramBins;
-
-  jointPDFDerivativesRegion.SetIndex( jointPDFDerivativesIndex );
-  jointPDFDerivativesRegion.SetSize( jointPDFDerivativesSize );
-
-  // Set the regions and allocate
-  m_JointPDFDerivatives->SetRegions( jointPDFDerivativesRegion );
-  m_JointPDFDerivatives->Allocate();
-
 
   /**
    * Setup the kernels used for the Parzen windows.
@@ -625,202 +606,7 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
 ::GetValue( const ParametersType& parameters ) const
 {
 
-  // Reset marginal pdf to all zeros.
-  // Assumed the size has already been set to NumberOfHistogramBins
-  // in Initialize().
-  for ( unsigned int j = 0; j < m_NumberOfHistogramBins; j++ )
-    {
-    m_FixedImageMarginalPDF[j]  = 0.0;
-    m_MovingImageMarginalPDF[j] = 0.0;
-    }
-
-  // Reset the joint pdfs to zero
-  m_JointPDF->FillBuffer( 0.0 );
-
-  // Set up the parameters in the transform
-  this->m_Transform->SetParameters( parameters );
-
-
-  // Declare iterators for iteration over the sample container
-  typename FixedImageSpatialSampleContainer::const_iterator fiter;
-  typename FixedImageSpatialSampleContainer::const_iterator fend = 
-    m_FixedImageSamples.end();
-
-  unsigned long nSamples=0;
-  unsigned long nFixedImageSamples=0;
-
-
-  for ( fiter = m_FixedImageSamples.begin(); fiter != fend; ++fiter )
-    {
-
-    // Get moving image value
-    MovingImagePointType mappedPoint;
-    bool sampleOk;
-    double movingImageValue;
-
-    this->TransformPoint( nFixedImageSamples, parameters, mappedPoint, 
-                          sampleOk, movingImageValue );
-
-    ++nFixedImageSamples;
-
-    if ( sampleOk )
-      {
-
-      ++nSamples; 
-
-      /**
-       * Compute this sample's contribution to the marginal and joint distributions.
-       *
-       */
-
-      // Determine parzen window arguments (see eqn 6 of Mattes paper [2]).    
-      double movingImageParzenWindowTerm =
-        movingImageValue / m_MovingImageBinSize - m_MovingImageNormalizedMin;
-      unsigned int movingImageParzenWindowIndex = 
-        static_cast<unsigned int>( vcl_floor(movingImageParzenWindowTerm ) );
-
-      // Make sure the extreme values are in valid bins
-      if ( movingImageParzenWindowIndex < 2 )
-        {
-        movingImageParzenWindowIndex = 2;
-        }
-      else if ( movingImageParzenWindowIndex > ( m_NumberOfHistogramBins - 3 ) )
-        {
-        movingImageParzenWindowIndex = m_NumberOfHistogramBins - 3;
-        }
-
-
-      // Since a zero-order BSpline (box car) kernel is used for
-      // the fixed image marginal pdf, we need only increment the
-      // fixedImageParzenWindowIndex by value of 1.0.
-      m_FixedImageMarginalPDF[(*fiter).FixedImageParzenWindowIndex] += 
-        static_cast<PDFValueType>( 1 );
-        
-      /**
-        * The region of support of the parzen window determines which bins
-        * of the joint PDF are effected by the pair of image values.
-        * Since we are using a cubic spline for the moving image parzen
-        * window, four bins are affected.  The fixed image parzen window is
-        * a zero-order spline (box car) and thus effects only one bin.
-        *
-        *  The PDF is arranged so that moving image bins corresponds to the 
-        * zero-th (column) dimension and the fixed image bins corresponds
-        * to the first (row) dimension.
-        *
-        */
-      
-      // Pointer to affected bin to be updated
-      JointPDFValueType *pdfPtr = m_JointPDF->GetBufferPointer() +
-        ( (*fiter).FixedImageParzenWindowIndex * m_JointPDF->GetOffsetTable()[1] );
- 
-      // Move the pointer to the first affected bin
-      int pdfMovingIndex = static_cast<int>( movingImageParzenWindowIndex ) - 1;
-      pdfPtr += pdfMovingIndex;
-
-      for ( ; pdfMovingIndex <= static_cast<int>( movingImageParzenWindowIndex ) + 2;
-            pdfMovingIndex++, pdfPtr++ )
-        {
-
-        // Update PDF for the current intensity pair
-        double movingImageParzenWindowArg = 
-          static_cast<double>( pdfMovingIndex ) - 
-          static_cast<double>( movingImageParzenWindowTerm );
-
-        *(pdfPtr) += static_cast<PDFValueType>( 
-          m_CubicBSplineKernel->Evaluate( movingImageParzenWindowArg ) );
-
-        }  //end parzen windowing for loop
-
-      } //end if-block check sampleOk
-    } // end iterating over fixed image spatial sample container for loop
-
-  itkDebugMacro( "Ratio of voxels mapping into moving image buffer: " 
-                 << nSamples << " / " << m_NumberOfSpatialSamples << std::endl );
-
-  if ( nSamples < m_NumberOfSpatialSamples / 4 )
-    {
-    itkExceptionMacro( "Too many samples map outside moving image buffer: "
-                       << nSamples << " / " << m_NumberOfSpatialSamples << std::endl );
-    }
-
-
-  /**
-   * Normalize the PDFs, compute moving image marginal PDF
-   *
-   */
-  typedef ImageRegionIterator<JointPDFType> JointPDFIteratorType;
-  JointPDFIteratorType jointPDFIterator ( m_JointPDF, m_JointPDF->GetBufferedRegion() );
-
-  jointPDFIterator.GoToBegin();
-  
-  // Compute joint PDF normalization factor (to ensure joint PDF sum adds to 1.0)
-  double jointPDFSum = 0.0;
-
-  while ( !jointPDFIterator.IsAtEnd() )
-    {
-    jointPDFSum += jointPDFIterator.Get();
-    ++jointPDFIterator;
-    }
-
-  if ( jointPDFSum == 0.0 )
-    {
-    itkExceptionMacro( "Joint PDF summed to zero" );
-    }
-
-
-  // Normalize the PDF bins
-  jointPDFIterator.GoToEnd();
-  while ( !jointPDFIterator.IsAtBegin() )
-    {
-    --jointPDFIterator;
-    jointPDFIterator.Value() /= static_cast<PDFValueType>( jointPDFSum );
-    }
-
-
-  // Normalize the fixed image marginal PDF
-  double fixedPDFSum = 0.0;
-  for ( unsigned int bin = 0; bin < m_NumberOfHistogramBins; bin++ )
-    {
-    fixedPDFSum += m_FixedImageMarginalPDF[bin];
-    }
-
-  if ( fixedPDFSum == 0.0 )
-    {
-    itkExceptionMacro( "Fixed image marginal PDF summed to zero" );
-    }
-
-  for ( unsigned int bin = 0; bin < m_NumberOfHistogramBins; bin++ )
-    {
-    m_FixedImageMarginalPDF[bin] /= static_cast<PDFValueType>( fixedPDFSum );
-    }
-
-
-  // Compute moving image marginal PDF by summing over fixed image bins.
-  typedef ImageLinearIteratorWithIndex<JointPDFType> JointPDFLinearIterator;
-  JointPDFLinearIterator linearIter( 
-    m_JointPDF, m_JointPDF->GetBufferedRegion() );
-
-  linearIter.SetDirection( 1 );
-  linearIter.GoToBegin();
-  unsigned int movingIndex = 0;
-
-  while( !linearIter.IsAtEnd() )
-    {
-
-    double sum = 0.0;
-
-    while( !linearIter.IsAtEndOfLine() )
-      {
-      sum += linearIter.Get();
-      ++linearIter;
-      }
-
-    m_MovingImageMarginalPDF[movingIndex] = static_cast<PDFValueType>(sum);
-
-    linearIter.NextLine();
-    ++movingIndex;
-
-    }
+  this->ComputeJointPDF( parameters, false );
 
   /**
    * Compute the metric by double summation over histogram.
@@ -884,343 +670,110 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
   derivative = DerivativeType( this->GetNumberOfParameters() );
   derivative.Fill( NumericTraits< MeasureType >::Zero );
 
+  // Build the PDFs, keeping the moving image values and gradients of the
+  // samples for the derivative pass.
+  const unsigned long nSamples = this->ComputeJointPDF( parameters, true );
 
-  // Reset marginal pdf to all zeros.
-  // Assumed the size has already been set to NumberOfHistogramBins
-  // in Initialize().
-  for ( unsigned int j = 0; j < m_NumberOfHistogramBins; j++ )
+  /**
+   * Compute the metric by double summation over histogram.
+   */
+  double movingSum = 0.0;
+  double movingSquaredSum = 0.0;
+  for ( unsigned int movingIndex = 0; movingIndex < m_NumberOfHistogramBins; ++movingIndex )      
     {
-    m_FixedImageMarginalPDF[j]  = 0.0;
-    m_MovingImageMarginalPDF[j] = 0.0;
+    double movingImagePDFValue = m_MovingImageMarginalPDF[movingIndex];
+    movingSum += static_cast<double>( movingIndex ) * movingImagePDFValue;
+    movingSquaredSum += static_cast<double>( vnl_math_sqr( movingIndex ) ) * movingImagePDFValue;
     }
+  double sigma = movingSquaredSum - vnl_math_sqr( movingSum );
 
-  // Reset the joint pdfs to zero
-  m_JointPDF->FillBuffer( 0.0 );
-  m_JointPDFDerivatives->FillBuffer( 0.0 );
-
-
-  // Set up the parameters in the transform
-  this->m_Transform->SetParameters( parameters );
-
+  // Setup pointer to point to the first bin
+  JointPDFValueType *jointPDFPtr = m_JointPDF->GetBufferPointer();
 
-  // Declare iterators for iteration over the sample container
-  typename FixedImageSpatialSampleContainer::const_iterator fiter;
-  typename FixedImageSpatialSampleContainer::const_iterator fend = 
-    m_FixedImageSamples.end();
+  // First moment of the moving image bins in every fixed image bin
+  std::vector<double> fixedSigmaSum1( m_NumberOfHistogramBins, 0.0 );
 
-  unsigned long nSamples=0;
-  unsigned long nFixedImageSamples=0;
+  // Initialize sum to zero
+  double sum = 0.0;
 
-  for ( fiter = m_FixedImageSamples.begin(); fiter != fend; ++fiter )
+  for ( unsigned int fixedIndex = 0; fixedIndex < m_NumberOfHistogramBins; ++fixedIndex )
     {
+    double fixedImagePDFValue = m_FixedImageMarginalPDF[fixedIndex];
 
-    // Get moving image value
-    MovingImagePointType mappedPoint;
-    bool sampleOk;
-    double movingImageValue;
-
-    this->TransformPoint( nFixedImageSamples, parameters, mappedPoint, 
-                          sampleOk, movingImageValue );
-
-    if( sampleOk )
+    if ( fixedImagePDFValue < 1e-16 )
       {
-      ++nSamples; 
-
-      // Get moving image derivative at the mapped position
-      ImageDerivativesType movingImageGradientValue;
-      this->ComputeImageDerivatives( mappedPoint, movingImageGradientValue );
-
-
-      /**
-       * Compute this sample's contribution to the marginal and joint distributions.
-       *
-       */
-
-      // Determine parzen window arguments (see eqn 6 of Mattes paper [2]).    
-      double movingImageParzenWindowTerm =
-        movingImageValue / m_MovingImageBinSize - m_MovingImageNormalizedMin;
-      unsigned int movingImageParzenWindowIndex = 
-        static_cast<unsigned int>( vcl_floor(movingImageParzenWindowTerm ) );
-
-     // Make sure the extreme values are in valid bins     
-      if ( movingImageParzenWindowIndex < 2 )
-        {
-        movingImageParzenWindowIndex = 2;
-        }
-      else if ( movingImageParzenWindowIndex > (m_NumberOfHistogramBins - 3) )
-        {
-        movingImageParzenWindowIndex = m_NumberOfHistogramBins - 3;
-        }
-
-
-      // Since a zero-order BSpline (box car) kernel is used for
-      // the fixed image marginal pdf, we need only increment the
-      // fixedImageParzenWindowIndex by value of 1.0.
-     m_FixedImageMarginalPDF[(*fiter).FixedImageParzenWindowIndex] +=
-        static_cast<PDFValueType>( 1 );
-        
-      /**
-        * The region of support of the parzen window determines which bins
-        * of the joint PDF are effected by the pair of image values.
-        * Since we are using a cubic spline for the moving image parzen
-        * window, four bins are effected.  The fixed image parzen window is
-        * a zero-order spline (box car) and thus effects only one bin.
-        *
-        *  The PDF is arranged so that moving image bins corresponds to the 
-        * zero-th (column) dimension and the fixed image bins corresponds
-        * to the first (row) dimension.
-        *
-        */
-
-      // Pointer to affected bin to be updated
-      JointPDFValueType *pdfPtr = m_JointPDF->GetBufferPointer() +
-        ( (*fiter).FixedImageParzenWindowIndex * m_NumberOfHistogramBins );
+      jointPDFPtr += m_NumberOfHistogramBins;
+      continue;
+      }
+    double sigmaSum1 = 0.0;
+    double sigmaSum2 = 0.0; 
+    for ( unsigned int movingIndex = 0; movingIndex < m_NumberOfHistogramBins; 
+      ++movingIndex, jointPDFPtr++ )      
+      {
+      double jointPDFValue = *(jointPDFPtr);
  
-      // Move the pointer to the fist affected bin
-      int pdfMovingIndex = static_cast<int>( movingImageParzenWindowIndex ) - 1;
-      pdfPtr += pdfMovingIndex;
-
-      for ( ; pdfMovingIndex <= static_cast<int>( movingImageParzenWindowIndex ) + 2;
-            pdfMovingIndex++, pdfPtr++ )
-        {
-
-          // Update PDF for the current intensity pair
-        double movingImageParzenWindowArg = 
-          static_cast<double>( pdfMovingIndex ) - 
-          static_cast<double>(movingImageParzenWindowTerm);
-
-        *(pdfPtr) += static_cast<PDFValueType>( 
-          m_CubicBSplineKernel->Evaluate( movingImageParzenWindowArg ) );
-
-        // Compute the cubicBSplineDerivative for later repeated use.
-        double cubicBSplineDerivativeValue = 
-          m_CubicBSplineDerivativeKernel->Evaluate( movingImageParzenWindowArg );
-
-        // Compute PDF derivative contribution.
-        this->ComputePDFDerivatives( nFixedImageSamples,
-                                     pdfMovingIndex, 
-                                     movingImageGradientValue, 
-                                     cubicBSplineDerivativeValue );
-
-
-        }  //end parzen windowing for loop
-
-      } //end if-block check sampleOk
-
-    ++nFixedImageSamples;
-
-    } // end iterating over fixed image spatial sample container for loop
-
-  itkDebugMacro( "Ratio of voxels mapping into moving image buffer: " 
-                 << nSamples << " / " << m_NumberOfSpatialSamples << std::endl );
-
-  if( nSamples < m_NumberOfSpatialSamples / 4 )
-    {
-    itkExceptionMacro( "Too many samples map outside moving image buffer: "
-                       << nSamples << " / " << m_NumberOfSpatialSamples << std::endl );
-    }
+      sigmaSum1 += ( static_cast<double>( movingIndex ) * jointPDFValue );
+      sigmaSum2 += ( static_cast<double>( vnl_math_sqr( movingIndex ) ) * jointPDFValue );
+      }       
+    sum += ( sigmaSum2 - vnl_math_sqr( sigmaSum1 ) / fixedImagePDFValue );
+    fixedSigmaSum1[fixedIndex] = sigmaSum1;
+    }   
 
-  this->m_NumberOfPixelsCounted = nSamples;
+  value = static_cast<MeasureType>( 1.0 - sum / sigma );
 
   /**
-   * Normalize the PDFs, compute moving image marginal PDF
+   * The derivative is linear in the derivatives of the joint PDF,
+   *
+   *   d value = sum_f sum_m W(f,m) d p(f,m),
    *
+   * with, for the fixed image bins f of nonzero probability,
+   *
+   *   W(f,m) = ( m^2 - 2 m movingSum ) sum / sigma^2
+   *            - ( m^2 - 2 m sigmaSum1(f) / p(f) ) / sigma
+   *
+   * and W(f,m) = 0 otherwise.  The weights are computed once and the
+   * derivatives of the joint PDF are accumulated directly into the
+   * derivative, sample by sample.
    */
-  typedef ImageRegionIterator<JointPDFType> JointPDFIteratorType;
-  JointPDFIteratorType jointPDFIterator ( m_JointPDF, m_JointPDF->GetBufferedRegion() );
+  std::vector<double> binWeights(
+    m_NumberOfHistogramBins * m_NumberOfHistogramBins, 0.0 );
 
-  jointPDFIterator.GoToBegin();
-  
-
-  // Compute joint PDF normalization factor (to ensure joint PDF sum adds to 1.0)
-  double jointPDFSum = 0.0;
-
-  while( !jointPDFIterator.IsAtEnd() )
+  for ( unsigned int fixedIndex = 0; fixedIndex < m_NumberOfHistogramBins; ++fixedIndex )
     {
-    jointPDFSum += jointPDFIterator.Get();
-    ++jointPDFIterator;
-    }
+    double fixedImagePDFValue = m_FixedImageMarginalPDF[fixedIndex];
 
-  if ( jointPDFSum == 0.0 )
-    {
-    itkExceptionMacro( "Joint PDF summed to zero" );
+    if ( fixedImagePDFValue < 1e-16 )
+      {
+      continue;
+      }
+    double *weightPtr = &binWeights[fixedIndex * m_NumberOfHistogramBins];
+    for ( unsigned int movingIndex = 0; movingIndex < m_NumberOfHistogramBins; 
+      ++movingIndex, weightPtr++ )      
+      {
+      double bin = static_cast<double>( movingIndex );
+      *(weightPtr) = 
+        ( vnl_math_sqr( bin ) - 2.0 * bin * movingSum ) * sum / vnl_math_sqr( sigma )
+        - ( vnl_math_sqr( bin ) - 2.0 * bin * fixedSigmaSum1[fixedIndex] 
+        / fixedImagePDFValue ) / sigma;
+      }
     }
 
+  this->ComputeDerivative( binWeights, nSamples, derivative );
+}
 
-  // Normalize the PDF bins
-  jointPDFIterator.GoToEnd();
-  while( !jointPDFIterator.IsAtBegin() )
-    {
-    --jointPDFIterator;
-    jointPDFIterator.Value() /= static_cast<PDFValueType>( jointPDFSum );
-    }
 
-
-  // Normalize the fixed image marginal PDF
-  double fixedPDFSum = 0.0;
-  for( unsigned int bin = 0; bin < m_NumberOfHistogramBins; bin++ )
-    {
-    fixedPDFSum += m_FixedImageMarginalPDF[bin];
-    }
-
-  if ( fixedPDFSum == 0.0 )
-    {
-    itkExceptionMacro( "Fixed image marginal PDF summed to zero" );
-    }
-
-  for( unsigned int bin=0; bin < m_NumberOfHistogramBins; bin++ )
-    {
-    m_FixedImageMarginalPDF[bin] /= static_cast<PDFValueType>( fixedPDFSum );
-    }
-
-
-  // Compute moving image marginal PDF by summing over fixed image bins.
-  typedef ImageLinearIteratorWithIndex<JointPDFType> JointPDFLinearIterator;
-  JointPDFLinearIterator linearIter( 
-    m_JointPDF, m_JointPDF->GetBufferedRegion() );
-
-  linearIter.SetDirection( 1 );
-  linearIter.GoToBegin();
-  unsigned int movingIndex = 0;
-
-  while( !linearIter.IsAtEnd() )
-    {
-
-    double sum = 0.0;
-
-    while( !linearIter.IsAtEndOfLine() )
-      {
-      sum += linearIter.Get();
-      ++linearIter;
-      }
-
-    m_MovingImageMarginalPDF[movingIndex] = static_cast<PDFValueType>(sum);
-
-    linearIter.NextLine();
-    ++movingIndex;
-
-    }
-
-
-  // Normalize the joint PDF derivatives by the test image binsize and nSamples
-  typedef ImageRegionIterator<JointPDFDerivativesType> JointPDFDerivativesIteratorType;
-  JointPDFDerivativesIteratorType jointPDFDerivativesIterator (
-    m_JointPDFDerivatives, m_JointPDFDerivatives->GetBufferedRegion() );
-
-  jointPDFDerivativesIterator.GoToBegin();
-  
-  double nFactor = 1.0 / ( m_MovingImageBinSize * static_cast<double>( nSamples ) );
-
-  while( !jointPDFDerivativesIterator.IsAtEnd() )
-    {
-    jointPDFDerivativesIterator.Value() *= nFactor;
-    ++jointPDFDerivativesIterator;
-    }
-
-  /**
-   * Compute the metric by double summation over histogram.
-   */
-
-  // Setup pointer to point to the first bin
-  JointPDFValueType *jointPDFPtr = m_JointPDF->GetBufferPointer();
-
-  // Initialize sum to zero
-  double sum = 0.0;
-
-  DerivativeType derivativeSum1 = DerivativeType( this->GetNumberOfParameters() );
-  derivativeSum1.Fill( NumericTraits< MeasureType >::Zero );
-  DerivativeType derivativeSum2 = DerivativeType( this->GetNumberOfParameters() );
-  derivativeSum2.Fill( NumericTraits< MeasureType >::Zero );
- 
-  double movingSum = 0.0;
-  for ( unsigned int movingIndex = 0; movingIndex < m_NumberOfHistogramBins; ++movingIndex )      
-    {
-    movingSum += static_cast<double>( movingIndex ) * m_MovingImageMarginalPDF[movingIndex];
-    }
-
-  for ( unsigned int fixedIndex = 0; fixedIndex < m_NumberOfHistogramBins; ++fixedIndex )
-    {
-    double fixedImagePDFValue = m_FixedImageMarginalPDF[fixedIndex];
-
-    if ( fixedImagePDFValue < 1e-16 )
-      {
-      jointPDFPtr += m_NumberOfHistogramBins;
-      continue;
-      }
-    double sigmaSum1 = 0.0;
-    double sigmaSum2 = 0.0; 
-
-    DerivativeType sigmaDerivativeSum1 = DerivativeType( this->GetNumberOfParameters() );
-    sigmaDerivativeSum1.Fill( NumericTraits< MeasureType >::Zero );
-    DerivativeType sigmaDerivativeSum2 = DerivativeType( this->GetNumberOfParameters() );
-    sigmaDerivativeSum2.Fill( NumericTraits< MeasureType >::Zero );
-
-    for ( unsigned int movingIndex = 0; movingIndex < m_NumberOfHistogramBins; 
-      ++movingIndex, jointPDFPtr++ )      
-      {
-      double jointPDFValue = *(jointPDFPtr);
- 
-      sigmaSum1 += ( static_cast<double>( movingIndex ) * jointPDFValue );
-      sigmaSum2 += ( static_cast<double>( vnl_math_sqr( movingIndex ) ) * jointPDFValue );
-
-      JointPDFValueType *derivPtr = m_JointPDFDerivatives->GetBufferPointer() +
-        ( fixedIndex * m_JointPDFDerivatives->GetOffsetTable()[2] ) +
-        ( movingIndex * m_JointPDFDerivatives->GetOffsetTable()[1] );
-
-      for ( unsigned int parameter = 0; parameter < m_NumberOfParameters; 
-        ++parameter, derivPtr++ )
-        {
-        sigmaDerivativeSum1[parameter] += static_cast<double>( movingIndex ) * (*derivPtr);
-        sigmaDerivativeSum2[parameter] += static_cast<double>( vnl_math_sqr( movingIndex ) ) * (*derivPtr);
-        }
-      }       
-    sum += ( sigmaSum2 - vnl_math_sqr( sigmaSum1 ) / fixedImagePDFValue );
-    for( unsigned int parameter = 0; parameter < m_NumberOfParameters; ++parameter )
-      {
-      derivativeSum1[parameter] += 
-        ( sigmaDerivativeSum2[parameter] - 2.0 * sigmaSum1 * sigmaDerivativeSum1[parameter] 
-        / fixedImagePDFValue );  
-      derivativeSum2[parameter] += 
-        ( sigmaDerivativeSum2[parameter] - 2.0 * movingSum * sigmaDerivativeSum1[parameter] );  
-      }
-    }   
-
-  // Finish calculating the value
-
-  double sigmaSum1 = 0.0;
-  double sigmaSum2 = 0.0;
-  for ( unsigned int movingIndex = 0; movingIndex < m_NumberOfHistogramBins; ++movingIndex )      
-    {
-    double movingImagePDFValue = m_MovingImageMarginalPDF[movingIndex];
-    sigmaSum1 += static_cast<double>( movingIndex ) * movingImagePDFValue;
-    sigmaSum2 += static_cast<double>( vnl_math_sqr( movingIndex ) ) * movingImagePDFValue;
-    }
-  double sigma = sigmaSum2 - vnl_math_sqr( sigmaSum1 );
-
-  value = static_cast<MeasureType>( 1.0 - sum / sigma );
-
-  // Finish calculating the derivative
-
-  for( unsigned int parameter = 0; parameter < m_NumberOfParameters; ++parameter )
-    {
-    derivative[parameter] = derivativeSum2[parameter] * sum / vnl_math_sqr( sigma ) 
-                             - derivativeSum1[parameter] / sigma;
-    } 
-}
-
-
-/**
- * Get the match measure derivative
- */
-template < class TFixedImage, class TMovingImage  >
-void
-TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
-::GetDerivative( const ParametersType& parameters, DerivativeType & derivative ) const
-{
-  MeasureType value;
-  // call the combined version
-  this->GetValueAndDerivative( parameters, value, derivative );
-}
+/**
+ * Get the match measure derivative
+ */
+template < class TFixedImage, class TMovingImage  >
+void
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::GetDerivative( const ParametersType& parameters, DerivativeType & derivative ) const
+{
+  MeasureType value;
+  // call the combined version
+  this->GetValueAndDerivative( parameters, value, derivative );
+}
 
 
 /**
@@ -1333,24 +886,256 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
 
 
 /**
- * Compute PDF derivatives contribution for each parameter
+ * Fill the joint and marginal PDFs from the samples
+ */
+template < class TFixedImage, class TMovingImage >
+unsigned long
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::ComputeJointPDF( 
+  const ParametersType& parameters,
+  bool cacheSampleValues ) const
+{
+
+  const unsigned long numberOfFixedImageSamples = m_FixedImageSamples.size();
+  const unsigned int numberOfBins = 
+    m_NumberOfHistogramBins * m_NumberOfHistogramBins;
+
+  // Set up the parameters in the transform
+  this->m_Transform->SetParameters( parameters );
+
+  m_SampleIsValid.resize( numberOfFixedImageSamples );
+  if ( cacheSampleValues )
+    {
+    m_MovingImageParzenWindowTerms.resize( numberOfFixedImageSamples );
+    m_MovingImageGradients.resize( numberOfFixedImageSamples );
+    }
+
+  // Every thread fills its own histograms over a range of the samples
+  m_ThreaderJointPDFs.resize( m_NumberOfThreads );
+  m_ThreaderFixedImageMarginalPDFs.resize( m_NumberOfThreads );
+  for ( unsigned int t = 0; t < m_NumberOfThreads; t++ )
+    {
+    m_ThreaderJointPDFs[t].assign( numberOfBins, 0.0 );
+    m_ThreaderFixedImageMarginalPDFs[t].assign( m_NumberOfHistogramBins, 0.0 );
+    }
+  m_ThreaderNumberOfSamples.assign( m_NumberOfThreads, 0 );
+
+  ThreadStruct str;
+  str.Metric = this;
+  str.Parameters = &parameters;
+  str.CacheSampleValues = cacheSampleValues;
+  str.BinWeights = NULL;
+  str.DerivativeFactor = 0.0;
+
+  this->RunThreads( &str, this->JointPDFThreaderCallback, m_NumberOfThreads );
+
+  // Sum the histograms of the threads
+  unsigned long nSamples = 0;
+  for ( unsigned int t = 0; t < m_NumberOfThreads; t++ )
+    {
+    nSamples += m_ThreaderNumberOfSamples[t];
+    }
+
+  JointPDFValueType *jointPDFPtr = m_JointPDF->GetBufferPointer();
+  for ( unsigned int bin = 0; bin < numberOfBins; bin++ )
+    {
+    double jointPDFValue = 0.0;
+    for ( unsigned int t = 0; t < m_NumberOfThreads; t++ )
+      {
+      jointPDFValue += m_ThreaderJointPDFs[t][bin];
+      }
+    jointPDFPtr[bin] = static_cast<PDFValueType>( jointPDFValue );
+    }
+
+  for ( unsigned int bin = 0; bin < m_NumberOfHistogramBins; bin++ )
+    {
+    double fixedImagePDFValue = 0.0;
+    for ( unsigned int t = 0; t < m_NumberOfThreads; t++ )
+      {
+      fixedImagePDFValue += m_ThreaderFixedImageMarginalPDFs[t][bin];
+      }
+    m_FixedImageMarginalPDF[bin] = static_cast<PDFValueType>( fixedImagePDFValue );
+    m_MovingImageMarginalPDF[bin] = 0.0;
+    }
+
+  itkDebugMacro( "Ratio of voxels mapping into moving image buffer: " 
+                 << nSamples << " / " << m_NumberOfSpatialSamples << std::endl );
+
+  if ( nSamples < m_NumberOfSpatialSamples / 4 )
+    {
+    itkExceptionMacro( "Too many samples map outside moving image buffer: "
+                       << nSamples << " / " << m_NumberOfSpatialSamples << std::endl );
+    }
+
+  this->m_NumberOfPixelsCounted = nSamples;
+
+  /**
+   * Normalize the PDFs, compute moving image marginal PDF
+   *
+   */
+  typedef ImageRegionIterator<JointPDFType> JointPDFIteratorType;
+  JointPDFIteratorType jointPDFIterator ( m_JointPDF, m_JointPDF->GetBufferedRegion() );
+
+  jointPDFIterator.GoToBegin();
+  
+  // Compute joint PDF normalization factor (to ensure joint PDF sum adds to 1.0)
+  double jointPDFSum = 0.0;
+
+  while ( !jointPDFIterator.IsAtEnd() )
+    {
+    jointPDFSum += jointPDFIterator.Get();
+    ++jointPDFIterator;
+    }
+
+  if ( jointPDFSum == 0.0 )
+    {
+    itkExceptionMacro( "Joint PDF summed to zero" );
+    }
+
+
+  // Normalize the PDF bins
+  jointPDFIterator.GoToEnd();
+  while ( !jointPDFIterator.IsAtBegin() )
+    {
+    --jointPDFIterator;
+    jointPDFIterator.Value() /= static_cast<PDFValueType>( jointPDFSum );
+    }
+
+
+  // Normalize the fixed image marginal PDF
+  double fixedPDFSum = 0.0;
+  for ( unsigned int bin = 0; bin < m_NumberOfHistogramBins; bin++ )
+    {
+    fixedPDFSum += m_FixedImageMarginalPDF[bin];
+    }
+
+  if ( fixedPDFSum == 0.0 )
+    {
+    itkExceptionMacro( "Fixed image marginal PDF summed to zero" );
+    }
+
+  for ( unsigned int bin = 0; bin < m_NumberOfHistogramBins; bin++ )
+    {
+    m_FixedImageMarginalPDF[bin] /= static_cast<PDFValueType>( fixedPDFSum );
+    }
+
+
+  // Compute moving image marginal PDF by summing over fixed image bins.
+  typedef ImageLinearIteratorWithIndex<JointPDFType> JointPDFLinearIterator;
+  JointPDFLinearIterator linearIter( 
+    m_JointPDF, m_JointPDF->GetBufferedRegion() );
+
+  linearIter.SetDirection( 1 );
+  linearIter.GoToBegin();
+  unsigned int movingIndex = 0;
+
+  while( !linearIter.IsAtEnd() )
+    {
+
+    double sum = 0.0;
+
+    while( !linearIter.IsAtEndOfLine() )
+      {
+      sum += linearIter.Get();
+      ++linearIter;
+      }
+
+    m_MovingImageMarginalPDF[movingIndex] = static_cast<PDFValueType>(sum);
+
+    linearIter.NextLine();
+    ++movingIndex;
+
+    }
+
+  return nSamples;
+}
+
+
+/**
+ * Compute the derivative from the weights of the joint PDF bins
  */
 template < class TFixedImage, class TMovingImage >
 void
 TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
-::ComputePDFDerivatives( 
-  unsigned int sampleNumber, 
-  int pdfMovingIndex,
-  const ImageDerivativesType& movingImageGradientValue,
-  double cubicBSplineDerivativeValue ) const
+::ComputeDerivative( 
+  const std::vector<double> & binWeights,
+  unsigned long numberOfValidSamples,
+  DerivativeType & derivative ) const
 {
 
+  ThreadStruct str;
+  str.Metric = this;
+  str.Parameters = NULL;
+  str.CacheSampleValues = false;
+  str.BinWeights = &binWeights;
+
+  // Normalize the joint PDF derivatives by the test image binsize and nSamples
+  str.DerivativeFactor = 1.0 / 
+    ( m_MovingImageBinSize * static_cast<double>( numberOfValidSamples ) );
+
+  // The Jacobian of a generic transform is returned in a member of the 
+  // transform, so only the BSpline transform is processed in parallel.
+  const unsigned int numberOfThreads = m_TransformIsBSpline ? m_NumberOfThreads : 1;
+
+  // Every thread accumulates the derivative of its samples
+  m_ThreaderDerivatives.resize( numberOfThreads );
+  for ( unsigned int t = 0; t < numberOfThreads; t++ )
+    {
+    m_ThreaderDerivatives[t].assign( m_NumberOfParameters, 0.0 );
+    }
+
+  this->RunThreads( &str, this->DerivativeThreaderCallback, numberOfThreads );
+
+  for ( unsigned int t = 0; t < numberOfThreads; t++ )
+    {
+    const double *threadDerivative = &m_ThreaderDerivatives[t][0];
+    for ( unsigned int parameter = 0; parameter < m_NumberOfParameters; ++parameter )
+      {
+      derivative[parameter] += threadDerivative[parameter];
+      }
+    }
+}
+
+
+/**
+ * Compute the central bin of the moving image parzen window
+ */
+template < class TFixedImage, class TMovingImage >
+unsigned int
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::GetMovingImageParzenWindowIndex( double movingImageParzenWindowTerm ) const
+{
+
+  unsigned int movingImageParzenWindowIndex = 
+    static_cast<unsigned int>( vcl_floor( movingImageParzenWindowTerm ) );
+
+  // Make sure the extreme values are in valid bins
+  if ( movingImageParzenWindowIndex < 2 )
+    {
+    movingImageParzenWindowIndex = 2;
+    }
+  else if ( movingImageParzenWindowIndex > ( m_NumberOfHistogramBins - 3 ) )
+    {
+    movingImageParzenWindowIndex = m_NumberOfHistogramBins - 3;
+    }
+  return movingImageParzenWindowIndex;
+}
+
+
+/**
+ * Add the derivative contribution of a sample to the affected parameters
+ */
+template < class TFixedImage, class TMovingImage >
+void
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::AddSampleDerivative( 
+  unsigned int sampleNumber, 
+  double scale,
+  double *derivative ) const
+{
 
-  // Update bins in the PDF derivatives for the current intensity pair
-  JointPDFValueType * derivPtr = m_JointPDFDerivatives->GetBufferPointer() +
-    ( m_FixedImageSamples[sampleNumber].FixedImageParzenWindowIndex
-        * m_JointPDFDerivatives->GetOffsetTable()[2] ) +
-    ( pdfMovingIndex * m_JointPDFDerivatives->GetOffsetTable()[1] );
+  const ImageDerivativesType& movingImageGradientValue = 
+    m_MovingImageGradients[sampleNumber];
 
   if( !m_TransformIsBSpline )
     {
@@ -1365,7 +1150,7 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
       this->m_Transform->GetJacobian( 
         m_FixedImageSamples[sampleNumber].FixedImagePointValue );
 
-    for ( unsigned int mu = 0; mu < m_NumberOfParameters; mu++, derivPtr++ )
+    for ( unsigned int mu = 0; mu < m_NumberOfParameters; mu++ )
       {
       double innerProduct = 0.0;
       for ( unsigned int dim = 0; dim < FixedImageDimension; dim++ )
@@ -1374,7 +1159,7 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
           movingImageGradientValue[dim];
         }
 
-      *(derivPtr) -= innerProduct * cubicBSplineDerivativeValue;
+      derivative[mu] += innerProduct * scale;
 
       }
 
@@ -1384,7 +1169,7 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
 
    /**
    * If the transform is of type BSplineDeformableTransform,
-   * we can obtain a speed up by only processing the affected parameters.
+   * only the parameters of the support of the sample are affected.
    */
     const WeightsValueType * weights = m_BSplineTransformWeightsArray[sampleNumber];
     const IndexValueType   * indices = m_BSplineTransformIndicesArray[sampleNumber];
@@ -1392,16 +1177,16 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
     for( unsigned int dim = 0; dim < FixedImageDimension; dim++ )
       {
 
+      double *ptr = derivative + m_ParametersOffset[dim];
+      double gradientValue = movingImageGradientValue[dim] * scale;
+
       for( unsigned int mu = 0; mu < m_NumBSplineWeights; mu++ )
         {
 
         /* The array weights contains the Jacobian values in a 1-D array 
          * (because for each parameter the Jacobian is non-zero in only 1 of the
          * possible dimensions) which is multiplied by the moving image gradient. */
-        double innerProduct = movingImageGradientValue[dim] * weights[mu];
-
-        JointPDFValueType * ptr = derivPtr + indices[mu] + m_ParametersOffset[dim];
-        *(ptr) -= innerProduct * cubicBSplineDerivativeValue;
+        ptr[indices[mu]] += gradientValue * weights[mu];
             
         } //end mu for loop
       } //end dim for loop
@@ -1411,6 +1196,205 @@ TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
 }
 
 
+template < class TFixedImage, class TMovingImage >
+void
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::RunThreads( 
+  ThreadStruct *str, 
+  ThreadFunctionType callback,
+  unsigned int numberOfThreads ) const
+{
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( callback, str );
+  threader->SingleMethodExecute();
+}
+
+
+template < class TFixedImage, class TMovingImage >
+void
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::GetThreadSamples( 
+  int threadId, 
+  int threadCount,
+  unsigned long & begin, 
+  unsigned long & end ) const
+{
+  const unsigned long numberOfFixedImageSamples = m_FixedImageSamples.size();
+  begin = ( numberOfFixedImageSamples * threadId ) / threadCount;
+  end = ( numberOfFixedImageSamples * ( threadId + 1 ) ) / threadCount;
+}
+
+
+/**
+ * Add the samples of a thread to its joint and fixed image marginal PDFs
+ */
+template < class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::JointPDFThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const Self *metric = str->Metric;
+
+  unsigned long begin;
+  unsigned long end;
+  metric->GetThreadSamples( threadId, threadCount, begin, end );
+
+  const unsigned int numberOfHistogramBins = metric->m_NumberOfHistogramBins;
+  double *jointPDF = &metric->m_ThreaderJointPDFs[threadId][0];
+  double *fixedImageMarginalPDF = 
+    &metric->m_ThreaderFixedImageMarginalPDFs[threadId][0];
+
+  unsigned long nSamples = 0;
+
+  for ( unsigned long sampleNumber = begin; sampleNumber < end; ++sampleNumber )
+    {
+
+    // Get moving image value
+    MovingImagePointType mappedPoint;
+    bool sampleOk;
+    double movingImageValue;
+
+    metric->TransformPoint( sampleNumber, *(str->Parameters), mappedPoint, 
+                            sampleOk, movingImageValue );
+
+    metric->m_SampleIsValid[sampleNumber] = sampleOk;
+
+    if ( !sampleOk )
+      {
+      continue;
+      }
+
+    ++nSamples; 
+
+    // Determine parzen window arguments (see eqn 6 of Mattes paper [2]).    
+    double movingImageParzenWindowTerm =
+      movingImageValue / metric->m_MovingImageBinSize - 
+      metric->m_MovingImageNormalizedMin;
+    unsigned int movingImageParzenWindowIndex = 
+      metric->GetMovingImageParzenWindowIndex( movingImageParzenWindowTerm );
+
+    unsigned int fixedImageParzenWindowIndex = 
+      metric->m_FixedImageSamples[sampleNumber].FixedImageParzenWindowIndex;
+
+    // Since a zero-order BSpline (box car) kernel is used for
+    // the fixed image marginal pdf, we need only increment the
+    // fixedImageParzenWindowIndex by value of 1.0.
+    fixedImageMarginalPDF[fixedImageParzenWindowIndex] += 1.0;
+
+    /**
+      * The region of support of the parzen window determines which bins
+      * of the joint PDF are effected by the pair of image values.
+      * Since we are using a cubic spline for the moving image parzen
+      * window, four bins are affected.  The fixed image parzen window is
+      * a zero-order spline (box car) and thus effects only one bin.
+      *
+      *  The PDF is arranged so that moving image bins corresponds to the 
+      * zero-th (column) dimension and the fixed image bins corresponds
+      * to the first (row) dimension.
+      *
+      */
+    double *pdfPtr = jointPDF + 
+      fixedImageParzenWindowIndex * numberOfHistogramBins;
+
+    for ( int pdfMovingIndex = static_cast<int>( movingImageParzenWindowIndex ) - 1;
+          pdfMovingIndex <= static_cast<int>( movingImageParzenWindowIndex ) + 2;
+          pdfMovingIndex++ )
+      {
+      double movingImageParzenWindowArg = 
+        static_cast<double>( pdfMovingIndex ) - movingImageParzenWindowTerm;
+
+      pdfPtr[pdfMovingIndex] += 
+        metric->m_CubicBSplineKernel->Evaluate( movingImageParzenWindowArg );
+      }
+
+    if ( str->CacheSampleValues )
+      {
+      // Keep the moving image derivative at the mapped position
+      metric->m_MovingImageParzenWindowTerms[sampleNumber] = 
+        movingImageParzenWindowTerm;
+      metric->ComputeImageDerivatives( mappedPoint, 
+        metric->m_MovingImageGradients[sampleNumber] );
+      }
+    }
+
+  metric->m_ThreaderNumberOfSamples[threadId] = nSamples;
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+/**
+ * Add the derivative contributions of the samples of a thread
+ */
+template < class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
+::DerivativeThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const Self *metric = str->Metric;
+
+  unsigned long begin;
+  unsigned long end;
+  metric->GetThreadSamples( threadId, threadCount, begin, end );
+
+  const unsigned int numberOfHistogramBins = metric->m_NumberOfHistogramBins;
+  const double *binWeights = &(*str->BinWeights)[0];
+  double *derivative = &metric->m_ThreaderDerivatives[threadId][0];
+
+  for ( unsigned long sampleNumber = begin; sampleNumber < end; ++sampleNumber )
+    {
+    if ( !metric->m_SampleIsValid[sampleNumber] )
+      {
+      continue;
+      }
+
+    double movingImageParzenWindowTerm = 
+      metric->m_MovingImageParzenWindowTerms[sampleNumber];
+    unsigned int movingImageParzenWindowIndex = 
+      metric->GetMovingImageParzenWindowIndex( movingImageParzenWindowTerm );
+
+    const double *weightPtr = binWeights + numberOfHistogramBins * 
+      metric->m_FixedImageSamples[sampleNumber].FixedImageParzenWindowIndex;
+
+    // Weighted sum of the derivatives of the four bins of the parzen window
+    double binDerivative = 0.0;
+    for ( int pdfMovingIndex = static_cast<int>( movingImageParzenWindowIndex ) - 1;
+          pdfMovingIndex <= static_cast<int>( movingImageParzenWindowIndex ) + 2;
+          pdfMovingIndex++ )
+      {
+      double movingImageParzenWindowArg = 
+        static_cast<double>( pdfMovingIndex ) - movingImageParzenWindowTerm;
+
+      binDerivative += weightPtr[pdfMovingIndex] * 
+        metric->m_CubicBSplineDerivativeKernel->Evaluate( movingImageParzenWindowArg );
+      }
+
+    if ( binDerivative == 0.0 )
+      {
+      continue;
+      }
+
+    metric->AddSampleDerivative( sampleNumber, 
+      -binDerivative * str->DerivativeFactor, derivative );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
 // Method to reinitialize the seed of the random number generator
 template < class TFixedImage, class TMovingImage  > void
 TustisonCorrelationRatioImageToImageMetric<TFixedImage,TMovingImage>
@@ -21,6 +21,7 @@
 
 #include "itkBSplineScatteredDataPointSetToImageFilter.h"
 #include "itkPointSet.h"
+#include "itkRobustPointMatchingCorrespondenceMatrix.h"
 #include "itkVariableLengthVector.h"
 #include "itkVariableSizeMatrix.h"
 #include "itkVector.h"
@@ -61,6 +62,10 @@ public:
   /** Other typedef */
   typedef VariableSizeMatrix<RealType>                        MatrixType;
   typedef VariableLengthVector<RealType>                      OutlierVectorType;
+  typedef RobustPointMatchingCorrespondenceMatrix<RealType,
+    itkGetStaticConstMacro( Dimension )>                      CorrespondenceMatrixType;
+  typedef typename CorrespondenceMatrixType::PointContainerType
+                                                              PointContainerType;
 
   /** B-spline typedefs */
   typedef PointSet<VectorType, 
@@ -99,6 +104,14 @@ public:
   itkSetMacro( SolveSimplerLeastSquaresProblem, bool );
   itkGetConstMacro( SolveSimplerLeastSquaresProblem, bool );
 
+  /**
+   * Correspondences below exp( -TruncationExponent ) times their peak
+   * value are dropped, which keeps the correspondence matrix sparse once
+   * the temperature falls (default = 20).
+   */
+  itkSetClampMacro( TruncationExponent, RealType, 0, NumericTraits<RealType>::max() );
+  itkGetConstMacro( TruncationExponent, RealType );
+
   itkBooleanMacro( UseBoundingBox );
   itkSetMacro( UseBoundingBox, bool );
   itkGetConstMacro( UseBoundingBox, bool );
@@ -120,6 +133,7 @@ private:
   void UpdateCorrespondenceMatrix();
   void NormalizeCorrespondenceMatrix();
   void UpdateTransformation();
+  void GetCorrespondencePoints( const InputPointSetType *, PointContainerType & ) const;
  
 
   void VisualizeCurrentState();
@@ -130,7 +144,7 @@ private:
 
   typename InputPointSetType::Pointer                        m_VPoints;
 
-  MatrixType                                                 m_CorrespondenceMatrix;
+  typename CorrespondenceMatrixType::Pointer                 m_CorrespondenceMatrix;
   OutlierVectorType                                          m_OutlierRow;
   OutlierVectorType                                          m_OutlierColumn;
   typename InputPointSetType::PointType                      m_OutlierPointX;
@@ -143,6 +157,7 @@ private:
   unsigned int                                               m_NumberOfIterationsPerTemperature;
   bool                                                       m_SolveSimplerLeastSquaresProblem;
   bool                                                       m_UseBoundingBox;
+  RealType                                                   m_TruncationExponent;
     
   typename ControlPointLatticeType::Pointer                  m_ControlPointLattice;
 
@@ -35,8 +35,11 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
   this->m_Spacing.Fill( 1 );
 
   this->m_UseBoundingBox = true;
+  this->m_TruncationExponent = 20.0;
 
   this->m_SolveSimplerLeastSquaresProblem = false;
+
+  this->m_CorrespondenceMatrix = NULL;
 }
 
 template <class TPointSet, class TOutputImage>
@@ -144,15 +147,22 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
   /**
    * Initialize correspondence matrix and outlier row/column
    */
-  this->m_CorrespondenceMatrix.SetSize( 
-    this->m_VPoints->GetNumberOfPoints(), this->GetInput( 0 )->GetNumberOfPoints() );
+  PointContainerType fixedPoints;
+  this->GetCorrespondencePoints( this->GetInput( 0 ), fixedPoints );
+
+  this->m_CorrespondenceMatrix = CorrespondenceMatrixType::New();
+  this->m_CorrespondenceMatrix->SetTruncationExponent( this->m_TruncationExponent );
+  this->m_CorrespondenceMatrix->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_CorrespondenceMatrix->SetFixedPoints( fixedPoints );
+
   this->m_OutlierColumn.SetSize( this->m_VPoints->GetNumberOfPoints() );
   this->m_OutlierRow.SetSize( this->GetInput( 0 )->GetNumberOfPoints() );
 
   RealType K = static_cast<RealType>( this->m_VPoints->GetNumberOfPoints() );
   RealType N = static_cast<RealType>( this->GetInput( 0 )->GetNumberOfPoints() );
 
-  this->m_CorrespondenceMatrix.Fill( 1.0 / ( N * K ) );
+  this->m_CorrespondenceMatrix->Fill( this->m_VPoints->GetNumberOfPoints(),
+    1.0 / ( N * K ) );
 
   this->m_OutlierColumn.Fill( 1.0 / ( 1000 * N * K ) );
   this->m_OutlierRow.Fill( 1.0 / ( 1000 * N * K ) );
@@ -251,22 +261,15 @@ void
 BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
 ::UpdateCorrespondenceMatrix()
 {
-  for ( unsigned int i = 0; i < this->m_VPoints->GetNumberOfPoints(); i++ )
-    {
-    typename InputPointSetType::PointType pointV;
-    this->m_VPoints->GetPoint( i, &pointV );    
-
-    for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ )
-      {
-      typename InputPointSetType::PointType pointX;      
-      this->GetInput( 0 )->GetPoint( j, &pointX );      
- 
-      this->m_CorrespondenceMatrix( i, j )  
-        = vcl_exp( -0.5 * ( pointX - pointV ).GetSquaredNorm() / this->m_CurrentTemperature )
-          / this->m_CurrentTemperature;
+  /**
+   * m_ij = exp( -0.5 * |X_j - V_i|^2 / T ) / T, restricted to the fixed
+   * points near V_i once the temperature is low enough.
+   */
+  PointContainerType movingPoints;
+  this->GetCorrespondencePoints( this->m_VPoints, movingPoints );
 
-      }  
-    } 
+  this->m_CorrespondenceMatrix->Update( movingPoints,
+    this->m_CurrentTemperature, 0.5, 1.0 / this->m_CurrentTemperature );
 
 /*
   this->m_OutlierColumn.Fill( 0 );
@@ -302,69 +305,10 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
 ::NormalizeCorrespondenceMatrix()
 {
   RealType epsilon = 1e-4;
-  RealType deviation = NumericTraits<RealType>::max(); 
-
-  OutlierVectorType rowSum;
-  OutlierVectorType columnSum;
-
   unsigned int maximumNumberOfIterations = 100;
-  unsigned int iterations = 0;
-
-  while ( vnl_math_abs( deviation ) > epsilon && iterations++ < maximumNumberOfIterations )
-    {
-    /**
-     * do row normalization
-     */
-    rowSum = this->m_OutlierColumn;
-
-    for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-      {
-      for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-        {
-        rowSum[i] += this->m_CorrespondenceMatrix( i, j );
-        }
-      } 
-    for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-      {
-      for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-        {
-        this->m_CorrespondenceMatrix( i, j ) /= rowSum[i];
-        }
-      this->m_OutlierColumn[i] /= rowSum[i];
-      } 
-    
-
-    /**
-     * do column normalization
-     */
-    columnSum = this->m_OutlierRow;
-
-    for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-      {
-      for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-        {
-        columnSum[j] += this->m_CorrespondenceMatrix( i, j );
-        }
-      } 
-    for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-      {
-      for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-        {
-        this->m_CorrespondenceMatrix( i, j ) /= columnSum[j];
-        }
-      this->m_OutlierRow[j] /= columnSum[j];
-      } 
-
-    /**
-     * Calculate current deviation from 1
-     */
-    rowSum -= 1.0;
-    columnSum -= 1.0;
-
-    deviation = ( rowSum.GetSquaredNorm() + columnSum.GetSquaredNorm() )
-      / ( static_cast<RealType>( rowSum.GetSize() + columnSum.GetSize() ) );
-    }  
 
+  this->m_CorrespondenceMatrix->Normalize( this->m_OutlierRow,
+    this->m_OutlierColumn, epsilon, maximumNumberOfIterations, true );
 }
 
 template <class TPointSet, class TOutputImage>
@@ -387,16 +331,19 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
       typename InputPointSetType::PointType Y;
       Y.Fill( 0 );
       RealType weight = 0;
-      for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ ) 
+      for ( unsigned long k = this->m_CorrespondenceMatrix->GetRowBegin( i ); 
+            k < this->m_CorrespondenceMatrix->GetRowEnd( i ); k++ ) 
         {
-        typename InputPointSetType::PointType X;
-        this->GetInput( 0 )->GetPoint( j, &X );
+        RealType m = this->m_CorrespondenceMatrix->GetValue( k );
+        const typename CorrespondenceMatrixType::PointType & X 
+          = this->m_CorrespondenceMatrix->GetFixedPoint( 
+            this->m_CorrespondenceMatrix->GetColumn( k ) );
         for ( unsigned int d = 0; d < Dimension; d++ )
           {
-          Y[d] += ( X[d] * this->m_CorrespondenceMatrix( i, j ) ); 
+          Y[d] += ( X[d] * m ); 
           }
         
-        weight += this->m_CorrespondenceMatrix( i, j );
+        weight += m;
         }
       VectorType vector = Y - V;
 
@@ -407,20 +354,23 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
       }
     else
       {
-      for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ ) 
+      for ( unsigned long k = this->m_CorrespondenceMatrix->GetRowBegin( i ); 
+            k < this->m_CorrespondenceMatrix->GetRowEnd( i ); k++ ) 
         {
-        if ( this->m_CorrespondenceMatrix( i, j ) <= 0 )
+        RealType m = this->m_CorrespondenceMatrix->GetValue( k );
+        if ( m <= 0 )
           {
           continue;
           } 
         typename InputPointSetType::PointType X;
-        this->GetInput( 0 )->GetPoint( j, &X );
+        this->GetInput( 0 )->GetPoint( 
+          this->m_CorrespondenceMatrix->GetColumn( k ), &X );
 
         VectorType vector = X - V;
 
         points->SetPoint( count, V );  
         points->SetPointData( count, vector );
-        weights->InsertElement( count, this->m_CorrespondenceMatrix( i, j ) );
+        weights->InsertElement( count, m );
         count++;
         }
       }     
@@ -489,12 +439,14 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
     typename InputPointSetType::PointType V;
     this->m_VPoints->GetPoint( i, &V );
 
-    for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ ) 
+    for ( unsigned long k = this->m_CorrespondenceMatrix->GetRowBegin( i ); 
+          k < this->m_CorrespondenceMatrix->GetRowEnd( i ); k++ ) 
       {
       typename InputPointSetType::PointType X;
-      this->GetInput( 0 )->GetPoint( j, &X );
+      this->GetInput( 0 )->GetPoint( 
+        this->m_CorrespondenceMatrix->GetColumn( k ), &X );
 
-      error += ( this->m_CorrespondenceMatrix( i, j ) * ( X - V ).GetNorm() );  
+      error += ( this->m_CorrespondenceMatrix->GetValue( k ) * ( X - V ).GetNorm() );  
       }
     }     
 
@@ -530,12 +482,14 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
     typename InputPointSetType::PointType V;
     this->m_VPoints->GetPoint( i, &V );
 
-    for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ ) 
+    for ( unsigned long k = this->m_CorrespondenceMatrix->GetRowBegin( i ); 
+          k < this->m_CorrespondenceMatrix->GetRowEnd( i ); k++ ) 
       {
       typename InputPointSetType::PointType X;
-      this->GetInput( 0 )->GetPoint( j, &X );
+      this->GetInput( 0 )->GetPoint( 
+        this->m_CorrespondenceMatrix->GetColumn( k ), &X );
 
-      error += ( this->m_CorrespondenceMatrix(i, j) * ( X - V ).GetNorm() );  
+      error += ( this->m_CorrespondenceMatrix->GetValue( k ) * ( X - V ).GetNorm() );  
       }
     }     
 
@@ -546,6 +500,24 @@ BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
 
 }
 
+template <class TPointSet, class TOutputImage>
+void
+BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::GetCorrespondencePoints( const InputPointSetType *pointSet, 
+  PointContainerType &points ) const
+{
+  points.resize( pointSet->GetNumberOfPoints() );
+  for ( unsigned int i = 0; i < pointSet->GetNumberOfPoints(); i++ )
+    {
+    typename InputPointSetType::PointType point;
+    pointSet->GetPoint( i, &point );
+    for ( unsigned int d = 0; d < Dimension; d++ )
+      {
+      points[i][d] = point[d];
+      }
+    }
+}
+
 template <class TPointSet, class TOutputImage>
 void
 BSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
@@ -26,6 +26,7 @@
 #include "itkShapedNeighborhoodIterator.h"
 #include "itkBoykovGraphTraits.h"
 #include "itkBoykovImageToGraphFunctor.h"
+#include "itkBoykovResidualGraph.h"
 
 #include <vector>
 
@@ -55,6 +56,12 @@ namespace itk {
  * pixel indices can be specified to "hard-constrain" those pixels 
  * to be of a specific labeling.
  *
+ * \par
+ * For more than two labels the pixel graph is built once, in compressed
+ * row form, and kept in a BoykovResidualGraph.  Each expansion move only
+ * recomputes the terminal and arc capacities and warm-starts the max-flow
+ * from the flow and search trees of the previous move.
+ *
  * \par REFERENCE
  * Y. Boykov, O. Veksler, and R. Zabih, "Fast Approximate Energy 
  * Minimization via Graph Cuts," IEEE-PAMI, 23(11):1222-1239, 2001.
@@ -114,6 +121,8 @@ public:
   typedef std::vector<IndexType>                   IndexContainerType;
   typedef std::vector<IndexContainerType>          IndexContainerContainerType;
   typedef Image<RealType, ImageDimension>          ProbabilityImageType;
+  typedef BoykovResidualGraph<NodeWeightType>      ResidualGraphType;
+  typedef Image<int, ImageDimension>               NodeIdentifierImageType;
 
  
   /** Image To Graph Functor Type */
@@ -160,6 +169,7 @@ private:
   //void AlphaBetaSwap();
 
   void Initialize();
+  void InitializeResidualGraph();
   RealType CalculateCurrentEnergy();
   void FindMinimumEnergyBinaryLabeling();
   void FindMinimumEnergyLabeling( unsigned int );
@@ -176,9 +186,11 @@ private:
   
   EdgeWeightType CalculateSmoothnessPenaltyTerm( 
     IndexType, IndexType, unsigned int, unsigned int );  
-  void AddUnaryTerm(
-    GraphType *, NodePointerType, NodeWeightType, NodeWeightType );  
-  void AddBinaryTerm( GraphType *, EdgePointerType, 
+  EdgeWeightType CalculateSmoothnessPenaltyTerm( 
+    EdgeWeightType weight, unsigned int label1, unsigned int label2 )
+    { return ( label1 == label2 ) ? static_cast<EdgeWeightType>( 0 ) : weight; }
+  void AddUnaryTerm( unsigned int, NodeWeightType, NodeWeightType );  
+  void AddBinaryTerm( unsigned int, unsigned int, 
     EdgeWeightType, EdgeWeightType, EdgeWeightType, EdgeWeightType );  
 
   /** private data members */
@@ -189,6 +201,21 @@ private:
   IndexContainerContainerType         m_Indices;
   RealType                            m_CurrentEnergy;
 
+  /** 
+   * Pixel graph of the expansion moves.  The smoothness weight of an arc
+   * p->q is that of the neighborhood term (p, q), or 0 if q is not an
+   * active neighbor of p.  The data term of the current label of every
+   * node is cached.
+   */
+  ResidualGraphType                   m_ResidualGraph;
+  typename NodeIdentifierImageType::Pointer m_NodeIdentifierImage;
+  std::vector<IndexType>              m_NodeIndices;
+  std::vector<EdgeWeightType>         m_ArcSmoothnessWeights;
+  std::vector<NodeWeightType>         m_NodeDataTerms;
+  typename ResidualGraphType::WeightArrayType m_NodeWeights;
+  typename ResidualGraphType::WeightArrayType m_ArcCapacities;
+  NodeWeightType                      m_HardConstraintWeight;
+
   /** 
    * private data members in base MRF class. 
    * Should be 'protected' in MRF base class? 
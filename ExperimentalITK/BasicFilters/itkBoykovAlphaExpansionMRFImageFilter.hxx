@@ -19,7 +19,6 @@
 
 #include "itkBoykovAlphaExpansionMRFImageFilter.h"
 #include "itkBoykovMinCutGraphFilter.h"
-#include "itkCastImageFilter.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageDuplicator.h"
 #include "itkImageRegionIteratorWithIndex.h"
@@ -28,6 +27,9 @@
 
 #include "vnl/vnl_math.h"
 
+#include <algorithm>
+#include <utility>
+
 namespace itk
 {
 
@@ -73,6 +75,7 @@ BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
     this->Relabel();
     return;
     }
+  this->InitializeResidualGraph();
   this->m_CurrentEnergy = this->CalculateCurrentEnergy();    
   RealType E = 2.0*m_CurrentEnergy;
 
@@ -155,6 +158,149 @@ BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
   this->m_LabelImage = duplicator->GetOutput();  
 }
 
+template<typename TInputImage, typename TGraphTraits, typename TClassifiedImage>
+void
+BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
+::InitializeResidualGraph()
+{
+  typename InputImageType::Pointer input0 = const_cast<InputImageType*>(
+    static_cast<const InputImageType*>( this->ProcessObject::GetInput( 0 ) ) );
+  this->m_ImageToGraphFunctor->SetInput( input0 );
+
+  /** Number the labeled pixels */
+  this->m_NodeIdentifierImage = NodeIdentifierImageType::New();
+  this->m_NodeIdentifierImage->SetRegions( 
+    this->m_LabelImage->GetBufferedRegion() );
+  this->m_NodeIdentifierImage->Allocate();
+  this->m_NodeIdentifierImage->FillBuffer( -1 );
+
+  std::vector<OutputPixelType> labels;
+  this->m_NodeIndices.clear();
+  ImageRegionIteratorWithIndex<OutputImageType> 
+    It( this->m_LabelImage, this->m_LabelImage->GetBufferedRegion() );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    if( It.Get() != 0 )
+      {
+      this->m_NodeIdentifierImage->SetPixel( It.GetIndex(), 
+        static_cast<int>( this->m_NodeIndices.size() ) );
+      this->m_NodeIndices.push_back( It.GetIndex() );
+      labels.push_back( It.Get() );
+      }
+    }
+  unsigned int numberOfNodes = this->m_NodeIndices.size();
+
+  /** 
+   * Collect the neighborhood terms.  Every term p->q also needs the 
+   * reverse arc q->p in the residual graph, which carries no term of its
+   * own unless q->p is a neighborhood term as well.
+   */
+  typedef std::pair<unsigned int, EdgeWeightType> ArcType;
+  std::vector<std::vector<ArcType> > arcs( numberOfNodes );
+
+  ShapedNeighborhoodIterator<NodeIdentifierImageType> nit( 
+    this->m_ImageToGraphFunctor->GetRadius(), this->m_NodeIdentifierImage, 
+    this->m_NodeIdentifierImage->GetBufferedRegion() );  
+  nit.ClearActiveList();      
+  typename BoykovImageToGraphFunctorType::IndexListType::const_iterator iter;
+  for( iter = this->m_ImageToGraphFunctor->GetActiveIndexList().begin(); 
+       iter != this->m_ImageToGraphFunctor->GetActiveIndexList().end(); ++iter )
+    {
+    nit.ActivateOffset( nit.GetOffset( *iter ) );        
+    }  
+  for( nit.GoToBegin(); !nit.IsAtEnd(); ++nit )
+    {
+    int p = nit.GetCenterPixel();
+    if( p < 0 )
+      {
+      continue;
+      }
+    IndexType idx = nit.GetIndex();
+    typename ShapedNeighborhoodIterator<NodeIdentifierImageType>::Iterator it;
+    for( it = nit.Begin(); !it.IsAtEnd(); it++ )
+      {
+      unsigned int d = it.GetNeighborhoodIndex(); 
+      bool IsInBounds;
+      int q = nit.GetPixel( d, IsInBounds );
+      IndexType nidx = nit.GetIndex( d );
+      if( IsInBounds && idx != nidx && q >= 0 )
+        {
+        arcs[p].push_back( ArcType( q, 
+          this->m_ImageToGraphFunctor->GetSmoothnessTerm( idx, nidx ) ) );
+        arcs[q].push_back( ArcType( p, static_cast<EdgeWeightType>( 0 ) ) );
+        }
+      }
+    }
+
+  /** Compress the arcs, merging the terms of duplicate arcs */
+  typename ResidualGraphType::IndexArrayType arcOffsets( 1, 0 );
+  typename ResidualGraphType::IndexArrayType arcTargets;
+  this->m_ArcSmoothnessWeights.clear();
+  for( unsigned int p = 0; p < numberOfNodes; p++ )
+    {
+    std::sort( arcs[p].begin(), arcs[p].end() );
+    for( unsigned int k = 0; k < arcs[p].size(); k++ )
+      {
+      if( k > 0 && arcs[p][k].first == arcs[p][k-1].first )
+        {
+        this->m_ArcSmoothnessWeights.back() += arcs[p][k].second;
+        }
+      else
+        {
+        arcTargets.push_back( arcs[p][k].first );
+        this->m_ArcSmoothnessWeights.push_back( arcs[p][k].second );
+        }
+      }
+    arcOffsets.push_back( arcTargets.size() );
+    std::vector<ArcType>().swap( arcs[p] );
+    }
+  this->m_ResidualGraph.Initialize( arcOffsets, arcTargets );
+
+  /** 
+   * The terminal weight of the hard constraints exceeds the total 
+   * smoothness weight around any node (cf. BoykovImageToGraphFunctor).
+   */
+  const typename ResidualGraphType::IndexArrayType &reverseArcs 
+    = this->m_ResidualGraph.GetReverseArcs();
+  this->m_HardConstraintWeight = static_cast<NodeWeightType>( 0 );
+  for( unsigned int p = 0; p < numberOfNodes; p++ )
+    {
+    NodeWeightType K = static_cast<NodeWeightType>( 1 );
+    for( unsigned int a = arcOffsets[p]; a < arcOffsets[p+1]; a++ )
+      {
+      K += static_cast<NodeWeightType>( this->m_ArcSmoothnessWeights[a] 
+        + this->m_ArcSmoothnessWeights[reverseArcs[a]] );
+      }
+    if( this->m_HardConstraintWeight < K )
+      {
+      this->m_HardConstraintWeight = K;
+      }
+    }
+
+  /** Cache the data term of the current label of each node */
+  this->m_NodeDataTerms.assign( numberOfNodes, 
+    static_cast<NodeWeightType>( 0 ) );
+  for( unsigned int i = 1; i <= this->GetNumberOfClasses(); i++ )
+    {
+    typename ProbabilityImageType::Pointer input 
+      = const_cast<ProbabilityImageType*>(
+      static_cast<const ProbabilityImageType*>(
+      this->ProcessObject::GetInput( i ) ) );
+    this->m_ImageToGraphFunctor->SetSinkLikelihoodImage( input );
+    for( unsigned int n = 0; n < numberOfNodes; n++ )
+      {
+      if( static_cast<unsigned int>( labels[n] ) == i )
+        {
+        this->m_NodeDataTerms[n] = 
+          this->m_ImageToGraphFunctor->GetSinkDataTerm( this->m_NodeIndices[n] );
+        }
+      }
+    }
+
+  this->m_NodeWeights.resize( numberOfNodes );
+  this->m_ArcCapacities.resize( arcTargets.size() );
+}
+
 template<typename TInputImage, typename TGraphTraits, typename TClassifiedImage>
 typename BoykovAlphaExpansionMRFImageFilter
   <TInputImage, TGraphTraits, TClassifiedImage>::RealType
@@ -285,173 +431,116 @@ void
 BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
 ::FindMinimumEnergyLabeling( unsigned int alpha )
 {
-  /** Create the alpha / not-alpha graph. */
-  
-  typename ProbabilityImageType::Pointer sink = ProbabilityImageType::New();
-  sink->SetRegions( this->m_LabelImage->GetBufferedRegion() );
-  sink->Allocate();
-
-  typedef CastImageFilter<OutputImageType, InputImageType> CasterType;
-  typename CasterType::Pointer caster = CasterType::New();
-  caster->SetInput( this->m_LabelImage );
-  caster->Update();
+  unsigned int numberOfNodes = this->m_ResidualGraph.GetNumberOfNodes();
+  const typename ResidualGraphType::IndexArrayType &arcOffsets 
+    = this->m_ResidualGraph.GetArcOffsets();
+  const typename ResidualGraphType::IndexArrayType &arcTargets 
+    = this->m_ResidualGraph.GetArcTargets();
+
+  std::vector<OutputPixelType> labels( numberOfNodes );
+  for( unsigned int n = 0; n < numberOfNodes; n++ )
+    {
+    labels[n] = this->m_LabelImage->GetPixel( this->m_NodeIndices[n] );
+    }
+  const OutputPixelType alphaLabel = static_cast<OutputPixelType>( alpha );
 
-  /** Create the not-alpha sink image */
+  /** 
+   * Pixels labeled alpha keep their label and do not take part in the 
+   * cut.  The source (alpha) data term replaces the cached data term of 
+   * the pixels which switch to alpha.
+   */
+  typename ProbabilityImageType::Pointer source = 
+    const_cast<ProbabilityImageType*>( static_cast<const ProbabilityImageType*>(
+       this->ProcessObject::GetInput( alpha ) ) ); 
+  this->m_ImageToGraphFunctor->SetSourceLikelihoodImage( source );  
 
-  ImageRegionIterator<InputImageType> 
-     It( caster->GetOutput(), caster->GetOutput()->GetRequestedRegion() );  
-  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+  std::vector<NodeWeightType> sourceDataTerms( numberOfNodes, 
+    static_cast<NodeWeightType>( 0 ) );
+  std::fill( this->m_NodeWeights.begin(), this->m_NodeWeights.end(), 
+    static_cast<NodeWeightType>( 0 ) );
+  std::fill( this->m_ArcCapacities.begin(), this->m_ArcCapacities.end(), 
+    static_cast<NodeWeightType>( 0 ) );
+  for( unsigned int n = 0; n < numberOfNodes; n++ )
     {
-    unsigned int label = this->m_LabelImage->GetPixel( It.GetIndex() );
-    if( label == alpha || label == 0 )
+    if( labels[n] != alphaLabel )
       {
-      It.Set( this->m_ImageToGraphFunctor->GetBackgroundValue() );
+      sourceDataTerms[n] = 
+        this->m_ImageToGraphFunctor->GetSourceDataTerm( this->m_NodeIndices[n] );
+      this->m_NodeWeights[n] = this->m_NodeDataTerms[n] - sourceDataTerms[n];
       }
-    else 
-      {
-      typename ProbabilityImageType::Pointer input 
-        = const_cast<ProbabilityImageType*>(
-        static_cast<const ProbabilityImageType*>(
-        this->ProcessObject::GetInput( label ) ) );
-      sink->SetPixel( It.GetIndex(), input->GetPixel( It.GetIndex() ) );
-      }    
-    }  
-
-  /** Create the not-alpha Index vector */
-  IndexContainerType sink_index;  
-  typename IndexContainerType::const_iterator it;
+    }
 
-  for( unsigned int i = 1; i <= this->GetNumberOfClasses(); i++ )
+  /** Hard constraints: alpha pixels to the source, the others to the sink */
+  for( unsigned int i = 1; i <= this->GetNumberOfClasses() && 
+    i < this->m_Indices.size(); i++ )
     {
-    if( i != alpha && this->m_Indices.size() > i )
+    NodeWeightType K = ( i == alpha ) ? this->m_HardConstraintWeight
+      : -this->m_HardConstraintWeight;
+    typename IndexContainerType::const_iterator it;
+    for( it = this->m_Indices[i].begin(); it != this->m_Indices[i].end(); ++it )
       {
-      for( it = this->m_Indices[i].begin(); 
-        it != this->m_Indices[i].end(); ++it ) 
+      if( this->m_NodeIdentifierImage->GetBufferedRegion().IsInside( *it ) )
         {
-        sink_index.push_back( *it ); 
+        int n = this->m_NodeIdentifierImage->GetPixel( *it );
+        if( n >= 0 && labels[n] != alphaLabel )
+          {
+          this->m_NodeWeights[n] = K;
+          }
         }
       }
     }
 
-  /** Prepare the image-to-graph functor */
-  typename ProbabilityImageType::Pointer source = 
-    const_cast<ProbabilityImageType*>( static_cast<const ProbabilityImageType*>(
-       this->ProcessObject::GetInput( alpha ) ) ); 
-  this->m_ImageToGraphFunctor->SetSourceLikelihoodImage( source );  
-  this->m_ImageToGraphFunctor->SetSinkLikelihoodImage( sink ); 
-  bool tmp_ExcludeBackground = m_ImageToGraphFunctor->GetExcludeBackground();
-  this->m_ImageToGraphFunctor->SetExcludeBackground( true );
-  if( this->m_Indices.size() > alpha )
-    {
-    this->m_ImageToGraphFunctor->SetSourceIndexContainer( 
-      this->m_Indices[alpha] );
-    }  
-  if( sink_index.size() > 0 )
-    {
-    this->m_ImageToGraphFunctor->SetSinkIndexContainer( sink_index );   
-    }
-
-  /** Create the graph from the labeled image */
-  typedef ImageToGraphFilter<InputImageType, GraphType> FilterType;
-  typename FilterType::Pointer filter = FilterType::New();
-  filter->SetInput( caster->GetOutput() );    
-  filter->SetImageToGraphFunctor( this->m_ImageToGraphFunctor ); 
-  filter->Update();    
-  typename GraphType::Pointer graph = filter->GetOutput();
-  
-  this->m_ImageToGraphFunctor->SetExcludeBackground( tmp_ExcludeBackground );
-  this->m_ImageToGraphFunctor->SetInput( this->GetInput() );
-
-  /** Reassign the edge and node weights */
-
-  typedef Image<NodePointerType, ImageDimension> NodeImageType;
-  typename NodeImageType::Pointer nodes = NodeImageType::New();  
-  nodes->SetRegions( this->m_LabelImage->GetBufferedRegion() );
-  nodes->Allocate();
-  nodes->FillBuffer( NULL );
-
-  NodePointerType node;
-  NodeIteratorType NIt( graph );
-  for( NIt.GoToBegin(); !NIt.IsAtEnd(); ++NIt )  
-    {    
-    node = NIt.GetPointer();
-    nodes->SetPixel( node->ImageIndex, node );
-    }  
-
-  NeighborhoodIteratorType nit( this->m_ImageToGraphFunctor->GetRadius(), 
-    this->m_LabelImage, this->m_LabelImage->GetBufferedRegion() );  
-  nit.ClearActiveList();      
-  typename BoykovImageToGraphFunctorType::IndexListType::const_iterator iter;
-  for( iter = this->m_ImageToGraphFunctor->GetActiveIndexList().begin(); 
-       iter != this->m_ImageToGraphFunctor->GetActiveIndexList().end(); ++iter )
-    {
-    nit.ActivateOffset( nit.GetOffset( *iter ) );        
-    }  
-
-  for( nit.GoToBegin(); !nit.IsAtEnd(); ++nit )
+  /** Smoothness terms */
+  for( unsigned int p = 0; p < numberOfNodes; p++ )
     {
-    IndexType idx = nit.GetIndex();    
-    node = nodes->GetPixel( idx );   
-    if( node == NULL )
-      {
-      continue; 
-      }  
-    typename ShapedNeighborhoodIterator<OutputImageType>::Iterator it;
-    for( it = nit.Begin(); !it.IsAtEnd(); it++ )
+    for( unsigned int a = arcOffsets[p]; a < arcOffsets[p+1]; a++ )
       {
-      unsigned int d = it.GetNeighborhoodIndex(); 
-      bool IsInBounds;
-      nit.GetPixel( d, IsInBounds );
-      IndexType nidx = nit.GetIndex( d );
-      if( idx != nidx && IsInBounds )
+      EdgeWeightType w = this->m_ArcSmoothnessWeights[a];
+      if( w == static_cast<EdgeWeightType>( 0 ) )
         {
-        if( nit.GetPixel( d ) != static_cast<int>( alpha ) 
-            && nodes->GetPixel( nidx ) != NULL )
-          {   
-          EdgeWeightType A = this->CalculateSmoothnessPenaltyTerm(
-            idx, nidx, alpha, alpha );
-          EdgeWeightType B = this->CalculateSmoothnessPenaltyTerm(
-            idx, nidx, alpha, nit.GetPixel( d ) );
-          EdgeWeightType C = this->CalculateSmoothnessPenaltyTerm(
-            idx, nidx, nit.GetCenterPixel(), alpha );
-          EdgeWeightType D = this->CalculateSmoothnessPenaltyTerm(
-            idx, nidx, nit.GetCenterPixel(), nit.GetPixel( d ) );
-          this->AddBinaryTerm( graph, graph->GetEdgePointer(
-                  nodes->GetPixel( idx ), nodes->GetPixel( nidx ) ), 
-                  A, B, C, D );
-          }
-        else
-          {
-          EdgeWeightType A = this->CalculateSmoothnessPenaltyTerm(
-            idx, nidx, alpha, nit.GetPixel( d ) );
-          EdgeWeightType B = this->CalculateSmoothnessPenaltyTerm( 
-            idx, nidx, nit.GetCenterPixel(), alpha );
-          this->AddUnaryTerm( graph, node, static_cast<NodeWeightType>( A ), 
-            static_cast<NodeWeightType>( B ) );
-          }
-        }    
-      } 
+        continue;
+        }
+      unsigned int q = arcTargets[a];
+      unsigned int lp = labels[p];
+      unsigned int lq = labels[q];
+      if( lp != alpha && lq != alpha )
+        {
+        this->AddBinaryTerm( p, a, 
+          this->CalculateSmoothnessPenaltyTerm( w, alpha, alpha ),
+          this->CalculateSmoothnessPenaltyTerm( w, alpha, lq ),
+          this->CalculateSmoothnessPenaltyTerm( w, lp, alpha ),
+          this->CalculateSmoothnessPenaltyTerm( w, lp, lq ) );
+        }
+      else if( lp != alpha )
+        {
+        this->AddUnaryTerm( p, static_cast<NodeWeightType>( 
+          this->CalculateSmoothnessPenaltyTerm( w, alpha, lq ) ), 
+          static_cast<NodeWeightType>( 
+          this->CalculateSmoothnessPenaltyTerm( w, lp, lq ) ) );
+        }
+      else if( lq != alpha )
+        {
+        this->AddUnaryTerm( q, static_cast<NodeWeightType>( 
+          this->CalculateSmoothnessPenaltyTerm( w, lp, alpha ) ), 
+          static_cast<NodeWeightType>( 
+          this->CalculateSmoothnessPenaltyTerm( w, lp, lq ) ) );
+        }
+      }
     }
-  
-  /** Label the graph nodes as 'sink' or 'source' (alpha or not alpha) */
-  typedef BoykovMinCutGraphFilter<GraphType> MinCutFilterType;
-  typename MinCutFilterType::Pointer mincut = MinCutFilterType::New();  
-  mincut->SetInput( filter->GetOutput() );
-  mincut->Update();  
-  graph = mincut->GetOutput();
+
+  /** Label the nodes as 'sink' or 'source' (alpha or not alpha) */
+  this->m_ResidualGraph.SetCapacities( 
+    this->m_NodeWeights, this->m_ArcCapacities );
+  this->m_ResidualGraph.ComputeMaximumFlow();
 
   /** Update the m_LabelImage with the new labeling */
-  for( NIt.GoToBegin(); !NIt.IsAtEnd(); ++NIt )
+  for( unsigned int n = 0; n < numberOfNodes; n++ )
     {
-    node = NIt.GetPointer();
-    IndexType idx = node->ImageIndex;       
-    if( this->m_LabelImage->GetBufferedRegion().IsInside( idx ) )
+    if( labels[n] != alphaLabel && this->m_ResidualGraph.IsSourceNode( n ) )
       {
-      if( !node->IsSink && node->Parent != NULL )
-        {        
-        this->m_LabelImage->SetPixel(idx, alpha); 
-        }  
-      }  
+      this->m_LabelImage->SetPixel( this->m_NodeIndices[n], alphaLabel ); 
+      this->m_NodeDataTerms[n] = sourceDataTerms[n];
+      }
     }
 }
 
@@ -594,19 +683,21 @@ BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
 template<typename TInputImage, typename TGraphTraits, typename TClassifiedImage>
 void 
 BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
-::AddUnaryTerm( GraphType *graph, NodePointerType node, 
-  NodeWeightType A, NodeWeightType B )
+::AddUnaryTerm( unsigned int node, NodeWeightType A, NodeWeightType B )
 {
-  graph->AddNodeWeight( node, B-A );
+  this->m_NodeWeights[node] += B-A;
 }
 
 template<typename TInputImage, typename TGraphTraits, typename TClassifiedImage>
 void 
 BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
-::AddBinaryTerm( GraphType *graph, EdgePointerType edge, EdgeWeightType A, 
+::AddBinaryTerm( unsigned int node, unsigned int arc, EdgeWeightType A, 
   EdgeWeightType B, EdgeWeightType C, EdgeWeightType D )
 {
-  this->AddUnaryTerm( graph, graph->GetNodePointer( edge->SourceIdentifier ), 
+  unsigned int target = this->m_ResidualGraph.GetArcTargets()[arc];
+  unsigned int reverse = this->m_ResidualGraph.GetReverseArcs()[arc];
+
+  this->AddUnaryTerm( node, 
     static_cast<NodeWeightType>( A ), static_cast<NodeWeightType>( D ) );
   B -= A;
   C -= D;
@@ -618,29 +709,25 @@ BoykovAlphaExpansionMRFImageFilter<TInputImage, TGraphTraits, TClassifiedImage>
 
   if( B < 0 )
     {
-    this->AddUnaryTerm( graph, graph->GetNodePointer( edge->SourceIdentifier ), 
+    this->AddUnaryTerm( node, 
       static_cast<NodeWeightType>( B ), static_cast<NodeWeightType>( 0 ) );
-    this->AddUnaryTerm( graph, 
-      graph->GetNodePointer( edge->TargetIdentifier ), 
+    this->AddUnaryTerm( target, 
       static_cast<NodeWeightType>( -B ), static_cast<NodeWeightType>( 0 ) );
-    graph->SetEdgeWeight( edge, static_cast<EdgeWeightType>( 0 ) );
-    graph->SetEdgeWeight( graph->GetReverseEdgePointer( edge ), B+C );
+    this->m_ArcCapacities[reverse] += B+C;
     }
   else if( C < 0 )
     {
-    this->AddUnaryTerm( graph, graph->GetNodePointer( edge->SourceIdentifier ), 
+    this->AddUnaryTerm( node, 
       static_cast<NodeWeightType>( -C ), static_cast<NodeWeightType>( 0 ) );
-    this->AddUnaryTerm(graph, graph->GetNodePointer( edge->TargetIdentifier ), 
+    this->AddUnaryTerm( target, 
       static_cast<NodeWeightType>( C ), static_cast<NodeWeightType>( 0 ) );
-    graph->SetEdgeWeight( edge, B+C );
-    graph->SetEdgeWeight( graph->GetReverseEdgePointer( edge ), 
-      static_cast<EdgeWeightType>( 0 ) );
-  }
+    this->m_ArcCapacities[arc] += B+C;
+    }
   else
-  {
-    graph->SetEdgeWeight( edge, B );
-    graph->SetEdgeWeight( graph->GetReverseEdgePointer( edge ), C );
-  }
+    {
+    this->m_ArcCapacities[arc] += B;
+    this->m_ArcCapacities[reverse] += C;
+    }
 }
 
 
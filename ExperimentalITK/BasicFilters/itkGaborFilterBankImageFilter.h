@@ -20,14 +20,28 @@
 #include "itkImageToImageFilter.h"
 
 #include "itkFixedArray.h"
-#include "itkGaussianImageSource.h"
+#include "itkFastMutexLock.h"
+#include "itkMultiThreader.h"
 
+#include <complex>
+#include <vector>
 
 namespace itk
 {
 
 /** \class GaborFilterBankImageFilter.h
  * \brief Image filter.
+ *
+ * Filters the input with a bank of rotated Gabor filters in the frequency
+ * domain and keeps the maximum response.  The Fourier transform of each
+ * bank member (a pair of Gaussians centered at the +/- fundamental
+ * frequency, rotated by the Euler angles (theta, psi, phi) about the x, y
+ * and z axes) is evaluated analytically at the frequency samples, so no
+ * kernel image is resampled.  The bank members are processed concurrently.
+ *
+ * Besides the maximum response (the output), the filter provides the index
+ * of the bank member of the maximum response (GetOrientationImage()) and,
+ * optionally, the response of every bank member (GetResponseImage()).
  */
 
 template <class TInputImage, class TOutputImage>
@@ -57,12 +71,14 @@ public:
     itkGetStaticConstMacro( ImageDimension )>     RealImageType; 
   typedef Image<unsigned int, 
     itkGetStaticConstMacro( ImageDimension )>     LabelImageType;   
-  typedef GaussianImageSource<RealImageType>      FourierTransformGaborImageSourceType; 
   typedef FixedArray<RealType, 
     itkGetStaticConstMacro( ImageDimension )>     ArrayType; 
   typedef FixedArray<unsigned int, 
     itkGetStaticConstMacro( ImageDimension )>     UnsignedIntArrayType; 
 
+  /** Bank member parameters: (gabor spacing, theta, psi, phi) */
+  typedef FixedArray<RealType, 4>                 BankMemberType;
+
   /** Helper functions */
 
   itkSetMacro( NumberOfGaborSpacingSteps, unsigned int );
@@ -83,17 +99,103 @@ public:
   itkSetMacro( NumberOfRotationAngleSteps, UnsignedIntArrayType );
   itkGetConstMacro( NumberOfRotationAngleSteps, UnsignedIntArrayType );
 
+  /**
+   * Keep the response image of each bank member (default = false).
+   */
+  itkSetMacro( GenerateResponseImages, bool );
+  itkGetConstMacro( GenerateResponseImages, bool );
+  itkBooleanMacro( GenerateResponseImages );
+
+  /**
+   * Keep the frequency-domain kernels between updates so that filtering
+   * several images of the same geometry with the same bank only evaluates
+   * them once.  The cache holds one real image per bank member
+   * (default = false).
+   */
+  itkSetMacro( UseKernelCache, bool );
+  itkGetConstMacro( UseKernelCache, bool );
+  itkBooleanMacro( UseKernelCache );
+
+  /** Index of the bank member with the maximum response at each voxel. */
+  itkGetObjectMacro( OrientationImage, LabelImageType );
+
+  /** Response of the n-th bank member (requires GenerateResponseImages). */
+  RealImageType* GetResponseImage( unsigned int n )
+    {
+    if( n >= this->m_ResponseImages.size() )
+      {
+      return NULL;
+      }
+    return this->m_ResponseImages[n].GetPointer();
+    }
+
+  /** Bank members of the last update, in the order of the member index. */
+  unsigned int GetNumberOfBankMembers() const
+    {
+    return this->m_BankMembers.size();
+    }
+  const BankMemberType & GetBankMember( unsigned int n ) const
+    {
+    return this->m_BankMembers[n];
+    }
+
 protected:
   GaborFilterBankImageFilter();
   virtual ~GaborFilterBankImageFilter();
   void PrintSelf( std::ostream& os, Indent indent ) const;
 
+  /** The Fourier transform needs the entire input. */
+  void GenerateInputRequestedRegion();
+  void EnlargeOutputRequestedRegion( DataObject *output );
+
   void GenerateData();
 
 private:
   GaborFilterBankImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
+  typedef std::complex<RealType>                  ComplexType;
+  typedef typename RealImageType::SizeType        SizeType;
+  typedef typename RealImageType::SpacingType     SpacingType;
+
+  struct ThreadStruct
+    {
+    Self                                          *Filter;
+    SizeType                                       PaddedSize;
+    SizeType                                       Size;
+    SpacingType                                    Spacing;
+    const ComplexType                             *Spectrum;
+    RealType                                      *MaximumResponse;
+    unsigned int                                  *MaximumMember;
+    };
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback( void *arg );
+
+  /** Filters the input with one bank member. */
+  void ThreadedFilterBankMember( ThreadStruct *, unsigned int,
+    std::vector<ComplexType> &, std::vector<RealType> & );
+
+  /** Enumerates the bank members from the spacing and angle ranges. */
+  void InitializeBankMembers();
+
+  /** Fourier transform of a bank member at the (unshifted) frequency
+   * samples of an image of the given size and spacing, padded to the
+   * given FFT size. */
+  void EvaluateKernel( const BankMemberType &, const SizeType &,
+    const SizeType &, const SpacingType &, RealType * ) const;
+
+  /** In-place separable Fourier transform.  The inverse transform is
+   * not normalized. */
+  static void TransformSpectrum( ComplexType *, const SizeType &, bool );
+
+  /** Offset in the padded buffer of the n-th row along x of the image. */
+  static unsigned long GetPaddedRowOffset( unsigned long, const SizeType &,
+    const SizeType & );
+
+  /** Smallest size >= n with no prime factors other than 2, 3 and 5. */
+  static unsigned long GetFFTSize( unsigned long );
+
   unsigned int                                     m_NumberOfGaborSpacingSteps;
   RealType                                         m_GaborSpacingMinimum;
   RealType                                         m_GaborSpacingMaximum;
@@ -102,6 +204,20 @@ private:
   ArrayType                                        m_RotationAngleMinimum;
   ArrayType                                        m_RotationAngleMaximum;
 
+  bool                                             m_GenerateResponseImages;
+  bool                                             m_UseKernelCache;
+
+  std::vector<BankMemberType>                      m_BankMembers;
+  typename LabelImageType::Pointer                 m_OrientationImage;
+  std::vector<typename RealImageType::Pointer>     m_ResponseImages;
+
+  std::vector<std::vector<RealType> >              m_KernelCache;
+  std::vector<BankMemberType>                      m_KernelCacheMembers;
+  SizeType                                         m_KernelCacheSize;
+  SizeType                                         m_KernelCachePaddedSize;
+  SpacingType                                      m_KernelCacheSpacing;
+
+  SimpleFastMutexLock                              m_Mutex;
 };
 
 } // end namespace itk
@@ -111,4 +227,3 @@ private:
 #endif
 
 #endif
-
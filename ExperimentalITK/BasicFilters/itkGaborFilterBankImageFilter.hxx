@@ -3,24 +3,12 @@
 
 #include "itkGaborFilterBankImageFilter.h"
 
-#include "itkBinaryThresholdImageFilter.h"
-#include "itkEuler3DTransform.h"
-#include "itkExtractImageFilter.h"
-#include "itkFFTShiftImageFilter.h"
-#include "itkFFTWComplexConjugateToRealImageFilter.h"
-#include "itkFFTWRealToComplexConjugateImageFilter.h"
-#include "itkResampleImageFilter.h"
-#include "itkVnlFFTComplexConjugateToRealImageFilter.h"
-#include "itkVnlFFTRealToComplexConjugateImageFilter.h"
-
-#include "itkBinaryMagnitudeImageFilter.h"
-#include "itkComplexToImaginaryImageFilter.h"
-#include "itkComplexToRealImageFilter.h"
-#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
 
 #include "vnl/vnl_math.h"
-
-#define USE_FFTW
+#include "vnl/vnl_vector.h"
+#include "vnl/algo/vnl_fft_1d.h"
 
 namespace itk
 {
@@ -29,23 +17,104 @@ template <class TInputImage, class TOutputImage>
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
 ::GaborFilterBankImageFilter()
 {
+  this->m_GenerateResponseImages = false;
+  this->m_UseKernelCache = false;
+  this->m_OrientationImage = NULL;
+  this->m_KernelCacheSize.Fill( 0 );
+  this->m_KernelCachePaddedSize.Fill( 0 );
+  this->m_KernelCacheSpacing.Fill( 0.0 );
 }
 
 template <class TInputImage, class TOutputImage>
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
 ::~GaborFilterBankImageFilter()
-{  
+{
 }
 
 template <class TInputImage, class TOutputImage>
 void
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
-::GenerateData()
+::GenerateInputRequestedRegion()
 {
+  Superclass::GenerateInputRequestedRegion();
 
-  this->AllocateOutputs();
+  InputImageType *input = const_cast<InputImageType *>( this->GetInput() );
+  if( input )
+    {
+    input->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion( DataObject *output )
+{
+  Superclass::EnlargeOutputRequestedRegion( output );
+  output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::InitializeBankMembers()
+{
+  this->m_BankMembers.clear();
+
+  RealType deltaGaborSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_GaborSpacingMaximum - this->m_GaborSpacingMinimum );
+  RealType deltaPhiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_RotationAngleMaximum[2] - this->m_RotationAngleMinimum[2] );
+  RealType deltaPsiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_RotationAngleMaximum[1] - this->m_RotationAngleMinimum[1] );
+  RealType deltaThetaSpacing = vnl_math_max( static_cast<RealType>( 1.0 ),
+    this->m_RotationAngleMaximum[0] - this->m_RotationAngleMinimum[0] );
+
+  for ( RealType gaborSpacing = this->m_GaborSpacingMinimum;
+        gaborSpacing <= this->m_GaborSpacingMaximum;
+        gaborSpacing += deltaGaborSpacing
+          / static_cast<RealType>( this->m_NumberOfGaborSpacingSteps - 1 )
+      )
+    {
+    for ( RealType phi = this->m_RotationAngleMinimum[2];
+          phi <= this->m_RotationAngleMaximum[2];
+          phi += deltaPhiSpacing
+            / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[2] - 1 )
+        )
+      {
+      for ( RealType psi = this->m_RotationAngleMinimum[1];
+            psi <= this->m_RotationAngleMaximum[1];
+            psi += deltaPsiSpacing
+              / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[1] - 1 )
+          )
+        {
+        for ( RealType theta = this->m_RotationAngleMinimum[0];
+              theta <= this->m_RotationAngleMaximum[0];
+              theta += deltaThetaSpacing
+                / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[0] - 1 )
+            )
+          {
+          BankMemberType member;
+          member[0] = gaborSpacing;
+          member[1] = theta;
+          member[2] = psi;
+          member[3] = phi;
+          this->m_BankMembers.push_back( member );
+          }
+        }
+      }
+    }
+}
 
-  this->GetOutput( NumericTraits<RealType>::NonpositiveMin() );
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  if( ImageDimension != 3 )
+    {
+    itkExceptionMacro( "The Gabor filter bank is only defined for 3-D images." );
+    }
 
   /**
    * Note regarding tagging geometry:  Assume that the tagging planes are perpendicular
@@ -54,319 +123,446 @@ GaborFilterBankImageFilter<TInputImage, TOutputImage>
    * the x, y, and z axes, respectively.
    */
 
-  typename InputImageType::SpacingType spacing;
-  for ( unsigned int i = 0; i < ImageDimension; i++ )
-    { 
-    spacing[i] = 1.0 / this->GetInput()->GetSpacing()[i];
+  this->AllocateOutputs();
+
+  typename OutputImageType::Pointer output = this->GetOutput();
+  typename OutputImageType::RegionType region = output->GetRequestedRegion();
+
+  this->InitializeBankMembers();
+  const unsigned int numberOfMembers = this->m_BankMembers.size();
+
+  /**
+   * Pad the input to a size the vnl fft can handle and generate its
+   * fourier transform, which is shared by all the bank members.
+   */
+  ThreadStruct str;
+  str.Filter = this;
+  str.Size = region.GetSize();
+  str.Spacing = this->GetInput()->GetSpacing();
+
+  unsigned long numberOfPixels = 1;
+  unsigned long numberOfPaddedPixels = 1;
+  for( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    str.PaddedSize[i] = GetFFTSize( str.Size[i] );
+    numberOfPixels *= str.Size[i];
+    numberOfPaddedPixels *= str.PaddedSize[i];
     }
 
+  std::vector<ComplexType> spectrum( numberOfPaddedPixels,
+    ComplexType( 0.0, 0.0 ) );
+
+  unsigned long numberOfRows = 1;
+  for( unsigned int d = 1; d < ImageDimension; d++ )
+    {
+    numberOfRows *= str.Size[d];
+    }
+
+  ImageRegionConstIterator<InputImageType> ItI( this->GetInput(), region );
+  ItI.GoToBegin();
+  for( unsigned long r = 0; r < numberOfRows; r++ )
+    {
+    ComplexType *row = &spectrum[0] + GetPaddedRowOffset( r, str.Size,
+      str.PaddedSize );
+    for( unsigned long i = 0; i < str.Size[0]; i++ )
+      {
+      row[i] = ComplexType( static_cast<RealType>( ItI.Get() ), 0.0 );
+      ++ItI;
+      }
+    }
+
+  TransformSpectrum( &spectrum[0], str.PaddedSize, false );
+  str.Spectrum = &spectrum[0];
+
   /**
-   * Generate the fourier transform of the input image
+   * Invalidate the cached kernels if the bank or the geometry changed
    */
-#ifdef USE_FFTW   
-  typedef FFTWRealToComplexConjugateImageFilter
-    <RealType, ImageDimension> FFTFilterType;
-#else
-  typedef VnlFFTRealToComplexConjugateImageFilter
-    <RealType, ImageDimension> FFTFilterType;
-#endif
-  typename FFTFilterType::Pointer fftFilter = FFTFilterType::New();
-  fftFilter->SetInput( this->GetInput() );
-  fftFilter->Update(); 
-  fftFilter->GetOutput()->SetSpacing( spacing );
+  if( this->m_UseKernelCache )
+    {
+    if( this->m_KernelCacheMembers != this->m_BankMembers ||
+      this->m_KernelCacheSize != str.Size ||
+      this->m_KernelCachePaddedSize != str.PaddedSize ||
+      this->m_KernelCacheSpacing != str.Spacing )
+      {
+      this->m_KernelCache.clear();
+      this->m_KernelCache.resize( numberOfMembers );
+      this->m_KernelCacheMembers = this->m_BankMembers;
+      this->m_KernelCacheSize = str.Size;
+      this->m_KernelCachePaddedSize = str.PaddedSize;
+      this->m_KernelCacheSpacing = str.Spacing;
+      }
+    }
+  else
+    {
+    this->m_KernelCache.clear();
+    this->m_KernelCacheMembers.clear();
+    this->m_KernelCacheSize.Fill( 0 );
+    this->m_KernelCachePaddedSize.Fill( 0 );
+    }
+
+  this->m_ResponseImages.clear();
+  if( this->m_GenerateResponseImages )
+    {
+    this->m_ResponseImages.resize( numberOfMembers );
+    for( unsigned int n = 0; n < numberOfMembers; n++ )
+      {
+      this->m_ResponseImages[n] = RealImageType::New();
+      this->m_ResponseImages[n]->CopyInformation( output );
+      this->m_ResponseImages[n]->SetRegions( region );
+      this->m_ResponseImages[n]->Allocate();
+      }
+    }
+
+  std::vector<RealType> maximumResponse( numberOfPixels,
+    NumericTraits<RealType>::NonpositiveMin() );
+  std::vector<unsigned int> maximumMember( numberOfPixels, 0 );
+  str.MaximumResponse = &maximumResponse[0];
+  str.MaximumMember = &maximumMember[0];
+
+  /**
+   * Filter with the bank members in parallel
+   */
+  if( numberOfMembers > 0 )
+    {
+    int numberOfThreads = vnl_math_min( this->GetNumberOfThreads(),
+      static_cast<int>( numberOfMembers ) );
+    numberOfThreads = vnl_math_max( numberOfThreads, 1 );
+
+    this->GetMultiThreader()->SetNumberOfThreads( numberOfThreads );
+    this->GetMultiThreader()->SetSingleMethod( this->ThreaderCallback, &str );
+    this->GetMultiThreader()->SingleMethodExecute();
+    }
+
+  this->m_OrientationImage = LabelImageType::New();
+  this->m_OrientationImage->CopyInformation( output );
+  this->m_OrientationImage->SetRegions( region );
+  this->m_OrientationImage->Allocate();
+
+  ImageRegionIterator<OutputImageType> ItO( output, region );
+  ImageRegionIterator<LabelImageType> ItL( this->m_OrientationImage, region );
+  unsigned long n = 0;
+  for( ItO.GoToBegin(), ItL.GoToBegin(); !ItO.IsAtEnd(); ++ItO, ++ItL, ++n )
+    {
+    ItO.Set( static_cast<typename OutputImageType::PixelType>(
+      maximumResponse[n] ) );
+    ItL.Set( maximumMember[n] );
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::ThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  unsigned long numberOfPaddedPixels = 1;
+  for( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    numberOfPaddedPixels *= str->PaddedSize[i];
+    }
+
+  // Work buffers, reused for all the bank members of the thread
+  std::vector<ComplexType> buffer( numberOfPaddedPixels );
+  std::vector<RealType> kernel( numberOfPaddedPixels );
+
+  const unsigned int numberOfMembers = str->Filter->m_BankMembers.size();
+  for( unsigned int n = threadId; n < numberOfMembers; n += threadCount )
+    {
+    str->Filter->ThreadedFilterBankMember( str, n, buffer, kernel );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::ThreadedFilterBankMember( ThreadStruct *str, unsigned int n,
+  std::vector<ComplexType> & buffer, std::vector<RealType> & kernel )
+{
+  const unsigned long numberOfPaddedPixels = buffer.size();
 
-  typedef typename FFTFilterType::OutputImageType ComplexImageType;
-  typename ComplexImageType::Pointer fft = ComplexImageType::New();
+  /**
+   * Generate the fourier transform of the gabor filter.  Each cached
+   * kernel is only touched by the thread of its bank member.
+   */
+  const RealType *K = &kernel[0];
+  if( this->m_UseKernelCache )
+    {
+    std::vector<RealType> & cachedKernel = this->m_KernelCache[n];
+    if( cachedKernel.empty() )
+      {
+      cachedKernel.resize( numberOfPaddedPixels );
+      this->EvaluateKernel( this->m_BankMembers[n], str->Size,
+        str->PaddedSize, str->Spacing, &cachedKernel[0] );
+      }
+    K = &cachedKernel[0];
+    }
+  else
+    {
+    this->EvaluateKernel( this->m_BankMembers[n], str->Size,
+      str->PaddedSize, str->Spacing, &kernel[0] );
+    }
+
+  /**
+   * Multiply in frequency space and transform back
+   */
+  for( unsigned long i = 0; i < numberOfPaddedPixels; i++ )
+    {
+    buffer[i] = str->Spectrum[i] * -K[i];
+    }
+  TransformSpectrum( &buffer[0], str->PaddedSize, true );
+
+  /**
+   * Crop the padding.  The kernel buffer is free at this point and holds
+   * the response unless the response image is kept.
+   */
+  RealType *response = &kernel[0];
+  if( this->m_GenerateResponseImages )
+    {
+    response = this->m_ResponseImages[n]->GetBufferPointer();
+    }
+
+  const RealType scale = 1.0 / static_cast<RealType>( numberOfPaddedPixels );
+
+  unsigned long numberOfRows = 1;
+  for( unsigned int d = 1; d < ImageDimension; d++ )
+    {
+    numberOfRows *= str->Size[d];
+    }
+
+  unsigned long index = 0;
+  for( unsigned long r = 0; r < numberOfRows; r++ )
+    {
+    const unsigned long paddedOffset = GetPaddedRowOffset( r, str->Size,
+      str->PaddedSize );
+    for( unsigned long i = 0; i < str->Size[0]; i++ )
+      {
+      response[index++] = buffer[paddedOffset + i].real() * scale;
+      }
+    }
+
+  /**
+   * Keep the maximum response.  Ties go to the lowest bank member so the
+   * result does not depend on the thread scheduling.
+   */
+  this->m_Mutex.Lock();
+  for( unsigned long i = 0; i < index; i++ )
+    {
+    if( response[i] > str->MaximumResponse[i] ||
+      ( response[i] == str->MaximumResponse[i] && n < str->MaximumMember[i] ) )
+      {
+      str->MaximumResponse[i] = response[i];
+      str->MaximumMember[i] = n;
+      }
+    }
+  this->m_Mutex.Unlock();
+}
+
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::EvaluateKernel( const BankMemberType & member, const SizeType & imageSize,
+  const SizeType & size, const SpacingType & spacing, RealType *kernel ) const
+{
+  /**
+   * Calculate the initial parameters.  The kernel is the sum of two
+   * gaussians centered at the +/- fundamental frequency along x, with the
+   * frequency samples spaced by the inverse of the image spacing.
+   */
+  const RealType gaborSpacing = member[0];
 
-#ifdef USE_FFTW   
-  fft->SetSpacing( spacing );
-  fft->SetOrigin( fftFilter->GetOutput()->GetOrigin() );
-  fft->SetRegions( this->GetInput()->GetRequestedRegion() ); 
-  fft->SetDirection( this->GetInput()->GetDirection() ); 
-  fft->Allocate();
+  ArrayType sigma;
+  sigma[0] = 1.0 / gaborSpacing;
+  sigma[1] = sigma[2] = 2.0 * sigma[0];
 
-  ImageRegionIteratorWithIndex<ComplexImageType> ItF( fft,
-    fft->GetRequestedRegion() ); 
+  RealType inverseVariance[3];
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    RealType gaussianSigma = 1.0 / ( 2.0 * sigma[i] * vnl_math::pi );
+    inverseVariance[i] = 1.0 / vnl_math_sqr( gaussianSigma );
+    }
 
-  for ( ItF.GoToBegin(); !ItF.IsAtEnd(); ++ItF )
+  /**
+   * Rotation of the Euler3DTransform with angles (theta, psi, phi):
+   * R = Rz( phi ) * Rx( theta ) * Ry( psi ).  Resampling the unrotated
+   * kernel K0 with it gives K( f ) = K0( R f ) about the zero frequency.
+   */
+  const RealType cx = vcl_cos( member[1] );
+  const RealType sx = vcl_sin( member[1] );
+  const RealType cy = vcl_cos( member[2] );
+  const RealType sy = vcl_sin( member[2] );
+  const RealType cz = vcl_cos( member[3] );
+  const RealType sz = vcl_sin( member[3] );
+
+  RealType R[3][3];
+  R[0][0] = cz * cy - sz * sx * sy;
+  R[0][1] = -sz * cx;
+  R[0][2] = cz * sy + sz * sx * cy;
+  R[1][0] = sz * cy + cz * sx * sy;
+  R[1][1] = cz * cx;
+  R[1][2] = sz * sy - cz * sx * cy;
+  R[2][0] = -cx * sy;
+  R[2][1] = sx;
+  R[2][2] = cx * cy;
+
+  // Frequencies of the unshifted transform: index k stands for k - M
+  // past the Nyquist frequency.  The padded grid of size M samples the
+  // frequencies of the image of size N more finely, by N / M, so that the
+  // kernel does not change with the padding.
+  std::vector<RealType> frequencies[3];
+  for( unsigned int d = 0; d < 3; d++ )
     {
-    if ( ItF.GetIndex()[0] <= 0.5 * fft->GetRequestedRegion().GetSize()[0] )
+    const RealType scale = static_cast<RealType>( imageSize[d] ) /
+      ( static_cast<RealType>( size[d] ) * spacing[d] );
+    frequencies[d].resize( size[d] );
+    for( long k = 0; k < static_cast<long>( size[d] ); k++ )
       {
-      ItF.Set( fftFilter->GetOutput()->GetPixel( ItF.GetIndex() ) );  
-      } 
-    else
+      long signedIndex = ( 2 * k <= static_cast<long>( size[d] ) )
+        ? k : k - static_cast<long>( size[d] );
+      frequencies[d][k] = static_cast<RealType>( signedIndex ) * scale;
+      }
+    }
+
+  // Exponents beyond this value underflow the kernel to zero
+  const RealType maximumExponent = 100.0;
+
+  unsigned long index = 0;
+  for( unsigned long k2 = 0; k2 < size[2]; k2++ )
+    {
+    for( unsigned long k1 = 0; k1 < size[1]; k1++ )
       {
-      typename ComplexImageType::IndexType index;
-      for ( unsigned int i = 0; i < ImageDimension; i++ )
+      const RealType f1 = frequencies[1][k1];
+      const RealType f2 = frequencies[2][k2];
+
+      const RealType q0 = R[0][1] * f1 + R[0][2] * f2;
+      const RealType q1 = R[1][1] * f1 + R[1][2] * f2;
+      const RealType q2 = R[2][1] * f1 + R[2][2] * f2;
+
+      for( unsigned long k0 = 0; k0 < size[0]; k0++ )
         {
-        index[i] = fft->GetRequestedRegion().GetSize()[i] - ItF.GetIndex()[i];
-        } 
-      typename ComplexImageType::PixelType pixel
-        = fftFilter->GetOutput()->GetPixel( index );
-      ItF.Set( std::complex<RealType>( pixel.real(), -pixel.imag() ) ); 
+        const RealType f0 = frequencies[0][k0];
+
+        const RealType p0 = q0 + R[0][0] * f0;
+        const RealType p1 = q1 + R[1][0] * f0;
+        const RealType p2 = q2 + R[2][0] * f0;
+
+        const RealType transverse = vnl_math_sqr( p1 ) * inverseVariance[1]
+          + vnl_math_sqr( p2 ) * inverseVariance[2];
+        const RealType minus = vnl_math_sqr( p0 - gaborSpacing )
+          * inverseVariance[0] + transverse;
+        const RealType plus = vnl_math_sqr( p0 + gaborSpacing )
+          * inverseVariance[0] + transverse;
+
+        RealType value = 0.0;
+        if( minus < maximumExponent )
+          {
+          value += vcl_exp( -0.5 * minus );
+          }
+        if( plus < maximumExponent )
+          {
+          value += vcl_exp( -0.5 * plus );
+          }
+        kernel[index++] = value;
+        }
       }
     }
+}
 
-#else
-  fft = fftFilter->GetOutput();
-#endif 
-
-  typedef FFTShiftImageFilter<ComplexImageType, ComplexImageType> ShifterType;
-  typename ShifterType::Pointer shifter = ShifterType::New();
-  shifter->SetInput( fft );
-  shifter->SetInverse( 1 );
-  shifter->Update();
-
-  
-  /** 
-   * Debug: Write magnitude image of imaginary and real parts.
-   */ 
-  /*
-  typedef ComplexToImaginaryImageFilter<ComplexImageType, RealImageType> ImaginerType;
-  typename ImaginerType::Pointer imaginer = ImaginerType::New();
-  imaginer->SetInput( shifter->GetOutput() );
-  imaginer->Update();
-
-  typedef ComplexToImaginaryImageFilter<ComplexImageType, RealImageType> RealerType;
-  typename RealerType::Pointer realer = RealerType::New();
-  realer->SetInput( shifter->GetOutput() );
-  realer->Update();
-
-  typedef BinaryMagnitudeImageFilter<RealImageType, RealImageType, RealImageType> BinarierType;
-  typename BinarierType::Pointer binarier = BinarierType::New();
-  binarier->SetInput1( imaginer->GetOutput() );
-  binarier->SetInput2( realer->GetOutput() );
-  binarier->Update();
-
-  typedef ImageFileWriter<RealImageType> WriterType;
-  typename WriterType::Pointer writer = WriterType::New();
-  writer->SetInput( binarier->GetOutput() );
-  writer->SetFileName( "FFTimage.hdr" );
-  writer->Update();
-  */  
-
-  unsigned int iteration = 0;
-
-  RealType deltaGaborSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_GaborSpacingMaximum - this->m_GaborSpacingMinimum );
-  RealType deltaPhiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_RotationAngleMaximum[2] - this->m_RotationAngleMinimum[2] );
-  RealType deltaPsiSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_RotationAngleMaximum[1] - this->m_RotationAngleMinimum[1] );
-  RealType deltaThetaSpacing = vnl_math_max( static_cast<RealType>( 1.0 ), 
-    this->m_RotationAngleMaximum[0] - this->m_RotationAngleMinimum[0] );
+template <class TInputImage, class TOutputImage>
+void
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::TransformSpectrum( ComplexType *data, const SizeType & size, bool inverse )
+{
+  unsigned long numberOfPixels = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    numberOfPixels *= size[d];
+    }
 
-  for ( RealType gaborSpacing = this->m_GaborSpacingMinimum; 
-        gaborSpacing <= this->m_GaborSpacingMaximum; 
-        gaborSpacing += deltaGaborSpacing 
-          / static_cast<RealType>( this->m_NumberOfGaborSpacingSteps - 1 ) 
-      )
+  unsigned long stride = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
     {
-    for ( RealType phi = this->m_RotationAngleMinimum[2]; 
-          phi <= this->m_RotationAngleMaximum[2]; 
-          phi += deltaPhiSpacing 
-            / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[2] - 1 )  
-        )
+    const unsigned long length = size[d];
+
+    vnl_fft_1d<RealType> fft( length );
+    vnl_vector<ComplexType> line( length );
+
+    const unsigned long numberOfBlocks = numberOfPixels / ( length * stride );
+    for( unsigned long b = 0; b < numberOfBlocks; b++ )
       {
-      for ( RealType psi = this->m_RotationAngleMinimum[1]; 
-            psi <= this->m_RotationAngleMaximum[1]; 
-            psi += deltaPsiSpacing 
-              / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[1] - 1 )  
-          )
+      for( unsigned long s = 0; s < stride; s++ )
         {
-        for ( RealType theta = this->m_RotationAngleMinimum[0]; 
-              theta <= this->m_RotationAngleMaximum[0]; 
-              theta += deltaThetaSpacing 
-                / static_cast<RealType>( this->m_NumberOfRotationAngleSteps[0] - 1 )  
-            )
+        ComplexType *start = data + b * length * stride + s;
+        for( unsigned long i = 0; i < length; i++ )
           {
-          std::cout << "Iteration " << iteration << ": " << gaborSpacing << ", " << phi << ", " << psi << ", " << theta << std::endl; 
-  
-          /**
-           * Calculate the initial parameters
-           */
-  
-          ArrayType fundamentalFrequency;
-          fundamentalFrequency[0] = gaborSpacing; 
-          fundamentalFrequency[1] = 0; 
-          fundamentalFrequency[2] = 0; 
-
-          ArrayType sigma;
-          sigma[0] = 1.0 / gaborSpacing;
-          sigma[1] = sigma[2] = 2.0 * sigma[0]; 
-        
-          /**
-           * Generate the fourier transform of the gabor filter
-           */
-          typename RealImageType::Pointer fourierGaborImage 
-            = RealImageType::New();
-          fourierGaborImage->SetOrigin( this->GetInput()->GetOrigin() );
-          fourierGaborImage->SetSpacing( spacing );
-          fourierGaborImage->SetRegions( this->GetInput()->GetRequestedRegion().GetSize() );
-          fourierGaborImage->Allocate();
-          fourierGaborImage->FillBuffer( 0.0 );
-             
-          for ( RealType d = -1.0; d <= 1.01; d+=2.0 )
-            {  
-            typename FourierTransformGaborImageSourceType::Pointer 
-              fourierGabor = FourierTransformGaborImageSourceType::New();
-            fourierGabor->SetOrigin( this->GetInput()->GetOrigin() );
-            fourierGabor->SetSpacing( spacing );
-            fourierGabor->SetSize( this->GetInput()->GetRequestedRegion().GetSize() );
-          
-            typename FourierTransformGaborImageSourceType::ArrayType gaussianSigma;
-            typename FourierTransformGaborImageSourceType::ArrayType mean;
-          
-            for ( unsigned int i = 0; i < ImageDimension; i++ )
-              {
-              gaussianSigma[i] = 1.0 / ( 2.0 * sigma[i] * vnl_math::pi );
-              mean[i] = this->GetInput()->GetOrigin()[i] 
-                + 0.5 * ( this->GetInput()->GetRequestedRegion().GetSize()[i] - 1 ) 
-                      * ( spacing[i] ) + d * fundamentalFrequency[i];
-              } 
-    
-            fourierGabor->SetSigma( gaussianSigma );
-            fourierGabor->SetMean( mean );
-            fourierGabor->SetScale( 1.0 );
-            fourierGabor->SetNormalized( false );
-            fourierGabor->Update();
-            
-            ImageRegionIterator<RealImageType> It( fourierGabor->GetOutput(),
-              fourierGabor->GetOutput()->GetRequestedRegion() );
-            ImageRegionIterator<RealImageType> ItF( fourierGaborImage,
-              fourierGaborImage->GetRequestedRegion() );
-            for ( It.GoToBegin(), ItF.GoToBegin(); !It.IsAtEnd(); ++It, ++ItF )  
-              {
-              ItF.Set( ItF.Get() + It.Get() );
-              }  
-            }       
-       
-          /**
-           * Rotate the fourier transformed gabor filter
-           */
-          typedef Euler3DTransform<RealType> TransformType;
-          typename TransformType::Pointer transform = TransformType::New();
-        
-          transform->SetRotation( theta, psi, phi );
-          typename TransformType::OutputVectorType translation;
-          translation.Fill( 0 );
-          transform->SetTranslation( translation );
-          typename TransformType::InputPointType center;
-          for ( unsigned int i = 0; i < ImageDimension; i++ )
-            {
-            center[i] = this->GetInput()->GetOrigin()[i] + 0.5
-              * ( this->GetInput()->GetRequestedRegion().GetSize()[i] - 1 ) 
-              * ( spacing[i] );
-            }
-          transform->SetCenter( center );
-          
-          typedef LinearInterpolateImageFunction
-            <RealImageType, RealType> LinearInterpolatorType;
-          typename LinearInterpolatorType::Pointer interpolator 
-            = LinearInterpolatorType::New();
-          interpolator->SetInputImage( fourierGaborImage );
-        
-          typedef ResampleImageFilter
-            <RealImageType, RealImageType, RealType> ResamplerType;
-          typename ResamplerType::Pointer resampler = ResamplerType::New();
-          resampler->SetDefaultPixelValue( NumericTraits<RealType>::Zero );
-          resampler->SetTransform( transform );
-          resampler->SetInterpolator( interpolator );
-          resampler->SetInput( fourierGaborImage );
-          resampler->SetOutputSpacing( fourierGaborImage->GetSpacing() );
-          resampler->SetOutputOrigin( fourierGaborImage->GetOrigin() );
-          resampler->SetSize( 
-            fourierGaborImage->GetRequestedRegion().GetSize() );
-          resampler->Update();
-  
-          /**
-           * Multiply in frequency space
-           */
-          typename ComplexImageType::Pointer filteredImage 
-            = ComplexImageType::New();
-          filteredImage->SetRegions( 
-            resampler->GetOutput()->GetRequestedRegion() );
-          filteredImage->SetOrigin( resampler->GetOutput()->GetOrigin() );
-          filteredImage->SetSpacing( resampler->GetOutput()->GetSpacing() );
-          filteredImage->Allocate();
-        
-          ImageRegionIterator<ComplexImageType> ItS( shifter->GetOutput(), 
-            shifter->GetOutput()->GetRequestedRegion() );
-          ImageRegionIterator<RealImageType> ItG( resampler->GetOutput(), 
-            resampler->GetOutput()->GetRequestedRegion() );
-          ImageRegionIterator<ComplexImageType> It( filteredImage, 
-            filteredImage->GetRequestedRegion() );
-        
-          ItS.GoToBegin();
-          ItG.GoToBegin();
-          It.GoToBegin();
-          while ( !It.IsAtEnd()  )
-            {
-            It.Set( ItS.Get() * std::complex<RealType>( 
-              -ItG.Get(), NumericTraits<RealType>::Zero ) );     
-        
-            ++ItS;
-            ++ItG;  
-            ++It;
-            }  
-        
-          /**
-           * Generate the fourier transform of the filtered image
-           */
-        
-          typename ShifterType::Pointer inverseShifter = ShifterType::New();
-          inverseShifter->SetInput( filteredImage );
-          inverseShifter->SetInverse( 1 );
-          inverseShifter->Update();
-
-          typename ComplexImageType::Pointer ifft = ComplexImageType::New();
-
-#ifdef USE_FFTW   
-          typedef FFTWComplexConjugateToRealImageFilter
-            <RealType, ImageDimension> InverseFFTFilterType;
-
-          typedef ExtractImageFilter
-            <ComplexImageType, ComplexImageType> ExtracterType;
-          typename ExtracterType::Pointer extracter = ExtracterType::New();
-          typename ComplexImageType::RegionType region;
-          typename ComplexImageType::RegionType::SizeType size;
-          size = inverseShifter->GetOutput()->GetRequestedRegion().GetSize();
-          size[0] = static_cast<unsigned int>( 0.5 * size[0] ) + 1;
-          region.SetIndex( 
-            inverseShifter->GetOutput()->GetRequestedRegion().GetIndex() );
-          region.SetSize( size );
-          extracter->SetInput( inverseShifter->GetOutput() );
-          extracter->SetExtractionRegion( region );  
-          extracter->Update();
-
-          ifft = extracter->GetOutput();
-#else
-          typedef VnlFFTComplexConjugateToRealImageFilter
-            <RealType, ImageDimension> InverseFFTFilterType;
-          ifft = inverseShifter->GetOutput();
-#endif
-          typename InverseFFTFilterType::Pointer ifftFilter 
-            = InverseFFTFilterType::New();
-          ifftFilter->SetInput( ifft );
-          ifftFilter->Update(); 
-          ifftFilter->GetOutput()->SetSpacing( this->GetInput()->GetSpacing() );
-
-          ImageRegionIterator<RealImageType> ItI( ifftFilter->GetOutput(), 
-            ifftFilter->GetOutput()->GetRequestedRegion() );
-          ImageRegionIterator<RealImageType> ItR( this->GetOutput(), 
-            this->GetOutput()->GetRequestedRegion() );
-     
-          for ( ItI.GoToBegin(), ItR.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++ItR )
-            {
-            ItR.Set( vnl_math_max( ItI.Get(), ItR.Get() ) );
-            }  
-  
-          iteration++;
-          } 
+          line[i] = start[i * stride];
+          }
+        if( inverse )
+          {
+          fft.bwd_transform( line );
+          }
+        else
+          {
+          fft.fwd_transform( line );
+          }
+        for( unsigned long i = 0; i < length; i++ )
+          {
+          start[i * stride] = line[i];
+          }
         }
       }
-    }      
+    stride *= length;
+    }
+}
 
+template <class TInputImage, class TOutputImage>
+unsigned long
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::GetPaddedRowOffset( unsigned long row, const SizeType & size,
+  const SizeType & paddedSize )
+{
+  unsigned long offset = 0;
+  unsigned long stride = paddedSize[0];
+  for( unsigned int d = 1; d < ImageDimension; d++ )
+    {
+    offset += ( row % size[d] ) * stride;
+    row /= size[d];
+    stride *= paddedSize[d];
+    }
+  return offset;
+}
+
+template <class TInputImage, class TOutputImage>
+unsigned long
+GaborFilterBankImageFilter<TInputImage, TOutputImage>
+::GetFFTSize( unsigned long n )
+{
+  for( unsigned long m = vnl_math_max( n, 1ul ); ; m++ )
+    {
+    unsigned long k = m;
+    while( k % 2 == 0 )
+      {
+      k /= 2;
+      }
+    while( k % 3 == 0 )
+      {
+      k /= 3;
+      }
+    while( k % 5 == 0 )
+      {
+      k /= 5;
+      }
+    if( k == 1 )
+      {
+      return m;
+      }
+    }
 }
 
 /**
@@ -376,9 +572,16 @@ template <class TInputImage, class TOutputImage>
 void
 GaborFilterBankImageFilter<TInputImage, TOutputImage>
 ::PrintSelf(
-  std::ostream& os, 
+  std::ostream& os,
   Indent indent) const
 {
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Generate response images: "
+     << this->m_GenerateResponseImages << std::endl;
+  os << indent << "Use kernel cache: " << this->m_UseKernelCache << std::endl;
+  os << indent << "Number of bank members: "
+     << this->m_BankMembers.size() << std::endl;
 }
 
 
@@ -22,6 +22,8 @@
 #include "itkVector.h"
 #include "itkVectorLinearInterpolateImageFunction.h"
 
+#include <vector>
+
 namespace itk
 {
 /** \class DeformationFieldGradientTensorImageFilter
@@ -120,9 +122,13 @@ protected:
   void PrintSelf ( std::ostream& os, Indent indent ) const;
 
 private:
+  typedef typename RealVectorImageType::IndexType              IndexType;
+  typedef typename RealVectorImageType::SizeType               SizeType;
+  typedef typename RealVectorImageType::OffsetType             OffsetType;
+  typedef typename RealVectorImageType::OffsetValueType        OffsetValueType;
+
   RadiusType                                    m_NeighborhoodRadius;
   typename RealVectorImageType::ConstPointer    m_RealValuedInputImage;
-  typename InterpolatorType::Pointer            m_Interpolator;
 
   RealType                                      m_UndisplacedVolume;
 
@@ -135,8 +141,22 @@ private:
   RealVectorType                                m_DeltaTetrahedralPointC;
   RealVectorType                                m_DeltaTetrahedralPointD;
 
+  /**
+   * The simplex vertices of neighboring voxels coincide, e.g. the vertex C
+   * of a voxel is the vertex B of the next voxel.  The vertices are grouped
+   * into lattices of points which only differ by whole voxel shifts, so
+   * each lattice point is interpolated once and shared.  All the points of
+   * a lattice have the same interpolation weights.
+   */
+  std::vector<RealVectorType>                   m_VertexDeltas;
+  std::vector<unsigned int>                     m_VertexLattices;
+  std::vector<OffsetType>                       m_VertexShifts;
+  std::vector<OffsetType>                       m_LatticeFloors;
+  std::vector<std::vector<RealType> >           m_LatticeWeights;
+
   void InitializeTetrahedralDeltaPoints();
   void InitializeTriangularDeltaPoints();
+  void InitializeVertexLattices();
 
   RealType CalculateTetrahedralVolume( PointType, PointType, PointType, PointType );
   RealType CalculateTriangularArea( PointType, PointType, PointType );
@@ -19,11 +19,10 @@
 
 #include "itkGeometricJacobianDeterminantImageFilter.h"
 
-#include "itkImageRegionIteratorWithIndex.h"
-#include "itkNeighborhoodAlgorithm.h"
+#include "itkContinuousIndex.h"
+#include "itkImageRegionIterator.h"
 #include "itkProgressReporter.h"
 #include "itkVectorCastImageFilter.h"
-#include "itkZeroFluxNeumannBoundaryCondition.h"
 
 #include "vnl/vnl_cross.h"
 
@@ -34,7 +33,6 @@ template <typename TInputImage, typename TRealType, typename TOutputImage>
 GeometricJacobianDeterminantImageFilter<TInputImage, TRealType, TOutputImage>
 ::GeometricJacobianDeterminantImageFilter()
 {
-  this->m_Interpolator = NULL;
   this->m_UndisplacedVolume = 0.0;
 }
 
@@ -111,9 +109,6 @@ GeometricJacobianDeterminantImageFilter<TInputImage, TRealType, TOutputImage>
       = dynamic_cast<const RealVectorImageType *>( this->GetInput() );
     }
 
-  this->m_Interpolator = InterpolatorType::New();
-  this->m_Interpolator->SetInputImage( this->m_RealValuedInputImage );
-
   PointType origin( 0.0 );
 
   if( ImageDimension == 2 )
@@ -125,6 +120,11 @@ GeometricJacobianDeterminantImageFilter<TInputImage, TRealType, TOutputImage>
     PointType pointC = origin + this->m_DeltaTriangularPointC;
 
     this->m_UndisplacedVolume = this->CalculateTriangularArea( pointA, pointB, pointC );
+
+    this->m_VertexDeltas.resize( 3 );
+    this->m_VertexDeltas[0] = this->m_DeltaTriangularPointA;
+    this->m_VertexDeltas[1] = this->m_DeltaTriangularPointB;
+    this->m_VertexDeltas[2] = this->m_DeltaTriangularPointC;
     }
   else if( ImageDimension == 3 )
     {
@@ -136,11 +136,19 @@ GeometricJacobianDeterminantImageFilter<TInputImage, TRealType, TOutputImage>
     PointType pointD = origin + this->m_DeltaTetrahedralPointD;
 
     this->m_UndisplacedVolume = this->CalculateTetrahedralVolume( pointA, pointB, pointC, pointD );
+
+    this->m_VertexDeltas.resize( 4 );
+    this->m_VertexDeltas[0] = this->m_DeltaTetrahedralPointA;
+    this->m_VertexDeltas[1] = this->m_DeltaTetrahedralPointB;
+    this->m_VertexDeltas[2] = this->m_DeltaTetrahedralPointC;
+    this->m_VertexDeltas[3] = this->m_DeltaTetrahedralPointD;
     }
   else
     {
     itkExceptionMacro( "Computations are only valid for ImageDimension = 2 or 3" );
     }
+
+  this->InitializeVertexLattices();
 }
 
 template< typename TInputImage, typename TRealType, typename TOutputImage >
@@ -189,90 +197,337 @@ GeometricJacobianDeterminantImageFilter<TInputImage, TRealType, TOutputImage>
 }
 
 
+template< typename TInputImage, typename TRealType, typename TOutputImage >
+void
+GeometricJacobianDeterminantImageFilter<TInputImage, TRealType, TOutputImage>
+::InitializeVertexLattices()
+{
+  const unsigned int numberOfVertices = this->m_VertexDeltas.size();
+  const unsigned int numberOfNeighbors = 1 << ImageDimension;
+
+  this->m_VertexLattices.resize( numberOfVertices );
+  this->m_VertexShifts.resize( numberOfVertices );
+  this->m_LatticeFloors.clear();
+  this->m_LatticeWeights.clear();
+
+  // Continuous index offsets of the vertices, which are the same for all
+  // the voxels since the index to physical point mapping is affine.
+
+  PointType origin = this->m_RealValuedInputImage->GetOrigin();
+
+  std::vector<ContinuousIndex<double, ImageDimension> > indexDeltas( numberOfVertices );
+  for( unsigned int v = 0; v < numberOfVertices; v++ )
+    {
+    this->m_RealValuedInputImage->TransformPhysicalPointToContinuousIndex(
+      origin + this->m_VertexDeltas[v], indexDeltas[v] );
+    }
+
+  std::vector<unsigned int> latticeBaseVertices;
+  for( unsigned int v = 0; v < numberOfVertices; v++ )
+    {
+    bool isShared = false;
+    for( unsigned int l = 0; l < latticeBaseVertices.size() && !isShared; l++ )
+      {
+      const unsigned int base = latticeBaseVertices[l];
+
+      // Vertices are only shared within a hyperplane of the last dimension
+      OffsetType shift;
+      isShared = true;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        RealType difference = indexDeltas[v][d] - indexDeltas[base][d];
+        shift[d] = static_cast<OffsetValueType>( vcl_floor( difference + 0.5 ) );
+        if( vnl_math_abs( difference - shift[d] ) > 1e-6 ||
+          ( d == ImageDimension - 1 && shift[d] != 0 ) )
+          {
+          isShared = false;
+          }
+        }
+      if( isShared )
+        {
+        this->m_VertexLattices[v] = l;
+        this->m_VertexShifts[v] = shift;
+        }
+      }
+    if( isShared )
+      {
+      continue;
+      }
+
+    this->m_VertexLattices[v] = latticeBaseVertices.size();
+    this->m_VertexShifts[v].Fill( 0 );
+    latticeBaseVertices.push_back( v );
+
+    OffsetType floor;
+    RealType fraction[ImageDimension];
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      floor[d] = static_cast<OffsetValueType>( vcl_floor( indexDeltas[v][d] ) );
+      fraction[d] = indexDeltas[v][d] - static_cast<RealType>( floor[d] );
+      }
+    this->m_LatticeFloors.push_back( floor );
+
+    std::vector<RealType> weights( numberOfNeighbors );
+    for( unsigned int n = 0; n < numberOfNeighbors; n++ )
+      {
+      weights[n] = 1.0;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        weights[n] *= ( n & ( 1 << d ) ) ? fraction[d] : 1.0 - fraction[d];
+        }
+      }
+    this->m_LatticeWeights.push_back( weights );
+    }
+}
+
 template< typename TInputImage, typename TRealType, typename TOutputImage >
 void
 GeometricJacobianDeterminantImageFilter< TInputImage, TRealType, TOutputImage >
 ::ThreadedGenerateData( const OutputImageRegionType& outputRegionForThread,
                         ThreadIdType threadId )
 {
-  ZeroFluxNeumannBoundaryCondition<RealVectorImageType> nbc;
-  ConstNeighborhoodIteratorType bit;
-  ImageRegionIteratorWithIndex<TOutputImage> it;
-
-  typename OutputImageType::Pointer outputPtr = this->GetOutput();
-
-  // Find the data-set boundary "faces"
-  typename NeighborhoodAlgorithm::
-    ImageBoundaryFacesCalculator<RealVectorImageType>::FaceListType faceList;
-  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<RealVectorImageType> bC;
-  faceList = bC( dynamic_cast<const RealVectorImageType *>
-                   ( this->m_RealValuedInputImage.GetPointer() ),
-                 outputRegionForThread, this->m_NeighborhoodRadius );
-
-  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<RealVectorImageType>::
-    FaceListType::iterator fit;
-
-  // Support progress methods/callbacks
-  ProgressReporter progress( this, threadId, outputRegionForThread.GetNumberOfPixels() );
-
-  // Process each of the data set faces.  The iterator is reinitialized on each
-  // face so that it can determine whether or not to check for boundary
-  // conditions.
-  for ( fit = faceList.begin(); fit != faceList.end(); ++fit )
+  const unsigned int numberOfVertices = this->m_VertexDeltas.size();
+  const unsigned int numberOfLattices = this->m_LatticeWeights.size();
+  const unsigned int numberOfNeighbors = 1 << ImageDimension;
+  const unsigned int last = ImageDimension - 1;
+
+  const RealVectorType *field = this->m_RealValuedInputImage->GetBufferPointer();
+  const typename RealVectorImageType::RegionType bufferedRegion =
+    this->m_RealValuedInputImage->GetBufferedRegion();
+  const OffsetValueType *offsetTable =
+    this->m_RealValuedInputImage->GetOffsetTable();
+
+  const IndexType regionIndex = outputRegionForThread.GetIndex();
+  const SizeType regionSize = outputRegionForThread.GetSize();
+
+  // Extent of each lattice within a hyperplane of the last dimension: the
+  // thread region grown by the shifts of the vertices sharing it.
+
+  std::vector<OffsetType> latticeMinimumShifts( numberOfLattices );
+  std::vector<SizeType> latticeSizes( numberOfLattices );
+  for( unsigned int l = 0; l < numberOfLattices; l++ )
     {
-    bit = ConstNeighborhoodIteratorType( this->m_NeighborhoodRadius,
-                                         dynamic_cast<const RealVectorImageType *>
-                                           ( m_RealValuedInputImage.GetPointer() ),
-                                         *fit );
-    it = ImageRegionIteratorWithIndex<TOutputImage>( outputPtr, *fit );
-    bit.OverrideBoundaryCondition( &nbc );
-    bit.GoToBegin();
-
-    while ( ! bit.IsAtEnd() )
+    OffsetType minimumShift;
+    OffsetType maximumShift;
+    minimumShift.Fill( 0 );
+    maximumShift.Fill( 0 );
+    for( unsigned int v = 0; v < numberOfVertices; v++ )
       {
-      typename InputImageType::IndexType index = it.GetIndex();
-      PointType imagePoint;
-      outputPtr->TransformIndexToPhysicalPoint( index, imagePoint );
+      if( this->m_VertexLattices[v] != l )
+        {
+        continue;
+        }
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        minimumShift[d] = vnl_math_min( minimumShift[d], this->m_VertexShifts[v][d] );
+        maximumShift[d] = vnl_math_max( maximumShift[d], this->m_VertexShifts[v][d] );
+        }
+      }
+    latticeMinimumShifts[l] = minimumShift;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      latticeSizes[l][d] = regionSize[d] + maximumShift[d] - minimumShift[d];
+      }
+    latticeSizes[l][last] = 1;
+    }
 
-      RealType displacedVolume = 0.0;
-      if( ImageDimension == 2 )
+  // Buffer offsets of the lower and upper interpolation neighbors along
+  // each dimension, clamped to the buffer (zero flux at the boundary).
+
+  std::vector<std::vector<std::vector<OffsetValueType> > > lowerOffsets(
+    numberOfLattices, std::vector<std::vector<OffsetValueType> >( ImageDimension ) );
+  std::vector<std::vector<std::vector<OffsetValueType> > > upperOffsets(
+    numberOfLattices, std::vector<std::vector<OffsetValueType> >( ImageDimension ) );
+  for( unsigned int l = 0; l < numberOfLattices; l++ )
+    {
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      OffsetValueType first = regionIndex[d] + latticeMinimumShifts[l][d] +
+        this->m_LatticeFloors[l][d];
+      OffsetValueType extent = latticeSizes[l][d];
+      if( d == last )
         {
-        typename InterpolatorType::PointType pointA;
-        pointA.CastFrom( imagePoint + this->m_DeltaTriangularPointA );
-        typename InterpolatorType::PointType pointB;
-        pointB.CastFrom( imagePoint + this->m_DeltaTriangularPointB );
-        typename InterpolatorType::PointType pointC;
-        pointC.CastFrom( imagePoint + this->m_DeltaTriangularPointC );
-
-        PointType displacedPointA = pointA + this->m_Interpolator->Evaluate( pointA );
-        PointType displacedPointB = pointB + this->m_Interpolator->Evaluate( pointB );
-        PointType displacedPointC = pointC + this->m_Interpolator->Evaluate( pointC );
-
-        displacedVolume = this->CalculateTriangularArea( displacedPointA, displacedPointB, displacedPointC );
+        extent = regionSize[last];
         }
-      else if( ImageDimension == 3 )
+      const OffsetValueType bufferStart = bufferedRegion.GetIndex()[d];
+      const OffsetValueType bufferEnd = bufferStart +
+        static_cast<OffsetValueType>( bufferedRegion.GetSize()[d] ) - 1;
+
+      lowerOffsets[l][d].resize( extent );
+      upperOffsets[l][d].resize( extent );
+      for( OffsetValueType i = 0; i < extent; i++ )
         {
-        typename InterpolatorType::PointType pointA;
-        pointA.CastFrom( imagePoint + this->m_DeltaTetrahedralPointA );
-        typename InterpolatorType::PointType pointB;
-        pointB.CastFrom( imagePoint + this->m_DeltaTetrahedralPointB );
-        typename InterpolatorType::PointType pointC;
-        pointC.CastFrom( imagePoint + this->m_DeltaTetrahedralPointC );
-        typename InterpolatorType::PointType pointD;
-        pointD.CastFrom( imagePoint + this->m_DeltaTetrahedralPointD );
-
-        PointType displacedPointA = pointA + this->m_Interpolator->Evaluate( pointA );
-        PointType displacedPointB = pointB + this->m_Interpolator->Evaluate( pointB );
-        PointType displacedPointC = pointC + this->m_Interpolator->Evaluate( pointC );
-        PointType displacedPointD = pointD + this->m_Interpolator->Evaluate( pointD );
-
-        displacedVolume = this->CalculateTetrahedralVolume( displacedPointA, displacedPointB, displacedPointC, displacedPointD );
+        OffsetValueType lower = vnl_math_max( bufferStart,
+          vnl_math_min( bufferEnd, first + i ) );
+        OffsetValueType upper = vnl_math_max( bufferStart,
+          vnl_math_min( bufferEnd, first + i + 1 ) );
+        lowerOffsets[l][d][i] = ( lower - bufferStart ) * offsetTable[d];
+        upperOffsets[l][d][i] = ( upper - bufferStart ) * offsetTable[d];
         }
+      }
+    }
+
+  // Displacements at the lattice points of the current hyperplane
+
+  std::vector<std::vector<RealVectorType> > displacements( numberOfLattices );
+  for( unsigned int l = 0; l < numberOfLattices; l++ )
+    {
+    unsigned long numberOfPoints = 1;
+    for( unsigned int d = 0; d < last; d++ )
+      {
+      numberOfPoints *= latticeSizes[l][d];
+      }
+    displacements[l].resize( numberOfPoints );
+    }
+
+  // Undisplaced edges of the simplex, from the last vertex
 
-      RealType volumeDifferential = displacedVolume / this->m_UndisplacedVolume;
-      it.Set( volumeDifferential );
-      ++bit;
-      ++it;
+  RealType edges[3][3];
+  for( unsigned int v = 0; v + 1 < numberOfVertices; v++ )
+    {
+    for( unsigned int d = 0; d < 3; d++ )
+      {
+      edges[v][d] = ( d < ImageDimension ) ? this->m_VertexDeltas[v][d] -
+        this->m_VertexDeltas[numberOfVertices - 1][d] : 0.0;
+      }
+    }
+
+  const RealType *vertexDisplacements[4];
+  const RealType inverseUndisplacedVolume = 1.0 / this->m_UndisplacedVolume;
+
+  unsigned long numberOfRows = 1;
+  for( unsigned int d = 1; d < last; d++ )
+    {
+    numberOfRows *= regionSize[d];
+    }
+
+  ImageRegionIterator<TOutputImage> It( this->GetOutput(), outputRegionForThread );
+  It.GoToBegin();
+
+  // Support progress methods/callbacks, one row at a time
+  ProgressReporter progress( this, threadId, numberOfRows * regionSize[last] );
+
+  for( OffsetValueType k = 0; k < static_cast<OffsetValueType>( regionSize[last] ); k++ )
+    {
+    // Interpolate the displacement field at the lattice points of the
+    // hyperplane, with the same weights for all the points of a lattice.
+
+    for( unsigned int l = 0; l < numberOfLattices; l++ )
+      {
+      const std::vector<RealType> & weights = this->m_LatticeWeights[l];
+      const unsigned long numberOfPoints = displacements[l].size();
+
+      OffsetValueType position[ImageDimension];
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        position[d] = 0;
+        }
+      position[last] = k;
+
+      for( unsigned long p = 0; p < numberOfPoints; p++ )
+        {
+        RealVectorType displacement;
+        displacement.Fill( 0.0 );
+        for( unsigned int n = 0; n < numberOfNeighbors; n++ )
+          {
+          OffsetValueType offset = 0;
+          for( unsigned int d = 0; d < ImageDimension; d++ )
+            {
+            offset += ( n & ( 1 << d ) ) ? upperOffsets[l][d][position[d]]
+              : lowerOffsets[l][d][position[d]];
+            }
+          displacement += field[offset] * weights[n];
+          }
+        displacements[l][p] = displacement;
+
+        for( unsigned int d = 0; d < last; d++ )
+          {
+          if( ++position[d] < static_cast<OffsetValueType>( latticeSizes[l][d] ) )
+            {
+            break;
+            }
+          position[d] = 0;
+          }
+        }
+      }
+
+    // Simplex volumes, one row of voxels at a time.  The vertex
+    // displacements of a row are contiguous in the lattices.
+
+    for( unsigned long r = 0; r < numberOfRows; r++ )
+      {
+      OffsetValueType rowPosition[ImageDimension];
+      rowPosition[0] = 0;
+      unsigned long remainder = r;
+      for( unsigned int d = 1; d < last; d++ )
+        {
+        rowPosition[d] = remainder % regionSize[d];
+        remainder /= regionSize[d];
+        }
+
+      for( unsigned int v = 0; v < numberOfVertices; v++ )
+        {
+        const unsigned int l = this->m_VertexLattices[v];
+        unsigned long point = 0;
+        unsigned long stride = 1;
+        for( unsigned int d = 0; d < last; d++ )
+          {
+          point += ( rowPosition[d] + this->m_VertexShifts[v][d] -
+            latticeMinimumShifts[l][d] ) * stride;
+          stride *= latticeSizes[l][d];
+          }
+        vertexDisplacements[v] =
+          displacements[l][point].GetDataPointer();
+        }
+
+      const unsigned long rowLength = regionSize[0];
+      if( ImageDimension == 2 )
+        {
+        for( unsigned long i = 0; i < rowLength; i++ )
+          {
+          const RealType *a = vertexDisplacements[0] + i * ImageDimension;
+          const RealType *b = vertexDisplacements[1] + i * ImageDimension;
+          const RealType *c = vertexDisplacements[2] + i * ImageDimension;
+
+          const RealType ac0 = edges[0][0] + a[0] - c[0];
+          const RealType ac1 = edges[0][1] + a[1] - c[1];
+          const RealType bc0 = edges[1][0] + b[0] - c[0];
+          const RealType bc1 = edges[1][1] + b[1] - c[1];
+
+          RealType area = 0.5 * vnl_math_abs( ac0 * bc1 - bc0 * ac1 );
+
+          It.Set( area * inverseUndisplacedVolume );
+          ++It;
+          }
+        }
+      else
+        {
+        for( unsigned long i = 0; i < rowLength; i++ )
+          {
+          const RealType *a = vertexDisplacements[0] + i * ImageDimension;
+          const RealType *b = vertexDisplacements[1] + i * ImageDimension;
+          const RealType *c = vertexDisplacements[2] + i * ImageDimension;
+          const RealType *e = vertexDisplacements[3] + i * ImageDimension;
+
+          const RealType ad0 = edges[0][0] + a[0] - e[0];
+          const RealType ad1 = edges[0][1] + a[1] - e[1];
+          const RealType ad2 = edges[0][2] + a[2] - e[2];
+          const RealType bd0 = edges[1][0] + b[0] - e[0];
+          const RealType bd1 = edges[1][1] + b[1] - e[1];
+          const RealType bd2 = edges[1][2] + b[2] - e[2];
+          const RealType cd0 = edges[2][0] + c[0] - e[0];
+          const RealType cd1 = edges[2][1] + c[1] - e[1];
+          const RealType cd2 = edges[2][2] + c[2] - e[2];
+
+          RealType volume = vnl_math_abs(
+            ad0 * ( bd1 * cd2 - bd2 * cd1 ) +
+            ad1 * ( bd2 * cd0 - bd0 * cd2 ) +
+            ad2 * ( bd0 * cd1 - bd1 * cd0 ) ) / 6.0;
+
+          It.Set( volume * inverseUndisplacedVolume );
+          ++It;
+          }
+        }
       progress.CompletedPixel();
       }
     }
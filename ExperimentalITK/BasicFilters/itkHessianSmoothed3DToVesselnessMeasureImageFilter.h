@@ -108,6 +108,10 @@ public:
   itkGetMacro( ScaleVesselnessMeasure, bool );
   itkBooleanMacro(ScaleVesselnessMeasure);
 
+  /** Vesselness measure of one set of Hessian eigen values, in any order.
+   * Used by GenerateData() and by the fused multiscale pass. */
+  double ComputeVesselnessMeasure( const EigenValueArrayType & eigenValue ) const;
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   /** Begin concept checking */
   itkConceptMacro(DoubleConvertibleToOutputCheck,
@@ -22,6 +22,8 @@
 #include "itkImageRegionConstIterator.h"
 #include "vnl/vnl_math.h"
 
+#include <algorithm>
+
 #define EPSILON  1e-03
 
 namespace itk
@@ -73,7 +75,6 @@ HessianSmoothed3DToVesselnessMeasureImageFilter< TPixel >
                     m_SymmetricEigenValueFilter->GetOutput();
   
   // walk the region of eigen values and get the vesselness measure
-  EigenValueArrayType eigenValue;
   ImageRegionConstIterator<EigenValueImageType> it;
   it = ImageRegionConstIterator<EigenValueImageType>(
       eigenImage, eigenImage->GetRequestedRegion());
@@ -85,106 +86,83 @@ HessianSmoothed3DToVesselnessMeasureImageFilter< TPixel >
   it.GoToBegin();
   while (!it.IsAtEnd())
     {
-    // Get the eigen value
-    eigenValue = it.Get();
-
-
-    // Find the smallest eigenvalue
-    double smallest = vnl_math_abs( eigenValue[0] );
-    double Lambda1 = eigenValue[0];
- 
-    for ( unsigned int i=1; i <=2; i++ )
-      {
-      if ( vnl_math_abs( eigenValue[i] ) < smallest )
-        {
-        Lambda1 = eigenValue[i];
-        smallest = vnl_math_abs( eigenValue[i] );
-        }
-      }
-
-    // Find the largest eigenvalue
-    double largest = vnl_math_abs( eigenValue[0] );
-    double Lambda3 = eigenValue[0];
- 
-    for ( unsigned int i=1; i <=2; i++ )
-      {
-      if (  vnl_math_abs( eigenValue[i] > largest ) )
-        {
-        Lambda3 = eigenValue[i];
-        largest = vnl_math_abs( eigenValue[i] );
-        }
-      }
-
-
-    //  find Lambda2 so that |Lambda1| < |Lambda2| < |Lambda3|
-    double Lambda2 = eigenValue[0];
-
-    for ( unsigned int i=0; i <=2; i++ )
-      {
-      if ( eigenValue[i] != Lambda1 && eigenValue[i] != Lambda3 )
-        {
-        Lambda2 = eigenValue[i];
-        break;
-        }
-      }
-
-    if ( Lambda2 >= 0.0 ||  Lambda3 >= 0.0 || 
-         vnl_math_abs( Lambda2) < EPSILON  || 
-         vnl_math_abs( Lambda3 ) < EPSILON )
-      {
-      oit.Set( NumericTraits< OutputPixelType >::Zero );
-      } 
-    else
-      {
-   
-      double Lambda1Abs = vnl_math_abs( Lambda1 );
-      double Lambda2Abs = vnl_math_abs( Lambda2 );
-      double Lambda3Abs = vnl_math_abs( Lambda3 );
-
-      double Lambda1Sqr = vnl_math_sqr( Lambda1 );
-      double Lambda2Sqr = vnl_math_sqr( Lambda2 );
-      double Lambda3Sqr = vnl_math_sqr( Lambda3 );
-
-      double AlphaSqr = vnl_math_sqr( m_Alpha );
-      double BetaSqr = vnl_math_sqr( m_Beta );
-      double GammaSqr = vnl_math_sqr( m_Gamma );
-
-      double A  = Lambda2Abs / Lambda3Abs; 
-      double B  = Lambda1Abs / vcl_sqrt ( vnl_math_abs( Lambda2 * Lambda3 )); 
-      double S  = vcl_sqrt( Lambda1Sqr + Lambda2Sqr + Lambda3Sqr );
-
-      double vesMeasure_1  = 
-         ( 1 - vcl_exp(-1.0*(( vnl_math_sqr(A) ) / ( 2.0 * ( AlphaSqr)))));
-
-      double vesMeasure_2  = 
-         vcl_exp ( -1.0 * ((vnl_math_sqr( B )) /  ( 2.0 * (BetaSqr))));
-
-      double vesMeasure_3  = 
-         ( 1 - vcl_exp( -1.0 * (( vnl_math_sqr( S )) / ( 2.0 * ( GammaSqr)))));
-
-      double vesMeasure_4  = 
-         vcl_exp ( -1.0 * ( 2.0 * vnl_math_sqr( m_C )) / 
-                                   ( Lambda2Abs * (Lambda3Sqr))); 
-
-      double vesselnessMeasure = 
-         vesMeasure_1 * vesMeasure_2 * vesMeasure_3 * vesMeasure_4; 
-
-      if(  m_ScaleVesselnessMeasure ) 
-        {
-        oit.Set( static_cast< OutputPixelType >(
-                                     Lambda3Abs*vesselnessMeasure ) );
-        }
-      else
-        {
-        oit.Set( static_cast< OutputPixelType >( vesselnessMeasure ) );
-        }
-      }
+    oit.Set( static_cast< OutputPixelType >(
+                     this->ComputeVesselnessMeasure( it.Get() ) ) );
     ++it;
     ++oit;
     }
     
 }
 
+template < typename TPixel >
+double
+HessianSmoothed3DToVesselnessMeasureImageFilter< TPixel >
+::ComputeVesselnessMeasure( const EigenValueArrayType & eigenValue ) const
+{
+  // Order the eigen values so that |Lambda1| <= |Lambda2| <= |Lambda3|
+  double Lambda1 = eigenValue[0];
+  double Lambda2 = eigenValue[1];
+  double Lambda3 = eigenValue[2];
+
+  if ( vnl_math_abs( Lambda1 ) > vnl_math_abs( Lambda2 ) )
+    {
+    std::swap( Lambda1, Lambda2 );
+    }
+  if ( vnl_math_abs( Lambda2 ) > vnl_math_abs( Lambda3 ) )
+    {
+    std::swap( Lambda2, Lambda3 );
+    }
+  if ( vnl_math_abs( Lambda1 ) > vnl_math_abs( Lambda2 ) )
+    {
+    std::swap( Lambda1, Lambda2 );
+    }
+
+  if ( Lambda2 >= 0.0 ||  Lambda3 >= 0.0 || 
+       vnl_math_abs( Lambda2) < EPSILON  || 
+       vnl_math_abs( Lambda3 ) < EPSILON )
+    {
+    return 0.0;
+    } 
+
+  double Lambda1Abs = vnl_math_abs( Lambda1 );
+  double Lambda2Abs = vnl_math_abs( Lambda2 );
+  double Lambda3Abs = vnl_math_abs( Lambda3 );
+
+  double Lambda1Sqr = vnl_math_sqr( Lambda1 );
+  double Lambda2Sqr = vnl_math_sqr( Lambda2 );
+  double Lambda3Sqr = vnl_math_sqr( Lambda3 );
+
+  double AlphaSqr = vnl_math_sqr( m_Alpha );
+  double BetaSqr = vnl_math_sqr( m_Beta );
+  double GammaSqr = vnl_math_sqr( m_Gamma );
+
+  double A  = Lambda2Abs / Lambda3Abs; 
+  double B  = Lambda1Abs / vcl_sqrt ( vnl_math_abs( Lambda2 * Lambda3 )); 
+  double S  = vcl_sqrt( Lambda1Sqr + Lambda2Sqr + Lambda3Sqr );
+
+  double vesMeasure_1  = 
+     ( 1 - vcl_exp(-1.0*(( vnl_math_sqr(A) ) / ( 2.0 * ( AlphaSqr)))));
+
+  double vesMeasure_2  = 
+     vcl_exp ( -1.0 * ((vnl_math_sqr( B )) /  ( 2.0 * (BetaSqr))));
+
+  double vesMeasure_3  = 
+     ( 1 - vcl_exp( -1.0 * (( vnl_math_sqr( S )) / ( 2.0 * ( GammaSqr)))));
+
+  double vesMeasure_4  = 
+     vcl_exp ( -1.0 * ( 2.0 * vnl_math_sqr( m_C )) / 
+                               ( Lambda2Abs * (Lambda3Sqr))); 
+
+  double vesselnessMeasure = 
+     vesMeasure_1 * vesMeasure_2 * vesMeasure_3 * vesMeasure_4; 
+
+  if(  m_ScaleVesselnessMeasure ) 
+    {
+    return Lambda3Abs*vesselnessMeasure;
+    }
+  return vesselnessMeasure;
+}
+
 template < typename TPixel >
 void
 HessianSmoothed3DToVesselnessMeasureImageFilter< TPixel >
@@ -0,0 +1,125 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkImagePCAProjectionCalculator.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkImagePCAProjectionCalculator_h
+#define __itkImagePCAProjectionCalculator_h
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include "vnl/vnl_vector.h"
+
+#include <vector>
+
+namespace itk {
+
+/** \class ImagePCAProjectionCalculator
+ * \brief Projects an image on a PCA basis and reconstructs an image
+ * from its projection.
+ *
+ * Project() computes the dot products of image - mean with all the
+ * basis images in one threaded pass, and Reconstruct() adds the
+ * weighted basis images to the mean in one threaded pass, without the
+ * intermediate images of a filter pipeline.  The voxels are processed
+ * in blocks so that the values of a block are reused by all the basis
+ * images while in cache.
+ */
+template<class TImage>
+class ImagePCAProjectionCalculator : public Object
+{
+public:
+  typedef ImagePCAProjectionCalculator              Self;
+  typedef Object                                    Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( ImagePCAProjectionCalculator, Object );
+
+  typedef TImage                                    ImageType;
+  typedef typename ImageType::Pointer               ImagePointer;
+  typedef typename ImageType::PixelType             PixelType;
+  typedef double                                    RealType;
+  typedef vnl_vector<RealType>                      VectorType;
+  typedef std::vector<ImagePointer>                 BasisImageContainerType;
+
+  void SetMeanImage( ImageType *mean )
+    { this->m_MeanImage = mean; this->Modified(); }
+  itkGetObjectMacro( MeanImage, ImageType );
+
+  void SetBasisImages( const BasisImageContainerType & basisImages )
+    { this->m_BasisImages = basisImages; this->Modified(); }
+  const BasisImageContainerType & GetBasisImages() const
+    { return this->m_BasisImages; }
+
+  itkSetMacro( BlockSize, unsigned int );
+  itkGetConstMacro( BlockSize, unsigned int );
+
+  void SetNumberOfThreads( int numberOfThreads );
+  itkGetConstMacro( NumberOfThreads, int );
+
+  /** Dot products of image - mean with the basis images. */
+  VectorType Project( const ImageType *image );
+
+  /** Mean plus the basis images weighted by the projection. */
+  ImagePointer Reconstruct( const VectorType & projection );
+
+protected:
+  ImagePCAProjectionCalculator();
+  virtual ~ImagePCAProjectionCalculator() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  ImagePCAProjectionCalculator( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  struct ThreadStruct
+    {
+    Self                                     *Calculator;
+    const PixelType                          *Image;
+    PixelType                                *Output;
+    const RealType                           *Projection;
+    std::vector<VectorType>                   ThreaderProjections;
+    };
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ProjectThreaderCallback( void *arg );
+  static ITK_THREAD_RETURN_TYPE ReconstructThreaderCallback( void *arg );
+
+  /** Checks the mean and the basis images against a reference size. */
+  void VerifyInputs( const ImageType *reference ) const;
+
+  void RunThreads( ThreadStruct *, ThreadFunctionType );
+
+  /** Contiguous range of voxels of a thread. */
+  void GetThreadRange( int threadId, int threadCount,
+    unsigned long & begin, unsigned long & end ) const;
+
+  ImagePointer                              m_MeanImage;
+  BasisImageContainerType                   m_BasisImages;
+  unsigned int                              m_BlockSize;
+  int                                       m_NumberOfThreads;
+};
+
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkImagePCAProjectionCalculator.hxx"
+#endif
+
+#endif
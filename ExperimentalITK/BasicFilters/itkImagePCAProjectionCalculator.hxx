@@ -0,0 +1,256 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkImagePCAProjectionCalculator.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkImagePCAProjectionCalculator_hxx
+#define _itkImagePCAProjectionCalculator_hxx
+
+#include "itkImagePCAProjectionCalculator.h"
+
+#include <algorithm>
+
+namespace itk {
+
+template<class TImage>
+ImagePCAProjectionCalculator<TImage>
+::ImagePCAProjectionCalculator()
+{
+  this->m_MeanImage = NULL;
+  this->m_BlockSize = 4096;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template<class TImage>
+void
+ImagePCAProjectionCalculator<TImage>
+::SetNumberOfThreads( int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( 1,
+    std::min( numberOfThreads, static_cast<int>( ITK_MAX_THREADS ) ) );
+  this->Modified();
+}
+
+template<class TImage>
+void
+ImagePCAProjectionCalculator<TImage>
+::VerifyInputs( const ImageType *reference ) const
+{
+  if( !this->m_MeanImage )
+    {
+    itkExceptionMacro( "The mean image is not set." );
+    }
+  const typename ImageType::RegionType region =
+    this->m_MeanImage->GetBufferedRegion();
+  if( reference && reference->GetBufferedRegion() != region )
+    {
+    itkExceptionMacro( "The image and the mean image differ in size." );
+    }
+  for( unsigned int k = 0; k < this->m_BasisImages.size(); k++ )
+    {
+    if( this->m_BasisImages[k]->GetBufferedRegion() != region )
+      {
+      itkExceptionMacro( "Basis image " << k
+        << " and the mean image differ in size." );
+      }
+    }
+}
+
+template<class TImage>
+typename ImagePCAProjectionCalculator<TImage>::VectorType
+ImagePCAProjectionCalculator<TImage>
+::Project( const ImageType *image )
+{
+  this->VerifyInputs( image );
+
+  ThreadStruct str;
+  str.Calculator = this;
+  str.Image = image->GetBufferPointer();
+  str.Output = NULL;
+  str.Projection = NULL;
+  str.ThreaderProjections.assign( this->m_NumberOfThreads,
+    VectorType( this->m_BasisImages.size(), 0.0 ) );
+
+  this->RunThreads( &str, this->ProjectThreaderCallback );
+
+  VectorType projection( this->m_BasisImages.size(), 0.0 );
+  for( unsigned int t = 0; t < str.ThreaderProjections.size(); t++ )
+    {
+    projection += str.ThreaderProjections[t];
+    }
+  return projection;
+}
+
+template<class TImage>
+typename ImagePCAProjectionCalculator<TImage>::ImagePointer
+ImagePCAProjectionCalculator<TImage>
+::Reconstruct( const VectorType & projection )
+{
+  this->VerifyInputs( NULL );
+  if( projection.size() != this->m_BasisImages.size() )
+    {
+    itkExceptionMacro( "The projection has " << projection.size()
+      << " coefficients for " << this->m_BasisImages.size()
+      << " basis images." );
+    }
+
+  ImagePointer output = ImageType::New();
+  output->CopyInformation( this->m_MeanImage );
+  output->SetRegions( this->m_MeanImage->GetBufferedRegion() );
+  output->Allocate();
+
+  ThreadStruct str;
+  str.Calculator = this;
+  str.Image = NULL;
+  str.Output = output->GetBufferPointer();
+  str.Projection = ( projection.size() > 0 ) ? projection.data_block() : NULL;
+
+  this->RunThreads( &str, this->ReconstructThreaderCallback );
+
+  return output;
+}
+
+template<class TImage>
+void
+ImagePCAProjectionCalculator<TImage>
+::RunThreads( ThreadStruct *str, ThreadFunctionType callback )
+{
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( this->m_NumberOfThreads );
+  threader->SetSingleMethod( callback, str );
+  threader->SingleMethodExecute();
+}
+
+template<class TImage>
+void
+ImagePCAProjectionCalculator<TImage>
+::GetThreadRange( int threadId, int threadCount, unsigned long & begin,
+  unsigned long & end ) const
+{
+  const unsigned long numberOfVoxels =
+    this->m_MeanImage->GetBufferedRegion().GetNumberOfPixels();
+  begin = ( numberOfVoxels * threadId ) / threadCount;
+  end = ( numberOfVoxels * ( threadId + 1 ) ) / threadCount;
+}
+
+template<class TImage>
+ITK_THREAD_RETURN_TYPE
+ImagePCAProjectionCalculator<TImage>
+::ProjectThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  Self *calculator = str->Calculator;
+
+  unsigned long begin;
+  unsigned long end;
+  calculator->GetThreadRange( threadId, threadCount, begin, end );
+
+  const unsigned int numberOfBasisImages = calculator->m_BasisImages.size();
+  const unsigned long blockSize = std::max( 1u, calculator->m_BlockSize );
+  const PixelType *mean = calculator->m_MeanImage->GetBufferPointer();
+  VectorType & projection = str->ThreaderProjections[threadId];
+
+  std::vector<RealType> centered( blockSize );
+  for( unsigned long first = begin; first < end; first += blockSize )
+    {
+    const unsigned long size = std::min( blockSize, end - first );
+    for( unsigned long v = 0; v < size; v++ )
+      {
+      centered[v] = static_cast<RealType>( str->Image[first + v] ) -
+        static_cast<RealType>( mean[first + v] );
+      }
+    for( unsigned int k = 0; k < numberOfBasisImages; k++ )
+      {
+      const PixelType *basis =
+        calculator->m_BasisImages[k]->GetBufferPointer() + first;
+      RealType dot = 0.0;
+      for( unsigned long v = 0; v < size; v++ )
+        {
+        dot += static_cast<RealType>( basis[v] ) * centered[v];
+        }
+      projection[k] += dot;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TImage>
+ITK_THREAD_RETURN_TYPE
+ImagePCAProjectionCalculator<TImage>
+::ReconstructThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  Self *calculator = str->Calculator;
+
+  unsigned long begin;
+  unsigned long end;
+  calculator->GetThreadRange( threadId, threadCount, begin, end );
+
+  const unsigned int numberOfBasisImages = calculator->m_BasisImages.size();
+  const unsigned long blockSize = std::max( 1u, calculator->m_BlockSize );
+  const PixelType *mean = calculator->m_MeanImage->GetBufferPointer();
+
+  std::vector<RealType> sum( blockSize );
+  for( unsigned long first = begin; first < end; first += blockSize )
+    {
+    const unsigned long size = std::min( blockSize, end - first );
+    for( unsigned long v = 0; v < size; v++ )
+      {
+      sum[v] = static_cast<RealType>( mean[first + v] );
+      }
+    for( unsigned int k = 0; k < numberOfBasisImages; k++ )
+      {
+      const PixelType *basis =
+        calculator->m_BasisImages[k]->GetBufferPointer() + first;
+      const RealType weight = str->Projection[k];
+      for( unsigned long v = 0; v < size; v++ )
+        {
+        sum[v] += weight * static_cast<RealType>( basis[v] );
+        }
+      }
+    for( unsigned long v = 0; v < size; v++ )
+      {
+      str->Output[first + v] = static_cast<PixelType>( sum[v] );
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TImage>
+void
+ImagePCAProjectionCalculator<TImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Number of basis images: "
+     << this->m_BasisImages.size() << std::endl;
+  os << indent << "Block size: " << this->m_BlockSize << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+}
+
+} // end of namespace itk
+
+#endif
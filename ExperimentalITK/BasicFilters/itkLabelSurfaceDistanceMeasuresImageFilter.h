@@ -0,0 +1,282 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkLabelSurfaceDistanceMeasuresImageFilter.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkLabelSurfaceDistanceMeasuresImageFilter_h
+#define __itkLabelSurfaceDistanceMeasuresImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkNumericTraits.h"
+#include "itkPoint.h"
+
+#include <map>
+#include <vector>
+
+namespace itk {
+
+/** \class LabelSurfaceDistanceMeasuresImageFilter
+ * \brief Computes the surface distances between the same set of labels
+ * of two images.  Background is assumed to be 0.
+ *
+ * The boundary voxels of all the labels of both images, i.e. the voxels
+ * with a face neighbor of another label, are extracted in a single
+ * threaded pass, and their physical positions are stored per label.  A
+ * k-d tree is built on every surface and the distance of every boundary
+ * voxel to the nearest boundary voxel of the same label in the other
+ * image is found in parallel, over all the labels at once.  No distance
+ * map is computed, so the cost scales with the number of boundary
+ * voxels rather than with the image size times the number of labels.
+ *
+ * For every label the filter returns the symmetric Hausdorff distance,
+ * the directed Hausdorff distance from the source to the target, the
+ * Hausdorff distance at the given percentile (default = 0.95) of the
+ * distances of both surfaces, and the mean surface distance, symmetric
+ * and directed.  The distances of a label that is missing from one of
+ * the images are infinite.
+ *
+ * These are distances between the label boundaries, not the region based
+ * distances of HausdorffDistanceImageFilter: a label nested inside of
+ * the other one, or with a cavity, has a nonzero distance.
+ *
+ * With UseSelectedLabel on, only the boundary of SelectedLabel is
+ * extracted and measured.
+ *
+ * \sa LabelOverlapMeasuresImageFilter
+ *
+ * \ingroup MultiThreaded
+ */
+template<class TLabelImage>
+class ITK_EXPORT LabelSurfaceDistanceMeasuresImageFilter :
+    public ImageToImageFilter<TLabelImage, TLabelImage>
+{
+public:
+  /** Standard Self typedef */
+  typedef LabelSurfaceDistanceMeasuresImageFilter        Self;
+  typedef ImageToImageFilter<TLabelImage,TLabelImage>    Superclass;
+  typedef SmartPointer<Self>                             Pointer;
+  typedef SmartPointer<const Self>                       ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Runtime information support. */
+  itkTypeMacro( LabelSurfaceDistanceMeasuresImageFilter, ImageToImageFilter );
+
+  /** Image related typedefs. */
+  itkStaticConstMacro( ImageDimension, unsigned int,
+    TLabelImage::ImageDimension );
+
+  typedef TLabelImage                                   LabelImageType;
+  typedef typename TLabelImage::Pointer                 LabelImagePointer;
+  typedef typename TLabelImage::ConstPointer            LabelImageConstPointer;
+
+  typedef typename TLabelImage::RegionType              RegionType;
+  typedef typename TLabelImage::SizeType                SizeType;
+  typedef typename TLabelImage::IndexType               IndexType;
+
+  typedef typename TLabelImage::PixelType               LabelType;
+
+  /** Type to use form computations. */
+  typedef typename NumericTraits<LabelType>::RealType   RealType;
+
+  typedef Point<RealType,
+    itkGetStaticConstMacro( ImageDimension )>           PointType;
+  typedef std::vector<PointType>                        PointContainerType;
+
+  /** \class LabelSurfaceMeasures
+   * \brief Distances stored per label */
+  class LabelSurfaceMeasures
+    {
+    public:
+    LabelSurfaceMeasures()
+      {
+      m_SurfaceSource = 0;
+      m_SurfaceTarget = 0;
+
+      m_HausdorffDistance = 0.0;
+      m_DirectedHausdorffDistance = 0.0;
+      m_PercentileHausdorffDistance = 0.0;
+      m_MeanSurfaceDistance = 0.0;
+      m_DirectedMeanSurfaceDistance = 0.0;
+      }
+
+    unsigned long m_SurfaceSource;
+    unsigned long m_SurfaceTarget;
+
+    RealType m_HausdorffDistance;
+    RealType m_DirectedHausdorffDistance;
+    RealType m_PercentileHausdorffDistance;
+    RealType m_MeanSurfaceDistance;
+    RealType m_DirectedMeanSurfaceDistance;
+    };
+
+  /** Type of the map used to store data per label */
+  typedef std::map<LabelType, LabelSurfaceMeasures>     MapType;
+  typedef typename MapType::iterator                    MapIterator;
+  typedef typename MapType::const_iterator              MapConstIterator;
+
+  /** Set the source image. */
+  void SetSourceImage( const LabelImageType * image )
+    { this->SetNthInput( 0, const_cast<LabelImageType *>( image ) ); }
+
+  /** Set the target image. */
+  void SetTargetImage( const LabelImageType * image )
+    { this->SetNthInput( 1, const_cast<LabelImageType *>( image ) ); }
+
+  /** Get the source image. */
+  const LabelImageType * GetSourceImage( void )
+    { return this->GetInput( 0 ); }
+
+  /** Get the target image. */
+  const LabelImageType * GetTargetImage( void )
+    { return this->GetInput( 1 ); }
+
+  /** Fraction of the distances below the percentile Hausdorff distance. */
+  itkSetClampMacro( Percentile, RealType, 0.0, 1.0 );
+  itkGetConstMacro( Percentile, RealType );
+
+  /** Measure only SelectedLabel (off by default: all the labels). */
+  itkSetMacro( SelectedLabel, LabelType );
+  itkGetConstMacro( SelectedLabel, LabelType );
+  itkSetMacro( UseSelectedLabel, bool );
+  itkGetConstMacro( UseSelectedLabel, bool );
+  itkBooleanMacro( UseSelectedLabel );
+
+  /** Number of points in the leaves of the k-d trees (default = 8). */
+  itkSetMacro( BucketSize, unsigned int );
+  itkGetConstMacro( BucketSize, unsigned int );
+
+  /** Get the label surface measures */
+  const MapType & GetLabelSurfaceMeasures() const
+    { return this->m_LabelSurfaceMeasures; }
+
+  /** Measures of individual labels */
+  RealType GetHausdorffDistance( LabelType );
+  RealType GetDirectedHausdorffDistance( LabelType );
+  RealType GetPercentileHausdorffDistance( LabelType );
+  RealType GetMeanSurfaceDistance( LabelType );
+  RealType GetDirectedMeanSurfaceDistance( LabelType );
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  /** Begin concept checking */
+  itkConceptMacro( Input1HasNumericTraitsCheck,
+    ( Concept::HasNumericTraits<LabelType> ) );
+  /** End concept checking */
+#endif
+
+protected:
+  LabelSurfaceDistanceMeasuresImageFilter();
+  ~LabelSurfaceDistanceMeasuresImageFilter(){};
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /**
+   * Pass the input through unmodified. Do this by setting the output to the
+   * source image in the AllocateOutputs() method.
+   */
+  void AllocateOutputs();
+
+  void BeforeThreadedGenerateData();
+
+  void AfterThreadedGenerateData();
+
+  /** Extracts the boundary voxels of a region of both images. */
+  void ThreadedGenerateData( const RegionType&, int );
+
+  // Override since the filter needs all the data for the algorithm
+  void GenerateInputRequestedRegion();
+
+  // Override since the filter produces all of its output
+  void EnlargeOutputRequestedRegion( DataObject *data );
+
+private:
+  LabelSurfaceDistanceMeasuresImageFilter( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  typedef std::map<LabelType, PointContainerType>       PointMapType;
+
+  /** The boundary points of a label in the source (0) and the target (1)
+   * images, and the distance of each of them to the other surface. */
+  struct LabelSurfaces
+    {
+    LabelType                                 Label;
+    PointContainerType                        Points[2];
+    std::vector<RealType>                     Distances[2];
+    };
+
+  /** Range of the points of one surface to look up in the other one. */
+  struct SearchChunk
+    {
+    unsigned int                              Surfaces;
+    unsigned int                              Side;
+    unsigned long                             Begin;
+    unsigned long                             End;
+    };
+
+  struct ThreadStruct
+    {
+    Self                                     *Filter;
+    std::vector<SearchChunk>                  Chunks;
+    };
+
+  struct CoordinateLess
+    {
+    unsigned int                              Axis;
+    bool operator()( const PointType & a, const PointType & b ) const
+      { return ( a[Axis] < b[Axis] ); }
+    };
+
+  /** Static functions used as "callbacks" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE BuildTreesThreaderCallback( void *arg );
+  static ITK_THREAD_RETURN_TYPE SearchThreaderCallback( void *arg );
+
+  /** Adds the boundary points of a region of an image to a point map. */
+  void ExtractSurfacePoints( const LabelImageType *image,
+    const RegionType & region, PointMapType & points );
+
+  /** Reorders [begin, end) into a balanced k-d tree, splitting on the
+   * coordinates in turn, with the splitting point at the middle. */
+  void BuildTree( PointType *begin, PointType *end, unsigned int depth ) const;
+
+  /** Lowers minimumDistance to the squared distance between the query and
+   * the nearest point of the tree [begin, end). */
+  void SearchTree( const PointType *begin, const PointType *end,
+    unsigned int depth, const PointType & query,
+    RealType & minimumDistance ) const;
+
+  /** Reduces the distances of a label into its measures. */
+  void ComputeLabelMeasures( LabelSurfaces & surfaces,
+    LabelSurfaceMeasures & measures ) const;
+
+  RealType                                        m_Percentile;
+  unsigned int                                    m_BucketSize;
+  LabelType                                       m_SelectedLabel;
+  bool                                            m_UseSelectedLabel;
+
+  std::vector<PointMapType>                       m_SourcePointsPerThread;
+  std::vector<PointMapType>                       m_TargetPointsPerThread;
+  std::vector<LabelSurfaces>                      m_LabelSurfaces;
+
+  MapType                                         m_LabelSurfaceMeasures;
+
+}; // end of class
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkLabelSurfaceDistanceMeasuresImageFilter.hxx"
+#endif
+
+#endif
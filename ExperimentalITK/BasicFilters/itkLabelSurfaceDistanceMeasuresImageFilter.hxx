@@ -0,0 +1,548 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkLabelSurfaceDistanceMeasuresImageFilter.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkLabelSurfaceDistanceMeasuresImageFilter_hxx
+#define _itkLabelSurfaceDistanceMeasuresImageFilter_hxx
+
+#include "itkLabelSurfaceDistanceMeasuresImageFilter.h"
+
+#include "itkConstantBoundaryCondition.h"
+#include "itkConstNeighborhoodIterator.h"
+#include "itkNeighborhoodAlgorithm.h"
+#include "itkProgressReporter.h"
+
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace itk {
+
+template<class TLabelImage>
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::LabelSurfaceDistanceMeasuresImageFilter()
+{
+  // this filter requires two input images
+  this->SetNumberOfRequiredInputs( 2 );
+
+  this->m_Percentile = 0.95;
+  this->m_BucketSize = 8;
+  this->m_SelectedLabel = NumericTraits<LabelType>::Zero;
+  this->m_UseSelectedLabel = false;
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::GenerateInputRequestedRegion()
+{
+  Superclass::GenerateInputRequestedRegion();
+  if( this->GetSourceImage() )
+    {
+    LabelImagePointer source = const_cast
+      <LabelImageType *>( this->GetSourceImage() );
+    source->SetRequestedRegionToLargestPossibleRegion();
+    }
+  if( this->GetTargetImage() )
+    {
+    LabelImagePointer target = const_cast
+      <LabelImageType *>( this->GetTargetImage() );
+    target->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::EnlargeOutputRequestedRegion( DataObject *data )
+{
+  Superclass::EnlargeOutputRequestedRegion( data );
+  data->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::AllocateOutputs()
+{
+  // Pass the source through as the output
+  LabelImagePointer image =
+    const_cast<TLabelImage *>( this->GetSourceImage() );
+  this->GraftOutput( image );
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::BeforeThreadedGenerateData()
+{
+  if( this->GetSourceImage()->GetLargestPossibleRegion() !=
+    this->GetTargetImage()->GetLargestPossibleRegion() )
+    {
+    itkExceptionMacro( "The source and target images differ in size." );
+    }
+
+  int numberOfThreads = this->GetNumberOfThreads();
+
+  // Resize and initialize the thread temporaries
+  this->m_SourcePointsPerThread.assign( numberOfThreads, PointMapType() );
+  this->m_TargetPointsPerThread.assign( numberOfThreads, PointMapType() );
+
+  // Initialize the final map
+  this->m_LabelSurfaces.clear();
+  this->m_LabelSurfaceMeasures.clear();
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::ThreadedGenerateData( const RegionType& outputRegionForThread,
+  int threadId )
+{
+  ProgressReporter progress( this, threadId, 2 );
+
+  this->ExtractSurfacePoints( this->GetSourceImage(), outputRegionForThread,
+    this->m_SourcePointsPerThread[threadId] );
+  progress.CompletedPixel();
+  this->ExtractSurfacePoints( this->GetTargetImage(), outputRegionForThread,
+    this->m_TargetPointsPerThread[threadId] );
+  progress.CompletedPixel();
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::ExtractSurfacePoints( const LabelImageType *image,
+  const RegionType & region, PointMapType & points )
+{
+  // Voxels outside of the image are background, so that the labels
+  // touching the image boundary are closed there
+  ConstantBoundaryCondition<LabelImageType> cbc;
+  cbc.SetConstant( NumericTraits<LabelType>::Zero );
+
+  SizeType radius;
+  radius.Fill( 1 );
+
+  typedef NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<LabelImageType>
+    FaceCalculatorType;
+  FaceCalculatorType faceCalculator;
+  typename FaceCalculatorType::FaceListType faceList =
+    faceCalculator( image, region, radius );
+
+  typename FaceCalculatorType::FaceListType::iterator fit;
+  for( fit = faceList.begin(); fit != faceList.end(); ++fit )
+    {
+    ConstNeighborhoodIterator<LabelImageType> bit( radius, image, *fit );
+    bit.OverrideBoundaryCondition( &cbc );
+
+    const unsigned int center = bit.Size() / 2;
+
+    PointType point;
+    PointContainerType *labelPoints = NULL;
+    LabelType currentLabel = NumericTraits<LabelType>::Zero;
+
+    for( bit.GoToBegin(); !bit.IsAtEnd(); ++bit )
+      {
+      const LabelType label = bit.GetCenterPixel();
+      if( label == NumericTraits<LabelType>::Zero ||
+        ( this->m_UseSelectedLabel && label != this->m_SelectedLabel ) )
+        {
+        continue;
+        }
+
+      // a voxel is on the surface if one of its face neighbors is not
+      bool isOnSurface = false;
+      for( unsigned int d = 0; d < ImageDimension && !isOnSurface; d++ )
+        {
+        const unsigned int stride = bit.GetStride( d );
+        isOnSurface = ( bit.GetPixel( center - stride ) != label ||
+          bit.GetPixel( center + stride ) != label );
+        }
+      if( !isOnSurface )
+        {
+        continue;
+        }
+
+      // consecutive surface voxels mostly share their label
+      if( labelPoints == NULL || label != currentLabel )
+        {
+        labelPoints = &points[label];
+        currentLabel = label;
+        }
+      image->TransformIndexToPhysicalPoint( bit.GetIndex(), point );
+      labelPoints->push_back( point );
+      }
+    }
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::AfterThreadedGenerateData()
+{
+  int numberOfThreads = this->GetNumberOfThreads();
+
+  // Gather the points of the threads, in thread order, per label
+  std::map<LabelType, unsigned int> surfaceIndices;
+  for( int n = 0; n < numberOfThreads; n++ )
+    {
+    for( unsigned int side = 0; side < 2; side++ )
+      {
+      PointMapType & threadPoints = ( side == 0 )
+        ? this->m_SourcePointsPerThread[n]
+        : this->m_TargetPointsPerThread[n];
+      typename PointMapType::iterator it;
+      for( it = threadPoints.begin(); it != threadPoints.end(); ++it )
+        {
+        typename std::map<LabelType, unsigned int>::iterator indexIt =
+          surfaceIndices.find( it->first );
+        if( indexIt == surfaceIndices.end() )
+          {
+          indexIt = surfaceIndices.insert( std::make_pair( it->first,
+            static_cast<unsigned int>( this->m_LabelSurfaces.size() ) ) ).first;
+          this->m_LabelSurfaces.push_back( LabelSurfaces() );
+          this->m_LabelSurfaces.back().Label = it->first;
+          }
+        PointContainerType & points =
+          this->m_LabelSurfaces[indexIt->second].Points[side];
+        points.insert( points.end(), it->second.begin(), it->second.end() );
+        }
+      threadPoints.clear();
+      }
+    }
+  this->m_SourcePointsPerThread.clear();
+  this->m_TargetPointsPerThread.clear();
+
+  ThreadStruct str;
+  str.Filter = this;
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod(
+    this->BuildTreesThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  // Split the points of every surface that has an opposite surface into
+  // chunks, so that the labels of very different sizes balance out
+  const unsigned long chunkSize = 1024;
+  for( unsigned int s = 0; s < this->m_LabelSurfaces.size(); s++ )
+    {
+    LabelSurfaces & surfaces = this->m_LabelSurfaces[s];
+    if( surfaces.Points[0].empty() || surfaces.Points[1].empty() )
+      {
+      continue;
+      }
+    for( unsigned int side = 0; side < 2; side++ )
+      {
+      const unsigned long numberOfPoints = surfaces.Points[side].size();
+      surfaces.Distances[side].resize( numberOfPoints );
+      for( unsigned long begin = 0; begin < numberOfPoints; begin += chunkSize )
+        {
+        SearchChunk chunk;
+        chunk.Surfaces = s;
+        chunk.Side = side;
+        chunk.Begin = begin;
+        chunk.End = std::min( begin + chunkSize, numberOfPoints );
+        str.Chunks.push_back( chunk );
+        }
+      }
+    }
+
+  this->GetMultiThreader()->SetSingleMethod(
+    this->SearchThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  for( unsigned int s = 0; s < this->m_LabelSurfaces.size(); s++ )
+    {
+    this->ComputeLabelMeasures( this->m_LabelSurfaces[s],
+      this->m_LabelSurfaceMeasures[this->m_LabelSurfaces[s].Label] );
+    }
+  this->m_LabelSurfaces.clear();
+}
+
+template<class TLabelImage>
+ITK_THREAD_RETURN_TYPE
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::BuildTreesThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  Self *filter = str->Filter;
+
+  // The surfaces are interleaved across the threads
+  const unsigned int numberOfTrees = 2 * filter->m_LabelSurfaces.size();
+  for( unsigned int t = threadId; t < numberOfTrees; t += threadCount )
+    {
+    PointContainerType & points =
+      filter->m_LabelSurfaces[t / 2].Points[t % 2];
+    if( !points.empty() )
+      {
+      filter->BuildTree( &points[0], &points[0] + points.size(), 0 );
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TLabelImage>
+ITK_THREAD_RETURN_TYPE
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::SearchThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  Self *filter = str->Filter;
+
+  for( unsigned long c = threadId; c < str->Chunks.size(); c += threadCount )
+    {
+    const SearchChunk & chunk = str->Chunks[c];
+    LabelSurfaces & surfaces = filter->m_LabelSurfaces[chunk.Surfaces];
+
+    const PointContainerType & queries = surfaces.Points[chunk.Side];
+    const PointContainerType & tree = surfaces.Points[1 - chunk.Side];
+    const PointType *treeBegin = &tree[0];
+    const PointType *treeEnd = treeBegin + tree.size();
+
+    for( unsigned long i = chunk.Begin; i < chunk.End; i++ )
+      {
+      RealType minimumDistance = NumericTraits<RealType>::max();
+      filter->SearchTree( treeBegin, treeEnd, 0, queries[i], minimumDistance );
+      surfaces.Distances[chunk.Side][i] = vcl_sqrt( minimumDistance );
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::BuildTree( PointType *begin, PointType *end, unsigned int depth ) const
+{
+  const unsigned long numberOfPoints = end - begin;
+  if( numberOfPoints <= this->m_BucketSize )
+    {
+    return;
+    }
+
+  CoordinateLess compare;
+  compare.Axis = depth % ImageDimension;
+
+  PointType *middle = begin + numberOfPoints / 2;
+  std::nth_element( begin, middle, end, compare );
+
+  this->BuildTree( begin, middle, depth + 1 );
+  this->BuildTree( middle + 1, end, depth + 1 );
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::SearchTree( const PointType *begin, const PointType *end,
+  unsigned int depth, const PointType & query,
+  RealType & minimumDistance ) const
+{
+  const unsigned long numberOfPoints = end - begin;
+  if( numberOfPoints <= this->m_BucketSize )
+    {
+    for( const PointType *p = begin; p != end; ++p )
+      {
+      minimumDistance = vnl_math_min( minimumDistance,
+        static_cast<RealType>( query.SquaredEuclideanDistanceTo( *p ) ) );
+      }
+    return;
+    }
+
+  const unsigned int axis = depth % ImageDimension;
+  const PointType *middle = begin + numberOfPoints / 2;
+
+  minimumDistance = vnl_math_min( minimumDistance,
+    static_cast<RealType>( query.SquaredEuclideanDistanceTo( *middle ) ) );
+
+  // Descend on the side of the query first, and on the other side only
+  // if the splitting plane is closer than the nearest point so far
+  const RealType difference = query[axis] - (*middle)[axis];
+  if( difference < 0.0 )
+    {
+    this->SearchTree( begin, middle, depth + 1, query, minimumDistance );
+    if( vnl_math_sqr( difference ) < minimumDistance )
+      {
+      this->SearchTree( middle + 1, end, depth + 1, query, minimumDistance );
+      }
+    }
+  else
+    {
+    this->SearchTree( middle + 1, end, depth + 1, query, minimumDistance );
+    if( vnl_math_sqr( difference ) < minimumDistance )
+      {
+      this->SearchTree( begin, middle, depth + 1, query, minimumDistance );
+      }
+    }
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::ComputeLabelMeasures( LabelSurfaces & surfaces,
+  LabelSurfaceMeasures & measures ) const
+{
+  measures.m_SurfaceSource = surfaces.Points[0].size();
+  measures.m_SurfaceTarget = surfaces.Points[1].size();
+
+  if( surfaces.Points[0].empty() || surfaces.Points[1].empty() )
+    {
+    const RealType infinity = std::numeric_limits<RealType>::infinity();
+    measures.m_HausdorffDistance = infinity;
+    measures.m_DirectedHausdorffDistance = infinity;
+    measures.m_PercentileHausdorffDistance = infinity;
+    measures.m_MeanSurfaceDistance = infinity;
+    measures.m_DirectedMeanSurfaceDistance = infinity;
+    return;
+    }
+
+  RealType maximum[2];
+  RealType sum[2];
+  for( unsigned int side = 0; side < 2; side++ )
+    {
+    const std::vector<RealType> & distances = surfaces.Distances[side];
+    maximum[side] = *std::max_element( distances.begin(), distances.end() );
+    sum[side] = NumericTraits<RealType>::Zero;
+    for( unsigned long i = 0; i < distances.size(); i++ )
+      {
+      sum[side] += distances[i];
+      }
+    }
+
+  const unsigned long numberOfDistances =
+    measures.m_SurfaceSource + measures.m_SurfaceTarget;
+
+  measures.m_HausdorffDistance = vnl_math_max( maximum[0], maximum[1] );
+  measures.m_DirectedHausdorffDistance = maximum[0];
+  measures.m_MeanSurfaceDistance = ( sum[0] + sum[1] ) /
+    static_cast<RealType>( numberOfDistances );
+  measures.m_DirectedMeanSurfaceDistance = sum[0] /
+    static_cast<RealType>( measures.m_SurfaceSource );
+
+  // The percentile is taken over the distances of both surfaces
+  std::vector<RealType> & distances = surfaces.Distances[0];
+  distances.insert( distances.end(), surfaces.Distances[1].begin(),
+    surfaces.Distances[1].end() );
+  std::vector<RealType>().swap( surfaces.Distances[1] );
+
+  long k = static_cast<long>( vcl_ceil( this->m_Percentile *
+    static_cast<RealType>( numberOfDistances ) ) ) - 1;
+  k = std::max( 0L, std::min( k, static_cast<long>( numberOfDistances ) - 1 ) );
+  std::nth_element( distances.begin(), distances.begin() + k, distances.end() );
+  measures.m_PercentileHausdorffDistance = distances[k];
+}
+
+template<class TLabelImage>
+typename LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>::RealType
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::GetHausdorffDistance( LabelType label )
+{
+  MapIterator mapIt = this->m_LabelSurfaceMeasures.find( label );
+  if( mapIt == this->m_LabelSurfaceMeasures.end() )
+    {
+    itkWarningMacro( "Label " << label << " not found." );
+    return 0.0;
+    }
+  return (*mapIt).second.m_HausdorffDistance;
+}
+
+template<class TLabelImage>
+typename LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>::RealType
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::GetDirectedHausdorffDistance( LabelType label )
+{
+  MapIterator mapIt = this->m_LabelSurfaceMeasures.find( label );
+  if( mapIt == this->m_LabelSurfaceMeasures.end() )
+    {
+    itkWarningMacro( "Label " << label << " not found." );
+    return 0.0;
+    }
+  return (*mapIt).second.m_DirectedHausdorffDistance;
+}
+
+template<class TLabelImage>
+typename LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>::RealType
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::GetPercentileHausdorffDistance( LabelType label )
+{
+  MapIterator mapIt = this->m_LabelSurfaceMeasures.find( label );
+  if( mapIt == this->m_LabelSurfaceMeasures.end() )
+    {
+    itkWarningMacro( "Label " << label << " not found." );
+    return 0.0;
+    }
+  return (*mapIt).second.m_PercentileHausdorffDistance;
+}
+
+template<class TLabelImage>
+typename LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>::RealType
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::GetMeanSurfaceDistance( LabelType label )
+{
+  MapIterator mapIt = this->m_LabelSurfaceMeasures.find( label );
+  if( mapIt == this->m_LabelSurfaceMeasures.end() )
+    {
+    itkWarningMacro( "Label " << label << " not found." );
+    return 0.0;
+    }
+  return (*mapIt).second.m_MeanSurfaceDistance;
+}
+
+template<class TLabelImage>
+typename LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>::RealType
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::GetDirectedMeanSurfaceDistance( LabelType label )
+{
+  MapIterator mapIt = this->m_LabelSurfaceMeasures.find( label );
+  if( mapIt == this->m_LabelSurfaceMeasures.end() )
+    {
+    itkWarningMacro( "Label " << label << " not found." );
+    return 0.0;
+    }
+  return (*mapIt).second.m_DirectedMeanSurfaceDistance;
+}
+
+template<class TLabelImage>
+void
+LabelSurfaceDistanceMeasuresImageFilter<TLabelImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Percentile: " << this->m_Percentile << std::endl;
+  os << indent << "Bucket size: " << this->m_BucketSize << std::endl;
+  if( this->m_UseSelectedLabel )
+    {
+    os << indent << "Selected label: " << static_cast<typename
+      NumericTraits<LabelType>::PrintType>( this->m_SelectedLabel ) << std::endl;
+    }
+  os << indent << "Number of labels: "
+     << this->m_LabelSurfaceMeasures.size() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -22,6 +22,9 @@
 #include "itkImage.h"
 #include "itkHessianSmoothed3DToVesselnessMeasureImageFilter.h" 
 #include "itkHessianRecursiveGaussianImageFilter.h"
+#include "itkMultiThreader.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -41,7 +44,20 @@ namespace itk
  * methods respectively. The number of scale levels is set using 
  * SetNumberOfSigmaSteps method. Exponentially distributed scale levels are 
  * computed within the bound set by the minimum and maximum sigma values 
- *  
+ *
+ * The eigen values and the vesselness of each scale are computed and
+ * merged into the best response in one threaded pass over the Hessian
+ * image, without intermediate eigen value and vesselness images.
+ *
+ * With UseScaleSpace on, the image is not smoothed from scratch at every
+ * scale: the smoothed image of a scale is smoothed incrementally, by
+ * sqrt( sigma^2 - previousSigma^2 ), to get the next one, and the
+ * Hessian is taken by central differences in the same per-voxel pass as
+ * the eigen values and the vesselness, so that no tensor image is
+ * stored.  With UseDownsampling on as well, the smoothed image is
+ * decimated by two whenever sigma reaches DownsamplingSigma voxels of
+ * its grid, the coarse scales are computed on the coarse grid and their
+ * best response is linearly interpolated back to the full grid.
  *
  * \par References
  *  Manniesing, R, Viergever, MA, & Niessen, WJ (2006). Vessel Enhancing 
@@ -81,6 +97,9 @@ public:
   /** Update image buffer that holds the best vesselness response */ 
   typedef Image< double, 3>                              UpdateBufferType;
 
+  /** Smoothed image of the scale space mode */
+  typedef Image< float, 3>                               ScaleSpaceImageType;
+
   /** Image dimension = 3. */
   itkStaticConstMacro(ImageDimension, unsigned int,
                    ::itk::GetImageDimension<InputImageType>::ImageDimension);
@@ -100,6 +119,21 @@ public:
   itkSetMacro(NumberOfSigmaSteps, int);
   itkGetMacro(NumberOfSigmaSteps, int);
 
+  /** Smooth incrementally from scale to scale (default = false) */
+  itkSetMacro(UseScaleSpace, bool);
+  itkGetMacro(UseScaleSpace, bool);
+  itkBooleanMacro(UseScaleSpace);
+
+  /** Decimate the scale space at coarse scales (default = false) */
+  itkSetMacro(UseDownsampling, bool);
+  itkGetMacro(UseDownsampling, bool);
+  itkBooleanMacro(UseDownsampling);
+
+  /** Sigma, in voxels of the current grid, from which the scale space
+   * is decimated (default = 2) */
+  itkSetMacro(DownsamplingSigma, double);
+  itkGetMacro(DownsamplingSigma, double);
+
 
 protected:
   MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter();
@@ -109,14 +143,72 @@ protected:
   typedef HessianRecursiveGaussianImageFilter< InputImageType >
                                                         HessianFilterType;
 
+  typedef typename HessianFilterType::OutputImageType    HessianImageType;
+
   typedef HessianSmoothed3DToVesselnessMeasureImageFilter< double >
                                                         VesselnessFilterType;
+  typedef typename VesselnessFilterType::EigenValueArrayType
+                                                        EigenValueArrayType;
+
+  typedef typename UpdateBufferType::RegionType         RegionType;
 
   /** Generate Data */
   void GenerateData( void );
 
 private:
-  void UpdateMaximumResponse();
+  /** Smooths every scale from the input with the Hessian filter. */
+  void GenerateDataWithHessianFilter( const std::vector<double> & sigmas );
+
+  /** Smooths every scale from the previous one. */
+  void GenerateDataWithScaleSpace( const std::vector<double> & sigmas );
+
+  /** Gaussian smoothing, in physical units, into the scale space type. */
+  template <class TImage>
+  ScaleSpaceImageType::Pointer SmoothImage( const TImage *image,
+                                            double sigma );
+
+  /** Every other voxel of the image, with twice the spacing. */
+  ScaleSpaceImageType::Pointer DownsampleImage(
+                                      const ScaleSpaceImageType *image );
+
+  /** Maximum of the response and of the vesselness of the Hessian
+   * image, or of the Hessian of the smoothed image at the given sigma. */
+  void UpdateMaximumResponse( const HessianImageType *hessian,
+                              const ScaleSpaceImageType *smoothed,
+                              double sigma, UpdateBufferType *response );
+
+  /** Maximum of the update buffer and of the interpolated response of a
+   * grid decimated by the given factor. */
+  void UpdateMaximumResponse( const UpdateBufferType *coarseResponse,
+                              unsigned int factor );
+
+  struct ThreadStruct
+    {
+    Self                                           *Filter;
+    const HessianImageType                         *Hessian;
+    const ScaleSpaceImageType                      *Smoothed;
+    const UpdateBufferType                         *CoarseResponse;
+    UpdateBufferType                               *Response;
+    double                                          Sigma;
+    unsigned int                                    Factor;
+    };
+
+  /** Static functions used as "callbacks" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ResponseThreaderCallback( void *arg );
+  static ITK_THREAD_RETURN_TYPE UpsampleThreaderCallback( void *arg );
+
+  void ThreadedUpdateFromHessian( const ThreadStruct *str,
+                                  const RegionType & region );
+  void ThreadedUpdateFromScaleSpace( const ThreadStruct *str,
+                                     const RegionType & region );
+  void ThreadedUpsample( const ThreadStruct *str,
+                         const RegionType & region );
+
+  /** Slab of the region along the last dimension for a thread. */
+  static RegionType GetThreadRegion( const RegionType & region,
+                                     int threadId, int threadCount );
+
+  void   RunThreads( ThreadStruct *str, ThreadFunctionType callback );
 
   double ComputeSigmaValue( int scaleLevel );
   
@@ -131,6 +223,10 @@ private:
 
   int                                               m_NumberOfSigmaSteps;
 
+  bool                                              m_UseScaleSpace;
+  bool                                              m_UseDownsampling;
+  double                                            m_DownsamplingSigma;
+
   typename VesselnessFilterType::Pointer            m_VesselnessFilter;
   typename HessianFilterType::Pointer               m_HessianFilter;
 
@@ -18,8 +18,12 @@
 #define __itkMultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter_hxx
 
 #include "itkMultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter.h"
+#include "itkConstNeighborhoodIterator.h"
+#include "itkDiscreteGaussianImageFilter.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkNeighborhoodAlgorithm.h"
 #include "vnl/vnl_math.h"
 
 #define EPSILON  1e-03
@@ -40,6 +44,10 @@ MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
 
   m_NumberOfSigmaSteps = 10;
 
+  m_UseScaleSpace = false;
+  m_UseDownsampling = false;
+  m_DownsamplingSigma = 2.0;
+
   m_HessianFilter                = HessianFilterType::New();
   m_VesselnessFilter             = VesselnessFilterType::New();
 
@@ -67,6 +75,9 @@ MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
   m_UpdateBuffer->SetRequestedRegion(output->GetRequestedRegion());
   m_UpdateBuffer->SetBufferedRegion(output->GetBufferedRegion());
   m_UpdateBuffer->Allocate();
+
+  // The vesselness is never negative
+  m_UpdateBuffer->FillBuffer( 0.0 );
 }
 
 
@@ -84,34 +95,30 @@ MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
   // Allocate the buffer
   AllocateUpdateBuffer();
 
-  typename InputImageType::ConstPointer input = this->GetInput();
- 
-  this->m_HessianFilter->SetInput( input );
+  std::vector<double> sigmas;
 
-  this->m_HessianFilter->SetNormalizeAcrossScale( true );
- 
   double sigma = m_SigmaMin;
 
   int scaleLevel = 1;
 
   while ( sigma <= m_SigmaMax )
     {
-    std::cout << "Computing vesselness for scale with sigma= " 
-              << sigma << std::endl;
-
-    m_HessianFilter->SetSigma( sigma );
-
-    m_VesselnessFilter->SetInput ( m_HessianFilter->GetOutput() ); 
-
-    m_VesselnessFilter->Update();
- 
-    this->UpdateMaximumResponse();
+    sigmas.push_back( sigma );
 
     sigma  = this->ComputeSigmaValue( scaleLevel );
 
     scaleLevel++;
     } 
 
+  if ( m_UseScaleSpace )
+    {
+    this->GenerateDataWithScaleSpace( sigmas );
+    }
+  else
+    {
+    this->GenerateDataWithHessianFilter( sigmas );
+    }
+
   //Write out the best response to the output image
   ImageRegionIterator<UpdateBufferType> 
                it(m_UpdateBuffer,m_UpdateBuffer->GetLargestPossibleRegion());
@@ -133,31 +140,479 @@ template <typename TInputImage, typename TOutputImage >
 void
 MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
 <TInputImage,TOutputImage>
-::UpdateMaximumResponse()
+::GenerateDataWithHessianFilter( const std::vector<double> & sigmas )
 {
+  this->m_HessianFilter->SetInput( this->GetInput() );
 
-  ImageRegionIterator<UpdateBufferType> 
-            oit(m_UpdateBuffer,m_UpdateBuffer->GetLargestPossibleRegion());
+  this->m_HessianFilter->SetNormalizeAcrossScale( true );
 
-  oit.GoToBegin();
+  for ( unsigned int k = 0; k < sigmas.size(); k++ )
+    {
+    std::cout << "Computing vesselness for scale with sigma= "
+              << sigmas[k] << std::endl;
 
-  typedef typename VesselnessFilterType::OutputImageType   
-                                         VesselnessOutputImageType;
+    m_HessianFilter->SetSigma( sigmas[k] );
 
-  ImageRegionIterator<VesselnessOutputImageType> 
-            it(m_VesselnessFilter->GetOutput(),
-            this->m_VesselnessFilter->GetOutput()->GetLargestPossibleRegion());
+    m_HessianFilter->Update();
 
-  it.GoToBegin();
+    this->UpdateMaximumResponse( m_HessianFilter->GetOutput(), NULL,
+                                 sigmas[k], m_UpdateBuffer );
+    }
 
-  while(!oit.IsAtEnd())
+  // Release the last Hessian image
+  m_HessianFilter->GetOutput()->ReleaseData();
+}
+
+template <typename TInputImage, typename TOutputImage >
+void
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::GenerateDataWithScaleSpace( const std::vector<double> & sigmas )
+{
+  if ( sigmas.empty() )
+    {
+    return;
+    }
+
+  typename ScaleSpaceImageType::Pointer smoothed;
+
+  // Best response of the scales computed on a decimated grid
+  typename UpdateBufferType::Pointer coarseResponse;
+  unsigned int factor = 1;
+
+  for ( unsigned int k = 0; k < sigmas.size(); k++ )
     {
-    if( oit.Value() < it.Value() )
+    std::cout << "Computing vesselness for scale with sigma= "
+              << sigmas[k] << std::endl;
+
+    // Gaussians compose by adding their variances
+    if ( k == 0 )
       {
-      oit.Value() = it.Value();
+      smoothed = this->SmoothImage( this->GetInput(), sigmas[0] );
+      }
+    else
+      {
+      smoothed = this->SmoothImage( smoothed.GetPointer(), vcl_sqrt(
+        vnl_math_sqr( sigmas[k] ) - vnl_math_sqr( sigmas[k-1] ) ) );
+      }
+
+    if ( m_UseDownsampling )
+      {
+      const typename ScaleSpaceImageType::SpacingType & spacing =
+        smoothed->GetSpacing();
+      const typename ScaleSpaceImageType::SizeType & size =
+        smoothed->GetBufferedRegion().GetSize();
+
+      bool decimate = true;
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        if ( sigmas[k] < m_DownsamplingSigma * spacing[i] || size[i] < 8 )
+          {
+          decimate = false;
+          }
+        }
+
+      if ( decimate )
+        {
+        if ( coarseResponse )
+          {
+          this->UpdateMaximumResponse( coarseResponse, factor );
+          }
+        smoothed = this->DownsampleImage( smoothed );
+        factor *= 2;
+
+        coarseResponse = UpdateBufferType::New();
+        coarseResponse->CopyInformation( smoothed );
+        coarseResponse->SetRegions( smoothed->GetBufferedRegion() );
+        coarseResponse->Allocate();
+        coarseResponse->FillBuffer( 0.0 );
+        }
+      }
+
+    this->UpdateMaximumResponse( NULL, smoothed, sigmas[k],
+      coarseResponse ? coarseResponse.GetPointer() : m_UpdateBuffer.GetPointer() );
+    }
+
+  if ( coarseResponse )
+    {
+    this->UpdateMaximumResponse( coarseResponse, factor );
+    }
+}
+
+template <typename TInputImage, typename TOutputImage >
+template <class TImage>
+typename MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>::ScaleSpaceImageType::Pointer
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::SmoothImage( const TImage *image, double sigma )
+{
+  typedef DiscreteGaussianImageFilter<TImage, ScaleSpaceImageType>
+                                                        SmootherType;
+  typename SmootherType::Pointer smoother = SmootherType::New();
+  smoother->SetInput( image );
+  smoother->SetUseImageSpacing( true );
+  smoother->SetVariance( vnl_math_sqr( sigma ) );
+
+  // Room for a kernel of four sigmas on each side
+  double minimumSpacing = image->GetSpacing()[0];
+  for ( unsigned int i = 1; i < ImageDimension; i++ )
+    {
+    minimumSpacing = vnl_math_min( minimumSpacing,
+                                   static_cast<double>( image->GetSpacing()[i] ) );
+    }
+  const int kernelWidth =
+    2 * static_cast<int>( vcl_ceil( 4.0 * sigma / minimumSpacing ) ) + 1;
+  smoother->SetMaximumKernelWidth( vnl_math_max( kernelWidth, 32 ) );
+
+  smoother->Update();
+
+  typename ScaleSpaceImageType::Pointer output = smoother->GetOutput();
+  output->DisconnectPipeline();
+  return output;
+}
+
+template <typename TInputImage, typename TOutputImage >
+typename MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>::ScaleSpaceImageType::Pointer
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::DownsampleImage( const ScaleSpaceImageType *image )
+{
+  const typename ScaleSpaceImageType::RegionType & region =
+    image->GetBufferedRegion();
+
+  typename ScaleSpaceImageType::PointType origin;
+  image->TransformIndexToPhysicalPoint( region.GetIndex(), origin );
+
+  typename ScaleSpaceImageType::SpacingType spacing = image->GetSpacing();
+  typename ScaleSpaceImageType::SizeType size;
+  for ( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    spacing[i] *= 2.0;
+    size[i] = ( region.GetSize()[i] + 1 ) / 2;
+    }
+
+  // Coarse voxel j lies on fine voxel start + 2 j
+  typename ScaleSpaceImageType::Pointer output = ScaleSpaceImageType::New();
+  output->SetOrigin( origin );
+  output->SetSpacing( spacing );
+  output->SetDirection( image->GetDirection() );
+  output->SetRegions( size );
+  output->Allocate();
+
+  ImageRegionIteratorWithIndex<ScaleSpaceImageType> it( output,
+    output->GetBufferedRegion() );
+  for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    typename ScaleSpaceImageType::IndexType index = region.GetIndex();
+    for ( unsigned int i = 0; i < ImageDimension; i++ )
+      {
+      index[i] += 2 * it.GetIndex()[i];
+      }
+    it.Set( image->GetPixel( index ) );
+    }
+
+  return output;
+}
+
+template <typename TInputImage, typename TOutputImage >
+void
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::UpdateMaximumResponse( const HessianImageType *hessian,
+                         const ScaleSpaceImageType *smoothed,
+                         double sigma, UpdateBufferType *response )
+{
+  ThreadStruct str;
+  str.Filter = this;
+  str.Hessian = hessian;
+  str.Smoothed = smoothed;
+  str.CoarseResponse = NULL;
+  str.Response = response;
+  str.Sigma = sigma;
+  str.Factor = 1;
+
+  this->RunThreads( &str, this->ResponseThreaderCallback );
+}
+
+template <typename TInputImage, typename TOutputImage >
+void
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::UpdateMaximumResponse( const UpdateBufferType *coarseResponse,
+                         unsigned int factor )
+{
+  ThreadStruct str;
+  str.Filter = this;
+  str.Hessian = NULL;
+  str.Smoothed = NULL;
+  str.CoarseResponse = coarseResponse;
+  str.Response = m_UpdateBuffer;
+  str.Sigma = 0.0;
+  str.Factor = factor;
+
+  this->RunThreads( &str, this->UpsampleThreaderCallback );
+}
+
+template <typename TInputImage, typename TOutputImage >
+void
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::RunThreads( ThreadStruct *str, ThreadFunctionType callback )
+{
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( callback, str );
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+template <typename TInputImage, typename TOutputImage >
+typename MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>::RegionType
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::GetThreadRegion( const RegionType & region, int threadId, int threadCount )
+{
+  const unsigned int last = ImageDimension - 1;
+  const unsigned long length = region.GetSize()[last];
+
+  const unsigned long begin = ( length * threadId ) / threadCount;
+  const unsigned long end = ( length * ( threadId + 1 ) ) / threadCount;
+
+  typename RegionType::IndexType index = region.GetIndex();
+  typename RegionType::SizeType size = region.GetSize();
+  index[last] += begin;
+  size[last] = end - begin;
+
+  RegionType threadRegion( index, size );
+  return threadRegion;
+}
+
+template <typename TInputImage, typename TOutputImage >
+ITK_THREAD_RETURN_TYPE
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::ResponseThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const RegionType region = GetThreadRegion(
+    str->Response->GetBufferedRegion(), threadId, threadCount );
+  if ( region.GetNumberOfPixels() == 0 )
+    {
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  if ( str->Hessian )
+    {
+    str->Filter->ThreadedUpdateFromHessian( str, region );
+    }
+  else
+    {
+    str->Filter->ThreadedUpdateFromScaleSpace( str, region );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <typename TInputImage, typename TOutputImage >
+ITK_THREAD_RETURN_TYPE
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::UpsampleThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const RegionType region = GetThreadRegion(
+    str->Response->GetBufferedRegion(), threadId, threadCount );
+  if ( region.GetNumberOfPixels() > 0 )
+    {
+    str->Filter->ThreadedUpsample( str, region );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <typename TInputImage, typename TOutputImage >
+void
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::ThreadedUpdateFromHessian( const ThreadStruct *str,
+                             const RegionType & region )
+{
+  ImageRegionConstIterator<HessianImageType> hit( str->Hessian, region );
+  ImageRegionIterator<UpdateBufferType> oit( str->Response, region );
+
+  EigenValueArrayType eigenValue;
+
+  for ( hit.GoToBegin(), oit.GoToBegin(); !oit.IsAtEnd(); ++hit, ++oit )
+    {
+    hit.Get().ComputeEigenValues( eigenValue );
+
+    const double vesselness =
+      m_VesselnessFilter->ComputeVesselnessMeasure( eigenValue );
+    if ( oit.Value() < vesselness )
+      {
+      oit.Value() = vesselness;
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage >
+void
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::ThreadedUpdateFromScaleSpace( const ThreadStruct *str,
+                                const RegionType & region )
+{
+  typedef ConstNeighborhoodIterator<ScaleSpaceImageType> NeighborhoodIteratorType;
+  typedef NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<ScaleSpaceImageType>
+                                                        FaceCalculatorType;
+
+  typename NeighborhoodIteratorType::RadiusType radius;
+  radius.Fill( 1 );
+
+  FaceCalculatorType faceCalculator;
+  typename FaceCalculatorType::FaceListType faceList =
+    faceCalculator( str->Smoothed, region, radius );
+
+  // Central differences of the smoothed image, normalized across scale
+  // like the Hessian filter
+  const typename ScaleSpaceImageType::SpacingType & spacing =
+    str->Smoothed->GetSpacing();
+  const double sigmaSqr = vnl_math_sqr( str->Sigma );
+
+  double weights[ImageDimension][ImageDimension];
+  for ( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    weights[i][i] = sigmaSqr / vnl_math_sqr( spacing[i] );
+    for ( unsigned int j = i + 1; j < ImageDimension; j++ )
+      {
+      weights[i][j] = 0.25 * sigmaSqr / ( spacing[i] * spacing[j] );
+      }
+    }
+
+  typename HessianImageType::PixelType hessian;
+  EigenValueArrayType eigenValue;
+
+  typename FaceCalculatorType::FaceListType::iterator fit;
+  for ( fit = faceList.begin(); fit != faceList.end(); ++fit )
+    {
+    NeighborhoodIteratorType bit( radius, str->Smoothed, *fit );
+    ImageRegionIterator<UpdateBufferType> oit( str->Response, *fit );
+
+    const unsigned int center = bit.Size() / 2;
+    unsigned int stride[ImageDimension];
+    for ( unsigned int i = 0; i < ImageDimension; i++ )
+      {
+      stride[i] = bit.GetStride( i );
+      }
+
+    for ( bit.GoToBegin(), oit.GoToBegin(); !oit.IsAtEnd(); ++bit, ++oit )
+      {
+      const double value = bit.GetPixel( center );
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        hessian( i, i ) = weights[i][i] * (
+          bit.GetPixel( center + stride[i] ) - 2.0 * value +
+          bit.GetPixel( center - stride[i] ) );
+        for ( unsigned int j = i + 1; j < ImageDimension; j++ )
+          {
+          hessian( i, j ) = weights[i][j] * (
+            bit.GetPixel( center + stride[i] + stride[j] ) -
+            bit.GetPixel( center + stride[i] - stride[j] ) -
+            bit.GetPixel( center - stride[i] + stride[j] ) +
+            bit.GetPixel( center - stride[i] - stride[j] ) );
+          }
+        }
+      hessian.ComputeEigenValues( eigenValue );
+
+      const double vesselness =
+        m_VesselnessFilter->ComputeVesselnessMeasure( eigenValue );
+      if ( oit.Value() < vesselness )
+        {
+        oit.Value() = vesselness;
+        }
+      }
+    }
+}
+
+template <typename TInputImage, typename TOutputImage >
+void
+MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
+<TInputImage,TOutputImage>
+::ThreadedUpsample( const ThreadStruct *str, const RegionType & region )
+{
+  const UpdateBufferType *coarse = str->CoarseResponse;
+  const typename UpdateBufferType::SizeType & coarseSize =
+    coarse->GetBufferedRegion().GetSize();
+  const typename UpdateBufferType::IndexType & start =
+    str->Response->GetBufferedRegion().GetIndex();
+  const double factor = static_cast<double>( str->Factor );
+
+  typename UpdateBufferType::IndexType lower;
+  typename UpdateBufferType::IndexType upper;
+  double fraction[ImageDimension];
+
+  ImageRegionIteratorWithIndex<UpdateBufferType> oit( str->Response, region );
+  for ( oit.GoToBegin(); !oit.IsAtEnd(); ++oit )
+    {
+    // Fine voxel start + factor j lies on coarse voxel j
+    const typename UpdateBufferType::IndexType & index = oit.GetIndex();
+    for ( unsigned int i = 0; i < ImageDimension; i++ )
+      {
+      const double x = static_cast<double>( index[i] - start[i] ) / factor;
+      lower[i] = static_cast<long>( vcl_floor( x ) );
+      if ( lower[i] >= static_cast<long>( coarseSize[i] ) - 1 )
+        {
+        lower[i] = static_cast<long>( coarseSize[i] ) - 1;
+        upper[i] = lower[i];
+        fraction[i] = 0.0;
+        }
+      else
+        {
+        upper[i] = lower[i] + 1;
+        fraction[i] = x - static_cast<double>( lower[i] );
+        }
+      }
+
+    // Trilinear interpolation over the corners of the coarse cell
+    double value = 0.0;
+    for ( unsigned int corner = 0; corner < ( 1u << ImageDimension ); corner++ )
+      {
+      typename UpdateBufferType::IndexType cornerIndex;
+      double weight = 1.0;
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        if ( corner & ( 1u << i ) )
+          {
+          cornerIndex[i] = upper[i];
+          weight *= fraction[i];
+          }
+        else
+          {
+          cornerIndex[i] = lower[i];
+          weight *= 1.0 - fraction[i];
+          }
+        }
+      if ( weight > 0.0 )
+        {
+        value += weight * coarse->GetPixel( cornerIndex );
+        }
+      }
+
+    if ( oit.Value() < value )
+      {
+      oit.Value() = value;
       }
-    ++oit;
-    ++it;
     }
 }
 
@@ -188,6 +643,10 @@ MultiScaleHessianSmoothed3DToVesselnessMeasureImageFilter
   
   os << indent << "SigmaMin:  " << m_SigmaMin << std::endl;
   os << indent << "SigmaMax:  " << m_SigmaMax  << std::endl;
+  os << indent << "NumberOfSigmaSteps:  " << m_NumberOfSigmaSteps << std::endl;
+  os << indent << "UseScaleSpace:  " << m_UseScaleSpace << std::endl;
+  os << indent << "UseDownsampling:  " << m_UseDownsampling << std::endl;
+  os << indent << "DownsamplingSigma:  " << m_DownsamplingSigma << std::endl;
 }
 
 
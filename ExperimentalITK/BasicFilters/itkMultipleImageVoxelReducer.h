@@ -0,0 +1,298 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkMultipleImageVoxelReducer.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkMultipleImageVoxelReducer_h
+#define __itkMultipleImageVoxelReducer_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include "vnl/vnl_math.h"
+
+#include <vector>
+
+namespace itk {
+
+/** \class WelfordAccumulator
+ * \brief Running count, sum, mean, sum of squared deviations and extrema.
+ *
+ * Add() updates the statistics with one value (Welford's algorithm) and
+ * Merge() combines two partial results (Chan et al.), so partial
+ * statistics computed by different threads can be pooled without
+ * losing precision.
+ */
+template<class TRealType = double>
+class WelfordAccumulator
+{
+public:
+  typedef TRealType                                 RealType;
+
+  WelfordAccumulator()
+    { this->Clear(); }
+
+  void Clear()
+    {
+    this->m_Count = 0;
+    this->m_Mean = 0.0;
+    this->m_M2 = 0.0;
+    this->m_Sum = 0.0;
+    this->m_Minimum = 0.0;
+    this->m_Maximum = 0.0;
+    }
+
+  void Add( RealType x )
+    {
+    if( this->m_Count == 0 )
+      {
+      this->m_Minimum = x;
+      this->m_Maximum = x;
+      }
+    else
+      {
+      this->m_Minimum = vnl_math_min( this->m_Minimum, x );
+      this->m_Maximum = vnl_math_max( this->m_Maximum, x );
+      }
+    this->m_Count++;
+    this->m_Sum += x;
+    const RealType delta = x - this->m_Mean;
+    this->m_Mean += delta / static_cast<RealType>( this->m_Count );
+    this->m_M2 += delta * ( x - this->m_Mean );
+    }
+
+  void Merge( const WelfordAccumulator & other )
+    {
+    if( other.m_Count == 0 )
+      {
+      return;
+      }
+    if( this->m_Count == 0 )
+      {
+      *this = other;
+      return;
+      }
+    const RealType n1 = static_cast<RealType>( this->m_Count );
+    const RealType n2 = static_cast<RealType>( other.m_Count );
+    const RealType n = n1 + n2;
+    const RealType delta = other.m_Mean - this->m_Mean;
+    this->m_Mean += delta * n2 / n;
+    this->m_M2 += other.m_M2 + delta * delta * n1 * n2 / n;
+    this->m_Count += other.m_Count;
+    this->m_Sum += other.m_Sum;
+    this->m_Minimum = vnl_math_min( this->m_Minimum, other.m_Minimum );
+    this->m_Maximum = vnl_math_max( this->m_Maximum, other.m_Maximum );
+    }
+
+  unsigned long GetCount() const
+    { return this->m_Count; }
+  RealType GetMean() const
+    { return this->m_Mean; }
+  RealType GetSum() const
+    { return this->m_Sum; }
+  RealType GetMinimum() const
+    { return this->m_Minimum; }
+  RealType GetMaximum() const
+    { return this->m_Maximum; }
+
+  /** Unbiased variance (zero for less than two values). */
+  RealType GetVariance() const
+    {
+    return ( this->m_Count > 1 )
+      ? this->m_M2 / static_cast<RealType>( this->m_Count - 1 ) : 0.0;
+    }
+
+private:
+  unsigned long                     m_Count;
+  RealType                          m_Mean;
+  RealType                          m_M2;
+  RealType                          m_Sum;
+  RealType                          m_Minimum;
+  RealType                          m_Maximum;
+};
+
+/** \class MultipleImageVoxelReducer
+ * \brief Base class of the per-voxel reductions run by
+ * StreamingMultipleImageReducer.
+ *
+ * ReduceVoxel() receives the values of all the input images at one
+ * voxel, given by its offset in raster order from the start of the
+ * image region.  Each voxel is seen by exactly one thread, so voxelwise
+ * outputs can be written directly; statistics that span several voxels
+ * must be kept per thread and combined in Finalize().  The voxels of a
+ * slab are split into contiguous ranges, in increasing thread order, and
+ * AfterSlab() is called between slabs, where per-thread partial results
+ * can be flushed in raster order.
+ */
+template<class TImage>
+class MultipleImageVoxelReducer : public Object
+{
+public:
+  typedef MultipleImageVoxelReducer                 Self;
+  typedef Object                                    Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkTypeMacro( MultipleImageVoxelReducer, Object );
+
+  typedef TImage                                    ImageType;
+  typedef typename ImageType::Pointer               ImagePointer;
+  typedef typename ImageType::IndexType             IndexType;
+  typedef typename ImageType::OffsetValueType       OffsetValueType;
+  typedef double                                    RealType;
+
+  itkStaticConstMacro( ImageDimension, unsigned int,
+    TImage::ImageDimension );
+
+  /** Called before the first slab.  The reference image has the
+   * information and the region of the inputs but no buffer. */
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads );
+
+  /** Reduce the numberOfImages values of the voxel at offset. */
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const RealType *values ) = 0;
+
+  /** Whether a masked reduction must also hand the voxels outside of the
+   * mask to ReduceVoxelOutsideOfMask(). */
+  virtual bool GetReducesVoxelsOutsideOfMask() const
+    { return false; }
+
+  /** Called instead of ReduceVoxel() for the voxels outside of the mask,
+   * if GetReducesVoxelsOutsideOfMask() is true. */
+  virtual void ReduceVoxelOutsideOfMask( unsigned int itkNotUsed( threadId ),
+    OffsetValueType itkNotUsed( offset ),
+    const RealType * itkNotUsed( values ) ) {}
+
+  /** Called after each slab, outside of the threads. */
+  virtual void AfterSlab() {}
+
+  /** Called after the last slab, outside of the threads. */
+  virtual void Finalize() {}
+
+  unsigned int GetNumberOfImages() const
+    { return this->m_NumberOfImages; }
+  unsigned int GetNumberOfThreads() const
+    { return this->m_NumberOfThreads; }
+
+protected:
+  MultipleImageVoxelReducer();
+  virtual ~MultipleImageVoxelReducer() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Index of the voxel at offset. */
+  IndexType ComputeIndex( OffsetValueType offset ) const
+    { return this->m_ReferenceImage->ComputeIndex( offset ); }
+
+  /** New image with the information of the inputs, filled with zeros. */
+  ImagePointer CreateOutputImage() const;
+
+  ImagePointer                      m_ReferenceImage;
+  unsigned int                      m_NumberOfImages;
+  unsigned int                      m_NumberOfThreads;
+
+private:
+  MultipleImageVoxelReducer( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+};
+
+/** \class MultipleImageStatisticsReducer
+ * \brief Voxelwise mean, sum, minimum, maximum and variance of the
+ * input images.
+ *
+ * Only the requested statistics get an output image; voxels that are
+ * not reduced (e.g. outside of the mask) are left at zero, unless
+ * CopyFirstImageOutsideOfMask is on, in which case the mean, sum,
+ * minimum and maximum take the value of the first image there (the
+ * variance stays zero).  The pooled statistics of all the reduced values
+ * are also available; they do not include the copied voxels.
+ */
+template<class TImage>
+class MultipleImageStatisticsReducer
+: public MultipleImageVoxelReducer<TImage>
+{
+public:
+  typedef MultipleImageStatisticsReducer            Self;
+  typedef MultipleImageVoxelReducer<TImage>         Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( MultipleImageStatisticsReducer, MultipleImageVoxelReducer );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef typename Superclass::ImagePointer         ImagePointer;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             RealType;
+  typedef WelfordAccumulator<RealType>              AccumulatorType;
+
+  typedef enum
+    {
+    Mean = 0,
+    Sum,
+    Minimum,
+    Maximum,
+    Variance,
+    NumberOfStatistics
+    } StatisticType;
+
+  void SetUseStatistic( StatisticType statistic, bool use )
+    { this->m_UseStatistic[statistic] = use; this->Modified(); }
+  bool GetUseStatistic( StatisticType statistic ) const
+    { return this->m_UseStatistic[statistic]; }
+
+  ImageType * GetOutput( StatisticType statistic )
+    { return this->m_Outputs[statistic].GetPointer(); }
+
+  const AccumulatorType & GetPooledStatistics() const
+    { return this->m_PooledStatistics; }
+
+  itkSetMacro( CopyFirstImageOutsideOfMask, bool );
+  itkGetConstMacro( CopyFirstImageOutsideOfMask, bool );
+  itkBooleanMacro( CopyFirstImageOutsideOfMask );
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads );
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const RealType *values );
+  virtual bool GetReducesVoxelsOutsideOfMask() const
+    { return this->m_CopyFirstImageOutsideOfMask; }
+  virtual void ReduceVoxelOutsideOfMask( unsigned int threadId,
+    OffsetValueType offset, const RealType *values );
+  virtual void Finalize();
+
+protected:
+  MultipleImageStatisticsReducer();
+  virtual ~MultipleImageStatisticsReducer() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  MultipleImageStatisticsReducer( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  bool                              m_UseStatistic[NumberOfStatistics];
+  ImagePointer                      m_Outputs[NumberOfStatistics];
+  bool                              m_CopyFirstImageOutsideOfMask;
+
+  std::vector<AccumulatorType>      m_ThreaderPooledStatistics;
+  AccumulatorType                   m_PooledStatistics;
+};
+
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkMultipleImageVoxelReducer.hxx"
+#endif
+
+#endif
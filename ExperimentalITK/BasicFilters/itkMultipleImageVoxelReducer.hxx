@@ -0,0 +1,194 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkMultipleImageVoxelReducer.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkMultipleImageVoxelReducer_hxx
+#define _itkMultipleImageVoxelReducer_hxx
+
+#include "itkMultipleImageVoxelReducer.h"
+
+#include "itkNumericTraits.h"
+
+namespace itk {
+
+template<class TImage>
+MultipleImageVoxelReducer<TImage>
+::MultipleImageVoxelReducer()
+{
+  this->m_ReferenceImage = NULL;
+  this->m_NumberOfImages = 0;
+  this->m_NumberOfThreads = 1;
+}
+
+template<class TImage>
+void
+MultipleImageVoxelReducer<TImage>
+::Initialize( const ImageType *reference, unsigned int numberOfImages,
+  unsigned int numberOfThreads )
+{
+  this->m_ReferenceImage = ImageType::New();
+  this->m_ReferenceImage->CopyInformation( reference );
+  this->m_ReferenceImage->SetRegions( reference->GetLargestPossibleRegion() );
+
+  this->m_NumberOfImages = numberOfImages;
+  this->m_NumberOfThreads = numberOfThreads;
+}
+
+template<class TImage>
+typename MultipleImageVoxelReducer<TImage>::ImagePointer
+MultipleImageVoxelReducer<TImage>
+::CreateOutputImage() const
+{
+  ImagePointer output = ImageType::New();
+  output->CopyInformation( this->m_ReferenceImage );
+  output->SetRegions( this->m_ReferenceImage->GetLargestPossibleRegion() );
+  output->Allocate();
+  output->FillBuffer( NumericTraits<typename ImageType::PixelType>::Zero );
+  return output;
+}
+
+template<class TImage>
+void
+MultipleImageVoxelReducer<TImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Number of images: " << this->m_NumberOfImages << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+}
+
+template<class TImage>
+MultipleImageStatisticsReducer<TImage>
+::MultipleImageStatisticsReducer()
+{
+  for( unsigned int s = 0; s < NumberOfStatistics; s++ )
+    {
+    this->m_UseStatistic[s] = false;
+    }
+  this->m_UseStatistic[Mean] = true;
+  this->m_CopyFirstImageOutsideOfMask = false;
+}
+
+template<class TImage>
+void
+MultipleImageStatisticsReducer<TImage>
+::Initialize( const ImageType *reference, unsigned int numberOfImages,
+  unsigned int numberOfThreads )
+{
+  Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+
+  for( unsigned int s = 0; s < NumberOfStatistics; s++ )
+    {
+    if( this->m_UseStatistic[s] )
+      {
+      this->m_Outputs[s] = this->CreateOutputImage();
+      }
+    else
+      {
+      this->m_Outputs[s] = NULL;
+      }
+    }
+
+  this->m_ThreaderPooledStatistics.assign( numberOfThreads, AccumulatorType() );
+  this->m_PooledStatistics.Clear();
+}
+
+template<class TImage>
+void
+MultipleImageStatisticsReducer<TImage>
+::ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+  const RealType *values )
+{
+  AccumulatorType statistics;
+  for( unsigned int n = 0; n < this->m_NumberOfImages; n++ )
+    {
+    statistics.Add( values[n] );
+    }
+  this->m_ThreaderPooledStatistics[threadId].Merge( statistics );
+
+  typedef typename ImageType::PixelType PixelType;
+  if( this->m_Outputs[Mean] )
+    {
+    this->m_Outputs[Mean]->GetBufferPointer()[offset] =
+      static_cast<PixelType>( statistics.GetMean() );
+    }
+  if( this->m_Outputs[Sum] )
+    {
+    this->m_Outputs[Sum]->GetBufferPointer()[offset] =
+      static_cast<PixelType>( statistics.GetSum() );
+    }
+  if( this->m_Outputs[Minimum] )
+    {
+    this->m_Outputs[Minimum]->GetBufferPointer()[offset] =
+      static_cast<PixelType>( statistics.GetMinimum() );
+    }
+  if( this->m_Outputs[Maximum] )
+    {
+    this->m_Outputs[Maximum]->GetBufferPointer()[offset] =
+      static_cast<PixelType>( statistics.GetMaximum() );
+    }
+  if( this->m_Outputs[Variance] )
+    {
+    this->m_Outputs[Variance]->GetBufferPointer()[offset] =
+      static_cast<PixelType>( statistics.GetVariance() );
+    }
+}
+
+template<class TImage>
+void
+MultipleImageStatisticsReducer<TImage>
+::ReduceVoxelOutsideOfMask( unsigned int itkNotUsed( threadId ),
+  OffsetValueType offset, const RealType *values )
+{
+  typedef typename ImageType::PixelType PixelType;
+  const PixelType value = static_cast<PixelType>( values[0] );
+  for( unsigned int s = 0; s < NumberOfStatistics; s++ )
+    {
+    if( s != Variance && this->m_Outputs[s] )
+      {
+      this->m_Outputs[s]->GetBufferPointer()[offset] = value;
+      }
+    }
+}
+
+template<class TImage>
+void
+MultipleImageStatisticsReducer<TImage>
+::Finalize()
+{
+  this->m_PooledStatistics.Clear();
+  for( unsigned int t = 0; t < this->m_ThreaderPooledStatistics.size(); t++ )
+    {
+    this->m_PooledStatistics.Merge( this->m_ThreaderPooledStatistics[t] );
+    }
+}
+
+template<class TImage>
+void
+MultipleImageStatisticsReducer<TImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Copy first image outside of mask: "
+     << this->m_CopyFirstImageOutsideOfMask << std::endl;
+  os << indent << "Pooled mean: "
+     << this->m_PooledStatistics.GetMean() << std::endl;
+  os << indent << "Pooled variance: "
+     << this->m_PooledStatistics.GetVariance() << std::endl;
+}
+
+} // end of namespace itk
+
+#endif
@@ -0,0 +1,169 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkNormalizedCutsLaplacianOperator.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkNormalizedCutsLaplacianOperator_h
+#define __itkNormalizedCutsLaplacianOperator_h
+
+#include "itkImageRegion.h"
+#include "itkMultiThreader.h"
+#include "itkOffset.h"
+
+#include "vnl/vnl_vector.h"
+
+#include <vector>
+
+namespace itk {
+
+/** \class NormalizedCutsLaplacianOperator
+ * \brief Matrix-free graph Laplacian of an image for spectral segmentation.
+ *
+ * The graph has one node per pixel of the region (x fastest) and links
+ * each pixel inside the mask to the pixels of a fixed stencil of
+ * neighbour offsets that are inside the region and the mask, with weight
+ *
+ *   w(i,j) = s(j-i) * exp( -0.5 * ( ( v(i) - v(j) ) / DataSigma )^2 ),
+ *
+ * where the spatial weights s are given per offset.  Neither W nor the
+ * degree matrix D is ever formed: the products with D - W and with the
+ * normalized Laplacian E (D - W) E, E = ( D + eps )^(-1/2), are evaluated
+ * directly from the pixel values, the rows being split across threads.
+ * Pixels outside the mask give zero rows and columns.
+ *
+ * rows(), columns() and mult() provide the matrix interface used by
+ * SparseSymmetricMatrixEigenAnalysis, mult() being the product with the
+ * normalized Laplacian.
+ *
+ * Used by NormalizedCutsSegmentationImageFilter.
+ */
+template<unsigned int VImageDimension, class TRealType = double>
+class NormalizedCutsLaplacianOperator
+{
+public:
+  typedef NormalizedCutsLaplacianOperator           Self;
+
+  itkStaticConstMacro( ImageDimension, unsigned int, VImageDimension );
+
+  typedef TRealType                                 RealType;
+  typedef vnl_vector<RealType>                      VectorType;
+  typedef Offset<VImageDimension>                   OffsetType;
+  typedef typename OffsetType::OffsetValueType      OffsetValueType;
+  typedef ImageRegion<VImageDimension>              RegionType;
+
+  typedef std::vector<RealType>                     RealContainerType;
+  typedef std::vector<unsigned char>                MaskContainerType;
+
+  NormalizedCutsLaplacianOperator();
+  ~NormalizedCutsLaplacianOperator() {}
+
+  /** Region covered by the graph.  Reallocates the values (set to zero)
+   * and the mask (set to one). */
+  void SetRegion( const RegionType & region );
+  const RegionType & GetRegion() const
+    { return this->m_Region; }
+
+  /** One value and one mask flag per pixel of the region, x fastest, to
+   * be filled by the caller. */
+  RealContainerType & GetValues()
+    { return this->m_Values; }
+  const RealContainerType & GetValues() const
+    { return this->m_Values; }
+  MaskContainerType & GetMask()
+    { return this->m_Mask; }
+  const MaskContainerType & GetMask() const
+    { return this->m_Mask; }
+
+  void SetDataSigma( RealType sigma )
+    { this->m_DataSigma = sigma; }
+  RealType GetDataSigma() const
+    { return this->m_DataSigma; }
+
+  /** Stencil of the graph. */
+  void AddNeighbor( const OffsetType & offset, RealType spatialWeight );
+  void ClearNeighbors();
+  unsigned int GetNumberOfNeighbors() const
+    { return this->m_Offsets.size(); }
+
+  void SetNumberOfThreads( int numberOfThreads );
+  int GetNumberOfThreads() const
+    { return this->m_NumberOfThreads; }
+
+  /** Computes the degrees.  To be called once the values, the mask and
+   * the stencil are set. */
+  void Initialize();
+
+  RealType GetDegree( unsigned long n ) const
+    { return this->m_Degrees[n]; }
+
+  /** Matrix interface */
+  unsigned int rows() const
+    { return this->m_Values.size(); }
+  unsigned int columns() const
+    { return this->m_Values.size(); }
+
+  /** y = E ( D - W ) E x */
+  void mult( const VectorType & x, VectorType & y ) const;
+
+  /** y = ( D - W ) x */
+  void MultiplyByLaplacian( const VectorType & x, VectorType & y ) const;
+
+private:
+  typedef enum
+    {
+    Degree,
+    Laplacian,
+    NormalizedLaplacian
+    } OperationType;
+
+  void Apply( const RealType *x, RealType *y, OperationType operation ) const;
+
+  /** Evaluates the rows [begin, end). */
+  void ApplyRange( const RealType *x, RealType *y, OperationType operation,
+    unsigned long begin, unsigned long end ) const;
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ApplyThreaderCallback( void *arg );
+
+  struct ApplyThreadStruct
+    {
+    const Self                               *Operator;
+    const RealType                           *Input;
+    RealType                                 *Output;
+    OperationType                             Operation;
+    };
+
+  RegionType                       m_Region;
+  RealContainerType                m_Values;
+  MaskContainerType                m_Mask;
+  RealType                         m_DataSigma;
+
+  std::vector<OffsetType>          m_Offsets;
+  RealContainerType                m_SpatialWeights;
+  std::vector<OffsetValueType>     m_LinearOffsets;
+  OffsetValueType                  m_Radius[VImageDimension];
+
+  RealContainerType                m_Degrees;
+  RealContainerType                m_Scales;
+
+  int                              m_NumberOfThreads;
+};
+
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkNormalizedCutsLaplacianOperator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,324 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkNormalizedCutsLaplacianOperator.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkNormalizedCutsLaplacianOperator_hxx
+#define _itkNormalizedCutsLaplacianOperator_hxx
+
+#include "itkNormalizedCutsLaplacianOperator.h"
+
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+
+namespace itk {
+
+template<unsigned int VImageDimension, class TRealType>
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::NormalizedCutsLaplacianOperator()
+{
+  this->m_DataSigma = 1.0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_Radius[d] = 0;
+    }
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::SetRegion( const RegionType & region )
+{
+  this->m_Region = region;
+  this->m_Values.assign( region.GetNumberOfPixels(), 0.0 );
+  this->m_Mask.assign( region.GetNumberOfPixels(), 1 );
+  this->m_Degrees.clear();
+  this->m_Scales.clear();
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::AddNeighbor( const OffsetType & offset, RealType spatialWeight )
+{
+  this->m_Offsets.push_back( offset );
+  this->m_SpatialWeights.push_back( spatialWeight );
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::ClearNeighbors()
+{
+  this->m_Offsets.clear();
+  this->m_SpatialWeights.clear();
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::SetNumberOfThreads( int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( 1,
+    std::min( numberOfThreads, static_cast<int>( ITK_MAX_THREADS ) ) );
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::Initialize()
+{
+  // linear offsets in the value container and extent of the stencil
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    this->m_Radius[d] = 0;
+    }
+  this->m_LinearOffsets.resize( this->m_Offsets.size() );
+  for( unsigned int k = 0; k < this->m_Offsets.size(); k++ )
+    {
+    OffsetValueType linearOffset = 0;
+    OffsetValueType stride = 1;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      linearOffset += this->m_Offsets[k][d] * stride;
+      stride *= static_cast<OffsetValueType>( this->m_Region.GetSize()[d] );
+      this->m_Radius[d] = std::max( this->m_Radius[d],
+        this->m_Offsets[k][d] > 0 ? this->m_Offsets[k][d]
+                                  : -this->m_Offsets[k][d] );
+      }
+    this->m_LinearOffsets[k] = linearOffset;
+    }
+
+  const unsigned long numberOfPixels = this->m_Values.size();
+
+  this->m_Degrees.resize( numberOfPixels );
+  this->m_Scales.resize( numberOfPixels );
+  if( numberOfPixels == 0 )
+    {
+    return;
+    }
+
+  this->Apply( NULL, &( this->m_Degrees[0] ), Degree );
+
+  for( unsigned long n = 0; n < numberOfPixels; n++ )
+    {
+    this->m_Scales[n] = ( this->m_Mask[n] )
+      ? 1.0 / vcl_sqrt( this->m_Degrees[n] + vnl_math::eps ) : 0.0;
+    }
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::mult( const VectorType & x, VectorType & y ) const
+{
+  if( y.size() != x.size() )
+    {
+    y.set_size( x.size() );
+    }
+  if( x.size() > 0 )
+    {
+    this->Apply( x.data_block(), y.data_block(), NormalizedLaplacian );
+    }
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::MultiplyByLaplacian( const VectorType & x, VectorType & y ) const
+{
+  if( y.size() != x.size() )
+    {
+    y.set_size( x.size() );
+    }
+  if( x.size() > 0 )
+    {
+    this->Apply( x.data_block(), y.data_block(), Laplacian );
+    }
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::Apply( const RealType *x, RealType *y, OperationType operation ) const
+{
+  const unsigned long numberOfPixels = this->m_Values.size();
+
+  int numberOfThreads = this->m_NumberOfThreads;
+  if( static_cast<unsigned long>( numberOfThreads ) > numberOfPixels )
+    {
+    numberOfThreads = static_cast<int>( numberOfPixels );
+    }
+
+  if( numberOfThreads <= 1 )
+    {
+    this->ApplyRange( x, y, operation, 0, numberOfPixels );
+    return;
+    }
+
+  ApplyThreadStruct str;
+  str.Operator = this;
+  str.Input = x;
+  str.Output = y;
+  str.Operation = operation;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->ApplyThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template<unsigned int VImageDimension, class TRealType>
+ITK_THREAD_RETURN_TYPE
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::ApplyThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ApplyThreadStruct *str = (ApplyThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const unsigned long numberOfPixels = str->Operator->m_Values.size();
+  const unsigned long begin = ( numberOfPixels * threadId ) / threadCount;
+  const unsigned long end = ( numberOfPixels * ( threadId + 1 ) ) / threadCount;
+
+  if( begin < end )
+    {
+    str->Operator->ApplyRange( str->Input, str->Output, str->Operation,
+      begin, end );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<unsigned int VImageDimension, class TRealType>
+void
+NormalizedCutsLaplacianOperator<VImageDimension, TRealType>
+::ApplyRange( const RealType *x, RealType *y, OperationType operation,
+  unsigned long begin, unsigned long end ) const
+{
+  // position of the first pixel of the range, relative to the region start
+  OffsetValueType position[VImageDimension];
+  OffsetValueType size[VImageDimension];
+  unsigned long remainder = begin;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    size[d] = static_cast<OffsetValueType>( this->m_Region.GetSize()[d] );
+    position[d] = static_cast<OffsetValueType>( remainder % size[d] );
+    remainder /= size[d];
+    }
+
+  const unsigned int numberOfNeighbors = this->m_Offsets.size();
+  const RealType *values = &( this->m_Values[0] );
+  const unsigned char *mask = &( this->m_Mask[0] );
+  const RealType *scales = ( operation == NormalizedLaplacian )
+    ? &( this->m_Scales[0] ) : NULL;
+  const RealType dataFactor = -0.5 / vnl_math_sqr( this->m_DataSigma );
+
+  for( unsigned long n = begin; n < end; n++ )
+    {
+    RealType result = 0.0;
+
+    if( mask[n] )
+      {
+      // the whole stencil is inside the region away from the boundary
+      bool isInterior = true;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        if( position[d] < this->m_Radius[d]
+          || position[d] >= size[d] - this->m_Radius[d] )
+          {
+          isInterior = false;
+          break;
+          }
+        }
+
+      RealType sum = 0.0;
+      for( unsigned int k = 0; k < numberOfNeighbors; k++ )
+        {
+        if( !isInterior )
+          {
+          bool isInside = true;
+          for( unsigned int d = 0; d < ImageDimension; d++ )
+            {
+            const OffsetValueType p = position[d] + this->m_Offsets[k][d];
+            if( p < 0 || p >= size[d] )
+              {
+              isInside = false;
+              break;
+              }
+            }
+          if( !isInside )
+            {
+            continue;
+            }
+          }
+
+        const unsigned long m = n + this->m_LinearOffsets[k];
+        if( !mask[m] )
+          {
+          continue;
+          }
+
+        const RealType difference = values[n] - values[m];
+        const RealType weight = this->m_SpatialWeights[k]
+          * vcl_exp( dataFactor * difference * difference );
+
+        switch( operation )
+          {
+          case Degree:
+            sum += weight;
+            break;
+          case Laplacian:
+            sum += weight * x[m];
+            break;
+          case NormalizedLaplacian:
+            sum += weight * scales[m] * x[m];
+            break;
+          }
+        }
+
+      switch( operation )
+        {
+        case Degree:
+          result = sum;
+          break;
+        case Laplacian:
+          result = this->m_Degrees[n] * x[n] - sum;
+          break;
+        case NormalizedLaplacian:
+          result = scales[n] * ( this->m_Degrees[n] * scales[n] * x[n] - sum );
+          break;
+        }
+      }
+
+    y[n] = result;
+
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      if( ++position[d] < size[d] )
+        {
+        break;
+        }
+      position[d] = 0;
+      }
+    }
+}
+
+} // end of namespace itk
+
+#endif
@@ -22,10 +22,9 @@
 
 #include "itkImageToImageFilter.h"
 
-#include "itkConstNeighborhoodIterator.h"
+#include "itkNormalizedCutsLaplacianOperator.h"
 #include "itkSparseSymmetricMatrixEigenAnalysis.h"
 
-#include "vnl/vnl_sparse_matrix.h"
 #include "vnl/vnl_vector.h"
 
 namespace itk 
@@ -41,6 +40,12 @@ namespace itk
  * To construct a graph, we need to create nodes from the appropriate voxels as well
  * as the edges linking the source nodes and the target nodes.
  *
+ * \par
+ * The graph is not stored: the normalized Laplacian is a
+ * NormalizedCutsLaplacianOperator which evaluates its products with the
+ * Lanczos vectors directly from the image, using spatial weights
+ * precomputed once per neighbourhood offset.
+ *
  * \par REFERENCE
  * Y. Boykov and V. Kolmogorov, "An Experimental Comparison of Min-Cut/Max-Flow 
  * Algorithms for Energy Minimization in Vision," IEEE-PAMI, 26(9):1124-1137, 2004.
@@ -84,11 +89,12 @@ public:
   typedef double                                             RealType;
   typedef Image<RealType, 
     itkGetStaticConstMacro(ImageDimension)>                  RealImageType;
-  typedef ConstNeighborhoodIterator<InputImageType>          ConstNeighborhoodIteratorType;
-  typedef typename ConstNeighborhoodIteratorType::RadiusType RadiusType;    
+  typedef Size<itkGetStaticConstMacro(ImageDimension)>       RadiusType;
 
-  typedef vnl_sparse_matrix<RealType>                        SparseMatrixType;
-  typedef SparseSymmetricMatrixEigenAnalysis<RealType>       EigenSystemType;
+  typedef NormalizedCutsLaplacianOperator<
+    itkGetStaticConstMacro(ImageDimension), RealType>        LaplacianOperatorType;
+  typedef SparseSymmetricMatrixEigenAnalysis<RealType,
+    LaplacianOperatorType>                                   EigenSystemType;
 
   itkSetMacro( NumberOfClasses, unsigned int );  
   itkGetConstMacro( NumberOfClasses, unsigned int );
@@ -131,48 +137,9 @@ private:
   void GenerateEigenSystemFromInputImage();
   void SolveEigensystem();
   void LabelOutputImage();
-  RealType EvaluateWeightFunction( IndexType, IndexType );  
   void MulticlassSpectralClustering();
   void EigenVectorClustering();
   
-  inline unsigned long 
-  IndexToNumber( IndexType index, SizeType size )
-    {
-    IndexType k;     
-    k[0] = 1;    
-    
-    for ( unsigned int i = 1; i < ImageDimension; i++ )
-      {
-      k[i] = size[ImageDimension-i-1]*k[i-1];
-      }  
-    unsigned long number = 0;
-    for ( unsigned int i = 0; i < ImageDimension; i++ )
-      {
-      number += ( k[ImageDimension-i-1] * index[ImageDimension-i-1] );
-      }
-    return number;
-    }
-
-  inline IndexType 
-  NumberToIndex( unsigned int number, SizeType size )
-    {
-    IndexType k;     
-    k[0] = 1;    
-    
-    for ( unsigned int i = 1; i < ImageDimension; i++ )
-      {
-      k[i] = size[ImageDimension-i-1]*k[i-1];
-      }  
-    IndexType index;
-    for ( unsigned int i = 0; i < ImageDimension; i++ )
-      {
-      index[ImageDimension-i-1] = static_cast<unsigned int>( number/k[ImageDimension-i-1] );
-      number %= k[ImageDimension-i-1];
-      }
-    return index;
-    }
-
-  
   unsigned int                                               m_NumberOfClasses;
   RadiusType                                                 m_Radius;
   typename LabelImageType::Pointer                           m_MaskImage;
@@ -184,9 +151,7 @@ private:
 
   unsigned int                                               m_NumberOfSplittingPoints;
    
-  SparseMatrixType                                           m_D;
-  SparseMatrixType                                           m_E;
-  SparseMatrixType                                           m_W;
+  LaplacianOperatorType                                      m_Laplacian;
   typename EigenSystemType::Pointer                          m_EigenSystem;    
 
 };
@@ -22,9 +22,8 @@
 
 #include "itkNormalizedCutsSegmentationImageFilter.h"
 
-#include "itkConstantScalarOperator.h"
-#include "itkNeighborhoodAlgorithm.h"
-#include "itkNeighborhoodInnerProduct.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
 
 #include "vnl/vnl_math.h"
 
@@ -64,85 +63,73 @@ void
 NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
 ::GenerateEigenSystemFromInputImage()
 {
-  unsigned long numberOfVoxels = 1;
-  for ( unsigned int i = 0; i < ImageDimension; i++ )
-    {
-    numberOfVoxels *= this->GetInput()->GetLargestPossibleRegion().GetSize()[i];
-    }
+  typename InputImageType::RegionType region 
+    = this->GetInput()->GetLargestPossibleRegion();
 
-  /** Fill in the sparse matrices **/  
-  this->m_W.resize( numberOfVoxels, numberOfVoxels );
-  this->m_D.resize( numberOfVoxels, numberOfVoxels );
-  this->m_E.resize( numberOfVoxels, numberOfVoxels );
+  this->m_Laplacian.SetRegion( region );
+  this->m_Laplacian.SetDataSigma( this->m_DataSigma );
+  this->m_Laplacian.SetNumberOfThreads( this->GetNumberOfThreads() );
 
-  SizeType size = this->GetInput()->GetLargestPossibleRegion().GetSize();
+  /** Pixel values and mask in raster order **/
+  ImageRegionConstIterator<InputImageType> It( this->GetInput(), region );
+  unsigned long n = 0;
+  for ( It.GoToBegin(); !It.IsAtEnd(); ++It, ++n )
+    {
+    this->m_Laplacian.GetValues()[n] = static_cast<RealType>( It.Get() );
+    }
+  if ( this->m_MaskImage )
+    {
+    ImageRegionConstIterator<LabelImageType> ItM( this->m_MaskImage, region );
+    n = 0;
+    for ( ItM.GoToBegin(); !ItM.IsAtEnd(); ++ItM, ++n )
+      {
+      this->m_Laplacian.GetMask()[n] = 
+        ( ItM.Get() == this->m_ForegroundValue ) ? 1 : 0;
+      }
+    }
 
+  /** The spatial part of the weights only depends on the offset **/
   unsigned long numberOfNeighbors = 1;
   for ( unsigned int i = 0; i < ImageDimension; i++ )
     {
     numberOfNeighbors *= ( 2*this->m_Radius[i] + 1 );
     }
 
-  typedef typename NeighborhoodAlgorithm
-    ::ImageBoundaryFacesCalculator<InputImageType> FaceCalculatorType;
-  
-  FaceCalculatorType faceCalculator;
-  typename FaceCalculatorType::FaceListType faceList;
-  typename FaceCalculatorType::FaceListType::iterator fit;
+  IndexType centerIndex = region.GetIndex();
+  InputPointType centerPoint;
+  this->GetInput()->TransformIndexToPhysicalPoint( centerIndex, centerPoint ); 
 
-  faceList = faceCalculator( this->GetInput(), this->GetInput()->GetLargestPossibleRegion(),
-                             this->m_Radius );
- 
-  for ( fit = faceList.begin(); fit != faceList.end(); ++fit )
+  this->m_Laplacian.ClearNeighbors();
+  for ( unsigned long j = 0; j < numberOfNeighbors; j++ )
     {
-    ConstNeighborhoodIteratorType It( this->m_Radius, this->GetInput(), *fit );
-    for ( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    typename LaplacianOperatorType::OffsetType offset;
+    bool isCenter = true;
+    unsigned long remainder = j;
+    for ( unsigned int i = 0; i < ImageDimension; i++ )
       {
-      if ( this->m_MaskImage && 
-           ( this->m_MaskImage->GetPixel( It.GetIndex() ) != this->m_ForegroundValue ) )
+      offset[i] = static_cast<long>( remainder % ( 2*this->m_Radius[i] + 1 ) ) 
+        - static_cast<long>( this->m_Radius[i] );
+      remainder /= ( 2*this->m_Radius[i] + 1 );
+      if ( offset[i] != 0 )
         {
-        continue;
+        isCenter = false;
         }
-      unsigned long iLabel = this->IndexToNumber( It.GetIndex(), size ); 
-      RealType d = 0.0;
-      for ( unsigned int j = 0; j < numberOfNeighbors; j++ )
-        {
-        unsigned long jLabel = this->IndexToNumber( It.GetIndex( j ), size );
-        if ( iLabel == jLabel || 
-             !this->GetInput()->GetLargestPossibleRegion().IsInside( It.GetIndex( j ) ) 
-             || ( this->m_MaskImage && 
-             ( this->m_MaskImage->GetPixel( It.GetIndex( j ) ) != this->m_ForegroundValue ) ) )
-          {
-          continue;
-          }
-        RealType weight = this->EvaluateWeightFunction( It.GetIndex(), It.GetIndex( j ) );
-        this->m_W( iLabel, jLabel ) = weight;  
-        d += weight;
-        }
-      
-      this->m_D( iLabel, iLabel ) = d;
-      this->m_E( iLabel, iLabel ) = 1.0 / vcl_sqrt( d + vnl_math::eps );
       }
-    }  
-}
+    if ( isCenter )
+      {
+      continue;
+      }
 
-template <class TInputImage, class TLabelImage>
-typename NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>:: RealType
-NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
-::EvaluateWeightFunction( IndexType index1, IndexType index2 )
-{
-  RealType iValue = static_cast<RealType>( this->GetInput()->GetPixel( index1 ) );
-  InputPointType iPoint;
-  this->GetInput()->TransformIndexToPhysicalPoint( index1, iPoint ); 
+    InputPointType neighborPoint;
+    this->GetInput()->TransformIndexToPhysicalPoint( 
+      centerIndex + offset, neighborPoint ); 
 
-  RealType jValue = static_cast<RealType>( this->GetInput()->GetPixel( index2 ) );
-  InputPointType jPoint;
-  this->GetInput()->TransformIndexToPhysicalPoint( index2, jPoint ); 
+    RealType weight = vcl_exp( -0.5*( neighborPoint - centerPoint ).GetSquaredNorm() 
+      / vnl_math_sqr( this->m_SpatialSigma ) );
+    this->m_Laplacian.AddNeighbor( offset, weight );
+    }
 
-  RealType weight = vcl_exp( -0.5*vnl_math_sqr( ( iValue - jValue ) / this->m_DataSigma ) ) 
-    * vcl_exp( -0.5*( iPoint - jPoint ).GetSquaredNorm() / vnl_math_sqr( this->m_SpatialSigma ) );
-  
-  return weight;
+  this->m_Laplacian.Initialize();
 }
 
 template <class TInputImage, class TLabelImage>
@@ -150,20 +137,12 @@ void
 NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
 ::SolveEigensystem()
 {
-  SparseMatrixType A;
-  SparseMatrixType B; 
-  SparseMatrixType C;
-
-  this->m_D.subtract( this->m_W, A );
-  this->m_E.mult( A, B );
-  B.mult( this->m_E, C );
-
   this->m_EigenSystem = EigenSystemType::New();
   this->m_EigenSystem->SetNumberOfEigenPairs( this->m_NumberOfClasses );
   this->m_EigenSystem->SetNumberOfLanczosVectors( 35 );
   this->m_EigenSystem->SetSolveForSmallestEigenValues( true );
   this->m_EigenSystem->SetTolerance( 1e-6 );
-  this->m_EigenSystem->SetMatrix( &C );
+  this->m_EigenSystem->SetMatrix( &this->m_Laplacian );
   this->m_EigenSystem->Update();
 }
 
@@ -215,9 +194,6 @@ NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
       break;
 
     case SplittingPoints: 
-      SparseMatrixType A;
-      this->m_D.subtract( this->m_W, A );
-   
       RealType minValue = this->m_EigenSystem->GetEigenVector( 1 ).min_value();
       RealType maxValue = this->m_EigenSystem->GetEigenVector( 1 ).max_value();
       RealType dx = vnl_math_abs( maxValue - minValue ) 
@@ -244,11 +220,11 @@ NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
           {
           if ( binaryEigenVector[i] < x )
             {
-            bNumerator += this->m_D( i, i );
+            bNumerator += this->m_Laplacian.GetDegree( i );
             }
           else
             {
-            bDenominator += this->m_D( i, i );
+            bDenominator += this->m_Laplacian.GetDegree( i );
             }      
           }
         RealType b = bNumerator / bDenominator;
@@ -273,7 +249,7 @@ NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
           }
      
         vnl_vector<RealType> result;
-        A.mult( binaryEigenVector, result );
+        this->m_Laplacian.MultiplyByLaplacian( binaryEigenVector, result );
     
         RealType numerator = 0.0;
         for ( unsigned int i = 0; i < binaryEigenVector.size(); i++ )
@@ -290,17 +266,18 @@ NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
       break;
     }  
 
-  SizeType size = this->GetInput()->GetLargestPossibleRegion().GetSize();
-
-  for ( unsigned long i = 0; i < minCutVector.size(); i++ )
+  ImageRegionIterator<LabelImageType> ItO( output, 
+    output->GetLargestPossibleRegion() );
+  unsigned long i = 0;
+  for ( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO, ++i )
     {
     if ( minCutVector[i] < 0 )
       { 
-      output->SetPixel( this->NumberToIndex( i, size ), 0 );    
+      ItO.Set( 0 );    
       } 
     else
       {
-      output->SetPixel( this->NumberToIndex( i, size ), 1 );    
+      ItO.Set( 1 );    
       } 
     }
 
@@ -321,20 +298,15 @@ NormalizedCutsSegmentationImageFilter<TInputImage, TLabelImage>
 
   if ( n < this->m_NumberOfClasses )
     {
-     vnl_vector<RealType> eigenVector 
-       = this->m_EigenSystem->GetEigenVector( n );
-
-    typename RealImageType::Pointer output = RealImageType::New();
-    output->SetRegions( this->GetInput()->GetLargestPossibleRegion() );
-    output->SetOrigin( this->GetInput()->GetOrigin() );
-    output->SetSpacing( this->GetInput()->GetSpacing() );
-    output->Allocate();
-  
-    SizeType size = this->GetInput()->GetLargestPossibleRegion().GetSize();
+    vnl_vector<RealType> eigenVector 
+      = this->m_EigenSystem->GetEigenVector( n );
 
-    for ( unsigned long i = 0; i < eigenVector.size(); i++ )
+    ImageRegionIterator<RealImageType> ItO( output, 
+      output->GetLargestPossibleRegion() );
+    unsigned long i = 0;
+    for ( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO, ++i )
       {
-      output->SetPixel( this->NumberToIndex( i, size ), eigenVector[i] );    
+      ItO.Set( eigenVector[i] );    
       }
     }
 
@@ -0,0 +1,224 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkRobustPointMatchingCorrespondenceMatrix.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkRobustPointMatchingCorrespondenceMatrix_h
+#define __itkRobustPointMatchingCorrespondenceMatrix_h
+
+#include "itkObject.h"
+
+#include "itkKdTreeGenerator.h"
+#include "itkListSample.h"
+#include "itkMultiThreader.h"
+#include "itkObjectFactory.h"
+#include "itkPoint.h"
+#include "itkVariableLengthVector.h"
+#include "itkVector.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class RobustPointMatchingCorrespondenceMatrix
+ * \brief Sparse correspondence matrix of the robust point matching filters.
+ *
+ * Row i holds the correspondences of the moving point V_i with the fixed
+ * points X_j, m_ij = scale * exp( -exponentFactor * |X_j - V_i|^2 / T ).
+ * Entries with an exponent beyond the truncation exponent are dropped, so
+ * only the fixed points within a temperature-dependent radius of V_i are
+ * kept.  They are found with a k-d tree of the fixed points.  While the
+ * radius covers all the point pairs (high temperature) every entry is
+ * kept and the k-d tree is bypassed.
+ *
+ * A dense matrix only stores its values, row by row: row i holds the
+ * entries [i * K, (i + 1) * K) and entry k is in column k % K, K being the
+ * number of fixed points, so it takes no more memory than a full matrix.
+ * A truncated matrix stores its entries in compressed rows with a column
+ * index on top.  Either way the Sinkhorn normalization is done in parallel
+ * over the rows and over the columns.
+ */
+template <class TRealType, unsigned int VDimension>
+class ITK_EXPORT RobustPointMatchingCorrespondenceMatrix
+: public Object
+{
+public:
+  typedef RobustPointMatchingCorrespondenceMatrix             Self;
+  typedef Object                                              Superclass;
+  typedef SmartPointer<Self>                                  Pointer;
+  typedef SmartPointer<const Self>                            ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( RobustPointMatchingCorrespondenceMatrix, Object );
+
+  itkStaticConstMacro( Dimension, unsigned int, VDimension );
+
+  typedef TRealType                                           RealType;
+  typedef Point<RealType, VDimension>                         PointType;
+  typedef std::vector<PointType>                              PointContainerType;
+  typedef VariableLengthVector<RealType>                      OutlierVectorType;
+
+  typedef Vector<RealType, VDimension>                        MeasurementVectorType;
+  typedef Statistics::ListSample<MeasurementVectorType>       SampleType;
+  typedef Statistics::KdTreeGenerator<SampleType>             TreeGeneratorType;
+  typedef typename TreeGeneratorType::KdTreeType              KdTreeType;
+
+  /**
+   * Entries with exponentFactor * d^2 / T beyond this value are dropped
+   * (default = 20, i.e. exp( -20 ) ~ 2e-9 relative to the peak).
+   */
+  itkSetClampMacro( TruncationExponent, RealType, 0, NumericTraits<RealType>::max() );
+  itkGetConstMacro( TruncationExponent, RealType );
+
+  itkSetMacro( BucketSize, unsigned int );
+  itkGetConstMacro( BucketSize, unsigned int );
+
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetConstMacro( NumberOfThreads, unsigned int );
+
+  /** Whether the last update kept every entry. */
+  itkGetConstMacro( IsDense, bool );
+
+  /** Sets the fixed points (the columns) and builds their k-d tree. */
+  void SetFixedPoints( const PointContainerType & );
+
+  /** Keeps every entry and sets it to the given value. */
+  void Fill( unsigned long numberOfRows, RealType value );
+
+  /** Recomputes the entries for the moving points (the rows). */
+  void Update( const PointContainerType &, RealType temperature,
+    RealType exponentFactor, RealType scale );
+
+  /**
+   * Alternating row and column normalization, including the outlier
+   * column (one per row) and outlier row (one per column), until the mean
+   * squared deviation of the sums from 1 falls below the tolerance.
+   */
+  void Normalize( OutlierVectorType & outlierRow,
+    OutlierVectorType & outlierColumn, RealType tolerance,
+    unsigned int maximumNumberOfIterations, bool normalizeRowsFirst );
+
+  unsigned long GetNumberOfRows() const
+    {
+    return this->m_NumberOfRows;
+    }
+  unsigned long GetNumberOfColumns() const
+    {
+    return this->m_FixedPoints.size();
+    }
+  unsigned long GetNumberOfEntries() const
+    {
+    return this->m_Values.size();
+    }
+
+  /** The entries of row i are [GetRowBegin( i ), GetRowEnd( i )). */
+  unsigned long GetRowBegin( unsigned long i ) const
+    {
+    return this->m_IsDense
+      ? i * this->m_FixedPoints.size() : this->m_RowPointers[i];
+    }
+  unsigned long GetRowEnd( unsigned long i ) const
+    {
+    return this->m_IsDense
+      ? ( i + 1 ) * this->m_FixedPoints.size() : this->m_RowPointers[i + 1];
+    }
+  unsigned long GetColumn( unsigned long k ) const
+    {
+    return this->m_IsDense
+      ? k % this->m_FixedPoints.size() : this->m_Columns[k];
+    }
+  RealType GetValue( unsigned long k ) const
+    {
+    return this->m_Values[k];
+    }
+
+  /** m_ij, zero for a dropped entry. */
+  RealType GetEntry( unsigned long i, unsigned long j ) const;
+
+  const PointType & GetFixedPoint( unsigned long j ) const
+    {
+    return this->m_FixedPoints[j];
+    }
+
+protected:
+  RobustPointMatchingCorrespondenceMatrix();
+  virtual ~RobustPointMatchingCorrespondenceMatrix();
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  RobustPointMatchingCorrespondenceMatrix(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  enum { ValuePass, RowPass, ColumnPass };
+
+  struct ThreadStruct
+    {
+    Self                                                     *Matrix;
+    unsigned int                                              Pass;
+    unsigned long                                             NumberOfItems;
+    const PointContainerType                                 *MovingPoints;
+    RealType                                                  Factor;
+    RealType                                                  Scale;
+    RealType                                                 *Outliers;
+    std::vector<RealType>                                     Deviations;
+    };
+
+  /** Runs a pass over contiguous ranges of rows or columns. */
+  void RunPass( ThreadStruct *, unsigned int, unsigned long );
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback( void *arg );
+
+  void ThreadedComputeValues( ThreadStruct *, unsigned long, unsigned long );
+  RealType ThreadedNormalizeRows( ThreadStruct *, unsigned long, unsigned long );
+  RealType ThreadedNormalizeColumns( ThreadStruct *, unsigned long, unsigned long );
+  RealType ThreadedNormalizeDenseColumns( ThreadStruct *, unsigned long, unsigned long );
+
+  /** Builds the column index once the row structure is known. */
+  void BuildColumnIndex();
+
+  /** Releases the row and column structure of a truncated matrix. */
+  void ReleaseSparseStructure();
+
+  PointContainerType                                          m_FixedPoints;
+  PointType                                                   m_FixedMinimum;
+  PointType                                                   m_FixedMaximum;
+  typename SampleType::Pointer                                m_Sample;
+  typename TreeGeneratorType::Pointer                         m_TreeGenerator;
+
+  unsigned long                                               m_NumberOfRows;
+  std::vector<unsigned long>                                  m_RowPointers;
+  std::vector<unsigned long>                                  m_Columns;
+  std::vector<RealType>                                       m_Values;
+
+  std::vector<unsigned long>                                  m_ColumnPointers;
+  std::vector<unsigned long>                                  m_ColumnEntries;
+
+  RealType                                                    m_TruncationExponent;
+  unsigned int                                                m_BucketSize;
+  unsigned int                                                m_NumberOfThreads;
+  bool                                                        m_IsDense;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkRobustPointMatchingCorrespondenceMatrix.hxx"
+#endif
+
+#endif
@@ -0,0 +1,492 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkRobustPointMatchingCorrespondenceMatrix.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkRobustPointMatchingCorrespondenceMatrix_hxx
+#define _itkRobustPointMatchingCorrespondenceMatrix_hxx
+
+#include "itkRobustPointMatchingCorrespondenceMatrix.h"
+
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+
+namespace itk {
+
+template <class TRealType, unsigned int VDimension>
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::RobustPointMatchingCorrespondenceMatrix()
+{
+  this->m_TruncationExponent = 20.0;
+  this->m_BucketSize = 16;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_IsDense = false;
+  this->m_NumberOfRows = 0;
+
+  this->m_Sample = NULL;
+  this->m_TreeGenerator = NULL;
+
+  this->m_FixedMinimum.Fill( 0.0 );
+  this->m_FixedMaximum.Fill( 0.0 );
+}
+
+template <class TRealType, unsigned int VDimension>
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::~RobustPointMatchingCorrespondenceMatrix()
+{
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::SetFixedPoints( const PointContainerType & points )
+{
+  this->m_FixedPoints = points;
+
+  this->m_Sample = SampleType::New();
+  this->m_Sample->SetMeasurementVectorSize( Dimension );
+
+  this->m_FixedMinimum.Fill( NumericTraits<RealType>::max() );
+  this->m_FixedMaximum.Fill( NumericTraits<RealType>::NonpositiveMin() );
+
+  for( unsigned long j = 0; j < points.size(); j++ )
+    {
+    MeasurementVectorType mv;
+    for( unsigned int d = 0; d < Dimension; d++ )
+      {
+      mv[d] = points[j][d];
+      this->m_FixedMinimum[d] = vnl_math_min( this->m_FixedMinimum[d], points[j][d] );
+      this->m_FixedMaximum[d] = vnl_math_max( this->m_FixedMaximum[d], points[j][d] );
+      }
+    this->m_Sample->PushBack( mv );
+    }
+
+  this->m_TreeGenerator = TreeGeneratorType::New();
+  this->m_TreeGenerator->SetSample( this->m_Sample );
+  this->m_TreeGenerator->SetBucketSize( this->m_BucketSize );
+  this->m_TreeGenerator->Update();
+
+  this->ReleaseSparseStructure();
+  this->m_Values.clear();
+  this->m_NumberOfRows = 0;
+  this->m_IsDense = false;
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::ReleaseSparseStructure()
+{
+  // swap rather than clear, so that the memory is actually given back
+  std::vector<unsigned long>().swap( this->m_RowPointers );
+  std::vector<unsigned long>().swap( this->m_Columns );
+  std::vector<unsigned long>().swap( this->m_ColumnPointers );
+  std::vector<unsigned long>().swap( this->m_ColumnEntries );
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::Fill( unsigned long numberOfRows, RealType value )
+{
+  const unsigned long numberOfColumns = this->GetNumberOfColumns();
+
+  // The dense layout is implicit, only the values are stored
+  if( !this->m_IsDense )
+    {
+    this->ReleaseSparseStructure();
+    this->m_IsDense = true;
+    }
+  this->m_NumberOfRows = numberOfRows;
+  this->m_Values.assign( numberOfRows * numberOfColumns, value );
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::Update( const PointContainerType & movingPoints, RealType temperature,
+  RealType exponentFactor, RealType scale )
+{
+  const unsigned long numberOfRows = movingPoints.size();
+
+  /**
+   * Entries are kept within the radius where the exponent reaches the
+   * truncation exponent.  If the radius spans the bounding box of both
+   * point sets every entry is kept.
+   */
+  const RealType squaredRadius =
+    this->m_TruncationExponent * temperature / exponentFactor;
+
+  RealType maximumSquaredDistance = 0.0;
+  for( unsigned int d = 0; d < Dimension; d++ )
+    {
+    RealType minimum = this->m_FixedMinimum[d];
+    RealType maximum = this->m_FixedMaximum[d];
+    for( unsigned long i = 0; i < numberOfRows; i++ )
+      {
+      minimum = vnl_math_min( minimum, movingPoints[i][d] );
+      maximum = vnl_math_max( maximum, movingPoints[i][d] );
+      }
+    maximumSquaredDistance += vnl_math_sqr( maximum - minimum );
+    }
+
+  if( squaredRadius >= maximumSquaredDistance )
+    {
+    this->Fill( numberOfRows, 0.0 );
+    }
+  else
+    {
+    // the values of a dense matrix are released before the search
+    this->m_IsDense = false;
+    this->m_NumberOfRows = numberOfRows;
+    std::vector<RealType>().swap( this->m_Values );
+
+    this->m_RowPointers.resize( numberOfRows + 1 );
+    this->m_Columns.clear();
+
+    const RealType radius = vcl_sqrt( squaredRadius );
+
+    typename KdTreeType::InstanceIdentifierVectorType neighbors;
+    this->m_RowPointers[0] = 0;
+    for( unsigned long i = 0; i < numberOfRows; i++ )
+      {
+      MeasurementVectorType queryPoint;
+      for( unsigned int d = 0; d < Dimension; d++ )
+        {
+        queryPoint[d] = movingPoints[i][d];
+        }
+      neighbors.clear();
+      this->m_TreeGenerator->GetOutput()->Search( queryPoint, radius, neighbors );
+      std::sort( neighbors.begin(), neighbors.end() );
+
+      for( unsigned long n = 0; n < neighbors.size(); n++ )
+        {
+        this->m_Columns.push_back( neighbors[n] );
+        }
+      this->m_RowPointers[i + 1] = this->m_Columns.size();
+      }
+    this->m_Values.resize( this->m_Columns.size() );
+    this->BuildColumnIndex();
+    }
+
+  ThreadStruct str;
+  str.Matrix = this;
+  str.MovingPoints = &movingPoints;
+  str.Factor = exponentFactor / temperature;
+  str.Scale = scale;
+  str.Outliers = NULL;
+
+  this->RunPass( &str, ValuePass, numberOfRows );
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::BuildColumnIndex()
+{
+  const unsigned long numberOfRows = this->GetNumberOfRows();
+  const unsigned long numberOfColumns = this->GetNumberOfColumns();
+
+  this->m_ColumnPointers.assign( numberOfColumns + 1, 0 );
+  for( unsigned long k = 0; k < this->m_Columns.size(); k++ )
+    {
+    this->m_ColumnPointers[this->m_Columns[k] + 1]++;
+    }
+  for( unsigned long j = 0; j < numberOfColumns; j++ )
+    {
+    this->m_ColumnPointers[j + 1] += this->m_ColumnPointers[j];
+    }
+
+  std::vector<unsigned long> position( this->m_ColumnPointers.begin(),
+    this->m_ColumnPointers.end() - 1 );
+  this->m_ColumnEntries.resize( this->m_Columns.size() );
+  for( unsigned long i = 0; i < numberOfRows; i++ )
+    {
+    for( unsigned long k = this->m_RowPointers[i]; k < this->m_RowPointers[i + 1]; k++ )
+      {
+      this->m_ColumnEntries[position[this->m_Columns[k]]++] = k;
+      }
+    }
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::Normalize( OutlierVectorType & outlierRow, OutlierVectorType & outlierColumn,
+  RealType tolerance, unsigned int maximumNumberOfIterations,
+  bool normalizeRowsFirst )
+{
+  const unsigned long numberOfRows = this->GetNumberOfRows();
+  const unsigned long numberOfColumns = this->GetNumberOfColumns();
+
+  ThreadStruct rowStr;
+  rowStr.Matrix = this;
+  rowStr.MovingPoints = NULL;
+  rowStr.Outliers = outlierColumn.GetDataPointer();
+
+  ThreadStruct columnStr;
+  columnStr.Matrix = this;
+  columnStr.MovingPoints = NULL;
+  columnStr.Outliers = outlierRow.GetDataPointer();
+
+  RealType deviation = NumericTraits<RealType>::max();
+  unsigned int iterations = 0;
+
+  while ( deviation > tolerance && iterations++ < maximumNumberOfIterations )
+    {
+    if( normalizeRowsFirst )
+      {
+      this->RunPass( &rowStr, RowPass, numberOfRows );
+      this->RunPass( &columnStr, ColumnPass, numberOfColumns );
+      }
+    else
+      {
+      this->RunPass( &columnStr, ColumnPass, numberOfColumns );
+      this->RunPass( &rowStr, RowPass, numberOfRows );
+      }
+
+    /**
+     * Calculate current deviation from 1
+     */
+    deviation = 0.0;
+    for( unsigned int t = 0; t < rowStr.Deviations.size(); t++ )
+      {
+      deviation += rowStr.Deviations[t];
+      }
+    for( unsigned int t = 0; t < columnStr.Deviations.size(); t++ )
+      {
+      deviation += columnStr.Deviations[t];
+      }
+    deviation /= static_cast<RealType>( numberOfRows + numberOfColumns );
+    }
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::RunPass( ThreadStruct *str, unsigned int pass, unsigned long numberOfItems )
+{
+  unsigned int numberOfThreads = vnl_math_min( this->m_NumberOfThreads,
+    static_cast<unsigned int>( vnl_math_min( numberOfItems,
+    static_cast<unsigned long>( NumericTraits<unsigned int>::max() ) ) ) );
+  numberOfThreads = vnl_math_max( numberOfThreads, 1u );
+
+  str->Pass = pass;
+  str->NumberOfItems = numberOfItems;
+  str->Deviations.assign( numberOfThreads, 0.0 );
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->ThreaderCallback, str );
+  threader->SingleMethodExecute();
+}
+
+template <class TRealType, unsigned int VDimension>
+ITK_THREAD_RETURN_TYPE
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::ThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const unsigned long first = ( str->NumberOfItems * threadId ) / threadCount;
+  const unsigned long end = ( str->NumberOfItems * ( threadId + 1 ) ) / threadCount;
+
+  if( first < end )
+    {
+    switch( str->Pass )
+      {
+      case ValuePass:
+        str->Matrix->ThreadedComputeValues( str, first, end );
+        break;
+      case RowPass:
+        str->Deviations[threadId] =
+          str->Matrix->ThreadedNormalizeRows( str, first, end );
+        break;
+      case ColumnPass:
+        str->Deviations[threadId] =
+          str->Matrix->ThreadedNormalizeColumns( str, first, end );
+        break;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::ThreadedComputeValues( ThreadStruct *str, unsigned long firstRow,
+  unsigned long endRow )
+{
+  const PointContainerType & movingPoints = *str->MovingPoints;
+
+  for( unsigned long i = firstRow; i < endRow; i++ )
+    {
+    const PointType & V = movingPoints[i];
+    const unsigned long rowBegin = this->GetRowBegin( i );
+    const unsigned long rowEnd = this->GetRowEnd( i );
+    for( unsigned long k = rowBegin; k < rowEnd; k++ )
+      {
+      const PointType & X = this->m_FixedPoints[( this->m_IsDense )
+        ? k - rowBegin : this->m_Columns[k]];
+
+      RealType squaredDistance = 0.0;
+      for( unsigned int d = 0; d < Dimension; d++ )
+        {
+        squaredDistance += vnl_math_sqr( X[d] - V[d] );
+        }
+      this->m_Values[k] = str->Scale * vcl_exp( -str->Factor * squaredDistance );
+      }
+    }
+}
+
+template <class TRealType, unsigned int VDimension>
+typename RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>::RealType
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::ThreadedNormalizeRows( ThreadStruct *str, unsigned long firstRow,
+  unsigned long endRow )
+{
+  RealType deviation = 0.0;
+  for( unsigned long i = firstRow; i < endRow; i++ )
+    {
+    const unsigned long rowBegin = this->GetRowBegin( i );
+    const unsigned long rowEnd = this->GetRowEnd( i );
+
+    RealType sum = str->Outliers[i];
+    for( unsigned long k = rowBegin; k < rowEnd; k++ )
+      {
+      sum += this->m_Values[k];
+      }
+    if( sum > 0.0 )
+      {
+      for( unsigned long k = rowBegin; k < rowEnd; k++ )
+        {
+        this->m_Values[k] /= sum;
+        }
+      str->Outliers[i] /= sum;
+      }
+    deviation += vnl_math_sqr( sum - 1.0 );
+    }
+  return deviation;
+}
+
+template <class TRealType, unsigned int VDimension>
+typename RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>::RealType
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::ThreadedNormalizeColumns( ThreadStruct *str, unsigned long firstColumn,
+  unsigned long endColumn )
+{
+  if( this->m_IsDense )
+    {
+    return this->ThreadedNormalizeDenseColumns( str, firstColumn, endColumn );
+    }
+
+  RealType deviation = 0.0;
+  for( unsigned long j = firstColumn; j < endColumn; j++ )
+    {
+    RealType sum = str->Outliers[j];
+    for( unsigned long c = this->m_ColumnPointers[j]; c < this->m_ColumnPointers[j + 1]; c++ )
+      {
+      sum += this->m_Values[this->m_ColumnEntries[c]];
+      }
+    if( sum > 0.0 )
+      {
+      for( unsigned long c = this->m_ColumnPointers[j]; c < this->m_ColumnPointers[j + 1]; c++ )
+        {
+        this->m_Values[this->m_ColumnEntries[c]] /= sum;
+        }
+      str->Outliers[j] /= sum;
+      }
+    deviation += vnl_math_sqr( sum - 1.0 );
+    }
+  return deviation;
+}
+
+template <class TRealType, unsigned int VDimension>
+typename RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>::RealType
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::ThreadedNormalizeDenseColumns( ThreadStruct *str, unsigned long firstColumn,
+  unsigned long endColumn )
+{
+  const unsigned long numberOfColumns = this->GetNumberOfColumns();
+  const unsigned long numberOfEntries = this->m_Values.size();
+
+  RealType deviation = 0.0;
+  for( unsigned long j = firstColumn; j < endColumn; j++ )
+    {
+    RealType sum = str->Outliers[j];
+    for( unsigned long k = j; k < numberOfEntries; k += numberOfColumns )
+      {
+      sum += this->m_Values[k];
+      }
+    if( sum > 0.0 )
+      {
+      for( unsigned long k = j; k < numberOfEntries; k += numberOfColumns )
+        {
+        this->m_Values[k] /= sum;
+        }
+      str->Outliers[j] /= sum;
+      }
+    deviation += vnl_math_sqr( sum - 1.0 );
+    }
+  return deviation;
+}
+
+template <class TRealType, unsigned int VDimension>
+typename RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>::RealType
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::GetEntry( unsigned long i, unsigned long j ) const
+{
+  if( this->m_IsDense )
+    {
+    return this->m_Values[i * this->GetNumberOfColumns() + j];
+    }
+
+  std::vector<unsigned long>::const_iterator begin =
+    this->m_Columns.begin() + this->m_RowPointers[i];
+  std::vector<unsigned long>::const_iterator end =
+    this->m_Columns.begin() + this->m_RowPointers[i + 1];
+  std::vector<unsigned long>::const_iterator it =
+    std::lower_bound( begin, end, j );
+  if( it == end || *it != j )
+    {
+    return 0.0;
+    }
+  return this->m_Values[it - this->m_Columns.begin()];
+}
+
+template <class TRealType, unsigned int VDimension>
+void
+RobustPointMatchingCorrespondenceMatrix<TRealType, VDimension>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Truncation exponent: " << this->m_TruncationExponent << std::endl;
+  os << indent << "Bucket size: " << this->m_BucketSize << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "Rows: " << this->GetNumberOfRows()
+     << ", columns: " << this->GetNumberOfColumns()
+     << ", entries: " << this->GetNumberOfEntries()
+     << ( this->m_IsDense ? " (dense)" : "" ) << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,262 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStreamingImagePCAEstimator.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkStreamingImagePCAEstimator_h
+#define __itkStreamingImagePCAEstimator_h
+
+#include "itkMultipleImageVoxelReducer.h"
+#include "itkStreamingMultipleImageReducer.h"
+
+#include "vnl/vnl_matrix.h"
+#include "vnl/vnl_vector.h"
+
+#include <string>
+#include <vector>
+
+namespace itk {
+
+/** \class ImagePCAGramMatrixReducer
+ * \brief Voxelwise mean and Gram matrix of the centered input images.
+ *
+ * The centered values of each thread are gathered in tiles of
+ * consecutive voxels, stored image by image, and every full tile adds
+ * the dot products of all the pairs of its rows to the Gram matrix of
+ * the thread.  The matrices of the threads are summed in Finalize().
+ */
+template<class TImage>
+class ImagePCAGramMatrixReducer
+: public MultipleImageVoxelReducer<TImage>
+{
+public:
+  typedef ImagePCAGramMatrixReducer                 Self;
+  typedef MultipleImageVoxelReducer<TImage>         Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( ImagePCAGramMatrixReducer, MultipleImageVoxelReducer );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef typename Superclass::ImagePointer         ImagePointer;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             RealType;
+  typedef vnl_matrix<RealType>                      MatrixType;
+
+  /** Voxels per tile (default = 64). */
+  itkSetMacro( TileSize, unsigned int );
+  itkGetConstMacro( TileSize, unsigned int );
+
+  ImageType * GetMeanImage()
+    { return this->m_MeanImage.GetPointer(); }
+
+  /** Gram matrix of the input images minus the voxelwise mean. */
+  const MatrixType & GetGramMatrix() const
+    { return this->m_GramMatrix; }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads );
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const RealType *values );
+  virtual void Finalize();
+
+protected:
+  ImagePCAGramMatrixReducer();
+  virtual ~ImagePCAGramMatrixReducer() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  ImagePCAGramMatrixReducer( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  /** Adds the dot products of the tile of a thread to its Gram matrix. */
+  void FlushTile( unsigned int threadId );
+
+  unsigned int                          m_TileSize;
+  ImagePointer                          m_MeanImage;
+  MatrixType                            m_GramMatrix;
+
+  std::vector<std::vector<RealType> >   m_ThreaderTiles;
+  std::vector<unsigned int>             m_ThreaderTileSizes;
+  std::vector<MatrixType>               m_ThreaderGramMatrices;
+};
+
+/** \class ImagePCABasisReducer
+ * \brief Voxelwise linear combinations of the centered input images.
+ *
+ * Basis image k is sum_i C(i, k) ( x_i - mean ) for the coefficient
+ * matrix C, which has one row per input image.
+ */
+template<class TImage>
+class ImagePCABasisReducer
+: public MultipleImageVoxelReducer<TImage>
+{
+public:
+  typedef ImagePCABasisReducer                      Self;
+  typedef MultipleImageVoxelReducer<TImage>         Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( ImagePCABasisReducer, MultipleImageVoxelReducer );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef typename Superclass::ImagePointer         ImagePointer;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             RealType;
+  typedef vnl_matrix<RealType>                      MatrixType;
+
+  void SetCoefficients( const MatrixType & coefficients )
+    { this->m_Coefficients = coefficients; this->Modified(); }
+  const MatrixType & GetCoefficients() const
+    { return this->m_Coefficients; }
+
+  unsigned int GetNumberOfBasisImages() const
+    { return this->m_BasisImages.size(); }
+  ImageType * GetBasisImage( unsigned int k )
+    { return this->m_BasisImages[k].GetPointer(); }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads );
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const RealType *values );
+
+protected:
+  ImagePCABasisReducer() {}
+  virtual ~ImagePCABasisReducer() {}
+
+private:
+  ImagePCABasisReducer( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  MatrixType                            m_Coefficients;
+
+  /** The coefficients with one contiguous row per basis image */
+  MatrixType                            m_BasisCoefficients;
+
+  std::vector<ImagePointer>             m_BasisImages;
+  std::vector<std::vector<RealType> >   m_ThreaderValues;
+};
+
+/** \class StreamingImagePCAEstimator
+ * \brief Principal components of a list of image files without holding
+ * them in memory.
+ *
+ * Update() streams the images once, through StreamingMultipleImageReducer,
+ * to compute the voxelwise mean and the N x N Gram matrix of the centered
+ * images, and solves the eigenproblem of the Gram matrix.  The eigen
+ * values are those of the sample covariance, i.e. of the Gram matrix
+ * divided by N - 1, in decreasing order.
+ *
+ * GenerateBasisImages() streams the images a second time to build the
+ * requested number of principal components as unit norm images.  The
+ * components of null eigen values are left at zero.
+ *
+ * With a mask, the voxels outside of it are ignored and left at zero in
+ * the mean and the basis images.
+ */
+template<class TImage, class TMaskImage =
+  Image<unsigned char, TImage::ImageDimension> >
+class StreamingImagePCAEstimator : public Object
+{
+public:
+  typedef StreamingImagePCAEstimator                Self;
+  typedef Object                                    Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( StreamingImagePCAEstimator, Object );
+
+  typedef TImage                                    ImageType;
+  typedef TMaskImage                                MaskImageType;
+
+  typedef StreamingMultipleImageReducer<ImageType, MaskImageType>
+                                                    StreamerType;
+  typedef ImagePCAGramMatrixReducer<ImageType>      GramMatrixReducerType;
+  typedef ImagePCABasisReducer<ImageType>           BasisReducerType;
+
+  typedef typename StreamerType::FileNameContainerType
+                                                    FileNameContainerType;
+  typedef typename GramMatrixReducerType::RealType  RealType;
+  typedef vnl_matrix<RealType>                      MatrixType;
+  typedef vnl_vector<RealType>                      VectorType;
+
+  void SetFileNames( const FileNameContainerType & fileNames )
+    { this->m_Streamer->SetFileNames( fileNames ); this->Modified(); }
+  const FileNameContainerType & GetFileNames() const
+    { return this->m_Streamer->GetFileNames(); }
+
+  void SetMaskImage( const MaskImageType *mask )
+    { this->m_Streamer->SetMaskImage( mask ); this->Modified(); }
+
+  /** Memory allowed for the slabs of all the images together. */
+  void SetMaximumMemoryInMegabytes( double memory )
+    { this->m_Streamer->SetMaximumMemoryInMegabytes( memory ); this->Modified(); }
+  double GetMaximumMemoryInMegabytes() const
+    { return this->m_Streamer->GetMaximumMemoryInMegabytes(); }
+
+  void SetNumberOfThreads( int numberOfThreads )
+    { this->m_Streamer->SetNumberOfThreads( numberOfThreads ); this->Modified(); }
+  int GetNumberOfThreads() const
+    { return this->m_Streamer->GetNumberOfThreads(); }
+
+  /** Computes the mean image and the eigen values. */
+  void Update();
+
+  /** Computes the first numberOfComponents principal components. */
+  void GenerateBasisImages( unsigned int numberOfComponents );
+
+  ImageType * GetMeanImage()
+    { return this->m_GramMatrixReducer->GetMeanImage(); }
+
+  const MatrixType & GetGramMatrix() const
+    { return this->m_GramMatrixReducer->GetGramMatrix(); }
+
+  const VectorType & GetEigenValues() const
+    { return this->m_EigenValues; }
+
+  unsigned int GetNumberOfBasisImages() const
+    { return this->m_BasisReducer->GetNumberOfBasisImages(); }
+  ImageType * GetBasisImage( unsigned int k )
+    { return this->m_BasisReducer->GetBasisImage( k ); }
+
+protected:
+  StreamingImagePCAEstimator();
+  virtual ~StreamingImagePCAEstimator() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  StreamingImagePCAEstimator( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  typename StreamerType::Pointer              m_Streamer;
+  typename GramMatrixReducerType::Pointer     m_GramMatrixReducer;
+  typename BasisReducerType::Pointer          m_BasisReducer;
+
+  /** Eigen values of the Gram matrix and eigen vectors in the columns,
+   * in decreasing order */
+  VectorType                                  m_GramEigenValues;
+  MatrixType                                  m_GramEigenVectors;
+  VectorType                                  m_EigenValues;
+};
+
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkStreamingImagePCAEstimator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,297 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStreamingImagePCAEstimator.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkStreamingImagePCAEstimator_hxx
+#define _itkStreamingImagePCAEstimator_hxx
+
+#include "itkStreamingImagePCAEstimator.h"
+
+#include "vnl/algo/vnl_symmetric_eigensystem.h"
+
+namespace itk {
+
+template<class TImage>
+ImagePCAGramMatrixReducer<TImage>
+::ImagePCAGramMatrixReducer()
+{
+  this->m_TileSize = 64;
+  this->m_MeanImage = NULL;
+}
+
+template<class TImage>
+void
+ImagePCAGramMatrixReducer<TImage>
+::Initialize( const ImageType *reference, unsigned int numberOfImages,
+  unsigned int numberOfThreads )
+{
+  Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+
+  this->m_MeanImage = this->CreateOutputImage();
+  this->m_GramMatrix.set_size( numberOfImages, numberOfImages );
+  this->m_GramMatrix.fill( 0.0 );
+
+  this->m_TileSize = vnl_math_max( this->m_TileSize, 1u );
+  this->m_ThreaderTiles.assign( numberOfThreads,
+    std::vector<RealType>( numberOfImages * this->m_TileSize ) );
+  this->m_ThreaderTileSizes.assign( numberOfThreads, 0 );
+  this->m_ThreaderGramMatrices.assign( numberOfThreads, this->m_GramMatrix );
+}
+
+template<class TImage>
+void
+ImagePCAGramMatrixReducer<TImage>
+::ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+  const RealType *values )
+{
+  const unsigned int numberOfImages = this->m_NumberOfImages;
+
+  RealType mean = 0.0;
+  for( unsigned int n = 0; n < numberOfImages; n++ )
+    {
+    mean += values[n];
+    }
+  mean /= static_cast<RealType>( numberOfImages );
+
+  this->m_MeanImage->GetBufferPointer()[offset] =
+    static_cast<typename ImageType::PixelType>( mean );
+
+  RealType *tile = &( this->m_ThreaderTiles[threadId][0] ) +
+    this->m_ThreaderTileSizes[threadId];
+  for( unsigned int n = 0; n < numberOfImages; n++ )
+    {
+    tile[n * this->m_TileSize] = values[n] - mean;
+    }
+  if( ++this->m_ThreaderTileSizes[threadId] == this->m_TileSize )
+    {
+    this->FlushTile( threadId );
+    }
+}
+
+template<class TImage>
+void
+ImagePCAGramMatrixReducer<TImage>
+::FlushTile( unsigned int threadId )
+{
+  const unsigned int numberOfImages = this->m_NumberOfImages;
+  const unsigned int tileSize = this->m_ThreaderTileSizes[threadId];
+  const RealType *tile = &( this->m_ThreaderTiles[threadId][0] );
+  MatrixType & gram = this->m_ThreaderGramMatrices[threadId];
+
+  // Upper triangle only, mirrored in Finalize()
+  for( unsigned int i = 0; i < numberOfImages; i++ )
+    {
+    const RealType *x = tile + i * this->m_TileSize;
+    for( unsigned int j = i; j < numberOfImages; j++ )
+      {
+      const RealType *y = tile + j * this->m_TileSize;
+      RealType dot = 0.0;
+      for( unsigned int k = 0; k < tileSize; k++ )
+        {
+        dot += x[k] * y[k];
+        }
+      gram( i, j ) += dot;
+      }
+    }
+  this->m_ThreaderTileSizes[threadId] = 0;
+}
+
+template<class TImage>
+void
+ImagePCAGramMatrixReducer<TImage>
+::Finalize()
+{
+  this->m_GramMatrix.fill( 0.0 );
+  for( unsigned int t = 0; t < this->m_ThreaderGramMatrices.size(); t++ )
+    {
+    if( this->m_ThreaderTileSizes[t] > 0 )
+      {
+      this->FlushTile( t );
+      }
+    this->m_GramMatrix += this->m_ThreaderGramMatrices[t];
+    }
+  for( unsigned int i = 0; i < this->m_NumberOfImages; i++ )
+    {
+    for( unsigned int j = 0; j < i; j++ )
+      {
+      this->m_GramMatrix( i, j ) = this->m_GramMatrix( j, i );
+      }
+    }
+
+  this->m_ThreaderTiles.clear();
+  this->m_ThreaderTileSizes.clear();
+  this->m_ThreaderGramMatrices.clear();
+}
+
+template<class TImage>
+void
+ImagePCAGramMatrixReducer<TImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Tile size: " << this->m_TileSize << std::endl;
+}
+
+template<class TImage>
+void
+ImagePCABasisReducer<TImage>
+::Initialize( const ImageType *reference, unsigned int numberOfImages,
+  unsigned int numberOfThreads )
+{
+  Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+
+  if( this->m_Coefficients.rows() != numberOfImages )
+    {
+    itkExceptionMacro( "The coefficient matrix has "
+      << this->m_Coefficients.rows() << " rows for "
+      << numberOfImages << " images." );
+    }
+
+  this->m_BasisCoefficients = this->m_Coefficients.transpose();
+
+  this->m_BasisImages.resize( this->m_Coefficients.cols() );
+  for( unsigned int k = 0; k < this->m_BasisImages.size(); k++ )
+    {
+    this->m_BasisImages[k] = this->CreateOutputImage();
+    }
+
+  this->m_ThreaderValues.assign( numberOfThreads,
+    std::vector<RealType>( numberOfImages ) );
+}
+
+template<class TImage>
+void
+ImagePCABasisReducer<TImage>
+::ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+  const RealType *values )
+{
+  const unsigned int numberOfImages = this->m_NumberOfImages;
+
+  RealType mean = 0.0;
+  for( unsigned int n = 0; n < numberOfImages; n++ )
+    {
+    mean += values[n];
+    }
+  mean /= static_cast<RealType>( numberOfImages );
+
+  RealType *centered = &( this->m_ThreaderValues[threadId][0] );
+  for( unsigned int n = 0; n < numberOfImages; n++ )
+    {
+    centered[n] = values[n] - mean;
+    }
+
+  for( unsigned int k = 0; k < this->m_BasisImages.size(); k++ )
+    {
+    const RealType *coefficients = this->m_BasisCoefficients[k];
+    RealType value = 0.0;
+    for( unsigned int n = 0; n < numberOfImages; n++ )
+      {
+      value += coefficients[n] * centered[n];
+      }
+    this->m_BasisImages[k]->GetBufferPointer()[offset] =
+      static_cast<typename ImageType::PixelType>( value );
+    }
+}
+
+template<class TImage, class TMaskImage>
+StreamingImagePCAEstimator<TImage, TMaskImage>
+::StreamingImagePCAEstimator()
+{
+  this->m_Streamer = StreamerType::New();
+  this->m_GramMatrixReducer = GramMatrixReducerType::New();
+  this->m_BasisReducer = BasisReducerType::New();
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingImagePCAEstimator<TImage, TMaskImage>
+::Update()
+{
+  const unsigned int numberOfImages = this->m_Streamer->GetFileNames().size();
+  if( numberOfImages < 2 )
+    {
+    itkExceptionMacro( "At least two training images are needed." );
+    }
+
+  this->m_Streamer->SetReducer( this->m_GramMatrixReducer.GetPointer() );
+  this->m_Streamer->Update();
+
+  // The eigen vectors of the Gram matrix are the coordinates of the
+  // principal components in the span of the centered images.
+  vnl_symmetric_eigensystem<RealType> eigenSystem(
+    this->m_GramMatrixReducer->GetGramMatrix() );
+
+  this->m_GramEigenValues.set_size( numberOfImages );
+  this->m_GramEigenVectors.set_size( numberOfImages, numberOfImages );
+  for( unsigned int k = 0; k < numberOfImages; k++ )
+    {
+    // vnl sorts the eigen values in increasing order
+    const unsigned int index = numberOfImages - 1 - k;
+    this->m_GramEigenValues[k] =
+      vnl_math_max( eigenSystem.get_eigenvalue( index ), 0.0 );
+    this->m_GramEigenVectors.set_column( k, eigenSystem.get_eigenvector( index ) );
+    }
+  this->m_EigenValues = this->m_GramEigenValues /
+    static_cast<RealType>( numberOfImages - 1 );
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingImagePCAEstimator<TImage, TMaskImage>
+::GenerateBasisImages( unsigned int numberOfComponents )
+{
+  const unsigned int numberOfImages = this->m_GramEigenValues.size();
+  if( numberOfImages == 0 )
+    {
+    itkExceptionMacro( "Update() must be called first." );
+    }
+  numberOfComponents = vnl_math_min( numberOfComponents, numberOfImages );
+
+  // The norm of sum_i v_i ( x_i - mean ) is the square root of the Gram
+  // eigen value of v.  Null components are left at zero rather than
+  // amplifying round-off.
+  const RealType tolerance = 1e-12 * this->m_GramEigenValues[0];
+
+  MatrixType coefficients( numberOfImages, numberOfComponents, 0.0 );
+  for( unsigned int k = 0; k < numberOfComponents; k++ )
+    {
+    if( this->m_GramEigenValues[k] > tolerance )
+      {
+      coefficients.set_column( k, this->m_GramEigenVectors.get_column( k ) /
+        vcl_sqrt( this->m_GramEigenValues[k] ) );
+      }
+    }
+
+  this->m_BasisReducer->SetCoefficients( coefficients );
+  this->m_Streamer->SetReducer( this->m_BasisReducer.GetPointer() );
+  this->m_Streamer->Update();
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingImagePCAEstimator<TImage, TMaskImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Number of files: "
+     << this->m_Streamer->GetFileNames().size() << std::endl;
+  os << indent << "Eigen values: " << this->m_EigenValues << std::endl;
+  os << indent << "Number of basis images: "
+     << this->m_BasisReducer->GetNumberOfBasisImages() << std::endl;
+}
+
+} // end of namespace itk
+
+#endif
@@ -0,0 +1,184 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStreamingMultipleImageReducer.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkStreamingMultipleImageReducer_h
+#define __itkStreamingMultipleImageReducer_h
+
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkMultiThreader.h"
+#include "itkMultipleImageVoxelReducer.h"
+
+#include <string>
+#include <vector>
+
+namespace itk {
+
+/** \class StreamingMultipleImageReducer
+ * \brief Runs a voxelwise reduction over a list of image files, one slab
+ * at a time.
+ *
+ * The inputs are read in slabs along the last dimension, as thick as
+ * the memory budget allows for all the inputs together, so a cohort of
+ * hundreds of volumes never needs to be resident at once (with image
+ * IOs that cannot stream, each reader holds its whole image instead).
+ * The slabs of the different inputs are read concurrently, one reader
+ * per thread at a time.
+ * The voxels of each slab are split across threads and handed to the
+ * MultipleImageVoxelReducer, with the values of all the inputs gathered
+ * in one array per voxel.
+ *
+ * With a mask, only the voxels where it is nonzero are reduced, and the
+ * others are skipped unless the reducer asks for them through
+ * GetReducesVoxelsOutsideOfMask().  The mask is compacted once into a
+ * sorted list of voxel offsets, which can also be given (or reused)
+ * directly with SetMaskOffsets().
+ *
+ * All the inputs must have the same size as the first one.
+ */
+template<class TImage, class TMaskImage =
+  Image<unsigned char, TImage::ImageDimension> >
+class StreamingMultipleImageReducer : public Object
+{
+public:
+  typedef StreamingMultipleImageReducer             Self;
+  typedef Object                                    Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( StreamingMultipleImageReducer, Object );
+
+  itkStaticConstMacro( ImageDimension, unsigned int,
+    TImage::ImageDimension );
+
+  typedef TImage                                    ImageType;
+  typedef typename ImageType::PixelType             PixelType;
+  typedef typename ImageType::RegionType            RegionType;
+  typedef typename ImageType::OffsetValueType       OffsetValueType;
+  typedef TMaskImage                                MaskImageType;
+
+  typedef MultipleImageVoxelReducer<ImageType>      ReducerType;
+  typedef typename ReducerType::RealType            RealType;
+
+  typedef std::vector<std::string>                  FileNameContainerType;
+  typedef std::vector<OffsetValueType>              OffsetContainerType;
+
+  void SetFileNames( const FileNameContainerType & fileNames )
+    { this->m_FileNames = fileNames; this->Modified(); }
+  const FileNameContainerType & GetFileNames() const
+    { return this->m_FileNames; }
+
+  /** Compacts the nonzero voxels of the mask into the mask offsets and
+   * turns UseMask on (off for a null mask). */
+  void SetMaskImage( const MaskImageType *mask );
+
+  /** Sorted offsets, in raster order from the start of the image
+   * region, of the voxels to reduce.  Turns UseMask on. */
+  void SetMaskOffsets( const OffsetContainerType & offsets );
+  const OffsetContainerType & GetMaskOffsets() const
+    { return this->m_MaskOffsets; }
+
+  /** Reduce only the mask offsets.  Turning it off keeps the offsets,
+   * e.g. for a reduction over all the voxels between masked ones. */
+  itkSetMacro( UseMask, bool );
+  itkGetConstMacro( UseMask, bool );
+  itkBooleanMacro( UseMask );
+
+  itkSetObjectMacro( Reducer, ReducerType );
+  itkGetObjectMacro( Reducer, ReducerType );
+
+  /** Memory allowed for the slabs of all the inputs together. */
+  itkSetMacro( MaximumMemoryInMegabytes, double );
+  itkGetConstMacro( MaximumMemoryInMegabytes, double );
+
+  void SetNumberOfThreads( int numberOfThreads );
+  itkGetConstMacro( NumberOfThreads, int );
+
+  /** Number of slabs used by the last Update(). */
+  itkGetConstMacro( NumberOfSlabs, unsigned int );
+
+  void Update();
+
+protected:
+  StreamingMultipleImageReducer();
+  virtual ~StreamingMultipleImageReducer() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  StreamingMultipleImageReducer( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  typedef ImageFileReader<ImageType>                ReaderType;
+  typedef std::vector<typename ReaderType::Pointer> ReaderContainerType;
+
+  /** The slab to read and the errors of each reader. */
+  struct ReadThreadStruct
+    {
+    ReaderContainerType                      *Readers;
+    RegionType                                Slab;
+    std::vector<std::string>                  Errors;
+    };
+
+  /** Reads the slab with the readers threadId, threadId + threadCount,
+   * ... */
+  static void ReadSlabs( ReadThreadStruct *str, int threadId,
+    int threadCount );
+
+  /** Reduces the voxels [begin, end) of the current slab, which are
+   * positions in the mask offsets if only the mask is reduced and voxel
+   * offsets otherwise. */
+  void ReduceRange( unsigned int threadId, unsigned long begin,
+    unsigned long end );
+
+  /** Static functions used as "callbacks" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ReadThreaderCallback( void *arg );
+  static ITK_THREAD_RETURN_TYPE ReduceThreaderCallback( void *arg );
+
+  struct ReduceThreadStruct
+    {
+    Self                                     *Reducer;
+    unsigned long                             Begin;
+    unsigned long                             End;
+    };
+
+  FileNameContainerType                     m_FileNames;
+  OffsetContainerType                       m_MaskOffsets;
+  bool                                      m_UseMask;
+  bool                                      m_ReduceOutsideOfMask;
+
+  typename ReducerType::Pointer             m_Reducer;
+
+  double                                    m_MaximumMemoryInMegabytes;
+  int                                       m_NumberOfThreads;
+  unsigned int                              m_NumberOfSlabs;
+
+  /** Current slab of each input: the buffer and the offset of its
+   * first voxel. */
+  std::vector<const PixelType *>            m_BufferPointers;
+  std::vector<OffsetValueType>              m_BufferOffsets;
+
+  /** Values of one voxel, per thread */
+  std::vector<std::vector<RealType> >       m_ThreaderValues;
+};
+
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkStreamingMultipleImageReducer.hxx"
+#endif
+
+#endif
@@ -0,0 +1,394 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStreamingMultipleImageReducer.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkStreamingMultipleImageReducer_hxx
+#define _itkStreamingMultipleImageReducer_hxx
+
+#include "itkStreamingMultipleImageReducer.h"
+
+#include "itkImageRegionConstIterator.h"
+
+#include <algorithm>
+
+namespace itk {
+
+template<class TImage, class TMaskImage>
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::StreamingMultipleImageReducer()
+{
+  this->m_UseMask = false;
+  this->m_ReduceOutsideOfMask = false;
+  this->m_Reducer = NULL;
+  this->m_MaximumMemoryInMegabytes = 1024.0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->m_NumberOfSlabs = 0;
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::SetNumberOfThreads( int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( 1,
+    std::min( numberOfThreads, static_cast<int>( ITK_MAX_THREADS ) ) );
+  this->Modified();
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::SetMaskImage( const MaskImageType *mask )
+{
+  this->m_MaskOffsets.clear();
+  this->m_UseMask = false;
+
+  if( mask )
+    {
+    ImageRegionConstIterator<MaskImageType> It( mask,
+      mask->GetLargestPossibleRegion() );
+    OffsetValueType offset = 0;
+    for( It.GoToBegin(); !It.IsAtEnd(); ++It, ++offset )
+      {
+      if( It.Get() != NumericTraits<typename MaskImageType::PixelType>::Zero )
+        {
+        this->m_MaskOffsets.push_back( offset );
+        }
+      }
+    this->m_UseMask = true;
+    }
+  this->Modified();
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::SetMaskOffsets( const OffsetContainerType & offsets )
+{
+  this->m_MaskOffsets = offsets;
+  this->m_UseMask = true;
+  this->Modified();
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::Update()
+{
+  if( !this->m_Reducer )
+    {
+    itkExceptionMacro( "The reducer is not set." );
+    }
+  if( this->m_FileNames.empty() )
+    {
+    itkExceptionMacro( "No input files." );
+    }
+
+  const unsigned int numberOfImages = this->m_FileNames.size();
+
+  // Only the headers are read here.  The image IO found for each file
+  // is then fixed, so that the readers do not go through the (not thread
+  // safe) IO factory again when the slabs are read in parallel.
+  ReaderContainerType readers( numberOfImages );
+  for( unsigned int n = 0; n < numberOfImages; n++ )
+    {
+    readers[n] = ReaderType::New();
+    readers[n]->SetFileName( this->m_FileNames[n].c_str() );
+    readers[n]->UpdateOutputInformation();
+    readers[n]->SetImageIO( readers[n]->GetImageIO() );
+    readers[n]->UpdateOutputInformation();
+    if( readers[n]->GetOutput()->GetLargestPossibleRegion().GetSize() !=
+      readers[0]->GetOutput()->GetLargestPossibleRegion().GetSize() )
+      {
+      itkExceptionMacro( "The size of " << this->m_FileNames[n]
+        << " differs from the size of " << this->m_FileNames[0] );
+      }
+    }
+
+  const RegionType region = readers[0]->GetOutput()->GetLargestPossibleRegion();
+  const unsigned int last = ImageDimension - 1;
+  const unsigned long numberOfSlices = region.GetSize()[last];
+  const unsigned long sliceSize = region.GetNumberOfPixels() / numberOfSlices;
+
+  if( this->m_UseMask && !this->m_MaskOffsets.empty() &&
+    this->m_MaskOffsets.back() >=
+      static_cast<OffsetValueType>( region.GetNumberOfPixels() ) )
+    {
+    itkExceptionMacro( "The mask is larger than the input images." );
+    }
+
+  typename ImageType::Pointer reference = ImageType::New();
+  reference->CopyInformation( readers[0]->GetOutput() );
+  reference->SetRegions( region );
+
+  // A reducer that also handles the voxels outside of the mask visits
+  // every voxel, checking it against the mask offsets as it goes
+  this->m_ReduceOutsideOfMask = this->m_UseMask &&
+    this->m_Reducer->GetReducesVoxelsOutsideOfMask();
+  const bool reduceMaskOffsets = this->m_UseMask &&
+    !this->m_ReduceOutsideOfMask;
+
+  int numberOfThreads = this->m_NumberOfThreads;
+  const unsigned long numberOfVoxels = ( reduceMaskOffsets )
+    ? this->m_MaskOffsets.size() : region.GetNumberOfPixels();
+  if( static_cast<unsigned long>( numberOfThreads ) > numberOfVoxels )
+    {
+    numberOfThreads = std::max( 1, static_cast<int>( numberOfVoxels ) );
+    }
+
+  this->m_Reducer->Initialize( reference, numberOfImages, numberOfThreads );
+
+  // Thickest slab that fits in the memory budget
+  const double sliceMemory = static_cast<double>( numberOfImages ) *
+    sliceSize * sizeof( PixelType );
+  unsigned long slabThickness = static_cast<unsigned long>(
+    this->m_MaximumMemoryInMegabytes * 1024.0 * 1024.0 / sliceMemory );
+  slabThickness = std::max( 1ul, std::min( slabThickness, numberOfSlices ) );
+  this->m_NumberOfSlabs = ( numberOfSlices + slabThickness - 1 ) / slabThickness;
+
+  this->m_BufferPointers.resize( numberOfImages );
+  this->m_BufferOffsets.resize( numberOfImages );
+  this->m_ThreaderValues.assign( numberOfThreads,
+    std::vector<RealType>( numberOfImages ) );
+
+  // The files are read by as many threads as there are inputs, at most
+  const int numberOfReadingThreads = std::max( 1, std::min(
+    this->m_NumberOfThreads, static_cast<int>( numberOfImages ) ) );
+
+  for( unsigned long first = 0; first < numberOfSlices; first += slabThickness )
+    {
+    typename RegionType::IndexType slabIndex = region.GetIndex();
+    typename RegionType::SizeType slabSize = region.GetSize();
+    slabIndex[last] += first;
+    slabSize[last] = std::min( slabThickness, numberOfSlices - first );
+
+    ReadThreadStruct readStr;
+    readStr.Readers = &readers;
+    readStr.Slab.SetIndex( slabIndex );
+    readStr.Slab.SetSize( slabSize );
+    readStr.Errors.assign( numberOfImages, std::string() );
+
+    if( numberOfReadingThreads <= 1 )
+      {
+      this->ReadSlabs( &readStr, 0, 1 );
+      }
+    else
+      {
+      MultiThreader::Pointer threader = MultiThreader::New();
+      threader->SetNumberOfThreads( numberOfReadingThreads );
+      threader->SetSingleMethod( this->ReadThreaderCallback, &readStr );
+      threader->SingleMethodExecute();
+      }
+
+    const RegionType & slab = readStr.Slab;
+    for( unsigned int n = 0; n < numberOfImages; n++ )
+      {
+      if( !readStr.Errors[n].empty() )
+        {
+        itkExceptionMacro( "Could not read " << this->m_FileNames[n]
+          << ": " << readStr.Errors[n] );
+        }
+      ImageType *input = readers[n]->GetOutput();
+
+      // The buffer holds whole slices, possibly more than the slab
+      const RegionType & buffered = input->GetBufferedRegion();
+      if( !buffered.IsInside( slab ) )
+        {
+        itkExceptionMacro( "Could not read the requested slab of "
+          << this->m_FileNames[n] );
+        }
+      this->m_BufferPointers[n] = input->GetBufferPointer();
+      this->m_BufferOffsets[n] = ( buffered.GetIndex()[last] -
+        region.GetIndex()[last] ) * sliceSize;
+      }
+
+    const OffsetValueType slabBegin = first * sliceSize;
+    const OffsetValueType slabEnd = slabBegin +
+      slab.GetSize()[last] * sliceSize;
+
+    ReduceThreadStruct str;
+    str.Reducer = this;
+    if( reduceMaskOffsets )
+      {
+      str.Begin = std::lower_bound( this->m_MaskOffsets.begin(),
+        this->m_MaskOffsets.end(), slabBegin ) - this->m_MaskOffsets.begin();
+      str.End = std::lower_bound( this->m_MaskOffsets.begin(),
+        this->m_MaskOffsets.end(), slabEnd ) - this->m_MaskOffsets.begin();
+      }
+    else
+      {
+      str.Begin = slabBegin;
+      str.End = slabEnd;
+      }
+
+    if( numberOfThreads <= 1 )
+      {
+      this->ReduceRange( 0, str.Begin, str.End );
+      }
+    else
+      {
+      MultiThreader::Pointer threader = MultiThreader::New();
+      threader->SetNumberOfThreads( numberOfThreads );
+      threader->SetSingleMethod( this->ReduceThreaderCallback, &str );
+      threader->SingleMethodExecute();
+      }
+
+    this->m_Reducer->AfterSlab();
+    }
+
+  this->m_Reducer->Finalize();
+
+  this->m_BufferPointers.clear();
+  this->m_BufferOffsets.clear();
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::ReadSlabs( ReadThreadStruct *str, int threadId, int threadCount )
+{
+  ReaderContainerType & readers = *( str->Readers );
+  for( unsigned int n = threadId; n < readers.size(); n += threadCount )
+    {
+    // Exceptions cannot leave the threads: they are reported per input
+    // and rethrown by Update()
+    try
+      {
+      readers[n]->GetOutput()->SetRequestedRegion( str->Slab );
+      readers[n]->Update();
+      }
+    catch( ExceptionObject & e )
+      {
+      str->Errors[n] = e.GetDescription();
+      }
+    catch( ... )
+      {
+      str->Errors[n] = "unknown error";
+      }
+    }
+}
+
+template<class TImage, class TMaskImage>
+ITK_THREAD_RETURN_TYPE
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::ReadThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ReadThreadStruct *str = (ReadThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  Self::ReadSlabs( str, threadId, threadCount );
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TImage, class TMaskImage>
+ITK_THREAD_RETURN_TYPE
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::ReduceThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ReduceThreadStruct *str = (ReduceThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const unsigned long numberOfVoxels = str->End - str->Begin;
+  const unsigned long begin = str->Begin +
+    ( numberOfVoxels * threadId ) / threadCount;
+  const unsigned long end = str->Begin +
+    ( numberOfVoxels * ( threadId + 1 ) ) / threadCount;
+
+  if( begin < end )
+    {
+    str->Reducer->ReduceRange( threadId, begin, end );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::ReduceRange( unsigned int threadId, unsigned long begin, unsigned long end )
+{
+  const unsigned int numberOfImages = this->m_BufferPointers.size();
+  const PixelType * const * buffers = &( this->m_BufferPointers[0] );
+  const OffsetValueType *bufferOffsets = &( this->m_BufferOffsets[0] );
+  RealType *values = &( this->m_ThreaderValues[threadId][0] );
+  ReducerType *reducer = this->m_Reducer.GetPointer();
+
+  if( this->m_ReduceOutsideOfMask )
+    {
+    // [begin, end) are voxel offsets; the next mask offset tells whether
+    // the current voxel is inside of the mask
+    typename OffsetContainerType::const_iterator next = std::lower_bound(
+      this->m_MaskOffsets.begin(), this->m_MaskOffsets.end(),
+      static_cast<OffsetValueType>( begin ) );
+    for( unsigned long p = begin; p < end; p++ )
+      {
+      const OffsetValueType offset = static_cast<OffsetValueType>( p );
+      for( unsigned int n = 0; n < numberOfImages; n++ )
+        {
+        values[n] = static_cast<RealType>(
+          buffers[n][offset - bufferOffsets[n]] );
+        }
+      if( next != this->m_MaskOffsets.end() && *next == offset )
+        {
+        reducer->ReduceVoxel( threadId, offset, values );
+        ++next;
+        }
+      else
+        {
+        reducer->ReduceVoxelOutsideOfMask( threadId, offset, values );
+        }
+      }
+    return;
+    }
+
+  for( unsigned long p = begin; p < end; p++ )
+    {
+    const OffsetValueType offset = ( this->m_UseMask )
+      ? this->m_MaskOffsets[p] : static_cast<OffsetValueType>( p );
+    for( unsigned int n = 0; n < numberOfImages; n++ )
+      {
+      values[n] = static_cast<RealType>(
+        buffers[n][offset - bufferOffsets[n]] );
+      }
+    reducer->ReduceVoxel( threadId, offset, values );
+    }
+}
+
+template<class TImage, class TMaskImage>
+void
+StreamingMultipleImageReducer<TImage, TMaskImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Number of files: " << this->m_FileNames.size() << std::endl;
+  os << indent << "Use mask: " << this->m_UseMask << std::endl;
+  os << indent << "Number of mask offsets: "
+     << this->m_MaskOffsets.size() << std::endl;
+  os << indent << "Maximum memory (MB): "
+     << this->m_MaximumMemoryInMegabytes << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "Number of slabs: " << this->m_NumberOfSlabs << std::endl;
+}
+
+} // end of namespace itk
+
+#endif
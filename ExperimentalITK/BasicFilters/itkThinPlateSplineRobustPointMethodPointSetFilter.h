@@ -20,11 +20,15 @@
 #include "itkPointSetToImageFilter.h"
 
 #include "itkPointSet.h"
+#include "itkRobustPointMatchingCorrespondenceMatrix.h"
 #include "itkKernelTransform.h"
+#include "itkMultiThreader.h"
 #include "itkVariableLengthVector.h"
 #include "itkVariableSizeMatrix.h"
 #include "itkVector.h"
 
+#include <vector>
+
 namespace itk
 {
 
@@ -58,10 +62,16 @@ public:
   typedef TOutputImage                                        VectorFieldType;
   typedef typename VectorFieldType::PixelType                 VectorType;
   typedef typename VectorType::ValueType                      RealType;
+  typedef typename OutputImageType::IndexType                 IndexType;
+  typedef typename OutputImageType::SizeType                  SizeType;
 
   /** Other typedef */
   typedef VariableSizeMatrix<RealType>                        MatrixType;
   typedef VariableLengthVector<RealType>                      OutlierVectorType;
+  typedef RobustPointMatchingCorrespondenceMatrix<RealType,
+    itkGetStaticConstMacro( Dimension )>                      CorrespondenceMatrixType;
+  typedef typename CorrespondenceMatrixType::PointContainerType
+                                                              PointContainerType;
 
   /** thin-plate spline typedefs */
   typedef KernelTransform<RealType,                      
@@ -90,6 +100,30 @@ public:
   itkSetMacro( SolveSimplerLeastSquaresProblem, bool );
   itkGetConstMacro( SolveSimplerLeastSquaresProblem, bool );
 
+  /**
+   * Correspondences below exp( -TruncationExponent ) times their peak
+   * value are dropped, which keeps the correspondence matrix sparse once
+   * the temperature falls (default = 20).
+   */
+  itkSetClampMacro( TruncationExponent, RealType, 0, NumericTraits<RealType>::max() );
+  itkGetConstMacro( TruncationExponent, RealType );
+
+  /**
+   * Tolerance, in physical units, on the output displacements interpolated
+   * from a coarse grid.  The cells of the grid are halved until the
+   * displacements interpolated at their center, face centers and edge
+   * midpoints are within the tolerance of the thin-plate spline.  This is
+   * a sampled check, not a strict bound on the error at every voxel.  A
+   * tolerance of zero (default) evaluates the thin-plate spline at every
+   * voxel.
+   */
+  itkSetClampMacro( FieldApproximationTolerance, RealType, 0, NumericTraits<RealType>::max() );
+  itkGetConstMacro( FieldApproximationTolerance, RealType );
+
+  /** Size, in voxels, of the cells of the coarse grid (default = 8). */
+  itkSetClampMacro( FieldApproximationCellSize, unsigned int, 1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( FieldApproximationCellSize, unsigned int );
+
   itkBooleanMacro( UseBoundingBox );
   itkSetMacro( UseBoundingBox, bool );
   itkGetConstMacro( UseBoundingBox, bool );
@@ -108,6 +142,46 @@ private:
   void CalculateInitialAndFinalTemperatures();
   void UpdateCorrespondenceMatrix();
   void UpdateTransformation();
+  void GetCorrespondencePoints( const InputPointSetType *, PointContainerType & ) const;
+
+  /** Displacements of a cell of the coarse grid, relative to its index. */
+  struct FieldCellType
+    {
+    IndexType                                                Index;
+    SizeType                                                 Size;
+    std::vector<VectorType>                                  Values;
+    std::vector<unsigned char>                               States;
+    };
+
+  struct ThreadStruct
+    {
+    Self                                                    *Filter;
+    const TransformType                                     *Transform;
+    OutputImageType                                         *Output;
+    SizeType                                                 NumberOfCells;
+    };
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback( void *arg );
+
+  /** Fills the voxels of the output owned by a cell of the coarse grid. */
+  void ThreadedGenerateFieldCell( ThreadStruct *, unsigned long, FieldCellType & );
+
+  /** Interpolates or subdivides the box [minimum, maximum] of a cell. */
+  void RefineFieldCell( ThreadStruct *, FieldCellType &, const IndexType &,
+    const IndexType & );
+
+  /** Evaluates the thin-plate spline at a voxel of a cell if needed. */
+  void EvaluateFieldCell( ThreadStruct *, FieldCellType &, const IndexType & );
+
+  /** Multilinear interpolation of the corners of a box of a cell. */
+  VectorType InterpolateFieldCell( const FieldCellType &, const IndexType &,
+    const IndexType &, const IndexType & ) const;
+
+  unsigned long GetFieldCellOffset( const FieldCellType &, const IndexType & ) const;
+
+  VectorType EvaluateDisplacement( const TransformType *, const OutputImageType *,
+    const IndexType & ) const;
  
   void VisualizeCurrentState();
 
@@ -117,7 +191,7 @@ private:
 
   typename InputPointSetType::Pointer                        m_VPoints;
 
-  MatrixType                                                 m_CorrespondenceMatrix;
+  typename CorrespondenceMatrixType::Pointer                 m_CorrespondenceMatrix;
   OutlierVectorType                                          m_OutlierRow;
   OutlierVectorType                                          m_OutlierColumn;
   typename InputPointSetType::PointType                      m_OutlierPointX;
@@ -132,6 +206,9 @@ private:
   unsigned int                                               m_NumberOfIterationsPerTemperature;
   bool                                                       m_SolveSimplerLeastSquaresProblem;
   bool                                                       m_UseBoundingBox;
+  RealType                                                   m_TruncationExponent;
+  RealType                                                   m_FieldApproximationTolerance;
+  unsigned int                                               m_FieldApproximationCellSize;
     
 };
 
@@ -3,7 +3,6 @@
 
 #include "itkThinPlateSplineRobustPointMethodPointSetFilter.h"
 
-#include "itkImageRegionIteratorWithIndex.h"
 #include "itkThinPlateSplineKernelTransform.h"
 #include "itkThinPlateR2LogRSplineKernelTransform.h"
 
@@ -31,8 +30,13 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
   this->m_Spacing.Fill( 1 );
 
   this->m_UseBoundingBox = true;
+  this->m_TruncationExponent = 20.0;
+  this->m_FieldApproximationTolerance = 0.0;
+  this->m_FieldApproximationCellSize = 8;
 
   this->m_SolveSimplerLeastSquaresProblem = true;
+
+  this->m_CorrespondenceMatrix = NULL;
 }
 
 template <class TPointSet, class TOutputImage>
@@ -87,6 +91,14 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
    * Generate output
    */   
 
+  // If the annealing never ran (initial temperature below the final one)
+  // the correspondences have not been computed yet
+  if ( this->m_CorrespondenceMatrix->GetNumberOfRows() != 
+       this->m_VPoints->GetNumberOfPoints() )
+    {
+    this->UpdateCorrespondenceMatrix();
+    }
+
   typename PointSetType::Pointer targetLandmarks = PointSetType::New();
   targetLandmarks->Initialize();
   typename PointSetType::Pointer sourceLandmarks = PointSetType::New();
@@ -102,13 +114,15 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
       { 
       typename PointSetType::PointType Y;
       Y.Fill( 0 );
-      for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ ) 
+      for ( unsigned long k = this->m_CorrespondenceMatrix->GetRowBegin( i ); 
+            k < this->m_CorrespondenceMatrix->GetRowEnd( i ); k++ ) 
         {
-        RealType m = this->m_CorrespondenceMatrix( i, j );
+        RealType m = this->m_CorrespondenceMatrix->GetValue( k );
         if ( m > 0 )
           {  
-          typename InputPointSetType::PointType X;
-          this->GetInput( 0 )->GetPoint( j, &X );
+          const typename CorrespondenceMatrixType::PointType & X 
+            = this->m_CorrespondenceMatrix->GetFixedPoint( 
+              this->m_CorrespondenceMatrix->GetColumn( k ) );
           for ( unsigned int d = 0; d < Dimension; d++ )
             {
             Y[d] += ( X[d] * m ); 
@@ -146,31 +160,393 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
   output->SetOrigin( this->m_Origin );
   output->Allocate();
 
-  ImageRegionIteratorWithIndex<OutputImageType> It( output,
-    output->GetLargestPossibleRegion() );
-  for ( It.GoToBegin(); !It.IsAtEnd(); ++It )
+  /**
+   * The output is tiled by the cells of a coarse grid which are filled in
+   * parallel, each voxel being owned by a single cell.
+   */
+  ThreadStruct str;
+  str.Filter = this;
+  str.Transform = tps.GetPointer();
+  str.Output = output.GetPointer();
+
+  const SizeType size = output->GetLargestPossibleRegion().GetSize();
+  for ( unsigned int d = 0; d < Dimension; d++ )
     {
-    typename OutputImageType::PointType point;
-    output->TransformIndexToPhysicalPoint( It.GetIndex(), point );
-    
-    typename PointSetType::PointType X;
+    str.NumberOfCells[d] = vnl_math_max( static_cast<unsigned long>( 1 ), 
+      ( size[d] + this->m_FieldApproximationCellSize - 2 ) 
+      / this->m_FieldApproximationCellSize );
+    }
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->ThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  this->GraftOutput( output );
+}      
+         
+template <class TPointSet, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::ThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ThreadStruct *str = (ThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  unsigned long numberOfCells = 1;
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    numberOfCells *= str->NumberOfCells[d];
+    }
+
+  /**
+   * Interleave the cells since the refinement concentrates near the
+   * landmarks.  The cell buffers are reused by all the cells of a thread.
+   */ 
+  FieldCellType cell;
+  for ( unsigned long c = threadId; c < numberOfCells; c += threadCount )
+    {
+    str->Filter->ThreadedGenerateFieldCell( str, c, cell );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TPointSet, class TOutputImage>
+void
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::ThreadedGenerateFieldCell( ThreadStruct *str, unsigned long c, 
+  FieldCellType &cell )
+{
+  const SizeType size = str->Output->GetLargestPossibleRegion().GetSize();
+  const unsigned long cellSize = this->m_FieldApproximationCellSize;
+
+  /**
+   * The cell spans [Index, Index + Size - 1] and owns its voxels but those
+   * of its upper faces, unless they lie on the boundary of the output.
+   */
+  IndexType ownedMaximum;
+  unsigned long numberOfVoxels = 1;
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    const unsigned long position = c % str->NumberOfCells[d];
+    c /= str->NumberOfCells[d];
+
+    cell.Index[d] = position * cellSize;
+    cell.Size[d] = vnl_math_min( cellSize, size[d] - 1 - cell.Index[d] ) + 1;
+    ownedMaximum[d] = cell.Index[d] + cell.Size[d] - 1;
+    if ( position + 1 < str->NumberOfCells[d] )
+      {
+      ownedMaximum[d]--;
+      }
+    numberOfVoxels *= cell.Size[d];
+    }
+
+  IndexType index = cell.Index;
+
+  if ( this->m_FieldApproximationTolerance <= 0.0 )
+    {
+    /**
+     * Exact fallback:  evaluate the thin-plate spline at every owned voxel.
+     */
+    while ( true )
+      {
+      str->Output->SetPixel( index, 
+        this->EvaluateDisplacement( str->Transform, str->Output, index ) );
+
+      unsigned int d = 0;
+      for ( ; d < Dimension; d++ )
+        {
+        if ( ++index[d] <= ownedMaximum[d] )
+          {
+          break;
+          }
+        index[d] = cell.Index[d];
+        }
+      if ( d == Dimension )
+        {
+        break;
+        }
+      }
+    return;
+    }
+
+  cell.Values.resize( numberOfVoxels );
+  cell.States.assign( numberOfVoxels, 0 );
+
+  IndexType maximum;
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    maximum[d] = cell.Index[d] + cell.Size[d] - 1;
+    }
+  for ( unsigned int n = 0; n < ( 1u << Dimension ); n++ )
+    {
+    IndexType corner;
     for ( unsigned int d = 0; d < Dimension; d++ )
       {
-      X[d] = point[d];
-      } 
-    typename PointSetType::PointType Y = tps->TransformPoint( X );
-    
-    typename OutputImageType::PixelType V;
+      corner[d] = ( n & ( 1 << d ) ) ? maximum[d] : cell.Index[d];
+      }
+    this->EvaluateFieldCell( str, cell, corner );
+    }
+  this->RefineFieldCell( str, cell, cell.Index, maximum );
+
+  while ( true )
+    {
+    str->Output->SetPixel( index, 
+      cell.Values[this->GetFieldCellOffset( cell, index )] );
+
+    unsigned int d = 0;
+    for ( ; d < Dimension; d++ )
+      {
+      if ( ++index[d] <= ownedMaximum[d] )
+        {
+        break;
+        }
+      index[d] = cell.Index[d];
+      }
+    if ( d == Dimension )
+      {
+      break;
+      }
+    }
+}
+
+template <class TPointSet, class TOutputImage>
+void
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::RefineFieldCell( ThreadStruct *str, FieldCellType &cell, 
+  const IndexType &minimum, const IndexType &maximum )
+{
+  /**
+   * The corners of the box are exact.  Compare the multilinear
+   * interpolation of the corners with the thin-plate spline at the
+   * center, the face centers and the edge midpoints of the box.  These
+   * are the corners of the halves, so they are needed anyway if the box
+   * is subdivided.
+   */
+  bool isSubdivisible = false;
+  IndexType center;
+  unsigned int numberOfSamples = 1;
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    center[d] = minimum[d] + ( maximum[d] - minimum[d] ) / 2;
+    if ( maximum[d] - minimum[d] > 1 )
+      {
+      isSubdivisible = true;
+      }
+    numberOfSamples *= 3;
+    }
+  if ( !isSubdivisible )
+    {
+    return;
+    }
+
+  const RealType squaredTolerance = 
+    vnl_math_sqr( this->m_FieldApproximationTolerance );
+  bool isWithinTolerance = true;
+  for ( unsigned int n = 0; n < numberOfSamples && isWithinTolerance; n++ )
+    {
+    IndexType sample;
+    bool isCorner = true;
+    bool isDuplicate = false;
+    unsigned int digits = n;
     for ( unsigned int d = 0; d < Dimension; d++ )
       {
-      V[d] = Y[d] - X[d]; 
+      switch ( digits % 3 )
+        {
+        case 0:
+          sample[d] = minimum[d];
+          break;
+        case 1:
+          sample[d] = center[d];
+          isCorner = false;
+          if ( maximum[d] - minimum[d] <= 1 )
+            {
+            isDuplicate = true;
+            }
+          break;
+        default:
+          sample[d] = maximum[d];
+          break;
+        }
+      digits /= 3;
+      }
+    if ( isCorner || isDuplicate )
+      {
+      continue;
       }
-    It.Set( V ); 
-    }  
 
-  this->GraftOutput( output );
-}      
-         
+    this->EvaluateFieldCell( str, cell, sample );
+
+    const unsigned long k = this->GetFieldCellOffset( cell, sample );
+    if ( ( this->InterpolateFieldCell( cell, minimum, maximum, sample ) 
+      - cell.Values[k] ).GetSquaredNorm() > squaredTolerance )
+      {
+      isWithinTolerance = false;
+      }
+    }
+
+  if ( isWithinTolerance )
+    {
+    IndexType index = minimum;
+    while ( true )
+      {
+      const unsigned long j = this->GetFieldCellOffset( cell, index );
+      if ( cell.States[j] == 0 )
+        {
+        cell.Values[j] = this->InterpolateFieldCell( cell, minimum, maximum, index );
+        cell.States[j] = 1;
+        }
+
+      unsigned int d = 0;
+      for ( ; d < Dimension; d++ )
+        {
+        if ( ++index[d] <= maximum[d] )
+          {
+          break;
+          }
+        index[d] = minimum[d];
+        }
+      if ( d == Dimension )
+        {
+        return;
+        }
+      }
+    }
+
+  /**
+   * Halve the box along the dimensions which have interior voxels.
+   */
+  const unsigned int numberOfCorners = 1 << Dimension;
+  for ( unsigned int n = 0; n < numberOfCorners; n++ )
+    {
+    IndexType childMinimum;
+    IndexType childMaximum;
+    bool isChild = true;
+    for ( unsigned int d = 0; d < Dimension; d++ )
+      {
+      if ( maximum[d] - minimum[d] > 1 )
+        {
+        childMinimum[d] = ( n & ( 1 << d ) ) ? center[d] : minimum[d];
+        childMaximum[d] = ( n & ( 1 << d ) ) ? maximum[d] : center[d];
+        }
+      else
+        {
+        if ( n & ( 1 << d ) )
+          {
+          isChild = false;
+          }
+        childMinimum[d] = minimum[d];
+        childMaximum[d] = maximum[d];
+        }
+      }
+    if ( !isChild )
+      {
+      continue;
+      }
+    for ( unsigned int m = 0; m < numberOfCorners; m++ )
+      {
+      IndexType corner;
+      for ( unsigned int d = 0; d < Dimension; d++ )
+        {
+        corner[d] = ( m & ( 1 << d ) ) ? childMaximum[d] : childMinimum[d];
+        }
+      this->EvaluateFieldCell( str, cell, corner );
+      }
+    this->RefineFieldCell( str, cell, childMinimum, childMaximum );
+    }
+}
+
+template <class TPointSet, class TOutputImage>
+void
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::EvaluateFieldCell( ThreadStruct *str, FieldCellType &cell, 
+  const IndexType &index )
+{
+  const unsigned long k = this->GetFieldCellOffset( cell, index );
+  if ( cell.States[k] != 2 )
+    {
+    cell.Values[k] = this->EvaluateDisplacement( str->Transform, str->Output, index );
+    cell.States[k] = 2;
+    }
+}
+
+template <class TPointSet, class TOutputImage>
+typename ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::VectorType
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::InterpolateFieldCell( const FieldCellType &cell, const IndexType &minimum, 
+  const IndexType &maximum, const IndexType &index ) const
+{
+  RealType t[Dimension];
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    t[d] = ( maximum[d] > minimum[d] ) 
+      ? static_cast<RealType>( index[d] - minimum[d] ) 
+        / static_cast<RealType>( maximum[d] - minimum[d] ) : 0.0;
+    }
+
+  VectorType value;
+  value.Fill( 0.0 );
+  for ( unsigned int n = 0; n < ( 1u << Dimension ); n++ )
+    {
+    IndexType corner;
+    RealType weight = 1.0;
+    for ( unsigned int d = 0; d < Dimension; d++ )
+      {
+      corner[d] = ( n & ( 1 << d ) ) ? maximum[d] : minimum[d];
+      weight *= ( n & ( 1 << d ) ) ? t[d] : 1.0 - t[d];
+      }
+    if ( weight != 0.0 )
+      {
+      value += cell.Values[this->GetFieldCellOffset( cell, corner )] * weight;
+      }
+    }
+  return value;
+}
+
+template <class TPointSet, class TOutputImage>
+unsigned long
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::GetFieldCellOffset( const FieldCellType &cell, const IndexType &index ) const
+{
+  unsigned long k = 0;
+  unsigned long stride = 1;
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    k += ( index[d] - cell.Index[d] ) * stride;
+    stride *= cell.Size[d];
+    }
+  return k;
+}
+
+template <class TPointSet, class TOutputImage>
+typename ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::VectorType
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::EvaluateDisplacement( const TransformType *tps, const OutputImageType *output,
+  const IndexType &index ) const
+{
+  typename OutputImageType::PointType point;
+  output->TransformIndexToPhysicalPoint( index, point );
+  
+  typename PointSetType::PointType X;
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    X[d] = point[d];
+    } 
+  typename PointSetType::PointType Y = tps->TransformPoint( X );
+  
+  VectorType V;
+  for ( unsigned int d = 0; d < Dimension; d++ )
+    {
+    V[d] = Y[d] - X[d]; 
+    }
+  return V;
+}
+
 template <class TPointSet, class TOutputImage>
 void
 ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
@@ -223,7 +599,14 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
   RealType K = static_cast<RealType>( this->GetInput( 1 )->GetNumberOfPoints() );
   RealType N = static_cast<RealType>( this->GetInput( 0 )->GetNumberOfPoints() );
 
-  this->m_CorrespondenceMatrix.SetSize( K, N );
+  PointContainerType fixedPoints;
+  this->GetCorrespondencePoints( this->GetInput( 0 ), fixedPoints );
+
+  this->m_CorrespondenceMatrix = CorrespondenceMatrixType::New();
+  this->m_CorrespondenceMatrix->SetTruncationExponent( this->m_TruncationExponent );
+  this->m_CorrespondenceMatrix->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->m_CorrespondenceMatrix->SetFixedPoints( fixedPoints );
+
   this->m_OutlierColumn.SetSize( K );
   this->m_OutlierRow.SetSize( N );
 
@@ -285,20 +668,15 @@ void
 ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
 ::UpdateCorrespondenceMatrix()
 {
-  for ( unsigned int i = 0; i < this->m_VPoints->GetNumberOfPoints(); i++ )
-    {
-    typename InputPointSetType::PointType V;
-    this->m_VPoints->GetPoint( i, &V );    
+  /**
+   * m_ij = exp( -|X_j - V_i|^2 / T ), restricted to the fixed points near
+   * V_i once the temperature is low enough.
+   */
+  PointContainerType movingPoints;
+  this->GetCorrespondencePoints( this->m_VPoints, movingPoints );
 
-    for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ )
-      {
-      typename InputPointSetType::PointType X;      
-      this->GetInput( 0 )->GetPoint( j, &X );      
- 
-      this->m_CorrespondenceMatrix( i, j )  
-        = vcl_exp( -( X - V ).GetSquaredNorm() / this->m_CurrentTemperature );
-      }  
-    } 
+  this->m_CorrespondenceMatrix->Update( movingPoints,
+    this->m_CurrentTemperature, 1.0, 1.0 );
 
   RealType K = static_cast<RealType>( this->GetInput( 1 )->GetNumberOfPoints() );
   if ( this->m_CurrentTemperature == this->m_InitialTemperature )
@@ -317,69 +695,11 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
    */
  
   RealType epsilon = 0.05;
-  RealType deviation = NumericTraits<RealType>::max(); 
-
-  OutlierVectorType rowSum;
-  OutlierVectorType columnSum;
 
   unsigned int maximumNumberOfIterations = 10;
-  unsigned int iterations = 0;
-
-  while ( deviation > epsilon*epsilon && iterations++ < maximumNumberOfIterations )
-    {
-    /**
-     * do column normalization
-     */
-    columnSum = this->m_OutlierRow;
-
-    for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-      {
-      for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-        {
-        columnSum[j] += this->m_CorrespondenceMatrix( i, j );
-        }
-      } 
-    for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-      {
-      for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-        {
-        this->m_CorrespondenceMatrix( i, j ) /= columnSum[j];
-        }
-      this->m_OutlierRow[j] /= columnSum[j];
-      } 
-
-    /**
-     * do row normalization
-     */
-    rowSum = this->m_OutlierColumn;
-
-    for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-      {
-      for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-        {
-        rowSum[i] += this->m_CorrespondenceMatrix( i, j );
-        }
-      } 
-    for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
-      {
-      for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
-        {
-        this->m_CorrespondenceMatrix( i, j ) /= rowSum[i];
-        }
-      this->m_OutlierColumn[i] /= rowSum[i];
-      } 
-    
-
-    /**
-     * Calculate current deviation from 1
-     */
-    rowSum -= 1.0;
-    columnSum -= 1.0;
-
-    deviation = ( rowSum.GetSquaredNorm() + columnSum.GetSquaredNorm() )
-      / ( static_cast<RealType>( rowSum.GetSize() + columnSum.GetSize() ) );
-    } 
 
+  this->m_CorrespondenceMatrix->Normalize( this->m_OutlierRow,
+    this->m_OutlierColumn, epsilon*epsilon, maximumNumberOfIterations, false );
 }
 
 template <class TPointSet, class TOutputImage>
@@ -402,13 +722,15 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
       { 
       typename PointSetType::PointType Y;
       Y.Fill( 0 );
-      for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ ) 
+      for ( unsigned long k = this->m_CorrespondenceMatrix->GetRowBegin( i ); 
+            k < this->m_CorrespondenceMatrix->GetRowEnd( i ); k++ ) 
         {
-        RealType m = this->m_CorrespondenceMatrix( i, j );
+        RealType m = this->m_CorrespondenceMatrix->GetValue( k );
         if ( m > 0 )
           {  
-          typename InputPointSetType::PointType X;
-          this->GetInput( 0 )->GetPoint( j, &X );
+          const typename CorrespondenceMatrixType::PointType & X 
+            = this->m_CorrespondenceMatrix->GetFixedPoint( 
+              this->m_CorrespondenceMatrix->GetColumn( k ) );
           for ( unsigned int d = 0; d < Dimension; d++ )
             {
             Y[d] += ( X[d] * m ); 
@@ -463,6 +785,24 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
     }      
 }
 
+template <class TPointSet, class TOutputImage>
+void
+ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
+::GetCorrespondencePoints( const InputPointSetType *pointSet, 
+  PointContainerType &points ) const
+{
+  points.resize( pointSet->GetNumberOfPoints() );
+  for ( unsigned int i = 0; i < pointSet->GetNumberOfPoints(); i++ )
+    {
+    typename InputPointSetType::PointType point;
+    pointSet->GetPoint( i, &point );
+    for ( unsigned int d = 0; d < Dimension; d++ )
+      {
+      points[i][d] = point[d];
+      }
+    }
+}
+
 template <class TPointSet, class TOutputImage>
 void
 ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
@@ -511,12 +851,14 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
     {
     typename InputPointSetType::PointType V;
     this->m_VPoints->GetPoint( i, &V );
-    for ( unsigned int j = 0; j < this->GetInput( 0 )->GetNumberOfPoints(); j++ )
+    for ( unsigned long k = this->m_CorrespondenceMatrix->GetRowBegin( i ); 
+          k < this->m_CorrespondenceMatrix->GetRowEnd( i ); k++ )
       {
-      if ( this->m_CorrespondenceMatrix( i, j ) > 1.0 / static_cast<RealType>( K ) )
+      if ( this->m_CorrespondenceMatrix->GetValue( k ) > 1.0 / static_cast<RealType>( K ) )
         {
         typename InputPointSetType::PointType X;
-        this->GetInput( 0 )->GetPoint( j, &X );
+        this->GetInput( 0 )->GetPoint( 
+          this->m_CorrespondenceMatrix->GetColumn( k ), &X );
         str3 << X[0] << " " << X[1] << " 0 " << i+1 << std::endl;      
         str3 << V[0] << " " << V[1] << " 0 " << i+1 << std::endl;   
         } 
@@ -528,11 +870,11 @@ ThinPlateSplineRobustPointMethodPointSetFilter<TPointSet, TOutputImage>
 
   std::ofstream str4( "CorrespondenceMatrix.txt" );
 
-  for ( unsigned int i = 0; i < this->m_CorrespondenceMatrix.Rows(); i++ )
+  for ( unsigned long i = 0; i < this->m_CorrespondenceMatrix->GetNumberOfRows(); i++ )
     {
-    for ( unsigned int j = 0; j < this->m_CorrespondenceMatrix.Cols(); j++ )
+    for ( unsigned long j = 0; j < this->m_CorrespondenceMatrix->GetNumberOfColumns(); j++ )
       {
-      str4 << this->m_CorrespondenceMatrix( i, j ) << " ";
+      str4 << this->m_CorrespondenceMatrix->GetEntry( i, j ) << " ";
       } 
     str4 << std::endl;   
     } 
@@ -0,0 +1,288 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkVoxelwiseModelFitter.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkVoxelwiseModelFitter_h
+#define __itkVoxelwiseModelFitter_h
+
+#include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include "vnl/vnl_math.h"
+
+#include <vector>
+
+namespace itk {
+
+/** \class InversionRecoveryModel
+ * \brief S(t) = A - B exp( -t / T1 ), with parameters ( A, B, T1 ).
+ *
+ * The models of the VoxelwiseModelFitter provide the number of
+ * parameters, the model value and its analytic derivatives with respect
+ * to the parameters at one sample position, a starting point computed
+ * from the samples of a voxel, a default starting point used when that
+ * one is not valid, and the valid parameter domain.
+ */
+class InversionRecoveryModel
+{
+public:
+  typedef double                                    RealType;
+
+  enum { NumberOfParameters = 3 };
+
+  RealType Evaluate( const RealType *p, RealType t,
+    RealType *derivatives ) const
+    {
+    const RealType e = vcl_exp( -t / p[2] );
+    derivatives[0] = 1.0;
+    derivatives[1] = -e;
+    derivatives[2] = -p[1] * e * t / vnl_math_sqr( p[2] );
+    return p[0] - p[1] * e;
+    }
+
+  /** A is the sample at the longest time, B = 2A and T1 puts the zero
+   * crossing at the sample of smallest magnitude. */
+  void InitializeParameters( const RealType *t, const RealType *s,
+    unsigned int numberOfSamples, RealType *p ) const
+    {
+    unsigned int maximumN = 0;
+    unsigned int minimumN = 0;
+    for( unsigned int n = 1; n < numberOfSamples; n++ )
+      {
+      if( t[n] > t[maximumN] )
+        {
+        maximumN = n;
+        }
+      if( vnl_math_abs( s[n] ) < vnl_math_abs( s[minimumN] ) )
+        {
+        minimumN = n;
+        }
+      }
+    p[0] = s[maximumN];
+    p[1] = 2.0 * p[0];
+    p[2] = t[minimumN] / vnl_math::ln2;
+    }
+
+  /** A and B as above and T1 a third of the longest time, i.e. the
+   * longest time is taken as nearly full recovery. */
+  void InitializeDefaultParameters( const RealType *t, const RealType *s,
+    unsigned int numberOfSamples, RealType *p ) const
+    {
+    unsigned int maximumN = 0;
+    for( unsigned int n = 1; n < numberOfSamples; n++ )
+      {
+      if( t[n] > t[maximumN] )
+        {
+        maximumN = n;
+        }
+      }
+    p[0] = s[maximumN];
+    p[1] = 2.0 * p[0];
+    p[2] = ( t[maximumN] > 0.0 ) ? t[maximumN] / 3.0 : 1.0;
+    }
+
+  bool IsValid( const RealType *p ) const
+    {
+    return ( p[2] > 0.0 );
+    }
+};
+
+/** \class VoxelwiseModelFitter
+ * \brief Fits a parametric model to the samples of every voxel of a
+ * list of images.
+ *
+ * Each input image holds the samples at one position (e.g. an inversion
+ * time or a b-value).  The voxels are fitted in parallel, in batches of
+ * consecutive voxels: the samples of a batch are first packed
+ * contiguously, then every voxel is fitted with Levenberg-Marquardt on
+ * the analytic derivatives of the model.  The least absolute deviations
+ * cost is minimized by iteratively reweighted least squares.
+ *
+ * Each voxel starts from the model's starting point, or from its default
+ * starting point if the former is not valid.  With
+ * UseNeighborInitialization on, a voxel instead starts from the fit of
+ * the previous voxel whenever that has a lower cost.  The previous voxel
+ * is the one before it in raster order within its batch, i.e. usually
+ * its neighbor along the first image axis, not a spatial neighborhood;
+ * with a mask it is the previous voxel inside the mask, which may lie on
+ * another line.  The batches do not depend on the number of threads, so
+ * neither do the results.
+ *
+ * With a mask, only the voxels where it is nonzero are fitted and the
+ * others are left at zero in the parameter images.  All the inputs must
+ * have the same size as the first one.
+ */
+template<class TModel, class TImage, class TMaskImage =
+  Image<unsigned char, TImage::ImageDimension> >
+class VoxelwiseModelFitter : public Object
+{
+public:
+  typedef VoxelwiseModelFitter                      Self;
+  typedef Object                                    Superclass;
+  typedef SmartPointer<Self>                        Pointer;
+  typedef SmartPointer<const Self>                  ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( VoxelwiseModelFitter, Object );
+
+  itkStaticConstMacro( ImageDimension, unsigned int,
+    TImage::ImageDimension );
+  itkStaticConstMacro( NumberOfParameters, unsigned int,
+    TModel::NumberOfParameters );
+
+  typedef TModel                                    ModelType;
+  typedef typename ModelType::RealType              RealType;
+
+  typedef TImage                                    ImageType;
+  typedef typename ImageType::PixelType             PixelType;
+  typedef typename ImageType::OffsetValueType       OffsetValueType;
+  typedef TMaskImage                                MaskImageType;
+
+  typedef std::vector<OffsetValueType>              OffsetContainerType;
+
+  /** Adds the image of the samples at the given position. */
+  void AddInput( const ImageType *image, RealType samplePosition );
+  void ClearInputs();
+
+  unsigned int GetNumberOfInputs() const
+    { return this->m_Inputs.size(); }
+
+  void SetModel( const ModelType & model )
+    { this->m_Model = model; this->Modified(); }
+  const ModelType & GetModel() const
+    { return this->m_Model; }
+
+  /** Compacts the nonzero voxels of the mask into the mask offsets and
+   * turns UseMask on (off for a null mask). */
+  void SetMaskImage( const MaskImageType *mask );
+
+  /** Sorted offsets, in raster order from the start of the image
+   * region, of the voxels to fit.  Turns UseMask on. */
+  void SetMaskOffsets( const OffsetContainerType & offsets );
+  const OffsetContainerType & GetMaskOffsets() const
+    { return this->m_MaskOffsets; }
+
+  itkSetMacro( UseMask, bool );
+  itkGetConstMacro( UseMask, bool );
+  itkBooleanMacro( UseMask );
+
+  /** Minimize the sum of absolute instead of squared residuals. */
+  itkSetMacro( UseLeastAbsoluteDeviations, bool );
+  itkGetConstMacro( UseLeastAbsoluteDeviations, bool );
+  itkBooleanMacro( UseLeastAbsoluteDeviations );
+
+  /** Start from the fit of the previous voxel in raster order of the
+   * batch if it has a lower cost (default = true). */
+  itkSetMacro( UseNeighborInitialization, bool );
+  itkGetConstMacro( UseNeighborInitialization, bool );
+  itkBooleanMacro( UseNeighborInitialization );
+
+  /** Levenberg-Marquardt iterations per least squares fit. */
+  itkSetMacro( MaximumNumberOfIterations, unsigned int );
+  itkGetConstMacro( MaximumNumberOfIterations, unsigned int );
+
+  /** Reweighted least squares fits for the least absolute deviations. */
+  itkSetMacro( MaximumNumberOfReweightingIterations, unsigned int );
+  itkGetConstMacro( MaximumNumberOfReweightingIterations, unsigned int );
+
+  /** Relative decrease of the cost below which a fit has converged. */
+  itkSetMacro( ConvergenceTolerance, RealType );
+  itkGetConstMacro( ConvergenceTolerance, RealType );
+
+  itkSetMacro( BatchSize, unsigned int );
+  itkGetConstMacro( BatchSize, unsigned int );
+
+  void SetNumberOfThreads( int numberOfThreads );
+  itkGetConstMacro( NumberOfThreads, int );
+
+  void Update();
+
+  /** Fitted values of parameter i. */
+  ImageType * GetParameterImage( unsigned int i )
+    { return this->m_ParameterImages[i].GetPointer(); }
+
+  /** Fits the samples of one voxel, starting from and returning the
+   * parameters p, and returns the final cost. */
+  RealType FitVoxel( const RealType *samples, RealType *p,
+    std::vector<RealType> & workspace ) const;
+
+protected:
+  VoxelwiseModelFitter();
+  virtual ~VoxelwiseModelFitter() {}
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  VoxelwiseModelFitter( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE FitThreaderCallback( void *arg );
+
+  struct FitThreadStruct
+    {
+    Self                                     *Fitter;
+    unsigned long                             NumberOfVoxels;
+    };
+
+  /** Packs and fits the voxels [begin, end) of the voxel list. */
+  void FitBatch( unsigned long begin, unsigned long end,
+    std::vector<RealType> & samples, std::vector<RealType> & workspace );
+
+  /** Weighted sum of squared residuals, with the residuals and the
+   * model derivatives at the samples. */
+  RealType EvaluateResiduals( const RealType *samples, const RealType *p,
+    const RealType *weights, RealType *residuals,
+    RealType *derivatives ) const;
+
+  /** Least absolute deviations or least squares cost of p. */
+  RealType EvaluateCost( const RealType *samples, const RealType *p ) const;
+
+  /** Levenberg-Marquardt minimization of the weighted sum of squared
+   * residuals, starting from p. */
+  void MinimizeWeightedLeastSquares( const RealType *samples, RealType *p,
+    const RealType *weights, RealType *residuals,
+    RealType *derivatives ) const;
+
+  /** Solves A x = b in place (b becomes x) for a symmetric positive
+   * definite A, which is overwritten.  Returns false if A is not. */
+  static bool SolveNormalEquations( RealType *A, RealType *b );
+
+  std::vector<typename ImageType::ConstPointer>     m_Inputs;
+  std::vector<RealType>                             m_SamplePositions;
+  std::vector<typename ImageType::Pointer>          m_ParameterImages;
+
+  ModelType                                         m_Model;
+
+  OffsetContainerType                               m_MaskOffsets;
+  bool                                              m_UseMask;
+
+  bool                                              m_UseLeastAbsoluteDeviations;
+  bool                                              m_UseNeighborInitialization;
+  unsigned int                                      m_MaximumNumberOfIterations;
+  unsigned int                                      m_MaximumNumberOfReweightingIterations;
+  RealType                                          m_ConvergenceTolerance;
+  unsigned int                                      m_BatchSize;
+  int                                               m_NumberOfThreads;
+};
+
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkVoxelwiseModelFitter.hxx"
+#endif
+
+#endif
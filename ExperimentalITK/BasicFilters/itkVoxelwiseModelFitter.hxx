@@ -0,0 +1,542 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkVoxelwiseModelFitter.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkVoxelwiseModelFitter_hxx
+#define _itkVoxelwiseModelFitter_hxx
+
+#include "itkVoxelwiseModelFitter.h"
+
+#include "itkImageRegionConstIterator.h"
+
+#include <algorithm>
+
+namespace itk {
+
+template<class TModel, class TImage, class TMaskImage>
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::VoxelwiseModelFitter()
+{
+  this->m_UseMask = false;
+  this->m_UseLeastAbsoluteDeviations = false;
+  this->m_UseNeighborInitialization = true;
+  this->m_MaximumNumberOfIterations = 100;
+  this->m_MaximumNumberOfReweightingIterations = 20;
+  this->m_ConvergenceTolerance = 1e-6;
+  this->m_BatchSize = 1024;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::AddInput( const ImageType *image, RealType samplePosition )
+{
+  this->m_Inputs.push_back( image );
+  this->m_SamplePositions.push_back( samplePosition );
+  this->Modified();
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::ClearInputs()
+{
+  this->m_Inputs.clear();
+  this->m_SamplePositions.clear();
+  this->Modified();
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::SetNumberOfThreads( int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( 1,
+    std::min( numberOfThreads, static_cast<int>( ITK_MAX_THREADS ) ) );
+  this->Modified();
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::SetMaskImage( const MaskImageType *mask )
+{
+  this->m_MaskOffsets.clear();
+  this->m_UseMask = false;
+
+  if( mask )
+    {
+    ImageRegionConstIterator<MaskImageType> It( mask,
+      mask->GetLargestPossibleRegion() );
+    OffsetValueType offset = 0;
+    for( It.GoToBegin(); !It.IsAtEnd(); ++It, ++offset )
+      {
+      if( It.Get() != NumericTraits<typename MaskImageType::PixelType>::Zero )
+        {
+        this->m_MaskOffsets.push_back( offset );
+        }
+      }
+    this->m_UseMask = true;
+    }
+  this->Modified();
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::SetMaskOffsets( const OffsetContainerType & offsets )
+{
+  this->m_MaskOffsets = offsets;
+  this->m_UseMask = true;
+  this->Modified();
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::Update()
+{
+  if( this->m_Inputs.empty() )
+    {
+    itkExceptionMacro( "No input images." );
+    }
+
+  const typename ImageType::RegionType region =
+    this->m_Inputs[0]->GetLargestPossibleRegion();
+  for( unsigned int n = 0; n < this->m_Inputs.size(); n++ )
+    {
+    if( this->m_Inputs[n]->GetLargestPossibleRegion().GetSize() !=
+      region.GetSize() )
+      {
+      itkExceptionMacro( "The size of input " << n
+        << " differs from the size of input 0." );
+      }
+    if( this->m_Inputs[n]->GetBufferedRegion() !=
+      this->m_Inputs[n]->GetLargestPossibleRegion() )
+      {
+      itkExceptionMacro( "Input " << n << " is not fully buffered." );
+      }
+    }
+
+  if( this->m_UseMask && !this->m_MaskOffsets.empty() &&
+    this->m_MaskOffsets.back() >=
+      static_cast<OffsetValueType>( region.GetNumberOfPixels() ) )
+    {
+    itkExceptionMacro( "The mask is larger than the input images." );
+    }
+
+  this->m_ParameterImages.resize( NumberOfParameters );
+  for( unsigned int i = 0; i < NumberOfParameters; i++ )
+    {
+    this->m_ParameterImages[i] = ImageType::New();
+    this->m_ParameterImages[i]->CopyInformation( this->m_Inputs[0] );
+    this->m_ParameterImages[i]->SetRegions( region );
+    this->m_ParameterImages[i]->Allocate();
+    this->m_ParameterImages[i]->FillBuffer( NumericTraits<PixelType>::Zero );
+    }
+
+  FitThreadStruct str;
+  str.Fitter = this;
+  str.NumberOfVoxels = ( this->m_UseMask )
+    ? this->m_MaskOffsets.size() : region.GetNumberOfPixels();
+
+  const unsigned int batchSize = std::max( 1u, this->m_BatchSize );
+  const unsigned long numberOfBatches =
+    ( str.NumberOfVoxels + batchSize - 1 ) / batchSize;
+
+  int numberOfThreads = this->m_NumberOfThreads;
+  if( static_cast<unsigned long>( numberOfThreads ) > numberOfBatches )
+    {
+    numberOfThreads = std::max( 1, static_cast<int>( numberOfBatches ) );
+    }
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->FitThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template<class TModel, class TImage, class TMaskImage>
+ITK_THREAD_RETURN_TYPE
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::FitThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  FitThreadStruct *str = (FitThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const unsigned long batchSize = std::max( 1u, str->Fitter->m_BatchSize );
+
+  // Interleave the batches since the fits converge faster in the
+  // background than in the tissue.  The buffers are reused by all the
+  // batches of a thread.
+  std::vector<RealType> samples;
+  std::vector<RealType> workspace;
+  for( unsigned long begin = threadId * batchSize;
+    begin < str->NumberOfVoxels; begin += threadCount * batchSize )
+    {
+    str->Fitter->FitBatch( begin,
+      std::min( begin + batchSize, str->NumberOfVoxels ), samples, workspace );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::FitBatch( unsigned long begin, unsigned long end,
+  std::vector<RealType> & samples, std::vector<RealType> & workspace )
+{
+  const unsigned int numberOfSamples = this->m_Inputs.size();
+
+  // Pack the samples of the batch, one input at a time
+  samples.resize( ( end - begin ) * numberOfSamples );
+  for( unsigned int n = 0; n < numberOfSamples; n++ )
+    {
+    const PixelType *buffer = this->m_Inputs[n]->GetBufferPointer();
+    RealType *voxelSamples = &( samples[n] );
+    for( unsigned long v = begin; v < end; v++ )
+      {
+      const OffsetValueType offset = ( this->m_UseMask )
+        ? this->m_MaskOffsets[v] : static_cast<OffsetValueType>( v );
+      *voxelSamples = static_cast<RealType>( buffer[offset] );
+      voxelSamples += numberOfSamples;
+      }
+    }
+
+  std::vector<PixelType *> parameterBuffers( NumberOfParameters );
+  for( unsigned int i = 0; i < NumberOfParameters; i++ )
+    {
+    parameterBuffers[i] = this->m_ParameterImages[i]->GetBufferPointer();
+    }
+
+  RealType p[NumberOfParameters];
+  RealType previous[NumberOfParameters];
+  bool hasPrevious = false;
+
+  for( unsigned long v = begin; v < end; v++ )
+    {
+    const RealType *voxelSamples = &( samples[( v - begin ) * numberOfSamples] );
+
+    this->m_Model.InitializeParameters( &( this->m_SamplePositions[0] ),
+      voxelSamples, numberOfSamples, p );
+    if( !this->m_Model.IsValid( p ) )
+      {
+      this->m_Model.InitializeDefaultParameters(
+        &( this->m_SamplePositions[0] ), voxelSamples, numberOfSamples, p );
+      }
+    if( this->m_UseNeighborInitialization && hasPrevious &&
+      this->EvaluateCost( voxelSamples, previous ) <
+      this->EvaluateCost( voxelSamples, p ) )
+      {
+      std::copy( previous, previous + NumberOfParameters, p );
+      }
+
+    this->FitVoxel( voxelSamples, p, workspace );
+
+    const OffsetValueType offset = ( this->m_UseMask )
+      ? this->m_MaskOffsets[v] : static_cast<OffsetValueType>( v );
+    for( unsigned int i = 0; i < NumberOfParameters; i++ )
+      {
+      parameterBuffers[i][offset] = static_cast<PixelType>( p[i] );
+      }
+
+    if( this->m_Model.IsValid( p ) )
+      {
+      std::copy( p, p + NumberOfParameters, previous );
+      hasPrevious = true;
+      }
+    }
+}
+
+template<class TModel, class TImage, class TMaskImage>
+typename VoxelwiseModelFitter<TModel, TImage, TMaskImage>::RealType
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::FitVoxel( const RealType *samples, RealType *p,
+  std::vector<RealType> & workspace ) const
+{
+  if( !this->m_Model.IsValid( p ) )
+    {
+    return this->EvaluateCost( samples, p );
+    }
+
+  const unsigned int numberOfSamples = this->m_SamplePositions.size();
+
+  workspace.resize( numberOfSamples * ( NumberOfParameters + 2 ) );
+  RealType *weights = &( workspace[0] );
+  RealType *residuals = weights + numberOfSamples;
+  RealType *derivatives = residuals + numberOfSamples;
+
+  std::fill( weights, weights + numberOfSamples, 1.0 );
+  this->MinimizeWeightedLeastSquares( samples, p, weights, residuals,
+    derivatives );
+
+  RealType cost = this->EvaluateCost( samples, p );
+  if( !this->m_UseLeastAbsoluteDeviations )
+    {
+    return cost;
+    }
+
+  // Iteratively reweighted least squares:  the weights 1 / |r_n| turn the
+  // weighted sum of squares into the sum of absolute residuals.  They are
+  // bounded relative to the magnitude of the samples.
+  RealType scale = 0.0;
+  for( unsigned int n = 0; n < numberOfSamples; n++ )
+    {
+    scale += vnl_math_abs( samples[n] );
+    }
+  const RealType minimumResidual = vnl_math_max( 1e-12,
+    1e-6 * scale / static_cast<RealType>( numberOfSamples ) );
+
+  RealType previous[NumberOfParameters];
+  for( unsigned int r = 0; r < this->m_MaximumNumberOfReweightingIterations; r++ )
+    {
+    for( unsigned int n = 0; n < numberOfSamples; n++ )
+      {
+      weights[n] = 1.0 / vnl_math_max( minimumResidual,
+        vnl_math_abs( residuals[n] ) );
+      }
+
+    std::copy( p, p + NumberOfParameters, previous );
+    this->MinimizeWeightedLeastSquares( samples, p, weights, residuals,
+      derivatives );
+
+    const RealType reweightedCost = this->EvaluateCost( samples, p );
+    if( reweightedCost > cost )
+      {
+      std::copy( previous, previous + NumberOfParameters, p );
+      break;
+      }
+    const bool isConverged =
+      ( cost - reweightedCost <= this->m_ConvergenceTolerance * cost );
+    cost = reweightedCost;
+    if( isConverged )
+      {
+      break;
+      }
+    }
+  return cost;
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::MinimizeWeightedLeastSquares( const RealType *samples, RealType *p,
+  const RealType *weights, RealType *residuals, RealType *derivatives ) const
+{
+  const unsigned int numberOfSamples = this->m_SamplePositions.size();
+  const unsigned int P = NumberOfParameters;
+
+  RealType cost = this->EvaluateResiduals( samples, p, weights, residuals,
+    derivatives );
+  RealType lambda = 1e-3;
+
+  RealType JTJ[NumberOfParameters * NumberOfParameters];
+  RealType gradient[NumberOfParameters];
+  RealType A[NumberOfParameters * NumberOfParameters];
+  RealType step[NumberOfParameters];
+  RealType trial[NumberOfParameters];
+
+  for( unsigned int iteration = 0;
+    iteration < this->m_MaximumNumberOfIterations; iteration++ )
+    {
+    // Gauss-Newton normal equations J^T W J step = J^T W r
+    std::fill( JTJ, JTJ + P * P, 0.0 );
+    std::fill( gradient, gradient + P, 0.0 );
+    for( unsigned int n = 0; n < numberOfSamples; n++ )
+      {
+      const RealType *J = derivatives + n * P;
+      for( unsigned int i = 0; i < P; i++ )
+        {
+        const RealType wJ = weights[n] * J[i];
+        gradient[i] += wJ * residuals[n];
+        for( unsigned int j = 0; j <= i; j++ )
+          {
+          JTJ[i * P + j] += wJ * J[j];
+          }
+        }
+      }
+    for( unsigned int i = 0; i < P; i++ )
+      {
+      for( unsigned int j = 0; j < i; j++ )
+        {
+        JTJ[j * P + i] = JTJ[i * P + j];
+        }
+      }
+
+    // Raise the damping until a step lowers the cost
+    bool isImproved = false;
+    RealType trialCost = cost;
+    while( !isImproved && lambda < 1e10 )
+      {
+      std::copy( JTJ, JTJ + P * P, A );
+      for( unsigned int i = 0; i < P; i++ )
+        {
+        A[i * P + i] += lambda * vnl_math_max( JTJ[i * P + i], 1e-12 );
+        }
+      std::copy( gradient, gradient + P, step );
+
+      if( this->SolveNormalEquations( A, step ) )
+        {
+        for( unsigned int i = 0; i < P; i++ )
+          {
+          trial[i] = p[i] + step[i];
+          }
+        if( this->m_Model.IsValid( trial ) )
+          {
+          trialCost = this->EvaluateResiduals( samples, trial, weights,
+            residuals, derivatives );
+          isImproved = ( trialCost < cost );
+          }
+        }
+      lambda *= ( isImproved ) ? 0.1 : 10.0;
+      }
+
+    if( !isImproved )
+      {
+      // Leave the residuals and the derivatives at p
+      this->EvaluateResiduals( samples, p, weights, residuals, derivatives );
+      break;
+      }
+
+    std::copy( trial, trial + P, p );
+    const bool isConverged =
+      ( cost - trialCost <= this->m_ConvergenceTolerance * cost );
+    cost = trialCost;
+    if( isConverged )
+      {
+      break;
+      }
+    }
+}
+
+template<class TModel, class TImage, class TMaskImage>
+bool
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::SolveNormalEquations( RealType *A, RealType *b )
+{
+  const unsigned int P = NumberOfParameters;
+
+  // Cholesky factorization A = L L^T in the lower triangle
+  for( unsigned int j = 0; j < P; j++ )
+    {
+    RealType diagonal = A[j * P + j];
+    for( unsigned int k = 0; k < j; k++ )
+      {
+      diagonal -= vnl_math_sqr( A[j * P + k] );
+      }
+    if( diagonal <= 0.0 )
+      {
+      return false;
+      }
+    A[j * P + j] = vcl_sqrt( diagonal );
+    for( unsigned int i = j + 1; i < P; i++ )
+      {
+      RealType value = A[i * P + j];
+      for( unsigned int k = 0; k < j; k++ )
+        {
+        value -= A[i * P + k] * A[j * P + k];
+        }
+      A[i * P + j] = value / A[j * P + j];
+      }
+    }
+
+  for( unsigned int i = 0; i < P; i++ )
+    {
+    for( unsigned int k = 0; k < i; k++ )
+      {
+      b[i] -= A[i * P + k] * b[k];
+      }
+    b[i] /= A[i * P + i];
+    }
+  for( int i = P - 1; i >= 0; i-- )
+    {
+    for( unsigned int k = i + 1; k < P; k++ )
+      {
+      b[i] -= A[k * P + i] * b[k];
+      }
+    b[i] /= A[i * P + i];
+    }
+  return true;
+}
+
+template<class TModel, class TImage, class TMaskImage>
+typename VoxelwiseModelFitter<TModel, TImage, TMaskImage>::RealType
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::EvaluateResiduals( const RealType *samples, const RealType *p,
+  const RealType *weights, RealType *residuals, RealType *derivatives ) const
+{
+  const unsigned int numberOfSamples = this->m_SamplePositions.size();
+
+  RealType cost = 0.0;
+  for( unsigned int n = 0; n < numberOfSamples; n++ )
+    {
+    residuals[n] = samples[n] - this->m_Model.Evaluate( p,
+      this->m_SamplePositions[n], derivatives + n * NumberOfParameters );
+    cost += weights[n] * vnl_math_sqr( residuals[n] );
+    }
+  return cost;
+}
+
+template<class TModel, class TImage, class TMaskImage>
+typename VoxelwiseModelFitter<TModel, TImage, TMaskImage>::RealType
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::EvaluateCost( const RealType *samples, const RealType *p ) const
+{
+  const unsigned int numberOfSamples = this->m_SamplePositions.size();
+
+  RealType derivatives[NumberOfParameters];
+  RealType cost = 0.0;
+  for( unsigned int n = 0; n < numberOfSamples; n++ )
+    {
+    const RealType residual = samples[n] - this->m_Model.Evaluate( p,
+      this->m_SamplePositions[n], derivatives );
+    cost += ( this->m_UseLeastAbsoluteDeviations )
+      ? vnl_math_abs( residual ) : vnl_math_sqr( residual );
+    }
+  return cost;
+}
+
+template<class TModel, class TImage, class TMaskImage>
+void
+VoxelwiseModelFitter<TModel, TImage, TMaskImage>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Number of inputs: " << this->m_Inputs.size() << std::endl;
+  os << indent << "Use mask: " << this->m_UseMask << std::endl;
+  os << indent << "Number of mask offsets: "
+     << this->m_MaskOffsets.size() << std::endl;
+  os << indent << "Use least absolute deviations: "
+     << this->m_UseLeastAbsoluteDeviations << std::endl;
+  os << indent << "Use neighbor initialization: "
+     << this->m_UseNeighborInitialization << std::endl;
+  os << indent << "Maximum number of iterations: "
+     << this->m_MaximumNumberOfIterations << std::endl;
+  os << indent << "Maximum number of reweighting iterations: "
+     << this->m_MaximumNumberOfReweightingIterations << std::endl;
+  os << indent << "Convergence tolerance: "
+     << this->m_ConvergenceTolerance << std::endl;
+  os << indent << "Batch size: " << this->m_BatchSize << std::endl;
+  os << indent << "Number of threads: " << this->m_NumberOfThreads << std::endl;
+}
+
+} // end of namespace itk
+
+#endif
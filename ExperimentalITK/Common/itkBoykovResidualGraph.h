@@ -0,0 +1,147 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkBoykovResidualGraph.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkBoykovResidualGraph_h
+#define __itkBoykovResidualGraph_h
+
+#include "vnl/vnl_math.h"
+
+#include <deque>
+#include <vector>
+
+namespace itk
+{
+
+/** \class BoykovResidualGraph
+ * \brief Compact residual graph for repeated Boykov-Kolmogorov max-flows.
+ *
+ * \par
+ * The arcs are stored in compressed row form (the arcs leaving node n
+ * are ArcOffsets[n] ... ArcOffsets[n+1]-1) with their residual
+ * capacities, reverse arcs and the search tree state in flat arrays.
+ * As in BoykovMinCutGraphFilter, the two terminal links of a node are
+ * kept as a single signed node weight (positive: source, negative:
+ * sink).
+ *
+ * \par
+ * SetCapacities() replaces the capacities but keeps the current flow:
+ * arcs now carrying more flow than their capacity give the excess back
+ * to the terminal links of their end nodes, which leaves the minimum
+ * cut unchanged.  The source and sink trees of the previous cut are
+ * kept wherever they are still valid and the remaining nodes go
+ * through the usual adoption step, so a sequence of similar problems
+ * (e.g. the expansion moves of BoykovAlphaExpansionMRFImageFilter)
+ * does not start every max-flow from scratch.
+ *
+ * \par REFERENCE
+ * Y. Boykov and V. Kolmogorov, "An Experimental Comparison of Min-
+ * Cut/Max-Flow Algorithms for Energy Minimization in Vision,"
+ * IEEE-PAMI, 26(9):1124-1137, 2004.
+ *
+ * P. Kohli and P. H. S. Torr, "Dynamic Graph Cuts for Efficient Inference
+ * in Markov Random Fields," IEEE-PAMI, 29(12):2079-2088, 2007.
+ *
+ **/
+
+template<typename TWeight>
+class BoykovResidualGraph
+{
+public:
+  typedef TWeight                                   WeightType;
+  typedef std::vector<unsigned int>                 IndexArrayType;
+  typedef std::vector<WeightType>                   WeightArrayType;
+
+  BoykovResidualGraph();
+  ~BoykovResidualGraph() {}
+
+  /** Set the arcs in compressed row form.  Every arc needs its reverse
+   * arc in the list.  The flow and the search trees are reset. */
+  void Initialize( const IndexArrayType &arcOffsets,
+    const IndexArrayType &arcTargets );
+
+  unsigned int GetNumberOfNodes() const
+    { return this->m_NodeWeights.size(); }
+  unsigned int GetNumberOfArcs() const
+    { return this->m_ArcTargets.size(); }
+  const IndexArrayType &GetArcOffsets() const
+    { return this->m_ArcOffsets; }
+  const IndexArrayType &GetArcTargets() const
+    { return this->m_ArcTargets; }
+  const IndexArrayType &GetReverseArcs() const
+    { return this->m_ReverseArcs; }
+
+  /** Replace the terminal (node) and arc capacities, keeping the flow
+   * found by the previous ComputeMaximumFlow(). */
+  void SetCapacities( const WeightArrayType &nodeWeights,
+    const WeightArrayType &arcCapacities );
+
+  /** Discard the flow and the search trees. */
+  void ResetFlow();
+
+  void ComputeMaximumFlow();
+
+  /** A node is on the source side of the minimum cut iff it belongs to
+   * the source search tree. */
+  bool IsSourceNode( unsigned int n ) const
+    { return ( !this->m_IsSink[n] && this->m_Parents[n] != NoParent ); }
+
+private:
+  /** Special values of the parent arcs. */
+  enum { TerminalArc = -1, OrphanArc = -2, NoParent = -3 };
+
+  void RepairSearchTrees();
+  void SetActiveNode( unsigned int );
+  int GetNextActiveNode();
+  void Augment( unsigned int );
+  void ProcessSourceOrphan( unsigned int );
+  void ProcessSinkOrphan( unsigned int );
+  void ProcessOrphans();
+
+  inline bool IsZero( WeightType m ) const
+    { return ( vnl_math_abs( static_cast<double>( m ) ) < 1e-10 ); }
+
+  /** Graph layout */
+  IndexArrayType                    m_ArcOffsets;
+  IndexArrayType                    m_ArcTargets;
+  IndexArrayType                    m_ReverseArcs;
+
+  /** Capacities of the current problem and their residuals */
+  WeightArrayType                   m_NodeCapacities;
+  WeightArrayType                   m_ArcCapacities;
+  WeightArrayType                   m_NodeWeights;
+  WeightArrayType                   m_ArcWeights;
+
+  /** Search trees.  The parent arc of a node points from the node
+   * to its parent. */
+  std::vector<int>                  m_Parents;
+  std::vector<int>                  m_TimeStamps;
+  std::vector<int>                  m_DistancesToTerminal;
+  std::vector<bool>                 m_IsSink;
+  std::vector<bool>                 m_IsActive;
+
+  std::deque<unsigned int>          m_ActiveNodes;
+  std::vector<unsigned int>         m_Orphans;
+
+  int                               m_GlobalTime;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkBoykovResidualGraph.hxx"
+#endif
+
+#endif
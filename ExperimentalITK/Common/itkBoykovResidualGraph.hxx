@@ -0,0 +1,701 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkBoykovResidualGraph.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkBoykovResidualGraph_hxx
+#define __itkBoykovResidualGraph_hxx
+
+#include "itkBoykovResidualGraph.h"
+#include "itkMacro.h"
+#include "itkNumericTraits.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+template<typename TWeight>
+BoykovResidualGraph<TWeight>
+::BoykovResidualGraph()
+{
+  this->m_GlobalTime = 0;
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::Initialize( const IndexArrayType &arcOffsets,
+  const IndexArrayType &arcTargets )
+{
+  if( arcOffsets.empty() || arcOffsets.back() != arcTargets.size() )
+    {
+    itkGenericExceptionMacro( "The arc offsets do not match the arcs." );
+    }
+
+  this->m_ArcOffsets = arcOffsets;
+  this->m_ArcTargets = arcTargets;
+
+  unsigned int numberOfNodes = arcOffsets.size() - 1;
+  unsigned int numberOfArcs = arcTargets.size();
+
+  /** Find the reverse arcs */
+  this->m_ReverseArcs.assign( numberOfArcs, 0 );
+  for( unsigned int p = 0; p < numberOfNodes; p++ )
+    {
+    for( unsigned int a = arcOffsets[p]; a < arcOffsets[p+1]; a++ )
+      {
+      unsigned int q = arcTargets[a];
+      unsigned int b = arcOffsets[q];
+      while( b < arcOffsets[q+1] && arcTargets[b] != p )
+        {
+        b++;
+        }
+      if( b == arcOffsets[q+1] )
+        {
+        itkGenericExceptionMacro( "Arc " << p << " -> " << q
+          << " has no reverse arc." );
+        }
+      this->m_ReverseArcs[a] = b;
+      }
+    }
+
+  this->m_NodeCapacities.assign( numberOfNodes, NumericTraits<WeightType>::Zero );
+  this->m_ArcCapacities.assign( numberOfArcs, NumericTraits<WeightType>::Zero );
+
+  this->m_Parents.resize( numberOfNodes );
+  this->m_TimeStamps.resize( numberOfNodes );
+  this->m_DistancesToTerminal.resize( numberOfNodes );
+  this->m_IsSink.resize( numberOfNodes );
+  this->m_IsActive.resize( numberOfNodes );
+
+  this->ResetFlow();
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::ResetFlow()
+{
+  this->m_NodeWeights = this->m_NodeCapacities;
+  this->m_ArcWeights = this->m_ArcCapacities;
+
+  std::fill( this->m_Parents.begin(), this->m_Parents.end(),
+    static_cast<int>( NoParent ) );
+  std::fill( this->m_TimeStamps.begin(), this->m_TimeStamps.end(), 0 );
+  std::fill( this->m_DistancesToTerminal.begin(),
+    this->m_DistancesToTerminal.end(), 0 );
+  std::fill( this->m_IsSink.begin(), this->m_IsSink.end(), false );
+  this->m_GlobalTime = 0;
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::SetCapacities( const WeightArrayType &nodeWeights,
+  const WeightArrayType &arcCapacities )
+{
+  if( nodeWeights.size() != this->m_NodeCapacities.size() ||
+    arcCapacities.size() != this->m_ArcCapacities.size() )
+    {
+    itkGenericExceptionMacro( "The capacities do not match the graph." );
+    }
+
+  /** Shift the residuals by the change in capacity */
+  for( unsigned int n = 0; n < nodeWeights.size(); n++ )
+    {
+    this->m_NodeWeights[n] += nodeWeights[n] - this->m_NodeCapacities[n];
+    }
+  for( unsigned int a = 0; a < arcCapacities.size(); a++ )
+    {
+    this->m_ArcWeights[a] += arcCapacities[a] - this->m_ArcCapacities[a];
+    }
+  this->m_NodeCapacities = nodeWeights;
+  this->m_ArcCapacities = arcCapacities;
+
+  /**
+   * An arc carrying more flow than its new capacity is saturated and the
+   * excess is returned to the terminal links of its end nodes.
+   */
+  for( unsigned int p = 0; p < this->GetNumberOfNodes(); p++ )
+    {
+    for( unsigned int a = this->m_ArcOffsets[p];
+      a < this->m_ArcOffsets[p+1]; a++ )
+      {
+      unsigned int b = this->m_ReverseArcs[a];
+      if( b < a )
+        {
+        continue;
+        }
+      unsigned int q = this->m_ArcTargets[a];
+      if( this->m_ArcWeights[a] < NumericTraits<WeightType>::Zero )
+        {
+        WeightType excess = -this->m_ArcWeights[a];
+        this->m_ArcWeights[a] = NumericTraits<WeightType>::Zero;
+        this->m_ArcWeights[b] -= excess;
+        this->m_NodeWeights[p] += excess;
+        this->m_NodeWeights[q] -= excess;
+        }
+      else if( this->m_ArcWeights[b] < NumericTraits<WeightType>::Zero )
+        {
+        WeightType excess = -this->m_ArcWeights[b];
+        this->m_ArcWeights[b] = NumericTraits<WeightType>::Zero;
+        this->m_ArcWeights[a] -= excess;
+        this->m_NodeWeights[q] += excess;
+        this->m_NodeWeights[p] -= excess;
+        }
+      }
+    }
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::ComputeMaximumFlow()
+{
+  this->RepairSearchTrees();
+
+  int current = -1;
+  while( true )
+    {
+    int i = current;
+
+    if( i >= 0 )
+      {
+      /** remove active flag */
+      this->m_IsActive[i] = false;
+      if( this->m_Parents[i] == NoParent )
+        {
+        i = -1;
+        }
+      }
+    if( i < 0 )
+      {
+      i = this->GetNextActiveNode();
+      if( i < 0 )
+        {
+        break;
+        }
+      }
+
+    /** Growing step */
+    int middle = -1;
+    if( !this->m_IsSink[i] )
+      {
+      /* Grow source tree **/
+      for( unsigned int a = this->m_ArcOffsets[i];
+        a < this->m_ArcOffsets[i+1]; a++ )
+        {
+        if( !this->IsZero( this->m_ArcWeights[a] ) )
+          {
+          unsigned int j = this->m_ArcTargets[a];
+          if( this->m_Parents[j] == NoParent )
+            {
+            this->m_IsSink[j] = false;
+            this->m_Parents[j] = this->m_ReverseArcs[a];
+            this->m_TimeStamps[j] = this->m_TimeStamps[i];
+            this->m_DistancesToTerminal[j] = this->m_DistancesToTerminal[i] + 1;
+            this->SetActiveNode( j );
+            }
+          else if( this->m_IsSink[j] )
+            {
+            middle = a;
+            break;
+            }
+          else if( this->m_TimeStamps[j] <= this->m_TimeStamps[i] &&
+            this->m_DistancesToTerminal[j] > this->m_DistancesToTerminal[i] )
+            {
+            /*
+             * heuristic - trying to shorten the distance from j to the source
+             **/
+            this->m_Parents[j] = this->m_ReverseArcs[a];
+            this->m_TimeStamps[j] = this->m_TimeStamps[i];
+            this->m_DistancesToTerminal[j] = this->m_DistancesToTerminal[i] + 1;
+            }
+          }
+        }
+      }
+    else
+      {
+      /* Grow sink tree **/
+      for( unsigned int a = this->m_ArcOffsets[i];
+        a < this->m_ArcOffsets[i+1]; a++ )
+        {
+        if( !this->IsZero( this->m_ArcWeights[this->m_ReverseArcs[a]] ) )
+          {
+          unsigned int j = this->m_ArcTargets[a];
+          if( this->m_Parents[j] == NoParent )
+            {
+            this->m_IsSink[j] = true;
+            this->m_Parents[j] = this->m_ReverseArcs[a];
+            this->m_TimeStamps[j] = this->m_TimeStamps[i];
+            this->m_DistancesToTerminal[j] = this->m_DistancesToTerminal[i] + 1;
+            this->SetActiveNode( j );
+            }
+          else if( !this->m_IsSink[j] )
+            {
+            middle = this->m_ReverseArcs[a];
+            break;
+            }
+          else if( this->m_TimeStamps[j] <= this->m_TimeStamps[i] &&
+            this->m_DistancesToTerminal[j] > this->m_DistancesToTerminal[i] )
+            {
+            /* heuristic - try to shorten the distance from j to the sink **/
+            this->m_Parents[j] = this->m_ReverseArcs[a];
+            this->m_TimeStamps[j] = this->m_TimeStamps[i];
+            this->m_DistancesToTerminal[j] = this->m_DistancesToTerminal[i] + 1;
+            }
+          }
+        }
+      }
+
+    this->m_GlobalTime++;
+
+    if( middle >= 0 )
+      {
+      /** set active flag */
+      this->m_IsActive[i] = true;
+      current = i;
+
+      /** Augmentation step */
+      this->Augment( middle );
+
+      /** Adoption step */
+      this->ProcessOrphans();
+      }
+    else
+      {
+      current = -1;
+      }
+    }
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::RepairSearchTrees()
+{
+  this->m_GlobalTime++;
+
+  this->m_ActiveNodes.clear();
+  this->m_Orphans.clear();
+  std::fill( this->m_IsActive.begin(), this->m_IsActive.end(), false );
+
+  /** Nodes with a terminal residual become (or stay) roots */
+  for( unsigned int n = 0; n < this->GetNumberOfNodes(); n++ )
+    {
+    if( !this->IsZero( this->m_NodeWeights[n] ) )
+      {
+      this->m_IsSink[n] =
+        ( this->m_NodeWeights[n] < NumericTraits<WeightType>::Zero );
+      this->m_Parents[n] = TerminalArc;
+      this->m_TimeStamps[n] = this->m_GlobalTime;
+      this->m_DistancesToTerminal[n] = 1;
+      }
+    else if( this->m_Parents[n] == TerminalArc )
+      {
+      this->m_Parents[n] = OrphanArc;
+      this->m_Orphans.push_back( n );
+      }
+    }
+
+  /** Tree arcs must still have a residual and stay within one tree */
+  for( unsigned int n = 0; n < this->GetNumberOfNodes(); n++ )
+    {
+    int a = this->m_Parents[n];
+    if( a < 0 )
+      {
+      continue;
+      }
+    unsigned int p = this->m_ArcTargets[a];
+    WeightType weight = this->m_IsSink[n] ? this->m_ArcWeights[a]
+      : this->m_ArcWeights[this->m_ReverseArcs[a]];
+    if( this->m_Parents[p] == NoParent ||
+      this->m_IsSink[p] != this->m_IsSink[n] || this->IsZero( weight ) )
+      {
+      this->m_Parents[n] = OrphanArc;
+      this->m_Orphans.push_back( n );
+      }
+    }
+
+  this->ProcessOrphans();
+
+  /** Any tree node may now border on the other tree or a free node */
+  for( unsigned int n = 0; n < this->GetNumberOfNodes(); n++ )
+    {
+    if( this->m_Parents[n] != NoParent )
+      {
+      this->SetActiveNode( n );
+      }
+    }
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::SetActiveNode( unsigned int n )
+{
+  if( !this->m_IsActive[n] )
+    {
+    this->m_IsActive[n] = true;
+    this->m_ActiveNodes.push_back( n );
+    }
+}
+
+template<typename TWeight>
+int
+BoykovResidualGraph<TWeight>
+::GetNextActiveNode()
+{
+  while( !this->m_ActiveNodes.empty() )
+    {
+    /* remove the node from the active list **/
+    unsigned int n = this->m_ActiveNodes.front();
+    this->m_IsActive[n] = false;
+    this->m_ActiveNodes.pop_front();
+
+    /* a node is active iff it has a Parent **/
+    if( this->m_Parents[n] != NoParent )
+      {
+      return static_cast<int>( n );
+      }
+    }
+  return -1;
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::Augment( unsigned int middle )
+{
+  unsigned int n;
+  int a;
+
+  /* 1. find the bottleneck capacity **/
+  /* the source tree **/
+  WeightType bottleneck = this->m_ArcWeights[middle];
+  for( n = this->m_ArcTargets[this->m_ReverseArcs[middle]]; ;
+    n = this->m_ArcTargets[a] )
+    {
+    a = this->m_Parents[n];
+    if( a == TerminalArc )
+      {
+      break;
+      }
+    if( bottleneck > this->m_ArcWeights[this->m_ReverseArcs[a]] )
+      {
+      bottleneck = this->m_ArcWeights[this->m_ReverseArcs[a]];
+      }
+    }
+  if( bottleneck > this->m_NodeWeights[n] )
+    {
+    bottleneck = this->m_NodeWeights[n];
+    }
+
+  /* the sink tree **/
+  for( n = this->m_ArcTargets[middle]; ; n = this->m_ArcTargets[a] )
+    {
+    a = this->m_Parents[n];
+    if( a == TerminalArc )
+      {
+      break;
+      }
+    if( bottleneck > this->m_ArcWeights[a] )
+      {
+      bottleneck = this->m_ArcWeights[a];
+      }
+    }
+  if( bottleneck > -this->m_NodeWeights[n] )
+    {
+    bottleneck = -this->m_NodeWeights[n];
+    }
+
+  /* 2. Augmenting **/
+  /* the source tree **/
+  this->m_ArcWeights[this->m_ReverseArcs[middle]] += bottleneck;
+  this->m_ArcWeights[middle] -= bottleneck;
+  for( n = this->m_ArcTargets[this->m_ReverseArcs[middle]]; ;
+    n = this->m_ArcTargets[a] )
+    {
+    a = this->m_Parents[n];
+    if( a == TerminalArc )
+      {
+      break;
+      }
+    this->m_ArcWeights[a] += bottleneck;
+    this->m_ArcWeights[this->m_ReverseArcs[a]] -= bottleneck;
+    if( this->IsZero( this->m_ArcWeights[this->m_ReverseArcs[a]] ) )
+      {
+      /* add node to the adoption list */
+      this->m_Parents[n] = OrphanArc;
+      this->m_Orphans.push_back( n );
+      }
+    }
+  this->m_NodeWeights[n] -= bottleneck;
+  if( this->IsZero( this->m_NodeWeights[n] ) )
+    {
+    /* add node to the adoption list */
+    this->m_Parents[n] = OrphanArc;
+    this->m_Orphans.push_back( n );
+    }
+
+  /* the sink tree **/
+  for( n = this->m_ArcTargets[middle]; ; n = this->m_ArcTargets[a] )
+    {
+    a = this->m_Parents[n];
+    if( a == TerminalArc )
+      {
+      break;
+      }
+    this->m_ArcWeights[this->m_ReverseArcs[a]] += bottleneck;
+    this->m_ArcWeights[a] -= bottleneck;
+    if( this->IsZero( this->m_ArcWeights[a] ) )
+      {
+      /* add node to the adoption list */
+      this->m_Parents[n] = OrphanArc;
+      this->m_Orphans.push_back( n );
+      }
+    }
+  this->m_NodeWeights[n] += bottleneck;
+  if( this->IsZero( this->m_NodeWeights[n] ) )
+    {
+    /* add node to the adoption list */
+    this->m_Parents[n] = OrphanArc;
+    this->m_Orphans.push_back( n );
+    }
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::ProcessOrphans()
+{
+  while( !this->m_Orphans.empty() )
+    {
+    unsigned int orphan = this->m_Orphans.back();
+    this->m_Orphans.pop_back();
+    if( this->m_IsSink[orphan] )
+      {
+      this->ProcessSinkOrphan( orphan );
+      }
+    else
+      {
+      this->ProcessSourceOrphan( orphan );
+      }
+    }
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::ProcessSourceOrphan( unsigned int orphan )
+{
+  int arcMin = NoParent;
+  int distanceMin = NumericTraits<int>::max();
+
+  /* trying to find a new Parent */
+  for( unsigned int a = this->m_ArcOffsets[orphan];
+    a < this->m_ArcOffsets[orphan+1]; a++ )
+    {
+    if( this->IsZero( this->m_ArcWeights[this->m_ReverseArcs[a]] ) )
+      {
+      continue;
+      }
+    unsigned int n = this->m_ArcTargets[a];
+    if( this->m_IsSink[n] || this->m_Parents[n] == NoParent )
+      {
+      continue;
+      }
+
+    /* checking the origin of n **/
+    int distance = 0;
+    while( true )
+      {
+      if( this->m_TimeStamps[n] == this->m_GlobalTime )
+        {
+        distance += this->m_DistancesToTerminal[n];
+        break;
+        }
+      int parent = this->m_Parents[n];
+      distance++;
+      if( parent == TerminalArc )
+        {
+        this->m_TimeStamps[n] = this->m_GlobalTime;
+        this->m_DistancesToTerminal[n] = 1;
+        break;
+        }
+      if( parent == OrphanArc )
+        {
+        distance = NumericTraits<int>::max();
+        break;
+        }
+      n = this->m_ArcTargets[parent];
+      }
+
+    /* n originates from the source - done **/
+    if( distance < NumericTraits<int>::max() )
+      {
+      if( distance < distanceMin )
+        {
+        arcMin = a;
+        distanceMin = distance;
+        }
+      /* set marks along the path */
+      for( n = this->m_ArcTargets[a];
+        this->m_TimeStamps[n] != this->m_GlobalTime;
+        n = this->m_ArcTargets[this->m_Parents[n]] )
+        {
+        this->m_TimeStamps[n] = this->m_GlobalTime;
+        this->m_DistancesToTerminal[n] = distance--;
+        }
+      }
+    }
+
+  this->m_Parents[orphan] = arcMin;
+  if( arcMin != NoParent )
+    {
+    this->m_TimeStamps[orphan] = this->m_GlobalTime;
+    this->m_DistancesToTerminal[orphan] = distanceMin + 1;
+    }
+  else
+    {
+    /* no parent is found */
+    this->m_TimeStamps[orphan] = 0;
+
+    /* process neighbors */
+    for( unsigned int a = this->m_ArcOffsets[orphan];
+      a < this->m_ArcOffsets[orphan+1]; a++ )
+      {
+      unsigned int n = this->m_ArcTargets[a];
+      int parent = this->m_Parents[n];
+      if( !this->m_IsSink[n] && parent != NoParent )
+        {
+        if( !this->IsZero( this->m_ArcWeights[this->m_ReverseArcs[a]] ) )
+          {
+          this->SetActiveNode( n );
+          }
+        if( parent >= 0 && this->m_ArcTargets[parent] == orphan )
+          {
+          /* add node to the adoption list */
+          this->m_Parents[n] = OrphanArc;
+          this->m_Orphans.push_back( n );
+          }
+        }
+      }
+    }
+}
+
+template<typename TWeight>
+void
+BoykovResidualGraph<TWeight>
+::ProcessSinkOrphan( unsigned int orphan )
+{
+  int arcMin = NoParent;
+  int distanceMin = NumericTraits<int>::max();
+
+  /* trying to find a new Parent */
+  for( unsigned int a = this->m_ArcOffsets[orphan];
+    a < this->m_ArcOffsets[orphan+1]; a++ )
+    {
+    if( this->IsZero( this->m_ArcWeights[a] ) )
+      {
+      continue;
+      }
+    unsigned int n = this->m_ArcTargets[a];
+    if( !this->m_IsSink[n] || this->m_Parents[n] == NoParent )
+      {
+      continue;
+      }
+
+    /* checking the origin of n **/
+    int distance = 0;
+    while( true )
+      {
+      if( this->m_TimeStamps[n] == this->m_GlobalTime )
+        {
+        distance += this->m_DistancesToTerminal[n];
+        break;
+        }
+      int parent = this->m_Parents[n];
+      distance++;
+      if( parent == TerminalArc )
+        {
+        this->m_TimeStamps[n] = this->m_GlobalTime;
+        this->m_DistancesToTerminal[n] = 1;
+        break;
+        }
+      if( parent == OrphanArc )
+        {
+        distance = NumericTraits<int>::max();
+        break;
+        }
+      n = this->m_ArcTargets[parent];
+      }
+
+    /* n originates from the sink - done **/
+    if( distance < NumericTraits<int>::max() )
+      {
+      if( distance < distanceMin )
+        {
+        arcMin = a;
+        distanceMin = distance;
+        }
+      /* set marks along the path */
+      for( n = this->m_ArcTargets[a];
+        this->m_TimeStamps[n] != this->m_GlobalTime;
+        n = this->m_ArcTargets[this->m_Parents[n]] )
+        {
+        this->m_TimeStamps[n] = this->m_GlobalTime;
+        this->m_DistancesToTerminal[n] = distance--;
+        }
+      }
+    }
+
+  this->m_Parents[orphan] = arcMin;
+  if( arcMin != NoParent )
+    {
+    this->m_TimeStamps[orphan] = this->m_GlobalTime;
+    this->m_DistancesToTerminal[orphan] = distanceMin + 1;
+    }
+  else
+    {
+    /* no parent is found */
+    this->m_TimeStamps[orphan] = 0;
+
+    /* process neighbors */
+    for( unsigned int a = this->m_ArcOffsets[orphan];
+      a < this->m_ArcOffsets[orphan+1]; a++ )
+      {
+      unsigned int n = this->m_ArcTargets[a];
+      int parent = this->m_Parents[n];
+      if( this->m_IsSink[n] && parent != NoParent )
+        {
+        if( !this->IsZero( this->m_ArcWeights[a] ) )
+          {
+          this->SetActiveNode( n );
+          }
+        if( parent >= 0 && this->m_ArcTargets[parent] == orphan )
+          {
+          /* add node to the adoption list */
+          this->m_Parents[n] = OrphanArc;
+          this->m_Orphans.push_back( n );
+          }
+        }
+      }
+    }
+}
+
+} // end namespace itk
+
+#endif
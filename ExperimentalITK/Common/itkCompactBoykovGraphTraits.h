@@ -0,0 +1,66 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkCompactBoykovGraphTraits.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkCompactBoykovGraphTraits_h
+#define __itkCompactBoykovGraphTraits_h
+
+#include "itkCompactImageGraphTraits.h"
+
+namespace itk
+{
+
+/**
+ * Compact graph traits for use with CompactGraph and the
+ * BoykovMinCutFilter class (cf. BoykovGraphTraits).
+ */
+
+template <typename TWeight = short, unsigned int VImageDimension = 3>
+class CompactBoykovGraphTraits
+: public CompactImageGraphTraits<TWeight, VImageDimension>
+{
+public:
+  typedef CompactBoykovGraphTraits Self;
+  typedef CompactImageGraphTraits<TWeight, VImageDimension> Superclass;
+
+  typedef TWeight NodeWeightType;
+  typedef TWeight EdgeWeightType;
+  typedef typename Superclass::NodeIdentifierType NodeIdentifierType;
+  typedef typename Superclass::EdgeIdentifierType EdgeIdentifierType;
+  typedef typename Superclass::EdgeIdentifierContainerType
+                                                  EdgeIdentifierContainerType;
+  typedef typename Superclass::IndexType          IndexType;
+  typedef typename Superclass::EdgeType           EdgeType;
+  typedef typename Superclass::EdgePointerType    EdgePointerType;
+
+  struct NodeType;
+  typedef NodeType* NodePointerType;
+
+  struct NodeType
+    {
+    NodeIdentifierType Identifier;
+    EdgeIdentifierContainerType OutgoingEdges;
+    EdgePointerType Parent;
+    int TimeStamp;
+    int DistanceToTerminal;
+    bool IsSink;
+    bool IsActive;
+    IndexType ImageIndex;
+    };
+};
+
+} // end namespace itk
+
+#endif
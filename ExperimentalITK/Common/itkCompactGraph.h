@@ -0,0 +1,356 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkCompactGraph.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkCompactGraph_h
+#define __itkCompactGraph_h
+
+#include "itkDataObject.h"
+#include "itkObjectFactory.h"
+#include "itkVectorContainer.h"
+
+namespace itk
+{
+
+/** \class CompactGraph
+ * \brief Graph class storing the outgoing edges of a node as a range
+ * of edge identifiers.
+ *
+ * \par
+ * Has the interface of Graph and is meant for large graphs such as the
+ * pixel graphs of 3-D images.  It is templated over graph traits like
+ * CompactGraphTraits: the outgoing edges of a node have consecutive
+ * identifiers and the node only stores the range [Begin, End) of those
+ * identifiers, so no per-node containers are allocated.  The edges are
+ * still kept as an array of edge structures (source, target and reverse
+ * edge identifiers), not as separate offset and target arrays.  The node
+ * and edge weights are kept in their own containers, separate from the
+ * node and edge structures.
+ *
+ * \par
+ * None of the filters or tools use this class yet; GraphSource,
+ * ImageToGraphFilter and BoykovMinCutGraphFilter are templated over the
+ * graph type and only rely on the interface shared with Graph.
+ *
+ * \par
+ * Consequently, the outgoing edges of a node have to be created one
+ * after the other (ImageToGraphFilter creates the edges node by node).
+ * Incoming edges are not stored; GetEdgePointer( source, target )
+ * searches the outgoing edges of the source node.
+ *
+ * \ingroup GraphObjects
+ * \ingroup DataRepresentation
+ */
+
+template <typename TGraphTraits>
+class ITK_EXPORT CompactGraph : public DataObject
+{
+public:
+  /** Standard class typedefs. */
+  typedef CompactGraph       Self;
+  typedef DataObject  Superclass;
+  typedef SmartPointer<Self>  Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Standard part of every itk Object. */
+  itkTypeMacro( CompactGraph, DataObject );
+
+  /** Hold on to the type information specified by the template parameters. */
+  typedef TGraphTraits GraphTraitsType;
+  typedef typename GraphTraitsType::NodeType             NodeType;
+  typedef typename GraphTraitsType::EdgeType             EdgeType;
+  typedef typename GraphTraitsType::NodePointerType      NodePointerType;
+  typedef typename GraphTraitsType::EdgePointerType      EdgePointerType;
+  typedef typename GraphTraitsType::NodeIdentifierType   NodeIdentifierType;
+  typedef typename GraphTraitsType::EdgeIdentifierType   EdgeIdentifierType;
+  typedef typename GraphTraitsType::NodeWeightType       NodeWeightType;
+  typedef typename GraphTraitsType::EdgeWeightType       EdgeWeightType;
+
+  typedef typename GraphTraitsType::EdgeIdentifierContainerType
+                                              EdgeIdentifierContainerType;
+
+  typedef VectorContainer<unsigned, NodeType>        NodeContainerType;
+  typedef typename NodeContainerType::Iterator       NodeIteratorType;
+  typedef typename NodeContainerType::ConstIterator  NodeConstIteratorType;
+  typedef VectorContainer<unsigned, EdgeType>        EdgeContainerType;
+  typedef typename EdgeContainerType::Iterator       EdgeIteratorType;
+  typedef typename EdgeContainerType::ConstIterator  EdgeConstIteratorType;
+  typedef VectorContainer<unsigned, NodeWeightType>  NodeWeightContainerType;
+  typedef VectorContainer<unsigned, EdgeWeightType>  EdgeWeightContainerType;
+
+  /** Return the total number of nodes. */
+  unsigned int GetTotalNumberOfNodes()
+    { return m_Nodes->Size(); }
+  /** Return the total number of edges. */
+  unsigned int GetTotalNumberOfEdges()
+    { return m_Edges->Size(); }
+
+  /** Clear the graph */
+  void Clear();
+
+  /** Reserve memory for the given number of nodes and edges */
+  void Reserve( unsigned int, unsigned int );
+
+  /** Create new nodes */
+  NodePointerType CreateNewNode();
+  NodePointerType CreateNewNode( NodeWeightType );
+
+  /** Create new edges.  The outgoing edges of a node have to be
+   * created consecutively. */
+  EdgePointerType CreateNewEdge();
+  EdgePointerType CreateNewEdge( NodeIdentifierType, NodeIdentifierType );
+  EdgePointerType CreateNewEdge(
+    NodeIdentifierType, NodeIdentifierType, EdgeWeightType);
+  EdgePointerType CreateNewEdge( NodePointerType SourceNode,
+    NodePointerType TargetNode )
+    {
+    return this->CreateNewEdge(
+      SourceNode->Identifier, TargetNode->Identifier );
+    };
+  EdgePointerType CreateNewEdge( NodePointerType SourceNode,
+    NodePointerType TargetNode, EdgeWeightType w )
+    {
+    return this->CreateNewEdge(
+      SourceNode->Identifier, TargetNode->Identifier, w );
+    };
+  EdgePointerType CreateNewEdge( NodeType SourceNode, NodeType TargetNode)
+    {
+    return this->CreateNewEdge( SourceNode.Identifier, TargetNode.Identifier);
+    };
+  EdgePointerType CreateNewEdge(
+    NodeType SourceNode, NodeType TargetNode, EdgeWeightType w )
+    {
+    return this->CreateNewEdge(
+      SourceNode.Identifier, TargetNode.Identifier, w );
+    };
+
+  /** Graph utility functions */
+  /** Get Nodes/Edges         */
+  NodeType& GetNode( NodeIdentifierType Id )
+    { return m_Nodes->ElementAt( Id ); }
+  EdgeType& GetEdge( EdgeIdentifierType Id )
+    { return m_Edges->ElementAt( Id ); }
+  EdgeType& GetReverseEdge( EdgeIdentifierType Id )
+    { return this->GetEdge( this->GetEdge( Id ).ReverseEdgeIdentifier ); }
+  NodeType& GetSourceNode( EdgePointerType Edge )
+    { return this->GetNode( Edge->SourceIdentifier ); }
+  NodeType& GetSourceNode( EdgeType Edge )
+    { return this->GetNode( Edge.SourceIdentifier ); }
+  NodeType& GetSourceNode( EdgeIdentifierType Id )
+    { return this->GetSourceNode( this->GetEdgePointer( Id ) ); }
+  NodeType& GetTargetNode( EdgePointerType Edge )
+    { return this->GetNode( Edge->TargetIdentifier ); }
+  NodeType& GetTargetNode( EdgeType Edge )
+    { return this->GetNode( Edge.TargetIdentifier ); }
+  NodeType& GetTargetNode( EdgeIdentifierType Id )
+    { return this->GetTargetNode( this->GetEdgePointer( Id ) ); }
+  EdgeType& GetEdge( NodeIdentifierType SourceNodeId,
+    NodeIdentifierType TargetNodeId )
+    { return *this->GetEdgePointer( SourceNodeId, TargetNodeId ); }
+
+  NodePointerType GetNodePointer( NodeIdentifierType Id )
+    { return &m_Nodes->ElementAt( Id ); }
+  EdgePointerType GetEdgePointer( EdgeIdentifierType Id )
+    { return &m_Edges->ElementAt( Id ); }
+  EdgePointerType GetReverseEdgePointer( EdgeIdentifierType Id )
+    { return this->GetEdgePointer(
+        this->GetEdgePointer( Id )->ReverseEdgeIdentifier ); }
+  EdgePointerType GetReverseEdgePointer( EdgePointerType Edge )
+    { return this->GetEdgePointer( Edge->ReverseEdgeIdentifier ); }
+  NodePointerType GetSourceNodePointer( EdgePointerType Edge )
+    { return this->GetNodePointer( Edge->SourceIdentifier ); }
+  NodePointerType GetSourceNodePointer( EdgeIdentifierType Id )
+    { return this->GetSourceNodePointer( this->GetEdgePointer( Id ) ); }
+  NodePointerType GetTargetNodePointer( EdgePointerType Edge )
+    { return this->GetNodePointer( Edge->TargetIdentifier ); }
+  NodePointerType GetTargetNodePointer( EdgeIdentifierType Id )
+    { return this->GetTargetNodePointer( this->GetEdgePointer( Id ) ); }
+  EdgePointerType GetEdgePointer( NodeIdentifierType SourceNodeId,
+    NodeIdentifierType TargetNodeId )
+    { return this->GetEdgePointer( this->GetNodePointer( SourceNodeId ),
+        this->GetNodePointer( TargetNodeId ) ); }
+  EdgePointerType GetEdgePointer( NodePointerType, NodePointerType );
+
+  /** Get Node/Edge Identifiers */
+  NodeIdentifierType GetNodeIdentifier( NodePointerType node )
+    { return node->Identifier; }
+  EdgeIdentifierType GetEdgeIdentifier( EdgePointerType edge )
+    { return edge->Identifier; }
+  NodeIdentifierType GetNodeIdentifier( NodeType node )
+    { return node.Identifier; }
+  EdgeIdentifierType GetEdgeIdentifier( EdgeType edge )
+    { return edge.Identifier; }
+
+  /** Get/Set/Add Node/Edge weights */
+  NodeWeightType GetNodeWeight( NodePointerType Node )
+    { return m_NodeWeights->ElementAt( Node->Identifier ); }
+  EdgeWeightType GetEdgeWeight( EdgePointerType Edge )
+    { return m_EdgeWeights->ElementAt( Edge->Identifier ); }
+  NodeWeightType GetNodeWeight( NodeType Node )
+    { return m_NodeWeights->ElementAt( Node.Identifier ); }
+  EdgeWeightType GetEdgeWeight( EdgeType Edge )
+    { return m_EdgeWeights->ElementAt( Edge.Identifier ); }
+  NodeWeightType GetNodeWeight( NodeIdentifierType Id )
+    { return m_NodeWeights->ElementAt( Id ); }
+  EdgeWeightType GetEdgeWeight( EdgeIdentifierType Id )
+    { return m_EdgeWeights->ElementAt( Id ); }
+  void SetNodeWeight( NodePointerType Node, NodeWeightType w )
+    { m_NodeWeights->ElementAt( Node->Identifier ) = w; }
+  void SetEdgeWeight( EdgePointerType Edge, EdgeWeightType w )
+    { m_EdgeWeights->ElementAt( Edge->Identifier ) = w; }
+  void SetNodeWeight( NodeType Node, NodeWeightType w )
+    { m_NodeWeights->ElementAt( Node.Identifier ) = w; }
+  void SetEdgeWeight( EdgeType Edge, EdgeWeightType w )
+    { m_EdgeWeights->ElementAt( Edge.Identifier ) = w; }
+  void SetNodeWeight( NodeIdentifierType Id, NodeWeightType w )
+    { m_NodeWeights->ElementAt( Id ) = w; }
+  void SetEdgeWeight( EdgeIdentifierType Id, EdgeWeightType w )
+    { m_EdgeWeights->ElementAt( Id ) = w; }
+  void AddNodeWeight( NodePointerType Node, NodeWeightType w )
+    { m_NodeWeights->ElementAt( Node->Identifier ) += w; }
+  void AddEdgeWeight( EdgePointerType Edge, EdgeWeightType w )
+    { m_EdgeWeights->ElementAt( Edge->Identifier ) += w; }
+  void AddNodeWeight( NodeType Node, NodeWeightType w )
+    { m_NodeWeights->ElementAt( Node.Identifier ) += w; }
+  void AddEdgeWeight( EdgeType Edge, EdgeWeightType w )
+    { m_EdgeWeights->ElementAt( Edge.Identifier ) += w; }
+  void AddNodeWeight( NodeIdentifierType Id, NodeWeightType w )
+    { m_NodeWeights->ElementAt( Id ) += w; }
+  void AddEdgeWeight( EdgeIdentifierType Id, EdgeWeightType w )
+    { m_EdgeWeights->ElementAt( Id ) += w; }
+
+  /** Get edges to adjacent nodes */
+  EdgeIdentifierContainerType GetOutgoingEdges( NodePointerType Node )
+    { return Node->OutgoingEdges; }
+
+  /**
+   * After creating all the edges, this function associates each
+   * edge with it's reverse edge ( if it exists ).
+   */
+  virtual void SetAllReverseEdges();
+
+  void ChangeNodeWeight( NodeIdentifierType Id, NodeWeightType W )
+    { m_NodeWeights->ElementAt( Id ) = W; }
+  void ChangeEdgeWeight( EdgeIdentifierType Id, EdgeWeightType W )
+    { m_EdgeWeights->ElementAt( Id ) = W; }
+
+  NodeContainerType* GetNodeContainer()
+    { return this->m_Nodes.GetPointer(); }
+  const NodeContainerType* GetNodeContainer() const
+    { return this->m_Nodes.GetPointer(); }
+  void SetNodeContainer( NodeContainerType * );
+  EdgeContainerType* GetEdgeContainer()
+    { return this->m_Edges.GetPointer(); }
+  const EdgeContainerType* GetEdgeContainer() const
+    { return this->m_Edges.GetPointer(); }
+  void SetEdgeContainer( EdgeContainerType * );
+  NodeWeightContainerType* GetNodeWeightContainer()
+    { return this->m_NodeWeights.GetPointer(); }
+  const NodeWeightContainerType* GetNodeWeightContainer() const
+    { return this->m_NodeWeights.GetPointer(); }
+  void SetNodeWeightContainer( NodeWeightContainerType * );
+  EdgeWeightContainerType* GetEdgeWeightContainer()
+    { return this->m_EdgeWeights.GetPointer(); }
+  const EdgeWeightContainerType* GetEdgeWeightContainer() const
+    { return this->m_EdgeWeights.GetPointer(); }
+  void SetEdgeWeightContainer( EdgeWeightContainerType * );
+
+  void Graft( const Self * );
+
+  /**
+   * Define the node/edge iterators which are simple
+   * wrappers for existing iterators of the wrapper
+   * class.
+   */
+
+  friend class NodeIterator;
+  friend class EdgeIterator;
+
+  class NodeIterator
+  {
+  public:
+    NodeIterator( CompactGraph* graph ) { this->m_Graph = graph; }
+   ~NodeIterator() {}
+
+    /** Iterator-related functions */
+    void GoToBegin(void)
+      { this->m_NodeIterator = this->m_Graph->m_Nodes->Begin(); }
+    bool IsAtEnd(void)
+      { return ( this->m_NodeIterator == this->m_Graph->m_Nodes->End() ); }
+    void operator++()
+      { m_NodeIterator++; }
+    NodePointerType GetPointer( void )
+      { return &this->m_NodeIterator.Value(); }
+    NodeType& Get( void )
+      { return this->m_NodeIterator.Value(); }
+    unsigned long GetIdentifier( void )
+      { return this->m_NodeIterator.Index(); }
+
+  private:
+    CompactGraph* m_Graph;
+    NodeIteratorType m_NodeIterator;
+  };
+
+  class EdgeIterator
+  {
+  public:
+    EdgeIterator( CompactGraph* graph ) { this->m_Graph = graph; }
+   ~EdgeIterator() {}
+
+    /** Iterator-related functions */
+    void GoToBegin( void )
+      { this->m_EdgeIterator = this->m_Graph->m_Edges->Begin(); }
+    bool IsAtEnd( void )
+      { return ( this->m_EdgeIterator == this->m_Graph->m_Edges->End() ); }
+    void operator++() { m_EdgeIterator++; }
+    EdgePointerType GetPointer(void)
+      { return &this->m_EdgeIterator.Value(); }
+    EdgeType& Get( void )
+      { return this->m_EdgeIterator.Value(); }
+    unsigned long GetIdentifier( void )
+      { return this->m_EdgeIterator.Index(); }
+
+  private:
+    CompactGraph* m_Graph;
+    EdgeIteratorType m_EdgeIterator;
+  };
+
+protected:
+  /** Constructor for use by New() method. */
+  CompactGraph();
+  ~CompactGraph();
+  virtual void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  CompactGraph( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  typename EdgeContainerType::Pointer        m_Edges;
+  typename NodeContainerType::Pointer        m_Nodes;
+  typename EdgeWeightContainerType::Pointer  m_EdgeWeights;
+  typename NodeWeightContainerType::Pointer  m_NodeWeights;
+
+}; // End Class: CompactGraph
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkCompactGraph.hxx"
+#endif
+
+#endif
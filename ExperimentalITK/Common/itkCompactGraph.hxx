@@ -0,0 +1,286 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkCompactGraph.hxx,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkCompactGraph_hxx
+#define _itkCompactGraph_hxx
+
+#include "itkCompactGraph.h"
+
+namespace itk
+{
+
+template<typename TGraphTraits>
+CompactGraph<TGraphTraits>
+::CompactGraph()
+{
+  this->m_Nodes = NodeContainerType::New();
+  this->m_Edges = EdgeContainerType::New();
+  this->m_NodeWeights = NodeWeightContainerType::New();
+  this->m_EdgeWeights = EdgeWeightContainerType::New();
+
+  this->m_Edges->Initialize();
+  this->m_Nodes->Initialize();
+  this->m_EdgeWeights->Initialize();
+  this->m_NodeWeights->Initialize();
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::Reserve( unsigned int numberOfNodes, unsigned int numberOfEdges )
+{
+  this->m_Nodes->Reserve( numberOfNodes );
+  this->m_NodeWeights->Reserve( numberOfNodes );
+  this->m_Edges->Reserve( numberOfEdges );
+  this->m_EdgeWeights->Reserve( numberOfEdges );
+}
+
+template<typename TGraphTraits>
+typename CompactGraph<TGraphTraits>::NodePointerType
+CompactGraph<TGraphTraits>
+::CreateNewNode()
+{
+  NodeIdentifierType Id = this->m_Nodes->Size();
+  NodePointerType node = &( this->m_Nodes->CreateElementAt( Id ) );
+  node->Identifier = Id;
+  node->OutgoingEdges.Begin = this->m_Edges->Size();
+  node->OutgoingEdges.End = this->m_Edges->Size();
+  this->m_NodeWeights->CreateElementAt( Id )
+    = static_cast<NodeWeightType>( 1 );
+  return node;
+}
+
+template<typename TGraphTraits>
+typename CompactGraph<TGraphTraits>::NodePointerType
+CompactGraph<TGraphTraits>
+::CreateNewNode( NodeWeightType Weight )
+{
+  NodePointerType node = this->CreateNewNode();
+  this->SetNodeWeight( node, Weight );
+  return node;
+}
+
+template<typename TGraphTraits>
+typename CompactGraph<TGraphTraits>::EdgePointerType
+CompactGraph<TGraphTraits>
+::CreateNewEdge()
+{
+  EdgeIdentifierType Id = this->m_Edges->Size();
+  EdgePointerType edge = &( this->m_Edges->CreateElementAt( Id ) );
+  edge->Identifier = Id;
+  edge->SourceIdentifier = 0;
+  edge->TargetIdentifier = 0;
+  edge->ReverseEdgeIdentifier = Id;
+  this->m_EdgeWeights->CreateElementAt( Id )
+    = static_cast<EdgeWeightType>( 1 );
+  return edge;
+}
+
+template<typename TGraphTraits>
+typename CompactGraph<TGraphTraits>::EdgePointerType
+CompactGraph<TGraphTraits>
+::CreateNewEdge( NodeIdentifierType SourceNodeId,
+  NodeIdentifierType TargetNodeId )
+{
+  EdgeIdentifierContainerType &edges
+    = this->GetNodePointer( SourceNodeId )->OutgoingEdges;
+  if( !edges.empty() && edges.End != this->m_Edges->Size() )
+    {
+    itkExceptionMacro( "The outgoing edges of node " << SourceNodeId
+      << " have to be created consecutively." );
+    }
+
+  EdgePointerType edge = this->CreateNewEdge();
+  edge->SourceIdentifier = SourceNodeId;
+  edge->TargetIdentifier = TargetNodeId;
+
+  if( edges.empty() )
+    {
+    edges.Begin = edge->Identifier;
+    }
+  edges.End = edge->Identifier + 1;
+
+  return edge;
+}
+
+template<typename TGraphTraits>
+typename CompactGraph<TGraphTraits>::EdgePointerType
+CompactGraph<TGraphTraits>
+::CreateNewEdge( NodeIdentifierType SourceNodeId,
+  NodeIdentifierType TargetNodeId, EdgeWeightType Weight )
+{
+  EdgePointerType edge = this->CreateNewEdge( SourceNodeId, TargetNodeId );
+  this->SetEdgeWeight( edge, Weight );
+  return edge;
+}
+
+template<typename TGraphTraits>
+typename CompactGraph<TGraphTraits>::EdgePointerType
+CompactGraph<TGraphTraits>
+::GetEdgePointer( NodePointerType SourceNode, NodePointerType TargetNode )
+{
+  for( EdgeIdentifierType Id = SourceNode->OutgoingEdges.Begin;
+    Id != SourceNode->OutgoingEdges.End; Id++ )
+    {
+    EdgePointerType edge = this->GetEdgePointer( Id );
+    if( edge->TargetIdentifier == TargetNode->Identifier )
+      {
+      return edge;
+      }
+    }
+  return NULL;
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::SetAllReverseEdges()
+{
+  NodeIteratorType It;
+
+  for( It = this->m_Nodes->Begin(); It != this->m_Nodes->End(); ++It )
+    {
+    NodePointerType node = &It.Value();
+    for( EdgeIdentifierType Id = node->OutgoingEdges.Begin;
+      Id != node->OutgoingEdges.End; Id++ )
+      {
+      EdgePointerType edge = this->GetEdgePointer( Id );
+      EdgePointerType reverse = this->GetEdgePointer(
+        this->GetNodePointer( edge->TargetIdentifier ), node );
+      if( reverse )
+        {
+        edge->ReverseEdgeIdentifier = reverse->Identifier;
+        }
+      }
+    }
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::Clear()
+{
+  this->m_Edges->Initialize();
+  this->m_Nodes->Initialize();
+  this->m_EdgeWeights->Initialize();
+  this->m_NodeWeights->Initialize();
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::SetEdgeContainer( EdgeContainerType *container )
+{
+  if( this->m_Edges != container )
+    {
+    this->m_Edges = container;
+    this->Modified();
+    }
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::SetNodeContainer( NodeContainerType *container )
+{
+  if( this->m_Nodes != container )
+    {
+    this->m_Nodes = container;
+    this->Modified();
+    }
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::SetEdgeWeightContainer( EdgeWeightContainerType *container )
+{
+  if( this->m_EdgeWeights != container )
+    {
+    this->m_EdgeWeights = container;
+    this->Modified();
+    }
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::SetNodeWeightContainer( NodeWeightContainerType *container )
+{
+  if( this->m_NodeWeights != container )
+    {
+    this->m_NodeWeights = container;
+    this->Modified();
+    }
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::Graft( const Self *data )
+{
+  if(  data  )
+    {
+    // Attempt to cast data to a graph
+    const Self *graph;
+
+    graph = dynamic_cast<const Self*>( data );
+
+    if( graph )
+      {
+      // Now copy anything remaining that is needed
+      this->SetEdgeContainer(
+        const_cast<typename Self::EdgeContainerType *>
+        ( graph->GetEdgeContainer() )  );
+      this->SetNodeContainer(
+        const_cast<typename Self::NodeContainerType *>
+        ( graph->GetNodeContainer() )  );
+      this->SetEdgeWeightContainer(
+        const_cast<typename Self::EdgeWeightContainerType *>
+        ( graph->GetEdgeWeightContainer() )  );
+      this->SetNodeWeightContainer(
+        const_cast<typename Self::NodeWeightContainerType *>
+        ( graph->GetNodeWeightContainer() )  );
+      }
+    else
+      {
+      // pointer could not be cast back down
+      itkExceptionMacro( "itk::CompactGraph::Graft() cannot cast "
+        << typeid( data ).name() << " to " << typeid( const Self * ).name() );
+      }
+  }
+}
+
+template<typename TGraphTraits>
+CompactGraph<TGraphTraits>
+::~CompactGraph()
+{
+  this->Clear();
+}
+
+template<typename TGraphTraits>
+void
+CompactGraph<TGraphTraits>
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Number of Nodes: " << this->m_Nodes->Size()  << std::endl;
+  os << indent << "Number of Edges: " << this->m_Edges->Size()  << std::endl;
+}
+
+} // end namespace itk
+
+#endif
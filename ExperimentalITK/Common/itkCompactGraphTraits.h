@@ -0,0 +1,112 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkCompactGraphTraits.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkCompactGraphTraits_h
+#define __itkCompactGraphTraits_h
+
+namespace itk
+{
+
+/** \class CompactGraphTraits
+ *  \brief Graph traits for use with the CompactGraph class.
+ *
+ *  Counterpart of DefaultGraphTraits with 32-bit identifiers.  The
+ *  outgoing edges of a node have consecutive identifiers, so the
+ *  adjacency of a node is simply a range of edge identifiers instead of
+ *  a std::vector.  The edge structures themselves are unchanged apart
+ *  from the identifier width.  The node and edge weights are
+ *  not part of the structures; CompactGraph keeps them in separate
+ *  arrays.  Incoming edges are not stored.
+ *
+ */
+
+template <typename TNodeWeight = short, typename TEdgeWeight = short>
+class CompactGraphTraits
+{
+public:
+  typedef CompactGraphTraits Self;
+
+  struct EdgeType;
+  struct NodeType;
+  typedef NodeType* NodePointerType;
+  typedef EdgeType* EdgePointerType;
+  typedef unsigned int NodeIdentifierType;
+  typedef unsigned int EdgeIdentifierType;
+  typedef TNodeWeight NodeWeightType;
+  typedef TEdgeWeight EdgeWeightType;
+
+  /** Range [Begin, End) of edge identifiers with the interface of a
+   * (read-only) std::vector<EdgeIdentifierType>. */
+  class EdgeIdentifierContainerType
+  {
+  public:
+    class const_iterator
+    {
+    public:
+      const_iterator( EdgeIdentifierType id = 0 ) : m_Identifier( id ) {}
+      EdgeIdentifierType operator*() const
+        { return this->m_Identifier; }
+      const_iterator& operator++()
+        { ++this->m_Identifier; return *this; }
+      const_iterator operator++( int )
+        { const_iterator it = *this; ++this->m_Identifier; return it; }
+      bool operator==( const const_iterator &it ) const
+        { return ( this->m_Identifier == it.m_Identifier ); }
+      bool operator!=( const const_iterator &it ) const
+        { return ( this->m_Identifier != it.m_Identifier ); }
+    private:
+      EdgeIdentifierType m_Identifier;
+    };
+    typedef const_iterator iterator;
+    typedef EdgeIdentifierType value_type;
+    typedef unsigned int size_type;
+
+    EdgeIdentifierContainerType() : Begin( 0 ), End( 0 ) {}
+
+    const_iterator begin() const
+      { return const_iterator( this->Begin ); }
+    const_iterator end() const
+      { return const_iterator( this->End ); }
+    size_type size() const
+      { return this->End - this->Begin; }
+    bool empty() const
+      { return ( this->End == this->Begin ); }
+    EdgeIdentifierType operator[]( size_type i ) const
+      { return this->Begin + i; }
+
+    EdgeIdentifierType Begin;
+    EdgeIdentifierType End;
+  };
+
+  struct NodeType
+  {
+    NodeIdentifierType Identifier;
+    EdgeIdentifierContainerType OutgoingEdges;
+  };
+
+  struct EdgeType
+  {
+    EdgeIdentifierType Identifier;
+    NodeIdentifierType SourceIdentifier;
+    NodeIdentifierType TargetIdentifier;
+    EdgeIdentifierType ReverseEdgeIdentifier;
+  };
+};
+
+
+} // end namespace itk
+
+#endif
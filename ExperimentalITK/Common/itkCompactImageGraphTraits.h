@@ -0,0 +1,65 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkCompactImageGraphTraits.h,v $
+  Language:  C++
+  Date:
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkCompactImageGraphTraits_h
+#define __itkCompactImageGraphTraits_h
+
+#include "itkCompactGraphTraits.h"
+#include "itkIndex.h"
+
+namespace itk
+{
+
+/** \class CompactImageGraphTraits
+ *  \brief Compact counterpart of ImageGraphTraits.
+ *
+ *  Each node structure has an associated IndexType which contains
+ *  the pixel index of the pixel the node represents.  See
+ *  CompactGraphTraits for the storage of the edges.
+ */
+
+template <typename TWeight, unsigned int VImageDimension>
+class CompactImageGraphTraits : public CompactGraphTraits<TWeight, TWeight>
+{
+public:
+  typedef CompactImageGraphTraits Self;
+  typedef CompactGraphTraits<TWeight, TWeight> Superclass;
+
+  typedef Index<VImageDimension> IndexType;
+  typedef TWeight NodeWeightType;
+  typedef TWeight EdgeWeightType;
+  typedef typename Superclass::NodeIdentifierType NodeIdentifierType;
+  typedef typename Superclass::EdgeIdentifierType EdgeIdentifierType;
+  typedef typename Superclass::EdgeType           EdgeType;
+  typedef typename Superclass::EdgePointerType    EdgePointerType;
+
+  typedef typename Superclass::EdgeIdentifierContainerType
+                                               EdgeIdentifierContainerType;
+
+  struct NodeType;
+  typedef NodeType* NodePointerType;
+
+  struct NodeType
+    {
+    NodeIdentifierType Identifier;
+    EdgeIdentifierContainerType OutgoingEdges;
+    IndexType ImageIndex;
+    };
+};
+
+} // end namespace itk
+
+#endif
@@ -25,6 +25,7 @@
 #include "itkMatrix.h"
 #include "itkMersenneTwisterRandomVariateGenerator.h"
 #include "itkMeshSource.h"
+#include "itkMultiThreader.h"
 #include "itkPointSet.h"
 #include "itkVector.h"
 #include "itkWeightedCentroidKdTreeGenerator.h"
@@ -36,6 +37,19 @@ namespace itk
 
 /** \class ManifoldParzenWindowsPointSetFunction.h
  * \brief point set filter.
+ *
+ * With UseSpatialHashing on, the Gaussians are additionally copied into
+ * flat structure-of-arrays buffers (means, packed upper triangular
+ * precision matrices and normalizers) and binned into a uniform grid.
+ * Each Gaussian is binned into every cell overlapped by its support,
+ * i.e. the box of half-width CutoffSigma times its largest standard
+ * deviation, so evaluating a point only visits the Gaussians of its
+ * own cell and skips those farther than CutoffSigma in Mahalanobis
+ * distance.  EvaluateBatch() groups the query points by cell and
+ * evaluates each candidate Gaussian over a block of queries at once
+ * (a loop the compiler can vectorize) on several threads.  The sum is
+ * normalized like the k-neighborhood evaluation so the density values
+ * stay on the same scale.
  */
 
 template <class TPointSet, class TOutput = double, class TCoordRep = double>
@@ -90,6 +104,15 @@ public:
   typedef std::vector<typename GaussianType::Pointer>    GaussianContainerType;
   typedef typename GaussianType::MatrixType              CovarianceMatrixType;
 
+  typedef std::vector<InputPointType>                    InputPointContainerType;
+  typedef std::vector<OutputType>                        OutputContainerType;
+  typedef std::vector<unsigned long>                     GaussianIdentifierContainerType;
+  typedef std::vector<RealType>                          GaussianValueContainerType;
+
+  /** Number of entries of a packed symmetric precision matrix. */
+  itkStaticConstMacro( PrecisionSize, unsigned int,
+    Dimension * ( Dimension + 1 ) / 2 );
+
   /** Helper functions */
 
   itkSetMacro( CovarianceKNeighborhood, unsigned int );
@@ -115,10 +138,57 @@ public:
   itkGetConstMacro( UseAnisotropicCovariances, bool );
   itkBooleanMacro( UseAnisotropicCovariances );
 
+  /** Evaluate through the Gaussian grid instead of the k-d tree. */
+  itkSetMacro( UseSpatialHashing, bool );
+  itkGetConstMacro( UseSpatialHashing, bool );
+  itkBooleanMacro( UseSpatialHashing );
+
+  /** Truncation radius of the Gaussians in units of standard deviation. */
+  itkSetMacro( CutoffSigma, RealType );
+  itkGetConstMacro( CutoffSigma, RealType );
+
+  /** Number of threads used by EvaluateBatch(). */
+  itkSetClampMacro( NumberOfThreads, int, 1, ITK_MAX_THREADS );
+  itkGetConstMacro( NumberOfThreads, int );
+
   virtual void SetInputPointSet( const InputPointSetType * ptr );
 
   virtual TOutput Evaluate( const InputPointType& point ) const;
 
+  /** Evaluates the density at all points.  The grid is used if it has
+   * been generated, otherwise Evaluate() is called per point. */
+  void EvaluateBatch( const InputPointContainerType & points,
+    OutputContainerType & values ) const;
+
+  /** Fills the identifiers and (unnormalized) values of the Gaussians
+   * contributing at the given point, i.e. those of the grid cell within
+   * the cutoff or, without grid, the k-neighborhood.  Returns the
+   * normalization that Evaluate() divides the sum of the values by.
+   * Safe to call from several threads. */
+  RealType GetContributingGaussians( const InputPointType & point,
+    GaussianIdentifierContainerType & ids,
+    GaussianValueContainerType & values ) const;
+
+  /** (Re)builds the structure-of-arrays Gaussian buffers and the grid
+   * from the current Gaussians.  Called by SetInputPointSet() and
+   * GenerateKdTree() when UseSpatialHashing is on. */
+  void GenerateSpatialHash();
+
+  bool GetSpatialHashIsValid() const
+    {
+    return this->m_SpatialHashIsValid;
+    }
+
+  /** Mean of Gaussian i from the structure-of-arrays buffers. */
+  RealType GetCachedMean( unsigned long i, unsigned int d ) const
+    {
+    return this->m_GaussianMeans[d * this->m_NumberOfCachedGaussians + i];
+    }
+
+  /** Computes precision_i * ( mean_i - point ) from the cached buffers. */
+  void GetCachedPrecisionTimesOffset( unsigned long i,
+    const InputPointType & point, VectorType & result ) const;
+
   PointType GenerateRandomSample();
 
   typename GaussianType::Pointer GetGaussian( unsigned int i )
@@ -141,6 +211,7 @@ public:
       this->m_Gaussians.resize( i+1 );
       }
     this->m_Gaussians[i] = gaussian;
+    this->m_SpatialHashIsValid = false;
     this->Modified();
     }
 
@@ -158,6 +229,28 @@ protected:
 
   void GenerateData();
 
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE EvaluateBatchThreaderCallback( void *arg );
+
+  /** Grid cell of a point, or -1 if the point lies outside the grid. */
+  long GetCellIdentifier( const InputPointType & point ) const;
+
+  /** Evaluates the unnormalized sums of the Gaussians of one cell at a
+   * block of queries stored as coordinates[d * blockSize + b]. */
+  void EvaluateCellBlock( long cell, const RealType *coordinates,
+    unsigned int blockSize, RealType *sums ) const;
+
+  /** Normalization of the k-neighborhood evaluation. */
+  RealType GetEvaluationNormalization() const;
+
+  struct EvaluateBatchThreadStruct
+    {
+    const Self                                 *Function;
+    const InputPointContainerType              *Points;
+    OutputContainerType                        *Values;
+    const std::vector<std::pair<long, unsigned long> > *SortedQueries;
+    };
+
 private:
   //purposely not implemented
   ManifoldParzenWindowsPointSetFunction( const Self& );
@@ -177,6 +270,21 @@ private:
   bool                                          m_Normalize;
   bool                                          m_UseAnisotropicCovariances;
   typename RandomizerType::Pointer              m_Randomizer;
+
+  bool                                          m_UseSpatialHashing;
+  RealType                                      m_CutoffSigma;
+  int                                           m_NumberOfThreads;
+
+  bool                                          m_SpatialHashIsValid;
+  unsigned long                                 m_NumberOfCachedGaussians;
+  std::vector<RealType>                         m_GaussianMeans;
+  std::vector<RealType>                         m_GaussianPrecisions;
+  std::vector<RealType>                         m_GaussianNormalizers;
+  RealType                                      m_GridOrigin[Dimension];
+  RealType                                      m_GridCellSize;
+  long                                          m_GridSize[Dimension];
+  std::vector<unsigned long>                    m_CellOffsets;
+  std::vector<unsigned long>                    m_CellGaussians;
 };
 
 } // end namespace itk
@@ -22,6 +22,8 @@
 #include "vnl/vnl_vector.h"
 #include "vnl/vnl_math.h"
 
+#include <algorithm>
+
 namespace itk
 {
 
@@ -45,6 +47,19 @@ ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
 
   this->m_Randomizer = RandomizerType::New();
   this->m_Randomizer->SetSeed();
+
+  this->m_UseSpatialHashing = false;
+  this->m_CutoffSigma = 5.0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  this->m_SpatialHashIsValid = false;
+  this->m_NumberOfCachedGaussians = 0;
+  this->m_GridCellSize = 1.0;
+  for( unsigned int d = 0; d < Dimension; d++ )
+    {
+    this->m_GridOrigin[d] = 0.0;
+    this->m_GridSize[d] = 0;
+    }
 }
 
 template <class TPointSet, class TOutput, class TCoordRep>
@@ -188,6 +203,12 @@ ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
       }
     ++It;
     }
+
+  this->m_SpatialHashIsValid = false;
+  if( this->m_UseSpatialHashing )
+    {
+    this->GenerateSpatialHash();
+    }
 }
 
 template <class TPointSet, class TOutput, class TCoordRep>
@@ -218,6 +239,493 @@ ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
   this->m_KdTreeGenerator->SetSample( this->m_SamplePoints );
   this->m_KdTreeGenerator->SetBucketSize( this->m_BucketSize );
   this->m_KdTreeGenerator->Update();
+
+  this->m_SpatialHashIsValid = false;
+  if( this->m_UseSpatialHashing )
+    {
+    this->GenerateSpatialHash();
+    }
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+void
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::GenerateSpatialHash()
+{
+  this->m_SpatialHashIsValid = false;
+
+  const unsigned long N = this->m_Gaussians.size();
+  this->m_NumberOfCachedGaussians = N;
+  if( N == 0 )
+    {
+    return;
+    }
+
+  /**
+   * Copy the Gaussians into structure-of-arrays buffers.  The Gaussians
+   * are evaluated unnormalized (see GaussianProbabilityDensityFunction),
+   * hence the unit normalizers.
+   */
+  this->m_GaussianMeans.resize( Dimension * N );
+  this->m_GaussianPrecisions.resize( PrecisionSize * N );
+  this->m_GaussianNormalizers.assign( N, 1.0 );
+
+  std::vector<RealType> radii( N );
+  for( unsigned long i = 0; i < N; i++ )
+    {
+    typename GaussianType::MeanType mean = this->m_Gaussians[i]->GetMean();
+    CovarianceMatrixType covariance = this->m_Gaussians[i]->GetCovariance();
+    CovarianceMatrixType precision
+      = this->m_Gaussians[i]->GetInverseCovariance();
+
+    // The largest row sum bounds the largest eigenvalue of the covariance.
+    RealType maxVariance = 0.0;
+    unsigned int k = 0;
+    for( unsigned int m = 0; m < Dimension; m++ )
+      {
+      this->m_GaussianMeans[m * N + i] = mean[m];
+
+      RealType rowSum = 0.0;
+      for( unsigned int n = 0; n < Dimension; n++ )
+        {
+        rowSum += vnl_math_abs( covariance( m, n ) );
+        }
+      maxVariance = vnl_math_max( maxVariance, rowSum );
+
+      for( unsigned int n = m; n < Dimension; n++ )
+        {
+        this->m_GaussianPrecisions[k++ * N + i] = precision( m, n );
+        }
+      }
+    radii[i] = this->m_CutoffSigma * vcl_sqrt( maxVariance );
+    }
+
+  /**
+   * Set up the grid.  The cell size is the median support diameter,
+   * doubled until the number of cells is reasonable.
+   */
+  RealType lower[Dimension];
+  RealType upper[Dimension];
+  for( unsigned int d = 0; d < Dimension; d++ )
+    {
+    lower[d] = NumericTraits<RealType>::max();
+    upper[d] = NumericTraits<RealType>::NonpositiveMin();
+    }
+  for( unsigned long i = 0; i < N; i++ )
+    {
+    for( unsigned int d = 0; d < Dimension; d++ )
+      {
+      lower[d] = vnl_math_min( lower[d],
+        this->m_GaussianMeans[d * N + i] - radii[i] );
+      upper[d] = vnl_math_max( upper[d],
+        this->m_GaussianMeans[d * N + i] + radii[i] );
+      }
+    }
+
+  std::vector<RealType> sortedRadii( radii );
+  std::nth_element( sortedRadii.begin(), sortedRadii.begin() + N / 2,
+    sortedRadii.end() );
+  this->m_GridCellSize = vnl_math_max( 2.0 * sortedRadii[N / 2],
+    static_cast<RealType>( 1e-6 ) );
+
+  const unsigned long maximumNumberOfCells = 1ul << 22;
+  unsigned long numberOfCells = 0;
+  while( true )
+    {
+    numberOfCells = 1;
+    for( unsigned int d = 0; d < Dimension; d++ )
+      {
+      this->m_GridOrigin[d] = lower[d];
+      this->m_GridSize[d] = static_cast<long>( vcl_floor(
+        ( upper[d] - lower[d] ) / this->m_GridCellSize ) ) + 1;
+      numberOfCells *= this->m_GridSize[d];
+      }
+    if( numberOfCells <= maximumNumberOfCells )
+      {
+      break;
+      }
+    this->m_GridCellSize *= 2.0;
+    }
+
+  /**
+   * Bin each Gaussian into all cells overlapped by its support in two
+   * passes (count, then fill) to obtain a compressed cell list.
+   */
+  this->m_CellOffsets.assign( numberOfCells + 1, 0 );
+  for( unsigned int pass = 0; pass < 2; pass++ )
+    {
+    std::vector<unsigned long> fill;
+    if( pass == 1 )
+      {
+      for( unsigned long c = 0; c < numberOfCells; c++ )
+        {
+        this->m_CellOffsets[c + 1] += this->m_CellOffsets[c];
+        }
+      this->m_CellGaussians.resize( this->m_CellOffsets[numberOfCells] );
+      fill.assign( this->m_CellOffsets.begin(), this->m_CellOffsets.end() - 1 );
+      }
+    for( unsigned long i = 0; i < N; i++ )
+      {
+      long first[Dimension];
+      long last[Dimension];
+      long cell[Dimension];
+      for( unsigned int d = 0; d < Dimension; d++ )
+        {
+        RealType mean = this->m_GaussianMeans[d * N + i];
+        first[d] = vnl_math_max( 0l, static_cast<long>( vcl_floor(
+          ( mean - radii[i] - this->m_GridOrigin[d] ) / this->m_GridCellSize ) ) );
+        last[d] = vnl_math_min( this->m_GridSize[d] - 1, static_cast<long>(
+          vcl_floor( ( mean + radii[i] - this->m_GridOrigin[d] )
+          / this->m_GridCellSize ) ) );
+        cell[d] = first[d];
+        }
+      bool done = false;
+      while( !done )
+        {
+        unsigned long id = 0;
+        unsigned long stride = 1;
+        for( unsigned int d = 0; d < Dimension; d++ )
+          {
+          id += cell[d] * stride;
+          stride *= this->m_GridSize[d];
+          }
+        if( pass == 0 )
+          {
+          this->m_CellOffsets[id + 1]++;
+          }
+        else
+          {
+          this->m_CellGaussians[fill[id]++] = i;
+          }
+
+        done = true;
+        for( unsigned int d = 0; d < Dimension; d++ )
+          {
+          if( ++cell[d] <= last[d] )
+            {
+            done = false;
+            break;
+            }
+          cell[d] = first[d];
+          }
+        }
+      }
+    }
+
+  this->m_SpatialHashIsValid = true;
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+long
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::GetCellIdentifier( const InputPointType &point ) const
+{
+  long id = 0;
+  long stride = 1;
+  for( unsigned int d = 0; d < Dimension; d++ )
+    {
+    RealType position = ( point[d] - this->m_GridOrigin[d] )
+      / this->m_GridCellSize;
+    if( position < 0.0 )
+      {
+      return -1;
+      }
+    long cell = static_cast<long>( position );
+    if( cell >= this->m_GridSize[d] )
+      {
+      return -1;
+      }
+    id += cell * stride;
+    stride *= this->m_GridSize[d];
+    }
+  return id;
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+void
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::EvaluateCellBlock( long cell, const RealType *coordinates,
+  unsigned int blockSize, RealType *sums ) const
+{
+  for( unsigned int b = 0; b < blockSize; b++ )
+    {
+    sums[b] = 0.0;
+    }
+
+  const unsigned long N = this->m_NumberOfCachedGaussians;
+  const RealType cutoff = vnl_math_sqr( this->m_CutoffSigma );
+
+  RealType mean[Dimension];
+  RealType precision[PrecisionSize];
+  RealType offset[Dimension];
+
+  for( unsigned long j = this->m_CellOffsets[cell];
+    j < this->m_CellOffsets[cell + 1]; j++ )
+    {
+    const unsigned long i = this->m_CellGaussians[j];
+    for( unsigned int d = 0; d < Dimension; d++ )
+      {
+      mean[d] = this->m_GaussianMeans[d * N + i];
+      }
+    for( unsigned int k = 0; k < PrecisionSize; k++ )
+      {
+      precision[k] = this->m_GaussianPrecisions[k * N + i];
+      }
+    const RealType normalizer = this->m_GaussianNormalizers[i];
+
+    // The Gaussian parameters are fixed over the block, so this loop
+    // runs over contiguous query coordinates.
+    for( unsigned int b = 0; b < blockSize; b++ )
+      {
+      for( unsigned int d = 0; d < Dimension; d++ )
+        {
+        offset[d] = coordinates[d * blockSize + b] - mean[d];
+        }
+      RealType distance = 0.0;
+      unsigned int k = 0;
+      for( unsigned int m = 0; m < Dimension; m++ )
+        {
+        distance += precision[k++] * offset[m] * offset[m];
+        for( unsigned int n = m + 1; n < Dimension; n++ )
+          {
+          distance += 2.0 * precision[k++] * offset[m] * offset[n];
+          }
+        }
+      sums[b] += ( distance <= cutoff )
+        ? normalizer * vcl_exp( -0.5 * distance ) : 0.0;
+      }
+    }
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+typename ManifoldParzenWindowsPointSetFunction
+  <TPointSet, TOutput, TCoordRep>::RealType
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::GetEvaluationNormalization() const
+{
+  if( !this->m_KdTreeGenerator )
+    {
+    return static_cast<RealType>( this->m_Gaussians.size() );
+    }
+  return static_cast<RealType>( vnl_math_min(
+    this->m_EvaluationKNeighborhood,
+    static_cast<unsigned int>( this->m_Gaussians.size() ) ) );
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+void
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::GetCachedPrecisionTimesOffset( unsigned long i,
+  const InputPointType &point, VectorType &result ) const
+{
+  const unsigned long N = this->m_NumberOfCachedGaussians;
+
+  RealType offset[Dimension];
+  for( unsigned int d = 0; d < Dimension; d++ )
+    {
+    offset[d] = this->m_GaussianMeans[d * N + i] - point[d];
+    result[d] = 0.0;
+    }
+  unsigned int k = 0;
+  for( unsigned int m = 0; m < Dimension; m++ )
+    {
+    for( unsigned int n = m; n < Dimension; n++ )
+      {
+      RealType p = this->m_GaussianPrecisions[k++ * N + i];
+      result[m] += p * offset[n];
+      if( n != m )
+        {
+        result[n] += p * offset[m];
+        }
+      }
+    }
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+typename ManifoldParzenWindowsPointSetFunction
+  <TPointSet, TOutput, TCoordRep>::RealType
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::GetContributingGaussians( const InputPointType &point,
+  GaussianIdentifierContainerType &ids,
+  GaussianValueContainerType &values ) const
+{
+  ids.clear();
+  values.clear();
+
+  MeasurementVectorType queryPoint;
+  for( unsigned int d = 0; d < Dimension; d++ )
+    {
+    queryPoint[d] = point[d];
+    }
+
+  if( this->m_SpatialHashIsValid )
+    {
+    long cell = this->GetCellIdentifier( point );
+    if( cell >= 0 )
+      {
+      const unsigned long N = this->m_NumberOfCachedGaussians;
+      const RealType cutoff = vnl_math_sqr( this->m_CutoffSigma );
+      for( unsigned long j = this->m_CellOffsets[cell];
+        j < this->m_CellOffsets[cell + 1]; j++ )
+        {
+        const unsigned long i = this->m_CellGaussians[j];
+        RealType offset[Dimension];
+        for( unsigned int d = 0; d < Dimension; d++ )
+          {
+          offset[d] = point[d] - this->m_GaussianMeans[d * N + i];
+          }
+        RealType distance = 0.0;
+        unsigned int k = 0;
+        for( unsigned int m = 0; m < Dimension; m++ )
+          {
+          for( unsigned int n = m; n < Dimension; n++ )
+            {
+            RealType p = this->m_GaussianPrecisions[k++ * N + i];
+            distance += ( n == m ? 1.0 : 2.0 ) * p * offset[m] * offset[n];
+            }
+          }
+        if( distance <= cutoff )
+          {
+          ids.push_back( i );
+          values.push_back( this->m_GaussianNormalizers[i]
+            * vcl_exp( -0.5 * distance ) );
+          }
+        }
+      }
+    return this->GetEvaluationNormalization();
+    }
+
+  unsigned int numberOfNeighbors = static_cast<unsigned int>(
+    this->GetEvaluationNormalization() );
+  if( !this->m_KdTreeGenerator || numberOfNeighbors == this->m_Gaussians.size() )
+    {
+    for( unsigned long i = 0; i < this->m_Gaussians.size(); i++ )
+      {
+      ids.push_back( i );
+      values.push_back( this->m_Gaussians[i]->Evaluate( queryPoint ) );
+      }
+    }
+  else
+    {
+    typename TreeGeneratorType::KdTreeType
+      ::InstanceIdentifierVectorType neighbors;
+    this->m_KdTreeGenerator->GetOutput()->Search( queryPoint,
+      numberOfNeighbors, neighbors );
+    for( unsigned int j = 0; j < neighbors.size(); j++ )
+      {
+      ids.push_back( neighbors[j] );
+      values.push_back(
+        this->m_Gaussians[neighbors[j]]->Evaluate( queryPoint ) );
+      }
+    }
+  return static_cast<RealType>( numberOfNeighbors );
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+void
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::EvaluateBatch( const InputPointContainerType &points,
+  OutputContainerType &values ) const
+{
+  values.resize( points.size() );
+
+  if( !this->m_SpatialHashIsValid )
+    {
+    for( unsigned long n = 0; n < points.size(); n++ )
+      {
+      values[n] = this->Evaluate( points[n] );
+      }
+    return;
+    }
+
+  // Order the queries by cell so that each block shares its Gaussians.
+  std::vector<std::pair<long, unsigned long> > sortedQueries( points.size() );
+  for( unsigned long n = 0; n < points.size(); n++ )
+    {
+    sortedQueries[n] = std::make_pair( this->GetCellIdentifier( points[n] ), n );
+    }
+  std::sort( sortedQueries.begin(), sortedQueries.end() );
+
+  EvaluateBatchThreadStruct str;
+  str.Function = this;
+  str.Points = &points;
+  str.Values = &values;
+  str.SortedQueries = &sortedQueries;
+
+  typename MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( vnl_math_max( 1, vnl_math_min(
+    this->m_NumberOfThreads, static_cast<int>( points.size() ) ) ) );
+  threader->SetSingleMethod( this->EvaluateBatchThreaderCallback, &str );
+  threader->SingleMethodExecute();
+}
+
+template <class TPointSet, class TOutput, class TCoordRep>
+ITK_THREAD_RETURN_TYPE
+ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
+::EvaluateBatchThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  EvaluateBatchThreadStruct *str = (EvaluateBatchThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const Self *function = str->Function;
+  const std::vector<std::pair<long, unsigned long> > &queries
+    = *str->SortedQueries;
+  const InputPointContainerType &points = *str->Points;
+  OutputContainerType &values = *str->Values;
+
+  const unsigned long numberOfQueries = queries.size();
+  const unsigned long begin = numberOfQueries * threadId / threadCount;
+  const unsigned long end = numberOfQueries * ( threadId + 1 ) / threadCount;
+
+  const RealType normalization = function->GetEvaluationNormalization();
+
+  const unsigned int maximumBlockSize = 64;
+  RealType coordinates[Dimension * maximumBlockSize];
+  RealType sums[maximumBlockSize];
+
+  unsigned long n = begin;
+  while( n < end )
+    {
+    const long cell = queries[n].first;
+    unsigned long blockEnd = n;
+    while( blockEnd < end && blockEnd - n < maximumBlockSize
+      && queries[blockEnd].first == cell )
+      {
+      blockEnd++;
+      }
+    const unsigned int blockSize = blockEnd - n;
+
+    if( cell < 0 )
+      {
+      for( unsigned int b = 0; b < blockSize; b++ )
+        {
+        values[queries[n + b].second] = NumericTraits<OutputType>::Zero;
+        }
+      }
+    else
+      {
+      for( unsigned int b = 0; b < blockSize; b++ )
+        {
+        const InputPointType &point = points[queries[n + b].second];
+        for( unsigned int d = 0; d < Dimension; d++ )
+          {
+          coordinates[d * blockSize + b] = point[d];
+          }
+        }
+      function->EvaluateCellBlock( cell, coordinates, blockSize, sums );
+      for( unsigned int b = 0; b < blockSize; b++ )
+        {
+        values[queries[n + b].second] =
+          static_cast<OutputType>( sums[b] / normalization );
+        }
+      }
+    n = blockEnd;
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
 }
 
 template <class TPointSet, class TOutput, class TCoordRep>
@@ -225,6 +733,23 @@ TOutput
 ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
 ::Evaluate( const InputPointType &point ) const
 {
+  if( this->m_SpatialHashIsValid )
+    {
+    long cell = this->GetCellIdentifier( point );
+    if( cell < 0 )
+      {
+      return NumericTraits<OutputType>::Zero;
+      }
+    RealType coordinates[Dimension];
+    for( unsigned int d = 0; d < Dimension; d++ )
+      {
+      coordinates[d] = point[d];
+      }
+    RealType sum = 0.0;
+    this->EvaluateCellBlock( cell, coordinates, 1, &sum );
+    return static_cast<OutputType>( sum / this->GetEvaluationNormalization() );
+    }
+
   if( !this->m_KdTreeGenerator )
     {
     MeasurementVectorType measurement;
@@ -361,6 +886,12 @@ ManifoldParzenWindowsPointSetFunction<TPointSet, TOutput, TCoordRep>
                << this->m_Normalize << std::endl;
   os << indent << "Use anisotropic covariances: "
                << this->m_UseAnisotropicCovariances << std::endl;
+  os << indent << "Use spatial hashing: "
+               << this->m_UseSpatialHashing << std::endl;
+  os << indent << "Cutoff sigma: "
+               << this->m_CutoffSigma << std::endl;
+  os << indent << "Number of threads: "
+               << this->m_NumberOfThreads << std::endl;
 }
 
 }  //end namespace itk
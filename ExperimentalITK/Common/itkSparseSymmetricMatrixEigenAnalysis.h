@@ -30,6 +30,10 @@ namespace itk
 {
   
 /** \class SparseSymmetricMatrixEigenAnalysis
+ *
+ * The matrix is only accessed through rows(), columns() and
+ * mult( x, y ) (y = A x), so besides vnl_sparse_matrix any symmetric
+ * operator with that interface, e.g. a matrix-free one, can be used.
  */  
 
 template < class TRealType = double, 
@@ -170,6 +170,12 @@ SparseSymmetricMatrixEigenAnalysis<TRealType, TSparseSymmetricMatrix, TEigenVect
     }
   double tol = static_cast<double>( this->m_Tolerance );
 
+  /**
+   * Reverse communication: ARPACK only asks for products with the matrix
+   */
+  VectorType result( this->m_Matrix->rows() );
+  VectorType rhs( this->m_Matrix->columns() );
+
   unsigned int iter = 0;
   while ( iter++ < this->m_MaximumNumberOfIterations )
     {
@@ -179,9 +185,6 @@ SparseSymmetricMatrixEigenAnalysis<TRealType, TSparseSymmetricMatrix, TEigenVect
 
     if ( ido == 1 || ido == -1 ) 
       {
-      VectorType result( this->m_Matrix->rows() );
-      VectorType rhs( this->m_Matrix->columns() );
-
       for ( unsigned int i = 0; i < this->m_Matrix->columns(); i++ )
         {
         rhs[i] = workd[ipntr[0]-1+i];
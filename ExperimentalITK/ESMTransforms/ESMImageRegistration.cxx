@@ -2,6 +2,7 @@
 #include "itkESMMeanSquaresImageToImageMetric.h"
 #include "itkLinearInterpolateImageFunction.h"
 #include "itkESMDogLegOptimizer.h"
+#include "itkESMMultiResolutionImageRegistrationMethod.h"
 #include "itkImage.h"
 
 #include "itkImageFileReader.h"
@@ -68,7 +69,7 @@ int main( int argc, char *argv[] )
     std::cerr << "Usage: " << argv[0];
     std::cerr << " fixedImageFile  movingImageFile ";
     std::cerr << "outputImagefile [differenceImageAfter]";
-    std::cerr << "[differenceImageBefore]" << std::endl;
+    std::cerr << "[differenceImageBefore] [numberOfLevels]" << std::endl;
     return EXIT_FAILURE;
     }
 
@@ -88,13 +89,18 @@ int main( int argc, char *argv[] )
   
   typedef itk:: LinearInterpolateImageFunction< 
     MovingImageType, double >                 InterpolatorType;
+
+  typedef itk::ESMMultiResolutionImageRegistrationMethod<
+    FixedImageType, MovingImageType >         RegistrationType;
   
   MetricType::Pointer         metric        = MetricType::New();
   TransformType::Pointer      transform     = TransformType::New();
   OptimizerType::Pointer      optimizer     = OptimizerType::New();
   InterpolatorType::Pointer   interpolator  = InterpolatorType::New();
+  RegistrationType::Pointer   registration  = RegistrationType::New();
 
-  optimizer->SetESMCostFunction( metric );
+  registration->SetMetric( metric );
+  registration->SetOptimizer( optimizer );
   
   metric->SetESMTransform( transform );
   metric->SetInterpolator(  interpolator  );
@@ -108,12 +114,23 @@ int main( int argc, char *argv[] )
   fixedImageReader->SetFileName(  argv[1] );
   movingImageReader->SetFileName( argv[2] );
   
-  metric->SetFixedImage(    fixedImageReader->GetOutput()    );
-  metric->SetMovingImage(   movingImageReader->GetOutput()   );
-  
   fixedImageReader->Update();
-  metric->SetFixedImageRegion( 
-                    fixedImageReader->GetOutput()->GetBufferedRegion() );
+  movingImageReader->Update();
+
+  registration->SetFixedImage(    fixedImageReader->GetOutput()    );
+  registration->SetMovingImage(   movingImageReader->GetOutput()   );
+
+  // With several levels, each one uses all its pixels, starting from a
+  // random quarter of them
+  const unsigned int numberOfLevels = ( argc > 6 ) ? atoi( argv[6] ) : 1;
+  registration->SetNumberOfLevels( numberOfLevels );
+  if( numberOfLevels > 1 )
+    {
+    metric->SetUseAllPixels( true );
+    optimizer->SetInitialSampleFraction( 0.25 );
+    optimizer->SetTrustRegionRadiusTolerance( 1e-4 );
+    optimizer->SetParameterChangeTolerance( 1e-5 );
+    }
   
   typedef OptimizerType::ParametersType ParametersType;
   ParametersType initialParameters( transform->GetNumberOfParameters() );
@@ -123,7 +140,7 @@ int main( int argc, char *argv[] )
     initialParameters[i] = 0.0;
     }
 
-  optimizer->SetInitialPosition( initialParameters );
+  registration->SetInitialTransformParameters( initialParameters );
   
   optimizer->SetMaximumNumberOfIterations( 10 );
 
@@ -133,7 +150,7 @@ int main( int argc, char *argv[] )
   
   try 
     { 
-    optimizer->StartOptimization();
+    registration->StartRegistration();
     } 
   catch( itk::ExceptionObject & err ) 
     { 
@@ -142,9 +159,9 @@ int main( int argc, char *argv[] )
     return EXIT_FAILURE;
     }
 
-  ParametersType finalParameters = optimizer->GetOptimalParameters();
+  ParametersType finalParameters = registration->GetLastTransformParameters();
   
-  const unsigned int numberOfIterations = optimizer->GetCurrentIteration();
+  const unsigned int numberOfIterations = registration->GetTotalNumberOfIterations();
   
   const double bestValue = optimizer->GetOptimalValue();
   
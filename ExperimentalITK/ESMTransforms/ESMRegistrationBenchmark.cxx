@@ -0,0 +1,260 @@
+#include "itkESMRigid2DTransform.h"
+#include "itkESMMeanSquaresImageToImageMetric.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkESMDogLegOptimizer.h"
+#include "itkESMMultiResolutionImageRegistrationMethod.h"
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkTimeProbe.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// Compares the single-level ESM registration using all the pixels with
+// the multi-resolution one starting each level on a random subset of
+// the pixels, on synthetic images related by known rigid motions.
+
+const    unsigned int    Dimension = 2;
+typedef  float           PixelType;
+
+typedef itk::Image< PixelType, Dimension >  ImageType;
+
+typedef itk::ESMRigid2DTransform< double >  TransformType;
+
+typedef itk::ESMDogLegOptimizer<
+  ImageType, ImageType >                    OptimizerType;
+
+typedef itk::ESMMeanSquaresImageToImageMetric<
+  ImageType, ImageType >                    MetricType;
+
+typedef itk::LinearInterpolateImageFunction<
+  ImageType, double >                       InterpolatorType;
+
+typedef itk::ESMMultiResolutionImageRegistrationMethod<
+  ImageType, ImageType >                    RegistrationType;
+
+typedef OptimizerType::ParametersType       ParametersType;
+
+
+struct Blob
+{
+  double x;
+  double y;
+  double sigma;
+  double amplitude;
+};
+
+struct RunResult
+{
+  unsigned long iterations;
+  double        time;
+  double        angleError;
+  double        translationError;
+};
+
+
+// Image of a sum of Gaussian blobs, seen through the inverse of the
+// rigid motion (angle, tx, ty) around center (cx, cy).
+ImageType::Pointer
+MakeBlobImage( unsigned int size, const std::vector<Blob> & blobs,
+               double angle, double tx, double ty, double cx, double cy )
+{
+  ImageType::SizeType imageSize;
+  imageSize.Fill( size );
+  ImageType::RegionType region;
+  region.SetSize( imageSize );
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( region );
+  image->Allocate();
+
+  const double ca = std::cos( angle );
+  const double sa = std::sin( angle );
+
+  itk::ImageRegionIteratorWithIndex< ImageType > it( image, region );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const double dx = it.GetIndex()[0] - cx - tx;
+    const double dy = it.GetIndex()[1] - cy - ty;
+    const double x =  ca * dx + sa * dy + cx;
+    const double y = -sa * dx + ca * dy + cy;
+
+    double value = 0.0;
+    for( unsigned int b = 0; b < blobs.size(); ++b )
+      {
+      const double r2 = ( x - blobs[b].x ) * ( x - blobs[b].x )
+        + ( y - blobs[b].y ) * ( y - blobs[b].y );
+      value += blobs[b].amplitude
+        * std::exp( -r2 / ( 2.0 * blobs[b].sigma * blobs[b].sigma ) );
+      }
+    it.Set( static_cast<PixelType>( value ) );
+    }
+
+  return image;
+}
+
+
+RunResult
+Register( const ImageType * fixedImage, const ImageType * movingImage,
+          unsigned int numberOfLevels, double initialSampleFraction,
+          const ParametersType & truth, double cx, double cy )
+{
+  MetricType::Pointer         metric        = MetricType::New();
+  TransformType::Pointer      transform     = TransformType::New();
+  OptimizerType::Pointer      optimizer     = OptimizerType::New();
+  InterpolatorType::Pointer   interpolator  = InterpolatorType::New();
+  RegistrationType::Pointer   registration  = RegistrationType::New();
+
+  TransformType::InputPointType center;
+  center[0] = cx;
+  center[1] = cy;
+  transform->SetIdentity();
+  transform->SetCenter( center );
+
+  metric->SetESMTransform( transform );
+  metric->SetInterpolator( interpolator );
+  metric->SetUseAllPixels( true );
+
+  optimizer->SetMaximumNumberOfIterations( 100 );
+  optimizer->SetInitialSampleFraction( initialSampleFraction );
+  if( numberOfLevels > 1 )
+    {
+    optimizer->SetTrustRegionRadiusTolerance( 1e-4 );
+    optimizer->SetParameterChangeTolerance( 1e-5 );
+    }
+
+  registration->SetFixedImage( fixedImage );
+  registration->SetMovingImage( movingImage );
+  registration->SetMetric( metric );
+  registration->SetOptimizer( optimizer );
+  registration->SetNumberOfLevels( numberOfLevels );
+  registration->SetInitialTransformParameters( transform->GetParameters() );
+
+  itk::TimeProbe probe;
+  probe.Start();
+  registration->StartRegistration();
+  probe.Stop();
+
+  const ParametersType & result = registration->GetLastTransformParameters();
+
+  RunResult run;
+  run.iterations = registration->GetTotalNumberOfIterations();
+  run.time = probe.GetMeanTime();
+  run.angleError = std::fabs( result[0] - truth[0] );
+  run.translationError = std::sqrt(
+    ( result[1] - truth[1] ) * ( result[1] - truth[1] )
+    + ( result[2] - truth[2] ) * ( result[2] - truth[2] ) );
+
+  return run;
+}
+
+
+void
+PrintRun( const char * name, const RunResult & run )
+{
+  std::cout << "  " << std::setw(12) << name
+            << std::setw(8)  << run.iterations
+            << std::setw(12) << run.time
+            << std::setw(14) << run.angleError
+            << std::setw(14) << run.translationError << std::endl;
+}
+
+
+int main( int argc, char *argv[] )
+{
+  if( argc > 1 && std::string( argv[1] ) == "-h" )
+    {
+    std::cerr << "Usage: " << argv[0];
+    std::cerr << " [numberOfTrials] [imageSize] [numberOfLevels]";
+    std::cerr << " [initialSampleFraction] [seed]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const unsigned int numberOfTrials = ( argc > 1 ) ? atoi( argv[1] ) : 10;
+  const unsigned int size = ( argc > 2 ) ? atoi( argv[2] ) : 256;
+  const unsigned int numberOfLevels = ( argc > 3 ) ? atoi( argv[3] ) : 3;
+  const double initialSampleFraction = ( argc > 4 ) ? atof( argv[4] ) : 0.25;
+  const int seed = ( argc > 5 ) ? atoi( argv[5] ) : 12345;
+
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+  GeneratorType::Pointer generator = GeneratorType::GetInstance();
+  generator->SetSeed( seed );
+
+  const double cx = 0.5 * ( size - 1 );
+  const double cy = 0.5 * ( size - 1 );
+
+  std::vector<Blob> blobs( 12 );
+  for( unsigned int b = 0; b < blobs.size(); ++b )
+    {
+    blobs[b].x = generator->GetUniformVariate( 0.2 * size, 0.8 * size );
+    blobs[b].y = generator->GetUniformVariate( 0.2 * size, 0.8 * size );
+    blobs[b].sigma = generator->GetUniformVariate( 0.03 * size, 0.08 * size );
+    blobs[b].amplitude = generator->GetUniformVariate( 50.0, 200.0 );
+    }
+
+  ImageType::Pointer fixedImage =
+    MakeBlobImage( size, blobs, 0.0, 0.0, 0.0, cx, cy );
+
+  RunResult singleTotal = { 0, 0.0, 0.0, 0.0 };
+  RunResult multiTotal = { 0, 0.0, 0.0, 0.0 };
+
+  std::cout << std::setw(14) << "run"
+            << std::setw(8)  << "iter"
+            << std::setw(12) << "time (s)"
+            << std::setw(14) << "angle err"
+            << std::setw(14) << "transl. err" << std::endl;
+
+  for( unsigned int trial = 0; trial < numberOfTrials; ++trial )
+    {
+    ParametersType truth( 3 );
+    truth[0] = generator->GetUniformVariate( -0.15, 0.15 );
+    truth[1] = generator->GetUniformVariate( -0.04 * size, 0.04 * size );
+    truth[2] = generator->GetUniformVariate( -0.04 * size, 0.04 * size );
+
+    ImageType::Pointer movingImage =
+      MakeBlobImage( size, blobs, truth[0], truth[1], truth[2], cx, cy );
+
+    std::cout << "Trial " << trial << ": " << truth << std::endl;
+
+    try
+      {
+      const RunResult single = Register( fixedImage, movingImage,
+        1, 1.0, truth, cx, cy );
+      const RunResult multi = Register( fixedImage, movingImage,
+        numberOfLevels, initialSampleFraction, truth, cx, cy );
+
+      PrintRun( "single", single );
+      PrintRun( "multi", multi );
+
+      singleTotal.iterations += single.iterations;
+      singleTotal.time += single.time;
+      singleTotal.angleError += single.angleError;
+      singleTotal.translationError += single.translationError;
+
+      multiTotal.iterations += multi.iterations;
+      multiTotal.time += multi.time;
+      multiTotal.angleError += multi.angleError;
+      multiTotal.translationError += multi.translationError;
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      std::cerr << "ExceptionObject caught !" << std::endl;
+      std::cerr << err << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  if( numberOfTrials > 0 )
+    {
+    std::cout << "Totals over " << numberOfTrials << " trials:" << std::endl;
+    PrintRun( "single", singleTotal );
+    PrintRun( "multi", multiTotal );
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -56,6 +56,25 @@ public:
   itkSetMacro( InitialTrustRegionRadius, double );
   itkGetConstReferenceMacro( InitialTrustRegionRadius, double );
 
+  /** Fraction of the metric samples used by the first iterations.
+   * The number of active samples is doubled each time the trust region
+   * shrinks or the optimizer converges on the current subset, until
+   * all the samples are used. The default (1.0) always uses all the
+   * samples. A fraction below 1.0 turns the metric's
+   * UseFixedImageSampleSubsets on. */
+  itkSetClampMacro( InitialSampleFraction, double, 0.0, 1.0 );
+  itkGetConstReferenceMacro( InitialSampleFraction, double );
+
+  /** Stop when the trust region radius falls below this value
+   * (0, the default, disables this test). */
+  itkSetMacro( TrustRegionRadiusTolerance, double );
+  itkGetConstReferenceMacro( TrustRegionRadiusTolerance, double );
+
+  /** Stop when an accepted step is shorter than this value
+   * (0, the default, disables this test). */
+  itkSetMacro( ParameterChangeTolerance, double );
+  itkGetConstReferenceMacro( ParameterChangeTolerance, double );
+
 protected:
   ESMDogLegOptimizer();
   virtual ~ESMDogLegOptimizer(){};
@@ -75,6 +94,10 @@ protected:
 
   virtual DogLegStepType GetDogLegStep(ParametersType & step, double & beta);
 
+  /** Double the number of active metric samples. Returns false if all
+   * the samples are already in use. */
+  virtual bool GrowSampleSubset();
+
   ParametersType                   m_GaussNewtonStep;
   ParametersType                   m_SteepestDescentStep;
   ParametersType                   m_DogLegStep;
@@ -82,6 +105,10 @@ protected:
   double                           m_InitialTrustRegionRadius;
   double                           m_TrustRegionRadius;
 
+  double                           m_InitialSampleFraction;
+  double                           m_TrustRegionRadiusTolerance;
+  double                           m_ParameterChangeTolerance;
+
 private:
   ESMDogLegOptimizer(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
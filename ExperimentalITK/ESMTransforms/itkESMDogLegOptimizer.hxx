@@ -11,6 +11,9 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
 ::ESMDogLegOptimizer()
    :Superclass()
    ,m_InitialTrustRegionRadius(10.0)
+   ,m_InitialSampleFraction(1.0)
+   ,m_TrustRegionRadiusTolerance(0.0)
+   ,m_ParameterChangeTolerance(0.0)
 {
 }
 
@@ -20,6 +23,15 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
 ::PrintSelf(std::ostream& os, Indent indent) const
 {
   Superclass::PrintSelf(os, indent);
+
+  os << indent << "InitialTrustRegionRadius: "
+     << m_InitialTrustRegionRadius << std::endl;
+  os << indent << "InitialSampleFraction: "
+     << m_InitialSampleFraction << std::endl;
+  os << indent << "TrustRegionRadiusTolerance: "
+     << m_TrustRegionRadiusTolerance << std::endl;
+  os << indent << "ParameterChangeTolerance: "
+     << m_ParameterChangeTolerance << std::endl;
 }
 
 template <class TFixedImage, class TMovingImage >
@@ -27,8 +39,23 @@ void
 ESMDogLegOptimizer<TFixedImage,TMovingImage>
 ::InitOptimization()
 {
+   // Start from a random subset of the samples if asked to
+   const bool useSubsets = ( this->m_InitialSampleFraction < 1.0 );
+   this->m_ESMCostFunction->SetUseFixedImageSampleSubsets( useSubsets );
+   this->m_ESMCostFunction->SetNumberOfActiveFixedImageSamples( 0 );
+
    this->Superclass::InitOptimization();
 
+   if ( useSubsets )
+   {
+      const unsigned long numberOfSamples =
+         this->m_ESMCostFunction->GetNumberOfFixedImageSamples();
+      const unsigned long numberOfActiveSamples = static_cast<unsigned long>(
+         this->m_InitialSampleFraction * numberOfSamples );
+      this->m_ESMCostFunction->SetNumberOfActiveFixedImageSamples(
+         std::max( numberOfActiveSamples, 1UL ) );
+   }
+
    const unsigned int spaceDimension = this->m_ESMCostFunction->GetNumberOfParameters();
 
    this->m_GaussNewtonStep.set_size( spaceDimension );
@@ -85,6 +112,30 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
    return TrueDogLegStep;
 }
 
+template <class TFixedImage, class TMovingImage >
+bool
+ESMDogLegOptimizer<TFixedImage,TMovingImage>
+::GrowSampleSubset()
+{
+   const unsigned long numberOfSamples =
+      this->m_ESMCostFunction->GetNumberOfFixedImageSamples();
+   const unsigned long numberOfActiveSamples =
+      this->m_ESMCostFunction->GetNumberOfActiveFixedImageSamples();
+
+   if ( numberOfActiveSamples >= numberOfSamples )
+   {
+      return false;
+   }
+
+   this->m_ESMCostFunction->SetNumberOfActiveFixedImageSamples(
+      std::min( 2*numberOfActiveSamples, numberOfSamples ) );
+
+   // Values computed on different subsets cannot be compared
+   this->m_OptimalValue = NumericTraits<MeasureType>::max();
+
+   return true;
+}
+
 template <class TFixedImage, class TMovingImage >
 void
 ESMDogLegOptimizer<TFixedImage,TMovingImage>
@@ -130,6 +181,10 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
    const double nx = this->GetCurrentPosition().two_norm();
    if ( nh <= this->m_SoftStepSizeTolerance*(nx+this->m_SoftStepSizeTolerance) )
    {
+      if ( this->GrowSampleSubset() )
+      {
+         return;
+      }
       this->m_StopCondition = Superclass::SoftStepSizeToleranceReached;
       this->m_StopConditionDescription << "The step size is too small. ||h||=" << nh
                                        << " ||x||="<<nx;
@@ -203,9 +258,14 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
       // This replaces ApplyUpdate
       this->SetCurrentPosition( newparams );
 
-      // Check if we can stop here
+      // Check if we can stop here. Convergence on a subset of the
+      // samples only means that it is time to use more of them.
       if ( newvalue <= this->m_MeasureTolerance )
       {
+         if ( this->GrowSampleSubset() )
+         {
+            return;
+         }
          ///\todo use the infinity norm
          this->m_StopCondition = Superclass::MeasureToleranceReached;
          this->m_StopConditionDescription << "Measure tolerance reached. Value=" << newvalue;
@@ -216,12 +276,28 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
       const double ng_inf = this->m_Gradient.inf_norm();
       if ( ng_inf <= this->m_GradientTolerance )
       {
+         if ( this->GrowSampleSubset() )
+         {
+            return;
+         }
          ///\todo use the infinity norm
          this->m_StopCondition = Superclass::GradientToleranceReached;
          this->m_StopConditionDescription << "Gradient tolerance reached. Value=" << ng_inf;
          this->StopOptimization();
          return;
       }
+
+      if ( nh < this->m_ParameterChangeTolerance )
+      {
+         if ( this->GrowSampleSubset() )
+         {
+            return;
+         }
+         this->m_StopCondition = Superclass::ParameterChangeToleranceReached;
+         this->m_StopConditionDescription << "Parameter change tolerance reached. ||h||=" << nh;
+         this->StopOptimization();
+         return;
+      }
    }
 
    if ( pho > 0.75 )
@@ -234,6 +310,13 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
       // Decrease the trust region
       this->m_TrustRegionRadius /= 2.0;
 
+      // A poor agreement with the model may come from using too few
+      // samples: grow the subset before testing the radius
+      if ( this->GrowSampleSubset() )
+      {
+         return;
+      }
+
       // Check if the new trust region is small compared to eps2^2 or small
       // compared to eps2*x
       if ( this->m_TrustRegionRadius <= this->m_SoftStepSizeTolerance*(nx+this->m_SoftStepSizeTolerance) )
@@ -245,6 +328,15 @@ ESMDogLegOptimizer<TFixedImage,TMovingImage>
          this->StopOptimization();
          return;
       }
+
+      if ( this->m_TrustRegionRadius < this->m_TrustRegionRadiusTolerance )
+      {
+         this->m_StopCondition = Superclass::TrustRegionRadiusToleranceReached;
+         this->m_StopConditionDescription << "Trust region radius tolerance reached. Delta="
+                                          << this->m_TrustRegionRadius;
+         this->StopOptimization();
+         return;
+      }
    }
 }
 
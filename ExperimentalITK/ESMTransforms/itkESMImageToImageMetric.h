@@ -195,6 +195,32 @@ public:
       return this->GetNumberOfFixedImageSamples();
    }
 
+   /** Only the first NumberOfActiveFixedImageSamples samples are used to
+    * compute the metric; zero (the default) uses all of them. Changing
+    * it does not require a new initialization, so an optimizer can start
+    * on a subset of the samples and grow it as it converges. */
+   void SetNumberOfActiveFixedImageSamples( unsigned long numSamples )
+   {
+      m_NumberOfActiveFixedImageSamples = numSamples;
+   }
+   unsigned long GetNumberOfActiveFixedImageSamples( void ) const
+   {
+      const unsigned long numberOfSamples = m_FixedImageSamples.size();
+      if( m_NumberOfActiveFixedImageSamples == 0
+          || m_NumberOfActiveFixedImageSamples > numberOfSamples )
+      {
+         return numberOfSamples;
+      }
+      return m_NumberOfActiveFixedImageSamples;
+   }
+
+   /** If set, the samples are put in random order at initialization so
+    * that the active subsets are spread over the fixed image region
+    * rather than taken from its first rows. */
+   itkSetMacro( UseFixedImageSampleSubsets, bool );
+   itkGetConstReferenceMacro( UseFixedImageSampleSubsets, bool );
+   itkBooleanMacro( UseFixedImageSampleSubsets );
+
    /** Select whether the metric will be computed using all the pixels on the
     * fixed image region, or only using a set of randomly selected pixels.
     * This value override IntensityThreshold, Masks, and SequentialSampling. */
@@ -284,10 +310,27 @@ protected:
    /** Container to store a set of points and fixed image values. */
    FixedImageSampleContainer   m_FixedImageSamples;
 
+   /** Fixed image side of the samples, which does not change during the
+    * optimization. Filled by MultiThreadingInitialize as flat arrays:
+    * for sample s, the fixed image gradient starts at
+    * m_FixedImageSampleGradients[s*ImageDimension], the incremental
+    * update Jacobian (ImageDimension x NumberOfParameters, row major) at
+    * m_FixedImageSampleJacobians[s*ImageDimension*NumberOfParameters]
+    * and the product gradient^T * Jacobian at
+    * m_FixedImageSampleJacobianGradients[s*NumberOfParameters]. */
+   std::vector<double>         m_FixedImageSampleGradients;
+   std::vector<double>         m_FixedImageSampleJacobians;
+   std::vector<double>         m_FixedImageSampleJacobianGradients;
+
+   /** Fill the fixed image sample gradients and Jacobians. */
+   virtual void PrecomputeFixedImageSamples( void );
+
    unsigned long               m_NumberOfParameters;
    mutable ParametersType      m_Parameters;
 
    unsigned long               m_NumberOfFixedImageSamples;
+   unsigned long               m_NumberOfActiveFixedImageSamples;
+   bool                        m_UseFixedImageSampleSubsets;
    //m_NumberOfPixelsCounted must be mutable because the const
    //thread consolidation functions merge each threads valus
    //onto this accumulator variable.
@@ -355,6 +398,44 @@ protected:
    virtual void ComputeFixedImageDerivatives( const PointType & fixedPoint,
                                               ImageDerivativesType & gradient ) const;
 
+   /** ESM Jacobian of a sample,
+    *   ( movingGradient^T * SpatialJacobian + fixedGradient^T )
+    *     * IncrementalUpdateJacobian,
+    * using the precomputed fixed image side. The result is written to a
+    * buffer of the thread and stays valid until the next call. */
+   const double * ComputeSampleJacobian( unsigned int threadID,
+                                         unsigned long fixedImageSample,
+                                         const ImageDerivativesType & movingImageGradientValue ) const;
+
+   /** Symmetric NumberOfParameters x NumberOfParameters matrices are
+    * accumulated as their upper triangle, row by row. */
+   typedef std::vector<double>                                 PackedHessianType;
+
+   /** packedHessian += jacobian * jacobian^T */
+   static inline void AccumulatePackedHessian( const double * jacobian,
+                                               unsigned int numberOfParameters,
+                                               double * packedHessian )
+   {
+      for( unsigned int i=0; i<numberOfParameters; ++i )
+      {
+         const double jacobian_i = jacobian[i];
+         const double * jacobian_j = jacobian + i;
+         const unsigned int length = numberOfParameters - i;
+         for( unsigned int j=0; j<length; ++j )
+         {
+            packedHessian[j] += jacobian_i * jacobian_j[j];
+         }
+         packedHessian += length;
+      }
+   }
+
+   /** hessian += unpacked packedHessian */
+   void AddPackedHessian( const PackedHessianType & packedHessian,
+                          HessianType & hessian ) const;
+
+   /** Per-thread buffers of ComputeSampleJacobian */
+   DerivativeType                                     * m_ThreaderSampleJacobians;
+
 
    /**
     * Types and variables related to multi-threading
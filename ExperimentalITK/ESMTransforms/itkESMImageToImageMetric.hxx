@@ -7,6 +7,7 @@
 #include <itkImageRandomConstIteratorWithIndex.h>
 #include <itkLinearInterpolateImageFunction.h>
 #include <itkMersenneTwisterRandomVariateGenerator.h>
+#include <algorithm>
 
 namespace itk
 {
@@ -23,6 +24,8 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
    m_UseAllPixels = false;
    m_UseSequentialSampling = false;
    m_UseFixedImageIndexes = false;
+   m_NumberOfActiveFixedImageSamples = 0;
+   m_UseFixedImageSampleSubsets = false;
    m_ReseedIterator = false;
    m_RandomSeed = -1;
 
@@ -34,6 +37,7 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
 
    m_ESMTransform         = NULL; // has to be provided by the user.
    m_ThreaderESMTransform = NULL; // constructed at initialization.
+   m_ThreaderSampleJacobians = NULL;
 
    // For convenience
    this->m_Interpolator  = itk::LinearInterpolateImageFunction<TMovingImage>::New();
@@ -60,6 +64,12 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
       delete [] m_ThreaderESMTransform;
    }
    m_ThreaderESMTransform = NULL;
+
+   if(m_ThreaderSampleJacobians != NULL)
+   {
+      delete [] m_ThreaderSampleJacobians;
+   }
+   m_ThreaderSampleJacobians = NULL;
 }
 
 /**
@@ -352,6 +362,21 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
       }
    }
 
+   if( m_UseFixedImageSampleSubsets )
+   {
+      //
+      // Put the samples in random order so that any leading subset
+      // is spread over the whole fixed image region.
+      //
+      typedef Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+      GeneratorType::Pointer generator = GeneratorType::GetInstance();
+      for( unsigned long i = m_FixedImageSamples.size(); i > 1; --i )
+      {
+         const unsigned long j = generator->GetIntegerVariate( i - 1 );
+         std::swap( m_FixedImageSamples[i-1], m_FixedImageSamples[j] );
+      }
+   }
+
    m_DerivativeCalculator = DerivativeFunctionType::New();
    m_FixedDerivativeCalculator = FixedDerivativeFunctionType::New();
 
@@ -362,6 +387,145 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
 
    m_DerivativeCalculator->SetInputImage( this->m_MovingImage );
    m_FixedDerivativeCalculator->SetInputImage( this->m_FixedImage );
+
+   if(m_ThreaderSampleJacobians != NULL)
+   {
+      delete [] m_ThreaderSampleJacobians;
+   }
+   m_ThreaderSampleJacobians = new DerivativeType[m_NumberOfThreads];
+   for( unsigned int ithread=0; ithread < m_NumberOfThreads; ++ithread)
+   {
+      m_ThreaderSampleJacobians[ithread].SetSize( this->m_NumberOfParameters );
+   }
+
+   this->PrecomputeFixedImageSamples();
+}
+
+
+/**
+ * Precompute the fixed image gradients and incremental update Jacobians
+ * of the samples
+ */
+template <class TFixedImage, class TMovingImage>
+void
+ESMImageToImageMetric<TFixedImage,TMovingImage>
+::PrecomputeFixedImageSamples( void )
+{
+   const unsigned long numberOfSamples = m_FixedImageSamples.size();
+   const unsigned int numberOfParameters = this->m_NumberOfParameters;
+
+   m_FixedImageSampleGradients.resize( numberOfSamples * ImageDimension );
+   m_FixedImageSampleJacobians.resize(
+      numberOfSamples * ImageDimension * numberOfParameters );
+   m_FixedImageSampleJacobianGradients.resize(
+      numberOfSamples * numberOfParameters );
+
+   ImageDerivativesType fixedImageGradient;
+   for( unsigned long sample=0; sample < numberOfSamples; ++sample )
+   {
+      const PointType & fixedImagePoint = m_FixedImageSamples[sample].point;
+
+      this->ComputeFixedImageDerivatives( fixedImagePoint, fixedImageGradient );
+
+      // The incremental update is composed on the right of the current
+      // transform, so its Jacobian does not depend on the parameters.
+      const TransformJacobianType & increment_jac =
+         this->m_ESMTransform->GetIncrementalUpdateJacobian( fixedImagePoint );
+
+      double * gradient = &m_FixedImageSampleGradients[sample*ImageDimension];
+      double * jacobian = &m_FixedImageSampleJacobians[
+         sample*ImageDimension*numberOfParameters];
+      double * jacobianGradient = &m_FixedImageSampleJacobianGradients[
+         sample*numberOfParameters];
+
+      for( unsigned int p=0; p<numberOfParameters; ++p )
+      {
+         jacobianGradient[p] = 0.0;
+      }
+      for( unsigned int d=0; d<ImageDimension; ++d )
+      {
+         gradient[d] = fixedImageGradient[d];
+         for( unsigned int p=0; p<numberOfParameters; ++p )
+         {
+            jacobian[d*numberOfParameters+p] = increment_jac(d,p);
+            jacobianGradient[p] += fixedImageGradient[d] * increment_jac(d,p);
+         }
+      }
+   }
+}
+
+template <class TFixedImage, class TMovingImage>
+const double *
+ESMImageToImageMetric<TFixedImage,TMovingImage>
+::ComputeSampleJacobian( unsigned int threadID,
+                         unsigned long fixedImageSample,
+                         const ImageDerivativesType & movingImageGradientValue ) const
+{
+   ESMTransformType * transform;
+
+   if( threadID > 0 )
+   {
+      transform = this->m_ThreaderESMTransform[threadID-1];
+   }
+   else
+   {
+      transform = this->m_ESMTransform;
+   }
+
+   const unsigned int numberOfParameters = this->m_NumberOfParameters;
+
+   const TransformJacobianType & spatial_jac = transform->GetSpatialJacobian(
+      this->m_FixedImageSamples[fixedImageSample].point );
+
+   // movingGradient^T * SpatialJacobian
+   double movingGradient[ImageDimension];
+   for( unsigned int d=0; d<ImageDimension; ++d )
+   {
+      movingGradient[d] = 0.0;
+      for( unsigned int k=0; k<ImageDimension; ++k )
+      {
+         movingGradient[d] += movingImageGradientValue[k] * spatial_jac(k,d);
+      }
+   }
+
+   const double * jacobian = &m_FixedImageSampleJacobians[
+      fixedImageSample*ImageDimension*numberOfParameters];
+   const double * jacobianGradient = &m_FixedImageSampleJacobianGradients[
+      fixedImageSample*numberOfParameters];
+
+   double * result = m_ThreaderSampleJacobians[threadID].data_block();
+   for( unsigned int p=0; p<numberOfParameters; ++p )
+   {
+      result[p] = jacobianGradient[p];
+   }
+   for( unsigned int d=0; d<ImageDimension; ++d )
+   {
+      const double * jacobian_d = jacobian + d*numberOfParameters;
+      for( unsigned int p=0; p<numberOfParameters; ++p )
+      {
+         result[p] += movingGradient[d] * jacobian_d[p];
+      }
+   }
+
+   return result;
+}
+
+template <class TFixedImage, class TMovingImage>
+void
+ESMImageToImageMetric<TFixedImage,TMovingImage>
+::AddPackedHessian( const PackedHessianType & packedHessian,
+                    HessianType & hessian ) const
+{
+   unsigned int k = 0;
+   for( unsigned int i=0; i<this->m_NumberOfParameters; ++i )
+   {
+      hessian(i,i) += packedHessian[k++];
+      for( unsigned int j=i+1; j<this->m_NumberOfParameters; ++j, ++k )
+      {
+         hessian(i,j) += packedHessian[k];
+         hessian(j,i) += packedHessian[k];
+      }
+   }
 }
 
 
@@ -783,8 +947,12 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
          this->ComputeImageDerivatives( mappedPoint, movingImageGradient );
          movingImageValue = this->m_Interpolator->Evaluate( mappedPoint );
 
-         this->ComputeFixedImageDerivatives(
-            this->m_FixedImageSamples[sampleNumber].point, fixedImageGradient );
+         const double * gradient =
+            &m_FixedImageSampleGradients[sampleNumber*ImageDimension];
+         for( unsigned int d=0; d<ImageDimension; ++d )
+         {
+            fixedImageGradient[d] = gradient[d];
+         }
       }
    }
 }
@@ -949,14 +1117,16 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
 ::GetValueThread( unsigned int threadID ) const
 {
    // Figure out how many samples to process
-   int chunkSize = m_NumberOfFixedImageSamples / m_NumberOfThreads;
+   const unsigned long numberOfActiveSamples =
+      this->GetNumberOfActiveFixedImageSamples();
+   int chunkSize = numberOfActiveSamples / m_NumberOfThreads;
 
    // Skip to this thread's samples to process
    unsigned int fixedImageSample = threadID * chunkSize;
 
    if(threadID == m_NumberOfThreads - 1)
    {
-      chunkSize = m_NumberOfFixedImageSamples
+      chunkSize = numberOfActiveSamples
          - ((m_NumberOfThreads-1)
             * chunkSize);
    }
@@ -1112,14 +1282,16 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
 ::GetValueAndDerivativeThread( unsigned int threadID ) const
 {
    // Figure out how many samples to process
-   int chunkSize = m_NumberOfFixedImageSamples / m_NumberOfThreads;
+   const unsigned long numberOfActiveSamples =
+      this->GetNumberOfActiveFixedImageSamples();
+   int chunkSize = numberOfActiveSamples / m_NumberOfThreads;
 
    // Skip to this thread's samples to process
    unsigned int fixedImageSample = threadID * chunkSize;
 
    if(threadID == m_NumberOfThreads - 1)
    {
-      chunkSize = m_NumberOfFixedImageSamples
+      chunkSize = numberOfActiveSamples
          - ((m_NumberOfThreads-1)
             * chunkSize);
    }
@@ -1284,14 +1456,16 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
 ::GetValueDerivativeAndHessianThread( unsigned int threadID ) const
 {
    // Figure out how many samples to process
-   int chunkSize = m_NumberOfFixedImageSamples / m_NumberOfThreads;
+   const unsigned long numberOfActiveSamples =
+      this->GetNumberOfActiveFixedImageSamples();
+   int chunkSize = numberOfActiveSamples / m_NumberOfThreads;
 
    // Skip to this thread's samples to process
    unsigned int fixedImageSample = threadID * chunkSize;
 
    if(threadID == m_NumberOfThreads - 1)
    {
-      chunkSize = m_NumberOfFixedImageSamples
+      chunkSize = numberOfActiveSamples
          - ((m_NumberOfThreads-1)
             * chunkSize);
    }
@@ -1384,6 +1558,11 @@ ESMImageToImageMetric<TFixedImage,TMovingImage>
    os << indent << "UseAllPixels: ";
    os << m_UseAllPixels << std::endl;
 
+   os << indent << "UseFixedImageSampleSubsets: ";
+   os << m_UseFixedImageSampleSubsets << std::endl;
+   os << indent << "NumberOfActiveFixedImageSamples: ";
+   os << m_NumberOfActiveFixedImageSamples << std::endl;
+
    os << indent << "Threader: " << m_Threader << std::endl;
    os << indent << "Number of Threads: " << m_NumberOfThreads << std::endl;
    os << indent << "ThreaderParameter: " << std::endl;
@@ -48,6 +48,7 @@ public:
   typedef typename Superclass::FixedImageSampleContainer
                                                         FixedImageSampleContainer;
   typedef typename Superclass::ImageDerivativesType     ImageDerivativesType;
+  typedef typename Superclass::PackedHessianType        PackedHessianType;
 
   /** The image dimension. */
   itkStaticConstMacro( ImageDimension, unsigned int,
@@ -118,7 +119,7 @@ private:
 
   MeasureType    * m_ThreaderMSE;
   DerivativeType * m_ThreaderMSEDerivatives;
-  HessianType    * m_ThreaderMSEHessians;
+  PackedHessianType * m_ThreaderMSEHessians;
 
 };
 
@@ -10,6 +10,8 @@
 #include <itkImageIterator.h>
 #include <vnl/vnl_math.h>
 
+#include <algorithm>
+
 namespace itk
 {
 
@@ -103,10 +105,11 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
    {
       delete [] m_ThreaderMSEHessians;
    }
-   m_ThreaderMSEHessians = new HessianType[this->m_NumberOfThreads];
+   m_ThreaderMSEHessians = new PackedHessianType[this->m_NumberOfThreads];
    for(unsigned int threadID=0; threadID<this->m_NumberOfThreads; ++threadID)
    {
-      m_ThreaderMSEHessians[threadID].set_size( this->m_NumberOfParameters, this->m_NumberOfParameters );
+      m_ThreaderMSEHessians[threadID].resize(
+         this->m_NumberOfParameters * ( this->m_NumberOfParameters + 1 ) / 2 );
    }
 }
 
@@ -151,15 +154,15 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 
    itkDebugMacro( "Ratio of voxels mapping into moving image buffer: "
                   << this->m_NumberOfPixelsCounted << " / "
-                  << this->m_NumberOfFixedImageSamples
+                  << this->GetNumberOfActiveFixedImageSamples()
                   << std::endl );
 
    if( this->m_NumberOfPixelsCounted <
-       this->m_NumberOfFixedImageSamples / 4 )
+       this->GetNumberOfActiveFixedImageSamples() / 4 )
    {
       /*itkExceptionMacro( "Too many samples map outside moving image buffer: "
                          << this->m_NumberOfPixelsCounted << " / "
-                         << this->m_NumberOfFixedImageSamples
+                         << this->GetNumberOfActiveFixedImageSamples()
                          << std::endl );*/
       return std::numeric_limits<MeasureType>::max();
    }
@@ -184,44 +187,24 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
    const PointType & itkNotUsed(mappedPoint),
    double movingImageValue,
    const ImageDerivativesType & movingImageGradientValue,
-   const ImageDerivativesType & fixedImageGradientValue ) const
+   const ImageDerivativesType & itkNotUsed(fixedImageGradientValue) ) const
 {
    const double minusDiff = movingImageValue
       - this->m_FixedImageSamples[fixedImageSample].value;
 
    m_ThreaderMSE[threadID] += minusDiff*minusDiff;
 
-   const PointType & fixedImagePoint = this->m_FixedImageSamples[fixedImageSample].point;
+   ///\todo replace use of spatial Jacobian by prior resampling of the moving image
 
-   // Need to use one of the threader transforms if we're
-   // not in thread 0.
-   //
-   // Use a raw pointer here to avoid the overhead of smart pointers.
-   // For instance, Register and UnRegister have mutex locks around
-   // the reference counts.
-   ESMTransformType* transform;
+   const double * minusJtimes2 = this->ComputeSampleJacobian(
+      threadID, fixedImageSample, movingImageGradientValue );
 
-   if (threadID > 0)
-   {
-      transform = this->m_ThreaderESMTransform[threadID - 1];
-   }
-   else
+   double * derivative = m_ThreaderMSEDerivatives[threadID].data_block();
+   for(unsigned int i=0; i<this->m_NumberOfParameters; ++i)
    {
-      transform = this->m_ESMTransform;
+      derivative[i] += minusJtimes2[i] * minusDiff;
    }
 
-   // Jacobian is evaluated at the unmapped (fixed image) point.
-   const TransformJacobianType & spatial_jac = transform->GetSpatialJacobian( fixedImagePoint );
-   const TransformJacobianType & increment_jac = transform->GetIncrementalUpdateJacobian( fixedImagePoint );
-
-   ///\todo replace use of spatial Jacobian by prior resampling of the moving image
-
-   m_ThreaderMSEDerivatives[threadID] +=
-      ( (movingImageGradientValue.GetVnlVector()*spatial_jac + fixedImageGradientValue.GetVnlVector())
-        * minusDiff ) * increment_jac;
-
-   //(movingImageGradientValue*minusDiff ).GetVnlVector() * (spatial_jac*increment_jac);
-
    return true;
 }
 
@@ -234,61 +217,29 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
    const PointType & itkNotUsed(mappedPoint),
    double movingImageValue,
    const ImageDerivativesType & movingImageGradientValue,
-   const ImageDerivativesType & fixedImageGradientValue ) const
+   const ImageDerivativesType & itkNotUsed(fixedImageGradientValue) ) const
 {
    const double minusDiff = movingImageValue - this->m_FixedImageSamples[fixedImageSample].value;
 
    m_ThreaderMSE[threadID] += minusDiff*minusDiff;
 
-   const PointType & fixedImagePoint = this->m_FixedImageSamples[fixedImageSample].point;
-
-   // Need to use one of the threader transforms if we're
-   // not in thread 0.
-   //
-   // Use a raw pointer here to avoid the overhead of smart pointers.
-   // For instance, Register and UnRegister have mutex locks around
-   // the reference counts.
-   ESMTransformType* transform;
-
-   if (threadID > 0)
-   {
-      transform = this->m_ThreaderESMTransform[threadID - 1];
-   }
-   else
-   {
-      transform = this->m_ESMTransform;
-   }
-
-   // Jacobian is evaluated at the unmapped (fixed image) point.
-   const TransformJacobianType & spatial_jac = transform->GetSpatialJacobian( fixedImagePoint );
-   const TransformJacobianType & increment_jac = transform->GetIncrementalUpdateJacobian( fixedImagePoint );
-
    ///\todo replace use of spatial Jacobian by prior resampling of the moving image
 
-   //const vnl_vector<double> minusJ( movingImageGradientValue.GetVnlVector()*(spatial_jac*increment_jac) );
-   const vnl_vector<double> minusJtimes2(
-      ( movingImageGradientValue.GetVnlVector()*spatial_jac
-        + fixedImageGradientValue.GetVnlVector() ) * increment_jac );
-
-   //m_ThreaderMSEDerivatives[threadID] += minusJ * minusDiff;
-   m_ThreaderMSEDerivatives[threadID] += minusJtimes2 * minusDiff;
+   // The fixed image side of the Jacobian was precomputed at
+   // initialization, see ComputeSampleJacobian
+   const double * minusJtimes2 = this->ComputeSampleJacobian(
+      threadID, fixedImageSample, movingImageGradientValue );
 
-   // The following code is equivalent to
-   // m_ThreaderMSEHessians[threadID] += outer_product( minusJ, minusJ );
-   // but uses the fact that it is twice the same vector
+   double * derivative = m_ThreaderMSEDerivatives[threadID].data_block();
    for(unsigned int i=0; i<this->m_NumberOfParameters; ++i)
    {
-      //m_ThreaderMSEHessians[threadID](i,i) += vnl_math_sqr(minusJ[i]);
-      m_ThreaderMSEHessians[threadID](i,i) += vnl_math_sqr(minusJtimes2[i]);
-      for(unsigned int j=i+1; j<this->m_NumberOfParameters; ++j)
-      {
-         //const double tmp = minusJ[i]*minusJ[j];
-         const double tmp = minusJtimes2[i]*minusJtimes2[j];
-         m_ThreaderMSEHessians[threadID](i,j) += tmp;
-         m_ThreaderMSEHessians[threadID](j,i) += tmp;
-      }
+      derivative[i] += minusJtimes2[i] * minusDiff;
    }
 
+   // outer_product( minusJtimes2, minusJtimes2 ), upper triangle only
+   this->AccumulatePackedHessian( minusJtimes2, this->m_NumberOfParameters,
+                                  &(m_ThreaderMSEHessians[threadID][0]) );
+
    return true;
 }
 
@@ -337,15 +288,15 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 
    itkDebugMacro( "Ratio of voxels mapping into moving image buffer: "
                   << this->m_NumberOfPixelsCounted << " / "
-                  << this->m_NumberOfFixedImageSamples
+                  << this->GetNumberOfActiveFixedImageSamples()
                   << std::endl );
 
    if( this->m_NumberOfPixelsCounted <
-       this->m_NumberOfFixedImageSamples / 4 )
+       this->GetNumberOfActiveFixedImageSamples() / 4 )
    {
       /*itkExceptionMacro( "Too many samples map outside moving image buffer: "
                          << this->m_NumberOfPixelsCounted << " / "
-                         << this->m_NumberOfFixedImageSamples
+                         << this->GetNumberOfActiveFixedImageSamples()
                          << std::endl );*/
       value = std::numeric_limits<MeasureType>::max();
       return;
@@ -414,9 +365,8 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 
    for( unsigned int threadID = 0; threadID<this->m_NumberOfThreads; ++threadID )
    {
-      memset( m_ThreaderMSEHessians[threadID].data_block(),
-              0,
-              this->m_NumberOfParameters * this->m_NumberOfParameters * sizeof(double) );
+      std::fill( m_ThreaderMSEHessians[threadID].begin(),
+                 m_ThreaderMSEHessians[threadID].end(), 0.0 );
    }
 
 
@@ -425,15 +375,15 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
 
    itkDebugMacro( "Ratio of voxels mapping into moving image buffer: "
                   << this->m_NumberOfPixelsCounted << " / "
-                  << this->m_NumberOfFixedImageSamples
+                  << this->GetNumberOfActiveFixedImageSamples()
                   << std::endl );
 
    if( this->m_NumberOfPixelsCounted <
-       this->m_NumberOfFixedImageSamples / 4 )
+       this->GetNumberOfActiveFixedImageSamples() / 4 )
    {
       /*itkExceptionMacro( "Too many samples map outside moving image buffer: "
                          << this->m_NumberOfPixelsCounted << " / "
-                         << this->m_NumberOfFixedImageSamples
+                         << this->GetNumberOfActiveFixedImageSamples()
                          << std::endl );*/
       value = std::numeric_limits<MeasureType>::max();
       return;
@@ -444,7 +394,7 @@ ESMMeanSquaresImageToImageMetric<TFixedImage,TMovingImage>
    {
       value += m_ThreaderMSE[t];
       derivative += m_ThreaderMSEDerivatives[t];
-      hessian += m_ThreaderMSEHessians[t];
+      this->AddPackedHessian( m_ThreaderMSEHessians[t], hessian );
    }
 
    value /= this->m_NumberOfPixelsCounted;
@@ -0,0 +1,130 @@
+#ifndef MZ_ESMMultiResolutionImageRegistrationMethod_H_
+#define MZ_ESMMultiResolutionImageRegistrationMethod_H_
+
+#include "itkESMImageToImageMetric.h"
+#include "itkESMOptimizerBase.h"
+#include "itkRecursiveMultiResolutionPyramidImageFilter.h"
+#include "itkObject.h"
+
+
+namespace itk
+{
+
+/** \class ESMMultiResolutionImageRegistrationMethod
+ * \brief Coarse to fine ESM registration
+ *
+ * The fixed and moving images are put into multi-resolution pyramids
+ * and the optimizer is run on each level in turn, from the coarsest
+ * one, starting from the optimal parameters of the previous level.
+ * The same metric and optimizer are used on all the levels so that
+ * the metric keeps its sample containers from one level to the next.
+ *
+ * An IterationEvent is invoked before the optimization of each level.
+ *
+ * \ingroup RegistrationFilters
+ */
+template <class TFixedImage,  class TMovingImage>
+class ITK_EXPORT ESMMultiResolutionImageRegistrationMethod : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef ESMMultiResolutionImageRegistrationMethod   Self;
+  typedef Object                                      Superclass;
+  typedef SmartPointer<Self>                          Pointer;
+  typedef SmartPointer<const Self>                    ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( ESMMultiResolutionImageRegistrationMethod, Object );
+
+  /** Images types */
+  typedef TFixedImage                                 FixedImageType;
+  typedef typename FixedImageType::ConstPointer       FixedImageConstPointer;
+  typedef TMovingImage                                MovingImageType;
+  typedef typename MovingImageType::ConstPointer      MovingImageConstPointer;
+
+  /** Metric and optimizer types */
+  typedef ESMImageToImageMetric<FixedImageType,
+     MovingImageType>                                 MetricType;
+  typedef typename MetricType::Pointer                MetricPointer;
+  typedef ESMOptimizerBase<FixedImageType,
+     MovingImageType>                                 OptimizerType;
+  typedef typename OptimizerType::Pointer             OptimizerPointer;
+  typedef typename OptimizerType::ParametersType      ParametersType;
+
+  /** Pyramid types */
+  typedef RecursiveMultiResolutionPyramidImageFilter<
+     FixedImageType, FixedImageType>                  FixedImagePyramidType;
+  typedef RecursiveMultiResolutionPyramidImageFilter<
+     MovingImageType, MovingImageType>                MovingImagePyramidType;
+
+  itkSetConstObjectMacro( FixedImage, FixedImageType );
+  itkGetConstObjectMacro( FixedImage, FixedImageType );
+
+  itkSetConstObjectMacro( MovingImage, MovingImageType );
+  itkGetConstObjectMacro( MovingImage, MovingImageType );
+
+  /** The metric must have its transform and interpolator set */
+  itkSetObjectMacro( Metric, MetricType );
+  itkGetObjectMacro( Metric, MetricType );
+
+  itkSetObjectMacro( Optimizer, OptimizerType );
+  itkGetObjectMacro( Optimizer, OptimizerType );
+
+  itkSetClampMacro( NumberOfLevels, unsigned int,
+                    1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfLevels, unsigned int );
+
+  /** Level being optimized, 0 being the coarsest one. */
+  itkGetConstMacro( CurrentLevel, unsigned int );
+
+  /** Parameters of the transform at the start of the coarsest level.
+   * If empty, the current parameters of the metric transform are used. */
+  itkSetMacro( InitialTransformParameters, ParametersType );
+  itkGetConstReferenceMacro( InitialTransformParameters, ParametersType );
+
+  /** Optimal parameters of the finest level. */
+  itkGetConstReferenceMacro( LastTransformParameters, ParametersType );
+
+  /** Sum of the optimizer iterations over all the levels. */
+  itkGetConstMacro( TotalNumberOfIterations, unsigned long );
+
+  /** Run the registration */
+  void StartRegistration();
+
+protected:
+  ESMMultiResolutionImageRegistrationMethod();
+  virtual ~ESMMultiResolutionImageRegistrationMethod(){};
+
+  /** Print out internal state */
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  FixedImageConstPointer                        m_FixedImage;
+  MovingImageConstPointer                       m_MovingImage;
+
+  MetricPointer                                 m_Metric;
+  OptimizerPointer                              m_Optimizer;
+
+  typename FixedImagePyramidType::Pointer       m_FixedImagePyramid;
+  typename MovingImagePyramidType::Pointer      m_MovingImagePyramid;
+
+  unsigned int                                  m_NumberOfLevels;
+  unsigned int                                  m_CurrentLevel;
+
+  ParametersType                                m_InitialTransformParameters;
+  ParametersType                                m_LastTransformParameters;
+
+  unsigned long                                 m_TotalNumberOfIterations;
+
+private:
+  ESMMultiResolutionImageRegistrationMethod(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+};
+
+} // end namespace itk
+
+#include "itkESMMultiResolutionImageRegistrationMethod.hxx"
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef MZ_ESMMultiResolutionImageRegistrationMethod_TXX_
+#define MZ_ESMMultiResolutionImageRegistrationMethod_TXX_
+
+#include "itkESMMultiResolutionImageRegistrationMethod.h"
+
+namespace itk
+{
+
+template <class TFixedImage, class TMovingImage>
+ESMMultiResolutionImageRegistrationMethod<TFixedImage,TMovingImage>
+::ESMMultiResolutionImageRegistrationMethod()
+   :m_FixedImage(0)
+   ,m_MovingImage(0)
+   ,m_Metric(0)
+   ,m_Optimizer(0)
+   ,m_NumberOfLevels(1)
+   ,m_CurrentLevel(0)
+   ,m_TotalNumberOfIterations(0)
+{
+   m_FixedImagePyramid = FixedImagePyramidType::New();
+   m_MovingImagePyramid = MovingImagePyramidType::New();
+}
+
+template <class TFixedImage, class TMovingImage >
+void
+ESMMultiResolutionImageRegistrationMethod<TFixedImage,TMovingImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+   Superclass::PrintSelf(os, indent);
+
+   os << indent << "Metric: " << m_Metric.GetPointer() << std::endl;
+   os << indent << "Optimizer: " << m_Optimizer.GetPointer() << std::endl;
+   os << indent << "NumberOfLevels: " << m_NumberOfLevels << std::endl;
+   os << indent << "CurrentLevel: " << m_CurrentLevel << std::endl;
+   os << indent << "TotalNumberOfIterations: "
+      << m_TotalNumberOfIterations << std::endl;
+}
+
+template <class TFixedImage, class TMovingImage >
+void
+ESMMultiResolutionImageRegistrationMethod<TFixedImage,TMovingImage>
+::StartRegistration()
+{
+   if( !m_FixedImage || !m_MovingImage )
+   {
+      itkExceptionMacro( "Fixed and moving images must be set" );
+   }
+   if( !m_Metric || !m_Optimizer )
+   {
+      itkExceptionMacro( "Metric and optimizer must be set" );
+   }
+   if( !m_Metric->GetESMTransform() )
+   {
+      itkExceptionMacro( "The metric transform must be set" );
+   }
+
+   m_FixedImagePyramid->SetInput( m_FixedImage );
+   m_FixedImagePyramid->SetNumberOfLevels( m_NumberOfLevels );
+   m_FixedImagePyramid->Update();
+
+   m_MovingImagePyramid->SetInput( m_MovingImage );
+   m_MovingImagePyramid->SetNumberOfLevels( m_NumberOfLevels );
+   m_MovingImagePyramid->Update();
+
+   ParametersType parameters = m_InitialTransformParameters;
+   if( parameters.Size() == 0 )
+   {
+      parameters = m_Metric->GetESMTransform()->GetParameters();
+   }
+
+   m_Optimizer->SetESMCostFunction( m_Metric );
+   m_TotalNumberOfIterations = 0;
+
+   for( m_CurrentLevel = 0; m_CurrentLevel < m_NumberOfLevels; ++m_CurrentLevel )
+   {
+      const FixedImageType * fixedImage =
+         m_FixedImagePyramid->GetOutput( m_CurrentLevel );
+
+      // The pyramids keep the physical extent of the images, so the
+      // transform parameters carry over from one level to the next
+      m_Metric->SetFixedImage( fixedImage );
+      m_Metric->SetMovingImage(
+         m_MovingImagePyramid->GetOutput( m_CurrentLevel ) );
+      m_Metric->SetFixedImageRegion( fixedImage->GetBufferedRegion() );
+
+      m_Optimizer->SetInitialPosition( parameters );
+
+      this->InvokeEvent( IterationEvent() );
+
+      m_Optimizer->StartOptimization();
+
+      m_TotalNumberOfIterations += m_Optimizer->GetCurrentIteration();
+      parameters = m_Optimizer->GetOptimalParameters();
+   }
+   m_CurrentLevel = m_NumberOfLevels - 1;
+
+   m_LastTransformParameters = parameters;
+   m_Metric->SetTransformParameters( m_LastTransformParameters );
+}
+
+} // end namespace itk
+
+#endif
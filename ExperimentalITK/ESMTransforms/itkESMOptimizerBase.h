@@ -64,7 +64,9 @@ public:
      SoftStepSizeToleranceReached,
      MeasureToleranceReached,
      GradientToleranceReached,
-     BadGainRatio
+     BadGainRatio,
+     TrustRegionRadiusToleranceReached,
+     ParameterChangeToleranceReached
   } StopConditionType;
 
   /** Set the cost function. */
@@ -116,6 +116,9 @@ ESMOptimizerBase<TFixedImage,TMovingImage>
    itkDebugMacro("StartOptimization");
 
    this->m_Stop = false;
+   this->m_CurrentIteration = 0;
+   this->m_StopCondition = Unknown;
+   this->m_StopConditionDescription.str("");
 
    this->InvokeEvent( StartEvent() );
 
@@ -0,0 +1,321 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkChunkedVectorImageContainer.h,v $
+  Language:  C++
+  Date:      $$
+  Version:   $ $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkChunkedVectorImageContainer_h
+#define __itkChunkedVectorImageContainer_h
+
+#include "itkMacro.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+namespace itk
+{
+
+/** \class ChunkedVectorImageContainerHeader
+ * \brief Layout of the single-file chunked vector image container.
+ *
+ * The container stores all vector components of an image in one file.
+ * The image is cut into a regular grid of chunks.  Each chunk holds the
+ * interleaved vector pixels of its sub-region (x fastest) and is
+ * compressed on its own, so chunks can be compressed and decompressed
+ * in parallel and a reader can seek directly to any chunk through the
+ * chunk table which follows the header:
+ *
+ *   magic[8] "ITKVCHNK"
+ *   uint32   version, image dimension, number of components,
+ *            component code, component size, compression (0 = none,
+ *            1 = zlib)
+ *   uint64   size[dim]
+ *   int64    start index[dim] (version 2 and later)
+ *   uint64   chunk size[dim]
+ *   double   spacing[dim], origin[dim], direction[dim*dim]
+ *   uint64   number of chunks
+ *   uint64   {offset, stored bytes, raw bytes} per chunk
+ *   chunk data
+ *
+ * Chunk regions are relative to the start index of the image region.
+ * Version 1 files have no start index and are read with a zero index.
+ * A chunk whose stored size equals its raw size is kept uncompressed.
+ * All values are written in the native byte order of the writing host.
+ *
+ * \ingroup IOFilters
+ */
+class ChunkedVectorImageContainerHeader
+{
+public:
+  typedef unsigned int   UInt32Type;
+  typedef unsigned long long UInt64Type;
+  typedef long long          Int64Type;
+
+  struct ChunkEntry
+    {
+    UInt64Type Offset;
+    UInt64Type StoredBytes;
+    UInt64Type RawBytes;
+    };
+
+  ChunkedVectorImageContainerHeader()
+    {
+    this->Version = 2;
+    this->ImageDimension = 0;
+    this->NumberOfComponents = 0;
+    this->ComponentCode = 0;
+    this->ComponentSize = 0;
+    this->Compression = 0;
+    }
+
+  static const char *GetMagic()
+    { return "ITKVCHNK"; }
+
+  /** Returns true if the file starts with the container magic. */
+  static bool IsChunkedContainer( const std::string & filename )
+    {
+    std::ifstream str( filename.c_str(), std::ios::in | std::ios::binary );
+    if( !str.is_open() )
+      {
+      return false;
+      }
+    char magic[8];
+    str.read( magic, 8 );
+    return ( str.gcount() == 8 &&
+      std::strncmp( magic, GetMagic(), 8 ) == 0 );
+    }
+
+  UInt64Type GetNumberOfChunks() const
+    {
+    UInt64Type n = 1;
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      n *= this->GetNumberOfChunks( d );
+      }
+    return n;
+    }
+
+  UInt64Type GetNumberOfChunks( unsigned int d ) const
+    {
+    return ( this->Size[d] + this->ChunkSize[d] - 1 ) / this->ChunkSize[d];
+    }
+
+  /** Chunk grid coordinates of the linear chunk id (x fastest). */
+  void GetChunkGridIndex( UInt64Type id, std::vector<UInt64Type> & grid ) const
+    {
+    grid.resize( this->ImageDimension );
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      UInt64Type n = this->GetNumberOfChunks( d );
+      grid[d] = id % n;
+      id /= n;
+      }
+    }
+
+  /** Start and size (in pixels) of the linear chunk id. */
+  void GetChunkRegion( UInt64Type id, std::vector<UInt64Type> & start,
+    std::vector<UInt64Type> & size ) const
+    {
+    this->GetChunkGridIndex( id, start );
+    size.resize( this->ImageDimension );
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      start[d] *= this->ChunkSize[d];
+      size[d] = this->ChunkSize[d];
+      if( start[d] + size[d] > this->Size[d] )
+        {
+        size[d] = this->Size[d] - start[d];
+        }
+      }
+    }
+
+  UInt64Type GetHeaderSizeInBytes() const
+    {
+    return 8 + 6 * sizeof( UInt32Type )
+      + 2 * this->ImageDimension * sizeof( UInt64Type )
+      + ( ( this->Version >= 2 ) ? this->ImageDimension * sizeof( Int64Type ) : 0 )
+      + ( 2 + this->ImageDimension ) * this->ImageDimension * sizeof( double )
+      + sizeof( UInt64Type )
+      + this->Chunks.size() * 3 * sizeof( UInt64Type );
+    }
+
+  void Write( std::ostream & str ) const
+    {
+    str.write( GetMagic(), 8 );
+    WriteValue( str, this->Version );
+    WriteValue( str, this->ImageDimension );
+    WriteValue( str, this->NumberOfComponents );
+    WriteValue( str, this->ComponentCode );
+    WriteValue( str, this->ComponentSize );
+    WriteValue( str, this->Compression );
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      WriteValue( str, this->Size[d] );
+      }
+    if( this->Version >= 2 )
+      {
+      for( unsigned int d = 0; d < this->ImageDimension; d++ )
+        {
+        WriteValue( str, this->Index[d] );
+        }
+      }
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      WriteValue( str, this->ChunkSize[d] );
+      }
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      WriteValue( str, this->Spacing[d] );
+      }
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      WriteValue( str, this->Origin[d] );
+      }
+    for( unsigned int d = 0; d < this->Direction.size(); d++ )
+      {
+      WriteValue( str, this->Direction[d] );
+      }
+    UInt64Type numberOfChunks = this->Chunks.size();
+    WriteValue( str, numberOfChunks );
+    for( unsigned int n = 0; n < this->Chunks.size(); n++ )
+      {
+      WriteValue( str, this->Chunks[n].Offset );
+      WriteValue( str, this->Chunks[n].StoredBytes );
+      WriteValue( str, this->Chunks[n].RawBytes );
+      }
+    }
+
+  /** Reads the header and chunk table.  Returns false on a malformed file. */
+  bool Read( std::istream & str )
+    {
+    char magic[8];
+    str.read( magic, 8 );
+    if( str.gcount() != 8 || std::strncmp( magic, GetMagic(), 8 ) != 0 )
+      {
+      return false;
+      }
+    ReadValue( str, this->Version );
+    ReadValue( str, this->ImageDimension );
+    ReadValue( str, this->NumberOfComponents );
+    ReadValue( str, this->ComponentCode );
+    ReadValue( str, this->ComponentSize );
+    ReadValue( str, this->Compression );
+    if( !str.good() || this->Version < 1 || this->Version > 2 ||
+      this->ImageDimension == 0 )
+      {
+      return false;
+      }
+    this->Size.resize( this->ImageDimension );
+    this->Index.assign( this->ImageDimension, 0 );
+    this->ChunkSize.resize( this->ImageDimension );
+    this->Spacing.resize( this->ImageDimension );
+    this->Origin.resize( this->ImageDimension );
+    this->Direction.resize( this->ImageDimension * this->ImageDimension );
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      ReadValue( str, this->Size[d] );
+      }
+    if( this->Version >= 2 )
+      {
+      for( unsigned int d = 0; d < this->ImageDimension; d++ )
+        {
+        ReadValue( str, this->Index[d] );
+        }
+      }
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      ReadValue( str, this->ChunkSize[d] );
+      if( this->ChunkSize[d] == 0 )
+        {
+        return false;
+        }
+      }
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      ReadValue( str, this->Spacing[d] );
+      }
+    for( unsigned int d = 0; d < this->ImageDimension; d++ )
+      {
+      ReadValue( str, this->Origin[d] );
+      }
+    for( unsigned int d = 0; d < this->Direction.size(); d++ )
+      {
+      ReadValue( str, this->Direction[d] );
+      }
+    UInt64Type numberOfChunks = 0;
+    ReadValue( str, numberOfChunks );
+    if( !str.good() || numberOfChunks != this->GetNumberOfChunks() )
+      {
+      return false;
+      }
+    this->Chunks.resize( numberOfChunks );
+    for( unsigned int n = 0; n < this->Chunks.size(); n++ )
+      {
+      ReadValue( str, this->Chunks[n].Offset );
+      ReadValue( str, this->Chunks[n].StoredBytes );
+      ReadValue( str, this->Chunks[n].RawBytes );
+      }
+    return str.good();
+    }
+
+  UInt32Type                Version;
+  UInt32Type                ImageDimension;
+  UInt32Type                NumberOfComponents;
+  UInt32Type                ComponentCode;
+  UInt32Type                ComponentSize;
+  UInt32Type                Compression;
+  std::vector<UInt64Type>   Size;
+  std::vector<Int64Type>    Index;
+  std::vector<UInt64Type>   ChunkSize;
+  std::vector<double>       Spacing;
+  std::vector<double>       Origin;
+  std::vector<double>       Direction;
+  std::vector<ChunkEntry>   Chunks;
+
+private:
+  template <class T>
+  static void WriteValue( std::ostream & str, const T & value )
+    { str.write( reinterpret_cast<const char *>( &value ), sizeof( T ) ); }
+
+  template <class T>
+  static void ReadValue( std::istream & str, T & value )
+    { str.read( reinterpret_cast<char *>( &value ), sizeof( T ) ); }
+};
+
+/** \class ChunkedVectorImageComponentCode
+ * \brief Maps a vector component type to the code stored in the container.
+ */
+template <class T> struct ChunkedVectorImageComponentCode
+  { static unsigned int Value() { return 0; } };
+template <> struct ChunkedVectorImageComponentCode<float>
+  { static unsigned int Value() { return 1; } };
+template <> struct ChunkedVectorImageComponentCode<double>
+  { static unsigned int Value() { return 2; } };
+template <> struct ChunkedVectorImageComponentCode<short>
+  { static unsigned int Value() { return 3; } };
+template <> struct ChunkedVectorImageComponentCode<unsigned short>
+  { static unsigned int Value() { return 4; } };
+template <> struct ChunkedVectorImageComponentCode<int>
+  { static unsigned int Value() { return 5; } };
+template <> struct ChunkedVectorImageComponentCode<unsigned int>
+  { static unsigned int Value() { return 6; } };
+template <> struct ChunkedVectorImageComponentCode<char>
+  { static unsigned int Value() { return 7; } };
+template <> struct ChunkedVectorImageComponentCode<unsigned char>
+  { static unsigned int Value() { return 8; } };
+
+} // end namespace itk
+
+#endif
@@ -24,6 +24,10 @@
 #include "itkSize.h"
 #include "itkImageRegion.h"
 #include "itkDefaultConvertPixelTraits.h"
+#include "itkMultiThreader.h"
+#include "itkChunkedVectorImageContainer.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -77,6 +81,12 @@ public:
  * raw binary format) have no accepted suffix, so you will have to
  * manually create the ImageIO instance of the write type.
  *
+ * If the file is a chunked container written by VectorImageFileWriter
+ * (see ChunkedVectorImageContainerHeader), the components are read from
+ * that single file instead.  The reader then supports streaming: only
+ * the chunks overlapping the requested region are located through the
+ * chunk table, read and decompressed, on NumberOfThreads threads.
+ *
  * \sa ImageSeriesReader
  * \sa ImageIOBase
  *
@@ -107,6 +117,7 @@ public:
   /** Deformation field types */
   typedef typename TVectorImage::RegionType  VectorImageRegionType;
   typedef typename TVectorImage::InternalPixelType VectorImagePixelType;
+  typedef typename VectorImagePixelType::ValueType VectorImageComponentType;
 
 
   /** Specify the file to read. This is forwarded to the IO instance. */
@@ -118,6 +129,14 @@ public:
   itkGetConstReferenceMacro(UseAvantsNamingConvention,bool);
   itkBooleanMacro(UseAvantsNamingConvention);
 
+  /** Number of threads used to decompress the chunks of a container. */
+  itkSetClampMacro(NumberOfThreads,int,1,ITK_MAX_THREADS);
+  itkGetConstMacro(NumberOfThreads,int);
+
+  /** Whether the file read is a chunked container.  Valid after
+   * UpdateOutputInformation(). */
+  itkGetConstMacro(IsChunkedContainer,bool);
+
   /** Set/Get the ImageIO helper class. Often this is created via the object
    * factory mechanism that determines whether a particular ImageIO can
    * read a certain file. This method provides a way to get the ImageIO
@@ -158,6 +177,17 @@ protected:
   /** Does the real work. */
   virtual void GenerateData();
 
+  /** Chunked container counterparts of GenerateOutputInformation() and
+   * GenerateData(). */
+  void GenerateChunkedContainerOutputInformation();
+  void GenerateChunkedContainerData();
+
+  /** Reads, decompresses and scatters a single chunk into the output. */
+  void ReadChunk( unsigned long chunkId );
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ReadChunksThreaderCallback( void *arg );
+
   ImageIOBase::Pointer m_ImageIO;
   bool m_UserSpecifiedImageIO; //keep track whether the ImageIO is user specified
 
@@ -172,6 +202,12 @@ private:
   typename TImage::Pointer m_Image;
   bool     m_UseAvantsNamingConvention;
 
+  bool                               m_IsChunkedContainer;
+  int                                m_NumberOfThreads;
+  ChunkedVectorImageContainerHeader  m_ContainerHeader;
+  std::vector<unsigned long>         m_ChunksToRead;
+  std::vector<char>                  m_ChunkFailed;
+
 };
 
 
@@ -26,6 +26,9 @@
 #include "itkPixelTraits.h"
 #include "itkVectorImage.h"
 #include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itk_zlib.h"
+#include "vnl/vnl_math.h"
 
 #include <itksys/SystemTools.hxx>
 #include <fstream>
@@ -42,6 +45,9 @@ VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
   m_UserSpecifiedImageIO = false;
   m_UseAvantsNamingConvention = true;
 
+  m_IsChunkedContainer = false;
+  m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+
   this->m_Image = TImage::New();
 }
 
@@ -103,6 +109,14 @@ VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
     throw VectorImageFileReaderException(__FILE__, __LINE__, "FileName must be specified", ITK_LOCATION);
     }
 
+  this->m_IsChunkedContainer =
+    ChunkedVectorImageContainerHeader::IsChunkedContainer( this->m_FileName );
+  if ( this->m_IsChunkedContainer )
+    {
+    this->GenerateChunkedContainerOutputInformation();
+    return;
+    }
+
   // Test if the files exist and if it can be open.
   // and exception will be thrown otherwise.
   //
@@ -414,6 +428,12 @@ VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
 {
   typename TVectorImage::Pointer out = dynamic_cast<TVectorImage*>(output);
 
+  // Chunked containers can be read region by region.
+  if ( this->m_IsChunkedContainer )
+    {
+    return;
+    }
+
   // the ImageIO object cannot stream, then set the RequestedRegion to the
   // LargestPossibleRegion
   if (!m_ImageIO->CanStreamRead())
@@ -435,6 +455,12 @@ template <class TImage, class TVectorImage, class ConvertPixelTraits>
 void VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
 ::GenerateData()
 {
+  if ( this->m_IsChunkedContainer )
+    {
+    this->GenerateChunkedContainerData();
+    return;
+    }
+
   typename TVectorImage::Pointer output = this->GetOutput();
 
   // allocate the output buffer
@@ -634,6 +660,303 @@ void VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
 
 
 
+template <class TImage, class TVectorImage, class ConvertPixelTraits>
+void
+VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
+::GenerateChunkedContainerOutputInformation()
+{
+  typename TVectorImage::Pointer output = this->GetOutput();
+
+  std::ifstream str( this->m_FileName.c_str(), std::ios::in | std::ios::binary );
+  if ( !str.is_open() || !this->m_ContainerHeader.Read( str ) )
+    {
+    std::stringstream msg;
+    msg << "Could not read the chunked container header of "
+        << this->m_FileName << std::endl;
+    throw VectorImageFileReaderException(__FILE__, __LINE__,
+      msg.str().c_str(), ITK_LOCATION);
+    }
+  str.close();
+
+  const ChunkedVectorImageContainerHeader &header = this->m_ContainerHeader;
+  const unsigned int dimension = TVectorImage::ImageDimension;
+  if ( header.ImageDimension != dimension ||
+       header.NumberOfComponents != itk::GetVectorDimension
+         <VectorImagePixelType>::VectorDimension )
+    {
+    std::stringstream msg;
+    msg << "The chunked container " << this->m_FileName << " holds a "
+        << header.ImageDimension << "-D image with "
+        << header.NumberOfComponents << " components." << std::endl;
+    throw VectorImageFileReaderException(__FILE__, __LINE__,
+      msg.str().c_str(), ITK_LOCATION);
+    }
+
+  typename TVectorImage::SizeType dimSize;
+  typename TVectorImage::SpacingType spacing;
+  typename TVectorImage::PointType origin;
+  typename TVectorImage::DirectionType direction;
+  for ( unsigned int d = 0; d < dimension; d++ )
+    {
+    dimSize[d] = static_cast<unsigned long>( header.Size[d] );
+    spacing[d] = header.Spacing[d];
+    origin[d] = header.Origin[d];
+    for ( unsigned int e = 0; e < dimension; e++ )
+      {
+      direction[d][e] = header.Direction[d * dimension + e];
+      }
+    }
+
+  // The start index of the written region is restored
+  typename TVectorImage::IndexType start;
+  for ( unsigned int d = 0; d < dimension; d++ )
+    {
+    start[d] = static_cast<long>( header.Index[d] );
+    }
+
+  VectorImageRegionType region;
+  region.SetSize( dimSize );
+  region.SetIndex( start );
+
+  output->SetSpacing( spacing );
+  output->SetOrigin( origin );
+  output->SetDirection( direction );
+  output->SetLargestPossibleRegion( region );
+}
+
+template <class TImage, class TVectorImage, class ConvertPixelTraits>
+void
+VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
+::GenerateChunkedContainerData()
+{
+  typename TVectorImage::Pointer output = this->GetOutput();
+
+  output->SetBufferedRegion( output->GetRequestedRegion() );
+  output->Allocate();
+
+  // Collect the chunks overlapping the requested region.
+  const ChunkedVectorImageContainerHeader &header = this->m_ContainerHeader;
+  const VectorImageRegionType requestedRegion = output->GetRequestedRegion();
+
+  this->m_ChunksToRead.clear();
+  std::vector<ChunkedVectorImageContainerHeader::UInt64Type> start;
+  std::vector<ChunkedVectorImageContainerHeader::UInt64Type> size;
+  for ( unsigned long n = 0; n < header.Chunks.size(); n++ )
+    {
+    header.GetChunkRegion( n, start, size );
+    typename VectorImageRegionType::IndexType chunkIndex;
+    typename VectorImageRegionType::SizeType chunkSize;
+    for ( unsigned int d = 0; d < TVectorImage::ImageDimension; d++ )
+      {
+      chunkIndex[d] = static_cast<long>( header.Index[d] ) +
+        static_cast<long>( start[d] );
+      chunkSize[d] = static_cast<unsigned long>( size[d] );
+      }
+    VectorImageRegionType chunkRegion( chunkIndex, chunkSize );
+    if ( chunkRegion.Crop( requestedRegion ) )
+      {
+      this->m_ChunksToRead.push_back( n );
+      }
+    }
+  this->m_ChunkFailed.assign( header.Chunks.size(), 0 );
+
+  if ( this->m_ChunksToRead.empty() )
+    {
+    return;
+    }
+
+  typename MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( vnl_math_min( this->m_NumberOfThreads,
+    static_cast<int>( this->m_ChunksToRead.size() ) ) );
+  threader->SetSingleMethod( this->ReadChunksThreaderCallback, this );
+  threader->SingleMethodExecute();
+
+  for ( unsigned long n = 0; n < this->m_ChunkFailed.size(); n++ )
+    {
+    if ( this->m_ChunkFailed[n] )
+      {
+      std::stringstream msg;
+      msg << "Could not read chunk " << n << " of " << this->m_FileName
+          << std::endl;
+      throw VectorImageFileReaderException(__FILE__, __LINE__,
+        msg.str().c_str(), ITK_LOCATION);
+      }
+    }
+}
+
+template <class TImage, class TVectorImage, class ConvertPixelTraits>
+ITK_THREAD_RETURN_TYPE
+VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
+::ReadChunksThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  Self *reader = (Self *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  for ( unsigned long n = threadId; n < reader->m_ChunksToRead.size();
+    n += threadCount )
+    {
+    reader->ReadChunk( reader->m_ChunksToRead[n] );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Copies the components of the raw chunk pixel at position 'offset'. */
+template <class TComponent, class TPixel>
+inline void
+CopyChunkedContainerPixel( const char *raw, unsigned long offset,
+  unsigned int numberOfComponents, TPixel &pixel )
+{
+  const TComponent *components = reinterpret_cast<const TComponent *>( raw )
+    + offset * numberOfComponents;
+  for ( unsigned int c = 0; c < numberOfComponents; c++ )
+    {
+    pixel[c] = static_cast<typename TPixel::ValueType>( components[c] );
+    }
+}
+
+/** Size in bytes of the component type of a chunked container code (0 if
+ * the code is unknown). */
+inline unsigned int
+GetChunkedContainerComponentSize( unsigned int componentCode )
+{
+  switch ( componentCode )
+    {
+    case 1: return sizeof( float );
+    case 2: return sizeof( double );
+    case 3: return sizeof( short );
+    case 4: return sizeof( unsigned short );
+    case 5: return sizeof( int );
+    case 6: return sizeof( unsigned int );
+    case 7: return sizeof( char );
+    case 8: return sizeof( unsigned char );
+    default: return 0;
+    }
+}
+
+template <class TImage, class TVectorImage, class ConvertPixelTraits>
+void
+VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
+::ReadChunk( unsigned long chunkId )
+{
+  const ChunkedVectorImageContainerHeader &header = this->m_ContainerHeader;
+  const ChunkedVectorImageContainerHeader::ChunkEntry &entry
+    = header.Chunks[chunkId];
+
+  std::vector<ChunkedVectorImageContainerHeader::UInt64Type> start;
+  std::vector<ChunkedVectorImageContainerHeader::UInt64Type> size;
+  header.GetChunkRegion( chunkId, start, size );
+
+  // The uncompressed chunk must hold exactly the pixels of its region,
+  // otherwise the header is corrupt and the copy below would read past
+  // the end of the buffer.
+  ChunkedVectorImageContainerHeader::UInt64Type expectedBytes =
+    static_cast<ChunkedVectorImageContainerHeader::UInt64Type>(
+    header.NumberOfComponents ) *
+    GetChunkedContainerComponentSize( header.ComponentCode );
+  for ( unsigned int d = 0; d < TVectorImage::ImageDimension; d++ )
+    {
+    expectedBytes *= size[d];
+    }
+  if ( expectedBytes == 0 || entry.RawBytes != expectedBytes )
+    {
+    this->m_ChunkFailed[chunkId] = 1;
+    return;
+    }
+
+  // Each thread seeks in its own stream.
+  std::ifstream str( this->m_FileName.c_str(), std::ios::in | std::ios::binary );
+  std::vector<char> stored( static_cast<size_t>( entry.StoredBytes ) );
+  str.seekg( static_cast<std::streamoff>( entry.Offset ), std::ios::beg );
+  if ( !stored.empty() )
+    {
+    str.read( &stored[0], stored.size() );
+    }
+  if ( !str.good() || stored.empty() )
+    {
+    this->m_ChunkFailed[chunkId] = 1;
+    return;
+    }
+
+  std::vector<char> raw;
+  if ( entry.StoredBytes == entry.RawBytes )
+    {
+    raw.swap( stored );
+    }
+  else
+    {
+    raw.resize( static_cast<size_t>( entry.RawBytes ) );
+    uLongf rawBytes = raw.size();
+    int status = uncompress( reinterpret_cast<Bytef *>( &raw[0] ), &rawBytes,
+      reinterpret_cast<const Bytef *>( &stored[0] ), stored.size() );
+    if ( status != Z_OK || rawBytes != raw.size() )
+      {
+      this->m_ChunkFailed[chunkId] = 1;
+      return;
+      }
+    }
+
+  typename VectorImageRegionType::IndexType chunkIndex;
+  typename VectorImageRegionType::SizeType chunkSize;
+  for ( unsigned int d = 0; d < TVectorImage::ImageDimension; d++ )
+    {
+    chunkIndex[d] = static_cast<long>( header.Index[d] ) +
+      static_cast<long>( start[d] );
+    chunkSize[d] = static_cast<unsigned long>( size[d] );
+    }
+  VectorImageRegionType chunkRegion( chunkIndex, chunkSize );
+  chunkRegion.Crop( this->GetOutput()->GetRequestedRegion() );
+
+  const unsigned int numberOfComponents = header.NumberOfComponents;
+  ImageRegionIteratorWithIndex<TVectorImage> It( this->GetOutput(), chunkRegion );
+  for ( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    typename TVectorImage::IndexType index = It.GetIndex();
+    unsigned long offset = 0;
+    unsigned long stride = 1;
+    for ( unsigned int d = 0; d < TVectorImage::ImageDimension; d++ )
+      {
+      offset += ( index[d] - chunkIndex[d] ) * stride;
+      stride *= static_cast<unsigned long>( size[d] );
+      }
+
+    VectorImagePixelType pixel;
+    switch ( header.ComponentCode )
+      {
+      case 1:
+        CopyChunkedContainerPixel<float>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      case 2:
+        CopyChunkedContainerPixel<double>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      case 3:
+        CopyChunkedContainerPixel<short>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      case 4:
+        CopyChunkedContainerPixel<unsigned short>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      case 5:
+        CopyChunkedContainerPixel<int>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      case 6:
+        CopyChunkedContainerPixel<unsigned int>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      case 7:
+        CopyChunkedContainerPixel<char>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      case 8:
+        CopyChunkedContainerPixel<unsigned char>( &raw[0], offset, numberOfComponents, pixel );
+        break;
+      default:
+        this->m_ChunkFailed[chunkId] = 1;
+        return;
+      }
+    It.Set( pixel );
+    }
+}
+
 template <class TImage, class TVectorImage, class ConvertPixelTraits>
 void
 VectorImageFileReader<TImage, TVectorImage, ConvertPixelTraits>
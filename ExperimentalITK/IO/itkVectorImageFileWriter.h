@@ -22,6 +22,10 @@
 #include "itkExceptionObject.h"
 #include "itkSize.h"
 #include "itkImageIORegion.h"
+#include "itkMultiThreader.h"
+#include "itkChunkedVectorImageContainer.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -53,6 +57,13 @@ public:
 /** \class VectorImageFileWriter
  * \brief Writes the deformation field as component images files.
  *
+ * Alternatively, with UseChunkedContainer turned on, all components are
+ * written to a single file laid out as described in
+ * ChunkedVectorImageContainerHeader.  The image is cut into chunks of
+ * ChunkSize pixels which are gathered and compressed independently on
+ * NumberOfThreads threads.  VectorImageFileReader recognizes the container
+ * and only decompresses the chunks overlapping its requested region.
+ *
  * \sa VectorImageFileWriter
  * \sa ImageSeriesReader
  * \sa ImageIOBase
@@ -85,6 +96,8 @@ public:
   typedef typename ImageType::Pointer ImagePointer;
   typedef typename ImageType::RegionType ImageRegionType; 
   typedef typename ImageType::PixelType ImagePixelType; 
+  typedef typename VectorImageType::SizeType VectorImageSizeType;
+  typedef typename VectorImagePixelType::ValueType VectorImageComponentType;
   
   /** Set/Get the image input of this writer.  */
   void SetInput(const VectorImageType *input);
@@ -160,6 +173,23 @@ public:
   itkGetConstReferenceMacro(UseInputMetaDataDictionary,bool);
   itkBooleanMacro(UseInputMetaDataDictionary);
 
+  /** Write all components into one chunked, independently compressed
+   * container instead of one image file per component. */
+  itkSetMacro(UseChunkedContainer,bool);
+  itkGetConstReferenceMacro(UseChunkedContainer,bool);
+  itkBooleanMacro(UseChunkedContainer);
+
+  /** Size of the chunks of the container (default 64 along each axis). */
+  itkSetMacro(ChunkSize,VectorImageSizeType);
+  itkGetConstReferenceMacro(ChunkSize,VectorImageSizeType);
+
+  /** zlib compression level (1-9) used for the container chunks. */
+  itkSetClampMacro(CompressionLevel,int,1,9);
+  itkGetConstMacro(CompressionLevel,int);
+
+  /** Number of threads used to gather and compress the container chunks. */
+  itkSetClampMacro(NumberOfThreads,int,1,ITK_MAX_THREADS);
+  itkGetConstMacro(NumberOfThreads,int);
 
 protected:
   VectorImageFileWriter();
@@ -168,7 +198,16 @@ protected:
 
   /** Does the real work. */
   void GenerateData(void);
-  
+
+  /** Writes the input as a single chunked container. */
+  void WriteChunkedContainer(void);
+
+  /** Gathers and compresses one chunk of the container. */
+  void CompressChunk(unsigned long chunkId);
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE CompressChunksThreaderCallback(void *arg);
+
 private:
   VectorImageFileWriter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
@@ -189,6 +228,14 @@ private:
   bool m_FactorySpecifiedImageIO; //track whether the factory mechanism set the ImageIO
   bool m_UseCompression;
   bool m_UseInputMetaDataDictionary; // whether to use the MetaDataDictionary from the input or not.
+
+  bool                               m_UseChunkedContainer;
+  VectorImageSizeType                m_ChunkSize;
+  int                                m_CompressionLevel;
+  int                                m_NumberOfThreads;
+  ChunkedVectorImageContainerHeader  m_ContainerHeader;
+  std::vector<std::vector<char> >    m_ChunkBuffers;
+  std::vector<char>                  m_ChunkFailed;
 };
 
   
@@ -24,8 +24,13 @@
 #include "itkImageIOFactory.h"
 #include "itkCommand.h"
 #include "vnl/vnl_vector.h"
+#include "vnl/vnl_math.h"
 #include "itkVectorImage.h"
 #include "itkVectorIndexSelectionCastImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itk_zlib.h"
+
+#include <fstream>
 
 namespace itk
 {
@@ -43,6 +48,11 @@ VectorImageFileWriter<TVectorImage, TImage>
   m_FactorySpecifiedImageIO = false;
   m_UseAvantsNamingConvention = true;
   m_UseZhangNamingConvention = false;
+
+  m_UseChunkedContainer = false;
+  m_ChunkSize.Fill( 64 );
+  m_CompressionLevel = 1;
+  m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
 }
 
 
@@ -147,6 +157,12 @@ void
 VectorImageFileWriter<TVectorImage, TImage>
 ::Write()
 {
+  if ( this->m_UseChunkedContainer )
+    {
+    this->WriteChunkedContainer();
+    return;
+    }
+
   typedef VectorIndexSelectionCastImageFilter
        <VectorImageType, ImageType> SelectorType;
   typename SelectorType::Pointer selector = SelectorType::New();
@@ -372,6 +388,240 @@ VectorImageFileWriter<TVectorImage, TImage>
 }
 
 
+//---------------------------------------------------------
+template <class TVectorImage, class TImage>
+void
+VectorImageFileWriter<TVectorImage, TImage>
+::WriteChunkedContainer()
+{
+  VectorImageType *input = const_cast<VectorImageType *>( this->GetInput() );
+  if ( input == 0 )
+    {
+    itkExceptionMacro(<< "No input to writer!");
+    }
+  if ( this->m_FileName == "" )
+    {
+    itkExceptionMacro(<<"No filename was specified");
+    }
+  if ( input->GetSource() )
+    {
+    input->GetSource()->UpdateLargestPossibleRegion();
+    }
+  else
+    {
+    input->Update();
+    }
+
+  const unsigned int dimension = VectorImageType::ImageDimension;
+  const unsigned int numberOfComponents = itk::GetVectorDimension
+      <VectorImagePixelType>::VectorDimension;
+
+  VectorImageRegionType region = input->GetLargestPossibleRegion();
+
+  this->m_ContainerHeader = ChunkedVectorImageContainerHeader();
+  ChunkedVectorImageContainerHeader &header = this->m_ContainerHeader;
+  header.ImageDimension = dimension;
+  header.NumberOfComponents = numberOfComponents;
+  header.ComponentCode =
+    ChunkedVectorImageComponentCode<VectorImageComponentType>::Value();
+  header.ComponentSize = sizeof( VectorImageComponentType );
+  header.Compression = this->m_UseCompression ? 1 : 0;
+  header.Size.resize( dimension );
+  header.Index.resize( dimension );
+  header.ChunkSize.resize( dimension );
+  header.Spacing.resize( dimension );
+  header.Origin.resize( dimension );
+  header.Direction.resize( dimension * dimension );
+  for ( unsigned int d = 0; d < dimension; d++ )
+    {
+    header.Size[d] = region.GetSize( d );
+    header.Index[d] = region.GetIndex( d );
+    header.ChunkSize[d] = vnl_math_max( static_cast<unsigned long>(
+      this->m_ChunkSize[d] ), 1ul );
+    header.Spacing[d] = input->GetSpacing()[d];
+    header.Origin[d] = input->GetOrigin()[d];
+    for ( unsigned int e = 0; e < dimension; e++ )
+      {
+      header.Direction[d * dimension + e] = input->GetDirection()[d][e];
+      }
+    }
+  if ( header.ComponentCode == 0 )
+    {
+    itkExceptionMacro( << "Unsupported vector component type for the "
+      << "chunked container." );
+    }
+
+  unsigned long numberOfChunks = header.GetNumberOfChunks();
+  if ( region.GetNumberOfPixels() == 0 )
+    {
+    itkExceptionMacro( << "Cannot write an empty image." );
+    }
+  header.Chunks.resize( numberOfChunks );
+  this->m_ChunkBuffers.clear();
+  this->m_ChunkBuffers.resize( numberOfChunks );
+  this->m_ChunkFailed.assign( numberOfChunks, 0 );
+
+  this->InvokeEvent( StartEvent() );
+
+  // Gather and compress the chunks on all threads.  Each chunk only
+  // touches its own buffer and table entry.
+  typename MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( vnl_math_min( this->m_NumberOfThreads,
+    static_cast<int>( numberOfChunks ) ) );
+  threader->SetSingleMethod( this->CompressChunksThreaderCallback, this );
+  threader->SingleMethodExecute();
+
+  for ( unsigned long n = 0; n < numberOfChunks; n++ )
+    {
+    if ( this->m_ChunkFailed[n] )
+      {
+      this->m_ChunkBuffers.clear();
+      itkExceptionMacro( << "Compression of chunk " << n << " failed." );
+      }
+    }
+
+  // The chunk table is complete once all sizes are known.
+  ChunkedVectorImageContainerHeader::UInt64Type offset
+    = header.GetHeaderSizeInBytes();
+  for ( unsigned long n = 0; n < numberOfChunks; n++ )
+    {
+    header.Chunks[n].Offset = offset;
+    offset += header.Chunks[n].StoredBytes;
+    }
+
+  std::ofstream str( this->m_FileName.c_str(),
+    std::ios::out | std::ios::binary );
+  if ( !str.is_open() )
+    {
+    VectorImageFileWriterException e(__FILE__, __LINE__);
+    OStringStream msg;
+    msg << "Could not open " << this->m_FileName << " for writing.";
+    e.SetDescription( msg.str().c_str() );
+    e.SetLocation( ITK_LOCATION );
+    throw e;
+    }
+  header.Write( str );
+  for ( unsigned long n = 0; n < numberOfChunks; n++ )
+    {
+    if ( !this->m_ChunkBuffers[n].empty() )
+      {
+      str.write( &this->m_ChunkBuffers[n][0], this->m_ChunkBuffers[n].size() );
+      }
+    std::vector<char>().swap( this->m_ChunkBuffers[n] );
+    }
+  bool failed = !str.good();
+  str.close();
+  this->m_ChunkBuffers.clear();
+
+  if ( failed )
+    {
+    VectorImageFileWriterException e(__FILE__, __LINE__);
+    OStringStream msg;
+    msg << "Error while writing " << this->m_FileName;
+    e.SetDescription( msg.str().c_str() );
+    e.SetLocation( ITK_LOCATION );
+    throw e;
+    }
+
+  this->InvokeEvent( EndEvent() );
+
+  if ( input->ShouldIReleaseData() )
+    {
+    input->ReleaseData();
+    }
+}
+
+//---------------------------------------------------------
+template <class TVectorImage, class TImage>
+ITK_THREAD_RETURN_TYPE
+VectorImageFileWriter<TVectorImage, TImage>
+::CompressChunksThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  Self *writer = (Self *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  unsigned long numberOfChunks = writer->m_ContainerHeader.Chunks.size();
+  for ( unsigned long n = threadId; n < numberOfChunks; n += threadCount )
+    {
+    writer->CompressChunk( n );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+//---------------------------------------------------------
+template <class TVectorImage, class TImage>
+void
+VectorImageFileWriter<TVectorImage, TImage>
+::CompressChunk( unsigned long chunkId )
+{
+  const ChunkedVectorImageContainerHeader &header = this->m_ContainerHeader;
+  const unsigned int numberOfComponents = header.NumberOfComponents;
+  const VectorImageType *input = this->GetInput();
+
+  std::vector<ChunkedVectorImageContainerHeader::UInt64Type> start;
+  std::vector<ChunkedVectorImageContainerHeader::UInt64Type> size;
+  header.GetChunkRegion( chunkId, start, size );
+
+  typename VectorImageRegionType::IndexType chunkIndex;
+  typename VectorImageRegionType::SizeType chunkSize;
+  for ( unsigned int d = 0; d < VectorImageType::ImageDimension; d++ )
+    {
+    chunkIndex[d] = static_cast<long>( header.Index[d] ) +
+      static_cast<long>( start[d] );
+    chunkSize[d] = static_cast<unsigned long>( size[d] );
+    }
+  VectorImageRegionType chunkRegion( chunkIndex, chunkSize );
+
+  std::vector<VectorImageComponentType> raw(
+    chunkRegion.GetNumberOfPixels() * numberOfComponents );
+  ImageRegionConstIterator<VectorImageType> It( input, chunkRegion );
+  unsigned long count = 0;
+  for ( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    const VectorImagePixelType &pixel = It.Get();
+    for ( unsigned int c = 0; c < numberOfComponents; c++ )
+      {
+      raw[count++] = pixel[c];
+      }
+    }
+
+  const unsigned long rawBytes = raw.size() * sizeof( VectorImageComponentType );
+  const char *rawPtr = reinterpret_cast<const char *>( &raw[0] );
+  std::vector<char> &buffer = this->m_ChunkBuffers[chunkId];
+
+  // A chunk is only kept compressed if that saves space; readers treat a
+  // chunk whose stored size equals its raw size as uncompressed.
+  bool stored = false;
+  if ( header.Compression == 1 )
+    {
+    uLongf compressedBytes = compressBound( rawBytes );
+    buffer.resize( compressedBytes );
+    int status = compress2( reinterpret_cast<Bytef *>( &buffer[0] ),
+      &compressedBytes, reinterpret_cast<const Bytef *>( rawPtr ),
+      rawBytes, this->m_CompressionLevel );
+    if ( status != Z_OK )
+      {
+      this->m_ChunkFailed[chunkId] = 1;
+      return;
+      }
+    if ( compressedBytes < rawBytes )
+      {
+      buffer.resize( compressedBytes );
+      stored = true;
+      }
+    }
+  if ( !stored )
+    {
+    buffer.assign( rawPtr, rawPtr + rawBytes );
+    }
+
+  this->m_ContainerHeader.Chunks[chunkId].StoredBytes = buffer.size();
+  this->m_ContainerHeader.Chunks[chunkId].RawBytes = rawBytes;
+}
+
 //---------------------------------------------------------
 template <class TVectorImage, class TImage>
 void 
@@ -426,6 +676,11 @@ VectorImageFileWriter<TVectorImage, TImage>
     {
     os << indent << "FactorySpecifiedmageIO: Off\n";
     }
+
+  os << indent << "UseChunkedContainer: " << m_UseChunkedContainer << "\n";
+  os << indent << "ChunkSize: " << m_ChunkSize << "\n";
+  os << indent << "CompressionLevel: " << m_CompressionLevel << "\n";
+  os << indent << "NumberOfThreads: " << m_NumberOfThreads << "\n";
 }
 
 } // end namespace itk
@@ -20,10 +20,14 @@
 #include "itkFEMLoadElementBase.h"
 
 #include "itkImage.h"
+#include "itkMultiThreader.h"
+#include "itkNeighborhoodIterator.h"
 #include "itkPDEDeformableRegistrationFunction.h"
 
 #include "vnl/vnl_math.h"
 
+#include <vector>
+
 namespace itk 
 {
 namespace fem
@@ -47,6 +51,12 @@ namespace fem
  * This region size may be set by the user by calling SetMetricRadius.
  * As the metric derivative computation evolves, performance should improve
  * and more functionality will be available (such as scale selection).
+ *
+ * When the load acts on all elements of a system, the Solver gets the nodal
+ * loads of all elements at once from GetLoadVectors. The shape functions,
+ * global positions and weights of the integration points are then
+ * tabulated once per mesh and the elements are split between threads, each
+ * with its own neighborhood iterator, metric global data and force vector.
  */ 
 template<class TMovingImage, class TFixedImage> 
 class FiniteDifferenceFunctionLoad 
@@ -75,6 +85,7 @@ public:
   typedef Image<VectorType, 
                 itkGetStaticConstMacro(ImageDimension)>   DeformationFieldType;
   typedef typename DeformationFieldType::Pointer          DeformationFieldTypePointer;
+  typedef NeighborhoodIterator<DeformationFieldType>      DeformationFieldNeighborhoodIteratorType;
 
   typedef PDEDeformableRegistrationFunction
           <FixedImageType, MovingImageType, 
@@ -87,6 +98,7 @@ public:
   FiniteDifferenceFunctionLoad(); 
   RealType EvaluateMetricGivenSolution(Element::ArrayType*, RealType);
   FEMVectorType Fe(FEMVectorType, FEMVectorType);
+  virtual bool GetLoadVectors(const Element::ArrayType&, unsigned int, std::vector<Float>&);
  
   static Baseclass* NewFiniteDifferenceFunctionLoad()
     { 
@@ -181,6 +193,25 @@ public:
 
 protected:
 
+  /** Metric force at global position Gpos given the solution Gsol there. */
+  void ComputeForce(const Float* Gpos, const Float* Gsol, 
+    DeformationFieldNeighborhoodIteratorType& nD, void* globalData, Float* force);
+
+  /** Tabulates the integration points of the elements. */
+  bool GenerateIntegrationPointTable(const Element::ArrayType&);
+
+  /** Adds the nodal loads of elements [begin, end) of the table to F. */
+  void ThreadedGetLoadVectors(unsigned int begin, unsigned int end, std::vector<Float>& F);
+
+  static ITK_THREAD_RETURN_TYPE LoadVectorsThreaderCallback( void *arg );
+
+  struct LoadVectorsThreadStruct
+  {
+    Self                              *Load;
+    std::vector<std::vector<Float> >  *Forces;
+    unsigned int                       NumberOfDegreesOfFreedom;
+  };
+
 private:
   MovingImageTypePointer                                  m_MovingImage;
   FixedImageTypePointer                                   m_FixedImage;
@@ -191,6 +222,21 @@ private:
   typename Solution::ConstPointer                         m_Solution;
   RealType                                                m_Gamma;
 
+  /**
+   * Integration point table: the elements it was computed for, the first
+   * integration point and shape function value of each element (one more
+   * entry than elements), the shape function values of all integration
+   * points, their global positions and their weights times the Jacobian
+   * determinant.
+   */
+  std::vector<const Element*>                             m_TableElements;
+  unsigned int                                            m_TableNumberOfIntegrationPoints;
+  std::vector<unsigned int>                               m_ElementIntegrationPointOffsets;
+  std::vector<unsigned int>                               m_ElementShapeFunctionOffsets;
+  std::vector<Float>                                      m_ShapeFunctionValues;
+  std::vector<Float>                                      m_IntegrationPointPositions;
+  std::vector<Float>                                      m_IntegrationPointWeights;
+
   /** Dummy static int that enables automatic registration
       with FEMObjectFactory. */
   static const int DummyCLID;
@@ -31,6 +31,7 @@ FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
 {
   m_Metric = NULL;
   m_MetricRadius.Fill(1);
+  m_TableNumberOfIntegrationPoints = 0;
 }
 
 template<class TMovingImage,class TFixedImage>
@@ -122,7 +123,6 @@ FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
   // the translation parameters as provided by the vector field at p.
   //------------------------------------------------------------
 
-  VectorType OutVec;
   FEMVectorType femVec;
   femVec.set_size(ImageDimension);
   femVec.fill(0.0);
@@ -136,6 +136,25 @@ FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
     }
   }
 
+  DeformationFieldNeighborhoodIteratorType nD(m_MetricRadius, 
+          m_DeformationField, m_DeformationField->GetLargestPossibleRegion());
+ 
+  void* globalData = NULL;
+  this->ComputeForce(Gpos.data_block(), Gsol.data_block(), nD, globalData, femVec.data_block());
+  return femVec;
+}
+
+template<class TMovingImage,class TFixedImage>
+void
+FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
+::ComputeForce(const Float* Gpos, const Float* Gsol, 
+  DeformationFieldNeighborhoodIteratorType& nD, void* globalData, Float* force)
+{
+  for (unsigned int k = 0; k < ImageDimension; k++) 
+  {
+    force[k] = 0.0;
+  }
+
   typename DeformationFieldType::IndexType idx;
   for (unsigned int k = 0; k < ImageDimension; k++) 
   {    
@@ -145,23 +164,223 @@ FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
         (Gpos[k]+0.5) < 0.0     ||
         (Gpos[k]+0.5) > m_FixedImage->GetLargestPossibleRegion().GetSize()[k]-1)
     {
-      return femVec;
+      return;
     }
     idx[k] = static_cast<unsigned int>(Gpos[k]+0.5);
   }
 
-  NeighborhoodIterator<DeformationFieldType> nD(m_MetricRadius, 
-          m_DeformationField, m_DeformationField->GetLargestPossibleRegion());
   nD.SetLocation(idx);
  
-  void* globalData = NULL;
-  OutVec = m_Metric->ComputeUpdate(nD, globalData);
+  VectorType OutVec = m_Metric->ComputeUpdate(nD, globalData);
   for (unsigned int k = 0; k < ImageDimension; k++) 
   {
-    femVec[k] = (vnl_math_isnan(OutVec[k]) || vnl_math_isinf(OutVec[k])) 
+    force[k] = (vnl_math_isnan(OutVec[k]) || vnl_math_isinf(OutVec[k])) 
               ? 0.0 : OutVec[k];
   }
-  return femVec;
+}
+
+template<class TMovingImage,class TFixedImage>
+bool
+FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
+::GetLoadVectors(const Element::ArrayType& elements, unsigned int numberOfDegreesOfFreedom, 
+  std::vector<Float>& F)
+{
+  if (!m_Metric || !m_DeformationField || !m_FixedImage || !m_MovingImage || !m_Solution)
+  {
+    return false;
+  }
+
+  // The table only depends on the mesh and the order of integration.
+  bool tableIsValid = ( m_TableNumberOfIntegrationPoints == m_NumberOfIntegrationPoints &&
+                        m_TableElements.size() == elements.size() );
+  for (unsigned int n = 0; tableIsValid && n < elements.size(); n++)
+  {
+    tableIsValid = ( m_TableElements[n] == static_cast<const Element*>(elements[n]) );
+  }
+  if (!tableIsValid && !this->GenerateIntegrationPointTable(elements))
+  {
+    return false;
+  }
+
+  // Errors in the numbering are reported by the element by element path.
+  for (unsigned int n = 0; n < m_TableElements.size(); n++)
+  {
+    const unsigned int Ne = m_TableElements[n]->GetNumberOfDegreesOfFreedom();
+    for (unsigned int j = 0; j < Ne; j++)
+    {
+      if (m_TableElements[n]->GetDegreeOfFreedom(j) >= numberOfDegreesOfFreedom)
+      {
+        return false;
+      }
+    }
+  }
+
+  int numberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if (numberOfThreads > static_cast<int>(m_TableElements.size()))
+  {
+    numberOfThreads = vnl_math_max(static_cast<int>(m_TableElements.size()), 1);
+  }
+  std::vector<std::vector<Float> > forces(numberOfThreads);
+
+  LoadVectorsThreadStruct str;
+  str.Load = this;
+  str.Forces = &forces;
+  str.NumberOfDegreesOfFreedom = numberOfDegreesOfFreedom;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(this->LoadVectorsThreaderCallback, &str);
+  threader->SingleMethodExecute();
+
+  // Sum the per-thread force vectors in thread order.
+  F.assign(numberOfDegreesOfFreedom, 0.0);
+  for (unsigned int t = 0; t < forces.size(); t++)
+  {
+    for (unsigned int i = 0; i < forces[t].size(); i++)
+    {
+      F[i] += forces[t][i];
+    }
+  }
+  return true;
+}
+
+template<class TMovingImage,class TFixedImage>
+bool
+FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
+::GenerateIntegrationPointTable(const Element::ArrayType& elements)
+{
+  m_TableElements.clear();
+  m_ElementIntegrationPointOffsets.assign(1, 0);
+  m_ElementShapeFunctionOffsets.assign(1, 0);
+  m_ShapeFunctionValues.clear();
+  m_IntegrationPointPositions.clear();
+  m_IntegrationPointWeights.clear();
+  m_TableNumberOfIntegrationPoints = m_NumberOfIntegrationPoints;
+
+  typename Element::VectorType ip, shapef;
+  typename Element::Float w;
+
+  for (unsigned int n = 0; n < elements.size(); n++)
+  {
+    const Element* element = elements[n];
+    if (element->GetNumberOfDegreesOfFreedomPerNode() != ImageDimension)
+    {
+      m_TableElements.clear();
+      return false;
+    }
+
+    const unsigned int Nip = element->GetNumberOfIntegrationPoints(m_NumberOfIntegrationPoints);
+    const unsigned int Nnodes = element->GetNumberOfNodes();
+    for (unsigned int i = 0; i < Nip; i++)
+    {
+      element->GetIntegrationPointAndWeight(i, ip, w, m_NumberOfIntegrationPoints);
+      shapef = element->ShapeFunctions(ip);
+      for (unsigned int k = 0; k < Nnodes; k++)
+      {
+        m_ShapeFunctionValues.push_back(shapef[k]);
+      }
+      for (unsigned int f = 0; f < ImageDimension; f++)
+      {
+        Float posval = 0.0;
+        for (unsigned int k = 0; k < Nnodes; k++)
+        {
+          posval += shapef[k] * ((element->GetNodeCoordinates(k))[f]);
+        }
+        m_IntegrationPointPositions.push_back(posval);
+      }
+      m_IntegrationPointWeights.push_back(w * element->JacobianDeterminant(ip));
+    }
+    m_TableElements.push_back(element);
+    m_ElementIntegrationPointOffsets.push_back(static_cast<unsigned int>(m_IntegrationPointWeights.size()));
+    m_ElementShapeFunctionOffsets.push_back(static_cast<unsigned int>(m_ShapeFunctionValues.size()));
+  }
+  return true;
+}
+
+template<class TMovingImage,class TFixedImage>
+ITK_THREAD_RETURN_TYPE
+FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
+::LoadVectorsThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  LoadVectorsThreadStruct *str = (LoadVectorsThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const unsigned long numberOfElements = str->Load->m_TableElements.size();
+  const unsigned int begin = static_cast<unsigned int>( ( numberOfElements * threadId ) / threadCount );
+  const unsigned int end = static_cast<unsigned int>( ( numberOfElements * ( threadId + 1 ) ) / threadCount );
+
+  std::vector<Float>& F = (*str->Forces)[threadId];
+  F.assign(str->NumberOfDegreesOfFreedom, 0.0);
+  if (begin < end)
+  {
+    str->Load->ThreadedGetLoadVectors(begin, end, F);
+  }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TMovingImage,class TFixedImage>
+void
+FiniteDifferenceFunctionLoad<TMovingImage , TFixedImage>
+::ThreadedGetLoadVectors(unsigned int begin, unsigned int end, std::vector<Float>& F)
+{
+  const unsigned int TotalSolutionIndex=1;/* Need to change if the index changes in CrankNicolsonSolver */
+
+  DeformationFieldNeighborhoodIteratorType nD(m_MetricRadius, 
+          m_DeformationField, m_DeformationField->GetLargestPossibleRegion());
+  void* globalData = m_Metric->GetGlobalDataPointer();
+
+  std::vector<Float> nodalSolution;
+  std::vector<unsigned int> dofs;
+  Float gsol[ImageDimension];
+  Float force[ImageDimension];
+
+  for (unsigned int n = begin; n < end; n++)
+  {
+    const Element* element = m_TableElements[n];
+    const unsigned int Ne = element->GetNumberOfDegreesOfFreedom();
+    const unsigned int Nnodes = element->GetNumberOfNodes();
+
+    // Solution at the nodes, read once per element
+    dofs.resize(Ne);
+    nodalSolution.resize(Ne);
+    for (unsigned int j = 0; j < Ne; j++)
+    {
+      dofs[j] = element->GetDegreeOfFreedom(j);
+      nodalSolution[j] = m_Solution->GetSolutionValue(dofs[j], TotalSolutionIndex);
+    }
+
+    const Float* shapef = &m_ShapeFunctionValues[m_ElementShapeFunctionOffsets[n]];
+    for (unsigned int i = m_ElementIntegrationPointOffsets[n]; 
+      i < m_ElementIntegrationPointOffsets[n+1]; i++, shapef += Nnodes)
+    {
+      for (unsigned int f = 0; f < ImageDimension; f++)
+      {
+        gsol[f] = 0.0;
+        for (unsigned int k = 0; k < Nnodes; k++)
+        {
+          gsol[f] += shapef[k] * nodalSolution[k*ImageDimension+f];
+        }
+      }
+
+      this->ComputeForce(&m_IntegrationPointPositions[i*ImageDimension], gsol, nD, globalData, force);
+
+      // Calculate the equivalent nodal loads
+      const Float wdetJ = m_IntegrationPointWeights[i];
+      for (unsigned int k = 0; k < Nnodes; k++)
+      {
+        for (unsigned int d = 0; d < ImageDimension; d++)
+        {
+          F[dofs[k*ImageDimension+d]] += shapef[k] * force[d] * wdetJ;
+        }
+      }
+    }
+  }
+
+  m_Metric->ReleaseGlobalDataPointer(globalData);
 }
 
 template<class TMovingImage,class TFixedImage> 
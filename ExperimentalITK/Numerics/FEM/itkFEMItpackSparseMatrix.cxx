@@ -221,9 +221,106 @@ void ItpackSparseMatrix::UnFinalize()
 }
 
 
+void ItpackSparseMatrix::SetCompressedRowPattern(const unsigned int *rowPointers, const unsigned int *columns)
+{
+
+  /* is matrix ready for initialization */
+  if (m_N <= 0)
+  {
+    throw FEMException(__FILE__, __LINE__, "ItpackSparseMatrix::SetCompressedRowPattern");
+  }
+
+  /* keep room for entries added later on in the dynamic form */
+  integer nonZeroValues = static_cast<integer>(rowPointers[m_N]);
+  if (m_NZ < nonZeroValues)
+  {
+    m_NZ = nonZeroValues;
+  }
+  if (m_NZ <= 0)
+  {
+    m_NZ = 1;
+  }
+
+  if (m_IA != 0)
+  {
+    delete [] m_IA;
+  }
+  if (m_JA != 0)
+  {
+    delete [] m_JA;
+  }
+  if (m_IWORK != 0)
+  {
+    delete [] m_IWORK;
+  }
+  if (m_A != 0)
+  {
+    delete [] m_A;
+  }
+  m_IA =    new integer [ m_N + 1 ];
+  m_JA =    new integer [ m_NZ ];
+  m_IWORK = new integer [ m_NZ ];
+  m_A =     new doublereal [ m_NZ ];
+
+  /* final itpack form uses 1-based indices */
+  int i;
+  for (i=0; i<=m_N; i++)
+  {
+    m_IA[i] = static_cast<integer>(rowPointers[i]) + 1;
+  }
+  for (i=0; i<nonZeroValues; i++)
+  {
+    m_JA[i] = static_cast<integer>(columns[i]) + 1;
+  }
+  for (i=nonZeroValues; i<m_NZ; i++)
+  {
+    m_JA[i] = 0;
+  }
+  for (i=0; i<m_NZ; i++)
+  {
+    m_IWORK[i] = 0;
+    m_A[i] = 0.0;
+  }
+
+  /* set info flags */
+  m_MatrixInitialized = 1;
+  m_MatrixFinalized = 1;
+
+  return;
+}
+
+
+ItpackSparseMatrix::integer ItpackSparseMatrix::FindFinalizedEntry(integer i, integer j) const
+{
+  if ( (m_MatrixInitialized == 0) || (m_MatrixFinalized == 0) )
+  {
+    return -1;
+  }
+
+  integer fortranJ = j+1;
+  for (integer k=m_IA[i]-1; k<m_IA[i+1]-1; k++)
+  {
+    if (m_JA[k] == fortranJ)
+    {
+      return k;
+    }
+  }
+
+  return -1;
+}
+
+
 void ItpackSparseMatrix::Set(integer i, integer j, doublereal value)
 {
 
+  /* entries of a finalized matrix are replaced in place */
+  integer entry = this->FindFinalizedEntry(i,j);
+  if (entry >= 0)
+  {
+    m_A[entry] = value;
+    return;
+  }
+
   /* check for dynamic form */
   if (m_MatrixInitialized == 0)
   {
@@ -273,6 +370,14 @@ void ItpackSparseMatrix::Add(integer i, integer j, doublereal value)
     return;
   }
 
+  /* entries of a finalized matrix are updated in place */
+  integer entry = this->FindFinalizedEntry(i,j);
+  if (entry >= 0)
+  {
+    m_A[entry] += value;
+    return;
+  }
+
   /* check for dynamic form */
   if (m_MatrixInitialized == 0)
   {
@@ -118,6 +118,18 @@ public:
    * \param a matrix values
    */
   void  SetCompressedRow(integer *ia, integer *ja, doublereal *a);
+
+  /**
+   * Replace the matrix by a finalized matrix of zeros with a fixed
+   * sparsity pattern. Set and Add on entries of the pattern then write
+   * in place; only new entries return the matrix to the dynamic form.
+   * \param rowPointers GetOrder()+1 zero-based offsets of the rows in columns
+   * \param columns zero-based column indices of the pattern
+   * \note the maximum number of non-zero values is raised to the size of
+   *       the pattern if necessary
+   */
+  void  SetCompressedRowPattern(const unsigned int *rowPointers, const unsigned int *columns);
+
   /**
    * Get the column indices of the matrix (via "itpack-like" naming scheme)
    */
@@ -185,6 +197,12 @@ private:
   /** finalize matrix form */
   void Finalize();
 
+  /**
+   * position of (i,j) in m_A if the matrix is finalized and the entry is
+   * allocated, -1 otherwise
+   */
+  integer FindFinalizedEntry(integer i, integer j) const;
+
 
 
   /** flag indicating whether the matrix representation has been finalized */
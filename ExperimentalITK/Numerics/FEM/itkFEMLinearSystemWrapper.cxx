@@ -165,6 +165,19 @@ void LinearSystemWrapper::GetColumnsOfNonZeroMatrixElementsInRow( unsigned int,
 }
 
 
+bool LinearSystemWrapper::InitializeMatrixPattern( const ColumnArray&, const ColumnArray&, unsigned int )
+{
+  // By default matrices have no fixed sparsity pattern
+  return false;
+}
+
+
+LinearSystemWrapper::Float* LinearSystemWrapper::GetMatrixPatternValues( unsigned int )
+{
+  return 0;
+}
+
+
 void LinearSystemWrapper::OptimizeMatrixStorage(unsigned int matrixIndex, unsigned int tempMatrixIndex)
 {
 
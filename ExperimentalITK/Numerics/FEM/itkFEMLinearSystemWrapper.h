@@ -227,6 +227,27 @@ public:
    */
   virtual void AddMatrixValue(unsigned int i, unsigned int j, Float value, unsigned int matrixIndex = 0) = 0;
 
+  /**
+   * Initialization of a matrix with a fixed sparsity pattern. The matrix
+   * is created with zeros at the entries of the pattern, which can then be
+   * accumulated directly through GetMatrixPatternValues. Returns false if
+   * the matrix storage cannot hold a fixed pattern; the matrix must then
+   * be initialized and assembled as usual. The default does nothing.
+   * \param rowPointers zero-based offsets of the rows in columns (order+1 values)
+   * \param columns zero-based column indices of the entries, row by row
+   * \param matrixIndex index of matrix to initialize
+   */
+  virtual bool InitializeMatrixPattern( const ColumnArray& rowPointers, const ColumnArray& columns, unsigned int matrixIndex = 0 );
+
+  /**
+   * Values of a matrix initialized with InitializeMatrixPattern, in the
+   * order of the columns of the pattern, or 0 if the matrix has no fixed
+   * pattern. The array is valid until an entry outside the pattern is
+   * set or added.
+   * \param matrixIndex index of matrix
+   */
+  virtual Float* GetMatrixPatternValues( unsigned int matrixIndex = 0 );
+
   /**
    * Returns the column index (zero based) of the i-th non zero
    * (non allocated)element in a given row of A matrix. This function
@@ -359,6 +359,47 @@ void LinearSystemWrapperItpack::GetColumnsOfNonZeroMatrixElementsInRow( unsigned
 }
 
 
+bool LinearSystemWrapperItpack::InitializeMatrixPattern( const ColumnArray& rowPointers, const ColumnArray& columns, unsigned int matrixIndex )
+{
+  /* error checking */
+  if (!m_Order) 
+  {
+    throw FEMExceptionLinearSystem(__FILE__, __LINE__, "LinearSystemWrapperItpack::InitializeMatrixPattern", "System order not set");
+  }
+  if (matrixIndex >= m_NumberOfMatrices)
+  {
+    throw FEMExceptionLinearSystemBounds(__FILE__, __LINE__, "LinearSystemWrapperItpack::InitializeMatrixPattern", "m_Matrices", matrixIndex);
+  }
+  if ( (rowPointers.size() != m_Order+1) || (columns.size() != rowPointers[m_Order]) )
+  {
+    throw FEMExceptionLinearSystem(__FILE__, __LINE__, "LinearSystemWrapperItpack::InitializeMatrixPattern", "Sparsity pattern does not match system order");
+  }
+
+  // allocate if necessay
+  if (m_Matrices == 0)
+  {
+    m_Matrices = new MatrixHolder(m_NumberOfMatrices);
+  }
+
+  /* the matrix is created directly in the final itpack form */
+  (*m_Matrices)[matrixIndex].Clear();
+  (*m_Matrices)[matrixIndex].SetOrder(m_Order);
+  (*m_Matrices)[matrixIndex].SetMaxNonZeroValues( m_MaximumNonZeroValues );
+  (*m_Matrices)[matrixIndex].SetCompressedRowPattern( &rowPointers[0], columns.empty() ? 0 : &columns[0] );
+
+  return true;
+}
+
+
+LinearSystemWrapperItpack::Float* LinearSystemWrapperItpack::GetMatrixPatternValues( unsigned int matrixIndex )
+{
+  if ( !m_Matrices || (matrixIndex >= m_NumberOfMatrices) ) return 0;
+  if ( !(*m_Matrices)[matrixIndex].m_MatrixFinalized ) return 0;
+
+  return (*m_Matrices)[matrixIndex].GetA();
+}
+
+
 void LinearSystemWrapperItpack::ScaleMatrix(Float scale, unsigned int matrixIndex)
 {
   /* error checking */
@@ -431,6 +431,10 @@ public:
 
   virtual void GetColumnsOfNonZeroMatrixElementsInRow( unsigned int row, ColumnArray& cols, unsigned int matrixIndex );
 
+  virtual bool  InitializeMatrixPattern( const ColumnArray& rowPointers, const ColumnArray& columns, unsigned int matrixIndex );
+
+  virtual Float* GetMatrixPatternValues( unsigned int matrixIndex );
+
   virtual Float GetVectorValue(unsigned int i, unsigned int vectorIndex) const;
 
   virtual void  SetVectorValue(unsigned int i, Float value, unsigned int vectorIndex);
@@ -59,6 +59,17 @@ public:
   virtual void Read( std::istream& f, void* info );
   void Write( std::ostream& f ) const;
 
+  /**
+   * Computes the nodal loads of all elements in a system at once. The
+   * result is indexed by global DOF and has numberOfDegreesOfFreedom
+   * values. Loads that return false (the default) are applied by calling
+   * the Element's GetLoadVector member for each element in turn.
+   */
+  virtual bool GetLoadVectors( const Element::ArrayType&, unsigned int, std::vector<Float>& )
+  {
+    return false;
+  }
+
   // FIXME: should clear vector, not zero it
   LoadElement() : el(0) {}
 
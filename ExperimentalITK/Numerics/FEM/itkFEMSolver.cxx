@@ -42,7 +42,7 @@ namespace fem {
 /*
  * Default constructor for Solver class
  */
-Solver::Solver() : NGFN(0), NMFC(0), m_NZE(0)
+Solver::Solver() : NGFN(0), NMFC(0), m_NZE(0), m_UseMatrixPattern(true)
 {
   this->SetLinearSystemWrapper(&m_lsVNL);
 }
@@ -60,6 +60,9 @@ void Solver::Clear( void )
   this->NGFN=0;
   this->NMFC=0;
   this->m_NZE=0;
+  this->m_MatrixPatternRowPointers.clear();
+  this->m_MatrixPatternColumns.clear();
+  this->m_ElementColors.clear();
   this->SetLinearSystemWrapper(&m_lsVNL);
 }
 
@@ -201,6 +204,11 @@ void Solver::Write( std::ostream& f ) {
  */
 void Solver::GenerateGFN() {
 
+  // The cached sparsity pattern is based on the old numbering
+  m_MatrixPatternRowPointers.clear();
+  m_MatrixPatternColumns.clear();
+  m_ElementColors.clear();
+
   // Clear the list of elements and global freedom numbers in nodes
   // FIXME: should be removed once Mesh is there
   for(NodeArray::iterator n=node.begin(); n!=node.end(); n++)
@@ -291,13 +299,22 @@ void Solver::AssembleK()
   this->InitializeMatrixForAssembly(NGFN+NMFC);
 
   /*
-   * Step over all elements
+   * Step over all elements. If the matrix has a fixed sparsity pattern
+   * the element matrices are added directly to its values.
    */
-  for(ElementArray::iterator e=el.begin(); e!=el.end(); e++)
+  std::vector<Float*> values(1,this->InitializeMatrixPattern(0));
+  if ( values[0] )
+  {
+    this->AssembleElementMatricesWithPattern(values);
+  }
+  else
   {
-    // Call the function that actually moves the element matrix
-    // to the master matrix.
-    this->AssembleElementMatrix(&**e);
+    for(ElementArray::iterator e=el.begin(); e!=el.end(); e++)
+    {
+      // Call the function that actually moves the element matrix
+      // to the master matrix.
+      this->AssembleElementMatrix(&**e);
+    }
   }
 
   /*
@@ -327,6 +344,198 @@ void Solver::InitializeMatrixForAssembly(unsigned int N)
 }
 
 
+void Solver::GenerateMatrixPattern( void )
+{
+  typedef LinearSystemWrapper::ColumnArray IndexArray;
+
+  m_MatrixPatternRowPointers.clear();
+  m_MatrixPatternColumns.clear();
+  m_ElementColors.clear();
+
+  /*
+   * Elements that contain each DOF, in increasing order.
+   */
+  std::vector<IndexArray> dofElements(NGFN);
+  for(unsigned int n=0; n<el.size(); n++)
+  {
+    const Element* e=&*el[n];
+    const unsigned int Ne=e->GetNumberOfDegreesOfFreedom();
+    for(unsigned int j=0; j<Ne; j++)
+    {
+      // error checking. all GFN should be =>0 and <NGFN
+      if ( e->GetDegreeOfFreedom(j) >= NGFN )
+      {
+        throw FEMExceptionSolution(__FILE__,__LINE__,"Solver::GenerateMatrixPattern()","Illegal GFN!");
+      }
+      dofElements[e->GetDegreeOfFreedom(j)].push_back(n);
+    }
+  }
+
+  /*
+   * Greedy colouring: each element gets the lowest colour that is not
+   * used by an earlier element sharing one of its DOFs, so that the
+   * elements of one colour never update the same matrix row.
+   */
+  IndexArray elementColor(el.size());
+  IndexArray colorMark;
+  for(unsigned int n=0; n<el.size(); n++)
+  {
+    const Element* e=&*el[n];
+    const unsigned int Ne=e->GetNumberOfDegreesOfFreedom();
+    for(unsigned int j=0; j<Ne; j++)
+    {
+      const IndexArray& neighbors=dofElements[e->GetDegreeOfFreedom(j)];
+      for(unsigned int m=0; m<neighbors.size() && neighbors[m]<n; m++)
+      {
+        colorMark[elementColor[neighbors[m]]]=n+1;
+      }
+    }
+    unsigned int color=0;
+    while( color<colorMark.size() && colorMark[color]==n+1 )
+    {
+      color++;
+    }
+    if ( color==colorMark.size() )
+    {
+      colorMark.push_back(0);
+      m_ElementColors.push_back(IndexArray());
+    }
+    elementColor[n]=color;
+    m_ElementColors[color].push_back(n);
+  }
+
+  /*
+   * Row j of the pattern holds the DOFs of all elements that contain DOF j.
+   */
+  IndexArray rowMark(NGFN,0);
+  m_MatrixPatternRowPointers.reserve(NGFN+1);
+  m_MatrixPatternRowPointers.push_back(0);
+  for(unsigned int row=0; row<NGFN; row++)
+  {
+    const IndexArray& elements=dofElements[row];
+    for(unsigned int m=0; m<elements.size(); m++)
+    {
+      const Element* e=&*el[elements[m]];
+      const unsigned int Ne=e->GetNumberOfDegreesOfFreedom();
+      for(unsigned int k=0; k<Ne; k++)
+      {
+        const unsigned int col=e->GetDegreeOfFreedom(k);
+        if ( rowMark[col]!=row+1 )
+        {
+          rowMark[col]=row+1;
+          m_MatrixPatternColumns.push_back(col);
+        }
+      }
+    }
+    std::sort(m_MatrixPatternColumns.begin()+m_MatrixPatternRowPointers.back(),m_MatrixPatternColumns.end());
+    m_MatrixPatternRowPointers.push_back(static_cast<unsigned int>(m_MatrixPatternColumns.size()));
+  }
+}
+
+
+
+
+Solver::Float* Solver::InitializeMatrixPattern(unsigned int matrixIndex)
+{
+  if ( !m_UseMatrixPattern || NGFN==0 )
+  {
+    return 0;
+  }
+
+  if ( m_MatrixPatternRowPointers.empty() )
+  {
+    this->GenerateMatrixPattern();
+  }
+
+  // The rows of the MFC Lagrange multipliers hold no element entries.
+  m_MatrixPatternRowPointers.resize(NGFN+NMFC+1,m_MatrixPatternRowPointers[NGFN]);
+
+  if ( !m_ls->InitializeMatrixPattern(m_MatrixPatternRowPointers,m_MatrixPatternColumns,matrixIndex) )
+  {
+    return 0;
+  }
+  return m_ls->GetMatrixPatternValues(matrixIndex);
+}
+
+
+
+
+void Solver::AssembleElementMatricesWithPattern(const std::vector<Float*>& values)
+{
+  MultiThreader::Pointer threader=MultiThreader::New();
+
+  MatrixPatternThreadStruct str;
+  str.TheSolver=this;
+  str.Values=&values;
+
+  /*
+   * Elements of one colour share no DOFs and are added concurrently.
+   * Each matrix entry is therefore always summed in the same order.
+   */
+  for(unsigned int c=0; c<m_ElementColors.size(); c++)
+  {
+    str.Elements=&m_ElementColors[c];
+
+    int numberOfThreads=MultiThreader::GetGlobalDefaultNumberOfThreads();
+    if ( numberOfThreads>static_cast<int>(m_ElementColors[c].size()) )
+    {
+      numberOfThreads=static_cast<int>(m_ElementColors[c].size());
+    }
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod( this->MatrixPatternThreaderCallback, &str );
+    threader->SingleMethodExecute();
+  }
+}
+
+
+
+
+ITK_THREAD_RETURN_TYPE Solver::MatrixPatternThreaderCallback(void *arg)
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  MatrixPatternThreadStruct *str = (MatrixPatternThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const LinearSystemWrapper::ColumnArray& elements=*str->Elements;
+  const unsigned int begin=static_cast<unsigned int>( ( static_cast<unsigned long>(elements.size())*threadId )/threadCount );
+  const unsigned int end=static_cast<unsigned int>( ( static_cast<unsigned long>(elements.size())*(threadId+1) )/threadCount );
+  for(unsigned int n=begin; n<end; n++)
+  {
+    str->TheSolver->AssembleElementMatrixWithPattern( &*str->TheSolver->el[elements[n]], *str->Values );
+  }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+
+
+void Solver::AssembleElementMatrixWithPattern(const Element* e, const std::vector<Float*>& values)
+{
+  // Copy the element stiffness matrix for faster access.
+  Element::MatrixType Ke;
+  e->GetStiffnessMatrix(Ke);
+
+  const unsigned int Ne=e->GetNumberOfDegreesOfFreedom();
+  Float* K=values[0];
+  for(unsigned int j=0; j<Ne; j++)
+  {
+    const unsigned int row=e->GetDegreeOfFreedom(j);
+    for(unsigned int k=0; k<Ne; k++)
+    {
+      if ( Ke[j][k]!=Float(0.0) )
+      {
+        K[this->GetMatrixPatternIndex(row,e->GetDegreeOfFreedom(k))]+=Ke[j][k];
+      }
+    }
+  }
+}
+
+
+
+
 void Solver::AssembleLandmarkContribution(Element::Pointer e, float eta)
 {
   // Copy the element "landmark" matrix for faster access.
@@ -510,20 +719,35 @@ void Solver::AssembleF(int dim) {
       {
  /*
   * If the list of element pointers in load object is empty,
-  * we apply the load to all elements in a system.
+  * we apply the load to all elements in a system. The load object
+  * may compute the nodal loads of all elements at once.
   */
- for(ElementArray::iterator e=el.begin(); e!=el.end(); e++) // step over all elements in a system
+ std::vector<Float> Fall;
+ if ( dim==0 && l1->GetLoadVectors(el, NGFN, Fall) )
  {
-   (*e)->GetLoadVector(Element::LoadPointer(l1), Fe);  // ... element's force vector
-   unsigned int Ne=(*e)->GetNumberOfDegreesOfFreedom();    // ... element's number of DOF
-   for(unsigned int j=0; j<Ne; j++)  // step over all DOF
+   for(unsigned int i=0; i<NGFN; i++)
    {
-     if ( (*e)->GetDegreeOfFreedom(j) >= NGFN )
+     if ( Fall[i]!=0.0 )
      {
-              throw FEMExceptionSolution(__FILE__,__LINE__,"Solver::AssembleF()","Illegal GFN!");
+       m_ls->AddVectorValue(i, Fall[i]);
+     }
+   }
+ }
+ else
+ {
+   for(ElementArray::iterator e=el.begin(); e!=el.end(); e++) // step over all elements in a system
+   {
+     (*e)->GetLoadVector(Element::LoadPointer(l1), Fe);  // ... element's force vector
+     unsigned int Ne=(*e)->GetNumberOfDegreesOfFreedom();    // ... element's number of DOF
+     for(unsigned int j=0; j<Ne; j++)  // step over all DOF
+     {
+       if ( (*e)->GetDegreeOfFreedom(j) >= NGFN )
+       {
+                throw FEMExceptionSolution(__FILE__,__LINE__,"Solver::AssembleF()","Illegal GFN!");
+       }
+       // update the master force vector (take care of the correct isotropic dimensions)
+       m_ls->AddVectorValue((*e)->GetDegreeOfFreedom(j) , Fe(j+dim*Ne));
      }
-     // update the master force vector (take care of the correct isotropic dimensions)
-     m_ls->AddVectorValue((*e)->GetDegreeOfFreedom(j) , Fe(j+dim*Ne));
    }
  }
       }
@@ -26,6 +26,10 @@
 #include "itkFEMLinearSystemWrapperVNL.h"
 
 #include "itkImage.h"
+#include "itkMultiThreader.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace itk {
 namespace fem {
@@ -274,6 +278,18 @@ public:
     */
   void SetMaximumNumberOfNonZeroElements( unsigned long nze ) { m_NZE = nze; };
 
+  /**
+   * Assemble the master matrices with a cached sparsity pattern. The
+   * pattern and a colouring of the elements, in which no two elements of
+   * one colour share a degree of freedom, are computed once from the
+   * element connectivity. The element matrices of each colour are then
+   * added in parallel directly to the matrix values. This is only done
+   * if the LinearSystemWrapper supports fixed patterns (see
+   * LinearSystemWrapper::InitializeMatrixPattern). On by default.
+   */
+  void SetUseMatrixPattern( bool b ) { m_UseMatrixPattern = b; }
+  bool GetUseMatrixPattern( void ) const { return m_UseMatrixPattern; }
+
 public:
   /**
    * Default constructor sets Solver to use VNL linear system .
@@ -349,8 +365,72 @@ protected:
   /** Pointer to LinearSystemWrapper object. */
   LinearSystemWrapper::Pointer m_ls;
 
+  /**
+   * Computes the sparsity pattern of the element matrices and the element
+   * colouring. Both are kept until GenerateGFN or Clear is called.
+   */
+  void GenerateMatrixPattern( void );
+
+  /**
+   * Initializes a master matrix of order NGFN+NMFC with the cached
+   * sparsity pattern and returns its values, or 0 if the matrix must be
+   * assembled with AssembleElementMatrix.
+   *
+   * \param matrixIndex Index of the matrix in the LinearSystemWrapper.
+   */
+  Float* InitializeMatrixPattern( unsigned int matrixIndex );
+
+  /**
+   * Position of entry (i,j) of the pattern in the values returned by
+   * InitializeMatrixPattern.
+   */
+  unsigned int GetMatrixPatternIndex( unsigned int i, unsigned int j ) const
+  {
+    LinearSystemWrapper::ColumnArray::const_iterator first=m_MatrixPatternColumns.begin()+m_MatrixPatternRowPointers[i];
+    LinearSystemWrapper::ColumnArray::const_iterator last=m_MatrixPatternColumns.begin()+m_MatrixPatternRowPointers[i+1];
+    return static_cast<unsigned int>( std::lower_bound(first,last,j)-m_MatrixPatternColumns.begin() );
+  }
+
+  /**
+   * Adds the matrices of all elements to the master matrix values returned
+   * by InitializeMatrixPattern, one colour at a time.
+   */
+  void AssembleElementMatricesWithPattern( const std::vector<Float*>& values );
+
+  /**
+   * Adds the matrices of one element to the master matrix values. This is
+   * called concurrently for the elements of one colour. Derived solvers
+   * that override AssembleElementMatrix must override this function too,
+   * or switch the pattern off.
+   */
+  virtual void AssembleElementMatrixWithPattern( const Element* e, const std::vector<Float*>& values );
+
 private:
 
+  /** Threader callback of AssembleElementMatricesWithPattern. */
+  static ITK_THREAD_RETURN_TYPE MatrixPatternThreaderCallback( void *arg );
+
+  struct MatrixPatternThreadStruct
+  {
+    Solver *TheSolver;
+    const LinearSystemWrapper::ColumnArray *Elements;
+    const std::vector<Float*> *Values;
+  };
+
+  /**
+   * Compressed row sparsity pattern of the element matrices: zero-based
+   * row offsets into m_MatrixPatternColumns, whose entries are sorted
+   * within each row. Empty if the pattern has not been computed.
+   */
+  LinearSystemWrapper::ColumnArray m_MatrixPatternRowPointers;
+  LinearSystemWrapper::ColumnArray m_MatrixPatternColumns;
+
+  /** Indices of the elements of each colour. */
+  std::vector<LinearSystemWrapper::ColumnArray> m_ElementColors;
+
+  bool m_UseMatrixPattern;
+
+
   /**
    * LinearSystemWrapperVNL object that is used by default in Solver class.
    */
@@ -94,50 +94,60 @@ void SolverCrankNicolson::AssembleKandM()
   InitializeForSolution(); 
   
   /*
-   * Step over all elements
+   * Step over all elements. If the matrices have a fixed sparsity pattern
+   * the element matrices are added directly to their values.
    */
-   
-  for(ElementArray::iterator e=el.begin(); e!=el.end(); e++)
+  std::vector<Float*> values(2);
+  values[0]=this->InitializeMatrixPattern(SumMatrixIndex);
+  values[1]=this->InitializeMatrixPattern(DifferenceMatrixIndex);
+  if ( values[0] && values[1] )
+  {
+    this->AssembleElementMatricesWithPattern(values);
+  }
+  else
   {
-    vnl_matrix<Float> Ke;
-    (*e)->GetStiffnessMatrix(Ke);  /*Copy the element stiffness matrix for faster access. */
+    for(ElementArray::iterator e=el.begin(); e!=el.end(); e++)
+    {
+      vnl_matrix<Float> Ke;
+      (*e)->GetStiffnessMatrix(Ke);  /*Copy the element stiffness matrix for faster access. */
 
-    vnl_matrix<Float> Me;
-    (*e)->GetMassMatrix(Me);  /*Copy the element mass matrix for faster access. */
-    int Ne=(*e)->GetNumberOfDegreesOfFreedom();          /*... same for element DOF */
+      vnl_matrix<Float> Me;
+      (*e)->GetMassMatrix(Me);  /*Copy the element mass matrix for faster access. */
+      int Ne=(*e)->GetNumberOfDegreesOfFreedom();          /*... same for element DOF */
 
-    Me=Me*m_rho;
+      Me=Me*m_rho;
 
-    /* step over all rows in in element matrix */
-    for(int j=0; j<Ne; j++)
-    {
-      /* step over all columns in in element matrix */
-      for(int k=0; k<Ne; k++) 
+      /* step over all rows in in element matrix */
+      for(int j=0; j<Ne; j++)
       {
-        /* error checking. all GFN should be =>0 and <NGFN */
-        if ( (*e)->GetDegreeOfFreedom(j) >= NGFN ||
-             (*e)->GetDegreeOfFreedom(k) >= NGFN  )
+        /* step over all columns in in element matrix */
+        for(int k=0; k<Ne; k++) 
         {
-          throw FEMExceptionSolution(__FILE__,__LINE__,"SolverCrankNicolson::AssembleKandM()","Illegal GFN!");
-        }
+          /* error checking. all GFN should be =>0 and <NGFN */
+          if ( (*e)->GetDegreeOfFreedom(j) >= NGFN ||
+               (*e)->GetDegreeOfFreedom(k) >= NGFN  )
+          {
+            throw FEMExceptionSolution(__FILE__,__LINE__,"SolverCrankNicolson::AssembleKandM()","Illegal GFN!");
+          }
         
-        /* Here we finaly update the corresponding element
-         * in the master stiffness matrix. We first check if 
-         * element in Ke is zero, to prevent zeros from being 
-         * allocated in sparse matrix.
-         */
-        if ( Ke(j,k)!=Float(0.0) || Me(j,k) != Float(0.0) )
-        {
-          // left hand side matrix
-          lhsval=(Me(j,k) + m_alpha*m_deltaT*Ke(j,k));
-          m_ls->AddMatrixValue( (*e)->GetDegreeOfFreedom(j) , 
-                    (*e)->GetDegreeOfFreedom(k), 
-                    lhsval, SumMatrixIndex );
-          // right hand side matrix
-          rhsval=(Me(j,k) - (1.-m_alpha)*m_deltaT*Ke(j,k));
-          m_ls->AddMatrixValue( (*e)->GetDegreeOfFreedom(j) , 
-                    (*e)->GetDegreeOfFreedom(k), 
-                    rhsval, DifferenceMatrixIndex );
+          /* Here we finaly update the corresponding element
+           * in the master stiffness matrix. We first check if 
+           * element in Ke is zero, to prevent zeros from being 
+           * allocated in sparse matrix.
+           */
+          if ( Ke(j,k)!=Float(0.0) || Me(j,k) != Float(0.0) )
+          {
+            // left hand side matrix
+            lhsval=(Me(j,k) + m_alpha*m_deltaT*Ke(j,k));
+            m_ls->AddMatrixValue( (*e)->GetDegreeOfFreedom(j) , 
+                      (*e)->GetDegreeOfFreedom(k), 
+                      lhsval, SumMatrixIndex );
+            // right hand side matrix
+            rhsval=(Me(j,k) - (1.-m_alpha)*m_deltaT*Ke(j,k));
+            m_ls->AddMatrixValue( (*e)->GetDegreeOfFreedom(j) , 
+                      (*e)->GetDegreeOfFreedom(k), 
+                      rhsval, DifferenceMatrixIndex );
+          }
         }
       }
     }
@@ -188,6 +198,34 @@ void SolverCrankNicolson::AssembleKandM()
 }
 
 
+void SolverCrankNicolson::AssembleElementMatrixWithPattern(const Element* e, const std::vector<Float*>& values)
+{
+  vnl_matrix<Float> Ke;
+  e->GetStiffnessMatrix(Ke);
+
+  vnl_matrix<Float> Me;
+  e->GetMassMatrix(Me);
+
+  Me=Me*m_rho;
+
+  const unsigned int Ne=e->GetNumberOfDegreesOfFreedom();
+  for(unsigned int j=0; j<Ne; j++)
+  {
+    const unsigned int row=e->GetDegreeOfFreedom(j);
+    for(unsigned int k=0; k<Ne; k++)
+    {
+      if ( Ke(j,k)!=Float(0.0) || Me(j,k) != Float(0.0) )
+      {
+        const unsigned int index=this->GetMatrixPatternIndex(row,e->GetDegreeOfFreedom(k));
+        // left and right hand side matrices
+        values[0][index]+=(Me(j,k) + m_alpha*m_deltaT*Ke(j,k));
+        values[1][index]+=(Me(j,k) - (1.-m_alpha)*m_deltaT*Ke(j,k));
+      }
+    }
+  }
+}
+
+
 /*
  * Assemble the master force vector
  */
@@ -74,6 +74,12 @@ public:
    */  
   void AssembleKandM();            
 
+  /**
+   * Adds the element stiffness and mass matrices to the left and right
+   * hand side matrices of the implicit scheme.
+   */
+  virtual void AssembleElementMatrixWithPattern(const Element* e, const std::vector<Float*>& values);
+
   /**
    * Assemble the master force vector at a given time.
    *
@@ -32,6 +32,8 @@ SolverHyperbolic::SolverHyperbolic()
 {
   this->InitializeLinearSystemWrapper();
   this->SetMaximumNumberOfNonZeroElements(0);
+  // M and K are assembled together by AssembleElementMatrix
+  this->SetUseMatrixPattern(false);
   m_beta=0.25;
   m_gamma=0.5;
   m_deltaT=1.0;
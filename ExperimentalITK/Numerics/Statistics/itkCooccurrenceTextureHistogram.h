@@ -0,0 +1,223 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+// co-occurrence matrix for the moving window texture features
+#ifndef __itkCooccurrenceTextureHistogram_h
+#define __itkCooccurrenceTextureHistogram_h
+#include "itkNumericTraits.h"
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace itk
+{
+namespace Function
+{
+
+/*
+ * Dense, symmetric co-occurrence matrix over small integer bins which
+ * keeps the running sums needed for the Haralick features of
+ * HistogramToTextureFeaturesFilter.  Pairs are added and removed one at
+ * a time so that a sliding window only has to touch the pairs entering
+ * and leaving it; GetValue() is then independent of the window size.
+ *
+ * The entropy is the plain Shannon entropy of the normalized matrix,
+ * i.e. without the 1e-4 relative frequency cutoff used by
+ * HistogramToTextureFeaturesFilter.
+ */
+template< class TOutputPixel >
+class CooccurrenceTextureHistogram
+{
+public:
+
+  CooccurrenceTextureHistogram( unsigned int numberOfBins = 64 )
+    {
+    this->SetNumberOfBins( numberOfBins );
+    }
+
+  // ~CooccurrenceTextureHistogram()  {} default is ok
+
+  void SetNumberOfBins( unsigned int numberOfBins )
+    {
+    m_NumberOfBins = numberOfBins;
+    m_Counts.assign( numberOfBins * numberOfBins, 0 );
+    m_RowCounts.assign( numberOfBins, 0 );
+    this->Clear();
+    }
+
+  unsigned int GetNumberOfBins() const
+    {
+    return m_NumberOfBins;
+    }
+
+  void Clear()
+    {
+    std::fill( m_Counts.begin(), m_Counts.end(), 0 );
+    std::fill( m_RowCounts.begin(), m_RowCounts.end(), 0 );
+    m_Total = 0.0;
+    m_SumI = 0.0;
+    m_SumI2 = 0.0;
+    m_SumIJ = 0.0;
+    m_SumS2 = 0.0;
+    m_SumS3 = 0.0;
+    m_SumS4 = 0.0;
+    m_SumSquaredCounts = 0.0;
+    m_SumCountLogCount = 0.0;
+    m_SumInverseDifference = 0.0;
+    m_SumSquaredDifference = 0.0;
+    m_SumSquaredRowCounts = 0.0;
+    }
+
+  /** Adds the pair (a, b) and, by symmetry, (b, a). */
+  void AddPair( unsigned int a, unsigned int b )
+    {
+    this->UpdateCell( a, b, 1 );
+    this->UpdateCell( b, a, 1 );
+    }
+
+  void RemovePair( unsigned int a, unsigned int b )
+    {
+    this->UpdateCell( a, b, -1 );
+    this->UpdateCell( b, a, -1 );
+    }
+
+  unsigned int GetNumberOfFeatures() const
+    {
+    return 8;
+    }
+
+  /**
+   * Energy, entropy, correlation, inverse difference moment, inertia,
+   * cluster shade, cluster prominence and Haralick's correlation, in the
+   * order of the outputs of TextureFeaturesImageFilter.
+   */
+  TOutputPixel GetValue() const
+    {
+    TOutputPixel out;
+    NumericTraits<TOutputPixel>::SetLength( out, 8 );
+    for( unsigned int i = 0; i < 8; i++ )
+      {
+      out[i] = 0;
+      }
+    if( m_Total <= 0 )
+      {
+      return out;
+      }
+
+    const double icount = 1.0 / m_Total;
+
+    const double pixelMean = m_SumI * icount;
+    double pixelVarianceSquared = vnl_math_sqr(
+      m_SumI2 * icount - pixelMean * pixelMean );
+    if( pixelVarianceSquared < 2.0 * NumericTraits<double>::epsilon() )
+      {
+      pixelVarianceSquared = 1.0;
+      }
+
+    // the marginal sums add up to one over m_NumberOfBins bins
+    const double marginalMean = 1.0 / static_cast<double>( m_NumberOfBins );
+    const double marginalDevSquared = m_SumSquaredRowCounts * icount * icount
+      * marginalMean - marginalMean * marginalMean;
+
+    const double meanIJ = m_SumIJ * icount;
+
+    // central moments of s = i + j about its mean m = 2 * pixelMean
+    const double m = 2.0 * pixelMean;
+    const double s2 = m_SumS2 * icount;
+    const double s3 = m_SumS3 * icount;
+    const double s4 = m_SumS4 * icount;
+    const double clusterShade = s3 - 3.0 * m * s2 + 2.0 * m * m * m;
+    const double clusterProminence = s4 - 4.0 * m * s3 + 6.0 * m * m * s2
+      - 3.0 * m * m * m * m;
+
+    const double entropy = ( vcl_log( m_Total )
+      - m_SumCountLogCount * icount ) / vcl_log( 2.0 );
+
+    unsigned int i = 0;
+    out[i++] = m_SumSquaredCounts * icount * icount;
+    out[i++] = entropy;
+    out[i++] = ( meanIJ - pixelMean * pixelMean ) / pixelVarianceSquared;
+    out[i++] = m_SumInverseDifference * icount;
+    out[i++] = m_SumSquaredDifference * icount;
+    out[i++] = clusterShade;
+    out[i++] = clusterProminence;
+    out[i++] = ( marginalDevSquared > 0 )
+      ? ( meanIJ - marginalMean * marginalMean ) / marginalDevSquared : 0.0;
+    return out;
+  }
+
+private:
+
+  void UpdateCell( unsigned int i, unsigned int j, int delta )
+    {
+    unsigned int &count = m_Counts[i * m_NumberOfBins + j];
+    const double c0 = static_cast<double>( count );
+    count += delta;
+    const double c1 = static_cast<double>( count );
+
+    unsigned int &rowCount = m_RowCounts[i];
+    const double r0 = static_cast<double>( rowCount );
+    rowCount += delta;
+    const double r1 = static_cast<double>( rowCount );
+
+    const double d = static_cast<double>( delta );
+    const double di = static_cast<double>( i );
+    const double dj = static_cast<double>( j );
+    const double s = di + dj;
+    const double diff2 = ( di - dj ) * ( di - dj );
+
+    m_Total += d;
+    m_SumI += d * di;
+    m_SumI2 += d * di * di;
+    m_SumIJ += d * di * dj;
+    m_SumS2 += d * s * s;
+    m_SumS3 += d * s * s * s;
+    m_SumS4 += d * s * s * s * s;
+    m_SumSquaredCounts += c1 * c1 - c0 * c0;
+    m_SumCountLogCount += XLogX( c1 ) - XLogX( c0 );
+    m_SumInverseDifference += d / ( 1.0 + diff2 );
+    m_SumSquaredDifference += d * diff2;
+    m_SumSquaredRowCounts += r1 * r1 - r0 * r0;
+    }
+
+  static double XLogX( double x )
+    {
+    return ( x > 0 ) ? x * vcl_log( x ) : 0.0;
+    }
+
+  unsigned int                 m_NumberOfBins;
+  std::vector<unsigned int>    m_Counts;
+  std::vector<unsigned int>    m_RowCounts;
+
+  double                       m_Total;
+  double                       m_SumI;
+  double                       m_SumI2;
+  double                       m_SumIJ;
+  double                       m_SumS2;
+  double                       m_SumS3;
+  double                       m_SumS4;
+  double                       m_SumSquaredCounts;
+  double                       m_SumCountLogCount;
+  double                       m_SumInverseDifference;
+  double                       m_SumSquaredDifference;
+  double                       m_SumSquaredRowCounts;
+};
+
+} // end namespace Function
+} // end namespace itk
+#endif
@@ -47,6 +47,13 @@ namespace itk {
         return;
         }
 
+      if ( this->GetUseLineScanning() )
+        {
+        this->FillHistogramByLineScanning( this->m_ImageMask,
+          this->m_InsidePixelValue );
+        return;
+        }
+
       // Iterate over all of those pixels and offsets, adding each
       // co-occurrence pair to the histogram
 
@@ -0,0 +1,127 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkRunLengthLineScanner.h,v $
+  Language:  C++
+  Date:      $Date: $
+  Version:   $Revision: $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkRunLengthLineScanner_h
+#define __itkRunLengthLineScanner_h
+
+#include "itkImageRegion.h"
+#include "itkIndex.h"
+#include "itkMultiThreader.h"
+#include "itkOffset.h"
+
+#include <vector>
+
+namespace itk {
+namespace Statistics {
+
+/** \class RunLengthLineScanner
+ * \brief Counts the runs of a quantized image along an offset direction.
+ *
+ * The image is given as one bin per pixel of the region (x fastest);
+ * bins greater than or equal to the number of bins mark pixels outside
+ * the intensity range or the mask and break runs.  For an offset o the
+ * region is covered by the disjoint lines p, p + o, p + 2o, ... starting
+ * at the pixels p whose predecessor p - o lies outside the region.  Each
+ * line is read once and every maximal sequence of equal bins on it is
+ * counted as one run.
+ *
+ * The counts are returned as a dense matrix with
+ * GetMaximumRunLength( o ) + 1 columns per bin, i.e. the number of runs
+ * of bin b and length n (in pixels) is counts[b * ( L + 1 ) + n].  The
+ * lines are split across threads, each thread filling its own matrix;
+ * the matrices are summed at the end.
+ *
+ * Used by ScalarImageToRunLengthMatrixFilter and
+ * ScalarImageToGreyLevelRunLengthMatrixGenerator.
+ */
+template<unsigned int VImageDimension>
+class RunLengthLineScanner
+{
+public:
+  typedef RunLengthLineScanner                      Self;
+
+  itkStaticConstMacro( ImageDimension, unsigned int, VImageDimension );
+
+  typedef Index<VImageDimension>                    IndexType;
+  typedef Offset<VImageDimension>                   OffsetType;
+  typedef ImageRegion<VImageDimension>              RegionType;
+  typedef typename OffsetType::OffsetValueType      OffsetValueType;
+
+  typedef std::vector<unsigned int>                 BinContainerType;
+  typedef std::vector<unsigned long>                RunCountContainerType;
+
+  RunLengthLineScanner();
+  ~RunLengthLineScanner() {}
+
+  /** Region covered by the bins. Reallocates the bin container. */
+  void SetRegion( const RegionType & region );
+  const RegionType & GetRegion() const
+    { return this->m_Region; }
+
+  void SetNumberOfBins( unsigned int numberOfBins )
+    { this->m_NumberOfBins = numberOfBins; }
+  unsigned int GetNumberOfBins() const
+    { return this->m_NumberOfBins; }
+
+  void SetNumberOfThreads( int numberOfThreads );
+  int GetNumberOfThreads() const
+    { return this->m_NumberOfThreads; }
+
+  /** One bin per pixel of the region, x fastest, to be filled by the
+   * caller. */
+  BinContainerType & GetBins()
+    { return this->m_Bins; }
+  const BinContainerType & GetBins() const
+    { return this->m_Bins; }
+
+  /** Longest line, in pixels, along the offset. Zero for a null offset. */
+  unsigned long GetMaximumRunLength( const OffsetType & offset ) const;
+
+  /** Counts the runs along the offset. See the class documentation for
+   * the layout of the counts. */
+  void Scan( const OffsetType & offset, RunCountContainerType & counts ) const;
+
+private:
+  /** Counts the runs of the lines starting in the linear pixel range
+   * [begin, end). */
+  void ScanRange( const OffsetType & offset, unsigned long begin,
+    unsigned long end, unsigned long *counts ) const;
+
+  /** Static function used as a "callback" by the MultiThreader. */
+  static ITK_THREAD_RETURN_TYPE ScanThreaderCallback( void *arg );
+
+  struct ScanThreadStruct
+    {
+    const Self                               *Scanner;
+    OffsetType                                Offset;
+    unsigned long                             NumberOfCounts;
+    std::vector<RunCountContainerType>       *Counts;
+    };
+
+  RegionType                   m_Region;
+  BinContainerType             m_Bins;
+  unsigned int                 m_NumberOfBins;
+  int                          m_NumberOfThreads;
+};
+
+} // end of namespace Statistics
+} // end of namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkRunLengthLineScanner.hxx"
+#endif
+
+#endif
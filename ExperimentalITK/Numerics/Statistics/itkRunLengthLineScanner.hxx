@@ -0,0 +1,269 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkRunLengthLineScanner.hxx,v $
+  Language:  C++
+  Date:      $Date: $
+  Version:   $Revision: $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkRunLengthLineScanner_hxx
+#define _itkRunLengthLineScanner_hxx
+
+#include "itkRunLengthLineScanner.h"
+
+#include <algorithm>
+
+namespace itk {
+namespace Statistics {
+
+template<unsigned int VImageDimension>
+RunLengthLineScanner<VImageDimension>
+::RunLengthLineScanner()
+{
+  this->m_NumberOfBins = 0;
+  this->m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+}
+
+template<unsigned int VImageDimension>
+void
+RunLengthLineScanner<VImageDimension>
+::SetRegion( const RegionType & region )
+{
+  this->m_Region = region;
+  this->m_Bins.assign( region.GetNumberOfPixels(), 0 );
+}
+
+template<unsigned int VImageDimension>
+void
+RunLengthLineScanner<VImageDimension>
+::SetNumberOfThreads( int numberOfThreads )
+{
+  this->m_NumberOfThreads = std::max( 1,
+    std::min( numberOfThreads, static_cast<int>( ITK_MAX_THREADS ) ) );
+}
+
+template<unsigned int VImageDimension>
+unsigned long
+RunLengthLineScanner<VImageDimension>
+::GetMaximumRunLength( const OffsetType & offset ) const
+{
+  unsigned long maximumLength = 0;
+  bool isNull = true;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    if( offset[d] == 0 )
+      {
+      continue;
+      }
+    const unsigned long step = static_cast<unsigned long>(
+      offset[d] > 0 ? offset[d] : -offset[d] );
+    const unsigned long length =
+      ( this->m_Region.GetSize()[d] + step - 1 ) / step;
+    if( isNull || length < maximumLength )
+      {
+      maximumLength = length;
+      }
+    isNull = false;
+    }
+  return maximumLength;
+}
+
+template<unsigned int VImageDimension>
+void
+RunLengthLineScanner<VImageDimension>
+::Scan( const OffsetType & offset, RunCountContainerType & counts ) const
+{
+  const unsigned long numberOfCounts = this->m_NumberOfBins
+    * ( this->GetMaximumRunLength( offset ) + 1 );
+  counts.assign( numberOfCounts, 0 );
+
+  const unsigned long numberOfPixels = this->m_Bins.size();
+  if( numberOfPixels == 0 || this->GetMaximumRunLength( offset ) == 0 )
+    {
+    return;
+    }
+
+  int numberOfThreads = this->m_NumberOfThreads;
+  if( static_cast<unsigned long>( numberOfThreads ) > numberOfPixels )
+    {
+    numberOfThreads = static_cast<int>( numberOfPixels );
+    }
+
+  if( numberOfThreads <= 1 )
+    {
+    this->ScanRange( offset, 0, numberOfPixels, &counts[0] );
+    return;
+    }
+
+  std::vector<RunCountContainerType> threadCounts( numberOfThreads );
+
+  ScanThreadStruct str;
+  str.Scanner = this;
+  str.Offset = offset;
+  str.NumberOfCounts = numberOfCounts;
+  str.Counts = &threadCounts;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( this->ScanThreaderCallback, &str );
+  threader->SingleMethodExecute();
+
+  for( int t = 0; t < numberOfThreads; t++ )
+    {
+    if( threadCounts[t].empty() )
+      {
+      continue;
+      }
+    for( unsigned long k = 0; k < numberOfCounts; k++ )
+      {
+      counts[k] += threadCounts[t][k];
+      }
+    }
+}
+
+template<unsigned int VImageDimension>
+ITK_THREAD_RETURN_TYPE
+RunLengthLineScanner<VImageDimension>
+::ScanThreaderCallback( void *arg )
+{
+  int threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  int threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  ScanThreadStruct *str = (ScanThreadStruct *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  const unsigned long numberOfPixels = str->Scanner->m_Bins.size();
+  const unsigned long begin = ( numberOfPixels * threadId ) / threadCount;
+  const unsigned long end = ( numberOfPixels * ( threadId + 1 ) ) / threadCount;
+
+  if( begin < end )
+    {
+    (*str->Counts)[threadId].assign( str->NumberOfCounts, 0 );
+    str->Scanner->ScanRange( str->Offset, begin, end,
+      &( (*str->Counts)[threadId][0] ) );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<unsigned int VImageDimension>
+void
+RunLengthLineScanner<VImageDimension>
+::ScanRange( const OffsetType & offset, unsigned long begin,
+  unsigned long end, unsigned long *counts ) const
+{
+  const unsigned long numberOfColumns = this->GetMaximumRunLength( offset ) + 1;
+  const unsigned int numberOfBins = this->m_NumberOfBins;
+
+  // linear step along the offset in the bin container
+  OffsetValueType lineStride = 0;
+  OffsetValueType stride = 1;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    lineStride += offset[d] * stride;
+    stride *= static_cast<OffsetValueType>( this->m_Region.GetSize()[d] );
+    }
+
+  // position of the first pixel of the range, relative to the region start
+  OffsetValueType position[VImageDimension];
+  OffsetValueType size[VImageDimension];
+  unsigned long remainder = begin;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    size[d] = static_cast<OffsetValueType>( this->m_Region.GetSize()[d] );
+    position[d] = static_cast<OffsetValueType>( remainder % size[d] );
+    remainder /= size[d];
+    }
+
+  const unsigned int *bins = &( this->m_Bins[0] );
+
+  for( unsigned long n = begin; n < end; n++ )
+    {
+    // a line starts where the previous pixel along the offset is outside
+    bool isLineStart = false;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      const OffsetValueType previous = position[d] - offset[d];
+      if( previous < 0 || previous >= size[d] )
+        {
+        isLineStart = true;
+        break;
+        }
+      }
+
+    if( isLineStart )
+      {
+      // number of pixels on the line
+      OffsetValueType length = 0;
+      bool isFirst = true;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        OffsetValueType steps;
+        if( offset[d] > 0 )
+          {
+          steps = ( size[d] - 1 - position[d] ) / offset[d] + 1;
+          }
+        else if( offset[d] < 0 )
+          {
+          steps = position[d] / ( -offset[d] ) + 1;
+          }
+        else
+          {
+          continue;
+          }
+        if( isFirst || steps < length )
+          {
+          length = steps;
+          }
+        isFirst = false;
+        }
+
+      const unsigned int *bin = bins + n;
+      unsigned int currentBin = *bin;
+      unsigned long runLength = 1;
+      for( OffsetValueType k = 1; k < length; k++ )
+        {
+        bin += lineStride;
+        if( *bin == currentBin )
+          {
+          ++runLength;
+          }
+        else
+          {
+          if( currentBin < numberOfBins )
+            {
+            ++counts[currentBin * numberOfColumns + runLength];
+            }
+          currentBin = *bin;
+          runLength = 1;
+          }
+        }
+      if( currentBin < numberOfBins )
+        {
+        ++counts[currentBin * numberOfColumns + runLength];
+        }
+      }
+
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      if( ++position[d] < size[d] )
+        {
+        break;
+        }
+      position[d] = 0;
+      }
+    }
+}
+
+} // end of namespace Statistics
+} // end of namespace itk
+
+#endif
@@ -0,0 +1,180 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkRunLengthTextureFeaturesImageFilter_h
+#define __itkRunLengthTextureFeaturesImageFilter_h
+
+#include "itkConstNeighborhoodIterator.h"
+#include "itkImageToImageFilter.h"
+#include "itkRunLengthTextureHistogram.h"
+#include "itkVectorImage.h"
+
+#include <vector>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class RunLengthTextureFeaturesImageFilter
+ *  \brief This filter computes the run-length texture features in a
+ * window around each pixel.
+ *
+ * The run-length counterpart of TextureFeaturesImageFilter.  The input is
+ * quantized once into NumberOfBinsPerAxis bins over [Min, Max]; pixels
+ * outside that range or outside the mask break runs.  For every pixel
+ * the runs of all offsets are collected from the window, clipped to the
+ * image, by scanning each line of the window along each offset once.
+ * The run lengths are physical distances as in
+ * ScalarImageToRunLengthMatrixFilter, binned into NumberOfBinsPerAxis
+ * bins over [0, longest run that fits into the window].  The output has
+ * the ten features of HistogramToRunLengthFeaturesFilter of the combined
+ * run-length matrix (see Function::RunLengthTextureHistogram).
+ *
+ * \author
+ * \ingroup
+ */
+template<class TInputImage, class TOutputImage
+  = VectorImage<typename TInputImage::PixelType, TInputImage::ImageDimension> >
+class ITK_EXPORT RunLengthTextureFeaturesImageFilter:
+  public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef RunLengthTextureFeaturesImageFilter             Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage>   Superclass;
+  typedef SmartPointer<Self>                              Pointer;
+  typedef SmartPointer<const Self>                        ConstPointer;
+
+  /** Standard New method. */
+  itkNewMacro( Self );
+
+  /** Runtime information support. */
+  itkTypeMacro( RunLengthTextureFeaturesImageFilter, ImageToImageFilter );
+
+  /** ImageDimension constants */
+  itkStaticConstMacro( ImageDimension, unsigned int, TInputImage::ImageDimension );
+
+  /** Some convenient typedefs. */
+  typedef float                                      RealType;
+  typedef TInputImage                                InputImageType;
+  typedef typename InputImageType::RegionType        RegionType;
+  typedef typename InputImageType::IndexType         IndexType;
+  typedef typename InputImageType::OffsetType        OffsetType;
+  typedef std::vector<OffsetType>                    OffsetVectorType;
+  typedef typename OffsetType::OffsetValueType       OffsetValueType;
+  typedef Image<unsigned int, ImageDimension>        MaskImageType;
+  typedef TOutputImage                               OutputImageType;
+  typedef typename InputImageType::PixelType         InputPixelType;
+  typedef typename OutputImageType::PixelType        OutputPixelType;
+
+  /** Quantized input.  Pixels outside [Min, Max] or outside the mask are
+   * set to the number of bins. */
+  typedef Image<unsigned short, ImageDimension>                                    BinImageType;
+  typedef Function::RunLengthTextureHistogram<OutputPixelType>                     RunLengthHistogramType;
+
+  /** Set/Get the input mask image that will constraint the computation to
+   * pixels that are on in the mask. */
+  void SetMaskImage( const MaskImageType *mask );
+
+  const MaskImageType * GetMaskImage() const;
+
+  typedef ConstNeighborhoodIterator< InputImageType >        ConstNeighborhoodIteratorType;
+  typedef typename ConstNeighborhoodIteratorType::RadiusType RadiusType;
+
+  /** Radius defining the local window for evaluating the texture features. */
+  itkSetMacro( NeighborhoodRadius, RadiusType );
+  itkGetConstMacro( NeighborhoodRadius, RadiusType);
+
+  /** Set the offset or offsets along which the runs will be computed.
+      Calling either of these methods clears the previous offsets. */
+  itkGetConstReferenceMacro( Offsets, OffsetVectorType );
+  void SetOffsets( const OffsetVectorType &offsets )
+  {
+    if ( this->m_Offsets != offsets )
+      {
+      this->m_Offsets.assign( offsets.begin(), offsets.end() );
+      this->Modified();
+      }
+  }
+  void SetOffset( const OffsetType &offset );
+
+  /** Set number of histogram bins along each axis */
+  itkSetMacro( NumberOfBinsPerAxis, unsigned int );
+  itkGetConstMacro( NumberOfBinsPerAxis, unsigned int );
+
+  /**
+   * Set the min and max (inclusive) pixel value that will be placed in the
+   * histogram.
+   */
+  void SetPixelValueMinMax( InputPixelType, InputPixelType );
+
+  itkGetConstMacro( Min, InputPixelType );
+  itkGetConstMacro( Max, InputPixelType );
+
+  itkSetMacro( InsidePixelValue, typename MaskImageType::PixelType );
+  itkGetConstMacro( InsidePixelValue, typename MaskImageType::PixelType );
+
+  unsigned int GetNumberOfOutputComponents() { return 10; }
+
+protected:
+  RunLengthTextureFeaturesImageFilter();
+  ~RunLengthTextureFeaturesImageFilter() {};
+
+  virtual void GenerateInputRequestedRegion()
+  {
+    // currently we require the entire input image to process
+    TInputImage *input = const_cast<TInputImage *>( this->GetInput() );
+    input->SetRequestedRegionToLargestPossibleRegion();
+  }
+
+  virtual void ThreadedGenerateData( const RegionType &, ThreadIdType );
+
+  virtual void BeforeThreadedGenerateData();
+
+  virtual void AfterThreadedGenerateData();
+
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+  void GenerateOutputInformation();
+
+private:
+  RunLengthTextureFeaturesImageFilter( const Self & ); //purposely not implemented
+  void operator=( const Self & );                      //purposely not implemented
+
+  OffsetVectorType                                  m_Offsets;
+
+  RadiusType                                        m_NeighborhoodRadius;
+  InputPixelType                                    m_Min;
+  InputPixelType                                    m_Max;
+  unsigned int                                      m_NumberOfBinsPerAxis;
+  typename MaskImageType::PixelType                 m_InsidePixelValue;
+
+  typename BinImageType::Pointer                    m_BinImage;
+
+  /** Run length bin of a run of n pixels along each offset, indexed by
+   * n; empty for offsets that do not fit into the window. */
+  std::vector<std::vector<unsigned int> >           m_RunLengthBins;
+
+}; // end of class
+} // end namespace statistics
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkRunLengthTextureFeaturesImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,391 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkRunLengthTextureFeaturesImageFilter_hxx
+#define __itkRunLengthTextureFeaturesImageFilter_hxx
+
+#include "itkRunLengthTextureFeaturesImageFilter.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkNeighborhood.h"
+#include "itkProgressReporter.h"
+
+namespace itk
+{
+namespace Statistics
+{
+template<class TInputImage, class TOutputImage>
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::RunLengthTextureFeaturesImageFilter()
+{
+  // Set the offset directions to their defaults: half of all the possible
+  // directions 1 pixel away. (The other half gives the same runs.)
+  typedef Neighborhood<typename InputImageType::PixelType, ImageDimension> NeighborhoodType;
+  NeighborhoodType neighborhood;
+  neighborhood.SetRadius( 1 );
+
+  unsigned int centerIndex = neighborhood.GetCenterNeighborhoodIndex();
+
+  this->m_Offsets.clear();
+  for ( unsigned int d = 0; d < centerIndex; d++ )
+    {
+    this->m_Offsets.push_back( neighborhood.GetOffset( d ) );
+    }
+
+  this->m_Min = NumericTraits<InputPixelType>::NonpositiveMin();
+  this->m_Max = NumericTraits<InputPixelType>::max();
+
+  this->m_NumberOfBinsPerAxis = 64;
+
+  this->m_InsidePixelValue = 1;
+
+  this->m_NeighborhoodRadius.Fill( 10 );
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::SetMaskImage( const MaskImageType *mask )
+{
+  this->SetNthInput( 1, const_cast<MaskImageType *>( mask ) );
+}
+
+template<class TInputImage, class TOutputImage>
+const typename RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>::MaskImageType *
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::GetMaskImage() const
+{
+  const MaskImageType *maskImage = dynamic_cast<const MaskImageType *>( this->ProcessObject::GetInput( 1 ) );
+
+  return maskImage;
+}
+
+template< class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::SetOffset( const OffsetType &offset )
+{
+  OffsetVectorType offsetVector;
+
+  offsetVector.push_back( offset );
+  this->SetOffsets( offsetVector );
+}
+
+template< class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::SetPixelValueMinMax( InputPixelType min, InputPixelType max )
+{
+  if( this->m_Min != min || this->m_Max != max )
+    {
+    itkDebugMacro( "setting Min to " << min << "and Max to " << max );
+    this->m_Min = min;
+    this->m_Max = max;
+    this->Modified();
+    }
+}
+
+template< class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter< TInputImage, TOutputImage>
+::GenerateOutputInformation()
+{
+  // this methods is overloaded so that if the output image is a
+  // VectorImage then the correct number of components are set.
+  Superclass::GenerateOutputInformation();
+  OutputImageType* output = this->GetOutput();
+
+  if ( !output )
+    {
+    return;
+    }
+  if ( output->GetNumberOfComponentsPerPixel() != this->GetNumberOfOutputComponents() )
+    {
+    output->SetNumberOfComponentsPerPixel( this->GetNumberOfOutputComponents() );
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::BeforeThreadedGenerateData()
+{
+  const InputImageType *inputImage = this->GetInput();
+  const MaskImageType  *maskImage = this->GetMaskImage();
+  const RegionType     &largestRegion = inputImage->GetLargestPossibleRegion();
+
+  // quantize the input once: NumberOfBinsPerAxis bins over [Min, Max]
+  this->m_BinImage = BinImageType::New();
+  this->m_BinImage->CopyInformation( inputImage );
+  this->m_BinImage->SetRegions( largestRegion );
+  this->m_BinImage->Allocate();
+
+  const unsigned short outsideBin = static_cast<unsigned short>( this->m_NumberOfBinsPerAxis );
+  const double lowerBound = static_cast<double>( this->m_Min );
+  const double range = static_cast<double>( this->m_Max ) - lowerBound;
+  const double binScale = ( range > 0 )
+    ? static_cast<double>( this->m_NumberOfBinsPerAxis ) / range : 0.0;
+
+  ImageRegionConstIteratorWithIndex<InputImageType> ItI( inputImage, largestRegion );
+  for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI )
+    {
+    unsigned short bin = outsideBin;
+
+    const InputPixelType p = ItI.Get();
+    if( p >= this->m_Min && p <= this->m_Max &&
+      ( !maskImage || maskImage->GetPixel( ItI.GetIndex() ) == this->m_InsidePixelValue ) )
+      {
+      bin = static_cast<unsigned short>( vnl_math_min(
+        static_cast<double>( this->m_NumberOfBinsPerAxis - 1 ),
+        ( static_cast<double>( p ) - lowerBound ) * binScale ) );
+      }
+    this->m_BinImage->SetPixel( ItI.GetIndex(), bin );
+    }
+
+  // Physical length of each offset and the longest run along it that
+  // fits into the window.
+  const unsigned int numberOfOffsets = this->m_Offsets.size();
+  std::vector<double>        stepLengths( numberOfOffsets, 0.0 );
+  std::vector<unsigned long> maximumRunLengths( numberOfOffsets, 0 );
+
+  typename InputImageType::PointType origin;
+  inputImage->TransformIndexToPhysicalPoint( largestRegion.GetIndex(), origin );
+
+  double maximumDistance = 0.0;
+  for( unsigned int k = 0; k < numberOfOffsets; ++k )
+    {
+    const OffsetType &offset = this->m_Offsets[k];
+
+    typename InputImageType::PointType point;
+    inputImage->TransformIndexToPhysicalPoint( largestRegion.GetIndex() + offset, point );
+    stepLengths[k] = origin.EuclideanDistanceTo( point );
+
+    bool isNull = true;
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      if( offset[d] == 0 )
+        {
+        continue;
+        }
+      const unsigned long step = static_cast<unsigned long>( vnl_math_abs( offset[d] ) );
+      const unsigned long length = ( 2 * this->m_NeighborhoodRadius[d] + step ) / step;
+      if( isNull || length < maximumRunLengths[k] )
+        {
+        maximumRunLengths[k] = length;
+        }
+      isNull = false;
+      }
+    maximumDistance = vnl_math_max( maximumDistance,
+      stepLengths[k] * static_cast<double>( maximumRunLengths[k] ) );
+    }
+
+  // run length bins over [0, maximumDistance]
+  this->m_RunLengthBins.assign( numberOfOffsets, std::vector<unsigned int>() );
+  for( unsigned int k = 0; k < numberOfOffsets; ++k )
+    {
+    if( maximumRunLengths[k] == 0 || maximumDistance <= 0 )
+      {
+      continue;
+      }
+    this->m_RunLengthBins[k].resize( maximumRunLengths[k] + 1, 0 );
+    for( unsigned long n = 1; n <= maximumRunLengths[k]; ++n )
+      {
+      const double distance = stepLengths[k] * static_cast<double>( n );
+      this->m_RunLengthBins[k][n] = static_cast<unsigned int>( vnl_math_min(
+        static_cast<double>( this->m_NumberOfBinsPerAxis - 1 ),
+        distance / maximumDistance * static_cast<double>( this->m_NumberOfBinsPerAxis ) ) );
+      }
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::AfterThreadedGenerateData()
+{
+  this->m_BinImage = NULL;
+  this->m_RunLengthBins.clear();
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::ThreadedGenerateData( const RegionType & region, ThreadIdType threadId )
+{
+  OutputImageType      *outputImage = this->GetOutput();
+  const MaskImageType  *maskImage = this->GetMaskImage();
+  const RegionType     &largestRegion = this->GetInput()->GetLargestPossibleRegion();
+
+  const unsigned int outsideBin = this->m_NumberOfBinsPerAxis;
+
+  ProgressReporter progress( this, threadId, region.GetNumberOfPixels() );
+
+  RunLengthHistogramType histogram( this->m_NumberOfBinsPerAxis, this->m_NumberOfBinsPerAxis );
+
+  OutputPixelType zero;
+  NumericTraits<OutputPixelType>::SetLength( zero, this->GetNumberOfOutputComponents() );
+  zero.Fill( 0 );
+
+  // linear step along each offset in the bin image
+  const unsigned int numberOfOffsets = this->m_Offsets.size();
+  const typename BinImageType::OffsetValueType *offsetTable = this->m_BinImage->GetOffsetTable();
+  std::vector<OffsetValueType> lineStrides( numberOfOffsets, 0 );
+  for( unsigned int k = 0; k < numberOfOffsets; ++k )
+    {
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      lineStrides[k] += this->m_Offsets[k][d] * offsetTable[d];
+      }
+    }
+
+  const unsigned short *binBuffer = this->m_BinImage->GetBufferPointer();
+
+  ImageRegionIteratorWithIndex<OutputImageType> ItO( outputImage, region );
+  for( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO )
+    {
+    const IndexType centerIndex = ItO.GetIndex();
+
+    if( maskImage && ( maskImage->GetPixel( centerIndex ) != this->m_InsidePixelValue ) )
+      {
+      ItO.Set( zero );
+      progress.CompletedPixel();
+      continue;
+      }
+
+    // window clipped to the image
+    IndexType lower;
+    IndexType upper;
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      const OffsetValueType radius = static_cast<OffsetValueType>( this->m_NeighborhoodRadius[d] );
+      const OffsetValueType first = largestRegion.GetIndex()[d];
+      const OffsetValueType last = first
+        + static_cast<OffsetValueType>( largestRegion.GetSize()[d] ) - 1;
+      lower[d] = vnl_math_max( first, static_cast<OffsetValueType>( centerIndex[d] ) - radius );
+      upper[d] = vnl_math_min( last, static_cast<OffsetValueType>( centerIndex[d] ) + radius );
+      }
+
+    histogram.Clear();
+
+    // Every line of the window along an offset starts at a pixel whose
+    // predecessor is outside the window; each line is read once.
+    IndexType index = lower;
+    while( true )
+      {
+      for( unsigned int k = 0; k < numberOfOffsets; ++k )
+        {
+        const std::vector<unsigned int> &runLengthBins = this->m_RunLengthBins[k];
+        if( runLengthBins.empty() )
+          {
+          continue;
+          }
+        const OffsetType &offset = this->m_Offsets[k];
+
+        bool isLineStart = false;
+        OffsetValueType length = 0;
+        bool isFirst = true;
+        for( unsigned int d = 0; d < ImageDimension; ++d )
+          {
+          if( offset[d] == 0 )
+            {
+            continue;
+            }
+          const OffsetValueType previous = index[d] - offset[d];
+          if( previous < lower[d] || previous > upper[d] )
+            {
+            isLineStart = true;
+            }
+          const OffsetValueType steps = ( offset[d] > 0 )
+            ? ( upper[d] - index[d] ) / offset[d] + 1
+            : ( index[d] - lower[d] ) / ( -offset[d] ) + 1;
+          if( isFirst || steps < length )
+            {
+            length = steps;
+            }
+          isFirst = false;
+          }
+        if( !isLineStart )
+          {
+          continue;
+          }
+
+        const unsigned short *bin = binBuffer + this->m_BinImage->ComputeOffset( index );
+        unsigned int currentBin = *bin;
+        unsigned long runLength = 1;
+        for( OffsetValueType n = 1; n < length; ++n )
+          {
+          bin += lineStrides[k];
+          if( *bin == currentBin )
+            {
+            ++runLength;
+            }
+          else
+            {
+            if( currentBin != outsideBin )
+              {
+              histogram.AddRun( currentBin, runLengthBins[runLength] );
+              }
+            currentBin = *bin;
+            runLength = 1;
+            }
+          }
+        if( currentBin != outsideBin )
+          {
+          histogram.AddRun( currentBin, runLengthBins[runLength] );
+          }
+        }
+
+      unsigned int d = 0;
+      while( d < ImageDimension )
+        {
+        if( ++index[d] <= upper[d] )
+          {
+          break;
+          }
+        index[d] = lower[d];
+        ++d;
+        }
+      if( d == ImageDimension )
+        {
+        break;
+        }
+      }
+
+    ItO.Set( histogram.GetValue() );
+    progress.CompletedPixel();
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+RunLengthTextureFeaturesImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Min: " << this->GetMin() << std::endl;
+  os << indent << "Max: " << this->GetMax() << std::endl;
+  os << indent << "NumberOfBinsPerAxis: " << this->GetNumberOfBinsPerAxis() << std::endl;
+  os << indent << "NeighborhoodRadius: " << this->GetNeighborhoodRadius() << std::endl;
+  os << indent << "InsidePixelValue: " << this->GetInsidePixelValue() << std::endl;
+}
+
+} // end namespace Statistics
+} // end namespace itk
+
+#endif
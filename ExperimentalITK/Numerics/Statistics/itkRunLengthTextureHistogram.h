@@ -0,0 +1,177 @@
+/*=========================================================================
+ *
+ *  Copyright Insight Software Consortium
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+// run-length matrix for the moving window texture features
+#ifndef __itkRunLengthTextureHistogram_h
+#define __itkRunLengthTextureHistogram_h
+#include "itkNumericTraits.h"
+#include "vnl/vnl_math.h"
+
+#include <vector>
+
+namespace itk
+{
+namespace Function
+{
+
+/*
+ * Dense grey level x run length matrix over small integer bins with its
+ * two marginals.  Only the cells and marginals touched since the last
+ * Clear() are visited by GetValue() and Clear(), so the cost of a window
+ * does not depend on the number of bins.
+ */
+template< class TOutputPixel >
+class RunLengthTextureHistogram
+{
+public:
+
+  RunLengthTextureHistogram( unsigned int numberOfGreyLevelBins = 64,
+    unsigned int numberOfRunLengthBins = 64 )
+    {
+    this->SetNumberOfBins( numberOfGreyLevelBins, numberOfRunLengthBins );
+    }
+
+  // ~RunLengthTextureHistogram()  {} default is ok
+
+  void SetNumberOfBins( unsigned int numberOfGreyLevelBins,
+    unsigned int numberOfRunLengthBins )
+    {
+    m_NumberOfGreyLevelBins = numberOfGreyLevelBins;
+    m_NumberOfRunLengthBins = numberOfRunLengthBins;
+    m_Counts.assign( numberOfGreyLevelBins * numberOfRunLengthBins, 0 );
+    m_GreyLevelCounts.assign( numberOfGreyLevelBins, 0 );
+    m_RunLengthCounts.assign( numberOfRunLengthBins, 0 );
+    m_TouchedCells.clear();
+    m_TouchedGreyLevels.clear();
+    m_TouchedRunLengths.clear();
+    }
+
+  void Clear()
+    {
+    for( unsigned int n = 0; n < m_TouchedCells.size(); n++ )
+      {
+      m_Counts[m_TouchedCells[n]] = 0;
+      }
+    for( unsigned int n = 0; n < m_TouchedGreyLevels.size(); n++ )
+      {
+      m_GreyLevelCounts[m_TouchedGreyLevels[n]] = 0;
+      }
+    for( unsigned int n = 0; n < m_TouchedRunLengths.size(); n++ )
+      {
+      m_RunLengthCounts[m_TouchedRunLengths[n]] = 0;
+      }
+    m_TouchedCells.clear();
+    m_TouchedGreyLevels.clear();
+    m_TouchedRunLengths.clear();
+    }
+
+  void AddRun( unsigned int greyLevelBin, unsigned int runLengthBin )
+    {
+    const unsigned int cell = greyLevelBin * m_NumberOfRunLengthBins
+      + runLengthBin;
+    if( m_Counts[cell]++ == 0 )
+      {
+      m_TouchedCells.push_back( cell );
+      }
+    if( m_GreyLevelCounts[greyLevelBin]++ == 0 )
+      {
+      m_TouchedGreyLevels.push_back( greyLevelBin );
+      }
+    if( m_RunLengthCounts[runLengthBin]++ == 0 )
+      {
+      m_TouchedRunLengths.push_back( runLengthBin );
+      }
+    }
+
+  unsigned int GetNumberOfFeatures() const
+    {
+    return 10;
+    }
+
+  /**
+   * Short run emphasis, long run emphasis, grey level nonuniformity, run
+   * length nonuniformity, low grey level run emphasis, high grey level
+   * run emphasis, short run low grey level emphasis, short run high grey
+   * level emphasis, long run low grey level emphasis and long run high
+   * grey level emphasis, as in HistogramToRunLengthFeaturesFilter.
+   */
+  TOutputPixel GetValue() const
+    {
+    TOutputPixel out;
+    NumericTraits<TOutputPixel>::SetLength( out, 10 );
+    for( unsigned int i = 0; i < 10; i++ )
+      {
+      out[i] = 0;
+      }
+
+    double total = 0.0;
+    double features[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    for( unsigned int n = 0; n < m_TouchedCells.size(); n++ )
+      {
+      const unsigned int cell = m_TouchedCells[n];
+      const double frequency = static_cast<double>( m_Counts[cell] );
+      const unsigned int i = cell / m_NumberOfRunLengthBins;
+      const unsigned int j = cell % m_NumberOfRunLengthBins;
+      const double i2 = static_cast<double>( ( i + 1 ) * ( i + 1 ) );
+      const double j2 = static_cast<double>( ( j + 1 ) * ( j + 1 ) );
+
+      total += frequency;
+      features[0] += frequency / j2;
+      features[1] += frequency * j2;
+      features[4] += frequency / i2;
+      features[5] += frequency * i2;
+      features[6] += frequency / ( i2 * j2 );
+      features[7] += frequency * i2 / j2;
+      features[8] += frequency * j2 / i2;
+      features[9] += frequency * i2 * j2;
+      }
+    for( unsigned int n = 0; n < m_TouchedGreyLevels.size(); n++ )
+      {
+      features[2] += vnl_math_sqr( static_cast<double>(
+        m_GreyLevelCounts[m_TouchedGreyLevels[n]] ) );
+      }
+    for( unsigned int n = 0; n < m_TouchedRunLengths.size(); n++ )
+      {
+      features[3] += vnl_math_sqr( static_cast<double>(
+        m_RunLengthCounts[m_TouchedRunLengths[n]] ) );
+      }
+    if( total <= 0 )
+      {
+      return out;
+      }
+    for( unsigned int i = 0; i < 10; i++ )
+      {
+      out[i] = features[i] / total;
+      }
+    return out;
+  }
+
+private:
+
+  unsigned int                 m_NumberOfGreyLevelBins;
+  unsigned int                 m_NumberOfRunLengthBins;
+  std::vector<unsigned int>    m_Counts;
+  std::vector<unsigned int>    m_GreyLevelCounts;
+  std::vector<unsigned int>    m_RunLengthCounts;
+  std::vector<unsigned int>    m_TouchedCells;
+  std::vector<unsigned int>    m_TouchedGreyLevels;
+  std::vector<unsigned int>    m_TouchedRunLengths;
+};
+
+} // end namespace Function
+} // end namespace itk
+#endif
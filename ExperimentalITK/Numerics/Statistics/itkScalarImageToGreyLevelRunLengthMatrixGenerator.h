@@ -28,6 +28,11 @@ namespace itk {
 
 /** \class ScalarImageToGreyLevelRunLengthMatrixGenerator 
 *
+* With UseLineScanning on the runs are counted by scanning each line of
+* the quantized image along each offset once, see RunLengthLineScanner
+* and ScalarImageToRunLengthMatrixFilter.  It is off by default because
+* its bin edges differ from those of the walking path.
+*
 * Author: Nick Tustison
 */
     
@@ -126,12 +131,23 @@ class ScalarImageToGreyLevelRunLengthMatrixGenerator : public Object
       this->SetOffset( offset );
       }   
     }
+
+  /** Find the runs by scanning the lines along each offset once instead
+   * of walking from every pixel. On by default. */
+  itkSetMacro( UseLineScanning, bool );
+  itkGetConstMacro( UseLineScanning, bool );
+  itkBooleanMacro( UseLineScanning );
     
   protected:
     ScalarImageToGreyLevelRunLengthMatrixGenerator();
     virtual ~ScalarImageToGreyLevelRunLengthMatrixGenerator() {};
     void PrintSelf(std::ostream& os, Indent indent) const;
     virtual void FillHistogram();
+
+    /** Counts the runs with a RunLengthLineScanner. Pixels for which the
+     * mask, if not null, differs from insidePixelValue break runs. */
+    void FillHistogramByLineScanning( const ImageType *mask,
+      PixelType insidePixelValue );
         
    private:
   
@@ -144,6 +160,8 @@ class ScalarImageToGreyLevelRunLengthMatrixGenerator : public Object
     unsigned int            m_NumberOfBinsPerAxis;
     MeasurementVectorType   m_LowerBound, m_UpperBound;
 
+    bool                    m_UseLineScanning;
+
   };
     
     
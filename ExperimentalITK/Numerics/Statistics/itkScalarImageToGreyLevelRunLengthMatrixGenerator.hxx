@@ -20,7 +20,9 @@
 #include "itkScalarImageToGreyLevelRunLengthMatrixGenerator.h"
 
 #include "itkConstNeighborhoodIterator.h"
+#include "itkImageRegionConstIterator.h"
 #include "itkNeighborhood.h"
+#include "itkRunLengthLineScanner.h"
 #include "vnl/vnl_math.h"
 
 
@@ -37,6 +39,7 @@ namespace itk {
       this->m_Max = NumericTraits<PixelType>::max();
       this->m_MinDistance = NumericTraits<RealType>::Zero;
       this->m_MaxDistance = NumericTraits<RealType>::max();
+      this->m_UseLineScanning = false;
       
       // Get a set of default offset values.
       typedef Neighborhood<PixelType, ImageDimension> NeighborhoodType;
@@ -82,6 +85,12 @@ namespace itk {
     THistogramFrequencyContainer >::
     FillHistogram()
       {
+      if ( this->m_UseLineScanning )
+        {
+        this->FillHistogramByLineScanning( NULL,
+          NumericTraits<PixelType>::Zero );
+        return;
+        }
 
       // Iterate over all of those pixels and offsets, adding each
       // co-occurrence pair to the histogram
@@ -160,6 +169,104 @@ namespace itk {
         }
       }
 
+    template< class TImageType, class THistogramFrequencyContainer >
+    void
+    ScalarImageToGreyLevelRunLengthMatrixGenerator< TImageType,
+    THistogramFrequencyContainer >::
+    FillHistogramByLineScanning( const ImageType *mask,
+      PixelType insidePixelValue )
+      {
+      const RegionType region = this->m_Input->GetRequestedRegion();
+      const unsigned int numberOfBins = this->m_Output->GetSize( 0 );
+
+      typedef RunLengthLineScanner<ImageDimension> ScannerType;
+      ScannerType scanner;
+      scanner.SetRegion( region );
+      scanner.SetNumberOfBins( numberOfBins );
+
+      // Quantize the image once with the intensity bins of the histogram.
+      MeasurementVectorType measurement;
+      measurement[1] = this->m_Output->GetBinMin( 1, 0 );
+      typename HistogramType::IndexType histogramIndex;
+
+      typename ScannerType::BinContainerType &bins = scanner.GetBins();
+
+      ImageRegionConstIterator<ImageType> ItI( this->m_Input, region );
+      ImageRegionConstIterator<ImageType> ItM;
+      if ( mask )
+        {
+        ItM = ImageRegionConstIterator<ImageType>( mask, region );
+        ItM.GoToBegin();
+        }
+      unsigned long n = 0;
+      for ( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++n )
+        {
+        bins[n] = numberOfBins;
+
+        bool isInside = true;
+        if ( mask )
+          {
+          isInside = ( ItM.Get() == insidePixelValue );
+          ++ItM;
+          }
+
+        const PixelType pixelIntensity = ItI.Get();
+        if ( !isInside ||
+             pixelIntensity < this->m_Min ||
+             pixelIntensity > this->m_Max )
+          {
+          continue;
+          }
+        measurement[0] = pixelIntensity;
+        if ( this->m_Output->GetIndex( measurement, histogramIndex ) )
+          {
+          bins[n] = histogramIndex[0];
+          }
+        }
+
+      PointType regionOrigin;
+      this->m_Input->TransformIndexToPhysicalPoint( region.GetIndex(),
+        regionOrigin );
+
+      typename ScannerType::RunCountContainerType counts;
+      MeasurementVectorType run;
+
+      typename OffsetVector::ConstIterator offsets;
+      for( offsets = this->GetOffsets()->Begin(); 
+        offsets != this->GetOffsets()->End(); offsets++ )
+        {
+        OffsetType offset = offsets.Value();
+
+        PointType point;
+        this->m_Input->TransformIndexToPhysicalPoint(
+          region.GetIndex() + offset, point );
+        const RealType stepLength = regionOrigin.EuclideanDistanceTo( point );
+
+        scanner.Scan( offset, counts );
+
+        const unsigned long numberOfColumns =
+          scanner.GetMaximumRunLength( offset ) + 1;
+        for ( unsigned int b = 0; b < numberOfBins; b++ )
+          {
+          run[0] = this->m_Output->GetMeasurement( b, 0 );
+          for ( unsigned long length = 1; length < numberOfColumns; length++ )
+            {
+            const unsigned long count = counts[b * numberOfColumns + length];
+            if ( count == 0 )
+              {
+              continue;
+              }
+            run[1] = stepLength * static_cast<RealType>( length );
+            if ( run[1] >= this->m_MinDistance &&
+                 run[1] <= this->m_MaxDistance )
+              {
+              this->m_Output->IncreaseFrequency( run, count );
+              }
+            }
+          }
+        }
+      }
+
     template< class TImageType, class THistogramFrequencyContainer >
     void
     ScalarImageToGreyLevelRunLengthMatrixGenerator< TImageType,
@@ -192,6 +299,8 @@ namespace itk {
     PrintSelf(std::ostream& os, Indent indent) const
       {
       Superclass::PrintSelf(os,indent);
+      os << indent << "UseLineScanning: "
+         << this->m_UseLineScanning << std::endl;
       }
 
   } // end of namespace Statistics
@@ -30,6 +30,23 @@ namespace Statistics {
 
 /** \class ScalarImageToRunLengthMatrixFilter
 *
+* With UseLineScanning on the image is quantized once into
+* the intensity bins of the output histogram and, for each offset, every
+* line of the region along the offset is scanned once for maximal runs
+* of equal bins (see RunLengthLineScanner).  The runs are counted in
+* dense per-thread matrices which are added to the histogram at the end.
+* Pixels outside [Min, Max] or outside the mask break runs.  The run
+* length is, as before, the physical distance from the first pixel of
+* the run to the pixel following it.
+*
+* With UseLineScanning off (the default), the runs are found by walking
+* from every pixel along the offset and marking the visited pixels.  A
+* pixel joins a run if it lies in the closed [min, max] interval of the
+* bin of the first pixel, whereas line scanning puts every pixel in
+* exactly one half-open histogram bin.  Pixels on a bin edge are
+* therefore grouped differently, so line scanning gives slightly
+* different matrices and has to be turned on explicitly.
+*
 * Author: Nick Tustison
 */
 
@@ -117,6 +134,12 @@ public:
   void SetOffset( const OffsetType offset );
   void AddOffset( const OffsetType offset );
 
+  /** Find the runs by scanning the lines along each offset once instead
+   * of walking from every pixel. On by default. */
+  itkSetMacro( UseLineScanning, bool );
+  itkGetConstMacro( UseLineScanning, bool );
+  itkBooleanMacro( UseLineScanning );
+
 protected:
   ScalarImageToRunLengthMatrixFilter();
   virtual ~ScalarImageToRunLengthMatrixFilter() {};
@@ -125,6 +148,11 @@ protected:
   virtual void FillHistogramWithMask( RadiusType radius, RegionType region,
     const ImageType * maskImage );
 
+  /** Line scanning version of FillHistogram() and FillHistogramWithMask().
+   * The mask may be null. */
+  virtual void FillHistogramByLineScanning( RegionType region,
+    const ImageType * maskImage );
+
   /** Standard itk::ProcessObject subclass method. */
   typedef DataObject::Pointer DataObjectPointer;
   virtual DataObjectPointer MakeOutput(unsigned int idx);
@@ -147,6 +175,8 @@ private:
   MeasurementVectorType    m_UpperBound;
 
   PixelType                m_InsidePixelValue;
+
+  bool                     m_UseLineScanning;
 };
 
 } // end of namespace Statistics
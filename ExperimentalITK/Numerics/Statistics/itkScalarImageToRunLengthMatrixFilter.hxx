@@ -20,7 +20,9 @@
 #include "itkScalarImageToRunLengthMatrixFilter.h"
 
 #include "itkConstNeighborhoodIterator.h"
+#include "itkImageRegionConstIterator.h"
 #include "itkNeighborhood.h"
+#include "itkRunLengthLineScanner.h"
 #include "vnl/vnl_math.h"
 
 
@@ -60,6 +62,8 @@ ScalarImageToRunLengthMatrixFilter<TImageType, THistogramFrequencyContainer>
 
   this->m_NumberOfBinsPerAxis = DefaultBinsPerAxis;
 
+  this->m_UseLineScanning = false;
+
   // Get a set of default offset values.
   typedef Neighborhood<PixelType, ImageDimension> NeighborhoodType;
   NeighborhoodType neighborhood;
@@ -218,7 +222,11 @@ GenerateData( void )
     }
 
   // Now fill in the histogram
-  if ( maskImage != NULL )
+  if ( this->m_UseLineScanning )
+    {
+    this->FillHistogramByLineScanning( input->GetRequestedRegion(), maskImage );
+    }
+  else if ( maskImage != NULL )
     {
     this->FillHistogramWithMask( radius, input->GetRequestedRegion(), maskImage );
     }
@@ -406,6 +414,110 @@ FillHistogram( RadiusType radius, RegionType region )
     }
 }
 
+template<class TImageType, class THistogramFrequencyContainer>
+void
+ScalarImageToRunLengthMatrixFilter<TImageType,
+THistogramFrequencyContainer>::
+FillHistogramByLineScanning( RegionType region, const ImageType *maskImage )
+{
+  const ImageType *input = this->GetInput();
+
+  HistogramType * output =
+   static_cast< HistogramType * >( this->ProcessObject::GetOutput( 0 ) );
+
+  const unsigned int numberOfBins = output->GetSize( 0 );
+
+  typedef RunLengthLineScanner<ImageDimension> ScannerType;
+  ScannerType scanner;
+  scanner.SetRegion( region );
+  scanner.SetNumberOfBins( numberOfBins );
+  scanner.SetNumberOfThreads( this->GetNumberOfThreads() );
+
+  // Quantize the image once with the intensity bins of the histogram.
+  // Pixels outside [Min, Max] or outside the mask get numberOfBins.
+  MeasurementVectorType measurement( output->GetMeasurementVectorSize() );
+  measurement[1] = output->GetBinMin( 1, 0 );
+  typename HistogramType::IndexType histogramIndex(
+    output->GetMeasurementVectorSize() );
+
+  typename ScannerType::BinContainerType &bins = scanner.GetBins();
+
+  ImageRegionConstIterator<ImageType> ItI( input, region );
+  ImageRegionConstIterator<ImageType> ItM;
+  if ( maskImage != NULL )
+    {
+    ItM = ImageRegionConstIterator<ImageType>( maskImage, region );
+    ItM.GoToBegin();
+    }
+  unsigned long n = 0;
+  for ( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI, ++n )
+    {
+    bins[n] = numberOfBins;
+
+    bool isInside = true;
+    if ( maskImage != NULL )
+      {
+      isInside = ( ItM.Get() == this->m_InsidePixelValue );
+      ++ItM;
+      }
+
+    const PixelType pixelIntensity = ItI.Get();
+    if ( !isInside ||
+         pixelIntensity < this->m_Min ||
+         pixelIntensity > this->m_Max )
+      {
+      continue;
+      }
+    measurement[0] = pixelIntensity;
+    if ( output->GetIndex( measurement, histogramIndex ) )
+      {
+      bins[n] = histogramIndex[0];
+      }
+    }
+
+  // A run of n pixels along an offset has the physical length n times the
+  // length of the offset.
+  PointType regionOrigin;
+  input->TransformIndexToPhysicalPoint( region.GetIndex(), regionOrigin );
+
+  typename ScannerType::RunCountContainerType counts;
+  MeasurementVectorType run( output->GetMeasurementVectorSize() );
+
+  typename OffsetVector::ConstIterator offsets;
+  for( offsets = this->GetOffsets()->Begin();
+    offsets != this->GetOffsets()->End(); offsets++ )
+    {
+    OffsetType offset = offsets.Value();
+
+    PointType point;
+    input->TransformIndexToPhysicalPoint( region.GetIndex() + offset, point );
+    const RealType stepLength = regionOrigin.EuclideanDistanceTo( point );
+
+    scanner.Scan( offset, counts );
+
+    const unsigned long numberOfColumns =
+      scanner.GetMaximumRunLength( offset ) + 1;
+    for ( unsigned int b = 0; b < numberOfBins; b++ )
+      {
+      run[0] = output->GetMeasurement( b, 0 );
+      for ( unsigned long length = 1; length < numberOfColumns; length++ )
+        {
+        const unsigned long count = counts[b * numberOfColumns + length];
+        if ( count == 0 )
+          {
+          continue;
+          }
+        run[1] = stepLength * static_cast<RealType>( length );
+        if ( run[1] >= this->m_MinDistance &&
+             run[1] <= this->m_MaxDistance )
+          {
+          output->IncreaseFrequencyOfMeasurement( run, count );
+          }
+        }
+      }
+    }
+}
+
 template<class TImageType, class THistogramFrequencyContainer>
 void
 ScalarImageToRunLengthMatrixFilter<TImageType,
@@ -451,6 +563,8 @@ PrintSelf(std::ostream& os, Indent indent) const
      << this->GetNumberOfBinsPerAxis() << std::endl;
   os << indent << "InsidePixelValue: "
      << this->GetInsidePixelValue() << std::endl;
+  os << indent << "UseLineScanning: "
+     << this->GetUseLineScanning() << std::endl;
 }
 
 } // end of namespace Statistics
@@ -19,6 +19,7 @@
 #define __itkTextureFeaturesImageFilter_h
 
 #include "itkConstNeighborhoodIterator.h"
+#include "itkCooccurrenceTextureHistogram.h"
 #include "itkDenseFrequencyContainer2.h"
 #include "itkHistogram.h"
 #include "itkImageToImageFilter.h"
@@ -33,6 +34,14 @@ namespace Statistics
  *  \brief This filter computes texture features based on Haralick's
  * cooccurrence matrix.
  *
+ * With UseIncrementalCooccurrence on, the pixels are first quantized
+ * into the histogram bins and the co-occurrence matrix of each window is
+ * updated from that of the previous pixel on the same row: only the
+ * pairs entering and leaving the window are added and removed, and the
+ * features are read from running sums (see
+ * Function::CooccurrenceTextureHistogram).  The cost per pixel then grows
+ * with the window face instead of the window volume.
+ *
  * \author
  * \ingroup
  */
@@ -74,6 +83,12 @@ public:
   typedef Statistics::Histogram<MeasurementType, HistogramFrequencyContainerType>  HistogramType;
   typedef typename HistogramType::MeasurementVectorType                            MeasurementVectorType;
 
+  /** Quantized input used by the incremental co-occurrence computation.
+   * Pixels outside [Min, Max] or outside the mask are set to the number
+   * of bins. */
+  typedef Image<unsigned short, ImageDimension>                                    BinImageType;
+  typedef Function::CooccurrenceTextureHistogram<OutputPixelType>                  CooccurrenceHistogramType;
+
   /** Set/Get the input mask image that will constraint the computation to
    * pixels that are on in the mask. This is intended to reduce the computation time.
    */
@@ -127,6 +142,12 @@ public:
   itkSetMacro( InsidePixelValue, typename MaskImageType::PixelType );
   itkGetConstMacro( InsidePixelValue, typename MaskImageType::PixelType );
 
+  /** Slide the co-occurrence matrix along the rows instead of rebuilding
+   * the histogram for every pixel.  Off by default. */
+  itkSetMacro( UseIncrementalCooccurrence, bool );
+  itkGetConstMacro( UseIncrementalCooccurrence, bool );
+  itkBooleanMacro( UseIncrementalCooccurrence );
+
   unsigned int GetNumberOfOutputComponents() { return 8; }
 
 protected:
@@ -144,6 +165,16 @@ protected:
 
   virtual void BeforeThreadedGenerateData();
 
+  virtual void AfterThreadedGenerateData();
+
+  /** Row-wise sliding window version of ThreadedGenerateData(). */
+  void ThreadedGenerateDataIncremental( const RegionType &, ThreadIdType );
+
+  /** Nearest index inside the input, i.e. the pixel that the zero flux
+   * Neumann boundary condition of the neighborhood iterator returns. */
+  typename InputImageType::IndexType ClampIndex(
+    typename InputImageType::IndexType index ) const;
+
   void PrintSelf( std::ostream & os, Indent indent ) const;
 
   void GenerateOutputInformation();
@@ -162,6 +193,9 @@ private:
   bool                                              m_Normalize;
   typename MaskImageType::PixelType                 m_InsidePixelValue;
 
+  bool                                              m_UseIncrementalCooccurrence;
+  typename BinImageType::Pointer                    m_BinImage;
+
 }; // end of class
 } // end namespace statistics
 } // end namespace itk
@@ -21,6 +21,8 @@
 #include "itkTextureFeaturesImageFilter.h"
 
 #include "itkHistogramToTextureFeaturesFilter.h"
+#include "itkImageLinearIteratorWithIndex.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkNeighborhoodAlgorithm.h"
 #include "itkProgressReporter.h"
 
@@ -58,6 +60,8 @@ TextureFeaturesImageFilter<TInputImage, TOutputImage>
   this->m_InsidePixelValue = 1;
 
   this->m_NeighborhoodRadius.Fill( 10 );
+
+  this->m_UseIncrementalCooccurrence = false;
 }
 
 template<class TInputImage, class TOutputImage>
@@ -174,6 +178,70 @@ TextureFeaturesImageFilter<TInputImage, TOutputImage>
         }
       }
     } while ( o1[ImageDimension-1] <= static_cast<OffsetValueType>( this->m_NeighborhoodRadius[ImageDimension-1] ) );
+
+  this->m_BinImage = NULL;
+  if( !this->m_UseIncrementalCooccurrence )
+    {
+    return;
+    }
+
+  // quantize the input once with the bins of the histogram used by the
+  // non-incremental computation, i.e. NumberOfBinsPerAxis bins over
+  // [Min, Max + 1).
+  const InputImageType *inputImage = this->GetInput();
+  const MaskImageType  *maskImage = this->GetMaskImage();
+
+  this->m_BinImage = BinImageType::New();
+  this->m_BinImage->CopyInformation( inputImage );
+  this->m_BinImage->SetRegions( inputImage->GetLargestPossibleRegion() );
+  this->m_BinImage->Allocate();
+
+  const unsigned short outsideBin = static_cast<unsigned short>( this->m_NumberOfBinsPerAxis );
+  const double lowerBound = static_cast<double>( this->m_Min );
+  const double binScale = static_cast<double>( this->m_NumberOfBinsPerAxis )
+    / ( static_cast<double>( this->m_Max ) + 1.0 - lowerBound );
+
+  ImageRegionConstIteratorWithIndex<InputImageType> ItI( inputImage,
+    inputImage->GetLargestPossibleRegion() );
+  for( ItI.GoToBegin(); !ItI.IsAtEnd(); ++ItI )
+    {
+    unsigned short bin = outsideBin;
+
+    const InputPixelType p = ItI.Get();
+    if( p >= this->m_Min && p <= this->m_Max &&
+      ( !maskImage || maskImage->GetPixel( ItI.GetIndex() ) == this->m_InsidePixelValue ) )
+      {
+      bin = static_cast<unsigned short>( vnl_math_min(
+        static_cast<double>( this->m_NumberOfBinsPerAxis - 1 ),
+        ( static_cast<double>( p ) - lowerBound ) * binScale ) );
+      }
+    this->m_BinImage->SetPixel( ItI.GetIndex(), bin );
+    }
+}
+
+template<class TInputImage, class TOutputImage>
+void
+TextureFeaturesImageFilter<TInputImage, TOutputImage>
+::AfterThreadedGenerateData()
+{
+  this->m_BinImage = NULL;
+}
+
+template<class TInputImage, class TOutputImage>
+typename TextureFeaturesImageFilter<TInputImage, TOutputImage>::InputImageType::IndexType
+TextureFeaturesImageFilter<TInputImage, TOutputImage>
+::ClampIndex( typename InputImageType::IndexType index ) const
+{
+  const RegionType &largestRegion = this->GetInput()->GetLargestPossibleRegion();
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    const OffsetValueType first = largestRegion.GetIndex()[d];
+    const OffsetValueType last = first
+      + static_cast<OffsetValueType>( largestRegion.GetSize()[d] ) - 1;
+    index[d] = vnl_math_max( first, vnl_math_min( last,
+      static_cast<OffsetValueType>( index[d] ) ) );
+    }
+  return index;
 }
 
 
@@ -182,6 +250,12 @@ void
 TextureFeaturesImageFilter<TInputImage, TOutputImage>
 ::ThreadedGenerateData( const RegionType & region, ThreadIdType threadId )
 {
+  if( this->m_UseIncrementalCooccurrence )
+    {
+    this->ThreadedGenerateDataIncremental( region, threadId );
+    return;
+    }
+
   const InputImageType *inputImage = this->GetInput();
   OutputImageType      *outputImage = this->GetOutput();
   const MaskImageType  *maskImage = this->GetMaskImage();
@@ -229,12 +303,18 @@ TextureFeaturesImageFilter<TInputImage, TOutputImage>
 
     typename FeatureFilterType::Pointer featureFilter = FeatureFilterType::New();
 
-    typename InputImageType::IndexType centerIndex = It.GetIndex();
+    OutputPixelType zero;
+    NumericTraits<OutputPixelType>::SetLength( zero, this->GetNumberOfOutputComponents() );
+    zero.Fill( 0 );
 
     for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
       {
-      if( maskImage && ( maskImage->GetPixel( centerIndex ) == this->m_InsidePixelValue ) )
+      typename InputImageType::IndexType centerIndex = It.GetIndex();
+
+      if( maskImage && ( maskImage->GetPixel( centerIndex ) != this->m_InsidePixelValue ) )
         {
+        ItO.SetCenterPixel( zero );
+        progress.CompletedPixel();
         continue;
         }
       MeasurementVectorType cooccur( histogram->GetMeasurementVectorSize() );
@@ -246,8 +326,8 @@ TextureFeaturesImageFilter<TInputImage, TOutputImage>
         const InputPixelType p2 = It.GetPixel( it->second );
 
         if( maskImage &&
-          ( maskImage->GetPixel( centerIndex + it->first ) == this->m_InsidePixelValue ||
-            maskImage->GetPixel( centerIndex + it->second ) == this->m_InsidePixelValue ) )
+          ( maskImage->GetPixel( this->ClampIndex( centerIndex + it->first ) ) != this->m_InsidePixelValue ||
+            maskImage->GetPixel( this->ClampIndex( centerIndex + it->second ) ) != this->m_InsidePixelValue ) )
           {
           continue;
           }
@@ -262,8 +342,6 @@ TextureFeaturesImageFilter<TInputImage, TOutputImage>
           cooccur[0] = p2;
           histogram->IncreaseFrequencyOfMeasurement( cooccur, 1.0 );
           }
-
-        ++it;
         }
 
       featureFilter->SetInput( histogram );
@@ -287,6 +365,150 @@ TextureFeaturesImageFilter<TInputImage, TOutputImage>
     }
 }
 
+template<class TInputImage, class TOutputImage>
+void
+TextureFeaturesImageFilter<TInputImage, TOutputImage>
+::ThreadedGenerateDataIncremental( const RegionType & region, ThreadIdType threadId )
+{
+  typedef typename InputImageType::IndexType IndexType;
+
+  OutputImageType      *outputImage = this->GetOutput();
+  const MaskImageType  *maskImage = this->GetMaskImage();
+
+  const unsigned int outsideBin = this->m_NumberOfBinsPerAxis;
+
+  ProgressReporter progress( this, threadId, region.GetNumberOfPixels() );
+
+  CooccurrenceHistogramType histogram( this->m_NumberOfBinsPerAxis );
+
+  OutputPixelType zero;
+  NumericTraits<OutputPixelType>::SetLength( zero, this->GetNumberOfOutputComponents() );
+  zero.Fill( 0 );
+
+  // For each offset, the box of anchors a (relative to the center) for
+  // which both a and a + offset lie in the window.  Moving the center by
+  // one pixel along the row removes the first column of that box and adds
+  // a new last column.
+  const unsigned int numberOfOffsets = this->m_Offsets.size();
+  std::vector<OffsetType> anchorLower( numberOfOffsets );
+  std::vector<OffsetType> anchorUpper( numberOfOffsets );
+  std::vector<char>       anchorIsEmpty( numberOfOffsets, 0 );
+  for( unsigned int k = 0; k < numberOfOffsets; ++k )
+    {
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      const OffsetValueType radius = static_cast<OffsetValueType>( this->m_NeighborhoodRadius[d] );
+      const OffsetValueType o = this->m_Offsets[k][d];
+      anchorLower[k][d] = -radius + vnl_math_max( static_cast<OffsetValueType>( 0 ), -o );
+      anchorUpper[k][d] = radius - vnl_math_max( static_cast<OffsetValueType>( 0 ), o );
+      if( anchorLower[k][d] > anchorUpper[k][d] )
+        {
+        anchorIsEmpty[k] = 1;
+        }
+      }
+    }
+
+  ImageLinearIteratorWithIndex<OutputImageType> ItO( outputImage, region );
+  ItO.SetDirection( 0 );
+
+  for( ItO.GoToBegin(); !ItO.IsAtEnd(); ItO.NextLine() )
+    {
+    histogram.Clear();
+
+    bool isFirstPixelOfRow = true;
+    for( ItO.GoToBeginOfLine(); !ItO.IsAtEndOfLine(); ++ItO )
+      {
+      const IndexType centerIndex = ItO.GetIndex();
+
+      if( isFirstPixelOfRow )
+        {
+        typename std::vector<std::pair<OffsetType, OffsetType > >::const_iterator it;
+        for( it = this->m_CooccurenceOffsetVector.begin(); it != this->m_CooccurenceOffsetVector.end(); ++it )
+          {
+          const unsigned int b1 = this->m_BinImage->GetPixel( this->ClampIndex( centerIndex + it->first ) );
+          const unsigned int b2 = this->m_BinImage->GetPixel( this->ClampIndex( centerIndex + it->second ) );
+          if( b1 != outsideBin && b2 != outsideBin )
+            {
+            histogram.AddPair( b1, b2 );
+            }
+          }
+        isFirstPixelOfRow = false;
+        }
+      else
+        {
+        for( unsigned int k = 0; k < numberOfOffsets; ++k )
+          {
+          if( anchorIsEmpty[k] )
+            {
+            continue;
+            }
+          const OffsetType &offset = this->m_Offsets[k];
+
+          // leaving column, relative to the current center, then the
+          // entering column
+          for( unsigned int side = 0; side < 2; ++side )
+            {
+            OffsetType lower = anchorLower[k];
+            OffsetType upper = anchorUpper[k];
+            if( side == 0 )
+              {
+              lower[0] = upper[0] = anchorLower[k][0] - 1;
+              }
+            else
+              {
+              lower[0] = anchorUpper[k][0];
+              }
+
+            OffsetType anchor = lower;
+            while( true )
+              {
+              const IndexType anchorIndex = centerIndex + anchor;
+              const unsigned int b1 = this->m_BinImage->GetPixel( this->ClampIndex( anchorIndex ) );
+              const unsigned int b2 = this->m_BinImage->GetPixel( this->ClampIndex( anchorIndex + offset ) );
+              if( b1 != outsideBin && b2 != outsideBin )
+                {
+                if( side == 0 )
+                  {
+                  histogram.RemovePair( b1, b2 );
+                  }
+                else
+                  {
+                  histogram.AddPair( b1, b2 );
+                  }
+                }
+
+              unsigned int d = 0;
+              while( d < ImageDimension )
+                {
+                if( ++anchor[d] <= upper[d] )
+                  {
+                  break;
+                  }
+                anchor[d] = lower[d];
+                ++d;
+                }
+              if( d == ImageDimension )
+                {
+                break;
+                }
+              }
+            }
+          }
+        }
+
+      if( maskImage && ( maskImage->GetPixel( centerIndex ) != this->m_InsidePixelValue ) )
+        {
+        ItO.Set( zero );
+        }
+      else
+        {
+        ItO.Set( histogram.GetValue() );
+        }
+      progress.CompletedPixel();
+      }
+    }
+}
+
 template<class TInputImage, class TOutputImage>
 void
 TextureFeaturesImageFilter<TInputImage, TOutputImage>
@@ -299,6 +521,7 @@ TextureFeaturesImageFilter<TInputImage, TOutputImage>
   os << indent << "Max: " << this->GetMax() << std::endl;
   os << indent << "NumberOfBinsPerAxis: " << this->GetNumberOfBinsPerAxis() << std::endl;
   os << indent << "Normalize: " << this->GetNormalize() << std::endl;
+  os << indent << "UseIncrementalCooccurrence: " << this->GetUseIncrementalCooccurrence() << std::endl;
   }
 
 } // end namespace Statistics
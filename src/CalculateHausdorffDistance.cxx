@@ -1,9 +1,11 @@
 #include <stdio.h>
 
-#include "itkHausdorffDistanceImageFilter.h"
 #include "itkImage.h"
 #include "itkImageFileReader.h"
-#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkLabelSurfaceDistanceMeasuresImageFilter.h"
+
+#include <iomanip>
 
 
 template <unsigned int ImageDimension>
@@ -22,77 +24,82 @@ int CalculateHausdorffDistance( int argc, char *argv[] )
   reader2->SetFileName( argv[3] );
   reader2->Update();
 
-  long unsigned int differences = 0;
+  const bool useLabel = ( argc > 4 );
+  const PixelType label = useLabel
+    ? static_cast<PixelType>( atoi( argv[4] ) ) : 0;
 
-  typedef itk::HausdorffDistanceImageFilter<ImageType, ImageType> HausdorfferType;
-  typename HausdorfferType::Pointer hausdorffer = HausdorfferType::New();
+  long unsigned int differences = 0;
 
-  if ( argc <= 4 )
+  itk::ImageRegionConstIterator<ImageType> It1( reader1->GetOutput(),
+    reader1->GetOutput()->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<ImageType> It2( reader2->GetOutput(),
+    reader2->GetOutput()->GetLargestPossibleRegion() );
+  for ( It2.GoToBegin(), It1.GoToBegin(); !It2.IsAtEnd(); ++It2, ++It1 )
     {
-    hausdorffer->SetInput1( reader1->GetOutput() );
-    hausdorffer->SetInput2( reader2->GetOutput() );
-
-    itk::ImageRegionIterator<ImageType> It1( reader1->GetOutput(), reader1->GetOutput()->GetLargestPossibleRegion() );  
-    itk::ImageRegionIterator<ImageType> It2( reader2->GetOutput(), reader2->GetOutput()->GetLargestPossibleRegion() );  
-    for ( It2.GoToBegin(), It1.GoToBegin(); !It2.IsAtEnd(); ++It2, ++It1 )
+    if ( useLabel )
       {
-      if ( It1.Get() != It2.Get() )
+      if ( ( It1.Get() == label ) != ( It2.Get() == label ) )
         {
         differences++;
         }
       }
-    }
-  else
-    {
-
-    typename ImageType::Pointer image1 = ImageType::New();
-    image1->SetRegions( reader1->GetOutput()->GetLargestPossibleRegion() );
-    image1->SetOrigin( reader1->GetOutput()->GetOrigin() );
-    image1->SetSpacing( reader1->GetOutput()->GetSpacing() );
-    image1->Allocate();
-    image1->FillBuffer( 0 );
-
-    itk::ImageRegionIterator<ImageType> ItR1( reader1->GetOutput(), reader1->GetOutput()->GetLargestPossibleRegion() );  
-    itk::ImageRegionIterator<ImageType> It1( image1, image1->GetLargestPossibleRegion() );  
-    for ( It1.GoToBegin(), ItR1.GoToBegin(); !It1.IsAtEnd(); ++It1, ++ItR1 )
+    else if ( It1.Get() != It2.Get() )
       {
-      if ( ItR1.Get() == static_cast<PixelType>( atoi( argv[4] ) ) )
-        {
-        It1.Set( 1 );
-        }
+      differences++;
       }
+    }
 
-    typename ImageType::Pointer image2 = ImageType::New();
-    image2->SetRegions( reader2->GetOutput()->GetLargestPossibleRegion() );
-    image2->SetOrigin( reader2->GetOutput()->GetOrigin() );
-    image2->SetSpacing( reader2->GetOutput()->GetSpacing() );
-    image2->Allocate();
-    image2->FillBuffer( 0 );
+  // The surfaces of all the labels (or of the given one) are extracted
+  // once and the distances of both directions are computed together.
+  // These are boundary to boundary distances, unlike the region based
+  // HausdorffDistanceImageFilter used before.
+  typedef itk::LabelSurfaceDistanceMeasuresImageFilter<ImageType> FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetSourceImage( reader1->GetOutput() );
+  filter->SetTargetImage( reader2->GetOutput() );
+  if ( useLabel )
+    {
+    filter->SetSelectedLabel( label );
+    filter->UseSelectedLabelOn();
+    }
+  if ( argc > 5 )
+    {
+    filter->SetPercentile( atof( argv[5] ) );
+    }
+  filter->Update();
 
-    itk::ImageRegionIterator<ImageType> ItR2( reader2->GetOutput(), reader2->GetOutput()->GetLargestPossibleRegion() );  
-    itk::ImageRegionIterator<ImageType> It2( image2, image2->GetLargestPossibleRegion() );  
-    for ( It2.GoToBegin(), ItR2.GoToBegin(); !It2.IsAtEnd(); ++It2, ++ItR2 )
-      {
-      if ( ItR2.Get() == static_cast<PixelType>( atoi( argv[3] ) ) )
-        {
-        It2.Set( 1 );
-        }
-      }
-    for ( It2.GoToBegin(), It1.GoToBegin(); !It2.IsAtEnd(); ++It2, ++It1 )
-      {
-      if ( It1.Get() != It2.Get() )
-        {
-        differences++;
-        }
-      }
+  std::cout << "Pixel-wise difference = " << differences << std::endl;
 
-    hausdorffer->SetInput1( image1 );
-    hausdorffer->SetInput2( image2 );
-    }        
+  if ( useLabel )
+    {
+    std::cout << "Surface Hausdorff distance = "
+              << filter->GetHausdorffDistance( label ) << std::endl;
+    std::cout << "Percentile surface Hausdorff distance = "
+              << filter->GetPercentileHausdorffDistance( label ) << std::endl;
+    std::cout << "Mean surface distance = "
+              << filter->GetMeanSurfaceDistance( label ) << std::endl;
+    return 0;
+    }
 
-  hausdorffer->Update();
-  std::cout << "Pixel-wise difference = " << differences << std::endl;
-  std::cout << "Hausdorff distance = " << hausdorffer->GetHausdorffDistance() << std::endl;  
+  std::cout << std::setw( 10 ) << "Label"
+            << std::setw( 17 ) << "Surface Hd."
+            << std::setw( 17 ) << "Directed Hd."
+            << std::setw( 17 ) << "Percentile Hd."
+            << std::setw( 17 ) << "Mean surface"
+            << std::setw( 17 ) << "Directed mean" << std::endl;
+
+  typename FilterType::MapType::const_iterator it;
+  for ( it = filter->GetLabelSurfaceMeasures().begin();
+    it != filter->GetLabelSurfaceMeasures().end(); ++it )
+    {
+    std::cout << std::setw( 10 ) << (*it).first;
+    std::cout << std::setw( 17 ) << (*it).second.m_HausdorffDistance;
+    std::cout << std::setw( 17 ) << (*it).second.m_DirectedHausdorffDistance;
+    std::cout << std::setw( 17 ) << (*it).second.m_PercentileHausdorffDistance;
+    std::cout << std::setw( 17 ) << (*it).second.m_MeanSurfaceDistance;
+    std::cout << std::setw( 17 ) << (*it).second.m_DirectedMeanSurfaceDistance;
+    std::cout << std::endl;
+    }
 
   return 0;
 }
@@ -101,11 +108,14 @@ int main( int argc, char *argv[] )
 {
   if ( argc < 4 )
     {
-    std::cerr << "Usage: " << argv[0] << " imageDimension inputImage1 inputImage2 [label]"<< std::endl;
+    std::cerr << "Usage: " << argv[0] << " imageDimension inputImage1 inputImage2 [label] [percentile=0.95]"<< std::endl;
+    std::cerr << "  The Hausdorff and mean distances are measured between the label"
+              << " boundaries (surface distances), so nested labels and cavities"
+              << " give nonzero distances." << std::endl;
     exit( 1 );
     }
 
-  switch( atoi( argv[1] ) ) 
+  switch( atoi( argv[1] ) )
    {
    case 2:
      CalculateHausdorffDistance<2>( argc, argv );
@@ -118,4 +128,3 @@ int main( int argc, char *argv[] )
       exit( EXIT_FAILURE );
    }
 }
-
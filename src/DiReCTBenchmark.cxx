@@ -0,0 +1,197 @@
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkDiReCTImageFilter.h"
+#include "itkDiscreteGaussianImageFilter.h"
+#include "itkImage.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkTimeProbe.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Runs DiReCT on a spherical shell phantom (white matter sphere inside a
+// gray matter shell of known thickness, inside a csf shell) with the
+// original filter-based integration and with the fused one, and reports
+// the time, the mean gray matter thickness and the largest difference
+// between the two thickness maps.
+
+const unsigned int ImageDimension = 3;
+
+typedef unsigned int                                 LabelType;
+typedef itk::Image<LabelType, ImageDimension>        LabelImageType;
+typedef double                                       RealType;
+typedef itk::Image<RealType, ImageDimension>         ImageType;
+
+typedef itk::DiReCTImageFilter<LabelImageType, ImageType> DiReCTFilterType;
+
+LabelImageType::Pointer MakeShellPhantom( unsigned int size,
+  RealType innerRadius, RealType outerRadius, RealType csfRadius )
+{
+  LabelImageType::SizeType imageSize;
+  imageSize.Fill( size );
+  LabelImageType::RegionType region;
+  region.SetSize( imageSize );
+
+  LabelImageType::Pointer image = LabelImageType::New();
+  image->SetRegions( region );
+  image->Allocate();
+
+  const RealType center = 0.5 * static_cast<RealType>( size - 1 );
+
+  itk::ImageRegionIteratorWithIndex<LabelImageType> It( image, region );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    RealType radius = 0.0;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      radius += vnl_math_sqr( It.GetIndex()[d] - center );
+      }
+    radius = vcl_sqrt( radius );
+
+    LabelType label = 0;
+    if( radius < innerRadius )
+      {
+      label = 3;
+      }
+    else if( radius < outerRadius )
+      {
+      label = 2;
+      }
+    else if( radius < csfRadius )
+      {
+      label = 1;
+      }
+    It.Set( label );
+    }
+  return image;
+}
+
+ImageType::Pointer MakeProbabilityImage( LabelImageType *segmentation,
+  LabelType label )
+{
+  typedef itk::BinaryThresholdImageFilter<LabelImageType, ImageType>
+    ThresholderType;
+  ThresholderType::Pointer thresholder = ThresholderType::New();
+  thresholder->SetInput( segmentation );
+  thresholder->SetLowerThreshold( label );
+  thresholder->SetUpperThreshold( label );
+  thresholder->SetInsideValue( 1 );
+  thresholder->SetOutsideValue( 0 );
+
+  typedef itk::DiscreteGaussianImageFilter<ImageType, ImageType> SmootherType;
+  SmootherType::Pointer smoother = SmootherType::New();
+  smoother->SetVariance( 1.0 );
+  smoother->SetUseImageSpacingOn();
+  smoother->SetMaximumError( 0.01 );
+  smoother->SetInput( thresholder->GetOutput() );
+  smoother->Update();
+
+  return smoother->GetOutput();
+}
+
+ImageType::Pointer RunDiReCT( LabelImageType *segmentation,
+  ImageType *grayMatter, ImageType *whiteMatter, unsigned int iterations,
+  int threads, bool fused, double &time )
+{
+  DiReCTFilterType::Pointer direct = DiReCTFilterType::New();
+  direct->SetSegmentationImage( segmentation );
+  direct->SetGrayMatterProbabilityImage( grayMatter );
+  direct->SetWhiteMatterProbabilityImage( whiteMatter );
+  direct->SetMaximumNumberOfIterations( iterations );
+  // Never converge early so that both paths run the same iterations
+  direct->SetConvergenceThreshold( -1.0 );
+  direct->SetUseFusedIntegration( fused );
+  if( threads > 0 )
+    {
+    direct->SetNumberOfThreads( threads );
+    }
+
+  itk::TimeProbe timer;
+  timer.Start();
+  direct->Update();
+  timer.Stop();
+  time = timer.GetMeanTime();
+
+  ImageType::Pointer thickness = direct->GetOutput();
+  thickness->DisconnectPipeline();
+  return thickness;
+}
+
+RealType MeanGrayMatterThickness( const ImageType *thickness,
+  const LabelImageType *segmentation )
+{
+  itk::ImageRegionConstIterator<ImageType> ItT( thickness,
+    thickness->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<LabelImageType> ItS( segmentation,
+    segmentation->GetLargestPossibleRegion() );
+
+  RealType sum = 0.0;
+  RealType count = 0.0;
+  for( ItT.GoToBegin(), ItS.GoToBegin(); !ItT.IsAtEnd(); ++ItT, ++ItS )
+    {
+    if( ItS.Get() == 2 )
+      {
+      sum += ItT.Get();
+      count++;
+      }
+    }
+  return ( count > 0 ) ? sum / count : 0.0;
+}
+
+int main( int argc, char *argv[] )
+{
+  if( argc > 1 && ( std::string( argv[1] ) == "-h" ||
+    std::string( argv[1] ) == "--help" ) )
+    {
+    std::cout << "Usage: " << argv[0]
+      << " [imageSize=64] [numberOfIterations=10] [numberOfThreads]" << std::endl;
+    return EXIT_SUCCESS;
+    }
+
+  unsigned int size = ( argc > 1 ) ? atoi( argv[1] ) : 64;
+  unsigned int iterations = ( argc > 2 ) ? atoi( argv[2] ) : 10;
+  int threads = ( argc > 3 ) ? atoi( argv[3] ) : 0;
+
+  const RealType outerRadius = 0.35 * size;
+  const RealType innerRadius = outerRadius - 4.0;
+  const RealType csfRadius = outerRadius + 3.0;
+
+  LabelImageType::Pointer segmentation = MakeShellPhantom( size,
+    innerRadius, outerRadius, csfRadius );
+  ImageType::Pointer grayMatter = MakeProbabilityImage( segmentation, 2 );
+  ImageType::Pointer whiteMatter = MakeProbabilityImage( segmentation, 3 );
+
+  std::cout << "Phantom: " << size << "^3 voxels, gray matter shell from "
+    << innerRadius << " to " << outerRadius << " (thickness "
+    << outerRadius - innerRadius << ")" << std::endl;
+  std::cout << "Iterations: " << iterations << std::endl;
+
+  double filterTime = 0.0;
+  ImageType::Pointer filterThickness = RunDiReCT( segmentation, grayMatter,
+    whiteMatter, iterations, threads, false, filterTime );
+
+  double fusedTime = 0.0;
+  ImageType::Pointer fusedThickness = RunDiReCT( segmentation, grayMatter,
+    whiteMatter, iterations, threads, true, fusedTime );
+
+  itk::ImageRegionConstIterator<ImageType> ItF( filterThickness,
+    filterThickness->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<ImageType> ItU( fusedThickness,
+    fusedThickness->GetLargestPossibleRegion() );
+  RealType maxDifference = 0.0;
+  for( ItF.GoToBegin(), ItU.GoToBegin(); !ItF.IsAtEnd(); ++ItF, ++ItU )
+    {
+    maxDifference = vnl_math_max( maxDifference,
+      vnl_math_abs( ItF.Get() - ItU.Get() ) );
+    }
+
+  std::cout << "Filter-based integration: " << filterTime << " s, mean thickness "
+    << MeanGrayMatterThickness( filterThickness, segmentation ) << std::endl;
+  std::cout << "Fused integration:        " << fusedTime << " s, mean thickness "
+    << MeanGrayMatterThickness( fusedThickness, segmentation ) << std::endl;
+  std::cout << "Speedup: " << filterTime / fusedTime << std::endl;
+  std::cout << "Largest thickness difference: " << maxDifference << std::endl;
+
+  return EXIT_SUCCESS;
+}
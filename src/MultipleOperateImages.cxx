@@ -1,17 +1,13 @@
-#include "itkAddImageFilter.h"
 #include "itkArray.h"
-#include "itkBinaryThresholdImageFilter.h"
-#include "itkImageDuplicator.h"
 #include "itkImage.h"
-#include "itkImageDuplicator.h"
 #include "itkImageFileReader.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkImageFileWriter.h"
-#include "itkLabelGeometryImageFilter.h"
 #include "itkLabelStatisticsImageFilter.h"
 #include "itkMersenneTwisterRandomVariateGenerator.h"
-#include "itkRescaleIntensityImageFilter.h"
+#include "itkMultipleImageVoxelReducer.h"
+#include "itkStreamingMultipleImageReducer.h"
 
 #include <itksys/SystemTools.hxx>
 
@@ -19,6 +15,7 @@
 #include "vnl/vnl_complex_traits.h"
 #include "vcl_complex.h"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -27,32 +24,23 @@
 
 typedef float RealType;
 
-RealType CalculatePearsonCoefficient( std::vector<RealType> X, std::vector<RealType> Y )
+RealType CalculatePearsonCoefficient( const std::vector<RealType> & X, const double *Y )
 {
-  if( X.size() != Y.size() )
-    {
-    std::cerr << "Vectors are not the same size" << std::endl;
-    exit( 1 );
-    }
-
   RealType N = X.size();
 
-  std::vector<RealType>::const_iterator itX;
-  std::vector<RealType>::const_iterator itY;
+  double sumX = 0.0;
+  double sumY = 0.0;
+  double sumX2 = 0.0;
+  double sumXY = 0.0;
+  double sumY2 = 0.0;
 
-  RealType sumX = 0.0;
-  RealType sumY = 0.0;
-  RealType sumX2 = 0.0;
-  RealType sumXY = 0.0;
-  RealType sumY2 = 0.0;
-
-  for( itX = X.begin(), itY = Y.begin(); itX != X.end(); ++itX, ++itY )
+  for( unsigned int i = 0; i < X.size(); i++ )
     {
-    sumX  += (*itX);
-    sumY  += (*itY);
-    sumXY += (*itX) * (*itY);
-    sumX2 += (*itX) * (*itX);
-    sumY2 += (*itY) * (*itY);
+    sumX  += X[i];
+    sumY  += Y[i];
+    sumXY += X[i] * Y[i];
+    sumX2 += X[i] * X[i];
+    sumY2 += Y[i] * Y[i];
     }
 
   RealType r = ( N * sumXY - sumX*sumY ) / ( ( vcl_sqrt( N *sumX2 - (sumX*sumX) ) ) * ( vcl_sqrt( N *sumY2 - (sumY*sumY) ) ) );
@@ -60,34 +48,23 @@ RealType CalculatePearsonCoefficient( std::vector<RealType> X, std::vector<RealT
   return r;
 }
 
-std::vector<RealType> FitRegressionLine(
-  std::vector<RealType> X, std::vector<RealType> Y )
+void FitRegressionLine( const std::vector<RealType> & X, const double *Y, RealType line[2] )
 {
-  if( X.size() != Y.size() )
-    {
-    std::cerr << "Vectors are not the same size" << std::endl;
-    exit( 1 );
-    }
-
   RealType N = X.size();
 
-  std::vector<RealType>::const_iterator itX;
-  std::vector<RealType>::const_iterator itY;
-
-  RealType sumX = 0.0;
-  RealType sumY = 0.0;
-  RealType sumX2 = 0.0;
-  RealType sumXY = 0.0;
+  double sumX = 0.0;
+  double sumY = 0.0;
+  double sumX2 = 0.0;
+  double sumXY = 0.0;
 
-  for( itX = X.begin(), itY = Y.begin(); itX != X.end(); ++itX, ++itY )
+  for( unsigned int i = 0; i < X.size(); i++ )
     {
-    sumX  += (*itX);
-    sumY  += (*itY);
-    sumXY += (*itX) * (*itY);
-    sumX2 += (*itX) * (*itX);
+    sumX  += X[i];
+    sumY  += Y[i];
+    sumXY += X[i] * Y[i];
+    sumX2 += X[i] * X[i];
     }
 
-  std::vector<RealType> line( 2 );
   line[0] = ( N * sumXY - sumX*sumY ) / ( N *sumX2 - sumX*sumX );
   if( sumX2 == 0 )
     {
@@ -97,10 +74,741 @@ std::vector<RealType> FitRegressionLine(
     {
     line[1] = ( sumY - line[0] * sumX ) / N;
     }
+}
+
+template <class TImage>
+void WriteImage( TImage *image, const std::string & filename )
+{
+  typedef itk::ImageFileWriter<TImage> WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( image );
+  writer->SetFileName( filename.c_str() );
+  writer->Update();
+}
+
+/**
+ * Voxelwise operations, run by itk::StreamingMultipleImageReducer.  Each
+ * one gets the values of all the input images at one voxel.
+ */
+
+/**
+ * Reducer writing one function of the voxel values to a single output.
+ */
+template <class TImage, class TFunction>
+class VoxelFunctionReducer : public itk::MultipleImageVoxelReducer<TImage>
+{
+public:
+  typedef VoxelFunctionReducer                      Self;
+  typedef itk::MultipleImageVoxelReducer<TImage>    Superclass;
+  typedef itk::SmartPointer<Self>                   Pointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( VoxelFunctionReducer, MultipleImageVoxelReducer );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             ValueType;
+
+  void SetFunction( const TFunction & function )
+    { this->m_Function = function; }
+
+  ImageType * GetOutput()
+    { return this->m_Output.GetPointer(); }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads )
+    {
+    Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+    this->m_Output = this->CreateOutputImage();
+    }
+
+  virtual void ReduceVoxel( unsigned int, OffsetValueType offset,
+    const ValueType *values )
+    {
+    this->m_Output->GetBufferPointer()[offset] =
+      static_cast<typename ImageType::PixelType>(
+      this->m_Function( values, this->m_NumberOfImages ) );
+    }
+
+protected:
+  VoxelFunctionReducer() {}
+
+private:
+  TFunction                                         m_Function;
+  typename ImageType::Pointer                       m_Output;
+};
+
+/** Probability of exactly one of the label probabilities being true */
+struct WeightFunction
+{
+  RealType operator()( const double *p, unsigned int n ) const
+    {
+    float probability = 0.0;
+    for( unsigned int i = 0; i < n; i++ )
+      {
+      float negation = 1.0;
+      for( unsigned int j = 0; j < n; j++ )
+        {
+        if( i == j )
+          {
+          continue;
+          }
+        negation *= ( 1.0 - p[j] );
+        }
+      probability += negation * p[i];
+      }
+    return probability;
+    }
+};
+
+/** Label (starting at 1) of the highest label probability */
+struct SegmentationFunction
+{
+  RealType operator()( const double *p, unsigned int n ) const
+    {
+    float maxProbability = 0;
+    float maxLabel = 0;
+    for( unsigned int i = 0; i < n; i++ )
+      {
+      if( p[i] >= maxProbability )
+        {
+        maxProbability = p[i];
+        maxLabel = i + 1;
+        }
+      }
+    return ( maxProbability > 0 ) ? maxLabel : 0;
+    }
+};
+
+/** Expected ventilation from the posterior probabilities */
+struct ExpectedVentilationFunction
+{
+  RealType operator()( const double *p, unsigned int n ) const
+    {
+    float exVent = 0.0;
+    for( unsigned int i = 0; i < n; i++ )
+      {
+      exVent += ( ( i + 1 ) * p[i] );
+      }
+    return exVent;
+    }
+};
+
+struct ConcavityFunction
+{
+  RealType operator()( const double *p, unsigned int ) const
+    {
+    return p[2] - 2 * p[1] + p[0];
+    }
+};
+
+struct CorrelationFunction
+{
+  std::vector<RealType> X;
+
+  RealType operator()( const double *p, unsigned int ) const
+    {
+    return CalculatePearsonCoefficient( this->X, p );
+    }
+};
+
+struct SlopeFunction
+{
+  std::vector<RealType> X;
+
+  RealType operator()( const double *p, unsigned int ) const
+    {
+    RealType line[2];
+    FitRegressionLine( this->X, p, line );
+    return line[0];
+    }
+};
+
+/**
+ * Labels of each input, in order of first appearance in raster order.
+ */
+template <class TImage>
+class LabelListReducer : public itk::MultipleImageVoxelReducer<TImage>
+{
+public:
+  typedef LabelListReducer                          Self;
+  typedef itk::MultipleImageVoxelReducer<TImage>    Superclass;
+  typedef itk::SmartPointer<Self>                   Pointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( LabelListReducer, MultipleImageVoxelReducer );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             ValueType;
+  typedef unsigned int                              LabelType;
+  typedef std::vector<LabelType>                    LabelListType;
+
+  const LabelListType & GetLabels( unsigned int n ) const
+    { return this->m_Labels[n]; }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads )
+    {
+    Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+    this->m_Labels.assign( numberOfImages, LabelListType() );
+    this->m_ThreaderLabels.assign( numberOfThreads,
+      std::vector<LabelListType>( numberOfImages ) );
+    }
+
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType,
+    const ValueType *values )
+    {
+    for( unsigned int n = 0; n < this->m_NumberOfImages; n++ )
+      {
+      LabelListType & labels = this->m_ThreaderLabels[threadId][n];
+      const LabelType label = static_cast<LabelType>( values[n] );
+      if( std::find( labels.begin(), labels.end(), label ) == labels.end() )
+        {
+        labels.push_back( label );
+        }
+      }
+    }
+
+  /** The threads hold consecutive voxel ranges: merging their lists in
+   * thread order keeps the order of first appearance. */
+  virtual void AfterSlab()
+    {
+    for( unsigned int t = 0; t < this->m_ThreaderLabels.size(); t++ )
+      {
+      for( unsigned int n = 0; n < this->m_NumberOfImages; n++ )
+        {
+        LabelListType & labels = this->m_Labels[n];
+        LabelListType & threadLabels = this->m_ThreaderLabels[t][n];
+        for( unsigned int l = 0; l < threadLabels.size(); l++ )
+          {
+          if( std::find( labels.begin(), labels.end(), threadLabels[l] )
+            == labels.end() )
+            {
+            labels.push_back( threadLabels[l] );
+            }
+          }
+        threadLabels.clear();
+        }
+      }
+    }
+
+protected:
+  LabelListReducer() {}
 
-  return line;
+private:
+  std::vector<LabelListType>                        m_Labels;
+  std::vector<std::vector<LabelListType> >          m_ThreaderLabels;
+};
+
+/**
+ * New real image with the information and the region of a label image,
+ * filled with zeros.
+ */
+template <class TOutputImage, class TReferenceImage>
+typename TOutputImage::Pointer CreateOutputImageLike( const TReferenceImage *reference )
+{
+  typename TOutputImage::Pointer output = TOutputImage::New();
+  output->CopyInformation( reference );
+  output->SetRegions( reference->GetLargestPossibleRegion() );
+  output->Allocate();
+  output->FillBuffer( 0 );
+  return output;
 }
 
+/**
+ * Speed image from a set of label images (first pass), and centers of
+ * the voxels reaching the maximum label probabilities (second pass).
+ */
+template <class TLabelImage, class TOutputImage>
+class LabelProbabilityReducer : public itk::MultipleImageVoxelReducer<TLabelImage>
+{
+public:
+  typedef LabelProbabilityReducer                   Self;
+  typedef itk::MultipleImageVoxelReducer<TLabelImage> Superclass;
+  typedef itk::SmartPointer<Self>                   Pointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( LabelProbabilityReducer, MultipleImageVoxelReducer );
+
+  itkStaticConstMacro( ImageDimension, unsigned int, TLabelImage::ImageDimension );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef TOutputImage                              OutputImageType;
+  typedef typename Superclass::IndexType            IndexType;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             ValueType;
+  typedef unsigned int                              LabelType;
+
+  void SetLabels( const std::vector<LabelType> & labels,
+    unsigned int backgroundIndex )
+    {
+    this->m_Labels = labels;
+    this->m_BackgroundIndex = backgroundIndex;
+    this->m_MaxProbabilities.assign( labels.size(), 0.0 );
+    }
+
+  /** Second pass: accumulate the centers of the maximum probabilities
+   * found by the first pass instead of computing the speed image. */
+  void SetComputeCenters( bool computeCenters )
+    { this->m_ComputeCenters = computeCenters; }
+
+  OutputImageType * GetOutput()
+    { return this->m_Output.GetPointer(); }
+  const std::vector<float> & GetMaxProbabilities() const
+    { return this->m_MaxProbabilities; }
+  const std::vector<IndexType> & GetMaxProbabilityIndices() const
+    { return this->m_MaxProbabilityIndices; }
+
+  /** A label of the inputs missing from the label list, if any. */
+  bool GetUnknownLabel( LabelType & label ) const
+    {
+    for( unsigned int t = 0; t < this->m_ThreaderUnknownLabels.size(); t++ )
+      {
+      if( !this->m_ThreaderUnknownLabels[t].empty() )
+        {
+        label = this->m_ThreaderUnknownLabels[t][0];
+        return true;
+        }
+      }
+    return false;
+    }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads )
+    {
+    Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+
+    const unsigned int numberOfLabels = this->m_Labels.size();
+    this->m_ThreaderLabelCounts.assign( numberOfThreads,
+      std::vector<unsigned int>( numberOfLabels ) );
+    this->m_ThreaderUnknownLabels.assign( numberOfThreads,
+      std::vector<LabelType>() );
+    if( this->m_ComputeCenters )
+      {
+      this->m_ThreaderCenterSums.assign( numberOfThreads,
+        std::vector<double>( numberOfLabels * ImageDimension, 0.0 ) );
+      this->m_ThreaderCenterCounts.assign( numberOfThreads,
+        std::vector<float>( numberOfLabels, 0.0 ) );
+      }
+    else
+      {
+      this->m_Output = CreateOutputImageLike<OutputImageType>(
+        this->m_ReferenceImage.GetPointer() );
+      this->m_ThreaderMaxProbabilities.assign( numberOfThreads,
+        std::vector<float>( numberOfLabels, 0.0 ) );
+      }
+    }
+
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const ValueType *values )
+    {
+    const unsigned int numberOfLabels = this->m_Labels.size();
+    std::vector<unsigned int> & labelCount =
+      this->m_ThreaderLabelCounts[threadId];
+    std::fill( labelCount.begin(), labelCount.end(), 0 );
+
+    for( unsigned int n = 0; n < this->m_NumberOfImages; n++ )
+      {
+      const LabelType label = static_cast<LabelType>( values[n] );
+      typename std::vector<LabelType>::const_iterator loc
+        = std::find( this->m_Labels.begin(), this->m_Labels.end(), label );
+      if( loc == this->m_Labels.end() )
+        {
+        this->m_ThreaderUnknownLabels[threadId].push_back( label );
+        return;
+        }
+      labelCount[loc - this->m_Labels.begin()]++;
+      }
+
+    if( labelCount[this->m_BackgroundIndex] == this->m_NumberOfImages )
+      {
+      return;
+      }
+
+    const float numberOfImages = static_cast<float>( this->m_NumberOfImages );
+
+    if( this->m_ComputeCenters )
+      {
+      const IndexType index = this->ComputeIndex( offset );
+      for( unsigned int m = 0; m < numberOfLabels; m++ )
+        {
+        if( m == this->m_BackgroundIndex )
+          {
+          continue;
+          }
+        float probability = static_cast<float>( labelCount[m] ) / numberOfImages;
+        if( probability == this->m_MaxProbabilities[m] )
+          {
+          for( unsigned int d = 0; d < ImageDimension; d++ )
+            {
+            this->m_ThreaderCenterSums[threadId][m * ImageDimension + d] += index[d];
+            }
+          this->m_ThreaderCenterCounts[threadId][m]++;
+          }
+        }
+      return;
+      }
+
+    std::vector<float> & maxProbabilities =
+      this->m_ThreaderMaxProbabilities[threadId];
+    float totalProbability = 0.0;
+    for( unsigned int m = 0; m < numberOfLabels; m++ )
+      {
+      if( m == this->m_BackgroundIndex )
+        {
+        continue;
+        }
+      float probability = static_cast<float>( labelCount[m] ) / numberOfImages;
+
+      if( probability > maxProbabilities[m] )
+        {
+        maxProbabilities[m] = probability;
+        }
+      for( unsigned int n = 0; n < numberOfLabels; n++ )
+        {
+        if( m == n || n == this->m_BackgroundIndex )
+          {
+          continue;
+          }
+        probability *= ( 1.0 - static_cast<float>( labelCount[n] ) / numberOfImages );
+        }
+      totalProbability += probability;
+      }
+    this->m_Output->GetBufferPointer()[offset] = totalProbability;
+    }
+
+  virtual void Finalize()
+    {
+    const unsigned int numberOfLabels = this->m_Labels.size();
+    if( this->m_ComputeCenters )
+      {
+      this->m_MaxProbabilityIndices.resize( numberOfLabels );
+      for( unsigned int m = 0; m < numberOfLabels; m++ )
+        {
+        float count = 0.0;
+        for( unsigned int t = 0; t < this->m_ThreaderCenterCounts.size(); t++ )
+          {
+          count += this->m_ThreaderCenterCounts[t][m];
+          }
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          double sum = 0.0;
+          for( unsigned int t = 0; t < this->m_ThreaderCenterSums.size(); t++ )
+            {
+            sum += this->m_ThreaderCenterSums[t][m * ImageDimension + d];
+            }
+          this->m_MaxProbabilityIndices[m][d] = static_cast<
+            typename IndexType::IndexValueType>( vcl_floor( sum / count ) );
+          }
+        }
+      }
+    else
+      {
+      for( unsigned int m = 0; m < numberOfLabels; m++ )
+        {
+        for( unsigned int t = 0; t < this->m_ThreaderMaxProbabilities.size(); t++ )
+          {
+          this->m_MaxProbabilities[m] = vnl_math_max( this->m_MaxProbabilities[m],
+            this->m_ThreaderMaxProbabilities[t][m] );
+          }
+        }
+      }
+    }
+
+protected:
+  LabelProbabilityReducer()
+    {
+    this->m_BackgroundIndex = 0;
+    this->m_ComputeCenters = false;
+    }
+
+private:
+  std::vector<LabelType>                            m_Labels;
+  unsigned int                                      m_BackgroundIndex;
+  bool                                              m_ComputeCenters;
+
+  typename OutputImageType::Pointer                 m_Output;
+  std::vector<float>                                m_MaxProbabilities;
+  std::vector<IndexType>                            m_MaxProbabilityIndices;
+
+  std::vector<std::vector<unsigned int> >           m_ThreaderLabelCounts;
+  std::vector<std::vector<LabelType> >              m_ThreaderUnknownLabels;
+  std::vector<std::vector<float> >                  m_ThreaderMaxProbabilities;
+  std::vector<std::vector<double> >                 m_ThreaderCenterSums;
+  std::vector<std::vector<float> >                  m_ThreaderCenterCounts;
+};
+
+/**
+ * Fraction of the inputs having each label, one output per label.
+ */
+template <class TLabelImage, class TOutputImage>
+class LabelAverageReducer : public itk::MultipleImageVoxelReducer<TLabelImage>
+{
+public:
+  typedef LabelAverageReducer                       Self;
+  typedef itk::MultipleImageVoxelReducer<TLabelImage> Superclass;
+  typedef itk::SmartPointer<Self>                   Pointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( LabelAverageReducer, MultipleImageVoxelReducer );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef TOutputImage                              OutputImageType;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             ValueType;
+  typedef unsigned int                              LabelType;
+
+  void SetLabels( const std::vector<LabelType> & labels )
+    { this->m_Labels = labels; }
+
+  OutputImageType * GetOutput( unsigned int l )
+    { return this->m_Outputs[l].GetPointer(); }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads )
+    {
+    Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+    this->m_Outputs.resize( this->m_Labels.size() );
+    for( unsigned int l = 0; l < this->m_Labels.size(); l++ )
+      {
+      this->m_Outputs[l] = CreateOutputImageLike<OutputImageType>(
+        this->m_ReferenceImage.GetPointer() );
+      }
+    this->m_ThreaderLabelCounts.assign( numberOfThreads,
+      std::vector<unsigned int>( this->m_Labels.size() ) );
+    }
+
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const ValueType *values )
+    {
+    std::vector<unsigned int> & labelCount =
+      this->m_ThreaderLabelCounts[threadId];
+    std::fill( labelCount.begin(), labelCount.end(), 0 );
+
+    for( unsigned int n = 0; n < this->m_NumberOfImages; n++ )
+      {
+      const LabelType label = static_cast<LabelType>( values[n] );
+      typename std::vector<LabelType>::const_iterator loc
+        = std::find( this->m_Labels.begin(), this->m_Labels.end(), label );
+      if( loc != this->m_Labels.end() )
+        {
+        labelCount[loc - this->m_Labels.begin()]++;
+        }
+      }
+
+    const RealType numberOfImages = static_cast<RealType>( this->m_NumberOfImages );
+    for( unsigned int l = 0; l < this->m_Labels.size(); l++ )
+      {
+      this->m_Outputs[l]->GetBufferPointer()[offset] =
+        static_cast<RealType>( labelCount[l] ) / numberOfImages;
+      }
+    }
+
+protected:
+  LabelAverageReducer() {}
+
+private:
+  std::vector<LabelType>                            m_Labels;
+  std::vector<typename OutputImageType::Pointer>    m_Outputs;
+  std::vector<std::vector<unsigned int> >           m_ThreaderLabelCounts;
+};
+
+/**
+ * Magnitude of the Fourier transform of the Hann windowed voxel values,
+ * one output per frequency.
+ */
+template <class TImage>
+class FourierTransformReducer : public itk::MultipleImageVoxelReducer<TImage>
+{
+public:
+  typedef FourierTransformReducer                   Self;
+  typedef itk::MultipleImageVoxelReducer<TImage>    Superclass;
+  typedef itk::SmartPointer<Self>                   Pointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( FourierTransformReducer, MultipleImageVoxelReducer );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             ValueType;
+  typedef vnl_fft_1d<RealType>                      FFTType;
+  typedef vnl_vector< vcl_complex<RealType> >       ComplexVectorType;
+
+  void SetPaddedSize( unsigned int paddedSize )
+    { this->m_PaddedSize = paddedSize; }
+
+  ImageType * GetOutput( unsigned int n )
+    { return this->m_Outputs[n].GetPointer(); }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads )
+    {
+    Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+    this->m_Outputs.resize( this->m_PaddedSize );
+    for( unsigned int n = 0; n < this->m_PaddedSize; n++ )
+      {
+      this->m_Outputs[n] = this->CreateOutputImage();
+      }
+    this->ClearTransforms();
+    for( unsigned int t = 0; t < numberOfThreads; t++ )
+      {
+      this->m_ThreaderTransforms.push_back( new FFTType( this->m_PaddedSize ) );
+      }
+    this->m_ThreaderVectors.assign( numberOfThreads,
+      ComplexVectorType( this->m_PaddedSize ) );
+    }
+
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const ValueType *values )
+    {
+    ComplexVectorType & V = this->m_ThreaderVectors[threadId];
+    V.fill( vcl_complex<RealType>( 0.0, 0.0 ) );
+
+    for( unsigned int n = 0; n < this->m_NumberOfImages; n++ )
+      {
+      // Multiply intensity by Hann window
+      V[n] = static_cast<RealType>( values[n] ) * 0.5 * ( 1 - vcl_cos( 2 * vnl_math::pi * n / ( this->m_PaddedSize - 1 ) ) );
+      }
+    this->m_ThreaderTransforms[threadId]->fwd_transform( V );
+
+    for( unsigned int n = 0; n < this->m_PaddedSize; n++ )
+      {
+      this->m_Outputs[n]->GetBufferPointer()[offset] = vcl_norm( V[n] );
+      }
+    }
+
+protected:
+  FourierTransformReducer()
+    { this->m_PaddedSize = 1; }
+  ~FourierTransformReducer()
+    { this->ClearTransforms(); }
+
+private:
+  void ClearTransforms()
+    {
+    for( unsigned int t = 0; t < this->m_ThreaderTransforms.size(); t++ )
+      {
+      delete this->m_ThreaderTransforms[t];
+      }
+    this->m_ThreaderTransforms.clear();
+    }
+
+  unsigned int                                      m_PaddedSize;
+  std::vector<typename ImageType::Pointer>          m_Outputs;
+  std::vector<FFTType *>                            m_ThreaderTransforms;
+  std::vector<ComplexVectorType>                    m_ThreaderVectors;
+};
+
+/**
+ * Prints the voxel values and indices as csv lines, in raster order.
+ */
+template <class TImage, class TMaskImage>
+class SampleReducer : public itk::MultipleImageVoxelReducer<TImage>
+{
+public:
+  typedef SampleReducer                             Self;
+  typedef itk::MultipleImageVoxelReducer<TImage>    Superclass;
+  typedef itk::SmartPointer<Self>                   Pointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( SampleReducer, MultipleImageVoxelReducer );
+
+  itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+  typedef typename Superclass::ImageType            ImageType;
+  typedef typename Superclass::IndexType            IndexType;
+  typedef typename Superclass::OffsetValueType      OffsetValueType;
+  typedef typename Superclass::RealType             ValueType;
+
+  void SetMaskImage( const TMaskImage *mask )
+    { this->m_MaskImage = mask; }
+  void SetOutputStreams( std::ostream *samples, std::ostream *indices )
+    {
+    this->m_SampleStream = samples;
+    this->m_IndexStream = indices;
+    }
+
+  virtual void Initialize( const ImageType *reference,
+    unsigned int numberOfImages, unsigned int numberOfThreads )
+    {
+    Superclass::Initialize( reference, numberOfImages, numberOfThreads );
+    this->ClearStreams();
+    for( unsigned int t = 0; t < numberOfThreads; t++ )
+      {
+      this->m_ThreaderSamples.push_back( new std::ostringstream );
+      this->m_ThreaderIndices.push_back( new std::ostringstream );
+      }
+    }
+
+  virtual void ReduceVoxel( unsigned int threadId, OffsetValueType offset,
+    const ValueType *values )
+    {
+    std::ostringstream & str = *this->m_ThreaderSamples[threadId];
+    std::ostringstream & str2 = *this->m_ThreaderIndices[threadId];
+
+    const IndexType index = this->ComputeIndex( offset );
+    for( unsigned int d = 0; d < ImageDimension-1; d++ )
+      {
+      str2 << index[d] << ",";
+      }
+    str2 << index[ImageDimension-1] << std::endl;
+
+    if( !this->m_MaskImage )
+      {
+      str << "NA,";
+      }
+    else
+      {
+      str << this->m_MaskImage->GetBufferPointer()[offset] << ",";
+      }
+    for( unsigned int n = 0; n < this->m_NumberOfImages-1; n++ )
+      {
+      str << static_cast<RealType>( values[n] ) << ",";
+      }
+    str << static_cast<RealType>( values[this->m_NumberOfImages-1] ) << std::endl;
+    }
+
+  virtual void AfterSlab()
+    {
+    for( unsigned int t = 0; t < this->m_ThreaderSamples.size(); t++ )
+      {
+      *this->m_SampleStream << this->m_ThreaderSamples[t]->str();
+      *this->m_IndexStream << this->m_ThreaderIndices[t]->str();
+      this->m_ThreaderSamples[t]->str( "" );
+      this->m_ThreaderIndices[t]->str( "" );
+      }
+    }
+
+protected:
+  SampleReducer()
+    {
+    this->m_MaskImage = NULL;
+    this->m_SampleStream = NULL;
+    this->m_IndexStream = NULL;
+    }
+  ~SampleReducer()
+    { this->ClearStreams(); }
+
+private:
+  void ClearStreams()
+    {
+    for( unsigned int t = 0; t < this->m_ThreaderSamples.size(); t++ )
+      {
+      delete this->m_ThreaderSamples[t];
+      delete this->m_ThreaderIndices[t];
+      }
+    this->m_ThreaderSamples.clear();
+    this->m_ThreaderIndices.clear();
+    }
+
+  const TMaskImage                                 *m_MaskImage;
+  std::ostream                                     *m_SampleStream;
+  std::ostream                                     *m_IndexStream;
+  std::vector<std::ostringstream *>                 m_ThreaderSamples;
+  std::vector<std::ostringstream *>                 m_ThreaderIndices;
+};
+
 
 #include <fstream>
 
@@ -173,74 +881,50 @@ int MultipleOperateImages( int argc, char * argv[] )
 
   std::string op = std::string( argv[2] );
 
-  if( op.compare( std::string( "mean" ) ) == 0 )
-    {
-    typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName( filenames[0].c_str() );
-    reader->Update();
+  /**
+   * The voxelwise operations read the inputs one slab at a time
+   */
+  typedef itk::StreamingMultipleImageReducer<ImageType, LabelImageType> StreamerType;
+  typename StreamerType::Pointer streamer = StreamerType::New();
+  streamer->SetFileNames( filenames );
+  streamer->SetMaskImage( mask );
 
-    typename ImageType::Pointer output = reader->GetOutput();
+  // The label operations read the inputs in their integral pixel type
+  typedef itk::StreamingMultipleImageReducer<LabelImageType, LabelImageType> LabelStreamerType;
 
-    float N = 1.0;
+  typedef itk::MultipleImageStatisticsReducer<ImageType> StatisticsReducerType;
 
-    for( unsigned int n = 1; n < filenames.size(); n++ )
+  if( op.compare( std::string( "mean" ) ) == 0 ||
+    op.compare( std::string( "sum" ) ) == 0 ||
+    op.compare( std::string( "max" ) ) == 0 ||
+    op.compare( std::string( "var" ) ) == 0 )
+    {
+    typename StatisticsReducerType::StatisticType statistic =
+      StatisticsReducerType::Mean;
+    if( op.compare( std::string( "sum" ) ) == 0 )
       {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-
-      N += 1.0;
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( output,
-        output->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItO.Set( ItO.Get() * ( N - 1.0 ) / N + It.Get() / N );
-          }
-        }
+      statistic = StatisticsReducerType::Sum;
       }
-
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
-    }
-  else if( op.compare( std::string( "sum" ) ) == 0 )
-    {
-    typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName( filenames[0].c_str() );
-    reader->Update();
-
-    typename ImageType::Pointer output = reader->GetOutput();
-
-    for( unsigned int n = 1; n < filenames.size(); n++ )
+    else if( op.compare( std::string( "max" ) ) == 0 )
       {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( output,
-        output->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItO.Set( ItO.Get() + It.Get() );
-          }
-        }
+      statistic = StatisticsReducerType::Maximum;
+      }
+    else if( op.compare( std::string( "var" ) ) == 0 )
+      {
+      statistic = StatisticsReducerType::Variance;
       }
 
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
+    typename StatisticsReducerType::Pointer reducer = StatisticsReducerType::New();
+    reducer->SetUseStatistic( StatisticsReducerType::Mean, false );
+    reducer->SetUseStatistic( statistic, true );
+    // As before, the voxels outside of the mask keep the value of the
+    // first image (the variance stays zero there)
+    reducer->CopyFirstImageOutsideOfMaskOn();
+
+    streamer->SetReducer( reducer );
+    streamer->Update();
+
+    WriteImage<ImageType>( reducer->GetOutput( statistic ), argv[3] );
     }
   else if( op.compare( std::string( "center" ) ) == 0 )
     {
@@ -298,143 +982,29 @@ int MultipleOperateImages( int argc, char * argv[] )
       writer->Update();
       }
     }
-  else if( op.compare( std::string( "max" ) ) == 0 )
-    {
-    typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName( filenames[0].c_str() );
-    reader->Update();
-
-    typename ImageType::Pointer output = reader->GetOutput();
-
-    for( unsigned int n = 1; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( output,
-        output->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItO.Set( vnl_math_max( ItO.Get(), It.Get() ) );
-          }
-        }
-      }
-
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
-    }
-  else if( op.compare( std::string( "var" ) ) == 0 )
-    {
-    typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName( filenames[0].c_str() );
-    reader->Update();
-
-    typename ImageType::Pointer meanImage = reader->GetOutput();
-
-    float N = 1.0;
-
-    typename ImageType::Pointer output = ImageType::New();
-    output->SetOrigin( meanImage->GetOrigin() );
-    output->SetSpacing( meanImage->GetSpacing() );
-    output->SetRegions( meanImage->GetLargestPossibleRegion() );
-    output->SetDirection( meanImage->GetDirection() );
-    output->Allocate();
-    output->FillBuffer( 0 );
-
-    for( unsigned int n = 1; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-
-      N += 1.0;
-
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( output,
-        output->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItM( meanImage,
-        meanImage->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(), ItM.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO, ++ItM )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItM.Set( ItM.Get() * ( N - 1.0 ) / N + It.Get() / N );
-          if ( N > 1.0 )
-            {
-            ItO.Set( ItO.Get() * ( N - 1.0 )/N +
-              ( It.Get() - ItM.Get() )*( It.Get() - ItM.Get() ) / ( N - 1.0 ) );
-            }
-          }
-        }
-      }
-
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
-    }
   else if( op.compare( std::string( "s" ) ) == 0 )
     {
-    std::vector<typename LabelImageType::Pointer> labelImages;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename LabelReaderType::Pointer reader = LabelReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      labelImages.push_back( reader->GetOutput() );
-      }
-
-    typename ImageType::Pointer output = ImageType::New();
-    output->SetOrigin( labelImages[0]->GetOrigin() );
-    output->SetSpacing( labelImages[0]->GetSpacing() );
-    output->SetRegions( labelImages[0]->GetLargestPossibleRegion() );
-    output->SetDirection( labelImages[0]->GetDirection() );
-    output->Allocate();
-    output->FillBuffer( 0 );
-
     /**
      * Get the actual labels---assume that the first image read has all
      * the actual labels.
      */
-    itk::ImageRegionIteratorWithIndex<LabelImageType> It( labelImages[0],
-      labelImages[0]->GetLargestPossibleRegion() );
+    typedef LabelListReducer<LabelImageType> LabelListReducerType;
+    typename LabelListReducerType::Pointer labelLister = LabelListReducerType::New();
 
-    std::vector<LabelType> labels;
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( std::find( labels.begin(), labels.end(), It.Get() ) == labels.end() )
-        {
-        labels.push_back( It.Get() );
-        }
-      }
-    itk::Array<unsigned long> labelCount( labels.size() );
-    std::vector<float> maxProbabilities;
-    std::vector<typename LabelImageType::IndexType> maxProbabilityIndices;
-    std::vector<float> maxProbabilityCount;
-    maxProbabilities.resize( labels.size() );
-    maxProbabilityIndices.resize( labels.size() );
-    maxProbabilityCount.resize( labels.size() );
+    typename LabelStreamerType::Pointer firstImageStreamer = LabelStreamerType::New();
+    firstImageStreamer->SetFileNames( std::vector<std::string>( 1, filenames[0] ) );
+    firstImageStreamer->SetReducer( labelLister );
+    firstImageStreamer->Update();
+
+    std::vector<LabelType> labels = labelLister->GetLabels( 0 );
 
     std::cout << "Labels: ";
     for( unsigned int n = 0; n < labels.size(); n++ )
       {
-      maxProbabilities[n] = 0.0;
-      maxProbabilityCount[n] = 0.0;
       std::cout << labels[n] << " ";
       }
     std::cout << std::endl;
 
-
     std::vector<LabelType>::iterator loc
       = std::find( labels.begin(), labels.end(), 0 );
     if( loc == labels.end() )
@@ -445,127 +1015,38 @@ int MultipleOperateImages( int argc, char * argv[] )
     unsigned int backgroundIndex = static_cast<unsigned int>(
       std::distance( labels.begin(), loc ) );
 
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-        {
-        labelCount.Fill( 0 );
-        for( unsigned int n = 0; n < labelImages.size(); n++ )
-          {
-          LabelType label = labelImages[n]->GetPixel( It.GetIndex() );
-          std::vector<LabelType>::iterator loc
-            = std::find( labels.begin(), labels.end(), label );
-          if( loc == labels.end() )
-            {
-            std::cerr << "Label " << label << " not found." << std::endl;
-            return EXIT_FAILURE;
-            }
-          unsigned int index = static_cast<unsigned int>(
-            std::distance( labels.begin(), loc ) );
-          labelCount[index]++;
-          }
-
-        if( labelCount[backgroundIndex] == labelImages.size() )
-          {
-          continue;
-          }
+    typedef LabelProbabilityReducer<LabelImageType, ImageType> ProbabilityReducerType;
+    typename ProbabilityReducerType::Pointer reducer = ProbabilityReducerType::New();
+    reducer->SetLabels( labels, backgroundIndex );
 
-        float totalProbability = 0.0;
-        for( unsigned int m = 0; m < labelCount.Size(); m++ )
-          {
-          if( m == backgroundIndex )
-            {
-            continue;
-            }
-          float probability = static_cast<float>( labelCount[m] ) /
-            static_cast<float>( labelImages.size() );
+    typename LabelStreamerType::Pointer labelStreamer = LabelStreamerType::New();
+    labelStreamer->SetFileNames( filenames );
+    labelStreamer->SetMaskImage( mask );
+    labelStreamer->SetReducer( reducer );
+    labelStreamer->Update();
 
-          if( probability > maxProbabilities[m] )
-            {
-            maxProbabilities[m] = probability;
-            }
-          for( unsigned int n = 0; n < labelCount.Size(); n++ )
-            {
-            if( m == n || n == backgroundIndex )
-              {
-              continue;
-              }
-            probability *= ( 1.0 - static_cast<float>( labelCount[n] ) /
-            static_cast<float>( labelImages.size() ) );
-            }
-          totalProbability += probability;
-          }
-        output->SetPixel( It.GetIndex(), totalProbability );
-        }
+    LabelType unknownLabel;
+    if( reducer->GetUnknownLabel( unknownLabel ) )
+      {
+      std::cerr << "Label " << unknownLabel << " not found." << std::endl;
+      return EXIT_FAILURE;
       }
 
+    WriteImage<ImageType>( reducer->GetOutput(), argv[3] );
+
     /**
      * Find the central cluster of the max probabilities
      */
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      labelCount.Fill( 0 );
-      for( unsigned int n = 0; n < labelImages.size(); n++ )
-        {
-        LabelType label = labelImages[n]->GetPixel( It.GetIndex() );
-        std::vector<LabelType>::iterator loc
-          = std::find( labels.begin(), labels.end(), label );
-        if( loc == labels.end() )
-          {
-          std::cerr << "Label " << label << " not found." << std::endl;
-          return EXIT_FAILURE;
-          }
-        unsigned int index = static_cast<unsigned int>(
-          std::distance( labels.begin(), loc ) );
-        labelCount[index]++;
-        }
-
-      if( labelCount[backgroundIndex] == labelImages.size() )
-        {
-        continue;
-        }
-
-      for( unsigned int m = 0; m < labelCount.Size(); m++ )
-        {
-        if( m == backgroundIndex )
-          {
-          continue;
-          }
-        float probability = static_cast<float>( labelCount[m] ) /
-          static_cast<float>( labelImages.size() );
-        if( probability == maxProbabilities[m] )
-          {
-          for( unsigned int d = 0; d < ImageDimension; d++ )
-            {
-            if( maxProbabilityCount[m] == 0 )
-              {
-              maxProbabilityIndices[m][d] = It.GetIndex()[d];
-              }
-            else
-              {
-              maxProbabilityIndices[m][d] += It.GetIndex()[d];
-              }
-            }
-          maxProbabilityCount[m]++;
-          }
-        }
-      }
+    reducer->SetComputeCenters( true );
+    labelStreamer->UseMaskOff();
+    labelStreamer->Update();
 
-    for( unsigned int n = 0; n < maxProbabilityIndices.size(); n++ )
+    if( reducer->GetUnknownLabel( unknownLabel ) )
       {
-      for( unsigned int d = 0; d < ImageDimension; d++ )
-        {
-        maxProbabilityIndices[n][d] = vcl_floor( maxProbabilityIndices[n][d] /
-          maxProbabilityCount[n] );
-        }
+      std::cerr << "Label " << unknownLabel << " not found." << std::endl;
+      return EXIT_FAILURE;
       }
 
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
-
     for( unsigned int m = 0; m < labels.size(); m++ )
       {
       if( labels[m] == 0 )
@@ -573,167 +1054,52 @@ int MultipleOperateImages( int argc, char * argv[] )
         continue;
         }
       std::cout << labels[m] << " "
-        << maxProbabilityIndices[m] << " "
-        << maxProbabilities[m] << std::endl;
+        << reducer->GetMaxProbabilityIndices()[m] << " "
+        << reducer->GetMaxProbabilities()[m] << std::endl;
       }
     }
   else if( op.compare( std::string( "w" ) ) == 0 )
     {
-    std::vector<typename ImageType::Pointer> images;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
+    typedef VoxelFunctionReducer<ImageType, WeightFunction> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    streamer->SetReducer( reducer );
+    streamer->Update();
 
-    typename ImageType::Pointer output = ImageType::New();
-    output->SetOrigin( images[0]->GetOrigin() );
-    output->SetSpacing( images[0]->GetSpacing() );
-    output->SetRegions( images[0]->GetLargestPossibleRegion() );
-    output->SetDirection( images[0]->GetDirection() );
-    output->Allocate();
-    output->FillBuffer( 0 );
-
-    itk::ImageRegionIteratorWithIndex<ImageType> ItO( output,
-      output->GetLargestPossibleRegion() );
-    for( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO )
-      {
-      if( !mask || mask->GetPixel( ItO.GetIndex() ) != 0 )
-        {
-        float probability = 0.0;
-        for( unsigned int i = 0; i < images.size(); i++ )
-          {
-          float negation = 1.0;
-          for( unsigned int j = 0; j < images.size(); j++ )
-            {
-            if( i == j )
-              {
-              continue;
-              }
-            negation *= ( 1.0 - images[j]->GetPixel( ItO.GetIndex() ) );
-            }
-          probability += negation * images[i]->GetPixel( ItO.GetIndex() );
-          }
-        ItO.Set( probability );
-        }
-      }
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
+    WriteImage<ImageType>( reducer->GetOutput(), argv[3] );
     }
   else if( op.compare( std::string( "seg" ) ) == 0 )
     {
-    std::vector<typename ImageType::Pointer> images;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
+    typedef VoxelFunctionReducer<ImageType, SegmentationFunction> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    streamer->SetReducer( reducer );
+    streamer->Update();
 
-    typename ImageType::Pointer output = ImageType::New();
-    output->SetOrigin( images[0]->GetOrigin() );
-    output->SetSpacing( images[0]->GetSpacing() );
-    output->SetRegions( images[0]->GetLargestPossibleRegion() );
-    output->SetDirection( images[0]->GetDirection() );
-    output->Allocate();
-    output->FillBuffer( 0 );
-
-    itk::ImageRegionIteratorWithIndex<ImageType> ItO( output,
-      output->GetLargestPossibleRegion() );
-    for( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO )
-      {
-      if( !mask || mask->GetPixel( ItO.GetIndex() ) != 0 )
-        {
-        float maxProbability = 0;
-        float maxLabel = 0;
-        for( unsigned int i = 0; i < images.size(); i++ )
-          {
-          if( images[i]->GetPixel( ItO.GetIndex() ) >= maxProbability )
-            {
-            maxProbability = images[i]->GetPixel( ItO.GetIndex() );
-            maxLabel = i + 1;
-            }
-          }
-        if( maxProbability > 0 )
-          {
-          ItO.Set( maxLabel );
-          }
-        }
-      }
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
+    WriteImage<ImageType>( reducer->GetOutput(), argv[3] );
     }
   else if( op.compare( std::string( "ex" ) ) == 0 )
     {
-    std::vector<typename ImageType::Pointer> images;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
+    typedef VoxelFunctionReducer<ImageType, ExpectedVentilationFunction> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    streamer->SetReducer( reducer );
+    streamer->Update();
 
-    typename ImageType::Pointer output = ImageType::New();
-    output->SetOrigin( images[0]->GetOrigin() );
-    output->SetSpacing( images[0]->GetSpacing() );
-    output->SetRegions( images[0]->GetLargestPossibleRegion() );
-    output->SetDirection( images[0]->GetDirection() );
-    output->Allocate();
-    output->FillBuffer( 0 );
-
-    itk::ImageRegionIteratorWithIndex<ImageType> ItO( output,
-      output->GetLargestPossibleRegion() );
-    for( ItO.GoToBegin(); !ItO.IsAtEnd(); ++ItO )
-      {
-      if( !mask || mask->GetPixel( ItO.GetIndex() ) != 0 )
-        {
-        float exVent = 0.0;
-        for( unsigned int i = 0; i < images.size(); i++ )
-          {
-          exVent += ( ( i + 1 ) * images[i]->GetPixel( ItO.GetIndex() ) );
-          }
-        ItO.Set( exVent );
-        }
-      }
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( output );
-    writer->SetFileName( argv[3] );
-    writer->Update();
+    WriteImage<ImageType>( reducer->GetOutput(), argv[3] );
     }
   else if( op.compare( std::string( "labelAvg" ) ) == 0 )
     {
-    typedef unsigned int LabelType;
+    typedef LabelListReducer<LabelImageType> LabelListReducerType;
+    typename LabelListReducerType::Pointer labelLister = LabelListReducerType::New();
 
-    std::vector<LabelType> labels;
-    typedef itk::Image<LabelType, ImageDimension> LabelImageType;
+    typename LabelStreamerType::Pointer labelStreamer = LabelStreamerType::New();
+    labelStreamer->SetFileNames( filenames );
+    labelStreamer->SetReducer( labelLister );
+    labelStreamer->Update();
 
-    std::vector<typename LabelImageType::Pointer> images;
-    std::vector<typename ImageType::Pointer> outputImages;
-    std::vector<std::string> outputFilenames;
+    std::vector<LabelType> labels;
     for( unsigned int n = 0; n < filenames.size(); n++ )
       {
-      typename LabelReaderType::Pointer reader = LabelReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-
-      typedef itk::LabelGeometryImageFilter<LabelImageType, ImageType>  FilterType;
-      typename FilterType::Pointer filter = FilterType::New();
-      filter->SetInput( images[n] );
-      filter->Update();
-
-      std::vector<LabelType> imageLabels = filter->GetLabels();
+      std::vector<LabelType> imageLabels = labelLister->GetLabels( n );
+      std::sort( imageLabels.begin(), imageLabels.end() );
 
       std::vector<LabelType>::const_iterator it;
       for( it = imageLabels.begin(); it != imageLabels.end(); ++it )
@@ -745,87 +1111,36 @@ int MultipleOperateImages( int argc, char * argv[] )
         }
       }
 
+    typedef LabelAverageReducer<LabelImageType, ImageType> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    reducer->SetLabels( labels );
+
+    labelStreamer->SetReducer( reducer );
+    labelStreamer->Update();
+
     for( unsigned int n = 0; n < labels.size(); n++ )
       {
       std::ostringstream str;
       str << n;
 
       std::string outname = std::string( argv[3] ) + std::string( "" ) + str.str() + std::string( ".nii.gz" );
-      outputFilenames.push_back( outname );
-
-      typename ImageType::Pointer outImage = ImageType::New();
-      outImage->CopyInformation( images[0] );
-      outImage->SetRegions( images[0]->GetLargestPossibleRegion() );
-      outImage->Allocate();
-      outImage->FillBuffer( 0 );
-
-      outputImages.push_back( outImage );
-      }
-
-    RealType numberOfImages = static_cast<RealType>( filenames.size() );
-
-    std::vector<LabelType>::const_iterator it;
-    for( it = labels.begin(); it != labels.end(); ++it )
-      {
-      for( unsigned int n = 0; n < filenames.size(); n++ )
-        {
-        typedef itk::BinaryThresholdImageFilter<LabelImageType, ImageType> ThresholderType;
-        typename ThresholderType::Pointer thresholder = ThresholderType::New();
-        thresholder->SetInput( images[n] );
-        thresholder->SetLowerThreshold( *it );
-        thresholder->SetUpperThreshold( *it );
-        thresholder->SetInsideValue( 1.0 );
-        thresholder->SetOutsideValue( 0.0 );
-        thresholder->Update();
-
-        typedef itk::ImageDuplicator<ImageType> DuplicatorType;
-        typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-        duplicator->SetInputImage( outputImages[it - labels.begin()] );
-        duplicator->Update();
-
-        typedef itk::AddImageFilter<ImageType, ImageType, ImageType> AdderType;
-        typename AdderType::Pointer adder = AdderType::New();
-        adder->SetInput1( thresholder->GetOutput() );
-        adder->SetInput2( duplicator->GetOutput() );
-        adder->Update();
-
-        outputImages[it - labels.begin()] = adder->GetOutput();
-        outputImages[it - labels.begin()]->DisconnectPipeline();
-        }
-      itk::ImageRegionIterator<ImageType> It( outputImages[it - labels.begin()], outputImages[it - labels.begin()]->GetLargestPossibleRegion() );
-      for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-        {
-        It.Set( It.Get() / numberOfImages );
-        }
-      }
-
-    for( unsigned int n = 0; n < labels.size(); n++ )
-      {
-      typedef itk::ImageFileWriter<ImageType> WriterType;
-      typename WriterType::Pointer writer = WriterType::New();
-      writer->SetInput( outputImages[n] );
-      writer->SetFileName( outputFilenames[n] );
-      writer->Update();
+      WriteImage<ImageType>( reducer->GetOutput( n ), outname );
       }
     }
   else if( op.compare( std::string( "fft" ) ) == 0 )
     {
-    std::vector<typename ImageType::Pointer> images;
-    std::vector<typename ImageType::Pointer> outputImages;
-    std::vector<std::string> outputFilenames;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
-
     unsigned int numberOfImages = filenames.size();
 
     RealType exponent = vcl_ceil( vcl_log( static_cast<RealType>( numberOfImages ) ) / vcl_log( 2.0 ) );
     unsigned int paddedSize = static_cast<unsigned int>( vcl_pow( static_cast<RealType>( 2.0 ), exponent ) + 0.5 );
 
+    typedef FourierTransformReducer<ImageType> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    reducer->SetPaddedSize( paddedSize );
+
+    streamer->SetReducer( reducer );
+    streamer->Update();
+
     for( unsigned int n = 0; n < paddedSize; n++ )
       {
       std::string leadingZeros = std::string( 4, '0' );
@@ -838,52 +1153,7 @@ int MultipleOperateImages( int argc, char * argv[] )
         }
 
       std::string outname = std::string( argv[3] ) + std::string( "FT" ) + leadingZeros + std::string( ".nii.gz" );
-      outputFilenames.push_back( outname );
-
-      typename ImageType::Pointer outImage = ImageType::New();
-      outImage->CopyInformation( images[0] );
-      outImage->SetRegions( images[0]->GetLargestPossibleRegion() );
-      outImage->Allocate();
-      outImage->FillBuffer( 0 );
-
-      outputImages.push_back( outImage );
-      }
-
-    vnl_fft_1d<RealType> fft( paddedSize );
-
-    itk::ImageRegionIteratorWithIndex<ImageType> It( images[0],
-      images[0]->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-        {
-        vnl_vector< vcl_complex<RealType> > V( paddedSize, vcl_complex<RealType>( 0.0, 0.0 ) );
-
-        for( unsigned int n = 0; n < numberOfImages; n++ )
-          {
-          // Multiply intensity by Hann window
-          V[n] = images[n]->GetPixel( It.GetIndex() ) * 0.5 * ( 1 - vcl_cos( 2 * vnl_math::pi * n / ( paddedSize - 1 ) ) );
-          }
-        fft.fwd_transform( V );
-
-        for( unsigned int n = 0; n < paddedSize; n++ )
-          {
-          outputImages[n]->SetPixel( It.GetIndex(),  vcl_norm( V[n] ) );
-          }
-        }
-      else
-        {
-        It.Set( 0 );
-        }
-      }
-
-    for( unsigned int n = 0; n < paddedSize; n++ )
-      {
-      typedef itk::ImageFileWriter<ImageType> WriterType;
-      typename WriterType::Pointer writer = WriterType::New();
-      writer->SetInput( outputImages[n] );
-      writer->SetFileName( outputFilenames[n] );
-      writer->Update();
+      WriteImage<ImageType>( reducer->GetOutput( n ), outname );
       }
     }
   else if( op.compare( std::string( "concavity" ) ) == 0 )
@@ -894,150 +1164,57 @@ int MultipleOperateImages( int argc, char * argv[] )
       return EXIT_FAILURE;
       }
 
-    std::vector<typename ImageType::Pointer> images;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
-
-    itk::ImageRegionIteratorWithIndex<ImageType> It( images[0],
-      images[0]->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-        {
-        std::vector<RealType> intensities;
-        for( unsigned int n = 0; n < filenames.size(); n++ )
-          {
-          intensities.push_back( images[n]->GetPixel( It.GetIndex() ) );
-          }
+    typedef VoxelFunctionReducer<ImageType, ConcavityFunction> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    streamer->SetReducer( reducer );
+    streamer->Update();
 
-        float c = intensities[2] - 2 * intensities[1] + intensities[0];
-        It.Set( c );
-        }
-      else
-        {
-        It.Set( 0 );
-        }
-      }
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( images[0] );
-    writer->SetFileName( argv[3] );
-    writer->Update();
+    WriteImage<ImageType>( reducer->GetOutput(), argv[3] );
     }
   else if( op.compare( 0, 4, std::string( "corr", 0, 4 ) ) == 0 )
     {
-    std::vector<typename ImageType::Pointer> images;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
-
     std::string vectorString = op.substr( 5 );
 
-    std::vector<RealType> corrVector = ConvertVector<RealType>( vectorString );
+    CorrelationFunction correlation;
+    correlation.X = ConvertVector<RealType>( vectorString );
 
-    if( corrVector.size() != filenames.size() )
+    if( correlation.X.size() != filenames.size() )
       {
       std::cerr << "Error: the size of the specified correlation vector does not equal the number of images." << std::endl;
       return EXIT_FAILURE;
       }
 
-    itk::ImageRegionIteratorWithIndex<ImageType> It( images[0],
-      images[0]->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-        {
-        std::vector<RealType> intensities;
-        for( unsigned int n = 0; n < filenames.size(); n++ )
-          {
-          intensities.push_back( images[n]->GetPixel( It.GetIndex() ) );
-          }
-
-        RealType r = CalculatePearsonCoefficient( corrVector, intensities );
-        It.Set( r );
-        }
-      else
-        {
-        It.Set( 0 );
-        }
-      }
+    typedef VoxelFunctionReducer<ImageType, CorrelationFunction> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    reducer->SetFunction( correlation );
+    streamer->SetReducer( reducer );
+    streamer->Update();
 
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( images[0] );
-    writer->SetFileName( argv[3] );
-    writer->Update();
+    WriteImage<ImageType>( reducer->GetOutput(), argv[3] );
     }
   else if( op.compare( 0, 5, std::string( "slope", 0, 5 ) ) == 0 )
     {
-    std::vector<typename ImageType::Pointer> images;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
-
     std::string vectorString = op.substr( 6 );
 
-    std::vector<RealType> corrVector = ConvertVector<RealType>( vectorString );
+    SlopeFunction slope;
+    slope.X = ConvertVector<RealType>( vectorString );
 
-    std::vector<RealType> line;
-
-    if( corrVector.size() != filenames.size() )
+    if( slope.X.size() != filenames.size() )
       {
       std::cerr << "Error: the size of the specified correlation vector does not equal the number of images." << std::endl;
       return EXIT_FAILURE;
       }
 
-    itk::ImageRegionIteratorWithIndex<ImageType> It( images[0],
-      images[0]->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-        {
-        std::vector<RealType> intensities;
-        for( unsigned int n = 0; n < filenames.size(); n++ )
-          {
-          intensities.push_back( images[n]->GetPixel( It.GetIndex() ) );
-          }
-
-        line = FitRegressionLine( corrVector, intensities );
-        It.Set( line[0] );
-        }
-      else
-        {
-        It.Set( 0 );
-        }
-      }
+    typedef VoxelFunctionReducer<ImageType, SlopeFunction> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    reducer->SetFunction( slope );
+    streamer->SetReducer( reducer );
+    streamer->Update();
 
-    typedef itk::ImageFileWriter<ImageType> WriterType;
-    typename WriterType::Pointer writer = WriterType::New();
-    writer->SetInput( images[0] );
-    writer->SetFileName( argv[3] );
-    writer->Update();
+    WriteImage<ImageType>( reducer->GetOutput(), argv[3] );
     }
   else if( op.compare( std::string( "sample" ) ) == 0 )
     {
-    std::vector<typename ImageType::Pointer> images;
-    for( unsigned int n = 0; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
-      images.push_back( reader->GetOutput() );
-      }
-
     std::string sampleFilename = std::string( argv[3] ) +
       std::string( "Samples.csv" );
 
@@ -1054,83 +1231,30 @@ int MultipleOperateImages( int argc, char * argv[] )
       }
     str << filenames[filenames.size()-1] << std::endl;
 
-    itk::ImageRegionIteratorWithIndex<ImageType> It( images[0],
-      images[0]->GetLargestPossibleRegion() );
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-        {
-        for( unsigned int d = 0; d < ImageDimension-1; d++ )
-          {
-          str2 << It.GetIndex()[d] << ",";
-          }
-        str2 << It.GetIndex()[ImageDimension-1] << std::endl;
+    typedef SampleReducer<ImageType, LabelImageType> ReducerType;
+    typename ReducerType::Pointer reducer = ReducerType::New();
+    reducer->SetMaskImage( mask );
+    reducer->SetOutputStreams( &str, &str2 );
 
-        if( !mask )
-          {
-          str << "NA,";
-          }
-        else
-          {
-          str << mask->GetPixel( It.GetIndex() ) << ",";
-          }
-        for( unsigned int n = 0; n < images.size()-1; n++ )
-          {
-          str << images[n]->GetPixel( It.GetIndex() ) << ",";
-          }
-        str << images[images.size()-1]->GetPixel( It.GetIndex() ) << std::endl;
-        }
-      }
+    streamer->SetReducer( reducer );
+    streamer->Update();
     }
   else if( op.compare( 0, 6, std::string( "cohort", 0, 6 ) ) == 0 )
     {
-    typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName( filenames[0].c_str() );
-    reader->Update();
-
     std::string numberString = op.substr( 7 );
 
     unsigned int numberOfSubjects = Convert<unsigned int>( numberString );
 
-    typename ImageType::Pointer meanImage = reader->GetOutput();
-
-    float N = 1.0;
-
-    typename ImageType::Pointer variance = ImageType::New();
-    variance->SetOrigin( meanImage->GetOrigin() );
-    variance->SetSpacing( meanImage->GetSpacing() );
-    variance->SetRegions( meanImage->GetLargestPossibleRegion() );
-    variance->SetDirection( meanImage->GetDirection() );
-    variance->Allocate();
-    variance->FillBuffer( 0 );
-
-    for( unsigned int n = 1; n < filenames.size(); n++ )
-      {
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->SetFileName( filenames[n].c_str() );
-      reader->Update();
+    typename StatisticsReducerType::Pointer reducer = StatisticsReducerType::New();
+    reducer->SetUseStatistic( StatisticsReducerType::Variance, true );
 
-      N += 1.0;
+    streamer->SetReducer( reducer );
+    streamer->Update();
 
-      itk::ImageRegionIteratorWithIndex<ImageType> It( reader->GetOutput(),
-        reader->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItO( variance,
-        variance->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItM( meanImage,
-        meanImage->GetLargestPossibleRegion() );
-      for( It.GoToBegin(), ItO.GoToBegin(), ItM.GoToBegin(); !It.IsAtEnd(); ++It, ++ItO, ++ItM )
-        {
-        if( !mask || mask->GetPixel( It.GetIndex() ) != 0 )
-          {
-          ItM.Set( ItM.Get() * ( N - 1.0 ) / N + It.Get() / N );
-          if ( N > 1.0 )
-            {
-            ItO.Set( ItO.Get() * ( N - 1.0 )/N +
-              ( It.Get() - ItM.Get() )*( It.Get() - ItM.Get() ) / ( N - 1.0 ) );
-            }
-          }
-        }
-      }
+    typename ImageType::Pointer meanImage =
+      reducer->GetOutput( StatisticsReducerType::Mean );
+    typename ImageType::Pointer variance =
+      reducer->GetOutput( StatisticsReducerType::Variance );
 
     typedef typename itk::Statistics::MersenneTwisterRandomVariateGenerator RandomizerType;
     typename RandomizerType::Pointer randomizer = RandomizerType::New();
@@ -1171,11 +1295,7 @@ int MultipleOperateImages( int argc, char * argv[] )
       std::string subjectFilename = std::string( argv[3] ) + std::string( "Subject" ) +
          str.str() + std::string( ".nii.gz" );
 
-      typedef itk::ImageFileWriter<ImageType> WriterType;
-      typename WriterType::Pointer writer = WriterType::New();
-      writer->SetInput( output );
-      writer->SetFileName( subjectFilename.c_str() );
-      writer->Update();
+      WriteImage<ImageType>( output, subjectFilename );
       }
     }
   else if( op.compare( 0, 9, std::string( "normalize", 0, 9 ) ) == 0 )
@@ -1,16 +1,12 @@
-#include "itkImageDuplicator.h"
-#include "itkImageSeriesReader.h"
-#include "itkImageSeriesWriter.h"
-#include "itkImagePCAShapeModelEstimator.h"
-#include "itkImagePCADecompositionCalculator.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-
-#include "itkAddImageFilter.h"
+#include "itkImagePCAProjectionCalculator.h"
 #include "itkMultiplyImageFilter.h"
 #include "itkNumericSeriesFileNames.h"
+#include "itkStreamingImagePCAEstimator.h"
 
 #include <string>
+#include <vector>
 
 template <unsigned int ImageDimension>
 int CreatePCAImageDecompositionModel( int argc, char* argv[] )
@@ -18,24 +14,22 @@ int CreatePCAImageDecompositionModel( int argc, char* argv[] )
   typedef float PixelType;
   typedef itk::Image<PixelType, ImageDimension> ImageType;
 
-  typedef itk::ImagePCAShapeModelEstimator<ImageType, ImageType> ImagePCAType;
+  // The training images are streamed from disk, never all resident
+
+  typedef itk::StreamingImagePCAEstimator<ImageType> ImagePCAType;
   typename ImagePCAType::Pointer pca = ImagePCAType::New();
-  pca->SetNumberOfTrainingImages( argc - 4 );
-  pca->SetNumberOfPrincipalComponentsRequired( argc - 5 );
 
-  for( unsigned int n = 4; n < argc; n++ )
+  typename ImagePCAType::FileNameContainerType fileNames;
+  for( int n = 4; n < argc; n++ )
     {
-    std::cout << "Reading " << argv[n] << std::endl;
-    typedef itk::ImageFileReader<ImageType> ReaderType;
-    typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName( argv[n] );
-    reader->Update();
-
-    pca->SetInput( n-4, reader->GetOutput() );
+    fileNames.push_back( std::string( argv[n] ) );
     }
+  pca->SetFileNames( fileNames );
 
   try
     {
+    std::cout << "Computing the Gram matrix of " << fileNames.size()
+      << " images." << std::endl;
     pca->Update();
     }
   catch ( itk::ExceptionObject &ex )
@@ -44,26 +38,11 @@ int CreatePCAImageDecompositionModel( int argc, char* argv[] )
     return EXIT_FAILURE;
     }
 
-  std::string outputFormat = std::string( argv[2] );
-
-  itk::NumericSeriesFileNames::Pointer outputNames
-    = itk::NumericSeriesFileNames::New();
-  outputNames->SetSeriesFormat( outputFormat.c_str() );
-  outputNames->SetStartIndex( 0 );
-  outputNames->SetEndIndex( pca->GetNumberOfOutputs() );
-  outputNames->SetIncrementIndex( 1 );
-
-  // write out mean shape
-  typedef itk::ImageFileWriter<ImageType> WriterType;
-  typename WriterType::Pointer writer = WriterType::New();
-  writer->SetInput( pca->GetOutput() );
-  writer->SetFileName( ( outputNames->GetFileNames()[0] ).c_str() );
-  writer->Update();
-
   vnl_vector<double> eigenValues = pca->GetEigenValues();
   double eigenValueTotal = eigenValues.sum();
 
-  unsigned int numberOfOutputs = pca->GetNumberOfOutputs();
+  // At most N - 1 components have a nonzero eigen value
+  unsigned int numberOfOutputs = fileNames.size() - 1;
   float percentage = 0.0;
   if( atof( argv[3] ) < 1.0 )
     {
@@ -82,7 +61,8 @@ int CreatePCAImageDecompositionModel( int argc, char* argv[] )
     }
   else
     {
-    numberOfOutputs = atoi( argv[3] );
+    numberOfOutputs = vnl_math_min( numberOfOutputs,
+      static_cast<unsigned int>( atoi( argv[3] ) ) );
 
     double runningTotal = 0.0;
     for( unsigned int n = 0; n < numberOfOutputs; n++ )
@@ -96,6 +76,32 @@ int CreatePCAImageDecompositionModel( int argc, char* argv[] )
   std::cout << "Producing " << numberOfOutputs << " basis vectors (" << percentage * 100 << "%)." << std::endl;
   std::cout << "===========================================\n" << std::endl;
 
+  try
+    {
+    pca->GenerateBasisImages( numberOfOutputs );
+    }
+  catch ( itk::ExceptionObject &ex )
+    {
+    std::cout << ex;
+    return EXIT_FAILURE;
+    }
+
+  std::string outputFormat = std::string( argv[2] );
+
+  itk::NumericSeriesFileNames::Pointer outputNames
+    = itk::NumericSeriesFileNames::New();
+  outputNames->SetSeriesFormat( outputFormat.c_str() );
+  outputNames->SetStartIndex( 0 );
+  outputNames->SetEndIndex( numberOfOutputs );
+  outputNames->SetIncrementIndex( 1 );
+
+  // write out mean shape
+  typedef itk::ImageFileWriter<ImageType> WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( pca->GetMeanImage() );
+  writer->SetFileName( ( outputNames->GetFileNames()[0] ).c_str() );
+  writer->Update();
+
   double runningTotal = 0.0;
   for( unsigned int n = 0; n < numberOfOutputs; n++ )
     {
@@ -108,14 +114,14 @@ int CreatePCAImageDecompositionModel( int argc, char* argv[] )
     typedef itk::MultiplyImageFilter
       <ImageType,ImageType,ImageType> MultiplierType;
     typename MultiplierType::Pointer multiplier = MultiplierType::New();
-    multiplier->SetInput( pca->GetOutput( n ) );
+    multiplier->SetInput( pca->GetBasisImage( n ) );
     multiplier->SetConstant( vcl_sqrt( eigenValues[n] / eigenValues[0] ) );
     multiplier->Update();
 
     typedef itk::ImageFileWriter<ImageType> WriterType;
     typename WriterType::Pointer writer = WriterType::New();
     writer->SetInput( multiplier->GetOutput() );
-    writer->SetFileName( ( outputNames->GetFileNames()[n] ).c_str() );
+    writer->SetFileName( ( outputNames->GetFileNames()[n+1] ).c_str() );
     writer->Update();
     }
 
@@ -128,7 +134,7 @@ int PCADecomposeImage( int argc, char* argv[] )
   typedef float PixelType;
   typedef itk::Image<PixelType, ImageDimension> ImageType;
 
-  typedef itk::ImagePCADecompositionCalculator<ImageType, ImageType> PCAType;
+  typedef itk::ImagePCAProjectionCalculator<ImageType> PCAType;
   typename PCAType::Pointer pca = PCAType::New();
 
   typedef itk::ImageFileReader<ImageType> ReaderType;
@@ -136,8 +142,6 @@ int PCADecomposeImage( int argc, char* argv[] )
   reader->SetFileName( argv[2] );
   reader->Update();
 
-  pca->SetImage( reader->GetOutput() );
-
   typename ReaderType::Pointer meanImageReader = ReaderType::New();
   meanImageReader->SetFileName( argv[3] );
   meanImageReader->Update();
@@ -151,7 +155,7 @@ int PCADecomposeImage( int argc, char* argv[] )
   basisNames->SetEndIndex( atoi( argv[5] ) );
   basisNames->SetIncrementIndex( 1 );
 
-  typename PCAType::BasisImagePointerVector basisImages;
+  typename PCAType::BasisImageContainerType basisImages;
   for( unsigned int n = 0; n < ( basisNames->GetFileNames() ).size(); n++ )
     {
     typedef itk::ImageFileReader<ImageType> ReaderType;
@@ -163,38 +167,22 @@ int PCADecomposeImage( int argc, char* argv[] )
     }
 
   pca->SetBasisImages( basisImages );
-  pca->Compute();
-  typename PCAType::BasisVectorType projection = pca->GetProjection();
 
-  typedef typename itk::ImageDuplicator<ImageType> DuplicatorType;
-  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
-  duplicator->SetInputImage( meanImageReader->GetOutput() );
-  duplicator->Update();
-
-  typename ImageType::Pointer reconstructedImage = duplicator->GetOutput();
+  typename PCAType::VectorType projection;
+  try
+    {
+    projection = pca->Project( reader->GetOutput() );
+    }
+  catch ( itk::ExceptionObject &ex )
+    {
+    std::cout << ex;
+    return EXIT_FAILURE;
+    }
 
   if( argc > 6 )
     {
-    for( unsigned int n = 0; n < projection.size(); n++ )
-      {
-      typedef itk::MultiplyImageFilter<ImageType, ImageType, ImageType> MultiplierType;
-      typename MultiplierType::Pointer multiplier = MultiplierType::New();
-      multiplier->SetInput( basisImages[n] );
-      multiplier->SetConstant( projection[n] );
-      multiplier->Update();
-
-      typedef typename itk::AddImageFilter<ImageType, ImageType, ImageType> AdderType;
-      typename AdderType::Pointer adder = AdderType::New();
-      adder->SetInput1( reconstructedImage );
-      adder->SetInput2( multiplier->GetOutput() );
-      adder->Update();
-
-      typename DuplicatorType::Pointer duplicator2 = DuplicatorType::New();
-      duplicator2->SetInputImage( adder->GetOutput() );
-      duplicator2->Update();
-
-      reconstructedImage = duplicator2->GetOutput();
-      }
+    typename ImageType::Pointer reconstructedImage =
+      pca->Reconstruct( projection );
 
     typedef itk::ImageFileWriter<ImageType> WriterType;
     typename WriterType::Pointer writer = WriterType::New();
@@ -1,83 +1,15 @@
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 
-#include "itkAmoebaOptimizer.h"
-#include "itkImageRegionConstIteratorWithIndex.h"
-
-#include "vnl/vnl_vector.h"
-
-class amoebaCostFunction : public itk::SingleValuedCostFunction
-{
+#include "itkVoxelwiseModelFitter.h"
 
 //
 // We are solving the three parameter model (A, B, T1^*) at each
 // (x,y) voxel:
 //   S(x,y,t_n) = A(x,y) - B(x,y) \times \exp( -t_n / T1^*(x,y) )
 //
-
-public:
-  typedef amoebaCostFunction                    Self;
-  typedef itk::SingleValuedCostFunction         Superclass;
-  typedef itk::SmartPointer<Self>               Pointer;
-  typedef itk::SmartPointer<const Self>         ConstPointer;
-
-  itkNewMacro( Self );
-  itkTypeMacro( amoebaCostFunction, SingleValuedCostFunction );
-
-  typedef Superclass::ParametersType              ParametersType;
-  typedef Superclass::DerivativeType              DerivativeType;
-  typedef Superclass::MeasureType                 MeasureType;
-
-  typedef vnl_vector<double>                      VectorType;
-
-  enum { SpaceDimension = 3 };
-
-  amoebaCostFunction()
-    {
-    }
-
-  void SetConstants( VectorType inversionTimes, VectorType intensities )
-    {
-    if( intensities.size() != inversionTimes.size() )
-      {
-      itkExceptionMacro( "constant vectors aren't the same length." );
-      }
-
-    this->m_InversionTimes = inversionTimes;
-    this->m_Intensities = intensities;
-    }
-
-  double GetValue( const ParametersType & parameters ) const
-    {
-    double A = parameters[0];
-    double B = parameters[1];
-    double T1 = parameters[2];
-
-    double val = 0.0;
-    for( unsigned int n = 0; n < this->m_Intensities.size(); n++ )
-      {
-      val += vnl_math_abs( this->m_Intensities[n] - ( A - B * vcl_exp( -this->m_InversionTimes[n] / T1 ) ) );
-      }
-
-    return val;
-    }
-
-  void GetDerivative( const ParametersType & parameters,
-                            DerivativeType & derivative ) const
-    {
-    itkExceptionMacro( "Not implemented." );
-    }
-
-  unsigned int GetNumberOfParameters(void) const
-    {
-    return SpaceDimension;
-    }
-
-private:
-
-   VectorType               m_InversionTimes;
-   VectorType               m_Intensities;
-};
+// by minimizing the sum of the absolute residuals.
+//
 
 int main( int argc, char *argv[] )
 {
@@ -86,142 +18,57 @@ int main( int argc, char *argv[] )
     std::cout
       << argv[0] << " outputImagePrefix inputImage1 inversionTime1 "
       << "inputImage2 inversionTime2 ... inputImageN inversionTimeN "
-      << std::endl;
+      << "[maskImage]" << std::endl;
     exit( 1 );
     }
 
   typedef float PixelType;
   typedef itk::Image<PixelType, 2> ImageType;
+  typedef itk::Image<unsigned char, 2> MaskImageType;
 
-  typedef itk::AmoebaOptimizer OptimizerType;
-  OptimizerType::Pointer optimizer = OptimizerType::New();
-  optimizer->SetMaximumNumberOfIterations( 1000 );
-  optimizer->SetParametersConvergenceTolerance( 0.01 );
-  optimizer->SetFunctionConvergenceTolerance( 0.001 );
-
-  std::vector<ImageType::Pointer> inputImages;
-  std::vector<float> itimes;
+  typedef itk::VoxelwiseModelFitter<itk::InversionRecoveryModel, ImageType,
+    MaskImageType> FitterType;
+  FitterType::Pointer fitter = FitterType::New();
+  fitter->SetUseLeastAbsoluteDeviations( true );
 
-  for( unsigned int n = 2; n < argc; n+=2 )
+  int n = 2;
+  for( ; n + 1 < argc; n+=2 )
     {
     typedef itk::ImageFileReader<ImageType> ReaderType;
     ReaderType::Pointer reader = ReaderType::New();
     reader->SetFileName( argv[n] );
     reader->Update();
 
-    inputImages.push_back( reader->GetOutput() );
-    itimes.push_back( atof( argv[n+1] ) );
+    fitter->AddInput( reader->GetOutput(), atof( argv[n+1] ) );
     }
 
-//  if( itimes.size() != inputImages.size() )
-//    {
-//    itkExceptionMacro( "Number of inversion times does not match number of images." );
-//    }
-
-  ImageType::Pointer A = ImageType::New();
-  A->CopyInformation( inputImages[0] );
-  A->SetRegions( inputImages[0]->GetLargestPossibleRegion() );
-  A->Allocate();
-  A->FillBuffer( 0.0 );
-
-  ImageType::Pointer B = ImageType::New();
-  B->CopyInformation( inputImages[0] );
-  B->SetRegions( inputImages[0]->GetLargestPossibleRegion() );
-  B->Allocate();
-  B->FillBuffer( 0.0 );
-
-  ImageType::Pointer T1 = ImageType::New();
-  T1->CopyInformation( inputImages[0] );
-  T1->SetRegions( inputImages[0]->GetLargestPossibleRegion() );
-  T1->Allocate();
-  T1->FillBuffer( 0.0 );
-
-  amoebaCostFunction::VectorType inversionTimes;
-  inversionTimes.set_size( itimes.size() );
-
-  amoebaCostFunction::VectorType intensities;
-  intensities.set_size( itimes.size() );
+  // An odd argument left over is the mask
+  if( n < argc )
+    {
+    typedef itk::ImageFileReader<MaskImageType> MaskReaderType;
+    MaskReaderType::Pointer maskReader = MaskReaderType::New();
+    maskReader->SetFileName( argv[n] );
+    maskReader->Update();
 
-  float maxInversionTime = itimes[0];
-  unsigned int max_n = 0;
+    fitter->SetMaskImage( maskReader->GetOutput() );
+    }
 
-  for( unsigned int n = 0; n < itimes.size(); n++ )
+  try
     {
-    inversionTimes[n] = itimes[n];
-    if( itimes[n] > maxInversionTime )
-      {
-      max_n = n;
-      maxInversionTime = itimes[n];
-      }
+    fitter->Update();
     }
-
-  typedef amoebaCostFunction::VectorType VectorType;
-  amoebaCostFunction::Pointer costFunction = amoebaCostFunction::New();
-
-  optimizer->SetCostFunction( costFunction.GetPointer() );
-
-//   std::ofstream str( "nickSamples.txt" );
-
-  itk::ImageRegionConstIteratorWithIndex<ImageType> It( inputImages[0], inputImages[0]->GetLargestPossibleRegion() );
-  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+  catch( itk::ExceptionObject & e )
     {
-    ImageType::IndexType index = It.GetIndex();
-
-    unsigned int min_n = 0;
-    float min_intensity = itk::NumericTraits<float>::max();
-    for( unsigned int n = 0; n < inputImages.size(); n++ )
-      {
-      intensities[n] = inputImages[n]->GetPixel( index );
-      if( vnl_math_abs( intensities[n] ) < min_intensity )
-        {
-        min_intensity = vnl_math_abs( intensities[n] );
-        min_n = n;
-        }
-      }
-    costFunction->SetConstants( inversionTimes, intensities );
-
-    OptimizerType::ParametersType initialPosition( 3 );
-    initialPosition[0] = intensities[max_n];
-    initialPosition[1] = 2 * initialPosition[0];
-    initialPosition[2] = inversionTimes[min_n] / vnl_math::ln2;
-
-    optimizer->SetInitialPosition( initialPosition );
-
-    try
-      {
-      optimizer->StartOptimization();
-
-//      std::cout << optimizer->GetStopConditionDescription() << std::endl;
-      }
-    catch( itk::ExceptionObject & e )
-      {
-      std::cerr << "Exception thrown ! " << std::endl;
-      std::cerr << "An error ocurred during Optimization" << std::endl;
-      std::cerr << "Location    = " << e.GetLocation()    << std::endl;
-      std::cerr << "Description = " << e.GetDescription() << std::endl;
-      std::cerr <<"[TEST 1 FAILURE]\n";
-      return EXIT_FAILURE;
-      }
-
-    OptimizerType::ParametersType currentPosition = optimizer->GetCurrentPosition();
-
-    A->SetPixel( index, currentPosition[0] );
-    B->SetPixel( index, currentPosition[1] );
-    T1->SetPixel( index, currentPosition[2] );
-
-//     if( vnl_math_abs( intensities[0] ) > 0.0 )
-//       {
-//       str << currentPosition[0] << "," << currentPosition[1] << "," << currentPosition[2] << ",";
-//       for( unsigned int q = 0; q < intensities.size()-1; q++ )
-//         {
-//         str << intensities[q] << ",";
-//         }
-//       str << intensities[intensities.size()-1] << std::endl;
-//       }
+    std::cerr << "Exception thrown ! " << std::endl;
+    std::cerr << "An error ocurred during the fit" << std::endl;
+    std::cerr << "Location    = " << e.GetLocation()    << std::endl;
+    std::cerr << "Description = " << e.GetDescription() << std::endl;
+    return EXIT_FAILURE;
     }
-//   str.close();
 
-//   exit( 0 );
+  ImageType::Pointer A = fitter->GetParameterImage( 0 );
+  ImageType::Pointer B = fitter->GetParameterImage( 1 );
+  ImageType::Pointer T1 = fitter->GetParameterImage( 2 );
 
   std::string filenameA = std::string( argv[1] ) + std::string( "A.nii.gz" );
   std::string filenameB = std::string( argv[1] ) + std::string( "B.nii.gz" );